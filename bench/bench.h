@@ -0,0 +1,71 @@
+/*++
+
+Module Name:
+
+    bench.h
+
+Abstract:
+
+    Shared helpers for the frame-pipeline benchmarks.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Bench
+{
+    struct Resolution
+    {
+        const char* Name;
+        uint32_t Width;
+        uint32_t Height;
+    };
+
+    // 1080p, 1440p and 4K: the modes every benchmark reports on
+    extern const Resolution StandardResolutions[3];
+
+    // Returns the value following "--Name" on the command line, or Default if the option is absent
+    uint64_t ParseOption(int argc, char* argv[], const char* Name, uint64_t Default);
+
+    // Returns the P-th percentile (0..100) of Samples; reorders Samples
+    double Percentile(std::vector<double>& Samples, double P);
+
+    // Returns the CPU time consumed by the whole process so far [s]
+    double ProcessCpuSeconds();
+
+    // Returns the monotonic wall-clock time [s]
+    double WallSeconds();
+}
+
+// Entry points of the individual benchmarks, dispatched by name from bench.cpp
+int BenchPipeline(int argc, char* argv[]);
+int BenchSpsc(int argc, char* argv[]);
+int BenchPool(int argc, char* argv[]);
+int BenchConvert(int argc, char* argv[]);
+int BenchTiles(int argc, char* argv[]);
+int BenchDamage(int argc, char* argv[]);
+int BenchRegion(int argc, char* argv[]);
+int BenchMotion(int argc, char* argv[]);
+int BenchCodec(int argc, char* argv[]);
+int BenchMonitors(int argc, char* argv[]);
+int BenchPacing(int argc, char* argv[]);
+int BenchVsync(int argc, char* argv[]);
+int BenchTimings(int argc, char* argv[]);
+int BenchLog(int argc, char* argv[]);
+int BenchTrace(int argc, char* argv[]);
+int BenchMetrics(int argc, char* argv[]);
+int BenchStats(int argc, char* argv[]);
+int BenchExport(int argc, char* argv[]);
+int BenchClient(int argc, char* argv[]);
+int BenchBackpressure(int argc, char* argv[]);
+int BenchFanOut(int argc, char* argv[]);
+int BenchFormats(int argc, char* argv[]);
+int BenchScale(int argc, char* argv[]);
+int BenchTransform(int argc, char* argv[]);
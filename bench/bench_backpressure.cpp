@@ -0,0 +1,368 @@
+/*++
+
+Module Name:
+
+    bench_backpressure.cpp
+
+Abstract:
+
+    Checks and measures the backpressure sink. First a producer that repaints random rectangles and moves blocks
+    around feeds a consumer that is sometimes slow, under every policy, and the consumer rebuilds its image from the
+    damage of the frames it receives alone. Every frame it receives must match the checksum of what was produced,
+    both as delivered and as rebuilt, so damage merged forward from dropped frames is proven complete; the counters
+    must account for every frame. Then a paced simulated swap-chain runs through a pipeline into a consumer that
+    needs longer per frame than the refresh interval, and the table compares what each policy delivered, dropped
+    and skipped and the end-to-end latency from acquisition to the consumer.
+
+    Options: --frames N (default 3000, exactness), --seconds N (default 2, per policy), --consumer-us N (default
+    25000, per frame of the slow consumer)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/backpressure.h"
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint32_t Width = 320;
+    const uint32_t Height = 180;
+    const double FramesPerSecond = 60;
+
+    const BackpressurePolicy Policies[] = { BackpressurePolicy::LatestWins, BackpressurePolicy::DropOldest, BackpressurePolicy::Block };
+
+    uint64_t Checksum(const uint8_t* pPixels, uint32_t Pitch)
+    {
+        uint64_t Hash = 14695981039346656037ull;
+        for (uint32_t Y = 0; Y < Height; Y++)
+        {
+            const uint32_t* pRow = reinterpret_cast<const uint32_t*>(pPixels + static_cast<size_t>(Y) * Pitch);
+            for (uint32_t X = 0; X < Width; X++)
+            {
+                Hash = (Hash ^ pRow[X]) * 1099511628211ull;
+            }
+        }
+        return Hash;
+    }
+
+    Rect RandomRect(mt19937& Random)
+    {
+        int32_t Left = static_cast<int32_t>(Random() % Width);
+        int32_t Top = static_cast<int32_t>(Random() % Height);
+        int32_t Right = min<int32_t>(Width, Left + 1 + static_cast<int32_t>(Random() % 64));
+        int32_t Bottom = min<int32_t>(Height, Top + 1 + static_cast<int32_t>(Random() % 64));
+        return { Left, Top, Right, Bottom };
+    }
+
+    // Copies the rectangle Area of one Width-pitched BGRA image to the same place in another
+    void CopyRect(uint32_t* pDestination, const uint32_t* pSource, uint32_t SourcePitch, const Rect& Area)
+    {
+        for (int32_t Y = Area.Top; Y < Area.Bottom; Y++)
+        {
+            memcpy(pDestination + static_cast<size_t>(Y) * Width + Area.Left,
+                reinterpret_cast<const uint8_t*>(pSource) + static_cast<size_t>(Y) * SourcePitch + Area.Left * 4,
+                (Area.Right - Area.Left) * 4);
+        }
+    }
+
+    /// <summary>
+    /// A consumer that redraws only the damage of each frame, and checks what it ends up with.
+    /// </summary>
+    class MirrorConsumer : public IFrameSink
+    {
+    public:
+        MirrorConsumer(const vector<uint64_t>& Checksums)
+            : m_Checksums(Checksums), m_Random(7), m_Image(static_cast<size_t>(Width) * Height), m_Started(false)
+        {
+        }
+
+        void Consume(const Frame& Frame) override
+        {
+            uint64_t Expected = m_Checksums[Frame.FrameNumber];
+            WrongPixels += Checksum(Frame.pData, Frame.Pitch) != Expected ? 1 : 0;
+            OutOfOrder += Frame.FrameNumber <= LastFrame ? 1 : 0;
+            LastFrame = Frame.FrameNumber;
+
+            if (Frame.Damage != DamageState::Partial || !m_Started)
+            {
+                CopyRect(m_Image.data(), reinterpret_cast<const uint32_t*>(Frame.pData), Frame.Pitch,
+                    { 0, 0, static_cast<int32_t>(Width), static_cast<int32_t>(Height) });
+                m_Started = true;
+            }
+            else
+            {
+                // Moves read the previous image, so take them from a copy of it
+                if (Frame.MoveRectCount != 0)
+                {
+                    m_Previous = m_Image;
+                }
+                for (uint32_t i = 0; i < Frame.MoveRectCount; i++)
+                {
+                    const MoveRect& Move = Frame.pMoveRects[i];
+                    const Rect& Target = Move.Destination;
+                    for (int32_t Y = Target.Top; Y < Target.Bottom; Y++)
+                    {
+                        memcpy(&m_Image[static_cast<size_t>(Y) * Width + Target.Left],
+                            &m_Previous[static_cast<size_t>(Move.SourceY + Y - Target.Top) * Width + Move.SourceX],
+                            (Target.Right - Target.Left) * 4);
+                    }
+                }
+                for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+                {
+                    CopyRect(m_Image.data(), reinterpret_cast<const uint32_t*>(Frame.pData), Frame.Pitch, Frame.pDirtyRects[i]);
+                }
+                Partial++;
+            }
+            WrongDamage += Checksum(reinterpret_cast<const uint8_t*>(m_Image.data()), Width * 4) != Expected ? 1 : 0;
+            Received++;
+
+            // Fall behind now and then
+            if (m_Random() % 4 == 0)
+            {
+                this_thread::sleep_for(chrono::microseconds(m_Random() % 400));
+            }
+        }
+
+        uint64_t Received = 0;
+        uint64_t Partial = 0;
+        uint64_t LastFrame = 0;
+        uint64_t OutOfOrder = 0;
+        uint64_t WrongPixels = 0;
+        uint64_t WrongDamage = 0;
+
+    private:
+        const vector<uint64_t>& m_Checksums;
+        mt19937 m_Random;
+        vector<uint32_t> m_Image;
+        vector<uint32_t> m_Previous;
+        bool m_Started;
+    };
+
+    int CheckExactness(BackpressurePolicy Policy, uint64_t Frames)
+    {
+        vector<uint64_t> Checksums(Frames + 1);
+        auto Consumer = make_shared<MirrorConsumer>(Checksums);
+        auto Pool = make_shared<FrameBufferPool>(false, 8);
+
+        // With a block timeout of 0 the producer gives up on a frame as soon as the queue is full
+        BackpressureSink Sink(Consumer, Policy, 3, 0);
+
+        mt19937 Random(21);
+        vector<uint32_t> Image(static_cast<size_t>(Width) * Height);
+        vector<Rect> Dirty;
+        vector<MoveRect> Moves;
+
+        for (uint64_t Number = 1; Number <= Frames; Number++)
+        {
+            Frame Frame = {};
+            Dirty.clear();
+            Moves.clear();
+
+            if (Number == 1 || Number % 211 == 0)
+            {
+                for (size_t i = 0; i < Image.size(); i++)
+                {
+                    Image[i] = static_cast<uint32_t>(Number * 2654435761u + i);
+                }
+                Frame.Damage = DamageState::Full;
+            }
+            else
+            {
+                if (Number % 3 == 0)
+                {
+                    Rect Target = RandomRect(Random);
+                    int32_t SourceX = static_cast<int32_t>(Random() % (Width - (Target.Right - Target.Left) + 1));
+                    int32_t SourceY = static_cast<int32_t>(Random() % (Height - (Target.Bottom - Target.Top) + 1));
+                    vector<uint32_t> Previous = Image;
+                    for (int32_t Y = Target.Top; Y < Target.Bottom; Y++)
+                    {
+                        memcpy(&Image[static_cast<size_t>(Y) * Width + Target.Left],
+                            &Previous[static_cast<size_t>(SourceY + Y - Target.Top) * Width + SourceX], (Target.Right - Target.Left) * 4);
+                    }
+                    Moves.push_back({ SourceX, SourceY, Target });
+                }
+
+                Region Painted;
+                uint32_t Count = 1 + Random() % 3;
+                for (uint32_t i = 0; i < Count; i++)
+                {
+                    Painted.Union(RandomRect(Random));
+                }
+                for (const Rect& Area : Painted)
+                {
+                    for (int32_t Y = Area.Top; Y < Area.Bottom; Y++)
+                    {
+                        for (int32_t X = Area.Left; X < Area.Right; X++)
+                        {
+                            Image[static_cast<size_t>(Y) * Width + X] = static_cast<uint32_t>(Number * 40503u + X * 7 + Y);
+                        }
+                    }
+                    Dirty.push_back(Area);
+                }
+                Frame.Damage = DamageState::Partial;
+            }
+
+            Frame.FrameNumber = Number;
+            Frame.Width = Width;
+            Frame.Height = Height;
+            Frame.Pitch = Width * 4;
+            Frame.Format = PixelFormat::Bgra8;
+            Frame.pData = reinterpret_cast<uint8_t*>(Image.data());
+            Frame.DirtyRectCount = static_cast<uint32_t>(Dirty.size());
+            Frame.pDirtyRects = Dirty.data();
+            Frame.MoveRectCount = static_cast<uint32_t>(Moves.size());
+            Frame.pMoveRects = Moves.data();
+            Checksums[Number] = Checksum(Frame.pData, Frame.Pitch);
+
+            // Every other frame arrives in a pooled buffer, as from an asynchronous pipeline, and is queued without
+            // a copy
+            FrameBufferRef Buffer;
+            if (Number % 2 == 0)
+            {
+                Buffer = Pool->Acquire({ Width, Height, PixelFormat::Bgra8 });
+                for (uint32_t Y = 0; Y < Height; Y++)
+                {
+                    memcpy(Buffer->Data() + static_cast<size_t>(Y) * Buffer->Pitch(), &Image[static_cast<size_t>(Y) * Width], Width * 4);
+                }
+                Frame.pData = Buffer->Data();
+                Frame.Pitch = Buffer->Pitch();
+                Frame.pBuffer = Buffer.Get();
+            }
+
+            Sink.Consume(Frame);
+
+            if (Number % 4 != 0)
+            {
+                this_thread::sleep_for(chrono::microseconds(50));
+            }
+        }
+
+        Sink.Stop();
+
+        BackpressureStatistics Statistics = Sink.Statistics();
+        printf("%-12s %8llu %8llu %8llu %8llu %8llu %8llu %8llu %8llu %8llu\n", BackpressurePolicyName(Policy),
+            static_cast<unsigned long long>(Frames), static_cast<unsigned long long>(Statistics.FramesDelivered),
+            static_cast<unsigned long long>(Statistics.FramesDropped), static_cast<unsigned long long>(Statistics.FramesRejected),
+            static_cast<unsigned long long>(Statistics.FramesCopied), static_cast<unsigned long long>(Statistics.DamageMerges),
+            static_cast<unsigned long long>(Consumer->Partial), static_cast<unsigned long long>(Consumer->WrongPixels),
+            static_cast<unsigned long long>(Consumer->WrongDamage));
+
+        bool Accounted = Statistics.FramesAccepted + Statistics.FramesRejected == Frames &&
+            Statistics.FramesDelivered + Statistics.FramesDropped == Statistics.FramesAccepted &&
+            Statistics.FramesDelivered == Consumer->Received && Consumer->LastFrame == Frames;
+        bool PolicyHeld = Policy == BackpressurePolicy::Block ? Statistics.FramesDropped == 0 : Statistics.FramesRejected == 0;
+        bool Merged = Statistics.FramesDropped + Statistics.FramesRejected == 0 || Statistics.DamageMerges != 0;
+        bool ZeroCopy = Statistics.FramesCopied != 0 && Statistics.FramesCopied < Statistics.FramesAccepted;
+
+        if (Consumer->WrongPixels != 0 || Consumer->WrongDamage != 0 || Consumer->OutOfOrder != 0 || Consumer->Partial == 0 ||
+            !Accounted || !PolicyHeld || !Merged || !ZeroCopy || Pool->Statistics().OutstandingBuffers != 0)
+        {
+            printf("  FAILED: %s exactness (accounted %d, policy held %d, merged %d, zero copy %d, out of order %llu)\n",
+                BackpressurePolicyName(Policy), Accounted, PolicyHeld, Merged, ZeroCopy,
+                static_cast<unsigned long long>(Consumer->OutOfOrder));
+            return 1;
+        }
+        return 0;
+    }
+
+    /// <summary>
+    /// A consumer that needs a fixed time per frame, e.g. a software encoder that cannot keep up.
+    /// </summary>
+    class SlowConsumer : public IFrameSink
+    {
+    public:
+        explicit SlowConsumer(uint64_t CostUs) : m_CostUs(CostUs) {}
+
+        void Consume(const Frame& Frame) override
+        {
+            Latency.push_back((MonotonicNanoseconds() - Frame.AcquireTime) / 1e6);
+            this_thread::sleep_for(chrono::microseconds(m_CostUs));
+        }
+
+        vector<double> Latency;
+
+    private:
+        uint64_t m_CostUs;
+    };
+
+    int MeasureLatency(BackpressurePolicy Policy, double Seconds, uint64_t CostUs)
+    {
+        const Bench::Resolution& Mode = Bench::StandardResolutions[0];
+        auto Consumer = make_shared<SlowConsumer>(CostUs);
+        auto Pool = make_shared<FrameBufferPool>(false, 8);
+        auto Sink = make_shared<BackpressureSink>(Consumer, Policy, 3, 20);
+
+        uint64_t Frames = static_cast<uint64_t>(Seconds * FramesPerSecond);
+        SimulatedSwapChain SwapChain(Mode.Width, Mode.Height, FramesPerSecond, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.SetSink(Sink);
+        Pipeline.SetAsyncProcessing(3);
+        Pipeline.SetBufferPool(Pool);
+        Pipeline.RunCore();
+        Sink->Stop();
+
+        BackpressureStatistics Statistics = Sink->Statistics();
+        LatencySummary Queue = Sink->QueueDelay().Summarize();
+        size_t Delivered = Consumer->Latency.size();
+        printf("%-12s %8llu %8llu %8llu %8llu %8llu %8llu %10.2f %10.2f %10.2f %10.1f\n", BackpressurePolicyName(Policy),
+            static_cast<unsigned long long>(Pipeline.Statistics().FramesAcquired), static_cast<unsigned long long>(Delivered),
+            static_cast<unsigned long long>(Statistics.FramesDropped), static_cast<unsigned long long>(Statistics.FramesRejected),
+            static_cast<unsigned long long>(Pipeline.Statistics().FramesOverrun), static_cast<unsigned long long>(Statistics.DamageMerges),
+            Queue.P50 / 1e6, Delivered ? Bench::Percentile(Consumer->Latency, 50) : 0,
+            Delivered ? Bench::Percentile(Consumer->Latency, 99) : 0, Statistics.BlockedTime / 1e6);
+
+        if (Delivered == 0 || Statistics.FramesCopied != 0 || Statistics.FramesDelivered != Delivered ||
+            Statistics.FramesDelivered + Statistics.FramesDropped != Statistics.FramesAccepted)
+        {
+            printf("  FAILED: %s with a slow consumer (copied %llu)\n", BackpressurePolicyName(Policy),
+                static_cast<unsigned long long>(Statistics.FramesCopied));
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int BenchBackpressure(int argc, char* argv[])
+{
+    uint64_t Frames = max<uint64_t>(16, Bench::ParseOption(argc, argv, "frames", 3000));
+    double Seconds = static_cast<double>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "seconds", 2)));
+    uint64_t CostUs = Bench::ParseOption(argc, argv, "consumer-us", 25000);
+
+    printf("exactness: a sometimes slow consumer redrawing damage only, %ux%u\n", Width, Height);
+    printf("%-12s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "policy", "frames", "deliver", "dropped", "rejected", "copied",
+        "merges", "partial", "bad pix", "bad dmg");
+    int Failures = 0;
+    for (BackpressurePolicy Policy : Policies)
+    {
+        Failures |= CheckExactness(Policy, Frames);
+    }
+
+    printf("\npaced %.0f fps 1080p swap-chain into a consumer taking %.1f ms per frame [ms]\n", FramesPerSecond, CostUs / 1e3);
+    printf("%-12s %8s %8s %8s %8s %8s %8s %10s %10s %10s %10s\n", "policy", "acquired", "deliver", "dropped", "rejected",
+        "overrun", "merges", "queue p50", "e2e p50", "e2e p99", "blocked");
+    for (BackpressurePolicy Policy : Policies)
+    {
+        Failures |= MeasureLatency(Policy, Seconds, CostUs);
+    }
+
+    printf("\nbackpressure: %s\n", Failures == 0 ? "exact" : "FAILED");
+    return Failures;
+}
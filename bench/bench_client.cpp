@@ -0,0 +1,486 @@
+/*++
+
+Module Name:
+
+    bench_client.cpp
+
+Abstract:
+
+    Checks and measures the frame client library. First drives a FrameClient over an in-process loopback transport
+    to check that views give their frame back exactly once, that a second view is refused while one is held, and
+    that skipped frames and only real timeouts are counted, and has a second writer take a region over from under
+    a connected client to check that the client moves to it. An I420 frame padded to a wider pitch is then taken
+    through the C interface and rebuilt from the plane layout its header documents. Then stands in for the driver
+    with a paced simulated swap-chain whose frames are exported into a local region, and reads it with three
+    clients at once: one blocked in WaitFrame, one polling TryFrame, and one receiving frames in a callback through
+    the C interface. Each checks that sequence numbers only grow, that dirty rectangles lie inside the frame and
+    that it accounted for every frame published, and the table reports how long after publishing each style got to
+    see a frame.
+
+    Options: --seconds N (default 2)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../client/frame_client.h"
+#include "../client/idd_client.h"
+#include "../pipeline/color_convert.h"
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const char* const RegionName = "Local\\WinVirtualDisplayClientBench";
+    const double FramesPerSecond = 60;
+
+    /// <summary>
+    /// Hands out frames queued by the benchmark, keeping count of what was taken and given back.
+    /// </summary>
+    class LoopbackTransport : public IFrameTransport
+    {
+    public:
+        LoopbackTransport() : m_Sequence(0), m_LastTaken(0), m_Held(false), m_Acquired(0), m_Released(0), m_Pixel(0), m_EmptyWake(false) {}
+
+        void Publish()
+        {
+            m_Sequence++;
+        }
+
+        // Makes the next wait succeed without a frame, as when one is gone again before the client takes it
+        void WakeEmpty()
+        {
+            m_EmptyWake = true;
+        }
+
+        bool Acquire(ClientFrame& Frame) override
+        {
+            if (m_Sequence == m_LastTaken)
+            {
+                return false;
+            }
+
+            Frame = {};
+            Frame.pPixels = reinterpret_cast<const uint8_t*>(&m_Pixel);
+            Frame.Width = 1;
+            Frame.Height = 1;
+            Frame.Pitch = 4;
+            Frame.Format = PixelFormat::Bgra8;
+            Frame.Sequence = m_Sequence;
+            Frame.Missed = m_LastTaken != 0 ? m_Sequence - m_LastTaken - 1 : 0;
+            Frame.Damage = DamageState::Full;
+
+            m_LastTaken = m_Sequence;
+            m_Held = true;
+            m_Acquired++;
+            return true;
+        }
+
+        void Release() override
+        {
+            m_Held = false;
+            m_Released++;
+        }
+
+        bool Wait(uint32_t TimeoutMs) override
+        {
+            (void)TimeoutMs;
+            bool Woken = m_EmptyWake || m_Sequence != m_LastTaken;
+            m_EmptyWake = false;
+            return Woken;
+        }
+
+        bool Held() const { return m_Held; }
+        uint64_t Acquired() const { return m_Acquired; }
+        uint64_t Released() const { return m_Released; }
+
+    private:
+        uint64_t m_Sequence;
+        uint64_t m_LastTaken;
+        bool m_Held;
+        uint64_t m_Acquired;
+        uint64_t m_Released;
+        uint32_t m_Pixel;
+        bool m_EmptyWake;
+    };
+
+    int CheckLoopback()
+    {
+        LoopbackTransport* pTransport = new LoopbackTransport();
+        FrameClient Client{ unique_ptr<IFrameTransport>(pTransport) };
+        int Failures = 0;
+
+        bool NothingYet = !Client.TryFrame() && !Client.WaitFrame(0);
+        pTransport->WakeEmpty();
+        NothingYet = NothingYet && !Client.WaitFrame(0);
+
+        pTransport->Publish();
+        bool Refused, HeldWhileViewed;
+        {
+            FrameView View = Client.TryFrame();
+            pTransport->Publish();
+            Refused = View && !Client.TryFrame() && !Client.WaitFrame(0);
+
+            // Moving the view hands over the frame without giving it back
+            FrameView Moved = move(View);
+            HeldWhileViewed = !View && Moved && pTransport->Held() && pTransport->Released() == 0;
+        }
+        bool ReleasedOnce = !pTransport->Held() && pTransport->Released() == 1;
+
+        // Frame 2 is still new; publish three more before the client asks again, and it gets only the newest
+        pTransport->Publish();
+        pTransport->Publish();
+        pTransport->Publish();
+        uint64_t Sequence = 0, Missed = 0;
+        {
+            FrameView View = Client.WaitFrame(0);
+            if (View)
+            {
+                Sequence = View.Frame().Sequence;
+                Missed = View.Frame().Missed;
+            }
+            View.Reset();
+            View.Reset();
+        }
+
+        ClientStatistics Statistics = Client.Statistics();
+        printf("loopback: %llu received, %llu missed (longest run %llu), %llu timeouts, %llu refused; %llu acquired, "
+            "%llu released\n",
+            static_cast<unsigned long long>(Statistics.FramesReceived), static_cast<unsigned long long>(Statistics.FramesMissed),
+            static_cast<unsigned long long>(Statistics.LongestMiss), static_cast<unsigned long long>(Statistics.WaitTimeouts),
+            static_cast<unsigned long long>(Statistics.Refused), static_cast<unsigned long long>(pTransport->Acquired()),
+            static_cast<unsigned long long>(pTransport->Released()));
+
+        if (!NothingYet || !Refused || !HeldWhileViewed || !ReleasedOnce || Sequence != 5 || Missed != 3 ||
+            Statistics.FramesReceived != 2 || Statistics.FramesMissed != 3 || Statistics.LongestMiss != 3 ||
+            Statistics.WaitTimeouts != 1 || Statistics.Refused != 2 || pTransport->Released() != pTransport->Acquired())
+        {
+            printf("  FAILED: loopback (nothing yet %d, refused %d, held %d, released once %d, sequence %llu)\n",
+                NothingYet, Refused, HeldWhileViewed, ReleasedOnce, static_cast<unsigned long long>(Sequence));
+            Failures = 1;
+        }
+        return Failures;
+    }
+
+    // A driver that restarts while a client is connected takes the region over. The client's wait ends when the
+    // old writer goes, it opens the region again and gets the new writer's frames, starting with a whole one.
+    int CheckRestart()
+    {
+        const uint32_t Width = 64, Height = 64;
+        vector<uint32_t> Image(static_cast<size_t>(Width) * Height, 1u);
+        Frame Frame = {};
+        Frame.Width = Width;
+        Frame.Height = Height;
+        Frame.Pitch = Width * 4;
+        Frame.Format = PixelFormat::Bgra8;
+        Frame.Damage = DamageState::Full;
+        Frame.pData = reinterpret_cast<uint8_t*>(Image.data());
+
+        FrameExportWriter Old;
+        unique_ptr<FrameClient> Client;
+        if (!Old.Create(RegionName, Width, Height) || !(Client = FrameClient::Connect(RegionName)))
+        {
+            printf("  FAILED: cannot create %s for the restart\n", RegionName);
+            return 1;
+        }
+
+        bool Before = Old.Write(Frame) && Client->WaitFrame(100);
+
+        // Until the client opens the region again the new writer has no reader and skips its frames
+        FrameExportWriter New;
+        bool TakenOver = New.Create(RegionName, Width, Height);
+        atomic<bool> Done(false);
+        thread Writer([&]()
+        {
+            Rect Corner = { 0, 0, 8, 8 };
+            fill(Image.begin(), Image.end(), 2u);
+            Frame.Damage = DamageState::Partial;
+            Frame.DirtyRectCount = 1;
+            Frame.pDirtyRects = &Corner;
+            while (TakenOver && !Done.load(memory_order_acquire))
+            {
+                New.Write(Frame);
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+        });
+
+        uint64_t Start = MonotonicNanoseconds();
+        bool After = false;
+        {
+            FrameView View = Client->WaitFrame(1000);
+            After = View && View.Frame().Damage == DamageState::Full &&
+                reinterpret_cast<const uint32_t*>(View.Frame().pPixels)[0] == 2u;
+        }
+        double Reconnected = (MonotonicNanoseconds() - Start) / 1e6;
+        Done.store(true, memory_order_release);
+        Writer.join();
+
+        // Once the driver is gone for good the client times out rather than reading the stale region
+        New.Close();
+        Old.Close();
+        bool Gone = !Client->WaitFrame(30);
+
+        printf("restart: client reading the new writer after %.1f ms, first frame %s\n", Reconnected,
+            Before && TakenOver && After && Gone ? "whole" : "FAILED");
+        if (!Before || !TakenOver || !After || !Gone)
+        {
+            printf("  FAILED: restart (before %d, taken over %d, after %d, gone %d)\n", Before, TakenOver, After, Gone);
+            return 1;
+        }
+        return 0;
+    }
+
+    // An I420 frame padded to the pool's pitch, taken through the C interface, rebuilds plane for plane from the
+    // layout idd_client.h documents
+    int CheckYuvLayout()
+    {
+        const uint32_t Width = 630, Height = 350;
+        const uint32_t Pitch = 640;     // as FrameBufferPool pads it
+
+        FrameExportWriter Writer;
+        IddClient* pClient = nullptr;
+        if (!Writer.Create(RegionName, Pitch, Height) || !(pClient = IddClientOpen(RegionName)))
+        {
+            printf("  FAILED: cannot create %s for the YUV layout\n", RegionName);
+            return 1;
+        }
+
+        mt19937 Random(20);
+        vector<uint32_t> Image(static_cast<size_t>(Width) * Height);
+        for (uint32_t& Pixel : Image)
+        {
+            Pixel = Random();
+        }
+
+        vector<uint8_t> Converted(static_cast<size_t>(Pitch) * FrameRows(PixelFormat::I420, Height));
+        Frame Frame = {};
+        Frame.Width = Width;
+        Frame.Height = Height;
+        Frame.Pitch = Pitch;
+        Frame.Format = PixelFormat::I420;
+        Frame.Damage = DamageState::Full;
+        Frame.pData = Converted.data();
+        YuvPlanes Expected = MakeYuvPlanes(Converted.data(), Pitch, Height, PixelFormat::I420);
+
+        IddFrame Received = {};
+        bool Read = ConvertBgraFrame(reinterpret_cast<const uint8_t*>(Image.data()), Width * 4, Width, Height, Converted.data(),
+            Pitch, PixelFormat::I420, ColorMatrix::Bt709, ColorRange::Limited) && Writer.Write(Frame) &&
+            IddClientPollFrame(pClient, &Received) && Received.Format == IDD_FORMAT_I420 && Received.Width == Width &&
+            Received.Height == Height;
+
+        // Where the header says the planes are
+        size_t Wrong = 0;
+        if (Read)
+        {
+            uint32_t ChromaWidth = (Width + 1) / 2, ChromaHeight = (Height + 1) / 2, ChromaPitch = Received.Pitch / 2;
+            const uint8_t* pU = Received.Pixels + static_cast<size_t>(Received.Pitch) * Height;
+            const uint8_t* pV = pU + static_cast<size_t>(ChromaPitch) * ChromaHeight;
+            for (uint32_t Y = 0; Y < Height; Y++)
+            {
+                Wrong += memcmp(Received.Pixels + static_cast<size_t>(Y) * Received.Pitch, Expected.pY + static_cast<size_t>(Y) * Expected.YPitch, Width) != 0;
+            }
+            for (uint32_t Y = 0; Y < ChromaHeight; Y++)
+            {
+                Wrong += memcmp(pU + static_cast<size_t>(Y) * ChromaPitch, Expected.pU + static_cast<size_t>(Y) * Expected.UPitch, ChromaWidth) != 0;
+                Wrong += memcmp(pV + static_cast<size_t>(Y) * ChromaPitch, Expected.pV + static_cast<size_t>(Y) * Expected.VPitch, ChromaWidth) != 0;
+            }
+            IddClientReleaseFrame(pClient);
+        }
+        IddClientClose(pClient);
+
+        printf("I420 %ux%u at pitch %u through the C interface: %zu plane rows wrong\n", Width, Height, Pitch, Wrong);
+        if (!Read || Wrong != 0)
+        {
+            printf("  FAILED: YUV layout (read %d, %zu rows wrong)\n", Read, Wrong);
+            return 1;
+        }
+        return 0;
+    }
+
+    /// <summary>
+    /// What one client saw of the live export.
+    /// </summary>
+    struct ClientCheck
+    {
+        const char* Style;
+        bool Opened = false;
+        uint64_t Missed = 0;
+        uint64_t LastSequence = 0;
+        uint64_t OutOfOrder = 0;
+        uint64_t BadRects = 0;
+        vector<double> Latency;
+
+        void See(const ClientFrame& Frame, uint64_t Now)
+        {
+            Latency.push_back((Now - Frame.PublishTime) / 1e3);
+            OutOfOrder += Frame.Sequence <= LastSequence ? 1 : 0;
+            LastSequence = Frame.Sequence;
+            for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+            {
+                const Rect& Area = Frame.pDirtyRects[i];
+                BadRects += Area.Empty() || Area.Left < 0 || Area.Top < 0 || Area.Right > static_cast<int32_t>(Frame.Width) ||
+                    Area.Bottom > static_cast<int32_t>(Frame.Height) ? 1 : 0;
+            }
+        }
+
+        void SeeC(const IddFrame& Frame, uint64_t Now)
+        {
+            ClientFrame Copy = {};
+            Copy.Width = Frame.Width;
+            Copy.Height = Frame.Height;
+            Copy.Sequence = Frame.Sequence;
+            Copy.PublishTime = Frame.PublishTime;
+            Copy.DirtyRectCount = Frame.DirtyRectCount;
+            Copy.pDirtyRects = reinterpret_cast<const Rect*>(Frame.DirtyRects);
+            See(Copy, Now);
+        }
+    };
+
+    void IddCallback(const IddFrame* pFrame, void* pContext)
+    {
+        static_cast<ClientCheck*>(pContext)->SeeC(*pFrame, MonotonicNanoseconds());
+    }
+
+    int MeasureClients(const Bench::Resolution& Mode, double Seconds)
+    {
+        auto Writer = make_shared<FrameExportWriter>();
+        if (!Writer->Create(RegionName, Mode.Width, Mode.Height, 3))
+        {
+            printf("  FAILED: cannot create %s for %s\n", RegionName, Mode.Name);
+            return 1;
+        }
+
+        ClientCheck Blocking, Polling, Callback;
+        Blocking.Style = "wait";
+        Polling.Style = "poll";
+        Callback.Style = "callback";
+        atomic<bool> Done(false);
+        atomic<int> Ready(0);
+
+        thread BlockingThread([&] {
+            unique_ptr<FrameClient> Client = FrameClient::Connect(RegionName);
+            Blocking.Opened = Client != nullptr;
+            Ready++;
+            while (Client)
+            {
+                FrameView View = Client->WaitFrame(100);
+                if (View)
+                {
+                    Blocking.See(View.Frame(), MonotonicNanoseconds());
+                }
+                else if (Done.load(memory_order_acquire))
+                {
+                    break;
+                }
+            }
+            Blocking.Missed = Client ? Client->Statistics().FramesMissed : 0;
+        });
+
+        thread PollingThread([&] {
+            unique_ptr<FrameClient> Client = FrameClient::Connect(RegionName);
+            Polling.Opened = Client != nullptr;
+            Ready++;
+            while (Client)
+            {
+                bool Finished = Done.load(memory_order_acquire);
+                FrameView View = Client->TryFrame();
+                if (View)
+                {
+                    Polling.See(View.Frame(), MonotonicNanoseconds());
+                }
+                else if (Finished)
+                {
+                    break;
+                }
+                else
+                {
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                }
+            }
+            Polling.Missed = Client ? Client->Statistics().FramesMissed : 0;
+        });
+
+        IddClient* pCallbackClient = IddClientOpen(RegionName);
+        Callback.Opened = pCallbackClient && IddClientStart(pCallbackClient, IddCallback, &Callback);
+        while (Ready.load() != 2)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+
+        uint64_t Frames = static_cast<uint64_t>(Seconds * FramesPerSecond);
+        SimulatedSwapChain SwapChain(Mode.Width, Mode.Height, FramesPerSecond, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.SetSink(make_shared<FrameExportSink>(Writer));
+        Pipeline.SetAsyncProcessing(3);
+        Pipeline.RunCore();
+
+        // The callback thread looks for frames at least every 20 ms
+        this_thread::sleep_for(chrono::milliseconds(100));
+        Done.store(true, memory_order_release);
+        BlockingThread.join();
+        PollingThread.join();
+        if (pCallbackClient)
+        {
+            IddClientStop(pCallbackClient);
+            IddClientStatistics Statistics;
+            IddClientGetStatistics(pCallbackClient, &Statistics);
+            Callback.Missed = Statistics.FramesMissed;
+            IddClientClose(pCallbackClient);
+        }
+
+        uint64_t Published = Writer->Statistics().FramesPublished;
+        int Failures = 0;
+        for (ClientCheck* pCheck : { &Blocking, &Polling, &Callback })
+        {
+            size_t Read = pCheck->Latency.size();
+            printf("%-6s %-9s %8llu %8zu %8llu %10.1f %10.1f %10.1f\n", Mode.Name, pCheck->Style,
+                static_cast<unsigned long long>(Published), Read, static_cast<unsigned long long>(pCheck->Missed),
+                Read ? Bench::Percentile(pCheck->Latency, 50) : 0, Read ? Bench::Percentile(pCheck->Latency, 99) : 0,
+                Read ? Bench::Percentile(pCheck->Latency, 100) : 0);
+
+            if (!pCheck->Opened || Read == 0 || Read + pCheck->Missed != Published || pCheck->OutOfOrder != 0 ||
+                pCheck->BadRects != 0)
+            {
+                printf("  FAILED: %s %s client (opened %d, out of order %llu, bad rectangles %llu)\n", Mode.Name,
+                    pCheck->Style, pCheck->Opened, static_cast<unsigned long long>(pCheck->OutOfOrder),
+                    static_cast<unsigned long long>(pCheck->BadRects));
+                Failures = 1;
+            }
+        }
+        return Failures;
+    }
+}
+
+int BenchClient(int argc, char* argv[])
+{
+    double Seconds = static_cast<double>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "seconds", 2)));
+
+    int Failures = CheckLoopback();
+    Failures |= CheckRestart();
+    Failures |= CheckYuvLayout();
+
+    printf("\npaced %.0f fps swap-chain exported to three clients at once, publish to read [us]\n", FramesPerSecond);
+    printf("%-6s %-9s %8s %8s %8s %10s %10s %10s\n", "mode", "style", "frames", "read", "missed", "p50", "p99", "max");
+    // 1080p and 4K
+    Failures |= MeasureClients(Bench::StandardResolutions[0], Seconds);
+    Failures |= MeasureClients(Bench::StandardResolutions[2], Seconds);
+
+    printf("\nframe client: %s\n", Failures == 0 ? "exact" : "FAILED");
+    return Failures;
+}
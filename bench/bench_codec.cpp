@@ -0,0 +1,492 @@
+/*++
+
+Module Name:
+
+    bench_codec.cpp
+
+Abstract:
+
+    Checks and measures the lossless tile codec. Every encoded stream is decoded and compared byte for byte with its
+    source: key frames of odd sizes and tile sizes, a chain of delta frames with dirty and move rectangles, and
+    truncated or corrupted streams, which the decoder must reject without crashing. Then reports the compression
+    ratio and the encode and decode MB/s on synthetic desktop, text and photo frames for a growing number of
+    threads, and the cost of the delta frames of a typing session.
+
+    Options: --frames N (default 20), --width N (default 3840), --height N (default 2160),
+             --threads N (default: hardware threads)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/tile_codec.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    enum class Content
+    {
+        Desktop,    // wallpaper gradient, flat windows, title bars and icons
+        Text,       // a page of small text
+        Photo,      // smooth gradients with sensor noise
+    };
+
+    const char* ContentName(Content Kind)
+    {
+        switch (Kind)
+        {
+        case Content::Desktop:
+            return "desktop";
+        case Content::Text:
+            return "text";
+        default:
+            return "photo";
+        }
+    }
+
+    uint32_t Hash32(uint32_t Value)
+    {
+        Value ^= Value >> 16;
+        Value *= 0x7FEB352Du;
+        Value ^= Value >> 15;
+        Value *= 0x846CA68Bu;
+        Value ^= Value >> 16;
+        return Value;
+    }
+
+    uint32_t TextPixel(uint32_t x, uint32_t y)
+    {
+        if (x % 9 == 8 || y % 18 >= 12)
+        {
+            return 0xFFFFFFFFu;
+        }
+
+        uint32_t Glyph = Hash32((x / 9) * 0x10001u ^ (y / 18) * 0x9E3779B9u ^ (y % 18));
+        return ((Glyph >> (x % 9)) & 1) ? 0xFF202020u : 0xFFFFFFFFu;
+    }
+
+    uint32_t Pixel(Content Kind, uint32_t x, uint32_t y, uint32_t Width, uint32_t Height)
+    {
+        switch (Kind)
+        {
+        case Content::Desktop:
+        {
+            // Two windows over a gradient, each with a title bar and a few lines of text
+            uint32_t Windows[2][4] = { { Width / 10, Height / 8, Width / 2, Height / 2 }, { Width / 3, Height / 3, Width / 2, Height / 2 } };
+            for (int i = 1; i >= 0; i--)
+            {
+                uint32_t Left = Windows[i][0], Top = Windows[i][1];
+                if (x >= Left && y >= Top && x < Left + Windows[i][2] && y < Top + Windows[i][3])
+                {
+                    if (y < Top + 32)
+                    {
+                        return i == 1 ? 0xFF2B579Au : 0xFF404040u;
+                    }
+                    return (y - Top) / 18 % 3 == 0 ? TextPixel(x - Left, y - Top) : 0xFFF3F3F3u;
+                }
+            }
+            if (x % 96 < 48 && y % 96 < 48 && x < 96 * 2)
+            {
+                return 0xFF000000u | Hash32(y / 96 + x / 96 * 7) % 0xFFFFFFu;
+            }
+            return 0xFF000000u | (x * 255 / Width) << 16 | (y * 255 / Height) << 8 | 0x80;
+        }
+        case Content::Text:
+            return TextPixel(x, y);
+        default:
+        {
+            double Wave = sin(x * 0.01) * cos(y * 0.013) + sin((x + y) * 0.004);
+            int32_t Noise = static_cast<int32_t>(Hash32(y * Width + x) % 7) - 3;
+            uint32_t R = static_cast<uint32_t>(min(255.0, max(0.0, 128 + 60 * Wave + Noise)));
+            uint32_t G = static_cast<uint32_t>(min(255.0, max(0.0, 100 + 50 * Wave + x * 60.0 / Width + Noise)));
+            uint32_t B = static_cast<uint32_t>(min(255.0, max(0.0, 90 - 40 * Wave + y * 80.0 / Height + Noise)));
+            return 0xFF000000u | R << 16 | G << 8 | B;
+        }
+        }
+    }
+
+    vector<uint32_t> Render(Content Kind, uint32_t Width, uint32_t Height)
+    {
+        vector<uint32_t> Pixels(static_cast<size_t>(Width) * Height);
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            for (uint32_t x = 0; x < Width; x++)
+            {
+                Pixels[static_cast<size_t>(y) * Width + x] = Pixel(Kind, x, y, Width, Height);
+            }
+        }
+        return Pixels;
+    }
+
+    Frame MakeFrame(vector<uint32_t>& Pixels, uint32_t Width, uint32_t Height)
+    {
+        Frame Frame = {};
+        Frame.Width = Width;
+        Frame.Height = Height;
+        Frame.Pitch = Width * 4;
+        Frame.Format = PixelFormat::Bgra8;
+        Frame.pData = reinterpret_cast<uint8_t*>(Pixels.data());
+        Frame.Damage = DamageState::Full;
+        return Frame;
+    }
+
+    bool Matches(const TileDecoder& Decoder, const vector<uint32_t>& Pixels, uint32_t Width, uint32_t Height)
+    {
+        return Decoder.Valid() && Decoder.Width() == Width && Decoder.Height() == Height &&
+            memcmp(Decoder.Data(), Pixels.data(), Pixels.size() * 4) == 0;
+    }
+
+    /// <summary>
+    /// xorshift32, so every run checks the same streams.
+    /// </summary>
+    class Random
+    {
+    public:
+        explicit Random(uint32_t Seed) : m_State(Seed) {}
+
+        uint32_t Next()
+        {
+            m_State ^= m_State << 13;
+            m_State ^= m_State >> 17;
+            m_State ^= m_State << 5;
+            return m_State;
+        }
+
+        uint32_t Below(uint32_t Limit) { return Next() % Limit; }
+
+    private:
+        uint32_t m_State;
+    };
+
+    // Key frames of awkward sizes with content from flat to pure noise, including translucent pixels
+    uint64_t CheckKeyFrames(shared_ptr<WorkerPool> Pool, uint64_t& Streams)
+    {
+        const uint32_t Sizes[][2] = { { 1, 1 }, { 7, 3 }, { 64, 64 }, { 65, 63 }, { 130, 131 }, { 333, 97 }, { 1000, 17 } };
+        const uint32_t TileSizes[] = { 8, 16, 64, 256 };
+        Random Rng(12345);
+        uint64_t Failures = 0;
+
+        for (const auto& Size : Sizes)
+        {
+            for (uint32_t TileSize : TileSizes)
+            {
+                for (uint32_t Palette = 1; Palette <= 1u << 24; Palette <<= 6)
+                {
+                    vector<uint32_t> Pixels(static_cast<size_t>(Size[0]) * Size[1]);
+                    for (uint32_t& Value : Pixels)
+                    {
+                        // Palette 1 is a flat image; the largest one is noise with random alpha
+                        Value = Palette >= 1u << 18 ? Rng.Next() : 0xFF000000u | Hash32(Rng.Below(Palette)) >> 8;
+                    }
+
+                    TileEncoder Encoder(Pool, TileSize);
+                    TileDecoder Decoder;
+                    EncodedFrame Output;
+                    Frame Frame = MakeFrame(Pixels, Size[0], Size[1]);
+
+                    Streams++;
+                    if (!Encoder.Encode(Frame, Output) || !Output.KeyFrame || !Decoder.Decode(Output.pData, Output.Size) ||
+                        !Matches(Decoder, Pixels, Size[0], Size[1]))
+                    {
+                        Failures++;
+                    }
+                }
+            }
+        }
+
+        return Failures;
+    }
+
+    // Typing, scrolling with a move rectangle, and an unencodable frame that forces the next key frame
+    uint64_t CheckDeltaFrames(shared_ptr<WorkerPool> Pool, uint64_t& Streams)
+    {
+        const uint32_t Width = 800;
+        const uint32_t Height = 600;
+        vector<uint32_t> Pixels = Render(Content::Desktop, Width, Height);
+        TileEncoder Encoder(Pool, 64);
+        TileDecoder Decoder(Pool);
+        Random Rng(777);
+        uint64_t Failures = 0;
+
+        for (uint32_t i = 0; i < 200; i++)
+        {
+            Frame Frame = MakeFrame(Pixels, Width, Height);
+            vector<Rect> Dirty;
+            vector<MoveRect> Moves;
+
+            if (i % 50 == 25)
+            {
+                // Not BGRA: the encoder refuses it, the decoder never sees it
+                Frame.Format = PixelFormat::Nv12;
+                EncodedFrame Output;
+                if (Encoder.Encode(Frame, Output))
+                {
+                    Failures++;
+                }
+                continue;
+            }
+
+            if (i != 0 && i % 7 == 0)
+            {
+                // Scroll a band up by a few rows and paint the uncovered strip
+                int32_t Left = static_cast<int32_t>(Rng.Below(200));
+                int32_t Right = Left + 300 + static_cast<int32_t>(Rng.Below(250));
+                int32_t Top = 40 + static_cast<int32_t>(Rng.Below(100));
+                int32_t Bottom = Top + 200 + static_cast<int32_t>(Rng.Below(200));
+                int32_t Delta = 1 + static_cast<int32_t>(Rng.Below(30));
+
+                vector<uint32_t> Before = Pixels;
+                for (int32_t y = Top; y < Bottom - Delta; y++)
+                {
+                    memcpy(&Pixels[y * Width + Left], &Before[(y + Delta) * Width + Left], (Right - Left) * 4);
+                }
+                for (int32_t y = Bottom - Delta; y < Bottom; y++)
+                {
+                    for (int32_t x = Left; x < Right; x++)
+                    {
+                        Pixels[y * Width + x] = TextPixel(x, y + i);
+                    }
+                }
+
+                Moves.push_back({ Left, Top + Delta, { Left, Top, Right, Bottom - Delta } });
+                Dirty.push_back({ Left, Bottom - Delta, Right, Bottom });
+            }
+            else
+            {
+                // A few glyphs, some of them translucent
+                for (uint32_t g = 0; g < 1 + Rng.Below(4); g++)
+                {
+                    int32_t Left = static_cast<int32_t>(Rng.Below(Width - 9));
+                    int32_t Top = static_cast<int32_t>(Rng.Below(Height - 16));
+                    uint32_t Alpha = Rng.Below(4) == 0 ? 0x80000000u : 0xFF000000u;
+                    for (int32_t y = Top; y < Top + 16; y++)
+                    {
+                        for (int32_t x = Left; x < Left + 9; x++)
+                        {
+                            Pixels[y * Width + x] = Alpha | (Rng.Next() & 0xFFFFFF);
+                        }
+                    }
+                    Dirty.push_back({ Left, Top, Left + 9, Top + 16 });
+                }
+            }
+
+            if (i != 0)
+            {
+                Frame.Damage = DamageState::Partial;
+                Frame.DirtyRectCount = static_cast<uint32_t>(Dirty.size());
+                Frame.pDirtyRects = Dirty.data();
+                Frame.MoveRectCount = static_cast<uint32_t>(Moves.size());
+                Frame.pMoveRects = Moves.data();
+            }
+
+            EncodedFrame Output;
+            Streams++;
+            if (!Encoder.Encode(Frame, Output) || Output.KeyFrame != (i == 0 || i % 50 == 26) ||
+                !Decoder.Decode(Output.pData, Output.Size) || !Matches(Decoder, Pixels, Width, Height))
+            {
+                Failures++;
+            }
+        }
+
+        return Failures;
+    }
+
+    // Every truncation of a delta and a key frame is rejected, and so is a delta after a rejected frame. Random
+    // corruption may decode to a wrong image, but must never crash or overrun.
+    uint64_t CheckMalformed(uint64_t& Streams)
+    {
+        const uint32_t Width = 200;
+        const uint32_t Height = 150;
+        vector<uint32_t> Pixels = Render(Content::Photo, Width, Height);
+        TileEncoder Encoder(nullptr, 32);
+        EncodedFrame Output;
+        uint64_t Failures = 0;
+
+        Frame Frame = MakeFrame(Pixels, Width, Height);
+        Encoder.Encode(Frame, Output);
+        vector<uint8_t> Key(Output.pData, Output.pData + Output.Size);
+
+        Rect Dirty = { 10, 10, 90, 70 };
+        Frame.Damage = DamageState::Partial;
+        Frame.DirtyRectCount = 1;
+        Frame.pDirtyRects = &Dirty;
+        Encoder.Encode(Frame, Output);
+        vector<uint8_t> Delta(Output.pData, Output.pData + Output.Size);
+
+        for (size_t Length = 0; Length < Key.size(); Length += 1 + Length / 64)
+        {
+            TileDecoder Decoder;
+            Streams++;
+            if (Decoder.Decode(Key.data(), Length) || Decoder.Decode(Delta.data(), Delta.size()))
+            {
+                Failures++;
+            }
+        }
+
+        for (size_t Length = 0; Length < Delta.size(); Length++)
+        {
+            TileDecoder Decoder;
+            Decoder.Decode(Key.data(), Key.size());
+            Streams++;
+            if (Decoder.Decode(Delta.data(), Length))
+            {
+                Failures++;
+            }
+        }
+
+        Random Rng(99);
+        for (int i = 0; i < 2000; i++)
+        {
+            vector<uint8_t> Corrupt = Rng.Below(2) ? Key : Delta;
+            for (uint32_t Flips = 1 + Rng.Below(3); Flips != 0; Flips--)
+            {
+                Corrupt[Rng.Below(static_cast<uint32_t>(Corrupt.size()))] ^= static_cast<uint8_t>(1 + Rng.Below(255));
+            }
+
+            TileDecoder Decoder;
+            Decoder.Decode(Key.data(), Key.size());
+            Decoder.Decode(Corrupt.data(), Corrupt.size());
+            Streams++;
+        }
+
+        return Failures;
+    }
+}
+
+int BenchCodec(int argc, char* argv[])
+{
+    uint64_t FrameCount = max<uint64_t>(1, Bench::ParseOption(argc, argv, "frames", 20));
+    uint32_t Width = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "width", 3840));
+    uint32_t Height = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "height", 2160));
+    uint32_t MaxThreads = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "threads", max(1u, thread::hardware_concurrency())));
+    const double FrameMegabytes = static_cast<double>(Width) * Height * 4 / 1e6;
+
+    // Round trips
+    uint64_t Streams = 0;
+    uint64_t KeyFailures = CheckKeyFrames(make_shared<WorkerPool>(2), Streams);
+    uint64_t DeltaFailures = CheckDeltaFrames(make_shared<WorkerPool>(2), Streams);
+    uint64_t MalformedFailures = CheckMalformed(Streams);
+
+    printf("round trip: %llu streams, failures: key %llu, delta %llu, malformed %llu\n\n",
+        static_cast<unsigned long long>(Streams),
+        static_cast<unsigned long long>(KeyFailures),
+        static_cast<unsigned long long>(DeltaFailures),
+        static_cast<unsigned long long>(MalformedFailures));
+
+    int Failures = (KeyFailures + DeltaFailures + MalformedFailures) != 0 ? 1 : 0;
+
+    // Key frames per content and thread count
+    printf("%ux%u key frames, %llu per measurement\n\n", Width, Height, static_cast<unsigned long long>(FrameCount));
+    printf("%-8s %-8s %8s %12s %10s %12s %10s\n", "content", "threads", "ratio", "encode ms", "enc MB/s", "decode ms", "dec MB/s");
+
+    const Content Contents[] = { Content::Desktop, Content::Text, Content::Photo };
+    for (Content Kind : Contents)
+    {
+        vector<uint32_t> Pixels = Render(Kind, Width, Height);
+        Frame Frame = MakeFrame(Pixels, Width, Height);
+
+        for (uint32_t Threads = 1; Threads <= MaxThreads; Threads = Threads < MaxThreads ? min(Threads * 2, MaxThreads) : Threads + 1)
+        {
+            // The encoding thread runs tiles too, so Threads - 1 pool threads make Threads in all
+            shared_ptr<WorkerPool> Pool = Threads > 1 ? make_shared<WorkerPool>(Threads - 1) : nullptr;
+            TileEncoder Encoder(Pool);
+            TileDecoder Decoder(Pool);
+            EncodedFrame Output = {};
+
+            double Start = Bench::WallSeconds();
+            for (uint64_t i = 0; i < FrameCount; i++)
+            {
+                Encoder.RequestKeyFrame();
+                Encoder.Encode(Frame, Output);
+            }
+            double EncodeSeconds = (Bench::WallSeconds() - Start) / FrameCount;
+
+            Start = Bench::WallSeconds();
+            for (uint64_t i = 0; i < FrameCount; i++)
+            {
+                Decoder.Decode(Output.pData, Output.Size);
+            }
+            double DecodeSeconds = (Bench::WallSeconds() - Start) / FrameCount;
+
+            if (!Matches(Decoder, Pixels, Width, Height))
+            {
+                Failures = 1;
+            }
+
+            printf("%-8s %-8u %8.2f %12.3f %10.0f %12.3f %10.0f\n",
+                ContentName(Kind),
+                Threads,
+                FrameMegabytes * 1e6 / Output.Size,
+                EncodeSeconds * 1e3,
+                FrameMegabytes / EncodeSeconds,
+                DecodeSeconds * 1e3,
+                FrameMegabytes / DecodeSeconds);
+        }
+    }
+
+    // Delta frames: a few glyphs per frame on the desktop
+    {
+        vector<uint32_t> Pixels = Render(Content::Desktop, Width, Height);
+        shared_ptr<WorkerPool> Pool = MaxThreads > 1 ? make_shared<WorkerPool>(MaxThreads - 1) : nullptr;
+        TileEncoder Encoder(Pool);
+        TileDecoder Decoder(Pool);
+        EncodedFrame Output;
+        Random Rng(4242);
+        uint64_t Bytes = 0;
+        uint64_t Mismatches = 0;
+        double Seconds = 0;
+
+        Frame Frame = MakeFrame(Pixels, Width, Height);
+        Encoder.Encode(Frame, Output);
+        Decoder.Decode(Output.pData, Output.Size);
+
+        for (uint64_t i = 0; i < FrameCount * 10; i++)
+        {
+            Rect Glyph = { 200 + static_cast<int32_t>(i % 150) * 9, 400 + static_cast<int32_t>(i / 150 % 40) * 18, 0, 0 };
+            Glyph.Right = Glyph.Left + 8;
+            Glyph.Bottom = Glyph.Top + 12;
+            for (int32_t y = Glyph.Top; y < Glyph.Bottom; y++)
+            {
+                for (int32_t x = Glyph.Left; x < Glyph.Right; x++)
+                {
+                    Pixels[static_cast<size_t>(y) * Width + x] = (Rng.Next() & 1) ? 0xFF202020u : 0xFFF3F3F3u;
+                }
+            }
+
+            Frame.Damage = DamageState::Partial;
+            Frame.DirtyRectCount = 1;
+            Frame.pDirtyRects = &Glyph;
+
+            double Start = Bench::WallSeconds();
+            Encoder.Encode(Frame, Output);
+            Seconds += Bench::WallSeconds() - Start;
+            Bytes += Output.Size;
+
+            if (!Decoder.Decode(Output.pData, Output.Size) || !Matches(Decoder, Pixels, Width, Height))
+            {
+                Mismatches++;
+            }
+        }
+
+        printf("\ntyping deltas: %.0f bytes/frame, %.3f ms/frame encode, %llu mismatches\n",
+            static_cast<double>(Bytes) / (FrameCount * 10), Seconds * 1e3 / (FrameCount * 10), static_cast<unsigned long long>(Mismatches));
+
+        Failures += Mismatches != 0 ? 1 : 0;
+    }
+
+    return Failures == 0 ? 0 : 1;
+}
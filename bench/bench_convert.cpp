@@ -0,0 +1,228 @@
+/*++
+
+Module Name:
+
+    bench_convert.cpp
+
+Abstract:
+
+    Checks every BGRA to YUV kernel tier the CPU supports against the scalar reference, for both matrices and both
+    ranges and for odd sizes, checks that the 4:4:4 split layout merges back into planar 4:4:4, then reports
+    conversion throughput per format and tier. GB/s counts BGRA bytes read; budget is the share of a 60 Hz frame.
+
+    Options: --frames N (default 30)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../pipeline/color_convert.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    struct ConvertedImage
+    {
+        vector<uint8_t> Data;
+        uint32_t Pitch;
+    };
+
+    const char* FormatName(PixelFormat Format)
+    {
+        switch (Format)
+        {
+        case PixelFormat::Nv12:
+            return "nv12";
+        case PixelFormat::I420:
+            return "i420";
+        case PixelFormat::I444:
+            return "i444";
+        default:
+            return "i444s";
+        }
+    }
+
+    void FillNoise(vector<uint8_t>& Pixels, uint32_t Seed)
+    {
+        uint32_t State = Seed | 1;
+        for (auto& Byte : Pixels)
+        {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            Byte = static_cast<uint8_t>(State >> 24);
+        }
+
+        // Pin the extremes of every channel so clamping is exercised
+        size_t Count = Pixels.size() < 64 ? Pixels.size() : 64;
+        for (size_t i = 0; i < Count; i++)
+        {
+            Pixels[i] = (i / 4 % 2) ? 0xFF : 0x00;
+        }
+    }
+
+    void Convert(
+        const vector<uint8_t>& Source,
+        uint32_t Width,
+        uint32_t Height,
+        PixelFormat Format,
+        ColorMatrix Matrix,
+        ColorRange Range,
+        SimdLevel Level,
+        ConvertedImage& Image)
+    {
+        // Even pitch with a little slack past the odd-width chroma column
+        Image.Pitch = (Width + 2) & ~1u;
+        Image.Data.assign(static_cast<size_t>(Image.Pitch) * FrameRows(Format, Height), 0xCD);
+        ConvertBgraFrame(Source.data(), Width * 4, Width, Height, Image.Data.data(), Image.Pitch, Format, Matrix, Range, Level);
+    }
+
+    // Returns true if the split layout merges back into exactly the planar 4:4:4 conversion
+    bool CheckSplitMerge(const vector<uint8_t>& Source, uint32_t Width, uint32_t Height)
+    {
+        ConvertedImage Planar, Split;
+        Convert(Source, Width, Height, PixelFormat::I444, ColorMatrix::Bt709, ColorRange::Full, DetectSimdLevel(), Planar);
+        Convert(Source, Width, Height, PixelFormat::I444Split, ColorMatrix::Bt709, ColorRange::Full, DetectSimdLevel(), Split);
+
+        YuvPlanes Main, Residual;
+        MakeYuvSplitPlanes(Split.Data.data(), Split.Pitch, Height, Main, Residual);
+
+        vector<uint8_t> Merged(Planar.Data.size(), 0xCD);
+        MergeYuv444Split(Main, Residual, Width, Height, MakeYuvPlanes(Merged.data(), Planar.Pitch, Height, PixelFormat::I444));
+        return Merged == Planar.Data;
+    }
+
+    // Returns the number of cases where a vector tier differs from the scalar reference
+    uint32_t CheckExactness(uint32_t& Cases)
+    {
+        const struct { uint32_t Width; uint32_t Height; } Sizes[] =
+        {
+            { 1, 1 }, { 7, 5 }, { 97, 33 }, { 1917, 13 }, { 1920, 16 },
+        };
+        const PixelFormat Formats[] = { PixelFormat::Nv12, PixelFormat::I420, PixelFormat::I444, PixelFormat::I444Split };
+        const ColorMatrix Matrices[] = { ColorMatrix::Bt601, ColorMatrix::Bt709 };
+        const ColorRange Ranges[] = { ColorRange::Limited, ColorRange::Full };
+
+        uint32_t Mismatches = 0;
+        Cases = 0;
+
+        for (const auto& Size : Sizes)
+        {
+            vector<uint8_t> Source(static_cast<size_t>(Size.Width) * Size.Height * 4);
+            FillNoise(Source, Size.Width * 31 + Size.Height);
+
+            for (PixelFormat Format : Formats)
+            {
+                // The split layout is only defined for even sizes
+                if (Format == PixelFormat::I444Split && ((Size.Width | Size.Height) & 1) != 0)
+                {
+                    continue;
+                }
+
+                for (ColorMatrix Matrix : Matrices)
+                {
+                    for (ColorRange Range : Ranges)
+                    {
+                        ConvertedImage Reference;
+                        Convert(Source, Size.Width, Size.Height, Format, Matrix, Range, SimdLevel::Scalar, Reference);
+
+                        for (int Level = 1; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+                        {
+                            ConvertedImage Image;
+                            Convert(Source, Size.Width, Size.Height, Format, Matrix, Range, static_cast<SimdLevel>(Level), Image);
+                            Cases++;
+
+                            if (Image.Data != Reference.Data)
+                            {
+                                Mismatches++;
+                                printf("MISMATCH %s %ux%u %s %s %s\n",
+                                    SimdLevelName(static_cast<SimdLevel>(Level)),
+                                    Size.Width,
+                                    Size.Height,
+                                    FormatName(Format),
+                                    Matrix == ColorMatrix::Bt709 ? "bt709" : "bt601",
+                                    Range == ColorRange::Full ? "full" : "limited");
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (((Size.Width | Size.Height) & 1) == 0 && !CheckSplitMerge(Source, Size.Width, Size.Height))
+            {
+                Mismatches++;
+                printf("MISMATCH split merge %ux%u\n", Size.Width, Size.Height);
+            }
+        }
+
+        return Mismatches;
+    }
+}
+
+int BenchConvert(int argc, char* argv[])
+{
+    uint64_t FrameCount = Bench::ParseOption(argc, argv, "frames", 30);
+
+    // Spot-check the reference itself: white, black and mid gray are neutral and land on the range ends
+    {
+        vector<uint8_t> Source = { 255, 255, 255, 255, 255, 255, 255, 255, 0, 0, 0, 255, 0, 0, 0, 255 };
+        ConvertedImage Image;
+        Convert(Source, 2, 2, PixelFormat::I420, ColorMatrix::Bt709, ColorRange::Limited, SimdLevel::Scalar, Image);
+        YuvPlanes Planes = MakeYuvPlanes(Image.Data.data(), Image.Pitch, 2, PixelFormat::I420);
+        if (Planes.pY[0] != 235 || Planes.pY[Planes.YPitch] != 16 || Planes.pU[0] != 128 || Planes.pV[0] != 128)
+        {
+            printf("reference conversion is off: Y %u/%u U %u V %u\n", Planes.pY[0], Planes.pY[Planes.YPitch], Planes.pU[0], Planes.pV[0]);
+            return 1;
+        }
+    }
+
+    uint32_t Cases = 0;
+    uint32_t Mismatches = CheckExactness(Cases);
+    printf("exactness: %u of %u cases match the scalar reference (best tier %s)\n\n",
+        Cases - Mismatches, Cases, SimdLevelName(DetectSimdLevel()));
+
+    printf("%-6s %-5s %-8s %10s %10s %8s\n", "mode", "fmt", "tier", "ms/frame", "GB/s", "budget");
+
+    for (const auto& Mode : Bench::StandardResolutions)
+    {
+        vector<uint8_t> Source(static_cast<size_t>(Mode.Width) * Mode.Height * 4);
+        FillNoise(Source, Mode.Width);
+
+        for (PixelFormat Format : { PixelFormat::Nv12, PixelFormat::I420, PixelFormat::I444, PixelFormat::I444Split })
+        {
+            for (int Level = 0; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+            {
+                ConvertedImage Image;
+                Convert(Source, Mode.Width, Mode.Height, Format, ColorMatrix::Bt709, ColorRange::Limited, static_cast<SimdLevel>(Level), Image);
+
+                double Start = Bench::WallSeconds();
+                for (uint64_t i = 0; i < FrameCount; i++)
+                {
+                    ConvertBgraFrame(Source.data(), Mode.Width * 4, Mode.Width, Mode.Height, Image.Data.data(), Image.Pitch, Format,
+                        ColorMatrix::Bt709, ColorRange::Limited, static_cast<SimdLevel>(Level));
+                }
+                double Seconds = (Bench::WallSeconds() - Start) / FrameCount;
+
+                printf("%-6s %-5s %-8s %10.3f %10.2f %7.1f%%\n",
+                    Mode.Name,
+                    FormatName(Format),
+                    SimdLevelName(static_cast<SimdLevel>(Level)),
+                    Seconds * 1e3,
+                    Source.size() / Seconds / 1e9,
+                    Seconds * 60.0 * 100.0);
+            }
+        }
+    }
+
+    return Mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,445 @@
+/*++
+
+Module Name:
+
+    bench_damage.cpp
+
+Abstract:
+
+    Replays a recorded stream of dirty and move rectangles through the frame pipeline and checks that no update is
+    lost. The source paints exactly what each record describes, sometimes without reporting it (so the tile-hash
+    detector has to find it), while frames are dropped by map failures, a stage and queue overruns. A mirror sink
+    rebuilds the screen from nothing but the damage it is handed and must match every delivered frame, also when
+    the motion search turns part of the damage into moves.
+
+    Options: --frames N (default 600), --width N (default 1920), --height N (default 1080)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "../pipeline/frame_damage.h"
+#include "../pipeline/frame_pipeline.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    uint32_t NextRandom(uint32_t& State)
+    {
+        State ^= State << 13;
+        State ^= State >> 17;
+        State ^= State << 5;
+        return State;
+    }
+
+    int32_t RandomIn(uint32_t& State, int32_t Low, int32_t High)
+    {
+        return Low + static_cast<int32_t>(NextRandom(State) % static_cast<uint32_t>(High - Low));
+    }
+
+    /// <summary>
+    /// One recorded frame: what the producer changed and what it reports.
+    /// </summary>
+    struct DamageRecord
+    {
+        DamageState Reported;       // Unknown records still change DirtyRects, they just do not say so
+        vector<Rect> DirtyRects;    // as recorded, possibly reaching past the frame
+        vector<MoveRect> MoveRects;
+        uint32_t Seed;
+    };
+
+    // Records typing, scrolling, unreported changes, full redraws, idle frames and rectangle storms
+    vector<DamageRecord> RecordStream(uint64_t FrameCount, int32_t Width, int32_t Height)
+    {
+        vector<DamageRecord> Records(FrameCount);
+        uint32_t State = 0x2545F491;
+
+        // A caret that unreported frames keep restoring to the same pixels while reported frames paint over it
+        const Rect Caret = { Width / 3, Height / 3, Width / 3 + 2, Height / 3 + 16 };
+        const uint32_t CaretSeed = 0x5BD1E995;
+
+        for (uint64_t i = 0; i < FrameCount; i++)
+        {
+            DamageRecord& Record = Records[i];
+            Record.Reported = DamageState::Partial;
+            Record.Seed = NextRandom(State);
+
+            uint32_t Kind = (i == 0) ? 0 : NextRandom(State) % 100;
+            if (Kind < 5)
+            {
+                Record.Reported = DamageState::Full;
+                Record.DirtyRects.push_back({ 0, 0, Width, Height });
+            }
+            else if (Kind < 50)
+            {
+                // Glyphs, some of them clipped by the edge of the screen
+                int Count = RandomIn(State, 1, 5);
+                for (int n = 0; n < Count; n++)
+                {
+                    int32_t Left = RandomIn(State, -40, Width);
+                    int32_t Top = RandomIn(State, -40, Height);
+                    Record.DirtyRects.push_back({ Left, Top, Left + RandomIn(State, 8, 200), Top + RandomIn(State, 16, 40) });
+                }
+
+                if (NextRandom(State) & 1)
+                {
+                    Record.DirtyRects.push_back(Caret);
+                }
+            }
+            else if (Kind < 70)
+            {
+                // A window scrolls by Delta rows: most of it moves, the exposed strip is redrawn
+                int32_t Left = RandomIn(State, 0, Width / 2);
+                int32_t Top = RandomIn(State, 0, Height / 2);
+                int32_t Right = min(Width, Left + RandomIn(State, 64, Width));
+                int32_t Bottom = min(Height, Top + RandomIn(State, 64, Height));
+                int32_t Delta = RandomIn(State, 1, 40) * ((NextRandom(State) & 1) ? 1 : -1);
+
+                if (Delta > 0)
+                {
+                    Record.MoveRects.push_back({ Left, Top + Delta, { Left, Top, Right, Bottom - Delta } });
+                    Record.DirtyRects.push_back({ Left, Bottom - Delta, Right, Bottom });
+                }
+                else
+                {
+                    Record.MoveRects.push_back({ Left, Top, { Left, Top - Delta, Right, Bottom } });
+                    Record.DirtyRects.push_back({ Left, Top, Right, Top - Delta });
+                }
+            }
+            else if (Kind < 78)
+            {
+                // The caret comes back without being reported
+                Record.Reported = DamageState::Unknown;
+                Record.DirtyRects.push_back(Caret);
+                Record.Seed = CaretSeed;
+            }
+            else if (Kind < 80)
+            {
+                // The producer changes something but reports nothing
+                Record.Reported = DamageState::Unknown;
+                int Count = RandomIn(State, 1, 4);
+                for (int n = 0; n < Count; n++)
+                {
+                    int32_t Left = RandomIn(State, 0, Width);
+                    int32_t Top = RandomIn(State, 0, Height);
+                    Record.DirtyRects.push_back({ Left, Top, Left + RandomIn(State, 1, 300), Top + RandomIn(State, 1, 300) });
+                }
+            }
+            else if (Kind < 85)
+            {
+                // Nothing changed
+            }
+            else
+            {
+                // More rectangles than a frame carries
+                for (int n = 0; n < 100; n++)
+                {
+                    int32_t Left = RandomIn(State, 0, Width);
+                    int32_t Top = RandomIn(State, 0, Height);
+                    Record.DirtyRects.push_back({ Left, Top, Left + 4, Top + 4 });
+                }
+            }
+        }
+
+        return Records;
+    }
+
+    /// <summary>
+    /// Replays a recorded stream, painting exactly what every record describes and failing some maps.
+    /// </summary>
+    class RecordedSource : public ISwapChainSource
+    {
+    public:
+        RecordedSource(const vector<DamageRecord>& Records, uint32_t Width, uint32_t Height, uint32_t MapFailurePercent)
+            : m_Records(Records)
+            , m_Width(Width)
+            , m_Height(Height)
+            , m_Pixels(static_cast<size_t>(Width) * Height)
+            , m_Next(0)
+            , m_MapFailurePercent(MapFailurePercent)
+            , m_Random(0x6B43A9B5)
+        {
+        }
+
+        bool Initialize() override { return true; }
+
+        AcquireStatus ReleaseAndAcquire(Frame& Frame) override
+        {
+            if (m_Next >= m_Records.size())
+            {
+                return AcquireStatus::Failed;
+            }
+
+            const DamageRecord& Record = m_Records[m_Next];
+
+            // Every move copies from the previous frame, then the dirty rectangles are repainted
+            if (!Record.MoveRects.empty())
+            {
+                m_Previous = m_Pixels;
+                for (const MoveRect& Move : Record.MoveRects)
+                {
+                    for (int32_t y = Move.Destination.Top; y < Move.Destination.Bottom; y++)
+                    {
+                        for (int32_t x = Move.Destination.Left; x < Move.Destination.Right; x++)
+                        {
+                            int32_t SourceX = Move.SourceX + x - Move.Destination.Left;
+                            int32_t SourceY = Move.SourceY + y - Move.Destination.Top;
+                            if (Inside(x, y) && Inside(SourceX, SourceY))
+                            {
+                                m_Pixels[Index(x, y)] = m_Previous[Index(SourceX, SourceY)];
+                            }
+                        }
+                    }
+                }
+            }
+
+            uint32_t Seed = Record.Seed;
+            for (const Rect& Area : Record.DirtyRects)
+            {
+                for (int32_t y = max(Area.Top, 0); y < min(Area.Bottom, static_cast<int32_t>(m_Height)); y++)
+                {
+                    for (int32_t x = max(Area.Left, 0); x < min(Area.Right, static_cast<int32_t>(m_Width)); x++)
+                    {
+                        m_Pixels[Index(x, y)] = 0xFF000000u | ((x * 0x9E3779B1u + y * 0x85EBCA77u + Seed) >> 8);
+                    }
+                }
+                Seed = Seed * 0x2C1B3C6Du + 1;
+            }
+
+            // Report it the way the driver reports IddCx metadata
+            m_Damage.Reset(Record.Reported);
+            if (Record.Reported == DamageState::Partial)
+            {
+                for (const Rect& Area : Record.DirtyRects)
+                {
+                    m_Damage.AddDirtyRect(Area);
+                }
+                for (const MoveRect& Move : Record.MoveRects)
+                {
+                    m_Damage.AddMoveRect(Move);
+                }
+                m_Damage.Normalize(m_Width, m_Height);
+            }
+
+            Frame.FrameNumber = m_Next++;
+            Frame.Width = m_Width;
+            Frame.Height = m_Height;
+            Frame.Pitch = m_Width * 4;
+            Frame.Format = PixelFormat::Bgra8;
+            Frame.pData = reinterpret_cast<uint8_t*>(m_Pixels.data());
+            m_Damage.Publish(Frame);
+            return AcquireStatus::Acquired;
+        }
+
+        WaitStatus WaitForFrame(uint32_t) override { return WaitStatus::NewFrame; }
+        bool FinishedProcessing() override { return true; }
+
+        bool MapFrame(Frame& Frame) override
+        {
+            return NextRandom(m_Random) % 100 >= m_MapFailurePercent && Frame.pData != nullptr;
+        }
+
+    private:
+        bool Inside(int32_t x, int32_t y) const
+        {
+            return x >= 0 && y >= 0 && x < static_cast<int32_t>(m_Width) && y < static_cast<int32_t>(m_Height);
+        }
+
+        size_t Index(int32_t x, int32_t y) const { return static_cast<size_t>(y) * m_Width + x; }
+
+        const vector<DamageRecord>& m_Records;
+        uint32_t m_Width;
+        uint32_t m_Height;
+        vector<uint32_t> m_Pixels;
+        vector<uint32_t> m_Previous;
+        size_t m_Next;
+        uint32_t m_MapFailurePercent;
+        uint32_t m_Random;
+        FrameDamage m_Damage;
+    };
+
+    /// <summary>
+    /// Drops a fixed share of the frames, at random.
+    /// </summary>
+    class RandomDropStage : public IFrameStage
+    {
+    public:
+        explicit RandomDropStage(uint32_t DropPercent) : m_DropPercent(DropPercent), m_Random(0x1B873593) {}
+
+        const char* Name() const override { return "random-drop"; }
+
+        bool Process(Frame&) override { return NextRandom(m_Random) % 100 >= m_DropPercent; }
+
+    private:
+        uint32_t m_DropPercent;
+        uint32_t m_Random;
+    };
+
+    /// <summary>
+    /// Keeps a copy of the screen that is only ever updated through the damage of the frames it is handed, and
+    /// compares it with every frame.
+    /// </summary>
+    class MirrorSink : public IFrameSink
+    {
+    public:
+        MirrorSink(uint32_t Width, uint32_t Height)
+            : m_Width(Width), m_Height(Height), m_Pixels(static_cast<size_t>(Width) * Height)
+        {
+        }
+
+        void Consume(const Frame& Frame) override
+        {
+            m_Delivered++;
+
+            if (Frame.Damage != DamageState::Partial)
+            {
+                CopyRect(Frame, { 0, 0, static_cast<int32_t>(m_Width), static_cast<int32_t>(m_Height) });
+            }
+            else
+            {
+                if (Frame.MoveRectCount != 0)
+                {
+                    m_Previous = m_Pixels;
+                }
+
+                for (uint32_t i = 0; i < Frame.MoveRectCount; i++)
+                {
+                    const MoveRect& Move = Frame.pMoveRects[i];
+                    if (!Valid(Move.Destination) ||
+                        !Valid({ Move.SourceX, Move.SourceY, Move.SourceX + Move.Destination.Right - Move.Destination.Left, Move.SourceY + Move.Destination.Bottom - Move.Destination.Top }))
+                    {
+                        m_InvalidRects++;
+                        continue;
+                    }
+
+                    for (int32_t y = Move.Destination.Top; y < Move.Destination.Bottom; y++)
+                    {
+                        memcpy(&m_Pixels[Index(Move.Destination.Left, y)],
+                            &m_Previous[Index(Move.SourceX, Move.SourceY + y - Move.Destination.Top)],
+                            static_cast<size_t>(Move.Destination.Right - Move.Destination.Left) * 4);
+                    }
+                }
+
+                for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+                {
+                    if (!Valid(Frame.pDirtyRects[i]))
+                    {
+                        m_InvalidRects++;
+                        continue;
+                    }
+                    CopyRect(Frame, Frame.pDirtyRects[i]);
+                }
+            }
+
+            for (uint32_t y = 0; y < m_Height; y++)
+            {
+                if (memcmp(&m_Pixels[Index(0, y)], Frame.pData + static_cast<size_t>(y) * Frame.Pitch, static_cast<size_t>(m_Width) * 4) != 0)
+                {
+                    m_Mismatches++;
+                    break;
+                }
+            }
+        }
+
+        uint64_t m_Delivered = 0;
+        uint64_t m_Mismatches = 0;      // delivered frames the mirror did not reproduce
+        uint64_t m_InvalidRects = 0;    // empty or out-of-frame rectangles
+        uint64_t m_CopiedPixels = 0;
+
+    private:
+        bool Valid(const Rect& Area) const
+        {
+            return !Area.Empty() && Area.Left >= 0 && Area.Top >= 0 &&
+                Area.Right <= static_cast<int32_t>(m_Width) && Area.Bottom <= static_cast<int32_t>(m_Height);
+        }
+
+        size_t Index(int32_t x, int32_t y) const { return static_cast<size_t>(y) * m_Width + x; }
+
+        void CopyRect(const Frame& Frame, const Rect& Area)
+        {
+            for (int32_t y = Area.Top; y < Area.Bottom; y++)
+            {
+                memcpy(&m_Pixels[Index(Area.Left, y)], Frame.pData + static_cast<size_t>(y) * Frame.Pitch + Area.Left * 4,
+                    static_cast<size_t>(Area.Right - Area.Left) * 4);
+            }
+            m_CopiedPixels += Area.Area();
+        }
+
+        uint32_t m_Width;
+        uint32_t m_Height;
+        vector<uint32_t> m_Pixels;
+        vector<uint32_t> m_Previous;
+    };
+}
+
+int BenchDamage(int argc, char* argv[])
+{
+    uint64_t FrameCount = Bench::ParseOption(argc, argv, "frames", 600);
+    uint32_t Width = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "width", 1920));
+    uint32_t Height = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "height", 1080));
+    int Failures = 0;
+
+    vector<DamageRecord> Records = RecordStream(FrameCount, static_cast<int32_t>(Width), static_cast<int32_t>(Height));
+
+    printf("%ux%u, %llu recorded frames\n\n", Width, Height, static_cast<unsigned long long>(FrameCount));
+    printf("%-6s %-7s %-7s %10s %10s %10s %10s %10s %10s %12s %10s\n",
+        "mode", "detect", "motion", "delivered", "missed", "dropped", "detected", "scrolled", "redrawn%", "mismatches", "invalid");
+
+    struct Configuration
+    {
+        uint32_t QueueDepth;
+        uint32_t DetectionTileSize;
+        bool MotionSearch;
+    };
+    const Configuration Configurations[] =
+    {
+        { 0, 64, false }, { 0, 0, false }, { 1, 64, false }, { 1, 0, false }, { 3, 32, false }, { 0, 64, true }, { 3, 64, true },
+    };
+
+    for (const Configuration& Config : Configurations)
+    {
+        RecordedSource Source(Records, Width, Height, 5);
+        auto Sink = make_shared<MirrorSink>(Width, Height);
+
+        FramePipeline Pipeline(Source);
+        Pipeline.AddStage(make_shared<RandomDropStage>(10));
+        Pipeline.SetSink(Sink);
+        Pipeline.SetAsyncProcessing(Config.QueueDepth);
+        Pipeline.SetChangeDetection(Config.DetectionTileSize);
+        Pipeline.SetMotionSearch(Config.MotionSearch);
+        Pipeline.RunCore();
+
+        const PipelineStatistics& Stats = Pipeline.Statistics();
+        uint64_t Missed = Stats.FramesOverrun + Stats.MapFailures;
+        double Redrawn = Sink->m_Delivered != 0 ? Sink->m_CopiedPixels * 100.0 / (static_cast<double>(Width) * Height * Sink->m_Delivered) : 0;
+
+        printf("%-6s %-7u %-7s %10llu %10llu %10llu %10llu %10llu %10.1f %12llu %10llu\n",
+            Config.QueueDepth != 0 ? "async" : "sync",
+            Config.DetectionTileSize,
+            Config.MotionSearch ? "on" : "off",
+            static_cast<unsigned long long>(Sink->m_Delivered),
+            static_cast<unsigned long long>(Missed),
+            static_cast<unsigned long long>(Stats.FramesDropped),
+            static_cast<unsigned long long>(Stats.FramesDetected),
+            static_cast<unsigned long long>(Stats.FramesScrolled),
+            Redrawn,
+            static_cast<unsigned long long>(Sink->m_Mismatches),
+            static_cast<unsigned long long>(Sink->m_InvalidRects));
+
+        Failures += (Sink->m_Mismatches != 0 || Sink->m_InvalidRects != 0) ? 1 : 0;
+    }
+
+    return Failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,608 @@
+/*++
+
+Module Name:
+
+    bench_export.cpp
+
+Abstract:
+
+    Checks and measures the shared-memory frame export. First a writer publishes synthetic frames that change in
+    random rectangles, move blocks around and once change size, while a reader on its own mapping of the region
+    checks every frame it claims against the checksum of the image the writer published, and rebuilds the image
+    from the dirty rectangles alone to check those too. Also checks that frames larger than the slots are refused
+    and that no more readers attach than the region has claim words for, and that garbage written into the claim
+    words and the header cannot steer where the writer copies, and that frames are neither mapped nor copied while
+    no reader is open, and come whole to the next reader, and that I420 and split I444 frames padded to a pitch
+    wider than their rows come out plane for plane as they went in. Then runs a paced simulated swap-chain at
+    1080p and 4K through a pipeline that exports every frame, with a reader blocked on the wake-up, and reports the
+    publish-to-read latency and what the writer copied per frame.
+
+    Options: --frames N (default 2000, exactness), --seconds N (default 2, per resolution)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/color_convert.h"
+#include "../pipeline/frame_export.h"
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/shared_memory.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // Local rather than Global, which needs the privilege to create global objects
+    const char* const RegionName = "Local\\WinVirtualDisplayFramesBench";
+
+    const uint32_t MaxWidth = 640;
+    const uint32_t MaxHeight = 360;
+    const double FramesPerSecond = 60;
+
+    uint64_t Checksum(const uint8_t* pPixels, uint32_t Pitch, uint32_t Width, uint32_t Height)
+    {
+        uint64_t Hash = 14695981039346656037ull;
+        for (uint32_t Y = 0; Y < Height; Y++)
+        {
+            const uint32_t* pRow = reinterpret_cast<const uint32_t*>(pPixels + static_cast<size_t>(Y) * Pitch);
+            for (uint32_t X = 0; X < Width; X++)
+            {
+                Hash = (Hash ^ pRow[X]) * 1099511628211ull;
+            }
+        }
+        return Hash;
+    }
+
+    Rect RandomRect(mt19937& Random, uint32_t Width, uint32_t Height)
+    {
+        int32_t Left = static_cast<int32_t>(Random() % Width);
+        int32_t Top = static_cast<int32_t>(Random() % Height);
+        int32_t Right = min<int32_t>(Width, Left + 1 + static_cast<int32_t>(Random() % 96));
+        int32_t Bottom = min<int32_t>(Height, Top + 1 + static_cast<int32_t>(Random() % 96));
+        return { Left, Top, Right, Bottom };
+    }
+
+    /// <summary>
+    /// Reader side of the exactness check.
+    /// </summary>
+    struct ExactnessReader
+    {
+        const vector<atomic<uint64_t>>* pChecksums;
+        atomic<bool> Done;
+        uint64_t Read = 0;
+        uint64_t Missed = 0;
+        uint64_t Partial = 0;
+        uint64_t WrongPixels = 0;
+        uint64_t WrongDamage = 0;
+        uint64_t Overwritten = 0;
+        bool Opened = false;
+        atomic<bool> Started;
+
+        void Run()
+        {
+            FrameExportReader Reader;
+            Opened = Reader.Open(RegionName);
+            Started.store(true, memory_order_release);
+
+            vector<uint8_t> Copy;
+            uint32_t CopyWidth = 0, CopyHeight = 0;
+            while (Opened)
+            {
+                bool Finished = Done.load(memory_order_acquire);
+                FrameExportView View;
+                if (!Reader.Acquire(View))
+                {
+                    if (Finished)
+                    {
+                        break;
+                    }
+                    Reader.Wait(10);
+                    continue;
+                }
+
+                const FrameExportSlot& Slot = *View.pSlot;
+                uint64_t Expected = (*pChecksums)[Slot.Sequence].load(memory_order_acquire);
+                WrongPixels += Checksum(View.pPixels, Slot.Pitch, Slot.Width, Slot.Height) != Expected ? 1 : 0;
+
+                // Bring the reader's own image up to date from the damage alone
+                if (View.Damage != DamageState::Partial || Slot.Width != CopyWidth || Slot.Height != CopyHeight)
+                {
+                    CopyWidth = Slot.Width;
+                    CopyHeight = Slot.Height;
+                    Copy.assign(View.pPixels, View.pPixels + static_cast<size_t>(Slot.Pitch) * Slot.Height);
+                }
+                else
+                {
+                    Partial++;
+                    for (uint32_t i = 0; i < View.DirtyRectCount; i++)
+                    {
+                        const Rect& Area = View.pDirtyRects[i];
+                        for (int32_t Y = Area.Top; Y < Area.Bottom; Y++)
+                        {
+                            size_t Offset = static_cast<size_t>(Y) * Slot.Pitch + Area.Left * 4;
+                            memcpy(Copy.data() + Offset, View.pPixels + Offset, (Area.Right - Area.Left) * 4);
+                        }
+                    }
+                }
+                WrongDamage += Checksum(Copy.data(), CopyWidth * 4, CopyWidth, CopyHeight) != Expected ? 1 : 0;
+
+                // The claim kept the writer out of the slot while it was read
+                Overwritten += Slot.Sequence != View.Sequence ? 1 : 0;
+            }
+
+            Read = Reader.FramesAcquired();
+            Missed = Reader.FramesMissed();
+        }
+    };
+
+    int CheckExactness(uint64_t Frames)
+    {
+        FrameExportWriter Writer;
+        if (!Writer.Create(RegionName, MaxWidth, MaxHeight))
+        {
+            printf("  FAILED: cannot create %s\n", RegionName);
+            return 1;
+        }
+
+        vector<atomic<uint64_t>> Checksums(Frames + 1);
+        ExactnessReader Check;
+        Check.pChecksums = &Checksums;
+        Check.Done.store(false);
+        Check.Started.store(false);
+        thread Reader(&ExactnessReader::Run, &Check);
+
+        // Give the reader its claim word before the second reader below tries for one
+        while (!Check.Started.load(memory_order_acquire))
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+
+        FrameExportReader Extra;
+        bool RefusesExtra = !Extra.Open(RegionName);
+
+        mt19937 Random(19);
+        uint32_t Width = MaxWidth, Height = MaxHeight;
+        vector<uint32_t> Image(static_cast<size_t>(MaxWidth) * MaxHeight);
+        vector<Rect> Dirty;
+        vector<MoveRect> Moves;
+
+        for (uint64_t Sequence = 1; Sequence <= Frames; Sequence++)
+        {
+            Frame Frame = {};
+            Dirty.clear();
+            Moves.clear();
+
+            // Halfway through the monitor switches to a smaller mode
+            bool Resized = Sequence == Frames / 2;
+            if (Resized)
+            {
+                Width = MaxWidth / 2;
+                Height = MaxHeight / 2;
+            }
+
+            if (Sequence == 1 || Resized || Sequence % 97 == 0)
+            {
+                for (size_t i = 0; i < static_cast<size_t>(Width) * Height; i++)
+                {
+                    Image[i] = static_cast<uint32_t>(Sequence * 2654435761u + i);
+                }
+                Frame.Damage = DamageState::Full;
+            }
+            else
+            {
+                // A block moved to a new spot, then a few repainted rectangles that do not overlap each other
+                if (Sequence % 5 == 0)
+                {
+                    Rect Target = RandomRect(Random, Width, Height);
+                    int32_t SourceX = static_cast<int32_t>(Random() % (Width - (Target.Right - Target.Left) + 1));
+                    int32_t SourceY = static_cast<int32_t>(Random() % (Height - (Target.Bottom - Target.Top) + 1));
+                    vector<uint32_t> Block;
+                    for (int32_t Y = 0; Y < Target.Bottom - Target.Top; Y++)
+                    {
+                        const uint32_t* pRow = &Image[static_cast<size_t>(SourceY + Y) * Width + SourceX];
+                        Block.insert(Block.end(), pRow, pRow + (Target.Right - Target.Left));
+                    }
+                    for (int32_t Y = Target.Top; Y < Target.Bottom; Y++)
+                    {
+                        memcpy(&Image[static_cast<size_t>(Y) * Width + Target.Left], &Block[static_cast<size_t>(Y - Target.Top) * (Target.Right - Target.Left)],
+                            (Target.Right - Target.Left) * 4);
+                    }
+                    Moves.push_back({ SourceX, SourceY, Target });
+                }
+
+                Region Painted;
+                uint32_t Count = 1 + Random() % 4;
+                for (uint32_t i = 0; i < Count; i++)
+                {
+                    Painted.Union(RandomRect(Random, Width, Height));
+                }
+                for (const Rect& Area : Painted)
+                {
+                    for (int32_t Y = Area.Top; Y < Area.Bottom; Y++)
+                    {
+                        for (int32_t X = Area.Left; X < Area.Right; X++)
+                        {
+                            Image[static_cast<size_t>(Y) * Width + X] = static_cast<uint32_t>(Sequence * 40503u + X * 7 + Y);
+                        }
+                    }
+                    Dirty.push_back(Area);
+                }
+                Frame.Damage = DamageState::Partial;
+            }
+
+            Frame.FrameNumber = Sequence;
+            Frame.Width = Width;
+            Frame.Height = Height;
+            Frame.Pitch = Width * 4;
+            Frame.Format = PixelFormat::Bgra8;
+            Frame.pData = reinterpret_cast<uint8_t*>(Image.data());
+            Frame.DirtyRectCount = static_cast<uint32_t>(Dirty.size());
+            Frame.pDirtyRects = Dirty.data();
+            Frame.MoveRectCount = static_cast<uint32_t>(Moves.size());
+            Frame.pMoveRects = Moves.data();
+
+            Checksums[Sequence].store(Checksum(Frame.pData, Frame.Pitch, Width, Height), memory_order_release);
+            Writer.Write(Frame);
+
+            // Let the reader keep up with most frames, so most of them arrive as partial updates
+            if (Sequence % 4 != 0)
+            {
+                this_thread::sleep_for(chrono::microseconds(50));
+            }
+        }
+
+        Check.Done.store(true, memory_order_release);
+        Reader.join();
+
+        // A frame larger than the slots, and one with no pixels
+        Frame Large = {};
+        Large.Width = MaxWidth * 2;
+        Large.Height = MaxHeight;
+        Large.Pitch = Large.Width * 4;
+        Large.Format = PixelFormat::Bgra8;
+        vector<uint8_t> LargePixels(static_cast<size_t>(Large.Pitch) * Large.Height);
+        Large.pData = LargePixels.data();
+        bool RefusesLarge = !Writer.Write(Large);
+        Large.pData = nullptr;
+        Large.Width = MaxWidth;
+        bool RefusesUnmapped = !Writer.Write(Large);
+
+        // The claim word of the finished reader is free again
+        bool ReusesClaim = Extra.Open(RegionName);
+
+        FrameExportStatistics Statistics = Writer.Statistics();
+        double FullBytes = static_cast<double>(MaxWidth) * MaxHeight * 4;
+        printf("%llu frames published, %llu read (%llu missed, %llu partial): %llu with wrong pixels, %llu wrong after "
+            "applying dirty rectangles, %llu overwritten while claimed\n",
+            static_cast<unsigned long long>(Statistics.FramesPublished), static_cast<unsigned long long>(Check.Read),
+            static_cast<unsigned long long>(Check.Missed), static_cast<unsigned long long>(Check.Partial),
+            static_cast<unsigned long long>(Check.WrongPixels), static_cast<unsigned long long>(Check.WrongDamage),
+            static_cast<unsigned long long>(Check.Overwritten));
+        printf("copied %.1f%% of the bytes full frames would have taken\n",
+            100.0 * Statistics.BytesCopied / (FullBytes * Statistics.FramesPublished));
+
+        if (!Check.Opened || Check.Read == 0 || Check.Partial == 0 || Check.WrongPixels != 0 || Check.WrongDamage != 0 ||
+            Check.Overwritten != 0 || Statistics.FramesPublished != Frames || !RefusesExtra || !RefusesLarge || !RefusesUnmapped || !ReusesClaim)
+        {
+            printf("  FAILED: exactness (opened %d, refuses extra reader %d, large %d, unmapped %d, reuses claim %d)\n",
+                Check.Opened, RefusesExtra, RefusesLarge, RefusesUnmapped, ReusesClaim);
+            return 1;
+        }
+        return 0;
+    }
+
+    // What anyone who can map the region writes must not move the writer's copies: garbage in every claim word and
+    // a scribbled layout in the header, which only the owner can write, still leave each frame in a slot of its own
+    int CheckTampering()
+    {
+        FrameExportWriter Writer;
+        FrameExportReader Reader;
+        SharedMemory Control, Data;
+        if (!Writer.Create(RegionName, MaxWidth, MaxHeight) || !Reader.Open(RegionName) ||
+            !Control.Open((string(RegionName) + FrameExportControlSuffix).c_str(), true) || !Data.Open(RegionName, true))
+        {
+            printf("  FAILED: cannot map %s for tampering\n", RegionName);
+            return 1;
+        }
+
+        vector<uint32_t> Image(static_cast<size_t>(MaxWidth) * MaxHeight);
+        Frame Frame = {};
+        Frame.Width = MaxWidth;
+        Frame.Height = MaxHeight;
+        Frame.Pitch = MaxWidth * 4;
+        Frame.Format = PixelFormat::Bgra8;
+        Frame.Damage = DamageState::Full;
+        Frame.pData = reinterpret_cast<uint8_t*>(Image.data());
+
+        FrameExportControl* pControl = static_cast<FrameExportControl*>(Control.Data());
+        FrameExportHeader* pHeader = static_cast<FrameExportHeader*>(Data.Data());
+        uint32_t SlotCount = pHeader->SlotCount, ReaderCount = pHeader->ReaderCount, PixelOffset = pHeader->PixelOffset;
+        uint64_t FirstSlotOffset = pHeader->FirstSlotOffset, SlotSize = pHeader->SlotSize;
+
+        bool Published = true;
+        for (uint32_t Round = 0; Round < 8; Round++)
+        {
+            for (uint32_t i = 0; i < FrameExportMaxReaders; i++)
+            {
+                pControl->Claims[i].store(0xDEADBEEFu + Round * i, memory_order_seq_cst);
+                pControl->Waiting[i].store(1, memory_order_seq_cst);
+            }
+            pHeader->SlotCount = 0xFFFFFF00u + Round;
+            pHeader->ReaderCount = 0xFFFFFFFFu;
+            pHeader->FirstSlotOffset = 0x7FFFFFFF00000000ull;
+            pHeader->SlotSize = Round;
+            pHeader->PixelOffset = 0xFFFFFFFFu;
+
+            fill(Image.begin(), Image.end(), Round * 2654435761u);
+            Published &= Writer.Write(Frame);
+        }
+
+        // Put the layout back and hand the reader its claim word again; it then reads the last frame intact
+        pHeader->SlotCount = SlotCount;
+        pHeader->ReaderCount = ReaderCount;
+        pHeader->FirstSlotOffset = FirstSlotOffset;
+        pHeader->SlotSize = SlotSize;
+        pHeader->PixelOffset = PixelOffset;
+        for (uint32_t i = 0; i < FrameExportMaxReaders; i++)
+        {
+            pControl->Claims[i].store(i == 0 ? FrameExportNoSlot : FrameExportNoReader, memory_order_seq_cst);
+            pControl->Waiting[i].store(0, memory_order_seq_cst);
+        }
+
+        FrameExportView View;
+        bool Intact = Reader.Acquire(View) && View.Sequence == 8 &&
+            Checksum(View.pPixels, View.pSlot->Pitch, MaxWidth, MaxHeight) == Checksum(Frame.pData, Frame.Pitch, MaxWidth, MaxHeight);
+
+        printf("tampered claim words and header: %s\n", Published && Intact ? "frames still published intact" : "FAILED");
+        if (!Published || !Intact)
+        {
+            printf("  FAILED: tampering (published %d, intact %d)\n", Published, Intact);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Without readers nothing is mapped or copied, and the first frame a reader gets afterwards is whole, even when
+    // the frame itself only repaints a corner
+    int CheckIdle()
+    {
+        auto Writer = make_shared<FrameExportWriter>();
+        if (!Writer->Create(RegionName, MaxWidth, MaxHeight))
+        {
+            printf("  FAILED: cannot create %s\n", RegionName);
+            return 1;
+        }
+
+        SimulatedSwapChain SwapChain(MaxWidth, MaxHeight, 0, 100);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.SetSink(make_shared<FrameExportSink>(Writer));
+        Pipeline.RunCore();
+
+        // The sink never even saw a frame, so none was mapped for it
+        FrameExportStatistics Idle = Writer->Statistics();
+        bool Unmapped = Pipeline.Statistics().FramesAcquired == 100 && Idle.FramesPublished == 0 && Idle.FramesSkipped == 0;
+
+        vector<uint32_t> Image(static_cast<size_t>(MaxWidth) * MaxHeight);
+        Rect Corner = { 0, 0, 16, 16 };
+        Frame Frame = {};
+        Frame.Width = MaxWidth;
+        Frame.Height = MaxHeight;
+        Frame.Pitch = MaxWidth * 4;
+        Frame.Format = PixelFormat::Bgra8;
+        Frame.pData = reinterpret_cast<uint8_t*>(Image.data());
+        Frame.Damage = DamageState::Partial;
+        Frame.DirtyRectCount = 1;
+        Frame.pDirtyRects = &Corner;
+
+        // Published while a reader is open, then changed everywhere while nobody reads
+        FrameExportReader Reader;
+        bool Whole = Reader.Open(RegionName);
+        fill(Image.begin(), Image.end(), 1u);
+        Frame.Damage = DamageState::Full;
+        Whole = Whole && Writer->Write(Frame);
+        Reader.Close();
+
+        fill(Image.begin(), Image.end(), 2u);
+        Whole = Whole && Writer->Write(Frame) && Writer->Statistics().FramesSkipped == 1;
+
+        Image[0] = 3;
+        Frame.Damage = DamageState::Partial;
+        FrameExportView View;
+        Whole = Whole && Reader.Open(RegionName) && Writer->Write(Frame) && Reader.Acquire(View) &&
+            View.Damage == DamageState::Full && View.pSlot->Damage == DamageState::Full &&
+            Checksum(View.pPixels, View.pSlot->Pitch, MaxWidth, MaxHeight) == Checksum(Frame.pData, Frame.Pitch, MaxWidth, MaxHeight);
+
+        printf("no reader: %llu frames acquired, %llu handed to the sink; first frame after a reader attaches %s\n",
+            static_cast<unsigned long long>(Pipeline.Statistics().FramesAcquired),
+            static_cast<unsigned long long>(Idle.FramesPublished + Idle.FramesSkipped), Whole ? "whole" : "FAILED");
+        if (!Unmapped || !Whole)
+        {
+            printf("  FAILED: idle export (unmapped %d, whole %d)\n", Unmapped, Whole);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Samples of the I420 picture at pActual that differ from the one at pExpected
+    size_t WrongI420Samples(const uint8_t* pExpected, uint32_t ExpectedPitch, const uint8_t* pActual, uint32_t ActualPitch,
+        uint32_t Width, uint32_t Height)
+    {
+        YuvPlanes Expected = MakeYuvPlanes(const_cast<uint8_t*>(pExpected), ExpectedPitch, Height, PixelFormat::I420);
+        YuvPlanes Actual = MakeYuvPlanes(const_cast<uint8_t*>(pActual), ActualPitch, Height, PixelFormat::I420);
+
+        size_t Wrong = 0;
+        auto ComparePlane = [&](const uint8_t* pE, uint32_t EPitch, const uint8_t* pA, uint32_t APitch, uint32_t W, uint32_t H)
+        {
+            for (uint32_t Y = 0; Y < H; Y++)
+            {
+                for (uint32_t X = 0; X < W; X++)
+                {
+                    Wrong += pE[static_cast<size_t>(Y) * EPitch + X] != pA[static_cast<size_t>(Y) * APitch + X] ? 1 : 0;
+                }
+            }
+        };
+        ComparePlane(Expected.pY, Expected.YPitch, Actual.pY, Actual.YPitch, Width, Height);
+        ComparePlane(Expected.pU, Expected.UPitch, Actual.pU, Actual.UPitch, (Width + 1) / 2, (Height + 1) / 2);
+        ComparePlane(Expected.pV, Expected.VPitch, Actual.pV, Actual.VPitch, (Width + 1) / 2, (Height + 1) / 2);
+        return Wrong;
+    }
+
+    // YUV frames whose width is no multiple of the pool's pitch alignment keep every plane, chroma included, on their
+    // way through the export
+    int CheckYuv()
+    {
+        const uint32_t Width = 630, Height = 350;
+        const uint32_t Pitch = 640;     // as FrameBufferPool pads it
+
+        FrameExportWriter Writer;
+        FrameExportReader Reader;
+        if (!Writer.Create(RegionName, MaxWidth, MaxHeight) || !Reader.Open(RegionName))
+        {
+            printf("  FAILED: cannot create %s for YUV frames\n", RegionName);
+            return 1;
+        }
+
+        mt19937 Random(19);
+        vector<uint32_t> Image(static_cast<size_t>(Width) * Height);
+        for (uint32_t& Pixel : Image)
+        {
+            Pixel = Random();
+        }
+
+        int Failures = 0;
+        for (PixelFormat Format : { PixelFormat::I420, PixelFormat::I444Split })
+        {
+            vector<uint8_t> Converted(static_cast<size_t>(Pitch) * FrameRows(Format, Height));
+            Frame Frame = {};
+            Frame.Width = Width;
+            Frame.Height = Height;
+            Frame.Pitch = Pitch;
+            Frame.Format = Format;
+            Frame.Damage = DamageState::Full;
+            Frame.pData = Converted.data();
+
+            FrameExportView View;
+            bool Read = ConvertBgraFrame(reinterpret_cast<const uint8_t*>(Image.data()), Width * 4, Width, Height, Converted.data(),
+                Pitch, Format, ColorMatrix::Bt709, ColorRange::Limited) && Writer.Write(Frame) && Reader.Acquire(View) &&
+                View.pSlot->Format == Format && View.pSlot->Width == Width && View.pSlot->Height == Height;
+
+            // The split is two I420 pictures, the residual right after the main view
+            size_t Samples = static_cast<size_t>(Width) * Height + 2 * static_cast<size_t>((Width + 1) / 2) * ((Height + 1) / 2);
+            size_t Wrong = 0;
+            uint32_t Pictures = Format == PixelFormat::I444Split ? 2 : 1;
+            for (uint32_t i = 0; Read && i < Pictures; i++)
+            {
+                size_t Rows = static_cast<size_t>(i) * FrameRows(PixelFormat::I420, Height);
+                Wrong += WrongI420Samples(Converted.data() + Rows * Pitch, Pitch, View.pPixels + Rows * View.pSlot->Pitch,
+                    View.pSlot->Pitch, Width, Height);
+            }
+
+            printf("%s %ux%u at pitch %u: %zu of %zu samples wrong after the export\n", Format == PixelFormat::I420 ? "I420" : "I444 split",
+                Width, Height, Pitch, Wrong, Samples * Pictures);
+            if (!Read || Wrong != 0)
+            {
+                printf("  FAILED: YUV export (read %d, %zu samples wrong)\n", Read, Wrong);
+                Failures = 1;
+            }
+        }
+        return Failures;
+    }
+
+    int MeasureLatency(const Bench::Resolution& Mode, double Seconds)
+    {
+        auto Writer = make_shared<FrameExportWriter>();
+        if (!Writer->Create(RegionName, Mode.Width, Mode.Height))
+        {
+            printf("  FAILED: cannot create %s for %s\n", RegionName, Mode.Name);
+            return 1;
+        }
+
+        atomic<bool> Done(false);
+        vector<double> PublishToRead, AcquireToRead;
+        bool Opened = false;
+        uint64_t Missed = 0;
+        thread Consumer([&] {
+            FrameExportReader Reader;
+            Opened = Reader.Open(RegionName);
+            while (Opened)
+            {
+                FrameExportView View;
+                if (Reader.Wait(100) && Reader.Acquire(View))
+                {
+                    uint64_t Now = MonotonicNanoseconds();
+                    PublishToRead.push_back((Now - View.pSlot->PublishTime) / 1e3);
+                    AcquireToRead.push_back((Now - View.pSlot->AcquireTime) / 1e3);
+                    Reader.Release();
+                }
+                else if (Done.load(memory_order_acquire))
+                {
+                    break;
+                }
+            }
+            Missed = Reader.FramesMissed();
+        });
+
+        uint64_t Frames = static_cast<uint64_t>(Seconds * FramesPerSecond);
+        SimulatedSwapChain SwapChain(Mode.Width, Mode.Height, FramesPerSecond, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.SetSink(make_shared<FrameExportSink>(Writer));
+        Pipeline.SetAsyncProcessing(3);
+        Pipeline.RunCore();
+
+        Done.store(true, memory_order_release);
+        Consumer.join();
+
+        FrameExportStatistics Statistics = Writer->Statistics();
+        size_t Read = PublishToRead.size();
+        double FullBytes = static_cast<double>(Mode.Width) * Mode.Height * 4;
+        printf("%-6s %8llu %8zu %8llu %10.1f %10.1f %10.1f %12.1f %12.2f\n", Mode.Name,
+            static_cast<unsigned long long>(Statistics.FramesPublished), Read, static_cast<unsigned long long>(Missed),
+            Read ? Bench::Percentile(PublishToRead, 50) : 0, Read ? Bench::Percentile(PublishToRead, 99) : 0,
+            Read ? Bench::Percentile(PublishToRead, 100) : 0, Read ? Bench::Percentile(AcquireToRead, 50) : 0,
+            Statistics.FramesPublished ? Statistics.BytesCopied / (FullBytes * Statistics.FramesPublished) * 100 : 0);
+
+        if (!Opened || Statistics.FramesPublished == 0 || Read == 0 || Read + Missed != Statistics.FramesPublished)
+        {
+            printf("  FAILED: %s export (opened %d)\n", Mode.Name, Opened);
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int BenchExport(int argc, char* argv[])
+{
+    uint64_t Frames = max<uint64_t>(8, Bench::ParseOption(argc, argv, "frames", 2000));
+    double Seconds = static_cast<double>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "seconds", 2)));
+
+    int Failures = CheckExactness(Frames);
+    Failures |= CheckTampering();
+    Failures |= CheckIdle();
+    Failures |= CheckYuv();
+
+    printf("\npaced %.0f fps swap-chain exported through a pipeline, one blocking reader [us]\n", FramesPerSecond);
+    printf("%-6s %8s %8s %8s %10s %10s %10s %12s %12s\n", "mode", "frames", "read", "missed", "pub p50", "pub p99", "pub max",
+        "acquire p50", "copied [%]");
+    // 1080p and 4K
+    Failures |= MeasureLatency(Bench::StandardResolutions[0], Seconds);
+    Failures |= MeasureLatency(Bench::StandardResolutions[2], Seconds);
+
+    printf("\nframe export: %s\n", Failures == 0 ? "exact" : "FAILED");
+    return Failures;
+}
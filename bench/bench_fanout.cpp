@@ -0,0 +1,411 @@
+/*++
+
+Module Name:
+
+    bench_fanout.cpp
+
+Abstract:
+
+    Checks and measures the fan-out sink. First publishes synthetic frames to subscribers that come and go, and
+    checks that a late subscriber starts with a full frame, that an unsubscribed one receives nothing more, that
+    frames are copied once however many subscribers there are and that every buffer goes back to the pool, and
+    that a Block subscriber stuck waiting for room does not delay frames for a subscriber behind it. Then
+    runs a paced 4K simulated swap-chain through a pipeline into 1, 4 and 16 subscribers, with the three
+    backpressure policies taking turns, each holding its frames for a while and checking that the pixels did not
+    change under it. The table compares sharing one buffer per frame with copying it for every subscriber: time
+    spent publishing a frame, per frame and per subscriber, and the peak memory of the frame pools.
+
+    Options: --seconds N (default 2, per configuration), --hold-us N (default 2000, per frame of a subscriber)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame_fanout.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const double FramesPerSecond = 60;
+    const uint32_t SubscriberCounts[] = { 1, 4, 16 };
+    const BackpressurePolicy Policies[] = { BackpressurePolicy::LatestWins, BackpressurePolicy::DropOldest, BackpressurePolicy::Block };
+
+    // Hash of every 16th row, enough to notice a buffer being reused under a subscriber
+    uint64_t SampledChecksum(const Frame& Frame)
+    {
+        uint64_t Hash = 14695981039346656037ull;
+        uint32_t RowBytes = Frame.Width * BytesPerPixel(Frame.Format);
+        for (uint32_t Y = 0; Y < Frame.Height; Y += 16)
+        {
+            const uint64_t* pRow = reinterpret_cast<const uint64_t*>(Frame.pData + static_cast<size_t>(Y) * Frame.Pitch);
+            for (uint32_t X = 0; X < RowBytes / 8; X += 8)
+            {
+                Hash = (Hash ^ pRow[X]) * 1099511628211ull;
+            }
+        }
+        return Hash;
+    }
+
+    /// <summary>
+    /// Records what a subscriber received.
+    /// </summary>
+    class RecordingConsumer : public IFrameSink
+    {
+    public:
+        explicit RecordingConsumer(uint64_t HoldUs = 0) : m_HoldUs(HoldUs) {}
+
+        void Consume(const Frame& Frame) override
+        {
+            if (Received == 0)
+            {
+                FirstDamage = Frame.Damage;
+            }
+            Received++;
+            LastFrame = Frame.FrameNumber;
+
+            if (m_HoldUs != 0)
+            {
+                uint64_t Before = SampledChecksum(Frame);
+                this_thread::sleep_for(chrono::microseconds(m_HoldUs));
+                Changed += SampledChecksum(Frame) != Before ? 1 : 0;
+            }
+        }
+
+        uint64_t Received = 0;
+        uint64_t LastFrame = 0;
+        uint64_t Changed = 0;
+        DamageState FirstDamage = DamageState::Unknown;
+
+    private:
+        uint64_t m_HoldUs;
+    };
+
+    int CheckSubscriptions()
+    {
+        const uint32_t Width = 256, Height = 64;
+        auto Pool = make_shared<FrameBufferPool>();
+        FrameFanOut FanOut(Pool);
+        vector<uint8_t> Pixels(static_cast<size_t>(Width) * Height * 4);
+        Rect Dirty = { 0, 0, 16, 16 };
+
+        auto Publish = [&](uint64_t Number) {
+            Frame Frame = {};
+            memset(Pixels.data(), static_cast<int>(Number), Pixels.size());
+            Frame.FrameNumber = Number;
+            Frame.Width = Width;
+            Frame.Height = Height;
+            Frame.Pitch = Width * 4;
+            Frame.Format = PixelFormat::Bgra8;
+            Frame.pData = Pixels.data();
+            Frame.Damage = DamageState::Partial;
+            Frame.DirtyRectCount = 1;
+            Frame.pDirtyRects = &Dirty;
+            FanOut.Consume(Frame);
+        };
+
+        auto Early = make_shared<RecordingConsumer>();
+        auto Late = make_shared<RecordingConsumer>();
+        auto EarlySink = FanOut.Subscribe(Early, BackpressurePolicy::Block, 8, 1000);
+        for (uint64_t Number = 1; Number <= 5; Number++)
+        {
+            Publish(Number);
+        }
+        auto LateSink = FanOut.Subscribe(Late, BackpressurePolicy::Block, 8, 1000);
+        for (uint64_t Number = 6; Number <= 10; Number++)
+        {
+            Publish(Number);
+        }
+        FanOut.Unsubscribe(EarlySink);
+        for (uint64_t Number = 11; Number <= 15; Number++)
+        {
+            Publish(Number);
+        }
+        size_t Remaining = FanOut.SubscriberCount();
+        FanOut.Stop();
+
+        FanOutStatistics Statistics = FanOut.Statistics();
+        bool Subscriptions = Early->Received == 10 && Early->LastFrame == 10 && Late->Received == 10 && Late->LastFrame == 15 &&
+            Late->FirstDamage == DamageState::Full && Remaining == 1 && FanOut.SubscriberCount() == 0;
+        bool CopiedOnce = Statistics.FramesPublished == 15 && Statistics.FramesCopied == 15 && Statistics.Deliveries == 20 &&
+            EarlySink->Statistics().FramesCopied == 0 && LateSink->Statistics().FramesCopied == 0;
+        bool Returned = Pool->Statistics().OutstandingBuffers == 0;
+
+        printf("subscriptions: early %llu frames up to %llu, late %llu frames up to %llu starting %s; %llu published, "
+            "%llu copied, %llu deliveries\n",
+            static_cast<unsigned long long>(Early->Received), static_cast<unsigned long long>(Early->LastFrame),
+            static_cast<unsigned long long>(Late->Received), static_cast<unsigned long long>(Late->LastFrame),
+            Late->FirstDamage == DamageState::Full ? "full" : "partial", static_cast<unsigned long long>(Statistics.FramesPublished),
+            static_cast<unsigned long long>(Statistics.FramesCopied), static_cast<unsigned long long>(Statistics.Deliveries));
+
+        if (!Subscriptions || !CopiedOnce || !Returned)
+        {
+            printf("  FAILED: subscriptions (subscriptions %d, copied once %d, buffers returned %d)\n", Subscriptions,
+                CopiedOnce, Returned);
+            return 1;
+        }
+        return 0;
+    }
+
+    /// <summary>
+    /// Records how long after it was published each frame reached a subscriber.
+    /// </summary>
+    class LatencyConsumer : public IFrameSink
+    {
+    public:
+        explicit LatencyConsumer(const vector<uint64_t>* pPublishTimes) : m_pPublishTimes(pPublishTimes) {}
+
+        void Consume(const Frame& Frame) override
+        {
+            Latencies.push_back((MonotonicNanoseconds() - (*m_pPublishTimes)[Frame.FrameNumber]) / 1e3);
+        }
+
+        vector<double> Latencies;
+
+    private:
+        const vector<uint64_t>* m_pPublishTimes;
+    };
+
+    // A Block subscriber whose consumer stalls, subscribed first, waits out its timeout on the publishing thread
+    // for most frames; a LatestWins subscriber behind it must still get every frame at once
+    int CheckBlockingSubscriber()
+    {
+        const uint32_t Width = 256, Height = 64, Frames = 40, BlockTimeoutMs = 30;
+        FrameFanOut FanOut;
+        vector<uint8_t> Pixels(static_cast<size_t>(Width) * Height * 4);
+        vector<uint64_t> PublishTimes(Frames + 1);
+
+        auto Stalled = make_shared<RecordingConsumer>(100000);
+        auto Prompt = make_shared<LatencyConsumer>(&PublishTimes);
+        auto StalledSink = FanOut.Subscribe(Stalled, BackpressurePolicy::Block, 1, BlockTimeoutMs);
+        auto PromptSink = FanOut.Subscribe(Prompt, BackpressurePolicy::LatestWins);
+
+        vector<double> PublishTime;
+        for (uint64_t Number = 1; Number <= Frames; Number++)
+        {
+            Frame Frame = {};
+            Frame.FrameNumber = Number;
+            Frame.Width = Width;
+            Frame.Height = Height;
+            Frame.Pitch = Width * 4;
+            Frame.Format = PixelFormat::Bgra8;
+            Frame.pData = Pixels.data();
+            Frame.Damage = DamageState::Full;
+
+            PublishTimes[Number] = MonotonicNanoseconds();
+            FanOut.Consume(Frame);
+            PublishTime.push_back((MonotonicNanoseconds() - PublishTimes[Number]) / 1e3);
+        }
+        FanOut.Unsubscribe(PromptSink);
+        FanOut.Stop();
+
+        size_t Received = Prompt->Latencies.size();
+        double Latency = Received ? Bench::Percentile(Prompt->Latencies, 50) : 0;
+        printf("stalled Block subscriber first: publishing takes %.1f ms (p50), the LatestWins one behind it receives "
+            "%zu of %u frames %.1f us (p50) after they are published, %llu rejected by the Block one\n",
+            Bench::Percentile(PublishTime, 50) / 1e3, Received, Frames, Latency,
+            static_cast<unsigned long long>(StalledSink->Statistics().FramesRejected));
+
+        // Had the Block subscriber been offered frames first, most would reach the other one BlockTimeoutMs late.
+        // LatestWins may replace a frame its consumer has not picked up yet.
+        if (Received < Frames * 3 / 4 || Latency > BlockTimeoutMs * 1e3 / 2)
+        {
+            printf("  FAILED: blocking subscriber (received %zu, p50 latency %.1f us)\n", Received, Latency);
+            return 1;
+        }
+        return 0;
+    }
+
+    /// <summary>
+    /// The alternative to sharing: every subscriber gets a copy of its own, from a pool of its own.
+    /// </summary>
+    class CopyingFanOut : public IFrameSink
+    {
+    public:
+        void Subscribe(shared_ptr<IFrameSink> Consumer, BackpressurePolicy Policy)
+        {
+            m_Pools.push_back(make_shared<FrameBufferPool>());
+            m_Sinks.push_back(make_shared<BackpressureSink>(Consumer, Policy, 3, 20, m_Pools.back()));
+        }
+
+        void Consume(const Frame& Published) override
+        {
+            for (size_t i = 0; i < m_Sinks.size(); i++)
+            {
+                FrameBufferRef Buffer = m_Pools[i]->Acquire({ Published.Width, Published.Height, Published.Format });
+                Frame Copy = Published;
+                uint32_t RowBytes = Published.Width * BytesPerPixel(Published.Format);
+                for (uint32_t Y = 0; Y < Published.Height; Y++)
+                {
+                    memcpy(Buffer->Data() + static_cast<size_t>(Y) * Buffer->Pitch(),
+                        Published.pData + static_cast<size_t>(Y) * Published.Pitch, RowBytes);
+                }
+                Copy.pData = Buffer->Data();
+                Copy.Pitch = Buffer->Pitch();
+                Copy.pBuffer = Buffer.Get();
+                m_Sinks[i]->Consume(Copy);
+            }
+        }
+
+        void Stop()
+        {
+            for (auto& Sink : m_Sinks)
+            {
+                Sink->Stop();
+            }
+        }
+
+        uint64_t ResidentBytes() const
+        {
+            uint64_t Bytes = 0;
+            for (auto& Pool : m_Pools)
+            {
+                Bytes += Pool->Statistics().ResidentBytes;
+            }
+            return Bytes;
+        }
+
+        const vector<shared_ptr<BackpressureSink>>& Sinks() const { return m_Sinks; }
+
+    private:
+        vector<shared_ptr<FrameBufferPool>> m_Pools;
+        vector<shared_ptr<BackpressureSink>> m_Sinks;
+    };
+
+    /// <summary>
+    /// Times whichever fan-out it wraps, and keeps the peak memory of the frame pools.
+    /// </summary>
+    class TimedSink : public IFrameSink
+    {
+    public:
+        TimedSink(shared_ptr<IFrameSink> Target, shared_ptr<FrameBufferPool> Pool, const CopyingFanOut* pCopies)
+            : m_Target(Target), m_Pool(Pool), m_pCopies(pCopies)
+        {
+        }
+
+        void Consume(const Frame& Frame) override
+        {
+            uint64_t Start = MonotonicNanoseconds();
+            m_Target->Consume(Frame);
+            Times.push_back((MonotonicNanoseconds() - Start) / 1e3);
+
+            uint64_t Resident = m_Pool->Statistics().ResidentBytes + (m_pCopies ? m_pCopies->ResidentBytes() : 0);
+            PeakResident = max(PeakResident, Resident);
+        }
+
+        vector<double> Times;
+        uint64_t PeakResident = 0;
+
+    private:
+        shared_ptr<IFrameSink> m_Target;
+        shared_ptr<FrameBufferPool> m_Pool;
+        const CopyingFanOut* m_pCopies;
+    };
+
+    int Measure(uint32_t Subscribers, bool Share, double Seconds, uint64_t HoldUs)
+    {
+        const Bench::Resolution& Mode = Bench::StandardResolutions[2];
+        auto Pool = make_shared<FrameBufferPool>();
+        auto FanOut = make_shared<FrameFanOut>(Pool);
+        auto Copies = make_shared<CopyingFanOut>();
+        vector<shared_ptr<RecordingConsumer>> Consumers;
+        vector<shared_ptr<BackpressureSink>> Sinks;
+
+        for (uint32_t i = 0; i < Subscribers; i++)
+        {
+            Consumers.push_back(make_shared<RecordingConsumer>(HoldUs));
+            if (Share)
+            {
+                Sinks.push_back(FanOut->Subscribe(Consumers.back(), Policies[i % 3]));
+            }
+            else
+            {
+                Copies->Subscribe(Consumers.back(), Policies[i % 3]);
+            }
+        }
+        if (!Share)
+        {
+            Sinks = Copies->Sinks();
+        }
+
+        shared_ptr<IFrameSink> Target = Share ? static_pointer_cast<IFrameSink>(FanOut) : static_pointer_cast<IFrameSink>(Copies);
+        auto Timed = make_shared<TimedSink>(Target, Pool, Share ? nullptr : Copies.get());
+
+        uint64_t Frames = static_cast<uint64_t>(Seconds * FramesPerSecond);
+        SimulatedSwapChain SwapChain(Mode.Width, Mode.Height, FramesPerSecond, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.SetSink(Timed);
+        Pipeline.SetAsyncProcessing(3);
+        Pipeline.SetBufferPool(Pool);
+        Pipeline.RunCore();
+        FanOut->Stop();
+        Copies->Stop();
+
+        uint64_t Published = Timed->Times.size();
+        uint64_t Delivered = 0, Dropped = 0, Copied = 0, Changed = 0;
+        bool Accounted = true;
+        for (uint32_t i = 0; i < Subscribers; i++)
+        {
+            BackpressureStatistics Statistics = Sinks[i]->Statistics();
+            Delivered += Statistics.FramesDelivered;
+            Dropped += Statistics.FramesDropped + Statistics.FramesRejected;
+            Copied += Statistics.FramesCopied;
+            Changed += Consumers[i]->Changed;
+            Accounted = Accounted && Statistics.FramesAccepted + Statistics.FramesRejected == Published &&
+                Statistics.FramesDelivered + Statistics.FramesDropped == Statistics.FramesAccepted &&
+                Consumers[i]->Received == Statistics.FramesDelivered;
+        }
+
+        double P50 = Published ? Bench::Percentile(Timed->Times, 50) : 0;
+        printf("%4u %-7s %8llu %10.1f %10.1f %10.1f %12.1f %10llu %10llu\n", Subscribers, Share ? "shared" : "copied",
+            static_cast<unsigned long long>(Published), P50, Published ? Bench::Percentile(Timed->Times, 99) : 0,
+            P50 / Subscribers, Timed->PeakResident / 1048576.0, static_cast<unsigned long long>(Delivered),
+            static_cast<unsigned long long>(Dropped));
+
+        bool Returned = Pool->Statistics().OutstandingBuffers == 0;
+        bool ZeroCopy = !Share || (Copied == 0 && FanOut->Statistics().FramesCopied == 0);
+        if (Published == 0 || !Accounted || Changed != 0 || !Returned || !ZeroCopy)
+        {
+            printf("  FAILED: %u %s subscribers (accounted %d, changed under a subscriber %llu, buffers returned %d, "
+                "zero copy %d)\n", Subscribers, Share ? "shared" : "copied", Accounted, static_cast<unsigned long long>(Changed),
+                Returned, ZeroCopy);
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int BenchFanOut(int argc, char* argv[])
+{
+    double Seconds = static_cast<double>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "seconds", 2)));
+    uint64_t HoldUs = Bench::ParseOption(argc, argv, "hold-us", 2000);
+
+    int Failures = CheckSubscriptions();
+    Failures |= CheckBlockingSubscriber();
+
+    printf("\npaced %.0f fps 4K swap-chain into subscribers holding each frame %.1f ms; publish time [us], pools [MB]\n",
+        FramesPerSecond, HoldUs / 1e3);
+    printf("%4s %-7s %8s %10s %10s %10s %12s %10s %10s\n", "subs", "pixels", "frames", "p50", "p99", "p50/sub", "peak pools",
+        "delivered", "dropped");
+    for (uint32_t Subscribers : SubscriberCounts)
+    {
+        Failures |= Measure(Subscribers, true, Seconds, HoldUs);
+        Failures |= Measure(Subscribers, false, Seconds, HoldUs);
+    }
+
+    printf("\nframe fan-out: %s\n", Failures == 0 ? "exact" : "FAILED");
+    return Failures;
+}
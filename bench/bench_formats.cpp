@@ -0,0 +1,331 @@
+/*++
+
+Module Name:
+
+    bench_formats.cpp
+
+Abstract:
+
+    Checks and measures the per-frame format cache. First several threads at once ask the cache of each of a
+    series of frames for NV12 and I444: every answer must match a direct conversion, each format must be converted
+    once per frame however many threads asked, and the formats nobody asked for must count as avoided. Then a
+    paced simulated swap-chain runs through a pipeline with a format cache stage into a fan-out whose subscribers each
+    want one format, for several mixes of subscribers, and the table compares the conversions the cache did, and the
+    CPU time per frame, with converting every frame into every offered format up front.
+
+    Options: --frames N (default 120, per subscriber mix)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/color_convert.h"
+#include "../pipeline/format_cache.h"
+#include "../pipeline/frame_fanout.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const double FramesPerSecond = 60;
+    const vector<PixelFormat> Offered = { PixelFormat::Nv12, PixelFormat::I420, PixelFormat::I444, PixelFormat::I444Split };
+
+    const char* FormatName(PixelFormat Format)
+    {
+        switch (Format)
+        {
+        case PixelFormat::Bgra8:
+            return "BGRA";
+        case PixelFormat::Nv12:
+            return "NV12";
+        case PixelFormat::I420:
+            return "I420";
+        case PixelFormat::I444:
+            return "I444";
+        case PixelFormat::I444Split:
+            return "I444S";
+        default:
+            return "?";
+        }
+    }
+
+    bool SameImage(const Frame& Converted, const vector<uint8_t>& Reference, uint32_t ReferencePitch)
+    {
+        uint32_t RowBytes = Converted.Width * BytesPerPixel(Converted.Format);
+        uint32_t Rows = FrameRows(Converted.Format, Converted.Height);
+        for (uint32_t Y = 0; Y < Rows; Y++)
+        {
+            if (memcmp(Converted.pData + static_cast<size_t>(Y) * Converted.Pitch, Reference.data() + static_cast<size_t>(Y) * ReferencePitch,
+                RowBytes) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int CheckSharing(uint32_t Frames)
+    {
+        const uint32_t Width = 640, Height = 360, Threads = 6;
+        const PixelFormat Requested[] = { PixelFormat::Nv12, PixelFormat::I444 };
+        FormatCacheStage Stage(Offered, ColorMatrix::Bt709, ColorRange::Limited);
+        mt19937 Random(23);
+        vector<uint8_t> Pixels(static_cast<size_t>(Width) * Height * 4);
+        vector<uint8_t> References[2];
+        uint32_t ReferencePitch = Width * 4;
+        for (auto& Reference : References)
+        {
+            Reference.resize(static_cast<size_t>(ReferencePitch) * Height * 3);
+        }
+
+        uint64_t Wrong = 0, Refused = 0, Early = 0;
+        for (uint32_t Number = 1; Number <= Frames; Number++)
+        {
+            for (auto& Byte : Pixels)
+            {
+                Byte = static_cast<uint8_t>(Random());
+            }
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                ConvertBgraFrame(Pixels.data(), Width * 4, Width, Height, References[i].data(), ReferencePitch, Requested[i],
+                    ColorMatrix::Bt709, ColorRange::Limited);
+            }
+
+            Frame Frame = {};
+            Frame.FrameNumber = Number;
+            Frame.Width = Width;
+            Frame.Height = Height;
+            Frame.Pitch = Width * 4;
+            Frame.Format = PixelFormat::Bgra8;
+            Frame.pData = Pixels.data();
+            Frame.Damage = DamageState::Full;
+            Stage.Process(Frame);
+
+            // Nothing is converted before someone asks
+            Early += Frame.pFormats->Has(PixelFormat::Nv12) || Frame.pFormats->Has(PixelFormat::I444) ? 1 : 0;
+
+            // Every thread waits for the others, so the requests really do arrive together
+            atomic<uint32_t> Arrived(0);
+            atomic<uint64_t> ThreadWrong(0), ThreadRefused(0);
+            vector<thread> Requesters;
+            for (uint32_t t = 0; t < Threads; t++)
+            {
+                Requesters.emplace_back([&, t] {
+                    Arrived++;
+                    while (Arrived.load() != Threads)
+                    {
+                        this_thread::yield();
+                    }
+
+                    struct Frame Converted = Frame;
+                    uint32_t i = t % 2;
+                    if (!Frame.pFormats->Get(Requested[i], Converted))
+                    {
+                        ThreadRefused++;
+                        return;
+                    }
+                    ThreadWrong += SameImage(Converted, References[i], ReferencePitch) ? 0 : 1;
+                });
+            }
+            for (auto& Requester : Requesters)
+            {
+                Requester.join();
+            }
+            Wrong += ThreadWrong;
+            Refused += ThreadRefused;
+
+            // The source format is served as it is, and formats that cannot be produced are refused
+            struct Frame Same = Frame;
+            struct Frame Unknown = Frame;
+            Refused += Frame.pFormats->Get(PixelFormat::Bgra8, Same) && Same.pData == Frame.pData ? 0 : 1;
+            Refused += Frame.pFormats->Get(PixelFormat::Unknown, Unknown) ? 1 : 0;
+        }
+
+        // The last frame's cache goes when the stage does; count it too
+        FormatCacheStatistics Statistics = Stage.Statistics();
+        printf("sharing: %u frames, %u threads asking for NV12 and I444 at once: %llu requests, %llu conversions, "
+            "%llu shared, %llu avoided so far, %llu failed; %llu wrong\n",
+            Frames, Threads, static_cast<unsigned long long>(Statistics.Requests), static_cast<unsigned long long>(Statistics.Conversions),
+            static_cast<unsigned long long>(Statistics.SharedRequests), static_cast<unsigned long long>(Statistics.Avoided),
+            static_cast<unsigned long long>(Statistics.Failures), static_cast<unsigned long long>(Wrong));
+
+        if (Wrong != 0 || Refused != 0 || Early != 0 || Statistics.Frames != Frames || Statistics.Conversions != 2ull * Frames ||
+            Statistics.SharedRequests != (Threads - 2ull) * Frames || Statistics.Avoided != 2ull * (Frames - 1) ||
+            Statistics.Failures != Frames)
+        {
+            printf("  FAILED: sharing (refused %llu, converted before asked %llu)\n", static_cast<unsigned long long>(Refused),
+                static_cast<unsigned long long>(Early));
+            return 1;
+        }
+        return 0;
+    }
+
+    /// <summary>
+    /// A subscriber that wants the frames in one format and reads a little of every one.
+    /// </summary>
+    class FormatConsumer : public IFrameSink
+    {
+    public:
+        explicit FormatConsumer(PixelFormat Format) : m_Format(Format) {}
+
+        void Consume(const Frame& Frame) override
+        {
+            struct Frame Converted = Frame;
+            if (!Frame.pFormats || !Frame.pFormats->Get(m_Format, Converted) || Converted.Format != m_Format)
+            {
+                Failures++;
+                return;
+            }
+            for (uint32_t Y = 0; Y < Converted.Height; Y += 64)
+            {
+                Sum += Converted.pData[static_cast<size_t>(Y) * Converted.Pitch];
+            }
+            Received++;
+        }
+
+        uint64_t Received = 0;
+        uint64_t Failures = 0;
+        uint64_t Sum = 0;
+
+    private:
+        PixelFormat m_Format;
+    };
+
+    /// <summary>
+    /// The alternative: converts every frame into every offered format as soon as it arrives.
+    /// </summary>
+    class EagerStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "Eager"; }
+
+        bool Process(Frame& Frame) override
+        {
+            for (PixelFormat Format : Offered)
+            {
+                struct Frame Converted = Frame;
+                Frame.pFormats->Get(Format, Converted);
+            }
+            return true;
+        }
+    };
+
+    struct SubscriberMix
+    {
+        vector<PixelFormat> Formats;
+    };
+
+    int Measure(const SubscriberMix& Mix, bool Eager, uint64_t Frames)
+    {
+        const Bench::Resolution& Mode = Bench::StandardResolutions[0];
+        auto Pool = make_shared<FrameBufferPool>();
+        auto Stage = make_shared<FormatCacheStage>(Offered, ColorMatrix::Bt709, ColorRange::Limited);
+        auto FanOut = make_shared<FrameFanOut>(Pool);
+        vector<shared_ptr<FormatConsumer>> Consumers;
+        vector<shared_ptr<BackpressureSink>> Sinks;
+        vector<PixelFormat> Distinct;
+        for (PixelFormat Format : Mix.Formats)
+        {
+            Consumers.push_back(make_shared<FormatConsumer>(Format));
+            Sinks.push_back(FanOut->Subscribe(Consumers.back(), BackpressurePolicy::Block, 3, 1000));
+            if (Format != PixelFormat::Bgra8 && find(Distinct.begin(), Distinct.end(), Format) == Distinct.end())
+            {
+                Distinct.push_back(Format);
+            }
+        }
+
+        SimulatedSwapChain SwapChain(Mode.Width, Mode.Height, FramesPerSecond, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.AddStage(Stage);
+        if (Eager)
+        {
+            Pipeline.AddStage(make_shared<EagerStage>());
+        }
+        Pipeline.SetSink(FanOut);
+        Pipeline.SetAsyncProcessing(3);
+        Pipeline.SetBufferPool(Pool);
+
+        double Cpu = Bench::ProcessCpuSeconds();
+        Pipeline.RunCore();
+        FanOut->Stop();
+        Cpu = Bench::ProcessCpuSeconds() - Cpu;
+
+        // The stage still holds the last frame's cache, so its avoided formats are not counted yet
+        FormatCacheStatistics Statistics = Stage->Statistics();
+        uint64_t Processed = Statistics.Frames;
+        uint64_t Received = 0, Rejected = 0, ConsumerFailures = 0;
+        for (size_t i = 0; i < Consumers.size(); i++)
+        {
+            Received += Consumers[i]->Received;
+            ConsumerFailures += Consumers[i]->Failures;
+            Rejected += Sinks[i]->Statistics().FramesRejected + Sinks[i]->Statistics().FramesDropped;
+        }
+
+        string Formats;
+        for (PixelFormat Format : Mix.Formats)
+        {
+            Formats += (Formats.empty() ? "" : "+") + string(FormatName(Format));
+        }
+        printf("%-22s %-5s %7llu %8llu %8llu %8llu %10.2f %10.2f\n", Formats.c_str(), Eager ? "eager" : "lazy",
+            static_cast<unsigned long long>(Processed), static_cast<unsigned long long>(Statistics.Conversions),
+            static_cast<unsigned long long>(Statistics.SharedRequests), static_cast<unsigned long long>(Statistics.Avoided),
+            Processed ? Statistics.ConversionTime / 1e6 / Processed : 0, Processed ? Cpu * 1e3 / Processed : 0);
+
+        // Every subscriber saw every frame, so the cache converted exactly the formats they asked for
+        uint64_t Converted = Eager ? Offered.size() : Distinct.size();
+        bool Exact = Processed != 0 && Rejected == 0 && ConsumerFailures == 0 && Received == Processed * Mix.Formats.size() &&
+            Statistics.Conversions == Processed * Converted && Statistics.Avoided == (Processed - 1) * (Offered.size() - Converted) &&
+            Statistics.Requests == Statistics.Conversions + Statistics.SharedRequests && Statistics.Failures == 0;
+        if (!Exact)
+        {
+            printf("  FAILED: %s %s (received %llu, dropped or rejected %llu, consumer failures %llu)\n", Formats.c_str(),
+                Eager ? "eager" : "lazy", static_cast<unsigned long long>(Received), static_cast<unsigned long long>(Rejected),
+                static_cast<unsigned long long>(ConsumerFailures));
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int BenchFormats(int argc, char* argv[])
+{
+    uint64_t Frames = max<uint64_t>(8, Bench::ParseOption(argc, argv, "frames", 120));
+    const SubscriberMix Mixes[] = {
+        { { PixelFormat::Bgra8 } },
+        { { PixelFormat::Nv12 } },
+        { { PixelFormat::Nv12, PixelFormat::Nv12 } },
+        { { PixelFormat::Bgra8, PixelFormat::Nv12, PixelFormat::Nv12, PixelFormat::I444 } },
+        { { PixelFormat::Nv12, PixelFormat::I420, PixelFormat::I444, PixelFormat::I444Split } },
+    };
+
+    int Failures = CheckSharing(32);
+
+    printf("\npaced %.0f fps 1080p swap-chain, offering NV12, I420, I444 and I444 split, into subscribers asking for one "
+        "format each; per frame [ms]\n", FramesPerSecond);
+    printf("%-22s %-5s %7s %8s %8s %8s %10s %10s\n", "subscribers", "mode", "frames", "convert", "shared", "avoided",
+        "convert", "cpu");
+    for (const SubscriberMix& Mix : Mixes)
+    {
+        Failures |= Measure(Mix, false, Frames);
+        Failures |= Measure(Mix, true, Frames);
+    }
+
+    printf("\nformat cache: %s\n", Failures == 0 ? "exact" : "FAILED");
+    return Failures;
+}
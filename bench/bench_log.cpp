@@ -0,0 +1,313 @@
+/*++
+
+Module Name:
+
+    bench_log.cpp
+
+Abstract:
+
+    Checks and measures the binary log. First logs calls with every kind of argument and checks that the decoder
+    prints exactly what snprintf prints for the same call, and that a call below IDD_LOG_MIN_LEVEL does not even
+    evaluate its arguments. Then has 1 to 8 threads log as fast as they can, comparing the nanoseconds per call
+    against what the driver's old WriteLogFile did (format, allocate, fwrite and fflush on the calling thread).
+    Every record logged must come back out of the file, in order per thread, or be counted as dropped.
+
+    Options: --records N (default 200000, per thread), --ring N (default 4096), --file PATH (default bench.blog)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/binary_log.h"
+#include "../pipeline/log_decoder.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+// Logs a call and remembers what snprintf makes of the same arguments
+#define CHECK_LOG(Format, ...)                                                      \
+    do                                                                              \
+    {                                                                               \
+        char Expected[256];                                                         \
+        snprintf(Expected, sizeof(Expected), Format, __VA_ARGS__);                  \
+        s_Expected.push_back(Expected);                                             \
+        IDD_LOG_INFO(Format, __VA_ARGS__);                                          \
+    } while (0)
+
+namespace
+{
+    enum class Mode : int16_t
+    {
+        Off = -1,
+        On = 1,
+    };
+
+    vector<string> s_Expected;
+
+    FILE* s_pTextFile = nullptr;
+
+    // What the driver did before the binary log
+    void WriteTextLog(const char* Format, ...)
+    {
+        va_list Arguments;
+        va_start(Arguments, Format);
+        va_list Copy;
+        va_copy(Copy, Arguments);
+
+        size_t Length = vsnprintf(nullptr, 0, Format, Arguments) + 1;
+        char* Line = new char[Length];
+        vsnprintf(Line, Length, Format, Copy);
+        va_end(Copy);
+        va_end(Arguments);
+
+        Line[Length - 1] = '\n';
+        fwrite(Line, Length, sizeof(char), s_pTextFile);
+        fflush(s_pTextFile);
+
+        delete[] Line;
+    }
+
+    int CheckFormatting(const char* Path)
+    {
+        s_Expected.clear();
+        if (!BinaryLog::Open(Path))
+        {
+            printf("FAILED: cannot create %s\n", Path);
+            return 1;
+        }
+
+        int Value = 12345;
+        CHECK_LOG("%d %i %5d|%-5d|%05d", -42, 7, 3, 4, 5);
+        CHECK_LOG("%u %x %X %#x %o", 4000000000u, 0xC000000Du, 0xBEEFu, 255, 8);
+        CHECK_LOG("status 0x%x", static_cast<int32_t>(0xC000000D));
+        CHECK_LOG("%lld %llu %llx", -1234567890123ll, 18446744073709551615ull, 0x123456789ABCDEFull);
+        CHECK_LOG("%hd %hu %hhd %hhu", static_cast<short>(-2), static_cast<unsigned short>(65535), static_cast<signed char>(-3), static_cast<unsigned char>(250));
+        CHECK_LOG("%zu %c%c", sizeof(LogRecord), 'o', 'k');
+        CHECK_LOG("%f %.3f %e %g %10.2f", 3.14159, -2.5, 1e-7, 1234567.0, 2.0f);
+        CHECK_LOG("%p", static_cast<void*>(&Value));
+        CHECK_LOG("enum %d, 100%% done, bool %d", static_cast<int>(Mode::Off), true);
+        CHECK_LOG("%d %d %d %d %d %d", 1, 2, 3, 4, 5, 6);
+
+        // A call below the minimum level must not evaluate its arguments
+        int Evaluated = 0;
+        IDD_LOG_TRACE("%d", ++Evaluated);
+
+        BinaryLog::Close();
+
+        LogDecoder Decoder;
+        if (!Decoder.Open(Path))
+        {
+            printf("FAILED: %s does not decode\n", Path);
+            return 1;
+        }
+
+        int Failures = 0;
+        size_t Index = 0;
+        LogEntry Entry;
+        while (Decoder.Next(Entry))
+        {
+            const char* Expected = Index < s_Expected.size() ? s_Expected[Index].c_str() : "<nothing>";
+            bool Match = Entry.Message == Expected && Entry.Level == LogLevel::Info && strstr(Entry.Function, "CheckFormatting") != nullptr;
+            printf("%-5s %s\n", Match ? "ok" : "DIFF", Entry.Message.c_str());
+            if (!Match)
+            {
+                printf("      expected %s\n", Expected);
+                Failures = 1;
+            }
+            Index++;
+        }
+
+        if (Index != s_Expected.size() || Decoder.Damaged() || Evaluated != 0)
+        {
+            printf("FAILED: %zu of %zu records decoded, %d disabled arguments evaluated\n", Index, s_Expected.size(), Evaluated);
+            Failures = 1;
+        }
+
+        return Failures;
+    }
+
+    struct RunResult
+    {
+        double NanosecondsPerCall;
+        double P99;
+        double P999;
+        uint64_t Dropped;
+        uint64_t Bytes;
+        bool Complete;
+    };
+
+    void LogRecords(bool Binary, uint32_t Thread, uint64_t Records, vector<double>& SampleNs)
+    {
+        for (uint64_t i = 0; i < Records; i++)
+        {
+            // Every 16th call is timed on its own
+            uint64_t Begin = (i % 16 == 0) ? MonotonicNanoseconds() : 0;
+
+            if (Binary)
+            {
+                IDD_LOG_INFO("thread %u record %llu of %llu", Thread, static_cast<unsigned long long>(i), static_cast<unsigned long long>(Records));
+            }
+            else
+            {
+                WriteTextLog("thread %u record %llu of %llu", Thread, static_cast<unsigned long long>(i), static_cast<unsigned long long>(Records));
+            }
+
+            if (Begin != 0)
+            {
+                SampleNs.push_back(static_cast<double>(MonotonicNanoseconds() - Begin));
+            }
+        }
+    }
+
+    RunResult Run(bool Binary, uint32_t Threads, uint64_t Records, uint32_t RingCapacity, const string& Path)
+    {
+        RunResult Result = {};
+        Result.Complete = true;
+
+        if (Binary)
+        {
+            BinaryLog::Open(Path.c_str(), RingCapacity);
+        }
+        else
+        {
+            s_pTextFile = fopen(Path.c_str(), "wb");
+        }
+
+        vector<vector<double>> Samples(Threads);
+        vector<thread> Loggers;
+        double Start = Bench::WallSeconds();
+        for (uint32_t t = 0; t < Threads; t++)
+        {
+            Loggers.emplace_back([=, &Samples] { LogRecords(Binary, t, Records, Samples[t]); });
+        }
+        for (thread& Logger : Loggers)
+        {
+            Logger.join();
+        }
+        double Seconds = Bench::WallSeconds() - Start;
+
+        vector<double> All;
+        for (uint32_t t = 0; t < Threads; t++)
+        {
+            All.insert(All.end(), Samples[t].begin(), Samples[t].end());
+        }
+
+        // The thread time a call costs: with more threads than cores, a thread's own wall time would include the
+        // time the others ran
+        uint32_t Cores = min(Threads, max(1u, thread::hardware_concurrency()));
+        Result.NanosecondsPerCall = Seconds * 1e9 * Cores / (static_cast<double>(Records) * Threads);
+        Result.P99 = Bench::Percentile(All, 99);
+        Result.P999 = Bench::Percentile(All, 99.9);
+
+        if (!Binary)
+        {
+            Result.Bytes = static_cast<uint64_t>(ftell(s_pTextFile));
+            fclose(s_pTextFile);
+            return Result;
+        }
+
+        BinaryLog::Close();
+        BinaryLogStatistics Statistics = BinaryLog::Statistics();
+        Result.Dropped = Statistics.Dropped;
+        Result.Bytes = Statistics.Bytes;
+
+        // Every record is in the file, in order for its thread, or was counted as dropped. The decoder numbers
+        // threads in the order they first logged, so the numbers are matched up through the messages.
+        LogDecoder Decoder;
+        if (!Decoder.Open(Path.c_str()))
+        {
+            Result.Complete = false;
+            return Result;
+        }
+
+        vector<long long> Last(Threads, -1);
+        uint64_t Decoded = 0;
+        uint64_t Dropped = 0;
+        LogEntry Entry;
+        while (Decoder.Next(Entry))
+        {
+            if (Entry.Dropped != 0)
+            {
+                Dropped += Entry.Dropped;
+                continue;
+            }
+
+            unsigned Thread = 0;
+            unsigned long long Index = 0;
+            if (sscanf(Entry.Message.c_str(), "thread %u record %llu", &Thread, &Index) != 2 || Thread >= Threads ||
+                static_cast<long long>(Index) <= Last[Thread])
+            {
+                Result.Complete = false;
+                break;
+            }
+            Last[Thread] = static_cast<long long>(Index);
+            Decoded++;
+        }
+
+        if (Decoder.Damaged() || Decoded + Dropped != Records * Threads || Dropped != Statistics.Dropped)
+        {
+            Result.Complete = false;
+        }
+
+        return Result;
+    }
+}
+
+int BenchLog(int argc, char* argv[])
+{
+    uint64_t Records = max<uint64_t>(1, Bench::ParseOption(argc, argv, "records", 200000));
+    uint32_t RingCapacity = static_cast<uint32_t>(max<uint64_t>(2, Bench::ParseOption(argc, argv, "ring", BinaryLog::DefaultRingCapacity)));
+
+    string Path = "bench.blog";
+    for (int i = 0; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--file") == 0)
+        {
+            Path = argv[i + 1];
+        }
+    }
+
+    int Failures = CheckFormatting(Path.c_str());
+    printf("formatting: %s\n\n", Failures == 0 ? "matches snprintf" : "FAILED");
+
+    printf("%llu records per thread, %u-record rings\n\n", static_cast<unsigned long long>(Records), RingCapacity);
+    printf("%-8s %-8s %12s %10s %11s %10s %10s\n", "threads", "log", "ns/call", "p99 [ns]", "p99.9 [ns]", "dropped", "MB");
+
+    const uint32_t ThreadCounts[] = { 1, 2, 4, 8 };
+    for (uint32_t Threads : ThreadCounts)
+    {
+        for (bool Binary : { false, true })
+        {
+            RunResult Result = Run(Binary, Threads, Records, RingCapacity, Path);
+            printf("%-8u %-8s %12.1f %10.0f %11.0f %10llu %10.1f\n",
+                Threads,
+                Binary ? "binary" : "text",
+                Result.NanosecondsPerCall,
+                Result.P99,
+                Result.P999,
+                static_cast<unsigned long long>(Result.Dropped),
+                Result.Bytes / 1e6);
+
+            if (!Result.Complete)
+            {
+                printf("  FAILED: records missing, out of order or miscounted\n");
+                Failures = 1;
+            }
+        }
+    }
+
+    remove(Path.c_str());
+    return Failures;
+}
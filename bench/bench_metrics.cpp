@@ -0,0 +1,319 @@
+/*++
+
+Module Name:
+
+    bench_metrics.cpp
+
+Abstract:
+
+    Checks and measures the metrics registry. First has 1 to 8 threads add to every metric at once and checks that
+    no add was lost and that gauges return to zero, and that a snapshot survives encoding and decoding, including
+    one from a later version with a longer header and more metrics, while truncated or foreign data is rejected.
+    Then compares the cost of an add against a single atomic counter shared by all threads. Last, runs an
+    unthrottled simulated swap-chain through an asynchronous pipeline with and without a registry, checks that the
+    registry agrees with the pipeline's statistics, and reports what counting costs per frame.
+
+    Options: --adds N (default 2000000, per thread), --frames N (default 20000)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/metrics.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint32_t MonitorWidth = 640;
+    const uint32_t MonitorHeight = 360;
+    const uint64_t DropInterval = 8;
+
+    template <typename Function>
+    double RunThreads(uint32_t Threads, Function Body)
+    {
+        double Start = Bench::WallSeconds();
+        vector<thread> Workers;
+        for (uint32_t t = 0; t < Threads; t++)
+        {
+            Workers.emplace_back(Body);
+        }
+        for (thread& Worker : Workers)
+        {
+            Worker.join();
+        }
+        return Bench::WallSeconds() - Start;
+    }
+
+    int CheckCounting(uint64_t Adds)
+    {
+        int Failures = 0;
+        const uint32_t ThreadCounts[] = { 1, 2, 4, 8 };
+        for (uint32_t Threads : ThreadCounts)
+        {
+            auto Metrics = make_shared<MetricsRegistry>();
+            uint64_t PerMetric = max<uint64_t>(1, Adds / MetricCount);
+
+            RunThreads(Threads, [&Metrics, PerMetric] {
+                for (uint64_t i = 0; i < PerMetric; i++)
+                {
+                    for (uint32_t Id = 0; Id < MetricCount; Id++)
+                    {
+                        // Gauges go up and come back down
+                        Metrics->Add(static_cast<MetricId>(Id), MetricKindOf(Id) == MetricKind::Gauge && (i & 1) ? -1 : 1);
+                    }
+                }
+            });
+
+            for (uint32_t Id = 0; Id < MetricCount; Id++)
+            {
+                int64_t Expected = MetricKindOf(Id) == MetricKind::Gauge ? static_cast<int64_t>(PerMetric % 2 * Threads) : static_cast<int64_t>(PerMetric * Threads);
+                if (Metrics->Read(static_cast<MetricId>(Id)) != Expected)
+                {
+                    printf("  FAILED: %s is %lld with %u threads, expected %lld\n", MetricName(Id),
+                        static_cast<long long>(Metrics->Read(static_cast<MetricId>(Id))), Threads, static_cast<long long>(Expected));
+                    Failures = 1;
+                }
+            }
+        }
+        return Failures;
+    }
+
+    int CheckSnapshots()
+    {
+        MetricsRegistry Metrics;
+        for (uint32_t Id = 0; Id < MetricCount; Id++)
+        {
+            Metrics.Add(static_cast<MetricId>(Id), 1000 + Id);
+        }
+        Metrics.Add(MetricId::FramesQueued, -2000);
+
+        vector<uint8_t> Data(MetricsRegistry::SerializedSize());
+        bool Serialized = Metrics.Serialize(Data.data(), Data.size());
+        bool Refused = !Metrics.Serialize(Data.data(), Data.size() - 1);
+
+        MetricsSnapshot Snapshot;
+        bool Decoded = Snapshot.Decode(Data.data(), Data.size());
+        bool Matches = Decoded && Snapshot.Values.size() == MetricCount && Snapshot.Version == MetricsVersion;
+        for (uint32_t Id = 0; Matches && Id < MetricCount; Id++)
+        {
+            Matches = Snapshot.Values[Id] == Metrics.Read(static_cast<MetricId>(Id));
+        }
+        Matches = Matches && Snapshot.Values[static_cast<uint32_t>(MetricId::FramesQueued)] < 0;
+
+        // A later version: 8 more header bytes and 2 more metrics
+        MetricsHeader Header;
+        memcpy(&Header, Data.data(), sizeof(Header));
+        Header.Version = MetricsVersion + 1;
+        Header.HeaderSize = sizeof(Header) + 8;
+        Header.MetricCount = MetricCount + 2;
+
+        vector<uint8_t> Later(Header.HeaderSize + Header.MetricCount * sizeof(int64_t), 0);
+        memcpy(Later.data(), &Header, sizeof(Header));
+        memcpy(Later.data() + Header.HeaderSize, Data.data() + sizeof(Header), MetricCount * sizeof(int64_t));
+
+        MetricsSnapshot LaterSnapshot;
+        bool ReadsLater = LaterSnapshot.Decode(Later.data(), Later.size()) && LaterSnapshot.Values.size() == MetricCount + 2 &&
+            equal(Snapshot.Values.begin(), Snapshot.Values.end(), LaterSnapshot.Values.begin()) && MetricName(MetricCount + 1) == nullptr;
+
+        // Truncated, or not a snapshot at all
+        MetricsSnapshot Rejected;
+        bool RejectsBad = !Rejected.Decode(Data.data(), Data.size() - 1) && !Rejected.Decode(Data.data(), sizeof(MetricsHeader) - 1);
+        Data[0] = 'X';
+        RejectsBad = RejectsBad && !Rejected.Decode(Data.data(), Data.size());
+
+        if (!Serialized || !Refused || !Matches || !ReadsLater || !RejectsBad)
+        {
+            printf("  FAILED: snapshot encoding (serialized %d, refused %d, matches %d, reads later %d, rejects bad %d)\n",
+                Serialized, Refused, Matches, ReadsLater, RejectsBad);
+            return 1;
+        }
+        return 0;
+    }
+
+    void MeasureAdds(uint64_t Adds)
+    {
+        printf("%-8s %16s %16s\n", "threads", "sharded [ns/add]", "shared [ns/add]");
+
+        const uint32_t ThreadCounts[] = { 1, 2, 4, 8 };
+        for (uint32_t Threads : ThreadCounts)
+        {
+            // The thread time an add costs, as in the log benchmark
+            uint32_t Cores = min(Threads, max(1u, thread::hardware_concurrency()));
+            double Scale = 1e9 * Cores / (static_cast<double>(Adds) * Threads);
+
+            auto Metrics = make_shared<MetricsRegistry>();
+            double Sharded = RunThreads(Threads, [&Metrics, Adds] {
+                for (uint64_t i = 0; i < Adds; i++)
+                {
+                    Metrics->Add(MetricId::FramesAcquired);
+                }
+            });
+
+            atomic<int64_t> Counter(0);
+            double Shared = RunThreads(Threads, [&Counter, Adds] {
+                for (uint64_t i = 0; i < Adds; i++)
+                {
+                    Counter.fetch_add(1, memory_order_relaxed);
+                }
+            });
+
+            printf("%-8u %16.2f %16.2f\n", Threads, Sharded * Scale, Shared * Scale);
+        }
+    }
+
+    /// <summary>
+    /// Drops every DropInterval-th frame it sees.
+    /// </summary>
+    class ThinningStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "thin"; }
+
+        bool Process(Frame&) override
+        {
+            return m_Seen++ % DropInterval != DropInterval - 1;
+        }
+
+    private:
+        uint64_t m_Seen = 0;
+    };
+
+    class NullSink : public IFrameSink
+    {
+    public:
+        void Consume(const Frame&) override
+        {
+        }
+    };
+
+    struct PipelineRun
+    {
+        double NanosecondsPerFrame;
+        PipelineStatistics Statistics;
+    };
+
+    PipelineRun RunPipeline(uint64_t Frames, shared_ptr<MetricsRegistry> Metrics)
+    {
+        SimulatedSwapChain SwapChain(MonitorWidth, MonitorHeight, 0, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.AddStage(make_shared<ThinningStage>());
+        Pipeline.SetSink(make_shared<NullSink>());
+        Pipeline.SetAsyncProcessing(3);
+        Pipeline.SetChangeDetection(0);
+        if (Metrics)
+        {
+            Pipeline.SetMetrics(Metrics);
+        }
+
+        double Start = Bench::WallSeconds();
+        Pipeline.RunCore();
+
+        PipelineRun Run;
+        Run.NanosecondsPerFrame = (Bench::WallSeconds() - Start) * 1e9 / Frames;
+        Run.Statistics = Pipeline.Statistics();
+        return Run;
+    }
+
+    int CheckPipeline(uint64_t Frames, uint64_t Adds)
+    {
+        // A warm-up, then alternate so both runs see the same machine
+        RunPipeline(Frames / 4 + 1, nullptr);
+
+        auto Metrics = make_shared<MetricsRegistry>();
+        PipelineRun Without = RunPipeline(Frames, nullptr);
+        PipelineRun With = RunPipeline(Frames, Metrics);
+
+        const PipelineStatistics& Statistics = With.Statistics;
+        uint64_t Processed = Statistics.FramesAcquired - Statistics.FramesOverrun - Statistics.MapFailures;
+
+        struct Expectation
+        {
+            MetricId Id;
+            uint64_t Value;
+        };
+        const Expectation Expected[] =
+        {
+            { MetricId::SwapChainsAbandoned, 1 },   // the simulated swap-chain fails once its frames are out
+            { MetricId::FramesAcquired, Statistics.FramesAcquired },
+            { MetricId::PendingAcquires, Statistics.PendingAcquires },
+            { MetricId::WaitTimeouts, Statistics.WaitTimeouts },
+            { MetricId::FramesDelivered, Processed - Statistics.FramesDropped },
+            { MetricId::FramesDropped, Statistics.FramesDropped },
+            { MetricId::FramesOverrun, Statistics.FramesOverrun },
+            { MetricId::MapFailures, Statistics.MapFailures },
+            { MetricId::ActiveSwapChains, 0 },
+            { MetricId::FramesQueued, 0 },
+        };
+
+        int Failures = 0;
+        uint64_t Updates = 0;
+        for (const Expectation& Check : Expected)
+        {
+            int64_t Value = Metrics->Read(Check.Id);
+            if (Value != static_cast<int64_t>(Check.Value))
+            {
+                printf("  FAILED: %s is %lld, the pipeline counted %llu\n", MetricName(static_cast<uint32_t>(Check.Id)),
+                    static_cast<long long>(Value), static_cast<unsigned long long>(Check.Value));
+                Failures = 1;
+            }
+        }
+
+        for (uint32_t Id = 0; Id < MetricCount; Id++)
+        {
+            if (MetricKindOf(Id) == MetricKind::Counter)
+            {
+                Updates += static_cast<uint64_t>(Metrics->Read(static_cast<MetricId>(Id)));
+            }
+        }
+
+        // Every queued frame moved the gauge twice, and the run itself once each way
+        Updates += 2 * Processed + 2;
+
+        // The cost of an add on one thread
+        MetricsRegistry Single;
+        double Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < Adds; i++)
+        {
+            Single.Add(MetricId::FramesAcquired);
+        }
+        double AddNs = (Bench::WallSeconds() - Start) * 1e9 / Adds;
+
+        double UpdatesPerFrame = static_cast<double>(Updates) / Statistics.FramesAcquired;
+        printf("\npipeline, %llu unthrottled %ux%u frames: %.0f ns/frame without metrics, %.0f ns/frame with\n",
+            static_cast<unsigned long long>(Frames), MonitorWidth, MonitorHeight, Without.NanosecondsPerFrame, With.NanosecondsPerFrame);
+        printf("%.2f updates per frame x %.2f ns = %.1f ns per frame, %.5f%% of a 60 Hz frame\n",
+            UpdatesPerFrame, AddNs, UpdatesPerFrame * AddNs, UpdatesPerFrame * AddNs / (1e9 / 60) * 100);
+
+        return Failures;
+    }
+}
+
+int BenchMetrics(int argc, char* argv[])
+{
+    uint64_t Adds = max<uint64_t>(MetricCount, Bench::ParseOption(argc, argv, "adds", 2000000));
+    uint64_t Frames = max<uint64_t>(DropInterval, Bench::ParseOption(argc, argv, "frames", 20000));
+
+    int Failures = CheckCounting(Adds);
+    Failures |= CheckSnapshots();
+    printf("counting and snapshots: %s\n\n", Failures == 0 ? "exact" : "FAILED");
+
+    MeasureAdds(Adds);
+    Failures |= CheckPipeline(Frames, Adds);
+    return Failures;
+}
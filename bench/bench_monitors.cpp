@@ -0,0 +1,235 @@
+/*++
+
+Module Name:
+
+    bench_monitors.cpp
+
+Abstract:
+
+    Measures how frame processing scales with the number of monitors. Every simulated monitor runs its own acquire
+    loop at a fixed refresh rate and encodes every frame as a tile-codec key frame, which is heavy enough to need
+    more than one thread at high monitor counts. With the shared work-stealing pool, the frames of all monitors and
+    the tiles inside each frame run on one set of threads; with dedicated threads, each monitor processes its own
+    frames on a thread of its own and encodes them serially. Reports the frames per second delivered against those
+    offered, the frames skipped because processing fell behind, and the pool's steal count, idle time and deepest
+    queue. Every 30th delivered frame is decoded and compared with the frame it came from.
+
+    Options: --seconds N (default 2), --fps N (default 60), --monitors N (default 16),
+             --threads N (default: hardware threads)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/simulated_swapchain.h"
+#include "../pipeline/tile_codec.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint32_t MonitorWidth = 1920;
+    const uint32_t MonitorHeight = 1080;
+    const uint64_t VerifyInterval = 30;
+
+    /// <summary>
+    /// Encodes every frame in full, the way a sink that just connected would need it.
+    /// </summary>
+    class KeyFrameStage : public IFrameStage
+    {
+    public:
+        explicit KeyFrameStage(shared_ptr<WorkerPool> Pool)
+            : m_Encoder(make_shared<TileEncoder>(move(Pool))), m_Stage(m_Encoder)
+        {
+        }
+
+        const char* Name() const override { return "KeyFrame"; }
+
+        bool Process(Frame& Frame) override
+        {
+            m_Encoder->RequestKeyFrame();
+            return m_Stage.Process(Frame);
+        }
+
+    private:
+        shared_ptr<TileEncoder> m_Encoder;
+        EncodeStage m_Stage;
+    };
+
+    /// <summary>
+    /// Counts delivered frames and decodes a sample of them.
+    /// </summary>
+    class VerifyingSink : public IFrameSink
+    {
+    public:
+        void Consume(const Frame& Frame) override
+        {
+            if (m_Delivered++ % VerifyInterval != 0)
+            {
+                return;
+            }
+
+            if (!Frame.pEncoded || !m_Decoder.Decode(Frame.pEncoded->pData, Frame.pEncoded->Size) ||
+                m_Decoder.Width() != Frame.Width || m_Decoder.Height() != Frame.Height)
+            {
+                m_Mismatches++;
+                return;
+            }
+
+            for (uint32_t y = 0; y < Frame.Height; y++)
+            {
+                if (memcmp(m_Decoder.Data() + static_cast<size_t>(y) * m_Decoder.Pitch(), Frame.pData + static_cast<size_t>(y) * Frame.Pitch, static_cast<size_t>(Frame.Width) * 4) != 0)
+                {
+                    m_Mismatches++;
+                    return;
+                }
+            }
+        }
+
+        uint64_t m_Delivered = 0;
+        uint64_t m_Mismatches = 0;
+
+    private:
+        TileDecoder m_Decoder;
+    };
+
+    struct RunResult
+    {
+        double Seconds;
+        uint64_t Acquired;
+        uint64_t Delivered;
+        uint64_t Overrun;
+        uint64_t Lost;          // acquired frames that were neither delivered nor accounted for as skipped
+        uint64_t Mismatches;
+        WorkerPoolStatistics Pool;
+    };
+
+    RunResult RunMonitors(uint32_t Monitors, bool Shared, uint32_t Threads, uint64_t FramesPerSecond, uint64_t Seconds)
+    {
+        shared_ptr<WorkerPool> Pool = Shared ? make_shared<WorkerPool>(Threads) : nullptr;
+        shared_ptr<FrameBufferPool> Buffers = make_shared<FrameBufferPool>();
+
+        vector<unique_ptr<SimulatedSwapChain>> SwapChains;
+        vector<unique_ptr<FramePipeline>> Pipelines;
+        vector<shared_ptr<VerifyingSink>> Sinks;
+
+        for (uint32_t i = 0; i < Monitors; i++)
+        {
+            SwapChains.emplace_back(new SimulatedSwapChain(MonitorWidth, MonitorHeight, static_cast<double>(FramesPerSecond), FramesPerSecond * Seconds));
+            Pipelines.emplace_back(new FramePipeline(*SwapChains.back()));
+            Sinks.push_back(make_shared<VerifyingSink>());
+
+            FramePipeline& Pipeline = *Pipelines.back();
+            Pipeline.AddStage(make_shared<KeyFrameStage>(Pool));
+            Pipeline.SetSink(Sinks.back());
+            Pipeline.SetAsyncProcessing(3);
+            Pipeline.SetProcessingPool(Pool);
+            Pipeline.SetBufferPool(Buffers);
+        }
+
+        double Start = Bench::WallSeconds();
+
+        vector<thread> AcquireThreads;
+        for (auto& Pipeline : Pipelines)
+        {
+            AcquireThreads.emplace_back([&Pipeline] { Pipeline->RunCore(); });
+        }
+        for (thread& Thread : AcquireThreads)
+        {
+            Thread.join();
+        }
+
+        RunResult Result = {};
+        Result.Seconds = Bench::WallSeconds() - Start;
+
+        for (uint32_t i = 0; i < Monitors; i++)
+        {
+            const PipelineStatistics& Statistics = Pipelines[i]->Statistics();
+            Result.Acquired += Statistics.FramesAcquired;
+            Result.Delivered += Sinks[i]->m_Delivered;
+            Result.Overrun += Statistics.FramesOverrun;
+            Result.Mismatches += Sinks[i]->m_Mismatches;
+
+            uint64_t Accounted = Sinks[i]->m_Delivered + Statistics.FramesOverrun + Statistics.FramesDropped + Statistics.MapFailures;
+            Result.Lost += Statistics.FramesAcquired > Accounted ? Statistics.FramesAcquired - Accounted : 0;
+        }
+
+        if (Pool)
+        {
+            Result.Pool = Pool->Statistics();
+        }
+
+        return Result;
+    }
+}
+
+int BenchMonitors(int argc, char* argv[])
+{
+    uint64_t Seconds = max<uint64_t>(1, Bench::ParseOption(argc, argv, "seconds", 2));
+    uint64_t FramesPerSecond = max<uint64_t>(1, Bench::ParseOption(argc, argv, "fps", 60));
+    uint32_t MaxMonitors = static_cast<uint32_t>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "monitors", 16)));
+    uint32_t Threads = static_cast<uint32_t>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "threads", WorkerPool::DefaultThreadCount())));
+
+    printf("%ux%u key frames at %llu fps per monitor, %u pool threads, %llu s per run\n\n",
+        MonitorWidth, MonitorHeight, static_cast<unsigned long long>(FramesPerSecond), Threads, static_cast<unsigned long long>(Seconds));
+    printf("%-9s %-10s %10s %10s %8s %8s %8s %8s %8s\n", "monitors", "mode", "offered", "fps", "speedup", "skipped", "steals", "idle %", "max q");
+
+    const uint32_t MonitorCounts[] = { 1, 2, 4, 8, 12, 16 };
+    int Failures = 0;
+
+    for (bool Shared : { true, false })
+    {
+        double SingleFps = 0;
+
+        for (uint32_t Monitors : MonitorCounts)
+        {
+            if (Monitors > MaxMonitors)
+            {
+                break;
+            }
+
+            RunResult Result = RunMonitors(Monitors, Shared, Threads, FramesPerSecond, Seconds);
+            double Fps = Result.Delivered / Result.Seconds;
+            if (Monitors == 1)
+            {
+                SingleFps = Fps;
+            }
+
+            double PoolSeconds = Result.Seconds * Result.Pool.Threads;
+            printf("%-9u %-10s %10llu %10.1f %8.2f %7.1f%% %8llu %8.1f %8u\n",
+                Monitors,
+                Shared ? "shared" : "dedicated",
+                static_cast<unsigned long long>(FramesPerSecond * Monitors),
+                Fps,
+                SingleFps > 0 ? Fps / SingleFps : 0.0,
+                Result.Acquired != 0 ? 100.0 * Result.Overrun / Result.Acquired : 0.0,
+                static_cast<unsigned long long>(Result.Pool.TasksStolen),
+                PoolSeconds > 0 ? 100.0 * Result.Pool.IdleNanoseconds / 1e9 / PoolSeconds : 0.0,
+                Result.Pool.MaxQueueDepth);
+
+            if (Result.Mismatches != 0 || Result.Lost != 0 || Result.Delivered == 0)
+            {
+                printf("  FAILED: %llu mismatches, %llu frames lost\n",
+                    static_cast<unsigned long long>(Result.Mismatches), static_cast<unsigned long long>(Result.Lost));
+                Failures = 1;
+            }
+        }
+
+        printf("\n");
+    }
+
+    return Failures;
+}
@@ -0,0 +1,326 @@
+/*++
+
+Module Name:
+
+    bench_motion.cpp
+
+Abstract:
+
+    Replays synthetic scroll, fling, pan and window-drag sequences, plus a video clip as a negative control, through
+    the tile-hash change detector and the motion detector behind it, per SIMD tier. Reports the CPU time of the
+    motion search per frame and how many damaged bytes are left to process once the moves it found are taken out.
+    Every frame is rebuilt from the previous one, the moves and the residual damage, and compared with the real
+    frame, so a wrong move counts as a mismatch.
+
+    Options: --frames N (default 120), --width N (default 1920), --height N (default 1080)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../pipeline/change_detector.h"
+#include "../pipeline/frame_damage.h"
+#include "../pipeline/motion_detector.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    enum class Motion
+    {
+        Scroll,     // a document scrolling by a few rows per frame
+        Fling,      // the same document flung, 40 rows per frame
+        Pan,        // a wide document panned sideways
+        Drag,       // a window dragged across the desktop
+        Video,      // new content every frame; nothing to find
+    };
+
+    struct Sequence
+    {
+        const char* Name;
+        Motion Kind;
+    };
+
+    const Sequence Sequences[] =
+    {
+        { "scroll", Motion::Scroll },
+        { "fling", Motion::Fling },
+        { "pan", Motion::Pan },
+        { "drag", Motion::Drag },
+        { "video", Motion::Video },
+    };
+
+    uint32_t Hash32(uint32_t Value)
+    {
+        Value ^= Value >> 16;
+        Value *= 0x7FEB352Du;
+        Value ^= Value >> 15;
+        Value *= 0x846CA68Bu;
+        Value ^= Value >> 16;
+        return Value;
+    }
+
+    /// <summary>
+    /// A BGRA desktop with one document window whose content or position changes every frame.
+    /// </summary>
+    class Scene
+    {
+    public:
+        Scene(uint32_t Width, uint32_t Height)
+            : m_Width(Width), m_Height(Height), m_Pixels(static_cast<size_t>(Width) * Height), m_Noise(0x9E3779B9), m_DragX(0)
+        {
+            for (uint32_t y = 0; y < Height; y++)
+            {
+                for (uint32_t x = 0; x < Width; x++)
+                {
+                    m_Pixels[static_cast<size_t>(y) * Width + x] = Desktop(x, y);
+                }
+            }
+        }
+
+        const uint8_t* Data() const { return reinterpret_cast<const uint8_t*>(m_Pixels.data()); }
+        uint32_t Pitch() const { return m_Width * 4; }
+
+        void Render(Motion Kind, uint32_t Index)
+        {
+            uint32_t Left = m_Width / 20;
+            uint32_t Top = m_Height / 8;
+            uint32_t Width = m_Width * 8 / 10;
+            uint32_t Height = m_Height * 3 / 4;
+
+            switch (Kind)
+            {
+            case Motion::Scroll:
+                Window(Left, Top, Width, Height, 0, Index * 3);
+                break;
+            case Motion::Fling:
+                Window(Left, Top, Width, Height, 0, Index * 40);
+                break;
+            case Motion::Pan:
+                Window(Left, Top, Width, Height, Index * 16, 0);
+                break;
+            case Motion::Drag:
+            {
+                // Back and forth, restoring the desktop the window uncovers
+                uint32_t Span = m_Width - Width / 2;
+                uint32_t Offset = Index * 24 % (2 * Span);
+                uint32_t X = Offset < Span ? Offset : 2 * Span - Offset;
+                Uncover(m_DragX, Top, Width / 2, Height);
+                Window(X, Top, Width / 2, Height, 0, 0);
+                m_DragX = X;
+                break;
+            }
+            default:
+                for (uint32_t y = Top; y < Top + Height; y++)
+                {
+                    for (uint32_t x = Left; x < Left + Width; x++)
+                    {
+                        m_Noise ^= m_Noise << 13;
+                        m_Noise ^= m_Noise >> 17;
+                        m_Noise ^= m_Noise << 5;
+                        m_Pixels[static_cast<size_t>(y) * m_Width + x] = m_Noise | 0xFF000000u;
+                    }
+                }
+                break;
+            }
+        }
+
+    private:
+        static uint32_t Desktop(uint32_t x, uint32_t y)
+        {
+            return 0xFF000000u | ((x / 8) & 0xFF) << 16 | ((y / 8) & 0xFF) << 8 | 0x60;
+        }
+
+        // Text in 9 x 18 cells with a different 8 x 12 glyph in every cell
+        static uint32_t Document(uint32_t x, uint32_t y)
+        {
+            uint32_t Column = x % 9;
+            uint32_t Row = y % 18;
+            if (Column == 8 || Row >= 12)
+            {
+                return 0xFFFFFFFFu;
+            }
+
+            uint32_t Glyph = Hash32((x / 9) * 0x10001u ^ (y / 18) * 0x9E3779B9u ^ Row);
+            return ((Glyph >> Column) & 1) ? 0xFF202020u : 0xFFFFFFFFu;
+        }
+
+        void Window(uint32_t Left, uint32_t Top, uint32_t Width, uint32_t Height, uint32_t ScrollX, uint32_t ScrollY)
+        {
+            for (uint32_t y = Top; y < min(m_Height, Top + Height); y++)
+            {
+                for (uint32_t x = Left; x < min(m_Width, Left + Width); x++)
+                {
+                    m_Pixels[static_cast<size_t>(y) * m_Width + x] = Document(x - Left + ScrollX, y - Top + ScrollY);
+                }
+            }
+        }
+
+        void Uncover(uint32_t Left, uint32_t Top, uint32_t Width, uint32_t Height)
+        {
+            for (uint32_t y = Top; y < min(m_Height, Top + Height); y++)
+            {
+                for (uint32_t x = Left; x < min(m_Width, Left + Width); x++)
+                {
+                    m_Pixels[static_cast<size_t>(y) * m_Width + x] = Desktop(x, y);
+                }
+            }
+        }
+
+        uint32_t m_Width;
+        uint32_t m_Height;
+        vector<uint32_t> m_Pixels;
+        uint32_t m_Noise;
+        uint32_t m_DragX;
+    };
+
+    // Applies the moves to a copy of Previous, then copies the dirty rectangles from Current, the way a sink would
+    bool Rebuild(const FrameDamage& Damage, const vector<uint8_t>& Previous, const uint8_t* pCurrent, uint32_t Width, uint32_t Height, vector<uint8_t>& Mirror)
+    {
+        const size_t Pitch = static_cast<size_t>(Width) * 4;
+        Mirror = Previous;
+
+        for (const MoveRect& Move : Damage.MoveRects())
+        {
+            size_t Bytes = static_cast<size_t>(Move.Destination.Right - Move.Destination.Left) * 4;
+            for (int32_t y = Move.Destination.Top; y < Move.Destination.Bottom; y++)
+            {
+                memcpy(&Mirror[y * Pitch + Move.Destination.Left * 4],
+                    &Previous[(Move.SourceY + y - Move.Destination.Top) * Pitch + Move.SourceX * 4],
+                    Bytes);
+            }
+        }
+
+        for (const Rect& Area : Damage.DirtyRegion())
+        {
+            for (int32_t y = Area.Top; y < Area.Bottom; y++)
+            {
+                memcpy(&Mirror[y * Pitch + Area.Left * 4], pCurrent + y * Pitch + Area.Left * 4, static_cast<size_t>(Area.Right - Area.Left) * 4);
+            }
+        }
+
+        return memcmp(Mirror.data(), pCurrent, static_cast<size_t>(Height) * Pitch) == 0;
+    }
+
+    double TimeFullHash(const uint8_t* pData, uint32_t Width, uint32_t Height, SimdLevel Level, uint64_t FrameCount)
+    {
+        MotionDetector Detector(32, Level);
+
+        double Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < FrameCount; i++)
+        {
+            Detector.Hash(pData, Width * 4, Width, Height);
+            Detector.Commit();
+        }
+        return (Bench::WallSeconds() - Start) / FrameCount;
+    }
+}
+
+int BenchMotion(int argc, char* argv[])
+{
+    uint64_t FrameCount = Bench::ParseOption(argc, argv, "frames", 120);
+    uint32_t Width = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "width", 1920));
+    uint32_t Height = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "height", 1080));
+    const size_t FrameBytes = static_cast<size_t>(Width) * Height * 4;
+    int Failures = 0;
+
+    printf("%ux%u frames, %llu frames per sequence\n\n", Width, Height, static_cast<unsigned long long>(FrameCount));
+
+    // Cost of hashing a whole frame, which is what the first frame and every frame without damage pay
+    Scene Static(Width, Height);
+    printf("%-8s %14s %10s\n", "tier", "full hash ms", "GB/s");
+    for (int Level = 0; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+    {
+        double Seconds = TimeFullHash(Static.Data(), Width, Height, static_cast<SimdLevel>(Level), FrameCount);
+        printf("%-8s %14.3f %10.2f\n", SimdLevelName(static_cast<SimdLevel>(Level)), Seconds * 1e3, FrameBytes / Seconds / 1e9);
+    }
+
+    printf("\n%-8s %-8s %10s %8s %12s %12s %10s %10s\n", "sequence", "tier", "ms/frame", "moves", "damage KB", "residual KB", "saved [%]", "mismatches");
+
+    for (const Sequence& Current : Sequences)
+    {
+        for (int Level = 0; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+        {
+            Scene Content(Width, Height);
+            TileChangeDetector Tiles(64);
+            MotionDetector Detector(32, static_cast<SimdLevel>(Level));
+            FrameDamage Damage;
+            Region Changed;
+            vector<MoveRect> Moves;
+            vector<uint8_t> Previous(Content.Data(), Content.Data() + FrameBytes);
+            vector<uint8_t> Mirror;
+
+            Tiles.Detect(Content.Data(), Content.Pitch(), Width, Height);
+            Detector.Hash(Content.Data(), Content.Pitch(), Width, Height);
+            Detector.Commit();
+
+            double Seconds = 0;
+            uint64_t MoveCount = 0;
+            uint64_t DamageBytes = 0;
+            uint64_t ResidualBytes = 0;
+            uint64_t Mismatches = 0;
+
+            for (uint32_t i = 1; i <= FrameCount; i++)
+            {
+                Content.Render(Current.Kind, i);
+
+                Tiles.Detect(Content.Data(), Content.Pitch(), Width, Height);
+                Changed.Clear();
+                Changed.Union(Tiles.ChangedRects().data(), Tiles.ChangedRects().size());
+
+                // What the pipeline does for a frame with detected damage
+                double Start = Bench::WallSeconds();
+                Detector.Hash(Content.Data(), Content.Pitch(), Width, Height, &Changed);
+                Detector.Search(Changed, FrameDamage::MaxMoveRects, Moves);
+                Seconds += Bench::WallSeconds() - Start;
+
+                Damage.Reset(DamageState::Partial);
+                for (const Rect& Area : Changed)
+                {
+                    Damage.AddDirtyRect(Area);
+                }
+                for (const MoveRect& Move : Moves)
+                {
+                    Damage.AddExactMove(Move);
+                }
+                Damage.Normalize(Width, Height);
+
+                if (!Rebuild(Damage, Previous, Content.Data(), Width, Height, Mirror))
+                {
+                    Mismatches++;
+                }
+
+                MoveCount += Damage.MoveRects().size();
+                DamageBytes += Changed.Area() * 4;
+                ResidualBytes += Damage.DirtyRegion().Area() * 4;
+
+                Detector.Commit();
+                Previous.assign(Content.Data(), Content.Data() + FrameBytes);
+            }
+
+            printf("%-8s %-8s %10.3f %8.2f %12.1f %12.1f %10.1f %10llu\n",
+                Current.Name,
+                SimdLevelName(static_cast<SimdLevel>(Level)),
+                Seconds * 1e3 / FrameCount,
+                static_cast<double>(MoveCount) / FrameCount,
+                DamageBytes / 1024.0 / FrameCount,
+                ResidualBytes / 1024.0 / FrameCount,
+                DamageBytes != 0 ? 100.0 - ResidualBytes * 100.0 / DamageBytes : 0.0,
+                static_cast<unsigned long long>(Mismatches));
+
+            Failures += Mismatches != 0 ? 1 : 0;
+        }
+    }
+
+    return Failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*++
+
+Module Name:
+
+    bench_pacing.cpp
+
+Abstract:
+
+    Compares the wakeups and the acquire latency of the frame pipeline's wait: the fixed 16 ms poll the loop used
+    to do against event-driven waiting paced by the refresh rate. A scripted swap-chain on a virtual clock presents
+    frames on vsync boundaries and signals its new-frame event, so a minute of desktop use replays in milliseconds.
+    Every fifth event arrives half a millisecond before its buffer is ready, as happens when the producer signals
+    early. Reports the wakeups per second of the acquire thread, the wakeups that found no buffer, and the
+    time from a buffer becoming ready to its acquisition, for an idle desktop with a ticking clock, typing, and an
+    animation at the full refresh rate. Every presented frame must be acquired.
+
+    Options: --seconds N (default 60)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint64_t EarlySignalInterval = 5;
+    const uint64_t EarlySignalLead = 500000;    // [ns]
+    const uint64_t Tail = 100000000;            // virtual time after the last presentation [ns]
+
+    struct Presentation
+    {
+        uint64_t Signal;    // when the new-frame event is set [ns]
+        uint64_t Ready;     // when the buffer can be acquired [ns]
+    };
+
+    enum class Scenario
+    {
+        Idle,       // a clock that ticks once a second
+        Typing,     // a keystroke every 150 ms and a caret blinking every 530 ms
+        Animation,  // a new frame on every vsync
+    };
+
+    const char* ScenarioName(Scenario Kind)
+    {
+        switch (Kind)
+        {
+        case Scenario::Idle:
+            return "idle";
+        case Scenario::Typing:
+            return "typing";
+        default:
+            return "animation";
+        }
+    }
+
+    vector<Presentation> MakeScript(Scenario Kind, uint32_t RefreshRate, uint64_t Duration)
+    {
+        const uint64_t Period = 1000000000ull / RefreshRate;
+        vector<uint64_t> Updates;
+
+        switch (Kind)
+        {
+        case Scenario::Idle:
+            for (uint64_t t = 1000000000ull; t < Duration; t += 1000000000ull)
+            {
+                Updates.push_back(t);
+            }
+            break;
+        case Scenario::Typing:
+            for (uint64_t t = 150000000ull; t < Duration; t += 150000000ull)
+            {
+                Updates.push_back(t);
+            }
+            for (uint64_t t = 530000000ull; t < Duration; t += 530000000ull)
+            {
+                Updates.push_back(t);
+            }
+            break;
+        default:
+            for (uint64_t t = Period; t < Duration; t += Period)
+            {
+                Updates.push_back(t);
+            }
+            break;
+        }
+
+        // The compositor presents on the next vsync, at most once per vsync
+        vector<Presentation> Script;
+        sort(Updates.begin(), Updates.end());
+        for (uint64_t Update : Updates)
+        {
+            uint64_t Ready = (Update + Period - 1) / Period * Period;
+            if (Ready >= Duration || (!Script.empty() && Script.back().Ready >= Ready))
+            {
+                continue;
+            }
+
+            uint64_t Signal = (Script.size() % EarlySignalInterval == EarlySignalInterval - 1) ? Ready - EarlySignalLead : Ready;
+            Script.push_back({ Signal, Ready });
+        }
+
+        return Script;
+    }
+
+    /// <summary>
+    /// Presents scripted frames on a virtual clock that jumps straight to whatever the pipeline waits for.
+    /// </summary>
+    class ScriptedSwapChain : public ISwapChainSource
+    {
+    public:
+        ScriptedSwapChain(vector<Presentation> Script, uint64_t End)
+            : m_Script(move(Script)), m_End(End), m_Now(0), m_NextSignal(0), m_NextFrame(0), m_EventSet(false)
+        {
+        }
+
+        bool Initialize() override { return true; }
+
+        AcquireStatus ReleaseAndAcquire(Frame& Frame) override
+        {
+            if (m_Now >= m_End)
+            {
+                return AcquireStatus::Failed;
+            }
+
+            if (m_NextFrame == m_Script.size() || m_Script[m_NextFrame].Ready > m_Now)
+            {
+                return AcquireStatus::Pending;
+            }
+
+            const Presentation& Presented = m_Script[m_NextFrame];
+            m_LatencyUs.push_back((m_Now - Presented.Ready) / 1000.0);
+
+            Frame.FrameNumber = m_NextFrame++;
+            Frame.PresentTime = Presented.Ready;
+            Frame.Width = 64;
+            Frame.Height = 64;
+            Frame.Format = PixelFormat::Bgra8;
+            return AcquireStatus::Acquired;
+        }
+
+        WaitStatus WaitForFrame(uint32_t TimeoutMs) override
+        {
+            // An event set while nobody waited satisfies the next wait at once, and only that one
+            if (m_EventSet)
+            {
+                m_EventSet = false;
+                return WaitStatus::NewFrame;
+            }
+
+            uint64_t Deadline = (TimeoutMs == FramePacer::WaitForever) ? m_End : min(m_End, m_Now + static_cast<uint64_t>(TimeoutMs) * 1000000);
+            if (m_NextSignal < m_Script.size() && m_Script[m_NextSignal].Signal <= Deadline)
+            {
+                m_Now = max(m_Now, m_Script[m_NextSignal].Signal);
+                Fire();
+                m_EventSet = false;
+                return WaitStatus::NewFrame;
+            }
+
+            m_Now = Deadline;
+            Fire();
+            return m_Now >= m_End ? WaitStatus::Terminate : WaitStatus::Timeout;
+        }
+
+        bool FinishedProcessing() override { return true; }
+
+        uint64_t Now() override { return m_Now; }
+
+        size_t Presented() const { return m_Script.size(); }
+        size_t Acquired() const { return m_NextFrame; }
+        vector<double>& LatencyUs() { return m_LatencyUs; }
+
+    private:
+        // Sets the event for every signal up to now
+        void Fire()
+        {
+            while (m_NextSignal < m_Script.size() && m_Script[m_NextSignal].Signal <= m_Now)
+            {
+                m_NextSignal++;
+                m_EventSet = true;
+            }
+        }
+
+        vector<Presentation> m_Script;
+        uint64_t m_End;
+        uint64_t m_Now;
+        size_t m_NextSignal;
+        size_t m_NextFrame;
+        bool m_EventSet;
+        vector<double> m_LatencyUs;
+    };
+}
+
+int BenchPacing(int argc, char* argv[])
+{
+    uint64_t Seconds = max<uint64_t>(1, Bench::ParseOption(argc, argv, "seconds", 60));
+    const uint64_t Duration = Seconds * 1000000000ull;
+
+    printf("%llu s of virtual time per run\n\n", static_cast<unsigned long long>(Seconds));
+    printf("%-10s %5s %-7s %8s %10s %10s %10s %10s %10s\n", "scenario", "Hz", "wait", "frames", "wakeups/s", "spurious", "p50 [us]", "p99 [us]", "max [us]");
+
+    const Scenario Scenarios[] = { Scenario::Idle, Scenario::Typing, Scenario::Animation };
+    const uint32_t RefreshRates[] = { 60, 144, 240 };
+    int Failures = 0;
+
+    for (Scenario Kind : Scenarios)
+    {
+        for (uint32_t RefreshRate : RefreshRates)
+        {
+            for (bool Paced : { false, true })
+            {
+                ScriptedSwapChain SwapChain(MakeScript(Kind, RefreshRate, Duration), Duration + Tail);
+                FramePipeline Pipeline(SwapChain);
+                Pipeline.SetRefreshRate(RefreshRate, 1);
+                if (!Paced)
+                {
+                    Pipeline.SetFixedPolling(16);
+                }
+
+                Pipeline.RunCore();
+
+                const PacerStatistics& Pacing = Pipeline.Pacing();
+                vector<double>& Latency = SwapChain.LatencyUs();
+
+                printf("%-10s %5u %-7s %8zu %10.1f %10llu %10.1f %10.1f %10.1f\n",
+                    ScenarioName(Kind),
+                    RefreshRate,
+                    Paced ? "paced" : "poll16",
+                    SwapChain.Acquired(),
+                    Pacing.Wakeups * 1e9 / (Duration + Tail),
+                    static_cast<unsigned long long>(Pacing.SpuriousWakeups),
+                    Latency.empty() ? 0.0 : Bench::Percentile(Latency, 50),
+                    Latency.empty() ? 0.0 : Bench::Percentile(Latency, 99),
+                    Latency.empty() ? 0.0 : Bench::Percentile(Latency, 100));
+
+                if (SwapChain.Acquired() != SwapChain.Presented())
+                {
+                    printf("  FAILED: %zu of %zu frames acquired\n", SwapChain.Acquired(), SwapChain.Presented());
+                    Failures = 1;
+                }
+            }
+        }
+    }
+
+    return Failures;
+}
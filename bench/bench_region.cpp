@@ -0,0 +1,424 @@
+/*++
+
+Module Name:
+
+    bench_region.cpp
+
+Abstract:
+
+    Checks the banded region against a pixel bitmap on thousands of random regions: every union, intersection and
+    subtraction must cover exactly the right pixels, stay canonical (sorted bands, non-overlapping rectangles,
+    coalesced spans and bands, exact extents) and obey the usual set identities. Then times damage accumulation
+    against a rectangle list that keeps itself non-overlapping by splitting rectangles, and reports how often a
+    region had to leave its inline storage.
+
+    Options: --trials N (default 20000), --repeat N (default 200)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "../pipeline/region.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // The property checks work on a small grid so every pixel can be checked; rectangles may reach past it
+    const int32_t GridMin = -4;
+    const int32_t GridMax = 60;
+    const int32_t GridSize = GridMax - GridMin;
+
+    uint32_t NextRandom(uint32_t& State)
+    {
+        State ^= State << 13;
+        State ^= State >> 17;
+        State ^= State << 5;
+        return State;
+    }
+
+    int32_t RandomIn(uint32_t& State, int32_t Low, int32_t High)
+    {
+        return Low + static_cast<int32_t>(NextRandom(State) % static_cast<uint32_t>(High - Low));
+    }
+
+    Rect RandomRect(uint32_t& State, int32_t Low, int32_t High, int32_t MaxSize)
+    {
+        int32_t Left = RandomIn(State, Low, High);
+        int32_t Top = RandomIn(State, Low, High);
+        return { Left, Top, min(High, Left + RandomIn(State, 0, MaxSize)), min(High, Top + RandomIn(State, 0, MaxSize)) };
+    }
+
+    /// <summary>
+    /// The reference: one flag per pixel of the grid.
+    /// </summary>
+    struct Bitmap
+    {
+        vector<uint8_t> Pixels = vector<uint8_t>(static_cast<size_t>(GridSize) * GridSize, 0);
+
+        void Fill(const Rect& Area, uint8_t Value)
+        {
+            for (int32_t y = max(Area.Top, GridMin); y < min(Area.Bottom, GridMax); y++)
+            {
+                for (int32_t x = max(Area.Left, GridMin); x < min(Area.Right, GridMax); x++)
+                {
+                    Pixels[static_cast<size_t>(y - GridMin) * GridSize + (x - GridMin)] = Value;
+                }
+            }
+        }
+
+        bool Get(int32_t x, int32_t y) const { return Pixels[static_cast<size_t>(y - GridMin) * GridSize + (x - GridMin)] != 0; }
+    };
+
+    // A random region built from unions and subtractions, mirrored into a bitmap
+    void RandomRegion(uint32_t& State, Region& Result, Bitmap& Reference)
+    {
+        Result.Clear();
+        Reference = Bitmap();
+
+        int Operations = RandomIn(State, 0, 12);
+        for (int i = 0; i < Operations; i++)
+        {
+            Rect Area = RandomRect(State, GridMin, GridMax, 40);
+            if (NextRandom(State) % 4 == 0)
+            {
+                Result.Subtract(Area);
+                Reference.Fill(Area, 0);
+            }
+            else
+            {
+                Result.Union(Area);
+                Reference.Fill(Area, 1);
+            }
+        }
+    }
+
+    // Returns true if the region is canonical and covers exactly the pixels set in Reference
+    bool Matches(const Region& Result, const Bitmap& Reference)
+    {
+        Bitmap Covered;
+        int64_t Area = 0;
+        Rect Extents = {};
+        const Rect* pPreviousBand = nullptr;
+        const Rect* pBand = nullptr;
+
+        for (const Rect* p = Result.begin(); p != Result.end(); p++)
+        {
+            if (p->Empty() || p->Left < GridMin || p->Top < GridMin || p->Right > GridMax || p->Bottom > GridMax)
+            {
+                return false;
+            }
+
+            if (p == Result.begin() || p->Top != pBand->Top)
+            {
+                // A new band starts below the previous one
+                if (pBand && p->Top < (p - 1)->Bottom)
+                {
+                    return false;
+                }
+
+                // Touching bands with identical spans should have been merged
+                if (pBand && pPreviousBand && pPreviousBand->Bottom == pBand->Top && (pBand - pPreviousBand) == (p - pBand) &&
+                    equal(pPreviousBand, pBand, pBand, [](const Rect& A, const Rect& B) { return A.Left == B.Left && A.Right == B.Right; }))
+                {
+                    return false;
+                }
+
+                pPreviousBand = pBand;
+                pBand = p;
+            }
+            else if (p->Bottom != pBand->Bottom || p->Left <= (p - 1)->Right)
+            {
+                // Spans in a band share their rows, are sorted and never touch
+                return false;
+            }
+
+            Extents = (p == Result.begin()) ? *p : Rect{ min(Extents.Left, p->Left), min(Extents.Top, p->Top), max(Extents.Right, p->Right), max(Extents.Bottom, p->Bottom) };
+            Area += p->Area();
+            Covered.Fill(*p, 1);
+        }
+
+        // The last band against the one before it
+        if (pBand && pPreviousBand && pPreviousBand->Bottom == pBand->Top && (pBand - pPreviousBand) == (Result.end() - pBand) &&
+            equal(pPreviousBand, pBand, pBand, [](const Rect& A, const Rect& B) { return A.Left == B.Left && A.Right == B.Right; }))
+        {
+            return false;
+        }
+
+        if (Extents != Result.Extents() || Area != Result.Area())
+        {
+            return false;
+        }
+
+        int64_t Expected = 0;
+        for (int32_t y = GridMin; y < GridMax; y++)
+        {
+            for (int32_t x = GridMin; x < GridMax; x++)
+            {
+                bool Set = Reference.Get(x, y);
+                Expected += Set ? 1 : 0;
+                if (Set != Covered.Get(x, y) || Set != Result.Contains(x, y))
+                {
+                    return false;
+                }
+            }
+        }
+
+        // Overlapping rectangles would count some pixels twice
+        return Expected == Area;
+    }
+
+    /// <summary>
+    /// The baseline: a rectangle list kept non-overlapping by splitting rectangles against each other.
+    /// </summary>
+    class RectList
+    {
+    public:
+        void Union(const Rect& Area)
+        {
+            // Add only the parts of Area no rectangle already covers
+            m_Pieces.assign(1, Area);
+            for (const Rect& Existing : m_Rects)
+            {
+                m_Scratch.clear();
+                for (const Rect& Piece : m_Pieces)
+                {
+                    Split(Piece, Existing, m_Scratch);
+                }
+                m_Pieces.swap(m_Scratch);
+            }
+            m_Rects.insert(m_Rects.end(), m_Pieces.begin(), m_Pieces.end());
+        }
+
+        void Subtract(const Rect& Area)
+        {
+            m_Scratch.clear();
+            for (const Rect& Existing : m_Rects)
+            {
+                Split(Existing, Area, m_Scratch);
+            }
+            m_Rects.swap(m_Scratch);
+        }
+
+        void Intersect(const Rect& Area)
+        {
+            size_t Kept = 0;
+            for (const Rect& Existing : m_Rects)
+            {
+                Rect Clipped = { max(Existing.Left, Area.Left), max(Existing.Top, Area.Top), min(Existing.Right, Area.Right), min(Existing.Bottom, Area.Bottom) };
+                if (!Clipped.Empty())
+                {
+                    m_Rects[Kept++] = Clipped;
+                }
+            }
+            m_Rects.resize(Kept);
+        }
+
+        void Clear() { m_Rects.clear(); }
+        size_t RectCount() const { return m_Rects.size(); }
+
+        int64_t Area() const
+        {
+            int64_t Total = 0;
+            for (const Rect& Existing : m_Rects)
+            {
+                Total += Existing.Area();
+            }
+            return Total;
+        }
+
+    private:
+        // Appends the up to four pieces of Area outside Cut
+        static void Split(const Rect& Area, const Rect& Cut, vector<Rect>& Out)
+        {
+            if (Cut.Left >= Area.Right || Cut.Right <= Area.Left || Cut.Top >= Area.Bottom || Cut.Bottom <= Area.Top)
+            {
+                Out.push_back(Area);
+                return;
+            }
+
+            int32_t Top = max(Area.Top, Cut.Top);
+            int32_t Bottom = min(Area.Bottom, Cut.Bottom);
+            if (Area.Top < Top)
+            {
+                Out.push_back({ Area.Left, Area.Top, Area.Right, Top });
+            }
+            if (Area.Left < Cut.Left)
+            {
+                Out.push_back({ Area.Left, Top, Cut.Left, Bottom });
+            }
+            if (Cut.Right < Area.Right)
+            {
+                Out.push_back({ Cut.Right, Top, Area.Right, Bottom });
+            }
+            if (Bottom < Area.Bottom)
+            {
+                Out.push_back({ Area.Left, Bottom, Area.Right, Area.Bottom });
+            }
+        }
+
+        vector<Rect> m_Rects;
+        vector<Rect> m_Pieces;
+        vector<Rect> m_Scratch;
+    };
+
+    uint64_t RunPropertyChecks(uint64_t Trials)
+    {
+        uint32_t State = 0x3C6EF372;
+        uint64_t Failures = 0;
+
+        Region A, B;
+        Bitmap ReferenceA, ReferenceB;
+
+        for (uint64_t Trial = 0; Trial < Trials; Trial++)
+        {
+            RandomRegion(State, A, ReferenceA);
+            RandomRegion(State, B, ReferenceB);
+
+            Bitmap Expected[3];
+            for (size_t i = 0; i < ReferenceA.Pixels.size(); i++)
+            {
+                Expected[0].Pixels[i] = ReferenceA.Pixels[i] | ReferenceB.Pixels[i];
+                Expected[1].Pixels[i] = ReferenceA.Pixels[i] & ReferenceB.Pixels[i];
+                Expected[2].Pixels[i] = ReferenceA.Pixels[i] & !ReferenceB.Pixels[i];
+            }
+
+            Region Union = A;
+            Union.Union(B);
+            Region Intersection = A;
+            Intersection.Intersect(B);
+            Region Difference = A;
+            Difference.Subtract(B);
+
+            bool Ok = Matches(A, ReferenceA) && Matches(B, ReferenceB) &&
+                Matches(Union, Expected[0]) && Matches(Intersection, Expected[1]) && Matches(Difference, Expected[2]);
+
+            // Set identities, which hold as plain equality because the representation is canonical
+            Region Commuted = B;
+            Commuted.Union(A);
+            Ok = Ok && Commuted == Union;
+
+            Commuted = B;
+            Commuted.Intersect(A);
+            Ok = Ok && Commuted == Intersection;
+
+            Region Rebuilt = Difference;
+            Rebuilt.Union(Intersection);
+            Ok = Ok && Rebuilt == A;
+
+            Region Disjoint = Difference;
+            Disjoint.Intersect(B);
+            Ok = Ok && Disjoint.Empty();
+
+            Region Moved = std::move(Rebuilt);
+            Moved.Translate(7, -3);
+            Moved.Translate(-7, 3);
+            Ok = Ok && Moved == A;
+
+            Failures += Ok ? 0 : 1;
+        }
+
+        return Failures;
+    }
+}
+
+int BenchRegion(int argc, char* argv[])
+{
+    uint64_t Trials = Bench::ParseOption(argc, argv, "trials", 20000);
+    uint64_t Repeat = Bench::ParseOption(argc, argv, "repeat", 200);
+    int Failures = 0;
+
+    uint64_t PropertyFailures = RunPropertyChecks(Trials);
+    printf("property checks: %llu random region pairs, %llu failures\n\n",
+        static_cast<unsigned long long>(Trials), static_cast<unsigned long long>(PropertyFailures));
+    Failures += PropertyFailures != 0 ? 1 : 0;
+
+    // Damage accumulation on a 1080p screen: N rectangles of up to Size pixels, then a few holes and a clip
+    printf("%-8s %6s %12s %12s %10s %10s %8s\n", "damage", "rects", "region [us]", "list [us]", "region #", "list #", "heap %");
+
+    struct Workload
+    {
+        const char* Name;
+        int Count;
+        int32_t Size;
+    };
+    const Workload Workloads[] = { { "typing", 4, 40 }, { "typing", 16, 40 }, { "windows", 8, 600 }, { "tiles", 64, 64 }, { "storm", 512, 32 } };
+    const Rect Screen = { 0, 0, 1920, 1080 };
+
+    for (const Workload& Load : Workloads)
+    {
+        uint32_t State = 0x9E3779B9u + Load.Count;
+        vector<Rect> Rects(static_cast<size_t>(Load.Count));
+        vector<Rect> Holes(4);
+
+        RectList List;
+        double RegionSeconds = 0;
+        double ListSeconds = 0;
+        uint64_t RegionRects = 0;
+        uint64_t ListRects = 0;
+        uint64_t OnHeap = 0;
+
+        for (uint64_t r = 0; r < Repeat; r++)
+        {
+            for (Rect& Area : Rects)
+            {
+                Area = RandomRect(State, -16, 1936, Load.Size);
+            }
+            for (Rect& Area : Holes)
+            {
+                Area = RandomRect(State, 0, 1920, Load.Size);
+            }
+
+            // A fresh region per frame, starting out in its inline storage
+            Region Damage;
+            double Start = Bench::WallSeconds();
+            Damage.Union(Rects.data(), Rects.size());
+            for (const Rect& Area : Holes)
+            {
+                Damage.Subtract(Area);
+            }
+            Damage.Intersect(Screen);
+            RegionSeconds += Bench::WallSeconds() - Start;
+
+            Start = Bench::WallSeconds();
+            List.Clear();
+            for (const Rect& Area : Rects)
+            {
+                List.Union(Area);
+            }
+            for (const Rect& Area : Holes)
+            {
+                List.Subtract(Area);
+            }
+            List.Intersect(Screen);
+            ListSeconds += Bench::WallSeconds() - Start;
+
+            // Both are exact, so they must agree on the area
+            Failures += Damage.Area() != List.Area() ? 1 : 0;
+
+            RegionRects += Damage.RectCount();
+            ListRects += List.RectCount();
+            OnHeap += Damage.OnHeap() ? 1 : 0;
+        }
+
+        printf("%-8s %6d %12.2f %12.2f %10.1f %10.1f %8.1f\n",
+            Load.Name,
+            Load.Count,
+            RegionSeconds * 1e6 / Repeat,
+            ListSeconds * 1e6 / Repeat,
+            static_cast<double>(RegionRects) / Repeat,
+            static_cast<double>(ListRects) / Repeat,
+            OnHeap * 100.0 / Repeat);
+    }
+
+    return Failures == 0 ? 0 : 1;
+}
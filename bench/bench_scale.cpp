@@ -0,0 +1,640 @@
+/*++
+
+Module Name:
+
+    bench_scale.cpp
+
+Abstract:
+
+    Checks and measures the scalers. Every kernel tier the CPU supports must match the scalar reference exactly,
+    for both formats, all three filters, odd sizes and ratios that shrink and enlarge. The fixed-point results must
+    stay within one step of a floating-point reference that computes every destination pixel straight from the
+    filter's definition; the table of those reports the largest error and the PSNR against the reference. The
+    pyramid must match halving the image three times in a row, and its first level must match box scaling by half.
+    With every filter, a consumer behind the stage that only redraws the damage it is handed must keep up with the
+    screen, also when a later stage drops every third frame and the pipeline folds their damage into the next one.
+    Then reports scaling throughput from a 4K source for common output sizes, and the single-pass pyramid against
+    scaling the source three times. GB/s is the source size over the time taken, though bilinear skips rows when
+    shrinking by more than half; budget is the share of a 60 Hz frame.
+
+    Options: --frames N (default 10)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/frame_scaler.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const ScaleFilter Filters[] = { ScaleFilter::Box, ScaleFilter::Bilinear, ScaleFilter::Area };
+    const PixelFormat Formats[] = { PixelFormat::Bgra8, PixelFormat::Nv12 };
+
+    struct Image
+    {
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t Pitch;
+        vector<uint8_t> Data;
+    };
+
+    uint32_t Channels(PixelFormat Format)
+    {
+        return Format == PixelFormat::Bgra8 ? 4 : 1;
+    }
+
+    Image MakeImage(uint32_t Width, uint32_t Height, PixelFormat Format)
+    {
+        Image Result;
+        Result.Width = Width;
+        Result.Height = Height;
+
+        // A little slack past the row, as pooled buffers have
+        Result.Pitch = (Width * Channels(Format) + 2 + 15) & ~15u;
+        Result.Data.assign(static_cast<size_t>(Result.Pitch) * FrameRows(Format, Height), 0xCD);
+        return Result;
+    }
+
+    // Smooth gradients with noise on top, so that both flat and busy areas are exercised
+    void FillPattern(Image& Target, PixelFormat Format, uint32_t Seed)
+    {
+        uint32_t State = Seed | 1;
+        uint32_t Rows = FrameRows(Format, Target.Height);
+        uint32_t Bytes = Format == PixelFormat::Bgra8 ? Target.Width * 4 : ((Target.Width + 1) & ~1u);
+        for (uint32_t y = 0; y < Rows; y++)
+        {
+            for (uint32_t x = 0; x < Bytes; x++)
+            {
+                State ^= State << 13;
+                State ^= State >> 17;
+                State ^= State << 5;
+                uint32_t Gradient = (x * 255 / max(Bytes, 1u) + y * 255 / max(Rows, 1u)) / 2;
+                uint32_t Value = (y / 8 + x / 32) % 4 == 0 ? (State >> 24) : Gradient;
+                Target.Data[static_cast<size_t>(y) * Target.Pitch + x] = static_cast<uint8_t>(Value);
+            }
+        }
+    }
+
+    bool Scale(const Image& Source, Image& Destination, PixelFormat Format, ScaleFilter Filter, SimdLevel Level)
+    {
+        return ScaleFrame(Source.Data.data(), Source.Pitch, Source.Width, Source.Height, Destination.Data.data(), Destination.Pitch,
+            Destination.Width, Destination.Height, Format, Filter, Level);
+    }
+
+    // Compares the pixels of two images of the same size and format, ignoring the padding
+    bool SamePixels(const Image& A, const Image& B, PixelFormat Format)
+    {
+        uint32_t Bytes = Format == PixelFormat::Bgra8 ? A.Width * 4 : A.Width;
+        uint32_t ChromaBytes = (A.Width + 1) / 2 * 2;
+        for (uint32_t y = 0; y < FrameRows(Format, A.Height); y++)
+        {
+            uint32_t RowBytes = y < A.Height ? Bytes : ChromaBytes;
+            if (memcmp(A.Data.data() + static_cast<size_t>(y) * A.Pitch, B.Data.data() + static_cast<size_t>(y) * B.Pitch, RowBytes) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //
+    // Floating-point reference: each destination sample straight from the filter's definition
+    //
+
+    // Weight of source pixel i in destination pixel d along one axis
+    double ReferenceWeight(ScaleFilter Filter, uint32_t Source, uint32_t Destination, uint32_t d, uint32_t i)
+    {
+        double Scale = static_cast<double>(Source) / Destination;
+        switch (Filter)
+        {
+        case ScaleFilter::Box:
+        {
+            uint64_t Begin = static_cast<uint64_t>(d) * Source / Destination;
+            uint64_t End = max(static_cast<uint64_t>(d + 1) * Source / Destination, Begin + 1);
+            return i >= Begin && i < End ? 1.0 / (End - Begin) : 0.0;
+        }
+
+        case ScaleFilter::Bilinear:
+        {
+            double Center = min(max((d + 0.5) * Scale - 0.5, 0.0), Source - 1.0);
+            double Distance = fabs(Center - i);
+            return Distance < 1.0 ? 1.0 - Distance : 0.0;
+        }
+
+        default:
+        {
+            double Overlap = min((d + 1) * Scale, i + 1.0) - max(d * Scale, static_cast<double>(i));
+            return Overlap > 0 ? Overlap / Scale : 0.0;
+        }
+        }
+    }
+
+    // Scales one plane of Channels-byte pixels in double precision
+    void ReferencePlane(
+        const uint8_t* pSource,
+        uint32_t SourcePitch,
+        uint32_t SourceWidth,
+        uint32_t SourceHeight,
+        uint32_t Width,
+        uint32_t Height,
+        uint32_t Channels,
+        ScaleFilter Filter,
+        vector<double>& Result)
+    {
+        Result.assign(static_cast<size_t>(Width) * Height * Channels, 0.0);
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            for (uint32_t x = 0; x < Width; x++)
+            {
+                double RowTotal = 0, Sums[4] = {};
+                for (uint32_t j = 0; j < SourceHeight; j++)
+                {
+                    double RowWeight = ReferenceWeight(Filter, SourceHeight, Height, y, j);
+                    if (RowWeight == 0)
+                    {
+                        continue;
+                    }
+                    for (uint32_t i = 0; i < SourceWidth; i++)
+                    {
+                        double Weight = RowWeight * ReferenceWeight(Filter, SourceWidth, Width, x, i);
+                        if (Weight == 0)
+                        {
+                            continue;
+                        }
+                        RowTotal += Weight;
+                        for (uint32_t c = 0; c < Channels; c++)
+                        {
+                            Sums[c] += Weight * pSource[static_cast<size_t>(j) * SourcePitch + i * Channels + c];
+                        }
+                    }
+                }
+                for (uint32_t c = 0; c < Channels; c++)
+                {
+                    Result[(static_cast<size_t>(y) * Width + x) * Channels + c] = Sums[c] / RowTotal;
+                }
+            }
+        }
+    }
+
+    struct Quality
+    {
+        double MaxError;
+        double SquaredError;
+        uint64_t Samples;
+    };
+
+    void CompareToReference(const uint8_t* pScaled, uint32_t Pitch, uint32_t Width, uint32_t Height, uint32_t Channels,
+        const vector<double>& Reference, Quality& Result)
+    {
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            for (uint32_t i = 0; i < Width * Channels; i++)
+            {
+                double Error = fabs(pScaled[static_cast<size_t>(y) * Pitch + i] - Reference[static_cast<size_t>(y) * Width * Channels + i]);
+                Result.MaxError = max(Result.MaxError, Error);
+                Result.SquaredError += Error * Error;
+                Result.Samples++;
+            }
+        }
+    }
+
+    // Returns the number of quality cases more than one step off the reference
+    uint32_t CheckQuality()
+    {
+        const struct { uint32_t Width; uint32_t Height; } Sizes[] =
+        {
+            { 320, 180 }, { 213, 120 }, { 97, 53 }, { 40, 22 }, { 480, 270 },
+        };
+        const uint32_t SourceWidth = 320, SourceHeight = 180;
+        uint32_t Failures = 0;
+
+        printf("%-5s %-8s %-9s %-10s %10s %10s\n", "fmt", "filter", "from", "to", "max err", "PSNR dB");
+        for (PixelFormat Format : Formats)
+        {
+            Image Source = MakeImage(SourceWidth, SourceHeight, Format);
+            FillPattern(Source, Format, 7);
+
+            for (ScaleFilter Filter : Filters)
+            {
+                for (const auto& Size : Sizes)
+                {
+                    Image Scaled = MakeImage(Size.Width, Size.Height, Format);
+                    Scale(Source, Scaled, Format, Filter, DetectSimdLevel());
+
+                    Quality Result = {};
+                    vector<double> Reference;
+                    ReferencePlane(Source.Data.data(), Source.Pitch, SourceWidth, SourceHeight, Size.Width, Size.Height, Channels(Format),
+                        Filter, Reference);
+                    CompareToReference(Scaled.Data.data(), Scaled.Pitch, Size.Width, Size.Height, Channels(Format), Reference, Result);
+
+                    if (Format == PixelFormat::Nv12)
+                    {
+                        uint32_t ChromaWidth = (Size.Width + 1) / 2, ChromaHeight = (Size.Height + 1) / 2;
+                        ReferencePlane(Source.Data.data() + static_cast<size_t>(Source.Pitch) * SourceHeight, Source.Pitch, SourceWidth / 2,
+                            SourceHeight / 2, ChromaWidth, ChromaHeight, 2, Filter, Reference);
+                        CompareToReference(Scaled.Data.data() + static_cast<size_t>(Scaled.Pitch) * Size.Height, Scaled.Pitch, ChromaWidth,
+                            ChromaHeight, 2, Reference, Result);
+                    }
+
+                    double Mse = Result.SquaredError / Result.Samples;
+                    char From[16], To[16];
+                    snprintf(From, sizeof(From), "%ux%u", SourceWidth, SourceHeight);
+                    snprintf(To, sizeof(To), "%ux%u", Size.Width, Size.Height);
+                    printf("%-5s %-8s %-9s %-10s %10.3f %10.1f\n", Format == PixelFormat::Bgra8 ? "bgra" : "nv12", ScaleFilterName(Filter),
+                        From, To, Result.MaxError, Mse > 0 ? 10 * log10(255.0 * 255.0 / Mse) : 99.0);
+
+                    // Rounding the weights and the intermediate row may cost up to one step, never more
+                    if (Result.MaxError > 1.0)
+                    {
+                        printf("  FAILED: more than one step off the reference\n");
+                        Failures++;
+                    }
+                }
+            }
+        }
+
+        return Failures;
+    }
+
+    // Returns the number of cases where a vector tier differs from the scalar reference
+    uint32_t CheckExactness(uint32_t& Cases)
+    {
+        const struct { uint32_t Width; uint32_t Height; } Sizes[] =
+        {
+            { 1, 1 }, { 7, 5 }, { 97, 33 }, { 1917, 13 }, { 1920, 16 },
+        };
+        const struct { uint32_t Numerator; uint32_t Denominator; } Ratios[] =
+        {
+            { 1, 2 }, { 1, 3 }, { 2, 3 }, { 3, 7 }, { 1, 8 }, { 3, 2 }, { 1, 1 },
+        };
+
+        uint32_t Mismatches = 0;
+        Cases = 0;
+
+        for (const auto& Size : Sizes)
+        {
+            for (PixelFormat Format : Formats)
+            {
+                Image Source = MakeImage(Size.Width, Size.Height, Format);
+                FillPattern(Source, Format, Size.Width * 31 + Size.Height);
+
+                for (const auto& Ratio : Ratios)
+                {
+                    uint32_t Width = max(1u, Size.Width * Ratio.Numerator / Ratio.Denominator);
+                    uint32_t Height = max(1u, Size.Height * Ratio.Numerator / Ratio.Denominator);
+
+                    for (ScaleFilter Filter : Filters)
+                    {
+                        Image Reference = MakeImage(Width, Height, Format);
+                        Scale(Source, Reference, Format, Filter, SimdLevel::Scalar);
+
+                        for (int Level = 1; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+                        {
+                            Image Scaled = MakeImage(Width, Height, Format);
+                            Scale(Source, Scaled, Format, Filter, static_cast<SimdLevel>(Level));
+                            Cases++;
+
+                            if (Scaled.Data != Reference.Data)
+                            {
+                                Mismatches++;
+                                printf("MISMATCH %s %s %s %ux%u to %ux%u\n", SimdLevelName(static_cast<SimdLevel>(Level)),
+                                    Format == PixelFormat::Bgra8 ? "bgra" : "nv12", ScaleFilterName(Filter), Size.Width, Size.Height, Width, Height);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        return Mismatches;
+    }
+
+    // Halves a plane the simple way, a pixel at a time, replicating an odd last column and row
+    void ReferenceHalve(const uint8_t* pSource, uint32_t SourcePitch, uint32_t Width, uint32_t Height, uint32_t Channels, uint8_t* pDestination,
+        uint32_t DestinationPitch)
+    {
+        for (uint32_t y = 0; y < (Height + 1) / 2; y++)
+        {
+            const uint8_t* pTop = pSource + static_cast<size_t>(y * 2) * SourcePitch;
+            const uint8_t* pBottom = pSource + static_cast<size_t>(min(y * 2 + 1, Height - 1)) * SourcePitch;
+            for (uint32_t x = 0; x < (Width + 1) / 2; x++)
+            {
+                uint32_t Left = x * 2, Right = min(x * 2 + 1, Width - 1);
+                for (uint32_t c = 0; c < Channels; c++)
+                {
+                    uint32_t Sum = pTop[Left * Channels + c] + pTop[Right * Channels + c] + pBottom[Left * Channels + c] + pBottom[Right * Channels + c];
+                    pDestination[static_cast<size_t>(y) * DestinationPitch + x * Channels + c] = static_cast<uint8_t>((Sum + 2) >> 2);
+                }
+            }
+        }
+    }
+
+    void ReferencePyramid(const Image& Source, PixelFormat Format, Image Levels[PyramidLevels])
+    {
+        const Image* pAbove = &Source;
+        for (uint32_t Level = 0; Level < PyramidLevels; Level++)
+        {
+            Image& Target = Levels[Level];
+            ReferenceHalve(pAbove->Data.data(), pAbove->Pitch, pAbove->Width, pAbove->Height, Channels(Format), Target.Data.data(), Target.Pitch);
+            if (Format == PixelFormat::Nv12)
+            {
+                ReferenceHalve(pAbove->Data.data() + static_cast<size_t>(pAbove->Pitch) * pAbove->Height, pAbove->Pitch, (pAbove->Width + 1) / 2,
+                    (pAbove->Height + 1) / 2, 2, Target.Data.data() + static_cast<size_t>(Target.Pitch) * Target.Height, Target.Pitch);
+            }
+            pAbove = &Target;
+        }
+    }
+
+    void MakeLevels(uint32_t Width, uint32_t Height, PixelFormat Format, Image Levels[PyramidLevels], uint8_t* pData[PyramidLevels],
+        uint32_t Pitches[PyramidLevels])
+    {
+        for (uint32_t Level = 0; Level < PyramidLevels; Level++)
+        {
+            Levels[Level] = MakeImage(PyramidExtent(Width, Level + 1), PyramidExtent(Height, Level + 1), Format);
+            pData[Level] = Levels[Level].Data.data();
+            Pitches[Level] = Levels[Level].Pitch;
+        }
+    }
+
+    // Returns the number of pyramid cases that differ from halving three times, or from box scaling by half
+    uint32_t CheckPyramid(uint32_t& Cases)
+    {
+        const struct { uint32_t Width; uint32_t Height; } Sizes[] =
+        {
+            { 1, 1 }, { 7, 5 }, { 97, 33 }, { 1917, 13 }, { 1920, 16 }, { 1920, 1080 },
+        };
+
+        uint32_t Mismatches = 0;
+        Cases = 0;
+
+        for (const auto& Size : Sizes)
+        {
+            for (PixelFormat Format : Formats)
+            {
+                Image Source = MakeImage(Size.Width, Size.Height, Format);
+                FillPattern(Source, Format, Size.Width + Size.Height);
+
+                Image Reference[PyramidLevels];
+                uint8_t* pReference[PyramidLevels];
+                uint32_t ReferencePitches[PyramidLevels];
+                MakeLevels(Size.Width, Size.Height, Format, Reference, pReference, ReferencePitches);
+                ReferencePyramid(Source, Format, Reference);
+
+                for (int Level = 0; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+                {
+                    Image Levels[PyramidLevels];
+                    uint8_t* pLevels[PyramidLevels];
+                    uint32_t Pitches[PyramidLevels];
+                    MakeLevels(Size.Width, Size.Height, Format, Levels, pLevels, Pitches);
+                    ScalePyramid(Source.Data.data(), Source.Pitch, Size.Width, Size.Height, Format, pLevels, Pitches, static_cast<SimdLevel>(Level));
+                    Cases++;
+
+                    bool Same = true;
+                    for (uint32_t i = 0; i < PyramidLevels; i++)
+                    {
+                        Same = Same && Levels[i].Data == Reference[i].Data;
+                    }
+                    if (!Same)
+                    {
+                        Mismatches++;
+                        printf("MISMATCH pyramid %s %s %ux%u\n", SimdLevelName(static_cast<SimdLevel>(Level)),
+                            Format == PixelFormat::Bgra8 ? "bgra" : "nv12", Size.Width, Size.Height);
+                    }
+                }
+
+                // With nothing to replicate, a box filter halving the image averages the same 2x2 blocks
+                if (Size.Width % 4 == 0 && Size.Height % 4 == 0)
+                {
+                    Image Half = MakeImage(Size.Width / 2, Size.Height / 2, Format);
+                    Scale(Source, Half, Format, ScaleFilter::Box, DetectSimdLevel());
+                    Cases++;
+                    if (!SamePixels(Half, Reference[0], Format))
+                    {
+                        Mismatches++;
+                        printf("MISMATCH pyramid against box %s %ux%u\n", Format == PixelFormat::Bgra8 ? "bgra" : "nv12", Size.Width, Size.Height);
+                    }
+                }
+            }
+        }
+
+        return Mismatches;
+    }
+
+    /// <summary>
+    /// Drops every third frame.
+    /// </summary>
+    class DropStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "drop"; }
+
+        bool Process(Frame&) override { return ++m_Frames % 3 != 0; }
+
+    private:
+        uint64_t m_Frames = 0;
+    };
+
+    /// <summary>
+    /// Keeps a copy of the BGRA screen that is only ever updated through the dirty rectangles of the frames it is
+    /// handed, and compares it with every frame.
+    /// </summary>
+    class MirrorSink : public IFrameSink
+    {
+    public:
+        void Consume(const Frame& Frame) override
+        {
+            Delivered++;
+
+            if (Frame.Width != m_Width || Frame.Height != m_Height || Frame.Damage != DamageState::Partial)
+            {
+                m_Width = Frame.Width;
+                m_Height = Frame.Height;
+                m_Pixels.assign(static_cast<size_t>(m_Width) * m_Height * 4, 0);
+                Copy(Frame, { 0, 0, static_cast<int32_t>(m_Width), static_cast<int32_t>(m_Height) });
+            }
+            else
+            {
+                for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+                {
+                    const Rect& Dirty = Frame.pDirtyRects[i];
+                    Copy(Frame, { max(Dirty.Left, 0), max(Dirty.Top, 0), min(Dirty.Right, static_cast<int32_t>(m_Width)),
+                        min(Dirty.Bottom, static_cast<int32_t>(m_Height)) });
+                }
+            }
+
+            for (uint32_t y = 0; y < m_Height; y++)
+            {
+                if (memcmp(&m_Pixels[static_cast<size_t>(y) * m_Width * 4], Frame.pData + static_cast<size_t>(y) * Frame.Pitch,
+                    static_cast<size_t>(m_Width) * 4) != 0)
+                {
+                    Mismatches++;
+                    break;
+                }
+            }
+        }
+
+        uint64_t Delivered = 0;
+        uint64_t Mismatches = 0;
+
+    private:
+        void Copy(const Frame& Frame, const Rect& Area)
+        {
+            for (int32_t y = Area.Top; y < Area.Bottom && !Area.Empty(); y++)
+            {
+                memcpy(&m_Pixels[(static_cast<size_t>(y) * m_Width + Area.Left) * 4], Frame.pData + static_cast<size_t>(y) * Frame.Pitch + Area.Left * 4,
+                    static_cast<size_t>(Area.Right - Area.Left) * 4);
+            }
+        }
+
+        uint32_t m_Width = 0;
+        uint32_t m_Height = 0;
+        vector<uint8_t> m_Pixels;
+    };
+
+    // Halves a simulated swap-chain with each filter in a pipeline that drops every third frame after the stage
+    uint32_t CheckDroppedFrames()
+    {
+        const uint32_t Frames = 60;
+        uint32_t Failures = 0;
+        for (ScaleFilter Filter : Filters)
+        {
+            SimulatedSwapChain SwapChain(320, 192, 0, Frames);
+            FramePipeline Pipeline(SwapChain);
+            Pipeline.AddStage(make_shared<ScaleStage>(160, 96, Filter));
+            Pipeline.AddStage(make_shared<DropStage>());
+            auto Mirror = make_shared<MirrorSink>();
+            Pipeline.SetSink(Mirror);
+            Pipeline.RunCore();
+
+            printf("dropped frames, %-8s: %llu of %llu frames redrawn from their damage alone match the scaled screen\n",
+                ScaleFilterName(Filter), static_cast<unsigned long long>(Mirror->Delivered - Mirror->Mismatches),
+                static_cast<unsigned long long>(Mirror->Delivered));
+            if (Mirror->Delivered != Frames - Frames / 3 || Mirror->Mismatches != 0)
+            {
+                printf("  FAILED: the damage of dropped frames was not carried over in the source's coordinates\n");
+                Failures++;
+            }
+        }
+        return Failures;
+    }
+
+    uint64_t SourceBytes(uint32_t Width, uint32_t Height, PixelFormat Format)
+    {
+        return Format == PixelFormat::Bgra8 ? static_cast<uint64_t>(Width) * Height * 4 : static_cast<uint64_t>(Width) * Height * 3 / 2;
+    }
+
+    void PrintThroughput(const char* Format, const char* What, const char* To, SimdLevel Level, double Seconds, uint64_t Bytes)
+    {
+        printf("%-5s %-9s %-10s %-8s %10.3f %10.2f %7.1f%%\n", Format, What, To, SimdLevelName(Level), Seconds * 1e3, Bytes / Seconds / 1e9,
+            Seconds * 60.0 * 100.0);
+    }
+}
+
+int BenchScale(int argc, char* argv[])
+{
+    uint64_t FrameCount = max<uint64_t>(1, Bench::ParseOption(argc, argv, "frames", 10));
+    int Failures = 0;
+
+    uint32_t Cases = 0;
+    uint32_t Mismatches = CheckExactness(Cases);
+    printf("exactness: %u of %u cases match the scalar reference (best tier %s)\n", Cases - Mismatches, Cases,
+        SimdLevelName(DetectSimdLevel()));
+    Failures += Mismatches;
+
+    Mismatches = CheckPyramid(Cases);
+    printf("pyramid: %u of %u cases match halving three times and box scaling by half\n\n", Cases - Mismatches, Cases);
+    Failures += Mismatches;
+
+    Failures += CheckQuality();
+    Failures += CheckDroppedFrames();
+
+    // AVX-512 runs the AVX2 kernels
+    const Bench::Resolution& Mode = Bench::StandardResolutions[2];
+    SimdLevel Best = min(DetectSimdLevel(), SimdLevel::Avx2);
+    const struct { uint32_t Width; uint32_t Height; } Outputs[] =
+    {
+        { 2560, 1440 }, { 1920, 1080 }, { 1280, 720 }, { 640, 360 },
+    };
+
+    printf("\n%s source\n", Mode.Name);
+    printf("%-5s %-9s %-10s %-8s %10s %10s %8s\n", "fmt", "filter", "to", "tier", "ms/frame", "GB/s", "budget");
+    for (PixelFormat Format : Formats)
+    {
+        const char* Name = Format == PixelFormat::Bgra8 ? "bgra" : "nv12";
+        Image Source = MakeImage(Mode.Width, Mode.Height, Format);
+        FillPattern(Source, Format, Mode.Width);
+        uint64_t Bytes = SourceBytes(Mode.Width, Mode.Height, Format);
+
+        for (ScaleFilter Filter : Filters)
+        {
+            for (const auto& Output : Outputs)
+            {
+                char To[16];
+                snprintf(To, sizeof(To), "%ux%u", Output.Width, Output.Height);
+                Image Scaled = MakeImage(Output.Width, Output.Height, Format);
+
+                for (int Level = 0; Level <= static_cast<int>(Best); Level++)
+                {
+                    FrameScaler Scaler(static_cast<SimdLevel>(Level));
+                    uint64_t Frames = Level == 0 ? max<uint64_t>(1, FrameCount / 4) : FrameCount;
+                    double Start = 0;
+                    for (uint64_t i = 0; i <= Frames; i++)
+                    {
+                        // The first run builds the tables
+                        Start = i == 1 ? Bench::WallSeconds() : Start;
+                        Scaler.Scale(Source.Data.data(), Source.Pitch, Mode.Width, Mode.Height, Scaled.Data.data(), Scaled.Pitch,
+                            Output.Width, Output.Height, Format, Filter);
+                    }
+                    PrintThroughput(Name, ScaleFilterName(Filter), To, static_cast<SimdLevel>(Level), (Bench::WallSeconds() - Start) / Frames, Bytes);
+                }
+            }
+        }
+
+        // 1/2, 1/4 and 1/8: one pass, against three box scalings of the source
+        Image Levels[PyramidLevels];
+        uint8_t* pLevels[PyramidLevels];
+        uint32_t Pitches[PyramidLevels];
+        MakeLevels(Mode.Width, Mode.Height, Format, Levels, pLevels, Pitches);
+        for (int Level = 0; Level <= static_cast<int>(Best); Level++)
+        {
+            double Start = Bench::WallSeconds();
+            for (uint64_t i = 0; i < FrameCount; i++)
+            {
+                ScalePyramid(Source.Data.data(), Source.Pitch, Mode.Width, Mode.Height, Format, pLevels, Pitches, static_cast<SimdLevel>(Level));
+            }
+            PrintThroughput(Name, "pyramid", "1/2..1/8", static_cast<SimdLevel>(Level), (Bench::WallSeconds() - Start) / FrameCount, Bytes);
+        }
+
+        FrameScaler Scalers[PyramidLevels] = { FrameScaler(Best), FrameScaler(Best), FrameScaler(Best) };
+        double Start = 0;
+        for (uint64_t i = 0; i <= FrameCount; i++)
+        {
+            Start = i == 1 ? Bench::WallSeconds() : Start;
+            for (uint32_t Level = 0; Level < PyramidLevels; Level++)
+            {
+                Scalers[Level].Scale(Source.Data.data(), Source.Pitch, Mode.Width, Mode.Height, pLevels[Level], Pitches[Level], Levels[Level].Width,
+                    Levels[Level].Height, Format, ScaleFilter::Box);
+            }
+        }
+        PrintThroughput(Name, "box x3", "1/2..1/8", Best, (Bench::WallSeconds() - Start) / FrameCount, Bytes);
+    }
+
+    printf("\nframe scaler: %s\n", Failures == 0 ? "exact" : "FAILED");
+    return Failures == 0 ? 0 : 1;
+}
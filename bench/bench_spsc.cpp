@@ -0,0 +1,219 @@
+/*++
+
+Module Name:
+
+    bench_spsc.cpp
+
+Abstract:
+
+    Measures the SPSC frame queue on its own (operations per second and hand-off latency) and then the effect of
+    asynchronous hand-off on how long the acquire thread holds each swap-chain buffer when a stage is slow.
+
+    Options: --ops N (default 10000000), --frames N (default 120), --stagems N (default 25)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/simulated_swapchain.h"
+#include "../pipeline/spsc_queue.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    /// <summary>
+    /// Wraps a source and records how long each acquired buffer is held before it is handed back.
+    /// </summary>
+    class HoldTimeSource : public ISwapChainSource
+    {
+    public:
+        HoldTimeSource(ISwapChainSource& Inner) : m_Inner(Inner), m_AcquireTime(0) {}
+
+        bool Initialize() override { return m_Inner.Initialize(); }
+
+        AcquireStatus ReleaseAndAcquire(Frame& Frame) override
+        {
+            AcquireStatus Status = m_Inner.ReleaseAndAcquire(Frame);
+            if (Status == AcquireStatus::Acquired)
+            {
+                m_AcquireTime = MonotonicNanoseconds();
+            }
+            return Status;
+        }
+
+        WaitStatus WaitForFrame(uint32_t TimeoutMs) override { return m_Inner.WaitForFrame(TimeoutMs); }
+
+        bool FinishedProcessing() override
+        {
+            m_HoldUs.push_back((MonotonicNanoseconds() - m_AcquireTime) / 1000.0);
+            return m_Inner.FinishedProcessing();
+        }
+
+        vector<double> m_HoldUs;
+
+    private:
+        ISwapChainSource& m_Inner;
+        uint64_t m_AcquireTime;
+    };
+
+    /// <summary>
+    /// Simulates an encoder that needs more than a frame period.
+    /// </summary>
+    class SlowStage : public IFrameStage
+    {
+    public:
+        SlowStage(uint64_t Milliseconds) : m_Milliseconds(Milliseconds) {}
+
+        const char* Name() const override { return "slow"; }
+
+        bool Process(Frame& Frame) override
+        {
+            (void)Frame;
+            this_thread::sleep_for(chrono::milliseconds(m_Milliseconds));
+            m_Processed++;
+            return true;
+        }
+
+        uint64_t m_Processed = 0;
+
+    private:
+        uint64_t m_Milliseconds;
+    };
+
+    int BenchThroughput(uint64_t Operations)
+    {
+        SpscQueue<uint64_t> Queue(1024);
+        bool Ordered = true;
+
+        double Start = Bench::WallSeconds();
+
+        thread Consumer([&]
+        {
+            uint64_t Expected = 0;
+            uint64_t Value;
+            while (Expected < Operations)
+            {
+                if (!Queue.TryPop(Value))
+                {
+                    this_thread::yield();
+                    continue;
+                }
+
+                Ordered = Ordered && (Value == Expected);
+                Expected++;
+            }
+        });
+
+        for (uint64_t Value = 0; Value < Operations; Value++)
+        {
+            while (!Queue.TryPush(Value))
+            {
+                this_thread::yield();
+            }
+        }
+
+        Consumer.join();
+        double Elapsed = Bench::WallSeconds() - Start;
+
+        printf("throughput: %.1f Mops/s (%llu items)%s\n", Operations / Elapsed / 1e6,
+            static_cast<unsigned long long>(Operations), Ordered ? "" : " OUT OF ORDER");
+        return Ordered ? 0 : 1;
+    }
+
+    void BenchLatency()
+    {
+        const uint32_t Messages = 20000;
+        SpscQueue<uint64_t> Queue(64);
+        vector<double> LatencyNs;
+        LatencyNs.reserve(Messages);
+
+        thread Consumer([&]
+        {
+            uint64_t Sent;
+            while (LatencyNs.size() < Messages)
+            {
+                if (Queue.TryPop(Sent))
+                {
+                    LatencyNs.push_back(static_cast<double>(MonotonicNanoseconds() - Sent));
+                }
+                else
+                {
+                    this_thread::yield();
+                }
+            }
+        });
+
+        for (uint32_t i = 0; i < Messages; i++)
+        {
+            while (!Queue.TryPush(MonotonicNanoseconds()))
+            {
+                this_thread::yield();
+            }
+
+            // Space the messages out so each one measures a hand-off to an idle consumer
+            uint64_t Until = MonotonicNanoseconds() + 2000;
+            while (MonotonicNanoseconds() < Until)
+            {
+            }
+        }
+
+        Consumer.join();
+
+        printf("hand-off latency: p50 %.0f ns, p99 %.0f ns, p99.9 %.0f ns\n",
+            Bench::Percentile(LatencyNs, 50), Bench::Percentile(LatencyNs, 99), Bench::Percentile(LatencyNs, 99.9));
+    }
+
+    void BenchHoldTime(uint64_t FrameCount, uint64_t StageMs)
+    {
+        printf("\nswap-chain buffer hold time with a %llu ms stage at 60 Hz:\n", static_cast<unsigned long long>(StageMs));
+        printf("%-6s %-6s %10s %10s %10s %10s\n", "mode", "queue", "p50 [us]", "p99 [us]", "processed", "overrun");
+
+        for (const auto& Mode : Bench::StandardResolutions)
+        {
+            for (uint32_t QueueDepth : { 0u, 3u })
+            {
+                SimulatedSwapChain SwapChain(Mode.Width, Mode.Height, 60.0, FrameCount);
+                HoldTimeSource Source(SwapChain);
+                FramePipeline Pipeline(Source);
+
+                auto Stage = make_shared<SlowStage>(StageMs);
+                Pipeline.AddStage(Stage);
+                Pipeline.SetAsyncProcessing(QueueDepth);
+                Pipeline.RunCore();
+
+                printf("%-6s %-6s %10.1f %10.1f %10llu %10llu\n",
+                    Mode.Name,
+                    QueueDepth ? "async" : "inline",
+                    Bench::Percentile(Source.m_HoldUs, 50),
+                    Bench::Percentile(Source.m_HoldUs, 99),
+                    static_cast<unsigned long long>(Stage->m_Processed),
+                    static_cast<unsigned long long>(Pipeline.Statistics().FramesOverrun));
+            }
+        }
+    }
+}
+
+int BenchSpsc(int argc, char* argv[])
+{
+    uint64_t Operations = Bench::ParseOption(argc, argv, "ops", 10000000);
+    uint64_t FrameCount = Bench::ParseOption(argc, argv, "frames", 120);
+    uint64_t StageMs = Bench::ParseOption(argc, argv, "stagems", 25);
+
+    int Result = BenchThroughput(Operations);
+    BenchLatency();
+    BenchHoldTime(FrameCount, StageMs);
+    return Result;
+}
@@ -0,0 +1,329 @@
+/*++
+
+Module Name:
+
+    bench_stats.cpp
+
+Abstract:
+
+    Checks and measures the live statistics page. First has a writer publish as fast as it can into a named
+    shared-memory region while readers poll their own read-only mapping of it; every field of a publish is derived
+    from its count, so any torn copy a reader accepted would show. Also checks that pages which are not there, not
+    initialized or too small are refused, and that a writer which finds the page of its previous instance still
+    mapped by a reader takes it over, while the reader notices and opens it again. Then reports the cost of a
+    publish and of an uncontended read. Last, runs a paced simulated swap-chain with a publisher attached and checks
+    the mode, counters, frame rate and latencies a tool polling the page sees.
+
+    Options: --publishes N (default 200000), --readers N (default 2), --frames N (default 600, at 300 fps)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/simulated_swapchain.h"
+#include "../pipeline/stats_page.h"
+#include "../pipeline/stats_publisher.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // Local rather than Global, which needs the privilege to create global objects
+    const char* const PageName = "Local\\WinVirtualDisplayStatsBench";
+
+    const uint32_t MonitorWidth = 640;
+    const uint32_t MonitorHeight = 360;
+    const double FramesPerSecond = 300;
+
+    const size_t DataWords = sizeof(StatsPageData) / sizeof(uint64_t);
+
+    // Every word of publish Count, PublishCount included, follows from Count
+    void Fill(StatsPageData& Data, uint64_t Count)
+    {
+        uint64_t Words[DataWords];
+        for (size_t i = 0; i < DataWords; i++)
+        {
+            Words[i] = Count * 0x9E3779B97F4A7C15ull + i;
+        }
+        memcpy(&Data, Words, sizeof(Data));
+        Data.PublishCount = Count;
+    }
+
+    bool IsWhole(const StatsPageData& Data)
+    {
+        StatsPageData Expected;
+        Fill(Expected, Data.PublishCount);
+        return memcmp(&Expected, &Data, sizeof(Data)) == 0;
+    }
+
+    int CheckConsistency(uint64_t Publishes, uint32_t Readers)
+    {
+        StatsPageWriter Writer;
+        if (!Writer.Create(PageName))
+        {
+            printf("  FAILED: cannot create %s\n", PageName);
+            return 1;
+        }
+
+        StatsPageData Data;
+        Fill(Data, 0);
+        Writer.Publish(Data);
+
+        atomic<bool> Done(false);
+        atomic<uint64_t> Reads(0), Retries(0), Torn(0), Backwards(0), Failed(0);
+
+        vector<thread> Threads;
+        for (uint32_t r = 0; r < Readers; r++)
+        {
+            Threads.emplace_back([&] {
+                StatsPageReader Reader;
+                if (!Reader.Open(PageName))
+                {
+                    Failed.fetch_add(1);
+                    return;
+                }
+
+                uint64_t Last = 0;
+                uint64_t Count = 0;
+                while (!Done.load(memory_order_acquire))
+                {
+                    StatsPageData Copy;
+                    if (!Reader.Read(Copy))
+                    {
+                        continue;
+                    }
+                    Count++;
+                    Torn.fetch_add(IsWhole(Copy) ? 0 : 1, memory_order_relaxed);
+                    Backwards.fetch_add(Copy.PublishCount < Last ? 1 : 0, memory_order_relaxed);
+                    Last = Copy.PublishCount;
+                }
+
+                Reads.fetch_add(Count);
+                Retries.fetch_add(Reader.Retries());
+            });
+        }
+
+        for (uint64_t i = 1; i <= Publishes; i++)
+        {
+            Fill(Data, i);
+            Writer.Publish(Data);
+        }
+        Done.store(true, memory_order_release);
+        for (thread& Reader : Threads)
+        {
+            Reader.join();
+        }
+
+        // Once the writer is gone, the page is too; and something that is no page is refused
+        Writer.Close();
+        StatsPageReader Reader;
+        bool RefusesGone = !Reader.Open(PageName);
+
+        vector<uint64_t> Blank(StatsPageSize() / sizeof(uint64_t), 0);
+        bool RefusesBlank = !Reader.Attach(Blank.data(), Blank.size() * sizeof(uint64_t));
+
+        StatsPageWriter Local;
+        Local.Attach(Blank.data());
+        bool RefusesSmall = !Reader.Attach(Blank.data(), Blank.size() * sizeof(uint64_t) - sizeof(uint64_t));
+        bool AcceptsLocal = Reader.Attach(Blank.data(), Blank.size() * sizeof(uint64_t)) && Reader.Read(Data) && Data.PublishCount == 0;
+
+        uint64_t TotalReads = Reads.load();
+        printf("%llu publishes, %u readers: %llu reads, %.3f%% retried, %llu torn, %llu out of order\n",
+            static_cast<unsigned long long>(Publishes), Readers, static_cast<unsigned long long>(TotalReads),
+            TotalReads ? 100.0 * Retries.load() / (TotalReads + Retries.load()) : 0.0,
+            static_cast<unsigned long long>(Torn.load()), static_cast<unsigned long long>(Backwards.load()));
+
+        if (Failed.load() != 0 || Torn.load() != 0 || Backwards.load() != 0 || !RefusesGone || !RefusesBlank || !RefusesSmall || !AcceptsLocal)
+        {
+            printf("  FAILED: consistency (open failures %llu, refuses gone %d, blank %d, small %d, accepts local %d)\n",
+                static_cast<unsigned long long>(Failed.load()), RefusesGone, RefusesBlank, RefusesSmall, AcceptsLocal);
+            return 1;
+        }
+        return 0;
+    }
+
+    // A second writer stands in for the restarted driver: the region of the first is still there, like one a
+    // reader keeps alive after the driver that created it went away
+    int CheckRestart()
+    {
+        StatsPageWriter Previous;
+        StatsPageData Data;
+        Fill(Data, 5);
+        if (!Previous.Create(PageName))
+        {
+            printf("  FAILED: cannot create %s\n", PageName);
+            return 1;
+        }
+        Previous.Publish(Data);
+
+        StatsPageReader Reader;
+        bool Opened = Reader.Open(PageName) && !Reader.WriterChanged();
+
+        StatsPageWriter Restarted;
+        bool TakenOver = Restarted.Create(PageName) && Reader.WriterChanged() && Reader.Read(Data) && Data.PublishCount == 0;
+
+        Fill(Data, 7);
+        Restarted.Publish(Data);
+        bool Reopened = Reader.Open(PageName) && !Reader.WriterChanged() && Reader.Read(Data) && IsWhole(Data) && Data.PublishCount == 7;
+
+        Restarted.Close();
+        bool SeesGone = Reader.WriterChanged();
+        Reader.Close();
+        bool RefusesGone = !Reader.Open(PageName);
+        Previous.Close();
+
+        printf("restart: the new writer %s the page, readers %s\n", TakenOver ? "takes over" : "cannot take over",
+            Reopened && SeesGone ? "notice and open it again" : "do not notice");
+        if (!Opened || !TakenOver || !Reopened || !SeesGone || !RefusesGone)
+        {
+            printf("  FAILED: restart (opened %d, taken over %d, reopened %d, sees gone %d, refuses gone %d)\n", Opened, TakenOver,
+                Reopened, SeesGone, RefusesGone);
+            return 1;
+        }
+        return 0;
+    }
+
+    void MeasureCost(uint64_t Publishes)
+    {
+        vector<uint64_t> Page(StatsPageSize() / sizeof(uint64_t));
+        StatsPageWriter Writer;
+        Writer.Attach(Page.data());
+
+        StatsPageData Data;
+        Fill(Data, 1);
+        double Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < Publishes; i++)
+        {
+            Data.PublishCount = i;
+            Writer.Publish(Data);
+        }
+        double PublishNs = (Bench::WallSeconds() - Start) * 1e9 / Publishes;
+
+        StatsPageReader Reader;
+        Reader.Attach(Page.data(), Page.size() * sizeof(uint64_t));
+        Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < Publishes; i++)
+        {
+            Reader.Read(Data);
+        }
+        double ReadNs = (Bench::WallSeconds() - Start) * 1e9 / Publishes;
+
+        printf("page of %zu bytes: %.1f ns per publish, %.1f ns per uncontended read\n", StatsPageSize(), PublishNs, ReadNs);
+    }
+
+    class NullSink : public IFrameSink
+    {
+    public:
+        void Consume(const Frame&) override
+        {
+        }
+    };
+
+    int CheckPublisher(uint64_t Frames)
+    {
+        auto Metrics = make_shared<MetricsRegistry>();
+        StatsPublisher Publisher(Metrics);
+        Publisher.SetMonitorMetrics(0, Metrics);
+        Publisher.SetMonitorMode(0, MonitorWidth, MonitorHeight, 300000, 1000);
+        if (!Publisher.Start(PageName, 50))
+        {
+            printf("  FAILED: cannot start the publisher on %s\n", PageName);
+            return 1;
+        }
+
+        SimulatedSwapChain SwapChain(MonitorWidth, MonitorHeight, FramesPerSecond, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.SetSink(make_shared<NullSink>());
+        Pipeline.SetAsyncProcessing(3);
+        Pipeline.SetMetrics(Metrics);
+
+        // A tool polling the page while the swap-chain runs
+        atomic<bool> Done(false);
+        vector<double> Rates;
+        StatsPageData Running = {};
+        bool Opened = false;
+        thread Tool([&] {
+            StatsPageReader Reader;
+            Opened = Reader.Open(PageName);
+            while (Opened && !Done.load(memory_order_acquire))
+            {
+                StatsPageData Data;
+                if (Reader.Read(Data) && Data.Monitors[0].SwapChainActive && Data.Monitors[0].FramesAcquired > 0)
+                {
+                    if (Data.Monitors[0].AcquiredPerSecond > 0 && Data.PublishCount != Running.PublishCount)
+                    {
+                        Rates.push_back(Data.Monitors[0].AcquiredPerSecond);
+                    }
+                    Running = Data;
+                }
+                this_thread::sleep_for(chrono::milliseconds(20));
+            }
+        });
+
+        Publisher.AttachTimings(0, &Pipeline.Timings());
+        Pipeline.RunCore();
+        Publisher.AttachTimings(0, nullptr);
+        Done.store(true, memory_order_release);
+        Tool.join();
+
+        Publisher.PublishNow();
+        StatsPageReader Reader;
+        StatsPageData Final = {};
+        bool ReadFinal = Reader.Open(PageName) && Reader.Read(Final);
+        Publisher.Stop();
+
+        const MonitorStats& Monitor = Final.Monitors[0];
+        const MonitorStats& Live = Running.Monitors[0];
+        PipelineStatistics Statistics = Pipeline.Statistics();
+        double Rate = Rates.empty() ? 0 : Bench::Percentile(Rates, 50);
+
+        printf("\n%llu frames at %.0f fps with the page published every 50 ms: %.1f fps seen, latency p50 %.3f ms, p99 %.3f ms, "
+            "max %.3f ms\n", static_cast<unsigned long long>(Frames), FramesPerSecond, Rate, Live.LatencyP50 / 1e6,
+            Live.LatencyP99 / 1e6, Live.LatencyMax / 1e6);
+
+        bool Mode = Monitor.Active == 1 && Monitor.Width == MonitorWidth && Monitor.Height == MonitorHeight &&
+            Monitor.RefreshNumerator == 300000 && Monitor.RefreshDenominator == 1000 && Final.MonitorCount == 1;
+        bool Counters = Monitor.FramesAcquired == Statistics.FramesAcquired &&
+            static_cast<int64_t>(Monitor.FramesDelivered) == Metrics->Read(MetricId::FramesDelivered) &&
+            Final.MetricCount == MetricCount && Final.Metrics[static_cast<uint32_t>(MetricId::FramesAcquired)] == static_cast<int64_t>(Statistics.FramesAcquired);
+        bool Detached = Monitor.SwapChainActive == 0 && Monitor.LatencyMax == 0;
+        bool Latencies = Live.LatencyP50 > 0 && Live.LatencyP50 <= Live.LatencyP99 && Live.LatencyP99 <= Live.LatencyMax;
+        bool Paced = Rate > FramesPerSecond * 0.5 && Rate < FramesPerSecond * 1.5;
+
+        if (!Opened || !ReadFinal || !Mode || !Counters || !Detached || !Latencies || !Paced)
+        {
+            printf("  FAILED: publisher (opened %d, read %d, mode %d, counters %d, detached %d, latencies %d, rate %d)\n",
+                Opened, ReadFinal, Mode, Counters, Detached, Latencies, Paced);
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int BenchStats(int argc, char* argv[])
+{
+    uint64_t Publishes = max<uint64_t>(1, Bench::ParseOption(argc, argv, "publishes", 200000));
+    uint32_t Readers = static_cast<uint32_t>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "readers", 2)));
+    uint64_t Frames = max<uint64_t>(60, Bench::ParseOption(argc, argv, "frames", 600));
+
+    int Failures = CheckConsistency(Publishes, Readers);
+    Failures |= CheckRestart();
+    MeasureCost(Publishes);
+    Failures |= CheckPublisher(Frames);
+    printf("\nstatistics page: %s\n", Failures == 0 ? "consistent" : "FAILED");
+    return Failures;
+}
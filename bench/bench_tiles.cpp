@@ -0,0 +1,314 @@
+/*++
+
+Module Name:
+
+    bench_tiles.cpp
+
+Abstract:
+
+    Measures the tile-hash change detector on a 4K frame per SIMD tier and tile size, against a memcmp of every
+    tile with a copy of the previous frame. Then replays synthetic "typing", "scrolling" and "video" content through
+    the detector and checks every frame against that exact memcmp ground truth. It also checks that the coalesced
+    rectangles cover exactly the changed tiles and never overlap.
+
+    Options: --frames N (default 60), --width N (default 3840), --height N (default 2160)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../pipeline/change_detector.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    /// <summary>
+    /// A BGRA canvas with a static desktop and a few ways to animate part of it.
+    /// </summary>
+    class Scene
+    {
+    public:
+        Scene(uint32_t Width, uint32_t Height)
+            : m_Width(Width)
+            , m_Height(Height)
+            , m_Pixels(static_cast<size_t>(Width) * Height)
+            , m_Noise(0x9E3779B9)
+        {
+            for (uint32_t y = 0; y < Height; y++)
+            {
+                for (uint32_t x = 0; x < Width; x++)
+                {
+                    m_Pixels[static_cast<size_t>(y) * Width + x] = Desktop(x, y);
+                }
+            }
+        }
+
+        const uint8_t* Data() const { return reinterpret_cast<const uint8_t*>(m_Pixels.data()); }
+        uint32_t Pitch() const { return m_Width * 4; }
+
+        // A glyph at the cursor position of character Index, then a cursor bar that blinks every other frame
+        void Type(uint64_t Index)
+        {
+            const uint32_t Columns = 100;
+            uint32_t Left = 160 + static_cast<uint32_t>(Index % Columns) * 9;
+            uint32_t Top = 240 + static_cast<uint32_t>(Index / Columns % 40) * 20;
+
+            uint32_t Glyph = Next();
+            Fill(Left, Top, 8, 16, [&](uint32_t x, uint32_t y) { return ((Glyph >> ((x * 3 + y) % 32)) & 1) ? 0xFF101010u : 0xFFF0F0F0u; });
+
+            bool CursorOn = (Index % 2) == 0;
+            Fill(Left + 9, Top, 2, 16, [&](uint32_t, uint32_t) { return CursorOn ? 0xFF000000u : 0xFFF0F0F0u; });
+        }
+
+        // Redraws a document window whose text moved up by Offset rows
+        void Scroll(uint64_t Offset)
+        {
+            Fill(200, 200, 1600, 1000, [&](uint32_t x, uint32_t y)
+            {
+                uint64_t Line = (y + Offset) / 18;
+                bool Ink = ((y + Offset) % 18) < 12 && (((x / 9) * 2654435761u + Line * 40503u) >> 7) % 5 != 0;
+                return Ink ? 0xFF202020u : 0xFFFFFFFFu;
+            });
+        }
+
+        // A 720p video area with new content everywhere
+        void PlayVideo()
+        {
+            Fill(400, 300, 1280, 720, [&](uint32_t, uint32_t) { return Next() | 0xFF000000u; });
+        }
+
+    private:
+        static uint32_t Desktop(uint32_t x, uint32_t y)
+        {
+            return 0xFF000000u | ((x / 8) & 0xFF) << 16 | ((y / 8) & 0xFF) << 8 | 0x60;
+        }
+
+        uint32_t Next()
+        {
+            m_Noise ^= m_Noise << 13;
+            m_Noise ^= m_Noise >> 17;
+            m_Noise ^= m_Noise << 5;
+            return m_Noise;
+        }
+
+        template<typename TColor>
+        void Fill(uint32_t Left, uint32_t Top, uint32_t Width, uint32_t Height, TColor Color)
+        {
+            uint32_t Right = min(m_Width, Left + Width);
+            uint32_t Bottom = min(m_Height, Top + Height);
+            for (uint32_t y = Top; y < Bottom; y++)
+            {
+                for (uint32_t x = Left; x < Right; x++)
+                {
+                    m_Pixels[static_cast<size_t>(y) * m_Width + x] = Color(x - Left, y - Top);
+                }
+            }
+        }
+
+        uint32_t m_Width;
+        uint32_t m_Height;
+        vector<uint32_t> m_Pixels;
+        uint32_t m_Noise;
+    };
+
+    // Marks the tiles whose bytes differ from Previous; the ground truth for the detector
+    uint32_t DiffTiles(const uint8_t* pCurrent, const uint8_t* pPrevious, uint32_t Width, uint32_t Height, uint32_t TileSize, vector<bool>& Changed)
+    {
+        uint32_t Columns = (Width + TileSize - 1) / TileSize;
+        uint32_t Rows = (Height + TileSize - 1) / TileSize;
+        uint32_t Count = 0;
+
+        Changed.assign(static_cast<size_t>(Columns) * Rows, false);
+
+        for (uint32_t Row = 0; Row < Rows; Row++)
+        {
+            for (uint32_t Column = 0; Column < Columns; Column++)
+            {
+                size_t Bytes = static_cast<size_t>(min(TileSize, Width - Column * TileSize)) * 4;
+                for (uint32_t y = Row * TileSize; y < min(Height, (Row + 1) * TileSize); y++)
+                {
+                    size_t Offset = static_cast<size_t>(y) * Width * 4 + static_cast<size_t>(Column) * TileSize * 4;
+                    if (memcmp(pCurrent + Offset, pPrevious + Offset, Bytes) != 0)
+                    {
+                        Changed[static_cast<size_t>(Row) * Columns + Column] = true;
+                        Count++;
+                        break;
+                    }
+                }
+            }
+        }
+
+        return Count;
+    }
+
+    // Returns true if the rectangles are disjoint and cover exactly the changed tiles
+    bool CheckRects(const TileChangeDetector& Detector, uint32_t Width, uint32_t Height)
+    {
+        uint32_t TileSize = Detector.TileSize();
+        vector<uint8_t> Coverage(static_cast<size_t>(Detector.TileColumns()) * Detector.TileRows(), 0);
+
+        for (const Rect& Area : Detector.ChangedRects())
+        {
+            if (Area.Empty() || Area.Right > static_cast<int32_t>(Width) || Area.Bottom > static_cast<int32_t>(Height))
+            {
+                return false;
+            }
+
+            for (uint32_t Row = Area.Top / TileSize; Row * TileSize < static_cast<uint32_t>(Area.Bottom); Row++)
+            {
+                for (uint32_t Column = Area.Left / TileSize; Column * TileSize < static_cast<uint32_t>(Area.Right); Column++)
+                {
+                    Coverage[static_cast<size_t>(Row) * Detector.TileColumns() + Column]++;
+                }
+            }
+        }
+
+        for (uint32_t Row = 0; Row < Detector.TileRows(); Row++)
+        {
+            for (uint32_t Column = 0; Column < Detector.TileColumns(); Column++)
+            {
+                uint8_t Expected = Detector.IsTileChanged(Column, Row) ? 1 : 0;
+                if (Coverage[static_cast<size_t>(Row) * Detector.TileColumns() + Column] != Expected)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    double TimeDetector(const vector<uint8_t>& Frame, uint32_t Width, uint32_t Height, uint32_t TileSize, SimdLevel Level, uint64_t FrameCount)
+    {
+        TileChangeDetector Detector(TileSize, Level);
+        Detector.Detect(Frame.data(), Width * 4, Width, Height);
+
+        double Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < FrameCount; i++)
+        {
+            Detector.Detect(Frame.data(), Width * 4, Width, Height);
+        }
+        return (Bench::WallSeconds() - Start) / FrameCount;
+    }
+}
+
+int BenchTiles(int argc, char* argv[])
+{
+    uint64_t FrameCount = Bench::ParseOption(argc, argv, "frames", 60);
+    uint32_t Width = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "width", 3840));
+    uint32_t Height = static_cast<uint32_t>(Bench::ParseOption(argc, argv, "height", 2160));
+    const uint32_t TileSizes[] = { 32, 64 };
+    int Failures = 0;
+
+    // Cost of a full pass over a static frame
+    Scene Static(Width, Height);
+    vector<uint8_t> Frame(Static.Data(), Static.Data() + static_cast<size_t>(Width) * Height * 4);
+    vector<uint8_t> Previous = Frame;
+
+    printf("%ux%u frame, %llu frames per measurement\n\n", Width, Height, static_cast<unsigned long long>(FrameCount));
+    printf("%-6s %-8s %10s %10s\n", "tile", "tier", "ms/frame", "GB/s");
+
+    for (uint32_t TileSize : TileSizes)
+    {
+        for (int Level = 0; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+        {
+            double Seconds = TimeDetector(Frame, Width, Height, TileSize, static_cast<SimdLevel>(Level), FrameCount);
+            printf("%-6u %-8s %10.3f %10.2f\n", TileSize, SimdLevelName(static_cast<SimdLevel>(Level)), Seconds * 1e3, Frame.size() / Seconds / 1e9);
+        }
+
+        vector<bool> Changed;
+        double Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < FrameCount; i++)
+        {
+            DiffTiles(Frame.data(), Previous.data(), Width, Height, TileSize, Changed);
+        }
+        double Seconds = (Bench::WallSeconds() - Start) / FrameCount;
+        printf("%-6u %-8s %10.3f %10.2f   (needs a copy of the previous frame)\n", TileSize, "memcmp", Seconds * 1e3, Frame.size() / Seconds / 1e9);
+    }
+
+    // Replay synthetic content and compare with the exact per-tile diff
+    printf("\n%-10s %-6s %12s %10s %10s %10s\n", "scenario", "tile", "changed [%]", "rects", "ms/frame", "misses");
+
+    const char* Scenarios[] = { "typing", "scrolling", "video" };
+    for (int ScenarioIndex = 0; ScenarioIndex < 3; ScenarioIndex++)
+    {
+        for (uint32_t TileSize : TileSizes)
+        {
+            Scene Content(Width, Height);
+            TileChangeDetector Detector(TileSize);
+            Detector.Detect(Content.Data(), Content.Pitch(), Width, Height);
+            Previous.assign(Content.Data(), Content.Data() + Previous.size());
+
+            uint64_t ChangedTiles = 0;
+            uint64_t Rects = 0;
+            uint64_t Misses = 0;
+            double DetectSeconds = 0;
+            vector<bool> Truth;
+
+            for (uint64_t i = 0; i < FrameCount; i++)
+            {
+                switch (ScenarioIndex)
+                {
+                case 0:
+                    Content.Type(i);
+                    break;
+                case 1:
+                    Content.Scroll((i + 1) * 3);
+                    break;
+                default:
+                    Content.PlayVideo();
+                    break;
+                }
+
+                double Start = Bench::WallSeconds();
+                Detector.Detect(Content.Data(), Content.Pitch(), Width, Height);
+                DetectSeconds += Bench::WallSeconds() - Start;
+
+                DiffTiles(Content.Data(), Previous.data(), Width, Height, TileSize, Truth);
+                for (uint32_t Row = 0; Row < Detector.TileRows(); Row++)
+                {
+                    for (uint32_t Column = 0; Column < Detector.TileColumns(); Column++)
+                    {
+                        if (Detector.IsTileChanged(Column, Row) != Truth[static_cast<size_t>(Row) * Detector.TileColumns() + Column])
+                        {
+                            Misses++;
+                        }
+                    }
+                }
+
+                if (!CheckRects(Detector, Width, Height))
+                {
+                    Misses++;
+                }
+
+                ChangedTiles += Detector.ChangedTileCount();
+                Rects += Detector.ChangedRects().size();
+                Previous.assign(Content.Data(), Content.Data() + Previous.size());
+            }
+
+            double Tiles = static_cast<double>(Detector.TileColumns()) * Detector.TileRows();
+            printf("%-10s %-6u %12.2f %10.1f %10.3f %10llu\n",
+                Scenarios[ScenarioIndex],
+                TileSize,
+                ChangedTiles * 100.0 / (Tiles * FrameCount),
+                static_cast<double>(Rects) / FrameCount,
+                DetectSeconds * 1e3 / FrameCount,
+                static_cast<unsigned long long>(Misses));
+
+            Failures += Misses != 0 ? 1 : 0;
+        }
+    }
+
+    return Failures == 0 ? 0 : 1;
+}
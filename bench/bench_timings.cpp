@@ -0,0 +1,381 @@
+/*++
+
+Module Name:
+
+    bench_timings.cpp
+
+Abstract:
+
+    Checks and measures the per-stage latency histograms. First checks that every value falls inside the bounds of
+    its bucket and that the percentiles of a million samples spread over six decades are within a bucket's width
+    (1/64) of the exact ones, then records from several threads at once and checks that nothing was lost. Reports
+    the cost of a single record. Last, runs the simulated swap-chain at 240 fps through a pipeline with a stage that
+    reads every pixel and a stage that drops every eighth frame, on the acquire thread and then asynchronously, and
+    prints p50/p99/p99.9 of every segment of the frame timeline. The histogram counts and the frames reported back
+    to the swap-chain must match the pipeline's statistics.
+
+    Options: --frames N (default 600, per run), --threads N (default 4, for the concurrency check)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/latency_histogram.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint32_t MonitorWidth = 1920;
+    const uint32_t MonitorHeight = 1080;
+    const uint64_t DropInterval = 8;
+    const double FramesPerSecond = 240;
+
+    uint64_t NextRandom(uint64_t& State)
+    {
+        State ^= State << 13;
+        State ^= State >> 7;
+        State ^= State << 17;
+        return State;
+    }
+
+    // Roughly log-uniform between 100 ns and 100 ms, the range frame latencies live in
+    uint64_t RandomLatency(uint64_t& State)
+    {
+        double Exponent = 2.0 + 6.0 * (NextRandom(State) >> 11) / 9007199254740992.0;
+        return static_cast<uint64_t>(pow(10.0, Exponent));
+    }
+
+    uint64_t CheckBuckets()
+    {
+        uint64_t Failures = 0;
+        uint64_t Random = 0x9E3779B97F4A7C15ull;
+
+        for (uint64_t i = 0; i < 2000000; i++)
+        {
+            uint64_t Value = (i < 1000000) ? i : NextRandom(Random) >> (NextRandom(Random) % 64);
+            uint32_t Index = LatencyHistogram::BucketIndex(Value);
+            uint64_t Upper = LatencyHistogram::BucketUpperBound(Index);
+            uint64_t Lower = Index == 0 ? 0 : LatencyHistogram::BucketUpperBound(Index - 1) + 1;
+
+            if (Index >= LatencyHistogram::BucketCount || Value > Upper || Value < Lower ||
+                (Value >= LatencyHistogram::LinearBuckets && (Upper - Lower) > Value / (LatencyHistogram::SubBuckets / 2)))
+            {
+                Failures++;
+            }
+        }
+
+        if (LatencyHistogram::BucketIndex(~0ull) != LatencyHistogram::BucketCount - 1)
+        {
+            Failures++;
+        }
+
+        return Failures;
+    }
+
+    uint64_t CheckPercentiles()
+    {
+        uint64_t Failures = 0;
+        uint64_t Random = 0x2545F4914F6CDD1Dull;
+
+        LatencyHistogram Histogram;
+        vector<uint64_t> Samples;
+        for (int i = 0; i < 1000000; i++)
+        {
+            Samples.push_back(RandomLatency(Random));
+            Histogram.Record(Samples.back());
+        }
+        sort(Samples.begin(), Samples.end());
+
+        printf("%-8s %14s %14s %10s\n", "pctl", "exact [ns]", "histogram", "error");
+
+        const double Percentiles[] = { 0, 50, 90, 99, 99.9, 99.99, 100 };
+        for (double P : Percentiles)
+        {
+            size_t Rank = static_cast<size_t>(ceil(P / 100.0 * Samples.size()));
+            uint64_t Exact = Samples[Rank == 0 ? 0 : Rank - 1];
+            uint64_t Estimate = Histogram.Percentile(P);
+            double Error = (static_cast<double>(Estimate) - Exact) / Exact;
+
+            printf("%-8g %14llu %14llu %9.2f%%\n",
+                P, static_cast<unsigned long long>(Exact), static_cast<unsigned long long>(Estimate), 100.0 * Error);
+
+            if (Estimate < Exact || Error > 1.0 / LatencyHistogram::SubBuckets)
+            {
+                Failures++;
+            }
+        }
+
+        if (Histogram.Count() != Samples.size() || Histogram.Max() != Samples.back())
+        {
+            Failures++;
+        }
+
+        return Failures;
+    }
+
+    uint64_t CheckConcurrency(uint32_t Threads)
+    {
+        const uint64_t PerThread = 1000000;
+        LatencyHistogram Histogram;
+        vector<uint64_t> Sums(Threads);
+        vector<thread> Recorders;
+
+        for (uint32_t t = 0; t < Threads; t++)
+        {
+            Recorders.emplace_back([&Histogram, &Sums, t]
+            {
+                uint64_t Random = 0x9E3779B97F4A7C15ull * (t + 1);
+                for (uint64_t i = 0; i < PerThread; i++)
+                {
+                    uint64_t Value = RandomLatency(Random);
+                    Sums[t] += Value;
+                    Histogram.Record(Value);
+                }
+            });
+        }
+        for (thread& Recorder : Recorders)
+        {
+            Recorder.join();
+        }
+
+        uint64_t Sum = 0;
+        for (uint64_t ThreadSum : Sums)
+        {
+            Sum += ThreadSum;
+        }
+
+        return (Histogram.Count() != PerThread * Threads || Histogram.Sum() != Sum) ? 1 : 0;
+    }
+
+    double RecordNanoseconds()
+    {
+        const uint64_t Records = 20000000;
+        LatencyHistogram Histogram;
+        uint64_t Random = 0x2545F4914F6CDD1Dull;
+
+        double Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < Records; i++)
+        {
+            Histogram.Record(NextRandom(Random) >> 40);
+        }
+        return (Bench::WallSeconds() - Start) * 1e9 / Records;
+    }
+
+    /// <summary>
+    /// Reads every pixel, as a converter or an encoder would.
+    /// </summary>
+    class ChecksumStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "checksum"; }
+
+        bool Process(Frame& Frame) override
+        {
+            uint64_t Sum = 0;
+            for (uint32_t y = 0; y < Frame.Height; y++)
+            {
+                const uint64_t* pRow = reinterpret_cast<const uint64_t*>(Frame.pData + static_cast<size_t>(y) * Frame.Pitch);
+                for (uint32_t x = 0; x < Frame.Width / 2; x++)
+                {
+                    Sum += pRow[x];
+                }
+            }
+            m_Checksum += Sum;
+            return true;
+        }
+
+        uint64_t m_Checksum = 0;
+    };
+
+    /// <summary>
+    /// Drops every DropInterval-th frame it sees.
+    /// </summary>
+    class ThinningStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "thin"; }
+
+        bool Process(Frame&) override
+        {
+            return m_Seen++ % DropInterval != DropInterval - 1;
+        }
+
+    private:
+        uint64_t m_Seen = 0;
+    };
+
+    class NullSink : public IFrameSink
+    {
+    public:
+        void Consume(const Frame&) override
+        {
+        }
+    };
+
+    /// <summary>
+    /// Counts the frame timelines the pipeline reports, as the driver forwards them to IddCx.
+    /// </summary>
+    class ReportingSwapChain : public SimulatedSwapChain
+    {
+    public:
+        explicit ReportingSwapChain(uint64_t Frames)
+            : SimulatedSwapChain(MonitorWidth, MonitorHeight, FramesPerSecond, Frames), m_Reported(0), m_ReportedDropped(0), m_Disordered(0)
+        {
+        }
+
+        void ReportFrame(const FrameTimeline& Timeline) override
+        {
+            m_Reported++;
+            if (Timeline.Dropped)
+            {
+                m_ReportedDropped++;
+            }
+
+            // Every stamp must follow the one before it
+            uint64_t Previous = Timeline.AcquireTime;
+            const uint64_t Stamps[] = { Timeline.HandOffTime, Timeline.ProcessStartTime, Timeline.AnalysisEndTime };
+            bool Ordered = true;
+            for (uint64_t Stamp : Stamps)
+            {
+                if (Stamp != 0)
+                {
+                    Ordered = Ordered && Stamp >= Previous;
+                    Previous = Stamp;
+                }
+            }
+            for (uint32_t i = 0; i < Timeline.StageCount; i++)
+            {
+                Ordered = Ordered && Timeline.pStageEndTimes[i] >= Previous;
+                Previous = Timeline.pStageEndTimes[i];
+            }
+            if (!Ordered || Timeline.FinishTime < Previous)
+            {
+                m_Disordered++;
+            }
+        }
+
+        atomic<uint64_t> m_Reported;
+        atomic<uint64_t> m_ReportedDropped;
+        atomic<uint64_t> m_Disordered;
+    };
+
+    int RunPipeline(bool Async, uint64_t Frames)
+    {
+        ReportingSwapChain SwapChain(Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.AddStage(make_shared<ChecksumStage>());
+        Pipeline.AddStage(make_shared<ThinningStage>());
+        Pipeline.SetSink(make_shared<NullSink>());
+        if (Async)
+        {
+            Pipeline.SetAsyncProcessing(3);
+        }
+
+        Pipeline.RunCore();
+
+        const PipelineStatistics& Statistics = Pipeline.Statistics();
+        const FrameTimings& Timings = Pipeline.Timings();
+
+        printf("\n%s: %llu frames acquired, %llu skipped, %llu dropped by a stage\n",
+            Async ? "async" : "sync",
+            static_cast<unsigned long long>(Statistics.FramesAcquired),
+            static_cast<unsigned long long>(Statistics.FramesOverrun + Statistics.MapFailures),
+            static_cast<unsigned long long>(Statistics.FramesDropped));
+        printf("%-10s %8s %10s %10s %10s %10s\n", "segment", "count", "p50 [us]", "p99 [us]", "p99.9 [us]", "max [us]");
+
+        uint64_t Processed = Statistics.FramesAcquired - Statistics.FramesOverrun - Statistics.MapFailures;
+        int Failures = 0;
+
+        for (uint32_t i = 0; i < Timings.SegmentCount(); i++)
+        {
+            LatencySummary Summary = Timings.Segment(i).Summarize();
+            printf("%-10s %8llu %10.1f %10.1f %10.1f %10.1f\n",
+                Timings.SegmentName(i),
+                static_cast<unsigned long long>(Summary.Count),
+                Summary.P50 / 1e3,
+                Summary.P99 / 1e3,
+                Summary.P999 / 1e3,
+                Summary.Max / 1e3);
+
+            // Copy and queue only exist asynchronously, the sink only sees frames no stage dropped
+            uint64_t Expected = Processed;
+            if (i < 2)
+            {
+                Expected = Async ? Processed : 0;
+            }
+            else if (i == Timings.SegmentCount() - 2)
+            {
+                Expected = Processed - Statistics.FramesDropped;
+            }
+
+            if (Summary.Count != Expected)
+            {
+                printf("  FAILED: %llu values in %s, expected %llu\n",
+                    static_cast<unsigned long long>(Summary.Count), Timings.SegmentName(i), static_cast<unsigned long long>(Expected));
+                Failures = 1;
+            }
+        }
+
+        uint64_t Dropped = Statistics.FramesDropped + Statistics.FramesOverrun + Statistics.MapFailures;
+        if (SwapChain.m_Reported != Statistics.FramesAcquired || SwapChain.m_ReportedDropped != Dropped ||
+            Timings.FramesDropped() != Dropped || SwapChain.m_Disordered != 0 || Statistics.FramesDropped == 0)
+        {
+            printf("  FAILED: %llu frames reported (%llu dropped, %llu out of order)\n",
+                static_cast<unsigned long long>(SwapChain.m_Reported.load()),
+                static_cast<unsigned long long>(SwapChain.m_ReportedDropped.load()),
+                static_cast<unsigned long long>(SwapChain.m_Disordered.load()));
+            Failures = 1;
+        }
+
+        return Failures;
+    }
+}
+
+int BenchTimings(int argc, char* argv[])
+{
+    uint64_t Frames = max<uint64_t>(DropInterval, Bench::ParseOption(argc, argv, "frames", 600));
+    uint32_t Threads = static_cast<uint32_t>(max<uint64_t>(1, Bench::ParseOption(argc, argv, "threads", 4)));
+    int Failures = 0;
+
+    uint64_t BucketFailures = CheckBuckets();
+    printf("bucket bounds: %llu failures\n\n", static_cast<unsigned long long>(BucketFailures));
+
+    uint64_t PercentileFailures = CheckPercentiles();
+    printf("percentiles: %llu failures\n\n", static_cast<unsigned long long>(PercentileFailures));
+
+    uint64_t ConcurrencyFailures = CheckConcurrency(Threads);
+    printf("%u concurrent recorders: %s\n", Threads, ConcurrencyFailures == 0 ? "no values lost" : "FAILED");
+
+    printf("record: %.1f ns\n", RecordNanoseconds());
+
+    if (BucketFailures != 0 || PercentileFailures != 0 || ConcurrencyFailures != 0)
+    {
+        Failures = 1;
+    }
+
+    for (bool Async : { false, true })
+    {
+        if (RunPipeline(Async, Frames) != 0)
+        {
+            Failures = 1;
+        }
+    }
+
+    return Failures;
+}
@@ -0,0 +1,408 @@
+/*++
+
+Module Name:
+
+    bench_trace.cpp
+
+Abstract:
+
+    Checks and measures the frame tracer. First has 1 to 4 threads record into a small ring as fast as they can,
+    reporting the cost of a tracepoint, and checks that the ring holds its last Capacity events, in order for each
+    thread, short of at most the events the tracer reports dropped. Then runs the simulated swap-chain at 240 fps through a traced pipeline with a stage that reads
+    every pixel and a stage that drops every eighth frame, on the acquire thread and then asynchronously. Every
+    begin must be closed by an end of the same span and frame on its own thread, every acquired frame must have an
+    acquire span, every processed frame a process span and, asynchronously, a flow from its hand-off, and the
+    dropped and skipped markers must match the pipeline's statistics. Prints the mean and p99 of every span and
+    checks that the exported Chrome trace is well-formed JSON holding every event.
+
+    Options: --frames N (default 600, per run), --events N (default 2000000, per thread), --ring N (default 65536),
+             --file PATH (writes the asynchronous run's trace, e.g. to open in chrome://tracing or Perfetto)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/frame_trace.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint32_t MonitorWidth = 1920;
+    const uint32_t MonitorHeight = 1080;
+    const uint64_t DropInterval = 8;
+    const double FramesPerSecond = 240;
+
+    // Recorded by the threads of the cost measurement, told apart by their TraceId
+    const char* const RecordName = "record";
+
+    void RecordEvents(FrameTracer& Tracer, uint32_t Thread, uint64_t Events)
+    {
+        for (uint64_t i = 0; i < Events; i++)
+        {
+            Tracer.Record(TracePhase::Instant, RecordName, static_cast<uint64_t>(Thread) << 40 | i);
+        }
+    }
+
+    int MeasureRecording(uint64_t Events, uint32_t RingCapacity)
+    {
+        printf("%llu events per thread, %u-event ring\n\n", static_cast<unsigned long long>(Events), RingCapacity);
+        printf("%-8s %12s %12s %10s %10s\n", "threads", "ns/event", "overwritten", "dropped", "kept");
+
+        int Failures = 0;
+        const uint32_t ThreadCounts[] = { 1, 2, 4 };
+        for (uint32_t Threads : ThreadCounts)
+        {
+            FrameTracer Tracer(RingCapacity);
+
+            double Start = Bench::WallSeconds();
+            vector<thread> Recorders;
+            for (uint32_t t = 0; t < Threads; t++)
+            {
+                Recorders.emplace_back([&Tracer, t, Events] { RecordEvents(Tracer, t, Events); });
+            }
+            for (thread& Recorder : Recorders)
+            {
+                Recorder.join();
+            }
+            double Seconds = Bench::WallSeconds() - Start;
+
+            // The thread time an event costs, as in the log benchmark
+            uint32_t Cores = min(Threads, max(1u, thread::hardware_concurrency()));
+            double NanosecondsPerEvent = Seconds * 1e9 * Cores / (static_cast<double>(Events) * Threads);
+
+            vector<TraceEvent> Kept;
+            Tracer.Snapshot(Kept);
+
+            // The newest events, each thread's in the order it recorded them, short of at most the ones dropped
+            uint64_t Total = Events * Threads;
+            uint64_t Window = min<uint64_t>(Total, Tracer.Recorded() - Tracer.Overwritten());
+            bool Complete = Tracer.Recorded() == Total && Kept.size() <= Window && Kept.size() + Tracer.Dropped() >= Window;
+            vector<long long> Last(Threads, -1);
+            for (const TraceEvent& Event : Kept)
+            {
+                uint32_t Thread = static_cast<uint32_t>(Event.TraceId >> 40);
+                long long Index = static_cast<long long>(Event.TraceId & ((1ull << 40) - 1));
+                if (Event.pName != RecordName || Event.Phase != TracePhase::Instant || Thread >= Threads || Index <= Last[Thread])
+                {
+                    Complete = false;
+                    break;
+                }
+                Last[Thread] = Index;
+            }
+
+            printf("%-8u %12.1f %12llu %10llu %10zu\n", Threads, NanosecondsPerEvent, static_cast<unsigned long long>(Tracer.Overwritten()),
+                static_cast<unsigned long long>(Tracer.Dropped()), Kept.size());
+            if (!Complete)
+            {
+                printf("  FAILED: the ring does not hold the newest events in order\n");
+                Failures = 1;
+            }
+        }
+
+        return Failures;
+    }
+
+    /// <summary>
+    /// Reads every pixel, as a converter or an encoder would.
+    /// </summary>
+    class ChecksumStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "checksum"; }
+
+        bool Process(Frame& Frame) override
+        {
+            uint64_t Sum = 0;
+            for (uint32_t y = 0; y < Frame.Height; y++)
+            {
+                const uint64_t* pRow = reinterpret_cast<const uint64_t*>(Frame.pData + static_cast<size_t>(y) * Frame.Pitch);
+                for (uint32_t x = 0; x < Frame.Width / 2; x++)
+                {
+                    Sum += pRow[x];
+                }
+            }
+            m_Checksum += Sum;
+            return true;
+        }
+
+        uint64_t m_Checksum = 0;
+    };
+
+    /// <summary>
+    /// Drops every DropInterval-th frame it sees.
+    /// </summary>
+    class ThinningStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "thin"; }
+
+        bool Process(Frame&) override
+        {
+            return m_Seen++ % DropInterval != DropInterval - 1;
+        }
+
+    private:
+        uint64_t m_Seen = 0;
+    };
+
+    class NullSink : public IFrameSink
+    {
+    public:
+        void Consume(const Frame&) override
+        {
+        }
+    };
+
+    struct OpenSpan
+    {
+        const char* pName;
+        uint64_t TraceId;
+        uint64_t Begin;
+    };
+
+    // Checks brackets, strings and escapes, which is all that the exporter could get wrong
+    bool WellFormed(const string& Json)
+    {
+        vector<char> Open;
+        bool InString = false;
+        for (size_t i = 0; i < Json.size(); i++)
+        {
+            char c = Json[i];
+            if (InString)
+            {
+                if (c == '\\')
+                {
+                    i++;
+                }
+                else if (c == '"')
+                {
+                    InString = false;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            if (c == '"')
+            {
+                InString = true;
+            }
+            else if (c == '{' || c == '[')
+            {
+                Open.push_back(c == '{' ? '}' : ']');
+            }
+            else if (c == '}' || c == ']')
+            {
+                if (Open.empty() || Open.back() != c)
+                {
+                    return false;
+                }
+                Open.pop_back();
+            }
+        }
+        return Open.empty() && !InString;
+    }
+
+    size_t CountOf(const string& Text, const char* pPattern)
+    {
+        size_t Count = 0;
+        for (size_t At = Text.find(pPattern); At != string::npos; At = Text.find(pPattern, At + 1))
+        {
+            Count++;
+        }
+        return Count;
+    }
+
+    int RunPipeline(bool Async, uint64_t Frames, uint32_t RingCapacity, const char* pPath)
+    {
+        auto Tracer = make_shared<FrameTracer>(RingCapacity);
+
+        SimulatedSwapChain SwapChain(MonitorWidth, MonitorHeight, FramesPerSecond, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.AddStage(make_shared<ChecksumStage>());
+        Pipeline.AddStage(make_shared<ThinningStage>());
+        Pipeline.SetSink(make_shared<NullSink>());
+        Pipeline.SetTracer(Tracer);
+        if (Async)
+        {
+            Pipeline.SetAsyncProcessing(3);
+        }
+
+        Pipeline.RunCore();
+
+        const PipelineStatistics& Statistics = Pipeline.Statistics();
+        uint64_t Skipped = Statistics.FramesOverrun + Statistics.MapFailures;
+        uint64_t Processed = Statistics.FramesAcquired - Skipped;
+
+        printf("\n%s: %llu frames acquired, %llu skipped, %llu dropped by a stage, %llu events\n",
+            Async ? "async" : "sync",
+            static_cast<unsigned long long>(Statistics.FramesAcquired),
+            static_cast<unsigned long long>(Skipped),
+            static_cast<unsigned long long>(Statistics.FramesDropped),
+            static_cast<unsigned long long>(Tracer->Recorded()));
+
+        int Failures = 0;
+        if (Tracer->Overwritten() != 0)
+        {
+            printf("  FAILED: the ring overflowed, run with a larger --ring\n");
+            return 1;
+        }
+
+        vector<TraceEvent> Events;
+        Tracer->Snapshot(Events);
+
+        // Match begins and ends on every thread, and collect the durations of each span
+        map<uint32_t, vector<OpenSpan>> Stacks;
+        map<string, vector<double>> Durations;
+        map<string, uint64_t> FramesWith;
+        uint64_t Unmatched = 0;
+        uint64_t FlowStarts = 0;
+        uint64_t FlowEnds = 0;
+        uint64_t DroppedMarks = 0;
+        uint64_t SkippedMarks = 0;
+
+        for (const TraceEvent& Event : Events)
+        {
+            vector<OpenSpan>& Stack = Stacks[Event.Thread];
+            switch (Event.Phase)
+            {
+            case TracePhase::Begin:
+                Stack.push_back({ Event.pName, Event.TraceId, Event.Timestamp });
+                break;
+            case TracePhase::End:
+                if (Stack.empty() || strcmp(Stack.back().pName, Event.pName) != 0 || Stack.back().TraceId != Event.TraceId ||
+                    Stack.back().Begin > Event.Timestamp)
+                {
+                    Unmatched++;
+                    break;
+                }
+                Durations[Event.pName].push_back(static_cast<double>(Event.Timestamp - Stack.back().Begin));
+                if (Event.TraceId != 0)
+                {
+                    FramesWith[Event.pName]++;
+                }
+                Stack.pop_back();
+                break;
+            case TracePhase::FlowStart:
+                FlowStarts++;
+                break;
+            case TracePhase::FlowEnd:
+                // Must arrive inside the frame's process span
+                if (Stack.empty() || strcmp(Stack.back().pName, "process") != 0 || Stack.back().TraceId != Event.TraceId)
+                {
+                    Unmatched++;
+                }
+                FlowEnds++;
+                break;
+            case TracePhase::Instant:
+                DroppedMarks += strcmp(Event.pName, "dropped") == 0;
+                SkippedMarks += strcmp(Event.pName, "skipped") == 0;
+                break;
+            }
+        }
+
+        for (const auto& Stack : Stacks)
+        {
+            Unmatched += Stack.second.size();
+        }
+
+        printf("%-10s %8s %10s %10s %10s\n", "span", "count", "mean [us]", "p99 [us]", "max [us]");
+        for (auto& Span : Durations)
+        {
+            vector<double>& Samples = Span.second;
+            double Sum = 0;
+            for (double Sample : Samples)
+            {
+                Sum += Sample;
+            }
+            double Max = *max_element(Samples.begin(), Samples.end());
+            printf("%-10s %8zu %10.1f %10.1f %10.1f\n", Span.first.c_str(), Samples.size(), Sum / Samples.size() / 1e3,
+                Bench::Percentile(Samples, 99) / 1e3, Max / 1e3);
+        }
+
+        if (Unmatched != 0 || FramesWith["acquire"] != Statistics.FramesAcquired || FramesWith["process"] != Processed ||
+            FlowStarts != (Async ? Processed : 0) || FlowEnds != FlowStarts || DroppedMarks != Statistics.FramesDropped ||
+            SkippedMarks != Skipped)
+        {
+            printf("  FAILED: %llu unmatched events, %llu acquire and %llu process spans, %llu/%llu flows, %llu dropped and %llu skipped markers\n",
+                static_cast<unsigned long long>(Unmatched),
+                static_cast<unsigned long long>(FramesWith["acquire"]),
+                static_cast<unsigned long long>(FramesWith["process"]),
+                static_cast<unsigned long long>(FlowStarts),
+                static_cast<unsigned long long>(FlowEnds),
+                static_cast<unsigned long long>(DroppedMarks),
+                static_cast<unsigned long long>(SkippedMarks));
+            Failures = 1;
+        }
+
+        string Json;
+        double Start = Bench::WallSeconds();
+        Tracer->ExportChromeTrace(Json);
+        double ExportMs = (Bench::WallSeconds() - Start) * 1e3;
+
+        // One "ph" per event, plus the thread names
+        size_t Exported = CountOf(Json, "\"ph\":");
+        size_t Named = CountOf(Json, "\"ph\":\"M\"");
+        printf("chrome trace: %.1f KB in %.2f ms\n", Json.size() / 1e3, ExportMs);
+        if (!WellFormed(Json) || Exported - Named != Events.size() || Named != Stacks.size())
+        {
+            printf("  FAILED: the trace is not well-formed or holds %zu of %zu events\n", Exported - Named, Events.size());
+            Failures = 1;
+        }
+
+        if (pPath)
+        {
+            if (Tracer->SaveChromeTrace(pPath))
+            {
+                printf("written to %s\n", pPath);
+            }
+            else
+            {
+                printf("  FAILED: cannot write %s\n", pPath);
+                Failures = 1;
+            }
+        }
+
+        return Failures;
+    }
+}
+
+int BenchTrace(int argc, char* argv[])
+{
+    uint64_t Frames = max<uint64_t>(1, Bench::ParseOption(argc, argv, "frames", 600));
+    uint64_t Events = max<uint64_t>(1, Bench::ParseOption(argc, argv, "events", 2000000));
+    uint32_t RingCapacity = static_cast<uint32_t>(max<uint64_t>(2, Bench::ParseOption(argc, argv, "ring", FrameTracer::DefaultCapacity)));
+
+    const char* pPath = nullptr;
+    for (int i = 0; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--file") == 0)
+        {
+            pPath = argv[i + 1];
+        }
+    }
+
+    int Failures = MeasureRecording(Events, RingCapacity);
+    Failures |= RunPipeline(false, Frames, RingCapacity, nullptr);
+    Failures |= RunPipeline(true, Frames, RingCapacity, pPath);
+    return Failures;
+}
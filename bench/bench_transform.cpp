@@ -0,0 +1,516 @@
+/*++
+
+Module Name:
+
+    bench_transform.cpp
+
+Abstract:
+
+    Checks and measures the frame transforms. Every kernel tier, the scalar one included, must match a naive loop
+    that moves one pixel at a time to where the orientation puts it, for all eight orientations, every format and
+    sizes that leave partial blocks and tiles at the edges, without touching the destination's row padding. Rectangles
+    must map to the pixels they cover, and the stage must orient a frame's damage along with its pixels. A consumer
+    behind the stage that only redraws the damage it is handed must keep up with the screen, also when a later stage
+    drops every third frame and the pipeline folds their damage into the next one. Then reports
+    the time to orient a 4K frame with the naive loop and with each tier, next to a plain copy of the frame. GB/s
+    counts the frame's bytes once; budget is the share of a 60 Hz frame.
+
+    Options: --frames N (default 20)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "../pipeline/color_convert.h"
+#include "../pipeline/frame_pipeline.h"
+#include "../pipeline/frame_transform.h"
+#include "../pipeline/simulated_swapchain.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const FrameOrientation Orientations[] =
+    {
+        FrameOrientation::Identity, FrameOrientation::Rotate90, FrameOrientation::Rotate180, FrameOrientation::Rotate270,
+        FrameOrientation::FlipHorizontal, FrameOrientation::FlipVertical, FrameOrientation::Transpose, FrameOrientation::Transverse,
+    };
+    const PixelFormat Formats[] = { PixelFormat::Bgra8, PixelFormat::Nv12, PixelFormat::I420, PixelFormat::I444 };
+
+    const char* FormatName(PixelFormat Format)
+    {
+        switch (Format)
+        {
+        case PixelFormat::Bgra8:
+            return "bgra";
+        case PixelFormat::Nv12:
+            return "nv12";
+        case PixelFormat::I420:
+            return "i420";
+        default:
+            return "i444";
+        }
+    }
+
+    struct Image
+    {
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t Pitch;
+        vector<uint8_t> Data;
+    };
+
+    Image MakeImage(uint32_t Width, uint32_t Height, PixelFormat Format)
+    {
+        Image Result;
+        Result.Width = Width;
+        Result.Height = Height;
+
+        // Some padding past the row, which must come through untouched; even, as MakeYuvPlanes wants
+        Result.Pitch = (Width * BytesPerPixel(Format) + 1 + 15) & ~15u;
+        Result.Data.assign(static_cast<size_t>(Result.Pitch) * FrameRows(Format, Height), 0xCD);
+        return Result;
+    }
+
+    void FillPattern(Image& Target, uint32_t Seed)
+    {
+        uint32_t State = Seed | 1;
+        for (uint8_t& Value : Target.Data)
+        {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            Value = static_cast<uint8_t>(State >> 24);
+        }
+    }
+
+    // Where pixel (x, y) of a Width x Height image ends up, from the definition of each orientation
+    void MapPixel(uint32_t x, uint32_t y, uint32_t Width, uint32_t Height, FrameOrientation Orientation, uint32_t& MappedX, uint32_t& MappedY)
+    {
+        switch (Orientation)
+        {
+        case FrameOrientation::Rotate90:
+            MappedX = Height - 1 - y;
+            MappedY = x;
+            break;
+        case FrameOrientation::Rotate180:
+            MappedX = Width - 1 - x;
+            MappedY = Height - 1 - y;
+            break;
+        case FrameOrientation::Rotate270:
+            MappedX = y;
+            MappedY = Width - 1 - x;
+            break;
+        case FrameOrientation::FlipHorizontal:
+            MappedX = Width - 1 - x;
+            MappedY = y;
+            break;
+        case FrameOrientation::FlipVertical:
+            MappedX = x;
+            MappedY = Height - 1 - y;
+            break;
+        case FrameOrientation::Transpose:
+            MappedX = y;
+            MappedY = x;
+            break;
+        case FrameOrientation::Transverse:
+            MappedX = Height - 1 - y;
+            MappedY = Width - 1 - x;
+            break;
+        default:
+            MappedX = x;
+            MappedY = y;
+            break;
+        }
+    }
+
+    // The naive loop: every pixel on its own, in source order
+    template <uint32_t Bytes>
+    void NaivePlane(const uint8_t* pSource, uint32_t SourcePitch, uint32_t Width, uint32_t Height, uint8_t* pDestination,
+        uint32_t DestinationPitch, FrameOrientation Orientation)
+    {
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            for (uint32_t x = 0; x < Width; x++)
+            {
+                uint32_t MappedX, MappedY;
+                MapPixel(x, y, Width, Height, Orientation, MappedX, MappedY);
+                memcpy(pDestination + static_cast<size_t>(MappedY) * DestinationPitch + MappedX * Bytes,
+                    pSource + static_cast<size_t>(y) * SourcePitch + x * Bytes, Bytes);
+            }
+        }
+    }
+
+    void NaiveFrame(const Image& Source, Image& Destination, PixelFormat Format, FrameOrientation Orientation)
+    {
+        const uint32_t Width = Source.Width;
+        const uint32_t Height = Source.Height;
+        if (Format == PixelFormat::Bgra8)
+        {
+            NaivePlane<4>(Source.Data.data(), Source.Pitch, Width, Height, Destination.Data.data(), Destination.Pitch, Orientation);
+            return;
+        }
+
+        const YuvPlanes From = MakeYuvPlanes(const_cast<uint8_t*>(Source.Data.data()), Source.Pitch, Height, Format);
+        const YuvPlanes To = MakeYuvPlanes(Destination.Data.data(), Destination.Pitch, Destination.Height, Format);
+        NaivePlane<1>(From.pY, From.YPitch, Width, Height, To.pY, To.YPitch, Orientation);
+
+        uint32_t ChromaWidth = Format == PixelFormat::I444 ? Width : (Width + 1) / 2;
+        uint32_t ChromaHeight = Format == PixelFormat::I444 ? Height : (Height + 1) / 2;
+        if (Format == PixelFormat::Nv12)
+        {
+            NaivePlane<2>(From.pU, From.UPitch, ChromaWidth, ChromaHeight, To.pU, To.UPitch, Orientation);
+            return;
+        }
+        NaivePlane<1>(From.pU, From.UPitch, ChromaWidth, ChromaHeight, To.pU, To.UPitch, Orientation);
+        NaivePlane<1>(From.pV, From.VPitch, ChromaWidth, ChromaHeight, To.pV, To.VPitch, Orientation);
+    }
+
+    Image MakeOriented(const Image& Source, PixelFormat Format, FrameOrientation Orientation)
+    {
+        return SwapsAxes(Orientation) ? MakeImage(Source.Height, Source.Width, Format) : MakeImage(Source.Width, Source.Height, Format);
+    }
+
+    uint32_t CheckExactness(uint32_t& Cases)
+    {
+        // Partial blocks of every tier, partial tiles, and sizes a block does not fit in at all
+        const struct { uint32_t Width; uint32_t Height; } Sizes[] =
+        {
+            { 1, 1 }, { 7, 5 }, { 33, 17 }, { 97, 61 }, { 200, 130 }, { 1917, 13 },
+        };
+
+        uint32_t Mismatches = 0;
+        Cases = 0;
+
+        for (const auto& Size : Sizes)
+        {
+            for (PixelFormat Format : Formats)
+            {
+                Image Source = MakeImage(Size.Width, Size.Height, Format);
+                FillPattern(Source, Size.Width * 31 + Size.Height);
+
+                for (FrameOrientation Orientation : Orientations)
+                {
+                    Image Reference = MakeOriented(Source, Format, Orientation);
+                    NaiveFrame(Source, Reference, Format, Orientation);
+
+                    for (int Level = 0; Level <= static_cast<int>(DetectSimdLevel()); Level++)
+                    {
+                        Image Oriented = MakeOriented(Source, Format, Orientation);
+                        bool Succeeded = TransformFrame(Source.Data.data(), Source.Pitch, Source.Width, Source.Height, Oriented.Data.data(),
+                            Oriented.Pitch, Format, Orientation, static_cast<SimdLevel>(Level));
+                        Cases++;
+
+                        if (!Succeeded || Oriented.Data != Reference.Data)
+                        {
+                            Mismatches++;
+                            printf("MISMATCH %s %s %s %ux%u\n", SimdLevelName(static_cast<SimdLevel>(Level)), FormatName(Format),
+                                FrameOrientationName(Orientation), Size.Width, Size.Height);
+                        }
+                    }
+                }
+            }
+        }
+
+        return Mismatches;
+    }
+
+    // A rectangle must map onto the bounding box of the pixels it covers
+    uint32_t CheckRects(uint32_t& Cases)
+    {
+        const uint32_t Width = 37, Height = 23;
+        const Rect Areas[] =
+        {
+            { 0, 0, 37, 23 }, { 0, 0, 1, 1 }, { 36, 22, 37, 23 }, { 5, 3, 20, 9 }, { 11, 0, 12, 23 },
+        };
+
+        uint32_t Mismatches = 0;
+        Cases = 0;
+        for (FrameOrientation Orientation : Orientations)
+        {
+            for (const Rect& Area : Areas)
+            {
+                Rect Expected = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+                for (int32_t y = Area.Top; y < Area.Bottom; y++)
+                {
+                    for (int32_t x = Area.Left; x < Area.Right; x++)
+                    {
+                        uint32_t MappedX, MappedY;
+                        MapPixel(x, y, Width, Height, Orientation, MappedX, MappedY);
+                        Expected.Left = min(Expected.Left, static_cast<int32_t>(MappedX));
+                        Expected.Top = min(Expected.Top, static_cast<int32_t>(MappedY));
+                        Expected.Right = max(Expected.Right, static_cast<int32_t>(MappedX) + 1);
+                        Expected.Bottom = max(Expected.Bottom, static_cast<int32_t>(MappedY) + 1);
+                    }
+                }
+
+                Cases++;
+                Rect Mapped = TransformRect(Area, Width, Height, Orientation);
+                if (Mapped != Expected)
+                {
+                    Mismatches++;
+                    printf("MISMATCH rect %s (%d,%d)-(%d,%d): (%d,%d)-(%d,%d), expected (%d,%d)-(%d,%d)\n", FrameOrientationName(Orientation),
+                        Area.Left, Area.Top, Area.Right, Area.Bottom, Mapped.Left, Mapped.Top, Mapped.Right, Mapped.Bottom, Expected.Left,
+                        Expected.Top, Expected.Right, Expected.Bottom);
+                }
+            }
+        }
+
+        return Mismatches;
+    }
+
+    // Runs a BGRA frame with a move and a dirty rectangle through the stage
+    int CheckStage()
+    {
+        const uint32_t Width = 320, Height = 200;
+        const FrameOrientation Orientation = FrameOrientation::Rotate90;
+        int Failures = 0;
+
+        Image Source = MakeImage(Width, Height, PixelFormat::Bgra8);
+        FillPattern(Source, 7);
+        Image Reference = MakeOriented(Source, PixelFormat::Bgra8, Orientation);
+        NaiveFrame(Source, Reference, PixelFormat::Bgra8, Orientation);
+
+        const Rect Dirty = { 10, 20, 50, 40 };
+        const MoveRect Move = { 100, 60, { 120, 100, 180, 130 } };
+
+        Frame Input = {};
+        Input.Width = Width;
+        Input.Height = Height;
+        Input.Pitch = Source.Pitch;
+        Input.Format = PixelFormat::Bgra8;
+        Input.pData = Source.Data.data();
+        Input.Damage = DamageState::Partial;
+        Input.DirtyRectCount = 1;
+        Input.pDirtyRects = &Dirty;
+        Input.MoveRectCount = 1;
+        Input.pMoveRects = &Move;
+
+        TransformStage Stage(Orientation);
+        if (!Stage.Process(Input) || Input.Width != Height || Input.Height != Width || !Input.pBuffer)
+        {
+            printf("  FAILED: the stage did not hand on a %ux%u frame\n", Height, Width);
+            return 1;
+        }
+
+        for (uint32_t y = 0; y < Input.Height; y++)
+        {
+            if (memcmp(Input.pData + static_cast<size_t>(y) * Input.Pitch, Reference.Data.data() + static_cast<size_t>(y) * Reference.Pitch,
+                static_cast<size_t>(Input.Width) * 4) != 0)
+            {
+                printf("  FAILED: the stage's pixels differ from the naive loop in row %u\n", y);
+                Failures++;
+                break;
+            }
+        }
+
+        // (x, y) goes to (Height - 1 - y, x)
+        const Rect ExpectedDirty = { 160, 10, 180, 50 };
+        const MoveRect ExpectedMove = { 110, 100, { 70, 120, 100, 180 } };
+        if (Input.Damage != DamageState::Partial || Input.DirtyRectCount != 1 || Input.pDirtyRects[0] != ExpectedDirty ||
+            Input.MoveRectCount != 1 || Input.pMoveRects[0].SourceX != ExpectedMove.SourceX ||
+            Input.pMoveRects[0].SourceY != ExpectedMove.SourceY || Input.pMoveRects[0].Destination != ExpectedMove.Destination)
+        {
+            printf("  FAILED: the stage did not rotate the damage along with the pixels\n");
+            Failures++;
+        }
+
+        return Failures;
+    }
+
+    /// <summary>
+    /// Drops every third frame.
+    /// </summary>
+    class DropStage : public IFrameStage
+    {
+    public:
+        const char* Name() const override { return "drop"; }
+
+        bool Process(Frame&) override { return ++m_Frames % 3 != 0; }
+
+    private:
+        uint64_t m_Frames = 0;
+    };
+
+    /// <summary>
+    /// Keeps a copy of the BGRA screen that is only ever updated through the dirty rectangles of the frames it is
+    /// handed, and compares it with every frame.
+    /// </summary>
+    class MirrorSink : public IFrameSink
+    {
+    public:
+        void Consume(const Frame& Frame) override
+        {
+            Delivered++;
+
+            Rect Whole = { 0, 0, static_cast<int32_t>(Frame.Width), static_cast<int32_t>(Frame.Height) };
+            if (Frame.Width != m_Width || Frame.Height != m_Height || Frame.Damage != DamageState::Partial)
+            {
+                m_Width = Frame.Width;
+                m_Height = Frame.Height;
+                m_Pixels.assign(static_cast<size_t>(m_Width) * m_Height * 4, 0);
+                Copy(Frame, Whole);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+                {
+                    const Rect& Dirty = Frame.pDirtyRects[i];
+                    Copy(Frame, { max(Dirty.Left, 0), max(Dirty.Top, 0), min(Dirty.Right, Whole.Right), min(Dirty.Bottom, Whole.Bottom) });
+                }
+            }
+
+            for (uint32_t y = 0; y < m_Height; y++)
+            {
+                if (memcmp(&m_Pixels[static_cast<size_t>(y) * m_Width * 4], Frame.pData + static_cast<size_t>(y) * Frame.Pitch,
+                    static_cast<size_t>(m_Width) * 4) != 0)
+                {
+                    Mismatches++;
+                    break;
+                }
+            }
+        }
+
+        uint64_t Delivered = 0;
+        uint64_t Mismatches = 0;
+
+    private:
+        void Copy(const Frame& Frame, const Rect& Area)
+        {
+            for (int32_t y = Area.Top; y < Area.Bottom && !Area.Empty(); y++)
+            {
+                memcpy(&m_Pixels[(static_cast<size_t>(y) * m_Width + Area.Left) * 4], Frame.pData + static_cast<size_t>(y) * Frame.Pitch + Area.Left * 4,
+                    static_cast<size_t>(Area.Right - Area.Left) * 4);
+            }
+        }
+
+        uint32_t m_Width = 0;
+        uint32_t m_Height = 0;
+        vector<uint8_t> m_Pixels;
+    };
+
+    // Rotates a simulated swap-chain in a pipeline that drops every third frame after the stage
+    int CheckDroppedFrames()
+    {
+        const uint32_t Frames = 60;
+        SimulatedSwapChain SwapChain(320, 192, 0, Frames);
+        FramePipeline Pipeline(SwapChain);
+        Pipeline.AddStage(make_shared<TransformStage>(FrameOrientation::Rotate90));
+        Pipeline.AddStage(make_shared<DropStage>());
+        auto Mirror = make_shared<MirrorSink>();
+        Pipeline.SetSink(Mirror);
+        Pipeline.RunCore();
+
+        printf("dropped frames: %llu of %llu frames redrawn from their damage alone match the rotated screen\n",
+            static_cast<unsigned long long>(Mirror->Delivered - Mirror->Mismatches), static_cast<unsigned long long>(Mirror->Delivered));
+        if (Mirror->Delivered != Frames - Frames / 3 || Mirror->Mismatches != 0)
+        {
+            printf("  FAILED: the damage of dropped frames was not carried over in the source's coordinates\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    uint64_t FrameBytes(uint32_t Width, uint32_t Height, PixelFormat Format)
+    {
+        switch (Format)
+        {
+        case PixelFormat::Bgra8:
+            return static_cast<uint64_t>(Width) * Height * 4;
+        case PixelFormat::I444:
+            return static_cast<uint64_t>(Width) * Height * 3;
+        default:
+            return static_cast<uint64_t>(Width) * Height * 3 / 2;
+        }
+    }
+
+    void PrintTiming(const char* Format, const char* What, const char* How, double Seconds, uint64_t Bytes)
+    {
+        printf("%-5s %-16s %-8s %10.3f %10.2f %7.1f%%\n", Format, What, How, Seconds * 1e3, Bytes / Seconds / 1e9, Seconds * 60.0 * 100.0);
+    }
+}
+
+int BenchTransform(int argc, char* argv[])
+{
+    uint64_t FrameCount = max<uint64_t>(1, Bench::ParseOption(argc, argv, "frames", 20));
+    int Failures = 0;
+
+    uint32_t Cases = 0;
+    uint32_t Mismatches = CheckExactness(Cases);
+    printf("exactness: %u of %u cases match the naive loop (best tier %s)\n", Cases - Mismatches, Cases, SimdLevelName(DetectSimdLevel()));
+    Failures += Mismatches;
+
+    Mismatches = CheckRects(Cases);
+    printf("rectangles: %u of %u cases map onto the pixels they cover\n", Cases - Mismatches, Cases);
+    Failures += Mismatches;
+
+    Failures += CheckStage();
+    Failures += CheckDroppedFrames();
+
+    // AVX-512 runs the AVX2 kernels
+    const Bench::Resolution& Mode = Bench::StandardResolutions[2];
+    SimdLevel Best = min(DetectSimdLevel(), SimdLevel::Avx2);
+    const FrameOrientation Timed[] =
+    {
+        FrameOrientation::Rotate90, FrameOrientation::Rotate270, FrameOrientation::Rotate180, FrameOrientation::FlipHorizontal,
+    };
+    const PixelFormat TimedFormats[] = { PixelFormat::Bgra8, PixelFormat::Nv12 };
+
+    printf("\n%s source\n", Mode.Name);
+    printf("%-5s %-16s %-8s %10s %10s %8s\n", "fmt", "orientation", "how", "ms/frame", "GB/s", "budget");
+    for (PixelFormat Format : TimedFormats)
+    {
+        const char* Name = FormatName(Format);
+        Image Source = MakeImage(Mode.Width, Mode.Height, Format);
+        FillPattern(Source, Mode.Width);
+        uint64_t Bytes = FrameBytes(Mode.Width, Mode.Height, Format);
+
+        // What any transform costs at least: reading and writing every byte once
+        Image Copy = MakeImage(Mode.Width, Mode.Height, Format);
+        double Start = Bench::WallSeconds();
+        for (uint64_t i = 0; i < FrameCount; i++)
+        {
+            memcpy(Copy.Data.data(), Source.Data.data(), Source.Data.size());
+        }
+        PrintTiming(Name, "copy", "memcpy", (Bench::WallSeconds() - Start) / FrameCount, Bytes);
+
+        for (FrameOrientation Orientation : Timed)
+        {
+            Image Oriented = MakeOriented(Source, Format, Orientation);
+
+            uint64_t Frames = max<uint64_t>(1, FrameCount / 4);
+            Start = Bench::WallSeconds();
+            for (uint64_t i = 0; i < Frames; i++)
+            {
+                NaiveFrame(Source, Oriented, Format, Orientation);
+            }
+            PrintTiming(Name, FrameOrientationName(Orientation), "naive", (Bench::WallSeconds() - Start) / Frames, Bytes);
+
+            for (int Level = 0; Level <= static_cast<int>(Best); Level++)
+            {
+                Start = Bench::WallSeconds();
+                for (uint64_t i = 0; i < FrameCount; i++)
+                {
+                    TransformFrame(Source.Data.data(), Source.Pitch, Source.Width, Source.Height, Oriented.Data.data(), Oriented.Pitch, Format,
+                        Orientation, static_cast<SimdLevel>(Level));
+                }
+                PrintTiming(Name, FrameOrientationName(Orientation), SimdLevelName(static_cast<SimdLevel>(Level)),
+                    (Bench::WallSeconds() - Start) / FrameCount, Bytes);
+            }
+        }
+    }
+
+    printf("\nframe transform: %s\n", Failures == 0 ? "exact" : "FAILED");
+    return Failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+/*++
+
+Module Name:
+
+    bench_vsync.cpp
+
+Abstract:
+
+    Checks and measures the virtual vsync clock. First checks that tick times are exact for the fractional refresh
+    rates of the sample modes and for 59.94 Hz, and shows how far a clock that adds a rounded period would drift in
+    an hour. Then simulates an hour of ticks on a virtual clock with a timer that oversleeps the way a 1 ms Windows
+    timer does, comparing three schedules: sleeping one period after every tick, sleeping until each tick is due,
+    and the clock's own, which sleeps until a learned lead before the tick and yields through the rest. Reports
+    the lateness percentiles, the ticks missed, the drift at the end of the hour and the time spent yielding. Last,
+    runs the real clock thread and measures how late a thread waiting for each tick wakes up.
+
+    Options: --seconds N (default 2, for the real clock), --hours N (default 1, simulated)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../pipeline/frame.h"
+#include "../pipeline/vsync_clock.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint64_t NanosecondsPerSecond = 1000000000ull;
+
+    struct Rate
+    {
+        const char* Name;
+        uint64_t Numerator;
+        uint64_t Denominator;
+    };
+
+    // The vertical refresh rates of s_KnownMonitorModes, and the NTSC-style rate that a rounded period gets wrong
+    const Rate Rates[] =
+    {
+        { "1080p60", 148500000, 2200 * 1125 },
+        { "720p60", 74250000, 1650 * 750 },
+        { "59.94", 60000, 1001 },
+        { "144", 144, 1 },
+    };
+
+    uint64_t NextRandom(uint64_t& State)
+    {
+        State ^= State << 13;
+        State ^= State >> 7;
+        State ^= State << 17;
+        return State;
+    }
+
+    // How late a 1 ms timer fires: mostly within its resolution, sometimes a few ms, rarely preempted for longer
+    uint64_t Oversleep(uint64_t& State)
+    {
+        uint64_t Roll = NextRandom(State) % 1000;
+        if (Roll < 970)
+        {
+            return 80000 + NextRandom(State) % 1020000;
+        }
+        if (Roll < 995)
+        {
+            return 1000000 + NextRandom(State) % 2000000;
+        }
+        return 3000000 + NextRandom(State) % 9000000;
+    }
+
+    uint64_t CheckExactness()
+    {
+        uint64_t Failures = 0;
+        uint64_t Random = 0x9E3779B97F4A7C15ull;
+
+        printf("%-8s %14s %16s %22s\n", "rate", "period [ns]", "ticks per hour", "rounded drift [us/h]");
+
+        for (const Rate& Mode : Rates)
+        {
+            const uint64_t Start = 123456789;
+            VsyncClock Clock(Mode.Numerator, Mode.Denominator, Start);
+
+            // Whole numbers of seconds fall exactly on the tick a rational period puts them on
+            for (uint64_t Seconds = 1; Seconds <= 100000; Seconds *= 10)
+            {
+                uint64_t Sequence = Clock.Numerator() * Seconds;
+                if (Sequence % Clock.Denominator() == 0 &&
+                    Clock.TickTime(Sequence / Clock.Denominator()) != Start + Seconds * NanosecondsPerSecond)
+                {
+                    Failures++;
+                }
+            }
+
+            for (int i = 0; i < 100000; i++)
+            {
+                uint64_t Sequence = NextRandom(Random) % 1000000000ull + 1;
+                uint64_t Time = Clock.TickTime(Sequence);
+                if (Clock.SequenceAt(Time) != Sequence || Clock.SequenceAt(Time - 1) != Sequence - 1 ||
+                    Clock.TickTime(Sequence - 1) >= Time)
+                {
+                    Failures++;
+                }
+            }
+
+            uint64_t TicksPerHour = Clock.SequenceAt(Start + 3600 * NanosecondsPerSecond);
+            uint64_t Exact = Clock.TickTime(TicksPerHour) - Start;
+            printf("%-8s %14llu %16llu %22.1f\n",
+                Mode.Name,
+                static_cast<unsigned long long>(Clock.Period()),
+                static_cast<unsigned long long>(TicksPerHour),
+                (Exact - TicksPerHour * Clock.Period()) / 1e3);
+        }
+
+        return Failures;
+    }
+
+    enum class Schedule
+    {
+        Relative,   // sleep one rounded period after each tick
+        Absolute,   // sleep until each tick is due
+        Clock,      // VsyncClock: sleep until the learned lead before the tick, yield through the rest
+    };
+
+    const char* ScheduleName(Schedule Kind)
+    {
+        switch (Kind)
+        {
+        case Schedule::Relative:
+            return "relative";
+        case Schedule::Absolute:
+            return "absolute";
+        default:
+            return "clock";
+        }
+    }
+
+    struct SimulationResult
+    {
+        vector<double> LatenessUs;
+        uint64_t Missed;
+        double DriftMs;             // how far the last tick is from where it should be
+        double YieldUsPerTick;
+        bool Ordered;               // sequences strictly increasing and on the exact timeline
+    };
+
+    SimulationResult Simulate(Schedule Kind, uint64_t Duration)
+    {
+        SimulationResult Result = {};
+        Result.Ordered = true;
+
+        VsyncClock Clock(148500000, 2200 * 1125, 0);
+        const uint64_t Period = Clock.Period();
+        uint64_t Random = 0x2545F4914F6CDD1Dull;
+        uint64_t Yielded = 0;
+        uint64_t Ticks = 0;
+
+        if (Kind == Schedule::Clock)
+        {
+            uint64_t Last = 0;
+            bool First = true;
+            while (Clock.NextTickTime() < Duration)
+            {
+                uint64_t Fired = Clock.NextWakeTime() + Oversleep(Random);
+                uint64_t Now = max(Fired, Clock.NextTickTime());
+                Yielded += Now - Fired;
+
+                VsyncTick Tick = Clock.Publish(Fired, Now);
+                Result.LatenessUs.push_back(Tick.Lateness / 1e3);
+                if ((!First && Tick.Sequence <= Last) || Tick.Time != Clock.TickTime(Tick.Sequence))
+                {
+                    Result.Ordered = false;
+                }
+                Last = Tick.Sequence;
+                First = false;
+                Ticks++;
+            }
+
+            Result.Missed = Clock.Statistics().MissedTicks;
+            Result.DriftMs = 0;
+        }
+        else
+        {
+            // The schedules a thread with a plain sleep would follow; tick N is published at Published
+            uint64_t Published = 0;
+            uint64_t Sequence = 0;
+            while (Clock.TickTime(Sequence) < Duration)
+            {
+                uint64_t Wake = (Kind == Schedule::Relative) ? (Sequence == 0 ? 0 : Published + Period) : Clock.TickTime(Sequence);
+                Published = Wake + Oversleep(Random);
+
+                Result.LatenessUs.push_back((Published - Clock.TickTime(Sequence)) / 1e3);
+                Sequence++;
+                Ticks++;
+
+                if (Kind == Schedule::Relative && Published >= Duration)
+                {
+                    break;
+                }
+            }
+
+            Result.Missed = Clock.SequenceAt(Duration) + 1 - Ticks;
+            Result.DriftMs = (Published - Clock.TickTime(Sequence - 1)) / 1e6;
+        }
+
+        Result.YieldUsPerTick = Ticks != 0 ? Yielded / 1e3 / Ticks : 0;
+        return Result;
+    }
+}
+
+int BenchVsync(int argc, char* argv[])
+{
+    uint64_t Seconds = max<uint64_t>(1, Bench::ParseOption(argc, argv, "seconds", 2));
+    uint64_t Hours = max<uint64_t>(1, Bench::ParseOption(argc, argv, "hours", 1));
+    int Failures = 0;
+
+    // Exact tick times
+    uint64_t ExactnessFailures = CheckExactness();
+    printf("exactness: %llu failures\n\n", static_cast<unsigned long long>(ExactnessFailures));
+    if (ExactnessFailures != 0)
+    {
+        Failures = 1;
+    }
+
+    // A simulated hour at 60 Hz
+    printf("%llu simulated hour(s) at 148.5 MHz / (2200 x 1125)\n\n", static_cast<unsigned long long>(Hours));
+    printf("%-9s %10s %10s %10s %10s %8s %11s %12s\n", "schedule", "p50 [us]", "p99 [us]", "p99.9 [us]", "max [us]", "missed", "drift [ms]", "yield [us/t]");
+
+    const Schedule Schedules[] = { Schedule::Relative, Schedule::Absolute, Schedule::Clock };
+    uint64_t AbsoluteMissed = 0;
+    for (Schedule Kind : Schedules)
+    {
+        SimulationResult Result = Simulate(Kind, Hours * 3600 * NanosecondsPerSecond);
+
+        printf("%-9s %10.1f %10.1f %10.1f %10.1f %8llu %11.1f %12.1f\n",
+            ScheduleName(Kind),
+            Bench::Percentile(Result.LatenessUs, 50),
+            Bench::Percentile(Result.LatenessUs, 99),
+            Bench::Percentile(Result.LatenessUs, 99.9),
+            Bench::Percentile(Result.LatenessUs, 100),
+            static_cast<unsigned long long>(Result.Missed),
+            Result.DriftMs,
+            Result.YieldUsPerTick);
+
+        if (Kind == Schedule::Absolute)
+        {
+            AbsoluteMissed = Result.Missed;
+        }
+        if (Kind == Schedule::Clock && (!Result.Ordered || Result.Missed > AbsoluteMissed))
+        {
+            printf("  FAILED: ticks out of order or off the timeline\n");
+            Failures = 1;
+        }
+    }
+
+    // The real clock thread
+    VsyncClock Clock(148500000, 2200 * 1125, MonotonicNanoseconds());
+    Clock.Start();
+
+    vector<double> WakeUs;
+    uint64_t Sequence = 0;
+    uint64_t End = MonotonicNanoseconds() + Seconds * NanosecondsPerSecond;
+    while (MonotonicNanoseconds() < End)
+    {
+        VsyncTick Tick;
+        if (Clock.WaitForTick(Sequence, 100, Tick))
+        {
+            WakeUs.push_back((MonotonicNanoseconds() - Tick.Time) / 1e3);
+            Sequence = Tick.Sequence;
+        }
+    }
+
+    Clock.Stop();
+    VsyncStatistics Statistics = Clock.Statistics();
+
+    printf("\nreal clock for %llu s: %llu ticks, %llu missed, lead %.1f us, waiter wakeup p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        static_cast<unsigned long long>(Seconds),
+        static_cast<unsigned long long>(Statistics.Ticks),
+        static_cast<unsigned long long>(Statistics.MissedTicks),
+        Statistics.Lead / 1e3,
+        WakeUs.empty() ? 0.0 : Bench::Percentile(WakeUs, 50),
+        WakeUs.empty() ? 0.0 : Bench::Percentile(WakeUs, 99),
+        WakeUs.empty() ? 0.0 : Bench::Percentile(WakeUs, 100));
+
+    if (Statistics.Ticks == 0)
+    {
+        Failures = 1;
+    }
+
+    return Failures;
+}
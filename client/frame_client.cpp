@@ -0,0 +1,266 @@
+/*++
+
+Module Name:
+
+    frame_client.cpp
+
+Abstract:
+
+    This module contains the frame client library.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_client.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <utility>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // How often the callback thread looks at the stop flag while no frames arrive
+    const uint32_t CallbackWaitMs = 20;
+
+    // How often a transport whose writer went away tries to open the region again
+    const uint32_t ReconnectMs = 10;
+}
+
+bool SharedMemoryTransport::Open(const char* Name)
+{
+    m_Name = Name;
+    return m_Reader.Open(Name);
+}
+
+bool SharedMemoryTransport::Attach(const void* pRegion, size_t Size, FrameExportControl* pControl)
+{
+    m_Name.clear();
+    return m_Reader.Attach(pRegion, Size, pControl);
+}
+
+bool SharedMemoryTransport::Reconnect()
+{
+    if (m_Reader.IsOpen() && !m_Reader.WriterChanged())
+    {
+        return true;
+    }
+
+    // Opening closes the reader first, which lets go of the old writer's regions
+    return !m_Name.empty() && m_Reader.Open(m_Name.c_str());
+}
+
+bool SharedMemoryTransport::Acquire(ClientFrame& Frame)
+{
+    FrameExportView View;
+    if (!Reconnect() || !m_Reader.Acquire(View))
+    {
+        return false;
+    }
+
+    const FrameExportSlot& Slot = *View.pSlot;
+    Frame.pPixels = View.pPixels;
+    Frame.Width = Slot.Width;
+    Frame.Height = Slot.Height;
+    Frame.Pitch = Slot.Pitch;
+    Frame.Format = Slot.Format;
+    Frame.Sequence = View.Sequence;
+    Frame.FrameNumber = Slot.FrameNumber;
+    Frame.PresentTime = Slot.PresentTime;
+    Frame.AcquireTime = Slot.AcquireTime;
+    Frame.PublishTime = Slot.PublishTime;
+    Frame.Missed = View.Missed;
+    Frame.Damage = View.Damage;
+    Frame.DirtyRectCount = View.DirtyRectCount;
+    Frame.pDirtyRects = View.pDirtyRects;
+    return true;
+}
+
+bool SharedMemoryTransport::Wait(uint32_t TimeoutMs)
+{
+    auto Deadline = chrono::steady_clock::now() + chrono::milliseconds(TimeoutMs);
+
+    for (;;)
+    {
+        // The reader's wait ends early when its writer goes away
+        auto Now = chrono::steady_clock::now();
+        uint32_t Remaining = Now < Deadline ? static_cast<uint32_t>(chrono::duration_cast<chrono::milliseconds>(Deadline - Now).count()) : 0;
+        bool Connected = Reconnect();
+        if (Connected && m_Reader.Wait(Remaining))
+        {
+            return true;
+        }
+
+        if (chrono::steady_clock::now() >= Deadline)
+        {
+            return false;
+        }
+        if (!Connected)
+        {
+            this_thread::sleep_for(chrono::milliseconds(min(Remaining, ReconnectMs)));
+        }
+    }
+}
+
+FrameView::FrameView(FrameView&& Other)
+    : m_pClient(Other.m_pClient), m_Frame(Other.m_Frame)
+{
+    Other.m_pClient = nullptr;
+}
+
+FrameView& FrameView::operator=(FrameView&& Other)
+{
+    if (this != &Other)
+    {
+        Reset();
+        m_pClient = Other.m_pClient;
+        m_Frame = Other.m_Frame;
+        Other.m_pClient = nullptr;
+    }
+    return *this;
+}
+
+void FrameView::Reset()
+{
+    if (m_pClient)
+    {
+        m_pClient->Release();
+        m_pClient = nullptr;
+    }
+}
+
+FrameClient::FrameClient(unique_ptr<IFrameTransport> Transport)
+    : m_Transport(move(Transport)), m_Holding(false), m_Statistics(), m_Stop(false)
+{
+}
+
+FrameClient::~FrameClient()
+{
+    Stop();
+
+    // A view still held would give its frame back through this client after it is gone
+    assert(!m_Holding);
+}
+
+unique_ptr<FrameClient> FrameClient::Connect(const char* Name)
+{
+    unique_ptr<SharedMemoryTransport> Transport(new SharedMemoryTransport());
+    if (!Transport->Open(Name))
+    {
+        return nullptr;
+    }
+
+    return unique_ptr<FrameClient>(new FrameClient(move(Transport)));
+}
+
+FrameView FrameClient::WaitFrame(uint32_t TimeoutMs)
+{
+    if (m_Holding)
+    {
+        lock_guard<mutex> Lock(m_StatisticsLock);
+        m_Statistics.Refused++;
+        return FrameView();
+    }
+
+    FrameView View = Take();
+    if (View)
+    {
+        return View;
+    }
+
+    // A wake-up whose frame is gone again by the time it is taken is no timeout
+    if (!m_Transport->Wait(TimeoutMs))
+    {
+        lock_guard<mutex> Lock(m_StatisticsLock);
+        m_Statistics.WaitTimeouts++;
+        return View;
+    }
+    return Take();
+}
+
+FrameView FrameClient::TryFrame()
+{
+    if (m_Holding)
+    {
+        lock_guard<mutex> Lock(m_StatisticsLock);
+        m_Statistics.Refused++;
+        return FrameView();
+    }
+
+    return Take();
+}
+
+FrameView FrameClient::Take()
+{
+    ClientFrame Frame;
+    if (!m_Transport->Acquire(Frame))
+    {
+        return FrameView();
+    }
+
+    {
+        lock_guard<mutex> Lock(m_StatisticsLock);
+        m_Statistics.FramesReceived++;
+        m_Statistics.FramesMissed += Frame.Missed;
+        m_Statistics.LongestMiss = max(m_Statistics.LongestMiss, Frame.Missed);
+    }
+
+    m_Holding = true;
+    return FrameView(this, Frame);
+}
+
+void FrameClient::Release()
+{
+    m_Transport->Release();
+    m_Holding = false;
+}
+
+bool FrameClient::Start(Callback Handler)
+{
+    if (m_Thread.joinable() || !Handler)
+    {
+        return false;
+    }
+
+    m_Stop = false;
+    m_Thread = thread(&FrameClient::CallbackThread, this, move(Handler));
+    return true;
+}
+
+void FrameClient::Stop()
+{
+    if (m_Thread.joinable())
+    {
+        m_Stop = true;
+        m_Thread.join();
+    }
+}
+
+void FrameClient::CallbackThread(Callback Handler)
+{
+    while (!m_Stop)
+    {
+        if (!m_Transport->Wait(CallbackWaitMs))
+        {
+            continue;
+        }
+
+        FrameView View = Take();
+        if (View)
+        {
+            Handler(View);
+        }
+    }
+}
+
+ClientStatistics FrameClient::Statistics() const
+{
+    lock_guard<mutex> Lock(m_StatisticsLock);
+    return m_Statistics;
+}
@@ -0,0 +1,204 @@
+/*++
+
+Module Name:
+
+    frame_client.h
+
+Abstract:
+
+    This module contains the frame client library, through which consumers receive the frames the driver
+    exports. A client reads frames in one of three styles: blocking in WaitFrame, polling with TryFrame, or
+    receiving them in a callback on a thread of its own. Frames are views of the producer's memory, released when
+    the view goes out of scope.
+
+    Where the frames come from is up to an IFrameTransport: SharedMemoryTransport reads the driver's frame export
+    region, or any other region a FrameExportWriter publishes into, which lets a local producer stand in for the
+    driver.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../pipeline/frame_export.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// A frame as a transport delivers it. The pixels and rectangles belong to the transport.
+        /// </summary>
+        struct ClientFrame
+        {
+            const uint8_t* pPixels;
+            uint32_t Width;
+            uint32_t Height;
+            uint32_t Pitch;
+            PixelFormat Format;
+
+            uint64_t Sequence;          // counts every frame the producer published, from 1
+            uint64_t FrameNumber;       // as in Frame
+            uint64_t PresentTime;       // MonotonicNanoseconds; 0 if unknown
+            uint64_t AcquireTime;
+            uint64_t PublishTime;
+
+            uint64_t Missed;            // frames published since the previous one the client received
+            DamageState Damage;         // relative to that frame
+            uint32_t DirtyRectCount;
+            const Rect* pDirtyRects;
+        };
+
+        /// <summary>
+        /// Where a client's frames come from. A transport holds at most one frame at a time.
+        /// </summary>
+        class IFrameTransport
+        {
+        public:
+            virtual ~IFrameTransport() = default;
+
+            // Takes the newest frame if it is newer than the last one taken, giving that one back
+            virtual bool Acquire(ClientFrame& Frame) = 0;
+
+            // Gives the frame taken last back to the producer
+            virtual void Release() = 0;
+
+            // Waits until a frame newer than the last one taken is available; false on timeout
+            virtual bool Wait(uint32_t TimeoutMs) = 0;
+        };
+
+        /// <summary>
+        /// Reads a frame export region through a FrameExportReader. When the writer of a named region goes away or
+        /// is replaced, e.g. because the driver restarted, the transport opens the region again as soon as it has
+        /// a writer; sequence numbers then start again from 1, and the first frame has Full damage.
+        /// </summary>
+        class SharedMemoryTransport : public IFrameTransport
+        {
+        public:
+            // Maps the named region; fails if there is none or every reader slot of it is taken
+            bool Open(const char* Name = FrameExportName);
+
+            // Reads a region and its control words in local memory
+            bool Attach(const void* pRegion, size_t Size, FrameExportControl* pControl);
+
+            bool Acquire(ClientFrame& Frame) override;
+            void Release() override { m_Reader.Release(); }
+            bool Wait(uint32_t TimeoutMs) override;
+
+        private:
+            bool Reconnect();
+
+            FrameExportReader m_Reader;
+            std::string m_Name;         // empty for a region in local memory, which cannot be opened again
+        };
+
+        /// <summary>
+        /// What a client received, and what it never saw.
+        /// </summary>
+        struct ClientStatistics
+        {
+            uint64_t FramesReceived;
+            uint64_t FramesMissed;      // published while the client was busy, and replaced before it asked again
+            uint64_t LongestMiss;       // most frames missed in a row
+            uint64_t WaitTimeouts;
+            uint64_t Refused;           // requests made while a view was still held
+        };
+
+        class FrameClient;
+
+        /// <summary>
+        /// A frame held by a client. Move-only; gives the frame back to the producer when destroyed or reset.
+        /// An empty view converts to false. A view points at its client, so it must be reset or destroyed before
+        /// the client is.
+        /// </summary>
+        class FrameView
+        {
+        public:
+            FrameView() : m_pClient(nullptr), m_Frame() {}
+            FrameView(FrameView&& Other);
+            FrameView& operator=(FrameView&& Other);
+            ~FrameView() { Reset(); }
+
+            FrameView(const FrameView&) = delete;
+            FrameView& operator=(const FrameView&) = delete;
+
+            explicit operator bool() const { return m_pClient != nullptr; }
+
+            void Reset();
+
+            const ClientFrame& Frame() const { return m_Frame; }
+            const uint8_t* Pixels() const { return m_Frame.pPixels; }
+            uint32_t Width() const { return m_Frame.Width; }
+            uint32_t Height() const { return m_Frame.Height; }
+            uint32_t Pitch() const { return m_Frame.Pitch; }
+
+        private:
+            friend class FrameClient;
+
+            FrameView(FrameClient* pClient, const ClientFrame& Frame) : m_pClient(pClient), m_Frame(Frame) {}
+
+            FrameClient* m_pClient;
+            ClientFrame m_Frame;
+        };
+
+        /// <summary>
+        /// Receives frames from a transport. One view may be held at a time: asking for another while one is held
+        /// returns an empty view. Either poll or wait from one thread, or start the callback thread; not both.
+        /// No view may outlive the client.
+        /// </summary>
+        class FrameClient
+        {
+        public:
+            typedef std::function<void(const FrameView& View)> Callback;
+
+            explicit FrameClient(std::unique_ptr<IFrameTransport> Transport);
+            ~FrameClient();
+
+            FrameClient(const FrameClient&) = delete;
+            FrameClient& operator=(const FrameClient&) = delete;
+
+            // Attaches to the driver's frame export, or another named region; nullptr if there is none
+            static std::unique_ptr<FrameClient> Connect(const char* Name = FrameExportName);
+
+            // The next frame newer than the last one received, waiting up to TimeoutMs for it
+            FrameView WaitFrame(uint32_t TimeoutMs);
+
+            // The newest frame if it is newer than the last one received, without waiting
+            FrameView TryFrame();
+
+            // Calls Handler with every new frame on a thread of the client's own, until Stop. The view is released
+            // when Handler returns.
+            bool Start(Callback Handler);
+            void Stop();
+
+            ClientStatistics Statistics() const;
+
+        private:
+            friend class FrameView;
+
+            FrameView Take();
+            void Release();
+            void CallbackThread(Callback Handler);
+
+            std::unique_ptr<IFrameTransport> m_Transport;
+            bool m_Holding;
+
+            mutable std::mutex m_StatisticsLock;
+            ClientStatistics m_Statistics;
+
+            std::atomic<bool> m_Stop;
+            std::thread m_Thread;
+        };
+    }
+}
@@ -0,0 +1,138 @@
+/*++
+
+Module Name:
+
+    idd_client.cpp
+
+Abstract:
+
+    This module contains the C interface of the frame client library.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "idd_client.h"
+
+#include "frame_client.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+static_assert(sizeof(IddRect) == sizeof(Rect), "dirty rectangles are handed out as they are");
+static_assert(IDD_DAMAGE_PARTIAL == static_cast<uint32_t>(DamageState::Partial), "damage values match");
+static_assert(IDD_DAMAGE_FULL == static_cast<uint32_t>(DamageState::Full), "damage values match");
+static_assert(IDD_FORMAT_BGRA8 == static_cast<uint32_t>(PixelFormat::Bgra8), "format values match");
+static_assert(IDD_FORMAT_NV12 == static_cast<uint32_t>(PixelFormat::Nv12), "format values match");
+static_assert(IDD_FORMAT_I420 == static_cast<uint32_t>(PixelFormat::I420), "format values match");
+static_assert(IDD_FORMAT_I444 == static_cast<uint32_t>(PixelFormat::I444), "format values match");
+static_assert(IDD_FORMAT_I444_SPLIT == static_cast<uint32_t>(PixelFormat::I444Split), "format values match");
+
+struct IddClient
+{
+    unique_ptr<FrameClient> Client;
+    FrameView View;
+};
+
+namespace
+{
+    void ToIddFrame(const ClientFrame& Frame, IddFrame* pFrame)
+    {
+        pFrame->Pixels = Frame.pPixels;
+        pFrame->Width = Frame.Width;
+        pFrame->Height = Frame.Height;
+        pFrame->Pitch = Frame.Pitch;
+        pFrame->Format = static_cast<uint32_t>(Frame.Format);
+        pFrame->Sequence = Frame.Sequence;
+        pFrame->FrameNumber = Frame.FrameNumber;
+        pFrame->PresentTime = Frame.PresentTime;
+        pFrame->AcquireTime = Frame.AcquireTime;
+        pFrame->PublishTime = Frame.PublishTime;
+        pFrame->Missed = Frame.Missed;
+        pFrame->Damage = static_cast<uint32_t>(Frame.Damage);
+        pFrame->DirtyRectCount = Frame.DirtyRectCount;
+        pFrame->DirtyRects = reinterpret_cast<const IddRect*>(Frame.pDirtyRects);
+    }
+
+    int Hold(IddClient* pClient, FrameView View, IddFrame* pFrame)
+    {
+        if (!View)
+        {
+            return 0;
+        }
+
+        ToIddFrame(View.Frame(), pFrame);
+        pClient->View = move(View);
+        return 1;
+    }
+}
+
+extern "C" IddClient* IddClientOpen(const char* Name)
+{
+    unique_ptr<FrameClient> Client = FrameClient::Connect(Name ? Name : FrameExportName);
+    if (!Client)
+    {
+        return nullptr;
+    }
+
+    IddClient* pClient = new IddClient();
+    pClient->Client = move(Client);
+    return pClient;
+}
+
+extern "C" void IddClientClose(IddClient* pClient)
+{
+    if (pClient)
+    {
+        pClient->Client->Stop();
+        pClient->View.Reset();
+        delete pClient;
+    }
+}
+
+extern "C" int IddClientWaitFrame(IddClient* pClient, uint32_t TimeoutMs, IddFrame* pFrame)
+{
+    return Hold(pClient, pClient->Client->WaitFrame(TimeoutMs), pFrame);
+}
+
+extern "C" int IddClientPollFrame(IddClient* pClient, IddFrame* pFrame)
+{
+    return Hold(pClient, pClient->Client->TryFrame(), pFrame);
+}
+
+extern "C" void IddClientReleaseFrame(IddClient* pClient)
+{
+    pClient->View.Reset();
+}
+
+extern "C" int IddClientStart(IddClient* pClient, IddFrameCallback Callback, void* Context)
+{
+    if (!Callback)
+    {
+        return 0;
+    }
+
+    return pClient->Client->Start([Callback, Context](const FrameView& View)
+    {
+        IddFrame Frame;
+        ToIddFrame(View.Frame(), &Frame);
+        Callback(&Frame, Context);
+    }) ? 1 : 0;
+}
+
+extern "C" void IddClientStop(IddClient* pClient)
+{
+    pClient->Client->Stop();
+}
+
+extern "C" void IddClientGetStatistics(const IddClient* pClient, IddClientStatistics* pStatistics)
+{
+    ClientStatistics Statistics = pClient->Client->Statistics();
+    pStatistics->FramesReceived = Statistics.FramesReceived;
+    pStatistics->FramesMissed = Statistics.FramesMissed;
+    pStatistics->LongestMiss = Statistics.LongestMiss;
+    pStatistics->WaitTimeouts = Statistics.WaitTimeouts;
+    pStatistics->Refused = Statistics.Refused;
+}
@@ -0,0 +1,107 @@
+/*++
+
+Module Name:
+
+    idd_client.h
+
+Abstract:
+
+    This module contains the C interface of the frame client library, for consumers that are not written in C++.
+    It wraps a FrameClient: a client holds at most one frame at a time, which it gives back to the driver with
+    IddClientReleaseFrame, or when the callback it was delivered to returns.
+
+Environment:
+
+    User Mode, C or C++
+
+--*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct IddClient IddClient;
+
+// Damage of a frame relative to the previous one the client received, as DamageState
+#define IDD_DAMAGE_UNKNOWN  0       // treat every pixel as changed
+#define IDD_DAMAGE_FULL     1
+#define IDD_DAMAGE_PARTIAL  2       // only the dirty rectangles changed
+
+// Pixel format of a frame, as PixelFormat. Every plane follows the one before it in Pixels without a gap; Pitch
+// is the pitch of the first plane, which may be wider than its rows, and H stands for Height.
+#define IDD_FORMAT_BGRA8        1   // H rows of 4-byte B, G, R, A pixels
+#define IDD_FORMAT_NV12         2   // Y: H rows; then UV: (H + 1) / 2 rows of interleaved U, V pairs, also at Pitch
+#define IDD_FORMAT_I420         3   // Y: H rows; then U and V: (H + 1) / 2 rows each at Pitch / 2
+#define IDD_FORMAT_I444         4   // Y, U and V: H rows each, all at Pitch
+#define IDD_FORMAT_I444_SPLIT   5   // two I420 pictures, the second at Pitch * (H + (H + 1) / 2): the first is the
+                                    // 4:2:0 main view, whose chroma is the 4:4:4 sample at each even column and row;
+                                    // the second the residual, whose Y plane holds the odd chroma rows (all U rows,
+                                    // then all V rows) and whose U and V planes the odd columns of the even rows
+
+typedef struct IddRect
+{
+    int32_t Left;
+    int32_t Top;
+    int32_t Right;
+    int32_t Bottom;
+} IddRect;
+
+typedef struct IddFrame
+{
+    const uint8_t* Pixels;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Pitch;
+    uint32_t Format;            // IDD_FORMAT_*
+
+    uint64_t Sequence;
+    uint64_t FrameNumber;
+    uint64_t PresentTime;       // nanoseconds of the monotonic clock; 0 if unknown
+    uint64_t AcquireTime;
+    uint64_t PublishTime;
+
+    uint64_t Missed;
+    uint32_t Damage;
+    uint32_t DirtyRectCount;
+    const IddRect* DirtyRects;
+} IddFrame;
+
+typedef struct IddClientStatistics
+{
+    uint64_t FramesReceived;
+    uint64_t FramesMissed;
+    uint64_t LongestMiss;
+    uint64_t WaitTimeouts;
+    uint64_t Refused;
+} IddClientStatistics;
+
+typedef void (*IddFrameCallback)(const IddFrame* Frame, void* Context);
+
+// Attaches to the named frame export, or the driver's when Name is NULL; NULL if there is none
+IddClient* IddClientOpen(const char* Name);
+
+// Stops the callback thread and releases the frame held, if any
+void IddClientClose(IddClient* Client);
+
+// Returns 1 and fills Frame with the next new frame, waiting up to TimeoutMs for one; 0 on timeout, or while a
+// frame is still held
+int IddClientWaitFrame(IddClient* Client, uint32_t TimeoutMs, IddFrame* Frame);
+
+// As IddClientWaitFrame, without waiting
+int IddClientPollFrame(IddClient* Client, IddFrame* Frame);
+
+void IddClientReleaseFrame(IddClient* Client);
+
+// Calls Callback with every new frame on a thread of the client's own until IddClientStop; 0 if already started
+int IddClientStart(IddClient* Client, IddFrameCallback Callback, void* Context);
+void IddClientStop(IddClient* Client);
+
+void IddClientGetStatistics(const IddClient* Client, IddClientStatistics* Statistics);
+
+#ifdef __cplusplus
+}
+#endif
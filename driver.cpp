@@ -42,39 +42,17 @@ EVT_IDD_CX_MONITOR_UNASSIGN_SWAPCHAIN EventMonitorUnassignSwapChain;
 
 #pragma region Logger
 
-//#define VERBOSE_LOG
-
-FILE* LogFile = NULL;
-
 void OpenLogFile()
 {
 #ifdef VERBOSE_LOG
-    LogFile = fopen("D:\\WinVirtualDisplay.log", "w");
+    BinaryLog::Open(IDD_LOG_PATH);
 #endif // VERBOSE_LOG
 }
 
 void CloseLogFile()
 {
 #ifdef VERBOSE_LOG
-    fclose(LogFile);
-#endif // VERBOSE_LOG
-}
-
-void WriteLogFile(char* fmt, ...)
-{
-#ifdef VERBOSE_LOG
-    va_list args = NULL;
-    va_start(args, fmt);
-    size_t length = _vscprintf(fmt, args) + 1;
-    char* line = new char[length];
-    _vsnprintf_s(line, length, length, fmt, args);
-    va_end(args);
-
-    line[length - 1] = '\n';
-    fwrite(line, length, sizeof(char), LogFile);
-    fflush(LogFile);
-    
-    delete[] line;
+    BinaryLog::Close();
 #endif // VERBOSE_LOG
 }
 
@@ -86,7 +64,7 @@ struct IndirectDeviceContextWrapper
 
     void Cleanup()
     {
-        WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+        IDD_LOG_TRACE("");
 
         delete pContext;
         pContext = nullptr;
@@ -134,7 +112,7 @@ extern "C" NTSTATUS DriverEntry(
 
     OpenLogFile();
 
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     return Status;
 }
@@ -142,7 +120,7 @@ extern "C" NTSTATUS DriverEntry(
 _Use_decl_annotations_
 NTSTATUS EventDeviceAdd(WDFDRIVER Driver, PWDFDEVICE_INIT pDeviceInit)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     NTSTATUS Status = STATUS_SUCCESS;
     WDF_PNPPOWER_EVENT_CALLBACKS PnpPowerCallbacks;
@@ -207,7 +185,7 @@ NTSTATUS EventDeviceAdd(WDFDRIVER Driver, PWDFDEVICE_INIT pDeviceInit)
     DECLARE_CONST_UNICODE_STRING(symbolicLink, L"\\DosDevices\\Global\\WinVirtualDisplay");
     WdfDeviceCreateSymbolicLink(Device, &symbolicLink);
 
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     return Status;
 }
@@ -215,7 +193,7 @@ NTSTATUS EventDeviceAdd(WDFDRIVER Driver, PWDFDEVICE_INIT pDeviceInit)
 _Use_decl_annotations_
 NTSTATUS EventDeviceD0Entry(WDFDEVICE Device, WDF_POWER_DEVICE_STATE PreviousState)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     UNREFERENCED_PARAMETER(PreviousState);
 
@@ -231,7 +209,7 @@ NTSTATUS EventDeviceD0Entry(WDFDEVICE Device, WDF_POWER_DEVICE_STATE PreviousSta
 
 Direct3DDevice::Direct3DDevice(LUID AdapterLuid) : AdapterLuid(AdapterLuid)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 }
 
 //Direct3DDevice::Direct3DDevice()
@@ -241,7 +219,7 @@ Direct3DDevice::Direct3DDevice(LUID AdapterLuid) : AdapterLuid(AdapterLuid)
 
 HRESULT Direct3DDevice::Init()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     // The DXGI factory could be cached, but if a new render adapter appears on the system, a new factory needs to be
     // created. If caching is desired, check DxgiFactory->IsCurrent() each time and recreate the factory if !IsCurrent.
@@ -272,12 +250,305 @@ HRESULT Direct3DDevice::Init()
 
 #pragma endregion
 
+#pragma region IddSwapChainSource
+
+IddSwapChainSource::IddSwapChainSource(IDDCX_SWAPCHAIN hSwapChain, shared_ptr<Direct3DDevice> Device, HANDLE NewFrameEvent, HANDLE TerminateEvent)
+    : m_hSwapChain(hSwapChain), m_Device(Device), m_hAvailableBufferEvent(NewFrameEvent), m_hTerminateEvent(TerminateEvent)
+    , m_StagingDesc()
+{
+    QueryPerformanceFrequency(&m_QpcFrequency);
+}
+
+bool IddSwapChainSource::Initialize()
+{
+    IDD_LOG_TRACE("");
+
+    // Get the DXGI device interface
+    ComPtr<IDXGIDevice> DxgiDevice;
+    HRESULT hr = m_Device->Device.As(&DxgiDevice);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+
+    IDARG_IN_SWAPCHAINSETDEVICE SetDevice = {};
+    SetDevice.pDevice = DxgiDevice.Get();
+
+    hr = IddCxSwapChainSetDevice(m_hSwapChain, &SetDevice);
+    return SUCCEEDED(hr);
+}
+
+AcquireStatus IddSwapChainSource::ReleaseAndAcquire(Frame& Frame)
+{
+    m_AcquiredBuffer.Reset();
+
+    // Ask for the next buffer from the producer
+    IDARG_OUT_RELEASEANDACQUIREBUFFER Buffer = {};
+    HRESULT hr = IddCxSwapChainReleaseAndAcquireBuffer(m_hSwapChain, &Buffer);
+
+    // AcquireBuffer immediately returns STATUS_PENDING if no buffer is yet available
+    if (hr == E_PENDING)
+    {
+        return AcquireStatus::Pending;
+    }
+    else if (FAILED(hr))
+    {
+        // The swap-chain was likely abandoned (e.g. DXGI_ERROR_ACCESS_LOST)
+        return AcquireStatus::Failed;
+    }
+
+    m_AcquiredBuffer.Attach(Buffer.MetaData.pSurface);
+
+    Frame.FrameNumber = Buffer.MetaData.PresentationFrameNumber;
+    Frame.pSurface = m_AcquiredBuffer.Get();
+
+    // steady_clock is backed by QueryPerformanceCounter, so the present time converts into the pipeline's clock
+    UINT64 Qpc = Buffer.MetaData.PresentDisplayQPCTime;
+    UINT64 Frequency = static_cast<UINT64>(m_QpcFrequency.QuadPart);
+    if (Qpc != 0 && Frequency != 0)
+    {
+        Frame.PresentTime = (Qpc / Frequency) * 1000000000ull + (Qpc % Frequency) * 1000000000ull / Frequency;
+    }
+
+    ComPtr<ID3D11Texture2D> Texture;
+    if (SUCCEEDED(m_AcquiredBuffer.As(&Texture)))
+    {
+        D3D11_TEXTURE2D_DESC Desc;
+        Texture->GetDesc(&Desc);
+
+        Frame.Width = Desc.Width;
+        Frame.Height = Desc.Height;
+        Frame.Format = (Desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM) ? PixelFormat::Bgra8 : PixelFormat::Unknown;
+    }
+
+    ReadDamage(Buffer.MetaData, Frame);
+
+    return AcquireStatus::Acquired;
+}
+
+void IddSwapChainSource::ReadDamage(const IDDCX_METADATA& MetaData, Frame& Frame)
+{
+    // Without regions from the OS the damage stays Unknown, and the pipeline falls back to change detection
+    m_Damage.Reset(DamageState::Unknown);
+
+    if ((MetaData.DirtyRectCount == 0 && MetaData.MoveRegionCount == 0) || Frame.Width == 0 || Frame.Height == 0)
+    {
+        m_Damage.Publish(Frame);
+        return;
+    }
+
+    m_Damage.Reset(DamageState::Partial);
+
+    if (MetaData.DirtyRectCount != 0)
+    {
+        m_DirtyRegions.resize(MetaData.DirtyRectCount);
+
+        IDARG_IN_GETDIRTYRECTS InArgs = {};
+        InArgs.DirtyRectInCount = static_cast<UINT>(m_DirtyRegions.size());
+        InArgs.pDirtyRects = m_DirtyRegions.data();
+
+        IDARG_OUT_GETDIRTYRECTS OutArgs = {};
+        if (FAILED(IddCxSwapChainGetDirtyRects(m_hSwapChain, &InArgs, &OutArgs)))
+        {
+            m_Damage.Reset(DamageState::Unknown);
+            m_Damage.Publish(Frame);
+            return;
+        }
+
+        for (UINT i = 0; i < OutArgs.DirtyRectOutCount && i < InArgs.DirtyRectInCount; i++)
+        {
+            const RECT& Region = m_DirtyRegions[i];
+            m_Damage.AddDirtyRect({ Region.left, Region.top, Region.right, Region.bottom });
+        }
+    }
+
+    if (MetaData.MoveRegionCount != 0)
+    {
+        m_MoveRegions.resize(MetaData.MoveRegionCount);
+
+        IDARG_IN_GETMOVEREGIONS InArgs = {};
+        InArgs.MoveRegionInCount = static_cast<UINT>(m_MoveRegions.size());
+        InArgs.pMoveRegions = m_MoveRegions.data();
+
+        IDARG_OUT_GETMOVEREGIONS OutArgs = {};
+        if (FAILED(IddCxSwapChainGetMoveRegions(m_hSwapChain, &InArgs, &OutArgs)))
+        {
+            m_Damage.Reset(DamageState::Unknown);
+            m_Damage.Publish(Frame);
+            return;
+        }
+
+        for (UINT i = 0; i < OutArgs.MoveRegionOutCount && i < InArgs.MoveRegionInCount; i++)
+        {
+            const IDDCX_MOVEREGION& Region = m_MoveRegions[i];
+            m_Damage.AddMoveRect({ Region.SourcePoint.x, Region.SourcePoint.y,
+                { Region.DestRect.left, Region.DestRect.top, Region.DestRect.right, Region.DestRect.bottom } });
+        }
+    }
+
+    m_Damage.Normalize(Frame.Width, Frame.Height);
+    m_Damage.Publish(Frame);
+}
+
+WaitStatus IddSwapChainSource::WaitForFrame(uint32_t TimeoutMs)
+{
+    // We must wait for a new buffer
+    HANDLE WaitHandles[] =
+    {
+        m_hAvailableBufferEvent,
+        m_hTerminateEvent
+    };
+    static_assert(FramePacer::WaitForever == INFINITE, "the pacer's infinite timeout must map to INFINITE");
+    DWORD WaitResult = WaitForMultipleObjects(ARRAYSIZE(WaitHandles), WaitHandles, FALSE, TimeoutMs);
+    if (WaitResult == WAIT_OBJECT_0)
+    {
+        return WaitStatus::NewFrame;
+    }
+    else if (WaitResult == WAIT_TIMEOUT)
+    {
+        return WaitStatus::Timeout;
+    }
+    else if (WaitResult == WAIT_OBJECT_0 + 1)
+    {
+        return WaitStatus::Terminate;
+    }
+    else
+    {
+        // The wait was cancelled or something unexpected happened
+        return WaitStatus::Failed;
+    }
+}
+
+bool IddSwapChainSource::FinishedProcessing()
+{
+    m_AcquiredBuffer.Reset();
+
+    HRESULT hr = IddCxSwapChainFinishedProcessingFrame(m_hSwapChain);
+
+    // Frame statistics are reported by ReportFrame once the pipeline is done with the frame, which may be after this
+    return SUCCEEDED(hr);
+}
+
+void IddSwapChainSource::ReportFrame(const FrameTimeline& Timeline)
+{
+    // Skipped frames are reported by the acquire thread while the processing thread may be reporting another, so
+    // only processed frames use m_Steps
+    bool Processed = Timeline.ProcessStartTime != 0;
+    if (Processed)
+    {
+        m_Steps.clear();
+
+        // The stages are the encode, the sink is the send; each stage also gets a private step of its own
+        uint64_t EncodeEnd = Timeline.AnalysisEndTime;
+        for (uint32_t i = 0; i < Timeline.StageCount; i++)
+        {
+            IDDCX_FRAME_STATISTICS_STEP Step = {};
+            Step.Size = sizeof(Step);
+            Step.Type = static_cast<IDDCX_FRAME_STATISTICS_STEP_TYPE>(IDDCX_FRAME_STATISTICS_STEP_TYPE_PRIVATE_DRIVER_DATA + i);
+            Step.QpcTime = ToQpc(Timeline.pStageEndTimes[i]);
+            m_Steps.push_back(Step);
+
+            EncodeEnd = Timeline.pStageEndTimes[i];
+        }
+
+        const pair<IDDCX_FRAME_STATISTICS_STEP_TYPE, uint64_t> Milestones[] =
+        {
+            { IDDCX_FRAME_STATISTICS_STEP_TYPE_ENCODE_START, Timeline.ProcessStartTime },
+            { IDDCX_FRAME_STATISTICS_STEP_TYPE_ENCODE_END, EncodeEnd },
+            { IDDCX_FRAME_STATISTICS_STEP_TYPE_SEND_START, EncodeEnd },
+            { IDDCX_FRAME_STATISTICS_STEP_TYPE_SEND_COMPLETE, Timeline.FinishTime },
+        };
+
+        // A dropped frame was never sent
+        size_t MilestoneCount = Timeline.Dropped ? 2 : ARRAYSIZE(Milestones);
+        for (size_t i = 0; i < MilestoneCount; i++)
+        {
+            IDDCX_FRAME_STATISTICS_STEP Step = {};
+            Step.Size = sizeof(Step);
+            Step.Type = Milestones[i].first;
+            Step.QpcTime = ToQpc(Milestones[i].second);
+            m_Steps.push_back(Step);
+        }
+    }
+
+    IDARG_IN_REPORTFRAMESTATISTICS Args = {};
+    Args.FrameStatistics.Size = sizeof(Args.FrameStatistics);
+    Args.FrameStatistics.PresentationFrameNumber = static_cast<UINT>(Timeline.FrameNumber);
+    Args.FrameStatistics.FrameStatus = Timeline.Dropped ? IDDCX_FRAME_STATUS_DROPPED : IDDCX_FRAME_STATUS_COMPLETED;
+    Args.FrameStatistics.FrameAcquireQpcTime = ToQpc(Timeline.AcquireTime);
+    Args.FrameStatistics.FrameProcessingStepsCount = Processed ? static_cast<UINT>(m_Steps.size()) : 0;
+    Args.FrameStatistics.pFrameProcessingStep = Processed ? m_Steps.data() : nullptr;
+
+    IddCxSwapChainReportFrameStatistics(m_hSwapChain, &Args);
+}
+
+UINT64 IddSwapChainSource::ToQpc(uint64_t Nanoseconds) const
+{
+    // The inverse of the present time conversion in ReleaseAndAcquire
+    UINT64 Frequency = static_cast<UINT64>(m_QpcFrequency.QuadPart);
+    return (Nanoseconds / 1000000000ull) * Frequency + (Nanoseconds % 1000000000ull) * Frequency / 1000000000ull;
+}
+
+bool IddSwapChainSource::MapFrame(Frame& Frame)
+{
+    ComPtr<ID3D11Texture2D> Texture;
+    HRESULT hr = m_AcquiredBuffer.As(&Texture);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+
+    D3D11_TEXTURE2D_DESC Desc;
+    Texture->GetDesc(&Desc);
+
+    if (!m_StagingTexture || Desc.Width != m_StagingDesc.Width || Desc.Height != m_StagingDesc.Height || Desc.Format != m_StagingDesc.Format)
+    {
+        m_StagingTexture.Reset();
+
+        m_StagingDesc = Desc;
+        m_StagingDesc.MipLevels = 1;
+        m_StagingDesc.ArraySize = 1;
+        m_StagingDesc.Usage = D3D11_USAGE_STAGING;
+        m_StagingDesc.BindFlags = 0;
+        m_StagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        m_StagingDesc.MiscFlags = 0;
+
+        hr = m_Device->Device->CreateTexture2D(&m_StagingDesc, nullptr, &m_StagingTexture);
+        if (FAILED(hr))
+        {
+            return false;
+        }
+    }
+
+    // A GPU copy to a staging surface, then map it so the pipeline can read the pixels
+    m_Device->DeviceContext->CopyResource(m_StagingTexture.Get(), Texture.Get());
+
+    D3D11_MAPPED_SUBRESOURCE Mapped;
+    hr = m_Device->DeviceContext->Map(m_StagingTexture.Get(), 0, D3D11_MAP_READ, 0, &Mapped);
+    if (FAILED(hr))
+    {
+        return false;
+    }
+
+    Frame.pData = static_cast<uint8_t*>(Mapped.pData);
+    Frame.Pitch = Mapped.RowPitch;
+    return true;
+}
+
+void IddSwapChainSource::UnmapFrame(Frame& Frame)
+{
+    m_Device->DeviceContext->Unmap(m_StagingTexture.Get(), 0);
+    Frame.pData = nullptr;
+}
+
+#pragma endregion
+
 #pragma region SwapChainProcessor
 
-SwapChainProcessor::SwapChainProcessor(IDDCX_SWAPCHAIN hSwapChain, shared_ptr<Direct3DDevice> Device, HANDLE NewFrameEvent)
-    : m_hSwapChain(hSwapChain), m_Device(Device), m_hAvailableBufferEvent(NewFrameEvent)
+SwapChainProcessor::SwapChainProcessor(IDDCX_SWAPCHAIN hSwapChain, shared_ptr<Direct3DDevice> Device, HANDLE NewFrameEvent, shared_ptr<FrameBufferPool> FramePool, shared_ptr<WorkerPool> WorkerPool, shared_ptr<FrameTracer> Tracer, shared_ptr<MetricsRegistry> Metrics, shared_ptr<StatsPublisher> Stats, shared_ptr<FrameExportWriter> FrameExport, DISPLAYCONFIG_RATIONAL RefreshRate)
+    : m_hSwapChain(hSwapChain), m_Device(Device), m_hAvailableBufferEvent(NewFrameEvent), m_FramePool(FramePool), m_WorkerPool(WorkerPool), m_Tracer(Tracer), m_Metrics(Metrics), m_Stats(Stats), m_FrameExport(FrameExport), m_RefreshRate(RefreshRate)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     m_hTerminateEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
 
@@ -287,7 +558,7 @@ SwapChainProcessor::SwapChainProcessor(IDDCX_SWAPCHAIN hSwapChain, shared_ptr<Di
 
 SwapChainProcessor::~SwapChainProcessor()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     // Alert the swap-chain processing thread to terminate
     SetEvent(m_hTerminateEvent.Get());
@@ -301,7 +572,7 @@ SwapChainProcessor::~SwapChainProcessor()
 
 DWORD CALLBACK SwapChainProcessor::RunThread(LPVOID Argument)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     reinterpret_cast<SwapChainProcessor*>(Argument)->Run();
     return 0;
@@ -309,7 +580,7 @@ DWORD CALLBACK SwapChainProcessor::RunThread(LPVOID Argument)
 
 void SwapChainProcessor::Run()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     // For improved performance, make use of the Multimedia Class Scheduler Service, which will intelligently
     // prioritize this thread for improved throughput in high CPU-load scenarios.
@@ -328,96 +599,78 @@ void SwapChainProcessor::Run()
 
 void SwapChainProcessor::RunCore()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
-    // Get the DXGI device interface
-    ComPtr<IDXGIDevice> DxgiDevice;
-    HRESULT hr = m_Device->Device.As(&DxgiDevice);
-    if (FAILED(hr))
-    {
-        return;
-    }
+    // The acquire/process/release loop itself is platform-neutral; only the swap-chain access is IddCx specific
+    IddSwapChainSource Source(m_hSwapChain, m_Device, m_hAvailableBufferEvent, m_hTerminateEvent.Get());
+    FramePipeline Pipeline(Source);
 
-    IDARG_IN_SWAPCHAINSETDEVICE SetDevice = {};
-    SetDevice.pDevice = DxgiDevice.Get();
+    // ==============================
+    // TODO: Add processing stages here, or replace the frame export sink below
+    //
+    // This is the most performance-critical section of code in an IddCx driver. It's important that whatever
+    // is done with the acquired surface be finished as quickly as possible. A stage could be:
+    //  * a GPU copy to another buffer surface for later processing (such as a staging surface for mapping to CPU memory)
+    //  * a GPU encode operation
+    //  * a rotation or flip for a portrait or mirrored monitor, added first so every later stage sees the oriented frame, e.g.
+    //    Pipeline.AddStage(std::make_shared<TransformStage>(FrameOrientation::Rotate90));
+    //  * a GPU VPBlt to another surface
+    //  * a GPU custom compute shader encode operation
+    //  * a CPU conversion to NV12 or I420 for a software encoder, e.g.
+    //    Pipeline.AddStage(std::make_shared<ColorConvertStage>(PixelFormat::Nv12, ColorMatrix::Bt709, ColorRange::Limited));
+    //    or, for monitors that show a lot of text, I444 / I444Split to keep full chroma at about twice the cost
+    //  * a lossless CPU encode for remote display, with tiles compressed across a worker pool, e.g.
+    //    Pipeline.AddStage(std::make_shared<EncodeStage>(std::make_shared<TileEncoder>(m_WorkerPool)));
+    //    (keep it last, so its delta frames match what the sink receives)
+    //
+    // A sink that may take longer than a refresh interval, such as a software encoder or a network sender, gets a
+    // thread of its own behind a BackpressureSink, so it skips frames (with their damage merged forward) instead
+    // of stalling the stages, e.g.
+    //    Pipeline.SetSink(std::make_shared<BackpressureSink>(Sender, BackpressurePolicy::LatestWins));
+    // Several consumers, e.g. a recorder, a streamer and a thumbnailer, share every frame through a FrameFanOut,
+    // each subscribed with a queue and policy of its own; the pixels are not copied for any of them. When they
+    // want different formats, a FormatCacheStage instead of a ColorConvertStage converts each frame only into the
+    // formats someone asks Frame.pFormats for, once however many ask, e.g.
+    //    Pipeline.AddStage(std::make_shared<FormatCacheStage>(Offered, ColorMatrix::Bt709, ColorRange::Limited));
+    // A lower-resolution simulcast or preview stream scales ahead of the cache, e.g.
+    //    Pipeline.AddStage(std::make_shared<ScaleStage>(1280, 720, ScaleFilter::Area));
+    // ==============================
 
-    hr = IddCxSwapChainSetDevice(m_hSwapChain, &SetDevice);
-    if (FAILED(hr))
+    // Publish every frame into the export region, where user-mode consumers read it in place. The writer never
+    // waits for its readers, so it needs no backpressure.
+    if (m_FrameExport->IsOpen())
     {
-        return;
+        Pipeline.SetSink(make_shared<FrameExportSink>(m_FrameExport));
     }
 
-    // Acquire and release buffers in a loop
-    for (;;)
-    {
-        ComPtr<IDXGIResource> AcquiredBuffer;
+    // Keep the acquire thread down to a copy and a hand-off; stages run on the shared worker pool so a slow frame
+    // never stalls the OS compositor. The acquire thread itself stays per monitor, since it blocks on the IddCx
+    // event and runs under MMCSS.
+    Pipeline.SetAsyncProcessing(3);
+    Pipeline.SetProcessingPool(m_WorkerPool);
+    Pipeline.SetBufferPool(m_FramePool);
 
-        // Ask for the next buffer from the producer
-        IDARG_OUT_RELEASEANDACQUIREBUFFER Buffer = {};
-        hr = IddCxSwapChainReleaseAndAcquireBuffer(m_hSwapChain, &Buffer);
+    // Turn scrolled and dragged content into move rectangles, so a sink copies it instead of encoding it again
+    Pipeline.SetMotionSearch(true);
 
-        // AcquireBuffer immediately returns STATUS_PENDING if no buffer is yet available
-        if (hr == E_PENDING)
-        {
-            // We must wait for a new buffer
-            HANDLE WaitHandles[] =
-            {
-                m_hAvailableBufferEvent,
-                m_hTerminateEvent.Get()
-            };
-            DWORD WaitResult = WaitForMultipleObjects(ARRAYSIZE(WaitHandles), WaitHandles, FALSE, 16);
-            if (WaitResult == WAIT_OBJECT_0 || WaitResult == WAIT_TIMEOUT)
-            {
-                // We have a new buffer, so try the AcquireBuffer again
-                continue;
-            }
-            else if (WaitResult == WAIT_OBJECT_0 + 1)
-            {
-                // We need to terminate
-                break;
-            }
-            else
-            {
-                // The wait was cancelled or something unexpected happened
-                hr = HRESULT_FROM_WIN32(WaitResult);
-                break;
-            }
-        }
-        else if (SUCCEEDED(hr))
-        {
-            AcquiredBuffer.Attach(Buffer.MetaData.pSurface);
-
-            // ==============================
-            // TODO: Process the frame here
-            //
-            // This is the most performance-critical section of code in an IddCx driver. It's important that whatever
-            // is done with the acquired surface be finished as quickly as possible. This operation could be:
-            //  * a GPU copy to another buffer surface for later processing (such as a staging surface for mapping to CPU memory)
-            //  * a GPU encode operation
-            //  * a GPU VPBlt to another surface
-            //  * a GPU custom compute shader encode operation
-            // ==============================
-
-            AcquiredBuffer.Reset();
-            hr = IddCxSwapChainFinishedProcessingFrame(m_hSwapChain);
-            if (FAILED(hr))
-            {
-                break;
-            }
+    // Wait on the new-frame event alone; the refresh rate only paces the retries for a buffer that is late
+    Pipeline.SetRefreshRate(m_RefreshRate.Numerator, m_RefreshRate.Denominator);
 
-            // ==============================
-            // TODO: Report frame statistics once the asynchronous encode/send work is completed
-            //
-            // Drivers should report information about sub-frame timings, like encode time, send time, etc.
-            // ==============================
-            // IddCxSwapChainReportFrameStatistics(m_hSwapChain, ...);
-        }
-        else
-        {
-            // The swap-chain was likely abandoned (e.g. DXGI_ERROR_ACCESS_LOST), so exit the processing loop
-            break;
-        }
-    }
+    // Scan-out clock of the virtual monitor at the exact rate of the mode. Stamping frames needs no thread; a sink
+    // that paces itself to the ticks starts the clock and waits on it.
+    Pipeline.SetVsyncClock(make_shared<VsyncClock>(m_RefreshRate.Numerator, m_RefreshRate.Denominator, MonotonicNanoseconds()));
+
+    // Span every step of every frame, from IddCxSwapChainReleaseAndAcquireBuffer to the sink, into the monitor's
+    // trace ring; about a microsecond a frame
+    Pipeline.SetTracer(m_Tracer);
+
+    // Sum the statistics of every swap-chain into the device's counters
+    Pipeline.SetMetrics(m_Metrics);
+
+    // Publish the latencies of this swap-chain into the statistics page while it runs
+    m_Stats->AttachTimings(0, &Pipeline.Timings());
+    Pipeline.RunCore();
+    m_Stats->AttachTimings(0, nullptr);
 }
 
 #pragma endregion
@@ -472,15 +725,41 @@ IndirectDeviceContext::IndirectDeviceContext(_In_ WDFDEVICE WdfDevice)
     , m_Monitor(NULL)
     , m_MonitorPlugged(false)
     , m_Event(NULL)
+    , m_FramePool(make_shared<FrameBufferPool>(true))
+    , m_WorkerPool(WorkerPool::Shared())
+    , m_Tracer(make_shared<FrameTracer>())
+    , m_RefreshRate()
+    , m_Metrics(make_shared<MetricsRegistry>())
+    , m_Stats(make_shared<StatsPublisher>(m_Metrics))
+    , m_FrameExport(make_shared<FrameExportWriter>())
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     m_Event = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    // The sample has a single monitor, numbered 0 in the page, whose frames are all the device counts
+    m_Stats->SetMonitorMetrics(0, m_Metrics);
+    if (!m_Stats->Start(StatsPageName))
+    {
+        IDD_LOG_WARNING("StatsPublisher::Start failed, no statistics page");
+    }
+
+    // Slots large enough for the largest mode the monitor offers, and one reader, so frames are triple-buffered
+    UINT32 MaxWidth = 0, MaxHeight = 0;
+    for (const DISPLAYCONFIG_VIDEO_SIGNAL_INFO& Mode : s_KnownMonitorModes)
+    {
+        MaxWidth = max(MaxWidth, Mode.activeSize.cx);
+        MaxHeight = max(MaxHeight, Mode.activeSize.cy);
+    }
+    if (!m_FrameExport->Create(FrameExportName, MaxWidth, MaxHeight))
+    {
+        IDD_LOG_WARNING("FrameExportWriter::Create failed, frames are not exported");
+    }
 }
 
 IndirectDeviceContext::~IndirectDeviceContext()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     m_ProcessingThread.reset();
 
@@ -496,7 +775,7 @@ void IndirectDeviceContext::InitAdapter()
     // This is also where static per-adapter capabilities are determined.
     // ==============================
 
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     IDDCX_ADAPTER_CAPS AdapterCaps = {};
     AdapterCaps.Size = sizeof(AdapterCaps);
@@ -545,7 +824,7 @@ void IndirectDeviceContext::InitAdapter()
 
 void IndirectDeviceContext::FinishInit()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     PlugInMonitor();
 }
@@ -561,7 +840,7 @@ void IndirectDeviceContext::PlugInMonitor()
     // single device to ensure the OS can tell the monitors apart.
     // ==============================
 
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     WDF_OBJECT_ATTRIBUTES Attr;
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&Attr, IndirectDeviceContextWrapper);
@@ -613,15 +892,41 @@ void IndirectDeviceContext::PlugInMonitor()
 
 void IndirectDeviceContext::PlugOutMonitor()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     IddCxMonitorDeparture(m_Monitor);
+    m_Stats->SetMonitorMode(0, 0, 0, 0, 0);
 }
 
 
+void IndirectDeviceContext::CommitModes(const IDDCX_PATH* pPaths, UINT PathCount)
+{
+    IDD_LOG_TRACE("");
+
+    m_RefreshRate = { 0, 0 };
+    m_Stats->SetMonitorMode(0, 0, 0, 0, 0);
+
+    // The sample has a single monitor, so at most one path is active
+    for (UINT i = 0; i < PathCount; i++)
+    {
+        if (pPaths[i].Flags & IDDCX_PATH_FLAGS_ACTIVE)
+        {
+            const DISPLAYCONFIG_VIDEO_SIGNAL_INFO& Signal = pPaths[i].TargetVideoSignalInfo;
+            UINT32 Divider = Signal.AdditionalSignalInfo.vSyncFreqDivider;
+
+            m_RefreshRate = Signal.vSyncFreq;
+            if (Divider > 1)
+            {
+                m_RefreshRate.Denominator *= Divider;
+            }
+            m_Stats->SetMonitorMode(0, Signal.activeSize.cx, Signal.activeSize.cy, m_RefreshRate.Numerator, m_RefreshRate.Denominator);
+        }
+    }
+}
+
 void IndirectDeviceContext::AssignSwapChain(IDDCX_SWAPCHAIN SwapChain, LUID RenderAdapter, HANDLE NewFrameEvent)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     m_ProcessingThread.reset();
 
@@ -635,7 +940,8 @@ void IndirectDeviceContext::AssignSwapChain(IDDCX_SWAPCHAIN SwapChain, LUID Rend
     else
     {
         // Create a new swap-chain processing thread
-        m_ProcessingThread.reset(new SwapChainProcessor(SwapChain, Device, NewFrameEvent));
+        m_ProcessingThread.reset(new SwapChainProcessor(SwapChain, Device, NewFrameEvent, m_FramePool, m_WorkerPool, m_Tracer, m_Metrics, m_Stats, m_FrameExport, m_RefreshRate));
+        m_Metrics->Add(MetricId::SwapChainsAssigned);
     }
 
     // Enable hardware cursor support for this monitor
@@ -651,18 +957,68 @@ void IndirectDeviceContext::AssignSwapChain(IDDCX_SWAPCHAIN SwapChain, LUID Rend
     hwCursor.CursorInfo.MaxY = 64;
     
     NTSTATUS Status = IddCxMonitorSetupHardwareCursor((IDDCX_MONITOR)m_Monitor, &hwCursor);
-    WriteLogFile("[%s %d %s] 0x%x", __FILE__, __LINE__, __FUNCDNAME__, Status);
+    IDD_LOG_INFO("IddCxMonitorSetupHardwareCursor 0x%x", Status);
 
 }
 
 void IndirectDeviceContext::UnassignSwapChain()
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     // Stop processing the last swap-chain
     m_ProcessingThread.reset();
 }
 
+NTSTATUS IndirectDeviceContext::QueryTrace(WDFREQUEST Request, size_t& BytesWritten)
+{
+    // Open it in chrome://tracing or ui.perfetto.dev. The ring may be written to meanwhile; events being written are
+    // left out.
+    string Json;
+    m_Tracer->ExportChromeTrace(Json);
+    IDD_LOG_INFO("QueryTrace %llu bytes, %llu events overwritten, %llu dropped", static_cast<unsigned long long>(Json.size()),
+        m_Tracer->Overwritten(), m_Tracer->Dropped());
+
+    BytesWritten = 0;
+
+    void* pBuffer;
+    size_t Length;
+    NTSTATUS Status = WdfRequestRetrieveOutputBuffer(Request, sizeof(ULONG), &pBuffer, &Length);
+    if (!NT_SUCCESS(Status))
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    // A buffer too small for the trace gets the size it needs now, as a ULONG; a warning status still brings that
+    // back to the caller, who should leave room for the trace to grow before asking again
+    if (Length < Json.size())
+    {
+        *static_cast<ULONG*>(pBuffer) = static_cast<ULONG>(Json.size());
+        BytesWritten = sizeof(ULONG);
+        return STATUS_BUFFER_OVERFLOW;
+    }
+
+    memcpy(pBuffer, Json.data(), Json.size());
+    BytesWritten = Json.size();
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS IndirectDeviceContext::QueryMetrics(WDFREQUEST Request, size_t& BytesWritten)
+{
+    BytesWritten = 0;
+
+    void* pBuffer;
+    size_t Length;
+    NTSTATUS Status = WdfRequestRetrieveOutputBuffer(Request, MetricsRegistry::SerializedSize(), &pBuffer, &Length);
+    if (!NT_SUCCESS(Status))
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    m_Metrics->Serialize(pBuffer, Length);
+    BytesWritten = MetricsRegistry::SerializedSize();
+    return STATUS_SUCCESS;
+}
+
 #pragma endregion
 
 #pragma region DDI Callbacks
@@ -670,17 +1026,21 @@ void IndirectDeviceContext::UnassignSwapChain()
 
 #define IOCTL_MONITOR_PLUG_IN     CTL_CODE(0x00009528, 0xcc1, METHOD_BUFFERED, FILE_ANY_ACCESS)
 #define IOCTL_MONITOR_PLUG_OUT    CTL_CODE(0x00009528, 0xcc2, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_QUERY_TRACE         CTL_CODE(METRICS_DEVICE_TYPE, TRACE_IOCTL_FUNCTION, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_QUERY_METRICS       CTL_CODE(METRICS_DEVICE_TYPE, METRICS_IOCTL_FUNCTION, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
 
 _Use_decl_annotations_
 void EventDeviceIoControl(WDFDEVICE Device, WDFREQUEST Request, size_t OutputBufferLength, size_t InputBufferLength, ULONG IoControlCode)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     UNREFERENCED_PARAMETER(OutputBufferLength);
     UNREFERENCED_PARAMETER(InputBufferLength);
 
     auto* pContext = WdfObjectGet_IndirectDeviceContextWrapper(Device)->pContext;
+    NTSTATUS Status = STATUS_SUCCESS;
+    size_t BytesWritten = 0;
 
     if (IoControlCode == IOCTL_MONITOR_PLUG_IN)
     {
@@ -688,6 +1048,7 @@ void EventDeviceIoControl(WDFDEVICE Device, WDFREQUEST Request, size_t OutputBuf
         {
             pContext->PlugInMonitor();
             pContext->m_MonitorPlugged = true;
+            pContext->m_Metrics->Add(MetricId::MonitorsPlugged);
         }
     }
     else if (IoControlCode == IOCTL_MONITOR_PLUG_OUT)
@@ -696,17 +1057,26 @@ void EventDeviceIoControl(WDFDEVICE Device, WDFREQUEST Request, size_t OutputBuf
         {
             pContext->PlugOutMonitor();
             pContext->m_MonitorPlugged = false;
+            pContext->m_Metrics->Add(MetricId::MonitorsPlugged, -1);
         }
     }
+    else if (IoControlCode == IOCTL_QUERY_TRACE)
+    {
+        Status = pContext->QueryTrace(Request, BytesWritten);
+    }
+    else if (IoControlCode == IOCTL_QUERY_METRICS)
+    {
+        Status = pContext->QueryMetrics(Request, BytesWritten);
+    }
 
-    WdfRequestComplete(Request, STATUS_SUCCESS);
+    WdfRequestCompleteWithInformation(Request, Status, BytesWritten);
 }
 
 
 _Use_decl_annotations_
 NTSTATUS EventAdapterInitFinished(IDDCX_ADAPTER AdapterObject, const IDARG_IN_ADAPTER_INIT_FINISHED* pInArgs)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     UNREFERENCED_PARAMETER(AdapterObject);
     UNREFERENCED_PARAMETER(pInArgs);
@@ -726,12 +1096,11 @@ NTSTATUS EventAdapterInitFinished(IDDCX_ADAPTER AdapterObject, const IDARG_IN_AD
 _Use_decl_annotations_
 NTSTATUS EventAdapterCommitModes(IDDCX_ADAPTER AdapterObject, const IDARG_IN_COMMITMODES* pInArgs)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
-
-    UNREFERENCED_PARAMETER(AdapterObject);
-    UNREFERENCED_PARAMETER(pInArgs);
+    IDD_LOG_TRACE("");
 
-    // For the sample, do nothing when modes are picked - the swap-chain is taken care of by IddCx
+    // The swap-chain is taken care of by IddCx; only remember the refresh rate to pace frame acquisition with
+    auto* pContext = WdfObjectGet_IndirectDeviceContextWrapper(AdapterObject);
+    pContext->pContext->CommitModes(pInArgs->pPaths, pInArgs->PathCount);
 
     // ==============================
     // TODO: In a real driver, this function would be used to reconfigure the device to commit the new modes. Loop
@@ -750,7 +1119,7 @@ NTSTATUS EventParseMonitorDescription(const IDARG_IN_PARSEMONITORDESCRIPTION* pI
     // this sample driver, we hard-code the EDID, so this function can generate known modes.
     // ==============================
 
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     pOutArgs->MonitorModeBufferOutputCount = ARRAYSIZE(IndirectDeviceContext::s_KnownMonitorModes);
 
@@ -779,7 +1148,7 @@ NTSTATUS EventParseMonitorDescription(const IDARG_IN_PARSEMONITORDESCRIPTION* pI
 _Use_decl_annotations_
 NTSTATUS EventMonitorGetDefaultModes(IDDCX_MONITOR MonitorObject, const IDARG_IN_GETDEFAULTDESCRIPTIONMODES* pInArgs, IDARG_OUT_GETDEFAULTDESCRIPTIONMODES* pOutArgs)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     UNREFERENCED_PARAMETER(MonitorObject);
     UNREFERENCED_PARAMETER(pInArgs);
@@ -802,7 +1171,7 @@ NTSTATUS EventMonitorGetDefaultModes(IDDCX_MONITOR MonitorObject, const IDARG_IN
 /// </summary>
 void CreateTargetMode(DISPLAYCONFIG_VIDEO_SIGNAL_INFO& Mode, UINT Width, UINT Height, UINT VSync)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     Mode.totalSize.cx = Mode.activeSize.cx = Width;
     Mode.totalSize.cy = Mode.activeSize.cy = Height;
@@ -817,7 +1186,7 @@ void CreateTargetMode(DISPLAYCONFIG_VIDEO_SIGNAL_INFO& Mode, UINT Width, UINT He
 
 void CreateTargetMode(IDDCX_TARGET_MODE& Mode, UINT Width, UINT Height, UINT VSync)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     Mode.Size = sizeof(Mode);
     CreateTargetMode(Mode.TargetVideoSignalInfo.targetVideoSignalInfo, Width, Height, VSync);
@@ -826,7 +1195,7 @@ void CreateTargetMode(IDDCX_TARGET_MODE& Mode, UINT Width, UINT Height, UINT VSy
 _Use_decl_annotations_
 NTSTATUS UniShareMonitorQueryModes(IDDCX_MONITOR MonitorObject, const IDARG_IN_QUERYTARGETMODES* pInArgs, IDARG_OUT_QUERYTARGETMODES* pOutArgs)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     UNREFERENCED_PARAMETER(MonitorObject);
 
@@ -852,7 +1221,7 @@ NTSTATUS UniShareMonitorQueryModes(IDDCX_MONITOR MonitorObject, const IDARG_IN_Q
 _Use_decl_annotations_
 NTSTATUS EventMonitorAssignSwapChain(IDDCX_MONITOR MonitorObject, const IDARG_IN_SETSWAPCHAIN* pInArgs)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     auto* pContext = WdfObjectGet_IndirectDeviceContextWrapper(MonitorObject);
     pContext->pContext->AssignSwapChain(pInArgs->hSwapChain, pInArgs->RenderAdapterLuid, pInArgs->hNextSurfaceAvailable);
@@ -862,7 +1231,7 @@ NTSTATUS EventMonitorAssignSwapChain(IDDCX_MONITOR MonitorObject, const IDARG_IN
 _Use_decl_annotations_
 NTSTATUS EventMonitorUnassignSwapChain(IDDCX_MONITOR MonitorObject)
 {
-    WriteLogFile("[%s %d %s]", __FILE__, __LINE__, __FUNCDNAME__);
+    IDD_LOG_TRACE("");
 
     auto* pContext = WdfObjectGet_IndirectDeviceContextWrapper(MonitorObject);
     pContext->pContext->UnassignSwapChain();
@@ -18,6 +18,24 @@
 
 #include "trace.h"
 
+// Writes a binary log, which logfmt decodes, to IDD_LOG_PATH and records every callback in it at Trace level.
+// Without it no log call is compiled in and no log file is opened.
+//#define VERBOSE_LOG
+
+#ifdef VERBOSE_LOG
+#define IDD_LOG_MIN_LEVEL 0
+#ifndef IDD_LOG_PATH
+#define IDD_LOG_PATH "D:\\WinVirtualDisplay.blog"
+#endif
+#else
+#define IDD_LOG_MIN_LEVEL 4
+#endif
+
+#include "pipeline/binary_log.h"
+#include "pipeline/frame_export.h"
+#include "pipeline/frame_pipeline.h"
+#include "pipeline/stats_publisher.h"
+
 namespace Microsoft
 {
     namespace WRL
@@ -50,13 +68,53 @@ namespace Microsoft
             Microsoft::WRL::ComPtr<ID3D11DeviceContext> DeviceContext;
         };
 
+        /// <summary>
+        /// Feeds the buffers of an indirect display swap-chain object into the portable frame pipeline.
+        /// </summary>
+        class IddSwapChainSource : public ISwapChainSource
+        {
+        public:
+            IddSwapChainSource(IDDCX_SWAPCHAIN hSwapChain, std::shared_ptr<Direct3DDevice> Device, HANDLE NewFrameEvent, HANDLE TerminateEvent);
+
+            bool Initialize() override;
+            AcquireStatus ReleaseAndAcquire(Frame& Frame) override;
+            WaitStatus WaitForFrame(uint32_t TimeoutMs) override;
+            bool FinishedProcessing() override;
+            bool MapFrame(Frame& Frame) override;
+            void UnmapFrame(Frame& Frame) override;
+            void ReportFrame(const FrameTimeline& Timeline) override;
+
+        private:
+            void ReadDamage(const IDDCX_METADATA& MetaData, Frame& Frame);
+            UINT64 ToQpc(uint64_t Nanoseconds) const;
+
+            IDDCX_SWAPCHAIN m_hSwapChain;
+            std::shared_ptr<Direct3DDevice> m_Device;
+            HANDLE m_hAvailableBufferEvent;
+            HANDLE m_hTerminateEvent;
+            LARGE_INTEGER m_QpcFrequency;
+            Microsoft::WRL::ComPtr<IDXGIResource> m_AcquiredBuffer;
+
+            // CPU-readable copy of the acquired surface, recreated only when the mode changes
+            Microsoft::WRL::ComPtr<ID3D11Texture2D> m_StagingTexture;
+            D3D11_TEXTURE2D_DESC m_StagingDesc;
+
+            // Dirty and move regions of the acquired buffer, reused from frame to frame
+            std::vector<RECT> m_DirtyRegions;
+            std::vector<IDDCX_MOVEREGION> m_MoveRegions;
+            FrameDamage m_Damage;
+
+            // Steps of the frame statistics, reused from frame to frame by the thread that processes frames
+            std::vector<IDDCX_FRAME_STATISTICS_STEP> m_Steps;
+        };
+
         /// <summary>
         /// Manages a thread that consumes buffers from an indirect display swap-chain object.
         /// </summary>
         class SwapChainProcessor
         {
         public:
-            SwapChainProcessor(IDDCX_SWAPCHAIN hSwapChain, std::shared_ptr<Direct3DDevice> Device, HANDLE NewFrameEvent);
+            SwapChainProcessor(IDDCX_SWAPCHAIN hSwapChain, std::shared_ptr<Direct3DDevice> Device, HANDLE NewFrameEvent, std::shared_ptr<FrameBufferPool> FramePool, std::shared_ptr<WorkerPool> WorkerPool, std::shared_ptr<FrameTracer> Tracer, std::shared_ptr<MetricsRegistry> Metrics, std::shared_ptr<StatsPublisher> Stats, std::shared_ptr<FrameExportWriter> FrameExport, DISPLAYCONFIG_RATIONAL RefreshRate);
             ~SwapChainProcessor();
 
         private:
@@ -69,6 +127,13 @@ namespace Microsoft
             IDDCX_SWAPCHAIN m_hSwapChain;
             std::shared_ptr<Direct3DDevice> m_Device;
             HANDLE m_hAvailableBufferEvent;
+            std::shared_ptr<FrameBufferPool> m_FramePool;
+            std::shared_ptr<WorkerPool> m_WorkerPool;
+            std::shared_ptr<FrameTracer> m_Tracer;
+            std::shared_ptr<MetricsRegistry> m_Metrics;
+            std::shared_ptr<StatsPublisher> m_Stats;
+            std::shared_ptr<FrameExportWriter> m_FrameExport;
+            DISPLAYCONFIG_RATIONAL m_RefreshRate;
             Microsoft::WRL::Wrappers::Thread m_hThread;
             Microsoft::WRL::Wrappers::Event m_hTerminateEvent;
         };
@@ -88,9 +153,13 @@ namespace Microsoft
             void PlugInMonitor();
             void PlugOutMonitor();
 
+            void CommitModes(const IDDCX_PATH* pPaths, UINT PathCount);
             void AssignSwapChain(IDDCX_SWAPCHAIN SwapChain, LUID RenderAdapter, HANDLE NewFrameEvent);
             void UnassignSwapChain();
 
+            NTSTATUS QueryTrace(WDFREQUEST Request, size_t& BytesWritten);
+            NTSTATUS QueryMetrics(WDFREQUEST Request, size_t& BytesWritten);
+
         protected:
             WDFDEVICE m_WdfDevice;
             IDDCX_ADAPTER m_Adapter;
@@ -99,11 +168,33 @@ namespace Microsoft
 
             std::unique_ptr<SwapChainProcessor> m_ProcessingThread;
 
+            // Owned here rather than by the processor so frame buffers survive swap-chain reassignment
+            std::shared_ptr<FrameBufferPool> m_FramePool;
+
+            // The process-wide pool that runs the frame processing of every monitor
+            std::shared_ptr<WorkerPool> m_WorkerPool;
+
+            // Flight recorder of the last frames of every swap-chain this monitor had, dumped on request
+            std::shared_ptr<FrameTracer> m_Tracer;
+
+            // Refresh rate of the mode last committed on the monitor's path, 0/0 while none is active
+            DISPLAYCONFIG_RATIONAL m_RefreshRate;
+
         public:
             static const DISPLAYCONFIG_VIDEO_SIGNAL_INFO s_KnownMonitorModes[];
             static const BYTE s_KnownMonitorEdid[];
 
             std::atomic<bool> m_MonitorPlugged;
+
+            // Counters of every swap-chain this device processed, read with IOCTL_QUERY_METRICS
+            std::shared_ptr<MetricsRegistry> m_Metrics;
+
+            // Republishes the counters and the monitor's mode and latencies into the shared statistics page
+            std::shared_ptr<StatsPublisher> m_Stats;
+
+            // Shared-memory region the monitor's frames are published into for user-mode consumers; kept across
+            // swap-chains so readers stay attached
+            std::shared_ptr<FrameExportWriter> m_FrameExport;
         };
     }
 }
\ No newline at end of file
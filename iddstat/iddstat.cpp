@@ -0,0 +1,385 @@
+/*++
+
+Module Name:
+
+    iddstat.cpp
+
+Abstract:
+
+    Prints the driver's counters and gauges, queried with IOCTL_QUERY_METRICS or read from a snapshot saved earlier.
+    With --interval, queries again every interval and adds the rate of every counter since the previous query.
+    With --page, reads the live statistics page instead, which also holds the mode, frame rates and latencies of
+    every monitor and costs the driver nothing to read. A page left behind by a driver that stopped or restarted is
+    opened again. With --trace, saves the driver's frame trace as Chrome trace JSON instead.
+
+    Usage: iddstat [--interval MS] [--count N] [--save PATH]    (queries the driver, Windows only)
+           iddstat --file PATH                                  (decodes a saved snapshot)
+           iddstat --page [NAME] [--interval MS] [--count N]    (reads the statistics page)
+           iddstat --trace PATH                                 (saves the frame trace, Windows only)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#endif
+
+#include "../pipeline/metrics.h"
+#include "../pipeline/stats_page.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    bool LoadFile(const char* Path, vector<uint8_t>& Data)
+    {
+        FILE* pFile = fopen(Path, "rb");
+        if (!pFile)
+        {
+            return false;
+        }
+
+        uint8_t Buffer[4096];
+        size_t Read;
+        while ((Read = fread(Buffer, 1, sizeof(Buffer), pFile)) != 0)
+        {
+            Data.insert(Data.end(), Buffer, Buffer + Read);
+        }
+        fclose(pFile);
+        return true;
+    }
+
+    bool SaveFile(const char* Path, const vector<uint8_t>& Data)
+    {
+        FILE* pFile = fopen(Path, "wb");
+        if (!pFile)
+        {
+            return false;
+        }
+
+        bool Written = fwrite(Data.data(), 1, Data.size(), pFile) == Data.size();
+        return fclose(pFile) == 0 && Written;
+    }
+
+#ifdef _WIN32
+    // The trace can outgrow the size the driver reported before it is queried, though only while the ring fills up
+    const uint32_t TraceAttempts = 4;
+
+    HANDLE OpenDriver()
+    {
+        HANDLE hDevice = CreateFileW(L"\\\\.\\WinVirtualDisplay", GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (hDevice == INVALID_HANDLE_VALUE)
+        {
+            fprintf(stderr, "cannot open the driver (error %lu)\n", GetLastError());
+        }
+        return hDevice;
+    }
+
+    bool QueryDriver(vector<uint8_t>& Data)
+    {
+        HANDLE hDevice = OpenDriver();
+        if (hDevice == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        // A newer driver may know more metrics than this build, so leave room for them
+        Data.resize(MetricsRegistry::SerializedSize() * 4);
+
+        DWORD Returned = 0;
+        BOOL Succeeded = DeviceIoControl(hDevice, CTL_CODE(METRICS_DEVICE_TYPE, METRICS_IOCTL_FUNCTION, METHOD_BUFFERED, FILE_ANY_ACCESS),
+            nullptr, 0, Data.data(), static_cast<DWORD>(Data.size()), &Returned, nullptr);
+        DWORD Error = GetLastError();
+        CloseHandle(hDevice);
+
+        if (!Succeeded)
+        {
+            fprintf(stderr, "IOCTL_QUERY_METRICS failed (error %lu)\n", Error);
+            return false;
+        }
+
+        Data.resize(Returned);
+        return true;
+    }
+
+    bool QueryTrace(vector<uint8_t>& Data)
+    {
+        HANDLE hDevice = OpenDriver();
+        if (hDevice == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        // A buffer too small for the trace, such as a single ULONG, comes back holding the size it needs
+        Data.resize(sizeof(ULONG));
+        DWORD Error = ERROR_SUCCESS;
+        for (uint32_t Attempt = 0; Attempt < TraceAttempts; Attempt++)
+        {
+            DWORD Returned = 0;
+            BOOL Succeeded = DeviceIoControl(hDevice, CTL_CODE(METRICS_DEVICE_TYPE, TRACE_IOCTL_FUNCTION, METHOD_BUFFERED, FILE_ANY_ACCESS),
+                nullptr, 0, Data.data(), static_cast<DWORD>(Data.size()), &Returned, nullptr);
+            Error = GetLastError();
+
+            if (Succeeded)
+            {
+                CloseHandle(hDevice);
+                Data.resize(Returned);
+                return true;
+            }
+            if (Error != ERROR_MORE_DATA || Returned != sizeof(ULONG))
+            {
+                break;
+            }
+
+            ULONG Size;
+            memcpy(&Size, Data.data(), sizeof(Size));
+            Data.resize(Size + Size / 8);
+        }
+
+        CloseHandle(hDevice);
+        fprintf(stderr, "IOCTL_QUERY_TRACE failed (error %lu)\n", Error);
+        return false;
+    }
+#else
+    bool QueryDriver(vector<uint8_t>&)
+    {
+        fprintf(stderr, "the driver can only be queried on Windows; decode a saved snapshot with --file\n");
+        return false;
+    }
+
+    bool QueryTrace(vector<uint8_t>&)
+    {
+        fprintf(stderr, "the trace can only be queried from the driver on Windows\n");
+        return false;
+    }
+#endif
+
+    void Print(const MetricsSnapshot& Snapshot, const MetricsSnapshot* pPrevious)
+    {
+        printf("uptime %.1f s, snapshot version %u, %u shards\n", (Snapshot.Timestamp - Snapshot.StartTime) / 1e9,
+            Snapshot.Version, Snapshot.ShardCount);
+
+        double Seconds = pPrevious ? (Snapshot.Timestamp - pPrevious->Timestamp) / 1e9 : 0;
+        for (uint32_t i = 0; i < Snapshot.Values.size(); i++)
+        {
+            const char* pName = MetricName(i);
+            char Unknown[32];
+            if (!pName)
+            {
+                snprintf(Unknown, sizeof(Unknown), "metric %u", i);
+                pName = Unknown;
+            }
+
+            printf("  %-22s %14lld", pName, static_cast<long long>(Snapshot.Values[i]));
+            if (Seconds > 0 && i < pPrevious->Values.size() && MetricKindOf(i) == MetricKind::Counter)
+            {
+                printf(" %12.1f/s", (Snapshot.Values[i] - pPrevious->Values[i]) / Seconds);
+            }
+            printf("\n");
+        }
+    }
+
+    void PrintPage(const StatsPageData& Data, uint64_t Retries)
+    {
+        printf("uptime %.1f s, publish %llu, %llu torn reads retried\n", (Data.PublishTime - Data.StartTime) / 1e9,
+            static_cast<unsigned long long>(Data.PublishCount), static_cast<unsigned long long>(Retries));
+
+        for (uint32_t i = 0; i < Data.MetricCount && i < StatsPageMaxMetrics; i++)
+        {
+            const char* pName = MetricName(i);
+            if (pName)
+            {
+                printf("  %-22s %14lld\n", pName, static_cast<long long>(Data.Metrics[i]));
+            }
+            else
+            {
+                printf("  metric %-15u %14lld\n", i, static_cast<long long>(Data.Metrics[i]));
+            }
+        }
+
+        for (uint32_t i = 0; i < Data.MonitorCount && i < StatsPageMaxMonitors; i++)
+        {
+            const MonitorStats& Monitor = Data.Monitors[i];
+            if (!Monitor.Active)
+            {
+                printf("monitor %u: no mode\n", i);
+                continue;
+            }
+
+            double Refresh = Monitor.RefreshDenominator ? static_cast<double>(Monitor.RefreshNumerator) / Monitor.RefreshDenominator : 0;
+            printf("monitor %u: %llux%llu @ %.3f Hz%s\n", i, static_cast<unsigned long long>(Monitor.Width),
+                static_cast<unsigned long long>(Monitor.Height), Refresh, Monitor.SwapChainActive ? "" : ", no swap-chain");
+            printf("  frames %llu acquired, %llu delivered, %llu dropped; %.1f/%.1f fps\n",
+                static_cast<unsigned long long>(Monitor.FramesAcquired), static_cast<unsigned long long>(Monitor.FramesDelivered),
+                static_cast<unsigned long long>(Monitor.FramesDropped), Monitor.AcquiredPerSecond, Monitor.DeliveredPerSecond);
+            printf("  latency p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n", Monitor.LatencyP50 / 1e6,
+                Monitor.LatencyP99 / 1e6, Monitor.LatencyP999 / 1e6, Monitor.LatencyMax / 1e6);
+        }
+    }
+
+    int WatchPage(const char* Name, uint32_t IntervalMs, uint32_t Count)
+    {
+        StatsPageReader Reader;
+        if (!Reader.Open(Name))
+        {
+            fprintf(stderr, "cannot open the statistics page %s\n", Name);
+            return 1;
+        }
+
+        for (uint32_t Read = 0; ; Read++)
+        {
+            // The driver restarted, or stopped and left the page to whoever still maps it
+            bool Reopened = !Reader.IsOpen() || Reader.WriterChanged();
+            if (Reopened && !Reader.Open(Name))
+            {
+                fprintf(stderr, "the driver stopped publishing %s\n", Name);
+                if (IntervalMs == 0)
+                {
+                    return 1;
+                }
+            }
+            else
+            {
+                if (Reopened)
+                {
+                    printf("the driver restarted\n");
+                }
+
+                StatsPageData Data;
+                if (!Reader.Read(Data))
+                {
+                    fprintf(stderr, "the statistics page stayed busy\n");
+                    return 1;
+                }
+
+                PrintPage(Data, Reader.Retries());
+            }
+
+            if (IntervalMs == 0 || (Count != 0 && Read + 1 >= Count))
+            {
+                return 0;
+            }
+
+            this_thread::sleep_for(chrono::milliseconds(IntervalMs));
+            printf("\n");
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* pFile = nullptr;
+    const char* pSave = nullptr;
+    const char* pPage = nullptr;
+    const char* pTrace = nullptr;
+    uint32_t IntervalMs = 0;
+    uint32_t Count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--page") == 0)
+        {
+            pPage = i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0 ? argv[i + 1] : StatsPageName;
+        }
+        else if (i + 1 >= argc)
+        {
+            break;
+        }
+        else if (strcmp(argv[i], "--file") == 0)
+        {
+            pFile = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--save") == 0)
+        {
+            pSave = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--trace") == 0)
+        {
+            pTrace = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "--interval") == 0)
+        {
+            IntervalMs = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+        }
+        else if (strcmp(argv[i], "--count") == 0)
+        {
+            Count = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+        }
+    }
+
+    if (pPage)
+    {
+        return WatchPage(pPage, IntervalMs, Count);
+    }
+
+    if (pTrace)
+    {
+        vector<uint8_t> Trace;
+        if (!QueryTrace(Trace))
+        {
+            return 1;
+        }
+        if (!SaveFile(pTrace, Trace))
+        {
+            fprintf(stderr, "cannot write %s\n", pTrace);
+            return 1;
+        }
+
+        // Open it in chrome://tracing or ui.perfetto.dev
+        printf("saved %zu bytes of trace to %s\n", Trace.size(), pTrace);
+        return 0;
+    }
+
+    MetricsSnapshot Previous = {};
+    bool HasPrevious = false;
+
+    for (uint32_t Query = 0; ; Query++)
+    {
+        vector<uint8_t> Data;
+        if (pFile ? !LoadFile(pFile, Data) : !QueryDriver(Data))
+        {
+            if (pFile)
+            {
+                fprintf(stderr, "cannot read %s\n", pFile);
+            }
+            return 1;
+        }
+
+        MetricsSnapshot Snapshot;
+        if (!Snapshot.Decode(Data.data(), Data.size()))
+        {
+            fprintf(stderr, "not a metrics snapshot\n");
+            return 1;
+        }
+
+        if (pSave && !SaveFile(pSave, Data))
+        {
+            fprintf(stderr, "cannot write %s\n", pSave);
+            return 1;
+        }
+
+        Print(Snapshot, HasPrevious ? &Previous : nullptr);
+
+        if (pFile || IntervalMs == 0 || (Count != 0 && Query + 1 >= Count))
+        {
+            return 0;
+        }
+
+        Previous = Snapshot;
+        HasPrevious = true;
+        this_thread::sleep_for(chrono::milliseconds(IntervalMs));
+        printf("\n");
+    }
+}
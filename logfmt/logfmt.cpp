@@ -0,0 +1,73 @@
+/*++
+
+Module Name:
+
+    logfmt.cpp
+
+Abstract:
+
+    Decodes a binary log written by the driver into text, one line per record.
+
+    Usage: logfmt <file> [--level N]    (0 = Trace, 1 = Info, 2 = Warning, 3 = Error; default 0)
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../pipeline/log_decoder.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: logfmt <file> [--level N]\n");
+        return 2;
+    }
+
+    uint32_t MinimumLevel = 0;
+    for (int i = 2; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--level") == 0)
+        {
+            MinimumLevel = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+        }
+    }
+
+    LogDecoder Decoder;
+    if (!Decoder.Open(argv[1]))
+    {
+        fprintf(stderr, "%s is not a binary log\n", argv[1]);
+        return 1;
+    }
+
+    LogEntry Entry;
+    string Line;
+    while (Decoder.Next(Entry))
+    {
+        if (static_cast<uint32_t>(Entry.Level) < MinimumLevel)
+        {
+            continue;
+        }
+
+        LogDecoder::FormatEntry(Entry, Line);
+        puts(Line.c_str());
+    }
+
+    if (Decoder.Damaged())
+    {
+        fprintf(stderr, "the log is damaged after the last line printed\n");
+        return 1;
+    }
+
+    return 0;
+}
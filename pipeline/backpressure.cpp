@@ -0,0 +1,229 @@
+/*++
+
+Module Name:
+
+    backpressure.cpp
+
+Abstract:
+
+    This module contains the backpressure sink.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "backpressure.h"
+
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+const char* Microsoft::IndirectDisp::BackpressurePolicyName(BackpressurePolicy Policy)
+{
+    switch (Policy)
+    {
+    case BackpressurePolicy::LatestWins:
+        return "latest-wins";
+    case BackpressurePolicy::DropOldest:
+        return "drop-oldest";
+    case BackpressurePolicy::Block:
+        return "block";
+    default:
+        return "unknown";
+    }
+}
+
+BackpressureSink::BackpressureSink(shared_ptr<IFrameSink> Consumer, BackpressurePolicy Policy, uint32_t Depth,
+    uint32_t BlockTimeoutMs, shared_ptr<FrameBufferPool> Pool)
+    : m_Consumer(Consumer), m_Policy(Policy), m_Depth(Policy == BackpressurePolicy::LatestWins || Depth == 0 ? 1 : Depth),
+      m_BlockTimeoutMs(BlockTimeoutMs), m_Pool(Pool), m_Entries(m_Depth), m_Head(0), m_Count(0), m_Stopping(false),
+      m_Statistics(), m_Current()
+{
+    if (!m_Pool)
+    {
+        // Room for every queued frame, the one being consumed and the one being copied
+        m_Pool = make_shared<FrameBufferPool>(false, m_Depth + 2);
+    }
+
+    m_Thread = thread(&BackpressureSink::ConsumerThread, this);
+}
+
+BackpressureSink::~BackpressureSink()
+{
+    Stop();
+}
+
+void BackpressureSink::Consume(const Frame& Frame)
+{
+    if (!Frame.pData)
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        Reject(Frame);
+        return;
+    }
+
+    // Take the pixels over before taking the lock, so the consumer never waits for a copy
+    FrameBufferRef Buffer;
+    uint8_t* pData = Frame.pData;
+    uint32_t Pitch = Frame.Pitch;
+    bool Copied = false;
+    if (Frame.pBuffer)
+    {
+        Frame.pBuffer->AddRef();
+        Buffer = FrameBufferRef(Frame.pBuffer);
+    }
+    else
+    {
+        Buffer = m_Pool->Acquire({ Frame.Width, Frame.Height, Frame.Format });
+        if (!Buffer)
+        {
+            lock_guard<mutex> Lock(m_Lock);
+            Reject(Frame);
+            return;
+        }
+
+        pData = Buffer->Data();
+        Pitch = Buffer->Pitch();
+        uint32_t RowBytes = Frame.Width * BytesPerPixel(Frame.Format);
+        uint32_t Rows = FrameRows(Frame.Format, Frame.Height);
+        for (uint32_t Y = 0; Y < Rows; Y++)
+        {
+            memcpy(pData + static_cast<size_t>(Y) * Pitch, Frame.pData + static_cast<size_t>(Y) * Frame.Pitch, RowBytes);
+        }
+        Copied = true;
+    }
+
+    unique_lock<mutex> Lock(m_Lock);
+    if (m_Count == m_Depth && m_Policy == BackpressurePolicy::Block)
+    {
+        uint64_t Start = MonotonicNanoseconds();
+        m_Room.wait_for(Lock, chrono::milliseconds(m_BlockTimeoutMs), [this] { return m_Count < m_Depth || m_Stopping; });
+        m_Statistics.BlockedTime += MonotonicNanoseconds() - Start;
+    }
+
+    if (m_Stopping || (m_Count == m_Depth && m_Policy == BackpressurePolicy::Block))
+    {
+        Reject(Frame);
+        return;
+    }
+
+    if (m_Count == m_Depth)
+    {
+        // The consumer has not got to the oldest frame yet; it never will
+        Entry& Oldest = m_Entries[m_Head];
+        Oldest.Damage.Publish(Oldest.Contents);
+        m_DroppedDamage.Accumulate(Oldest.Contents);
+        Oldest.Buffer.Reset();
+        Oldest.Formats.Reset();
+        m_Head = (m_Head + 1) % m_Depth;
+        m_Count--;
+        m_Statistics.FramesDropped++;
+    }
+
+    Entry& Queued = m_Entries[(m_Head + m_Count) % m_Depth];
+    Queued.Contents = Frame;
+    Queued.Contents.pData = pData;
+    Queued.Contents.Pitch = Pitch;
+    Queued.Contents.pSurface = nullptr;
+    Queued.Contents.pBuffer = Buffer.Get();
+    Queued.Contents.pEncoded = nullptr;
+    Queued.Buffer = move(Buffer);
+    if (Frame.pFormats)
+    {
+        Frame.pFormats->AddRef();
+    }
+    Queued.Formats = FrameFormatsRef(Frame.pFormats);
+    Queued.QueueTime = MonotonicNanoseconds();
+
+    // The producer's rectangles go away once this returns, so the entry keeps its own copy
+    Queued.Damage.Assign(Queued.Contents);
+    Queued.Damage.Publish(Queued.Contents);
+    Merge(m_RejectedDamage, Queued);
+
+    m_Count++;
+    m_Statistics.FramesAccepted++;
+    m_Statistics.FramesCopied += Copied ? 1 : 0;
+    Lock.unlock();
+    m_Ready.notify_one();
+}
+
+void BackpressureSink::Reject(const Frame& Frame)
+{
+    m_RejectedDamage.Accumulate(Frame);
+    m_Statistics.FramesRejected++;
+}
+
+void BackpressureSink::Merge(FrameDamage& Carried, Entry& Target)
+{
+    if (!Carried.HasMissed())
+    {
+        return;
+    }
+
+    bool WasFull = Target.Contents.Damage == DamageState::Full;
+    Carried.Deliver(Target.Contents);
+    Target.Damage.Assign(Target.Contents);
+    Target.Damage.Publish(Target.Contents);
+
+    m_Statistics.DamageMerges++;
+    m_Statistics.FullMerges += !WasFull && Target.Contents.Damage == DamageState::Full ? 1 : 0;
+}
+
+void BackpressureSink::Stop()
+{
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Stopping = true;
+    }
+    m_Ready.notify_one();
+    m_Room.notify_all();
+
+    if (m_Thread.joinable())
+    {
+        m_Thread.join();
+    }
+}
+
+BackpressureStatistics BackpressureSink::Statistics() const
+{
+    lock_guard<mutex> Lock(m_Lock);
+    return m_Statistics;
+}
+
+void BackpressureSink::ConsumerThread()
+{
+    for (;;)
+    {
+        {
+            unique_lock<mutex> Lock(m_Lock);
+            m_Ready.wait(Lock, [this] { return m_Count != 0 || m_Stopping; });
+            if (m_Count == 0)
+            {
+                // Stop was requested and every queued frame has been delivered
+                return;
+            }
+
+            // Swapping keeps the rectangle storage of both entries, so steady-state delivery never allocates
+            swap(m_Current, m_Entries[m_Head]);
+            m_Head = (m_Head + 1) % m_Depth;
+            m_Count--;
+
+            m_Current.Damage.Publish(m_Current.Contents);
+            Merge(m_DroppedDamage, m_Current);
+            m_Statistics.FramesDelivered++;
+        }
+        m_Room.notify_one();
+
+        m_QueueDelay.Record(MonotonicNanoseconds() - m_Current.QueueTime);
+        m_Consumer->Consume(m_Current.Contents);
+
+        // Hand the buffer back unless the consumer kept a reference
+        m_Current.Buffer.Reset();
+        m_Current.Formats.Reset();
+    }
+}
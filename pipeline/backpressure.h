@@ -0,0 +1,136 @@
+/*++
+
+Module Name:
+
+    backpressure.h
+
+Abstract:
+
+    This module contains the sink that decouples a consumer from the pipeline. The consumer runs on a thread of
+    its own, and frames wait for it in a small queue whose policy decides what happens when the consumer falls
+    behind: a new frame replaces the one waiting (latest wins), evicts the oldest one waiting (drop oldest), or
+    waits for room up to a timeout and is skipped after that (block). Whatever is dropped or skipped has its damage
+    folded into the next frame the consumer sees, so a consumer that only redraws damage never misses an update.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "format_cache.h"
+#include "frame.h"
+#include "frame_buffer_pool.h"
+#include "frame_damage.h"
+#include "frame_pipeline.h"
+#include "latency_histogram.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        enum class BackpressurePolicy
+        {
+            LatestWins,     // a mailbox of one frame; a new frame replaces the one waiting
+            DropOldest,     // a bounded queue; when it is full a new frame evicts the oldest one waiting
+            Block,          // a bounded queue; when it is full the producer waits for room, then skips the frame
+        };
+
+        const char* BackpressurePolicyName(BackpressurePolicy Policy);
+
+        /// <summary>
+        /// Counters of a backpressure sink.
+        /// </summary>
+        struct BackpressureStatistics
+        {
+            uint64_t FramesAccepted;
+            uint64_t FramesDelivered;
+            uint64_t FramesDropped;     // queued, then evicted to make room before the consumer saw them
+            uint64_t FramesRejected;    // never queued: the wait for room timed out, or the pixels were not available
+            uint64_t FramesCopied;      // accepted frames whose pixels were not in a pooled buffer yet
+            uint64_t DamageMerges;      // frames that took over the damage of dropped or rejected frames
+            uint64_t FullMerges;        // of those, frames whose damage became Full in the process
+            uint64_t BlockedTime;       // the producer spent waiting for room [ns]
+        };
+
+        /// <summary>
+        /// Hands frames to a consumer on a thread of its own, through a queue governed by a BackpressurePolicy.
+        /// Frames whose pixels are in a pooled buffer are queued without a copy, holding a reference on the buffer,
+        /// whose pool must outlive Stop; others are copied into a pool of the sink. A frame's format cache is held
+        /// along with it; pEncoded is not carried along.
+        /// </summary>
+        class BackpressureSink : public IFrameSink
+        {
+        public:
+            // Up to Depth frames wait for the consumer; LatestWins always uses 1. BlockTimeoutMs only applies to
+            // Block. Without a pool the sink creates a private one.
+            BackpressureSink(std::shared_ptr<IFrameSink> Consumer, BackpressurePolicy Policy, uint32_t Depth = 3,
+                uint32_t BlockTimeoutMs = 20, std::shared_ptr<FrameBufferPool> Pool = nullptr);
+            ~BackpressureSink();
+
+            BackpressureSink(const BackpressureSink&) = delete;
+            BackpressureSink& operator=(const BackpressureSink&) = delete;
+
+            void Consume(const Frame& Frame) override;
+
+            // Delivers the frames still waiting, then stops the consumer thread; later frames are rejected
+            void Stop();
+
+            BackpressurePolicy Policy() const { return m_Policy; }
+            BackpressureStatistics Statistics() const;
+
+            // Time frames waited in the queue, from Consume to the consumer [ns]; may be read while frames flow
+            const LatencyHistogram& QueueDelay() const { return m_QueueDelay; }
+
+        private:
+            struct Entry
+            {
+                Frame Contents;
+                FrameBufferRef Buffer;
+                FrameFormatsRef Formats;
+                FrameDamage Damage;     // what Contents points at
+                uint64_t QueueTime;
+            };
+
+            void Reject(const Frame& Frame);
+            void Merge(FrameDamage& Carried, Entry& Target);
+            void ConsumerThread();
+
+            const std::shared_ptr<IFrameSink> m_Consumer;
+            const BackpressurePolicy m_Policy;
+            const uint32_t m_Depth;
+            const uint32_t m_BlockTimeoutMs;
+            std::shared_ptr<FrameBufferPool> m_Pool;
+
+            // A ring of m_Depth entries, guarded by m_Lock along with everything below it
+            std::vector<Entry> m_Entries;
+            uint32_t m_Head;
+            uint32_t m_Count;
+            bool m_Stopping;
+
+            // Damage of frames the consumer will never see: m_RejectedDamage goes to the next frame queued,
+            // m_DroppedDamage to the next frame taken out of the queue, since the dropped ones were ahead of it
+            FrameDamage m_RejectedDamage;
+            FrameDamage m_DroppedDamage;
+            BackpressureStatistics m_Statistics;
+
+            mutable std::mutex m_Lock;
+            std::condition_variable m_Ready;
+            std::condition_variable m_Room;
+
+            // Owned by the consumer thread: the frame the consumer is working on
+            Entry m_Current;
+            LatencyHistogram m_QueueDelay;
+            std::thread m_Thread;
+        };
+    }
+}
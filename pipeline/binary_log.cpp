@@ -0,0 +1,402 @@
+/*++
+
+Module Name:
+
+    binary_log.cpp
+
+Abstract:
+
+    This module contains the rings and the flusher of the binary log. The file is a header followed by chunks: a
+    call-site definition before the first record that uses it, batches of records, and counts of records a full
+    ring dropped. log_decoder.cpp reads it back.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "binary_log.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log_format.h"
+#include "spsc_queue.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+atomic<bool> BinaryLog::s_Open(false);
+
+namespace
+{
+    // The longest an idle flusher sleeps before it looks at the rings again, in case a wakeup was missed
+    const uint32_t IdleFlushIntervalMs = 1000;
+
+    /// <summary>
+    /// The records of one thread, on their way to the flusher.
+    /// </summary>
+    struct LogRing
+    {
+        LogRing(uint32_t Capacity, uint16_t Thread)
+            : Records(Capacity), Thread(Thread), Unannounced(0), Dropped(0), DroppedWritten(0), Retired(false)
+        {
+        }
+
+        SpscQueue<LogRecord> Records;
+        uint16_t Thread;
+        size_t Unannounced;             // pushed since the producer last woke the flusher
+        atomic<uint64_t> Dropped;       // by the producer
+        uint64_t DroppedWritten;        // by the flusher
+        atomic<bool> Retired;           // the thread exited; freed once drained
+    };
+
+    struct LogSiteEntry
+    {
+        const LogSite* pSite;
+        const char* Types;
+    };
+
+    /// <summary>
+    /// Everything behind the static BinaryLog interface.
+    /// </summary>
+    struct LogState
+    {
+        mutex Lock;                     // guards everything below but the file, which only the flusher touches
+        vector<shared_ptr<LogRing>> Rings;
+        vector<LogSiteEntry> Sites;     // Sites[Id - 1]
+        uint16_t NextThread = 0;
+        uint32_t RingCapacity = BinaryLog::DefaultRingCapacity;
+        uint32_t FlushIntervalMs = BinaryLog::DefaultFlushIntervalMs;
+
+        FILE* pFile = nullptr;
+        size_t SitesWritten = 0;
+        vector<LogRecord> Batch;
+        vector<uint8_t> Chunk;
+
+        thread Flusher;
+        condition_variable Wake;
+        bool Stop = false;
+        atomic<bool> Idle{ false };     // the flusher found nothing last time and sleeps until woken
+        atomic<bool> Woken{ false };
+
+        atomic<uint64_t> Records{ 0 };
+        atomic<uint64_t> Dropped{ 0 };
+        atomic<uint64_t> Bytes{ 0 };
+        atomic<uint64_t> Flushes{ 0 };
+    };
+
+    LogState& State()
+    {
+        static LogState s_State;
+        return s_State;
+    }
+
+    thread_local LogRing* t_pRing = nullptr;
+
+    /// <summary>
+    /// Gives the calling thread its ring and retires the ring when the thread exits.
+    /// </summary>
+    struct ThreadRing
+    {
+        ~ThreadRing()
+        {
+            if (pRing)
+            {
+                pRing->Retired.store(true, memory_order_release);
+            }
+            t_pRing = nullptr;
+        }
+
+        shared_ptr<LogRing> pRing;
+    };
+
+    thread_local ThreadRing t_Ring;
+
+    LogRing* CreateRing()
+    {
+        LogState& Log = State();
+        lock_guard<mutex> Lock(Log.Lock);
+
+        shared_ptr<LogRing> Ring = make_shared<LogRing>(Log.RingCapacity, Log.NextThread++);
+        Log.Rings.push_back(Ring);
+
+        t_Ring.pRing = Ring;
+        t_pRing = Ring.get();
+        return t_pRing;
+    }
+
+    void Append(vector<uint8_t>& Chunk, const void* pData, size_t Size)
+    {
+        const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+        Chunk.insert(Chunk.end(), pBytes, pBytes + Size);
+    }
+
+    void AppendString(vector<uint8_t>& Chunk, const char* Text)
+    {
+        Append(Chunk, Text, strlen(Text) + 1);
+    }
+
+    void WriteChunk(LogState& Log, LogChunkKind Kind, const void* pData, size_t Size)
+    {
+        LogChunkHeader Header = { static_cast<uint32_t>(Kind), static_cast<uint32_t>(Size) };
+        fwrite(&Header, sizeof(Header), 1, Log.pFile);
+        fwrite(pData, 1, Size, Log.pFile);
+        Log.Bytes.fetch_add(sizeof(Header) + Size, memory_order_relaxed);
+    }
+
+    // Moves everything on the rings to the file. Returns false if there was nothing to write.
+    bool FlushRings(LogState& Log)
+    {
+        vector<shared_ptr<LogRing>> Rings;
+        {
+            lock_guard<mutex> Lock(Log.Lock);
+            Rings = Log.Rings;
+        }
+
+        // A ring is only freed if it was retired before it was drained, so nothing can be pushed after the drain
+        Log.Batch.clear();
+        vector<LogRing*> Drained;
+        for (const shared_ptr<LogRing>& Ring : Rings)
+        {
+            bool Retired = Ring->Retired.load(memory_order_acquire);
+
+            LogRecord Record;
+            while (Ring->Records.TryPop(Record))
+            {
+                Record.Thread = Ring->Thread;
+                Log.Batch.push_back(Record);
+            }
+
+            if (Retired)
+            {
+                Drained.push_back(Ring.get());
+            }
+        }
+
+        // Every site a drained record refers to was registered before the record was pushed
+        vector<LogSiteEntry> NewSites;
+        {
+            lock_guard<mutex> Lock(Log.Lock);
+            NewSites.assign(Log.Sites.begin() + Log.SitesWritten, Log.Sites.end());
+            Log.SitesWritten = Log.Sites.size();
+        }
+
+        bool Wrote = false;
+        uint32_t Id = static_cast<uint32_t>(Log.SitesWritten - NewSites.size());
+        for (const LogSiteEntry& Entry : NewSites)
+        {
+            Id++;
+            uint32_t Fields[] = { Id, Entry.pSite->Line, static_cast<uint32_t>(Entry.pSite->Level) };
+
+            Log.Chunk.clear();
+            Append(Log.Chunk, Fields, sizeof(Fields));
+            AppendString(Log.Chunk, Entry.pSite->Format);
+            AppendString(Log.Chunk, Entry.pSite->File);
+            AppendString(Log.Chunk, Entry.pSite->Function);
+            AppendString(Log.Chunk, Entry.Types);
+            WriteChunk(Log, LogChunkKind::Site, Log.Chunk.data(), Log.Chunk.size());
+            Wrote = true;
+        }
+
+        if (!Log.Batch.empty())
+        {
+            WriteChunk(Log, LogChunkKind::Records, Log.Batch.data(), Log.Batch.size() * sizeof(LogRecord));
+            Log.Records.fetch_add(Log.Batch.size(), memory_order_relaxed);
+            Wrote = true;
+        }
+
+        for (const shared_ptr<LogRing>& Ring : Rings)
+        {
+            uint64_t Dropped = Ring->Dropped.load(memory_order_relaxed);
+            if (Dropped != Ring->DroppedWritten)
+            {
+                LogDroppedChunk Chunk = { Ring->Thread, 0, Dropped - Ring->DroppedWritten };
+                WriteChunk(Log, LogChunkKind::Dropped, &Chunk, sizeof(Chunk));
+                Log.Dropped.fetch_add(Chunk.Count, memory_order_relaxed);
+                Ring->DroppedWritten = Dropped;
+                Wrote = true;
+            }
+        }
+
+        if (!Drained.empty())
+        {
+            lock_guard<mutex> Lock(Log.Lock);
+            for (LogRing* pRing : Drained)
+            {
+                for (size_t i = 0; i < Log.Rings.size(); i++)
+                {
+                    if (Log.Rings[i].get() == pRing)
+                    {
+                        Log.Rings.erase(Log.Rings.begin() + i);
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (Wrote)
+        {
+            fflush(Log.pFile);
+            Log.Flushes.fetch_add(1, memory_order_relaxed);
+        }
+
+        return Wrote;
+    }
+
+    void FlusherThread()
+    {
+        LogState& Log = State();
+
+        for (;;)
+        {
+            bool Wrote = FlushRings(Log);
+
+            unique_lock<mutex> Lock(Log.Lock);
+            if (Log.Stop)
+            {
+                return;
+            }
+
+            // While records flow, flush on a short period; once they stop, sleep until a logging thread wakes us.
+            // A thread also wakes us early when its ring fills up faster than the period drains it.
+            Log.Idle.store(!Wrote, memory_order_relaxed);
+            uint32_t IntervalMs = Wrote ? Log.FlushIntervalMs : IdleFlushIntervalMs;
+            Log.Wake.wait_for(Lock, chrono::milliseconds(IntervalMs), [&Log] { return Log.Stop || Log.Woken.load(memory_order_relaxed); });
+            Log.Woken.store(false, memory_order_relaxed);
+            Log.Idle.store(false, memory_order_relaxed);
+        }
+    }
+}
+
+bool BinaryLog::Open(const char* Path, uint32_t RingCapacity, uint32_t FlushIntervalMs)
+{
+    LogState& Log = State();
+    if (Log.pFile)
+    {
+        return false;
+    }
+
+    Log.pFile = fopen(Path, "wb");
+    if (!Log.pFile)
+    {
+        return false;
+    }
+
+    LogFileHeader Header = {};
+    memcpy(Header.Magic, LogFileMagic, sizeof(Header.Magic));
+    Header.Version = LogFileVersion;
+    Header.RecordSize = sizeof(LogRecord);
+    Header.OpenTime = MonotonicNanoseconds();
+    fwrite(&Header, sizeof(Header), 1, Log.pFile);
+
+    {
+        lock_guard<mutex> Lock(Log.Lock);
+        Log.RingCapacity = RingCapacity;
+        Log.FlushIntervalMs = FlushIntervalMs;
+        Log.Stop = false;
+
+        // Every file carries the definitions of the sites it uses, even those first used for an earlier file
+        Log.SitesWritten = 0;
+    }
+
+    Log.Records = 0;
+    Log.Dropped = 0;
+    Log.Bytes = sizeof(Header);
+    Log.Flushes = 0;
+
+    Log.Flusher = thread(FlusherThread);
+    s_Open.store(true, memory_order_release);
+    return true;
+}
+
+void BinaryLog::Close()
+{
+    LogState& Log = State();
+    if (!Log.pFile)
+    {
+        return;
+    }
+
+    s_Open.store(false, memory_order_release);
+
+    {
+        lock_guard<mutex> Lock(Log.Lock);
+        Log.Stop = true;
+    }
+    Log.Wake.notify_one();
+    Log.Flusher.join();
+
+    // Whatever was logged while the flusher stopped
+    FlushRings(Log);
+
+    fclose(Log.pFile);
+    Log.pFile = nullptr;
+}
+
+BinaryLogStatistics BinaryLog::Statistics()
+{
+    LogState& Log = State();
+
+    BinaryLogStatistics Statistics = {};
+    Statistics.Records = Log.Records.load(memory_order_relaxed);
+    Statistics.Bytes = Log.Bytes.load(memory_order_relaxed);
+    Statistics.Flushes = Log.Flushes.load(memory_order_relaxed);
+
+    Statistics.Dropped = Log.Dropped.load(memory_order_relaxed);
+
+    lock_guard<mutex> Lock(Log.Lock);
+    Statistics.Threads = static_cast<uint32_t>(Log.Rings.size());
+    return Statistics;
+}
+
+uint32_t BinaryLog::Register(LogSite& Site, const char* Types)
+{
+    LogState& Log = State();
+    lock_guard<mutex> Lock(Log.Lock);
+
+    // Another thread may have registered the site meanwhile
+    uint32_t Id = Site.Id.load(memory_order_relaxed);
+    if (Id == 0)
+    {
+        Log.Sites.push_back({ &Site, Types });
+        Id = static_cast<uint32_t>(Log.Sites.size());
+        Site.Id.store(Id, memory_order_release);
+    }
+    return Id;
+}
+
+void BinaryLog::Push(LogRecord& Record)
+{
+    LogRing* pRing = t_pRing;
+    if (!pRing)
+    {
+        pRing = CreateRing();
+    }
+
+    if (!pRing->Records.TryPush(Record))
+    {
+        pRing->Dropped.store(pRing->Dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        return;
+    }
+
+    // Wake the flusher for the first record after it went idle, and whenever a quarter of the ring filled up. A
+    // wakeup missed here only delays the write.
+    LogState& Log = State();
+    if (++pRing->Unannounced >= pRing->Records.Capacity() / 4 || Log.Idle.load(memory_order_relaxed))
+    {
+        pRing->Unannounced = 0;
+        if (!Log.Woken.exchange(true, memory_order_relaxed))
+        {
+            lock_guard<mutex> Lock(Log.Lock);
+            Log.Wake.notify_one();
+        }
+    }
+}
@@ -0,0 +1,204 @@
+/*++
+
+Module Name:
+
+    binary_log.h
+
+Abstract:
+
+    This module contains an asynchronous binary log. A log call copies a timestamp, the id of its call site and its
+    arguments into a fixed-size record on a ring owned by the calling thread; a background thread moves the records
+    to the file. Formatting happens offline, in logfmt, from the call-site definitions the file carries.
+
+    Calls below IDD_LOG_MIN_LEVEL compile to nothing, arguments included.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "frame.h"
+
+// 0 = Trace, 1 = Info, 2 = Warning, 3 = Error; 4 compiles every call out
+#ifndef IDD_LOG_MIN_LEVEL
+#define IDD_LOG_MIN_LEVEL 1
+#endif
+
+#define IDD_LOG(Level, Format, ...)                                                                                 \
+    do                                                                                                              \
+    {                                                                                                               \
+        if constexpr (static_cast<int>(Level) >= IDD_LOG_MIN_LEVEL)                                                 \
+        {                                                                                                           \
+            static ::Microsoft::IndirectDisp::LogSite s_LogSite = { Format, __FILE__, __FUNCTION__, __LINE__, Level, { 0 } }; \
+            ::Microsoft::IndirectDisp::BinaryLog::Write(s_LogSite, ##__VA_ARGS__);                                  \
+        }                                                                                                           \
+    } while (0)
+
+#define IDD_LOG_TRACE(Format, ...) IDD_LOG(::Microsoft::IndirectDisp::LogLevel::Trace, Format, ##__VA_ARGS__)
+#define IDD_LOG_INFO(Format, ...) IDD_LOG(::Microsoft::IndirectDisp::LogLevel::Info, Format, ##__VA_ARGS__)
+#define IDD_LOG_WARNING(Format, ...) IDD_LOG(::Microsoft::IndirectDisp::LogLevel::Warning, Format, ##__VA_ARGS__)
+#define IDD_LOG_ERROR(Format, ...) IDD_LOG(::Microsoft::IndirectDisp::LogLevel::Error, Format, ##__VA_ARGS__)
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        enum class LogLevel : uint32_t
+        {
+            Trace = 0,
+            Info,
+            Warning,
+            Error,
+        };
+
+        /// <summary>
+        /// What a log call knows at compile time. Written to the file once, the first time the call is made.
+        /// </summary>
+        struct LogSite
+        {
+            const char* Format;     // printf-style; strings must be part of it, as only their address could be kept
+            const char* File;
+            const char* Function;
+            uint32_t Line;
+            LogLevel Level;
+            std::atomic<uint32_t> Id;   // 0 until first used
+        };
+
+        const uint32_t LogMaxArguments = 6;
+
+        /// <summary>
+        /// One log call as it is stored on the rings and in the file.
+        /// </summary>
+        struct LogRecord
+        {
+            uint64_t Timestamp;     // MonotonicNanoseconds
+            uint32_t Site;
+            uint16_t Thread;        // numbered in the order threads first logged
+            uint8_t ArgumentCount;
+            uint8_t Reserved;
+            uint64_t Arguments[LogMaxArguments];
+        };
+
+        static_assert(sizeof(LogRecord) == 64, "a log record is meant to fill one cache line");
+
+        struct BinaryLogStatistics
+        {
+            uint64_t Records;       // written to the file
+            uint64_t Dropped;       // lost because their thread's ring was full, as noted in the file
+            uint64_t Bytes;
+            uint64_t Flushes;
+            uint32_t Threads;       // rings currently allocated
+        };
+
+        template <typename T, bool = std::is_enum<T>::value>
+        struct LogInteger
+        {
+            typedef T Type;
+        };
+
+        template <typename T>
+        struct LogInteger<T, true>
+        {
+            typedef typename std::underlying_type<T>::type Type;
+        };
+
+        // How an argument was passed, so the formatter can print it as printf would have; see LogChunkKind::Site
+        template <typename T>
+        constexpr char LogArgumentType()
+        {
+            return std::is_floating_point<T>::value ? 'f' :
+                std::is_pointer<T>::value ? 'p' :
+                std::is_signed<typename LogInteger<T>::Type>::value ?
+                    (sizeof(T) == 1 ? 'b' : sizeof(T) == 2 ? 'h' : sizeof(T) == 4 ? 'i' : 'l') :
+                    (sizeof(T) == 1 ? 'B' : sizeof(T) == 2 ? 'H' : sizeof(T) == 4 ? 'I' : 'L');
+        }
+
+        template <typename T>
+        inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint64_t>::type EncodeLogArgument(T Value)
+        {
+            // Signed values are sign-extended, so the formatter can widen them back
+            return static_cast<uint64_t>(static_cast<int64_t>(Value));
+        }
+
+        template <typename T>
+        inline typename std::enable_if<std::is_floating_point<T>::value, uint64_t>::type EncodeLogArgument(T Value)
+        {
+            double Widened = Value;
+            uint64_t Bits;
+            memcpy(&Bits, &Widened, sizeof(Bits));
+            return Bits;
+        }
+
+        template <typename T>
+        inline uint64_t EncodeLogArgument(T* Value)
+        {
+            static_assert(!std::is_same<typename std::remove_cv<T>::type, char>::value &&
+                !std::is_same<typename std::remove_cv<T>::type, wchar_t>::value,
+                "the log keeps only the address of a string; put constant text in the format instead");
+            return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(Value));
+        }
+
+        /// <summary>
+        /// The process-wide log. Each logging thread gets a ring of its own the first time it logs; a full ring drops
+        /// the record rather than blocking the caller.
+        /// </summary>
+        class BinaryLog
+        {
+        public:
+            static const uint32_t DefaultRingCapacity = 4096;
+            static const uint32_t DefaultFlushIntervalMs = 50;
+
+            // Starts writing to Path. Logging is off until this succeeds and after Close.
+            static bool Open(const char* Path, uint32_t RingCapacity = DefaultRingCapacity, uint32_t FlushIntervalMs = DefaultFlushIntervalMs);
+
+            // Writes everything logged so far and closes the file
+            static void Close();
+
+            static bool IsOpen() { return s_Open.load(std::memory_order_relaxed); }
+
+            static BinaryLogStatistics Statistics();
+
+            template <typename... Args>
+            static void Write(LogSite& Site, Args... Values)
+            {
+                static_assert(sizeof...(Args) <= LogMaxArguments, "too many log arguments");
+
+                if (!IsOpen())
+                {
+                    return;
+                }
+
+                uint32_t Id = Site.Id.load(std::memory_order_acquire);
+                if (Id == 0)
+                {
+                    static const char Types[] = { LogArgumentType<Args>()..., '\0' };
+                    Id = Register(Site, Types);
+                }
+
+                LogRecord Record = {};
+                Record.Timestamp = MonotonicNanoseconds();
+                Record.Site = Id;
+                Record.ArgumentCount = static_cast<uint8_t>(sizeof...(Args));
+
+                const uint64_t Encoded[] = { EncodeLogArgument(Values)..., 0 };
+                memcpy(Record.Arguments, Encoded, sizeof(uint64_t) * sizeof...(Args));
+
+                Push(Record);
+            }
+
+        private:
+            static uint32_t Register(LogSite& Site, const char* Types);
+            static void Push(LogRecord& Record);
+
+            static std::atomic<bool> s_Open;
+        };
+    }
+}
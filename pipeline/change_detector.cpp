@@ -0,0 +1,285 @@
+/*++
+
+Module Name:
+
+    change_detector.cpp
+
+Abstract:
+
+    This module contains the tile-hash change detector, its scalar hash kernel and the rectangle coalescing.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "change_detector.h"
+#include "change_detector_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+// splitmix64 output, seeded with the fractional digits of pi
+const uint64_t Microsoft::IndirectDisp::TileHashSecret[TileHashSecretStripes][8] =
+{
+    {
+        0x2CB0F69F4ABEA221ull, 0x9417034723148989ull, 0xDD555950609DFE03ull, 0xDBAFB150DEB12800ull,
+        0x7E789B2E6C442CB6ull, 0xF41E5636C7E4F8C4ull, 0x0959D150F8FBA7E4ull, 0xA97316F13CDB9EEAull,
+    },
+    {
+        0x74CD8258F9520068ull, 0x55C74A62E116868Bull, 0xD2F4C799A2023CBDull, 0xDF98CB79A37B51B9ull,
+        0x396F5885524F3905ull, 0xAF1D56386CA3B276ull, 0xA9FFBE6B5104E85Aull, 0x6BD0C51B9FD533B3ull,
+    },
+    {
+        0x980CE91C50AB4B56ull, 0x28AC395780FE62C5ull, 0x768912E3A6BCEDC7ull, 0x50B3E8C9332C7C88ull,
+        0xCE3BBFE520BD47DAull, 0xCBA6C8E8E0BB7C4Full, 0xBF194DB8434A346Dull, 0x7D8F2A7B60416D7Full,
+    },
+    {
+        0x0849D1F6E0E10A5Eull, 0x7654B590D064E22Full, 0x16D1DA9507DF3AF2ull, 0xF63AEF1089EA30E4ull,
+        0x9ADE6673CC6C522Bull, 0x4C75BC274E37087Cull, 0xD35E12B49F51F27Bull, 0x22DDF2FFCEE481EAull,
+    },
+    {
+        0x06007FB13C59A1F1ull, 0x8966A38C651EA4DAull, 0x25242F018FC01AC6ull, 0xA73EC74FA31B717Cull,
+        0x7EE0ABDD9797D3A2ull, 0x5C06FF7DC4AC1880ull, 0x8434E41042C28A7Dull, 0x770A372D64327351ull,
+    },
+    {
+        0xEED940DAD9E9C06Dull, 0x8977E93646524825ull, 0xA9897F0A62A51616ull, 0xA35D4250C53F2B3Aull,
+        0x4072542A94B9C33Eull, 0x3154A7A62447E8ABull, 0x686865712A1A245Eull, 0x0FBA67727D7B3B98ull,
+    },
+    {
+        0x0634E2024536912Full, 0xD9FF52A26CF9881Aull, 0x9435DC0399F932DAull, 0x18D39FC1AF93E7F0ull,
+        0x12F7147C1E7F46ABull, 0xDEDF66783EDDB4A0ull, 0x6F75480614554798ull, 0xE40E95E8EF84BDE2ull,
+    },
+    {
+        0xBB41FE601FEFB566ull, 0x5C3702E4C7BF19F1ull, 0x8C7D1D0D3D4A8EC5ull, 0xEE779996BA62DCCBull,
+        0x80CCB15BF530844Bull, 0xDF56E7DC4D57959Cull, 0x9EB86A81FE90B68Eull, 0x6A25741FA696FBD3ull,
+    },
+};
+
+namespace
+{
+    const uint64_t GoldenRatio = 0x9E3779B97F4A7C15ull;
+
+    void AccumulateStripe(const uint8_t* pData, uint32_t Stripe, uint64_t RowKey, uint64_t* pLanes)
+    {
+        uint64_t Words[8];
+        memcpy(Words, pData, sizeof(Words));
+
+        const uint64_t* pSecret = TileHashSecret[Stripe % TileHashSecretStripes];
+        for (int i = 0; i < 8; i++)
+        {
+            uint64_t Key = Words[i] ^ (pSecret[i] + RowKey);
+            pLanes[i] += Words[i ^ 1] + (Key & 0xFFFFFFFFull) * (Key >> 32);
+        }
+    }
+
+    // The narrower last tile column: whole stripes, then the remainder zero-padded to a stripe
+    void AccumulatePartialTileRow(const uint8_t* pRow, uint32_t Bytes, uint64_t RowKey, TileAccumulator& Accumulator)
+    {
+        uint32_t Stripe = 0;
+        for (; (Stripe + 1) * TileHashStripeBytes <= Bytes; Stripe++)
+        {
+            AccumulateStripe(pRow + Stripe * TileHashStripeBytes, Stripe, RowKey, Accumulator.Lanes);
+        }
+
+        uint32_t Remainder = Bytes - Stripe * TileHashStripeBytes;
+        if (Remainder != 0)
+        {
+            uint8_t Padded[TileHashStripeBytes] = {};
+            memcpy(Padded, pRow + Stripe * TileHashStripeBytes, Remainder);
+            AccumulateStripe(Padded, Stripe, RowKey, Accumulator.Lanes);
+        }
+    }
+
+    uint64_t Mix(uint64_t Value)
+    {
+        Value ^= Value >> 33;
+        Value *= 0xFF51AFD7ED558CCDull;
+        Value ^= Value >> 33;
+        return Value;
+    }
+}
+
+void Microsoft::IndirectDisp::AccumulateTileRowScalar(const uint8_t* pRow, uint32_t TileCount, uint32_t StripesPerTile, uint64_t RowKey, TileAccumulator* pAccumulators)
+{
+    for (uint32_t t = 0; t < TileCount; t++)
+    {
+        for (uint32_t s = 0; s < StripesPerTile; s++)
+        {
+            AccumulateStripe(pRow + (static_cast<size_t>(t) * StripesPerTile + s) * TileHashStripeBytes, s, RowKey, pAccumulators[t].Lanes);
+        }
+    }
+}
+
+uint64_t Microsoft::IndirectDisp::FinalizeTileHash(const TileAccumulator& Accumulator)
+{
+    uint64_t Hash = 0x27D4EB2F165667C5ull;
+    for (int i = 0; i < 8; i++)
+    {
+        Hash = (Hash ^ Mix(Accumulator.Lanes[i])) * GoldenRatio;
+        Hash = (Hash << 31) | (Hash >> 33);
+    }
+
+    return Hash ^ (Hash >> 32);
+}
+
+TileRowKernel Microsoft::IndirectDisp::SelectTileRowKernel(SimdLevel Level)
+{
+    switch (ClampSimdLevel(Level))
+    {
+#if IDD_X86
+    case SimdLevel::Avx512:
+        return AccumulateTileRowAvx512;
+    case SimdLevel::Avx2:
+        return AccumulateTileRowAvx2;
+    case SimdLevel::Sse41:
+        return AccumulateTileRowSse41;
+#endif
+    default:
+        return AccumulateTileRowScalar;
+    }
+}
+
+TileChangeDetector::TileChangeDetector(uint32_t TileSize, SimdLevel Level)
+    : m_TileSize(TileSize == 0 ? 16 : (TileSize + 15) / 16 * 16)
+    , m_Level(Level)
+    , m_Width(0)
+    , m_Height(0)
+    , m_Columns(0)
+    , m_Rows(0)
+    , m_HasPrevious(false)
+    , m_ChangedCount(0)
+{
+}
+
+void TileChangeDetector::Reset()
+{
+    m_HasPrevious = false;
+}
+
+bool TileChangeDetector::IsTileChanged(uint32_t Column, uint32_t Row) const
+{
+    size_t Index = static_cast<size_t>(Row) * m_Columns + Column;
+    return (m_Changed[Index / 64] >> (Index % 64)) & 1;
+}
+
+void TileChangeDetector::Detect(const uint8_t* pData, uint32_t Pitch, uint32_t Width, uint32_t Height)
+{
+    if (Width != m_Width || Height != m_Height)
+    {
+        m_Width = Width;
+        m_Height = Height;
+        m_Columns = (Width + m_TileSize - 1) / m_TileSize;
+        m_Rows = (Height + m_TileSize - 1) / m_TileSize;
+        m_Accumulators.resize(m_Columns);
+        m_Hashes.assign(static_cast<size_t>(m_Columns) * m_Rows, 0);
+        m_HasPrevious = false;
+    }
+
+    size_t TileCount = static_cast<size_t>(m_Columns) * m_Rows;
+    m_Changed.assign((TileCount + 63) / 64, 0);
+    m_ChangedCount = 0;
+
+    const TileRowKernel Kernel = SelectTileRowKernel(m_Level);
+    const uint32_t FullTiles = Width / m_TileSize;
+    const uint32_t RemainderBytes = (Width % m_TileSize) * 4;
+    const uint32_t StripesPerTile = m_TileSize * 4 / TileHashStripeBytes;
+
+    for (uint32_t Row = 0; Row < m_Rows; Row++)
+    {
+        memset(m_Accumulators.data(), 0, m_Accumulators.size() * sizeof(TileAccumulator));
+
+        uint32_t Top = Row * m_TileSize;
+        uint32_t Bottom = min(Height, Top + m_TileSize);
+
+        for (uint32_t y = Top; y < Bottom; y++)
+        {
+            const uint8_t* pRow = pData + static_cast<size_t>(y) * Pitch;
+            uint64_t RowKey = (y - Top + 1) * GoldenRatio;
+
+            Kernel(pRow, FullTiles, StripesPerTile, RowKey, m_Accumulators.data());
+            if (RemainderBytes != 0)
+            {
+                AccumulatePartialTileRow(pRow + static_cast<size_t>(FullTiles) * m_TileSize * 4, RemainderBytes, RowKey, m_Accumulators[FullTiles]);
+            }
+        }
+
+        for (uint32_t Column = 0; Column < m_Columns; Column++)
+        {
+            size_t Index = static_cast<size_t>(Row) * m_Columns + Column;
+            uint64_t Hash = FinalizeTileHash(m_Accumulators[Column]);
+
+            if (!m_HasPrevious || Hash != m_Hashes[Index])
+            {
+                m_Changed[Index / 64] |= 1ull << (Index % 64);
+                m_ChangedCount++;
+            }
+
+            m_Hashes[Index] = Hash;
+        }
+    }
+
+    m_HasPrevious = true;
+    Coalesce();
+}
+
+void TileChangeDetector::Coalesce()
+{
+    // Runs of changed tiles in a row become rectangles; a run spanning exactly the same columns as one in the row
+    // above extends that rectangle downwards instead
+    m_Rects.clear();
+
+    vector<size_t> Open;
+    vector<size_t> NextOpen;
+
+    for (uint32_t Row = 0; Row < m_Rows; Row++)
+    {
+        int32_t Top = static_cast<int32_t>(Row * m_TileSize);
+        int32_t Bottom = static_cast<int32_t>(min(m_Height, (Row + 1) * m_TileSize));
+        size_t Candidate = 0;
+
+        NextOpen.clear();
+
+        for (uint32_t Column = 0; Column < m_Columns;)
+        {
+            if (!IsTileChanged(Column, Row))
+            {
+                Column++;
+                continue;
+            }
+
+            uint32_t End = Column + 1;
+            while (End < m_Columns && IsTileChanged(End, Row))
+            {
+                End++;
+            }
+
+            int32_t Left = static_cast<int32_t>(Column * m_TileSize);
+            int32_t Right = static_cast<int32_t>(min(m_Width, End * m_TileSize));
+
+            while (Candidate < Open.size() && m_Rects[Open[Candidate]].Left < Left)
+            {
+                Candidate++;
+            }
+
+            if (Candidate < Open.size() && m_Rects[Open[Candidate]].Left == Left && m_Rects[Open[Candidate]].Right == Right)
+            {
+                m_Rects[Open[Candidate]].Bottom = Bottom;
+                NextOpen.push_back(Open[Candidate]);
+            }
+            else
+            {
+                NextOpen.push_back(m_Rects.size());
+                m_Rects.push_back({ Left, Top, Right, Bottom });
+            }
+
+            Column = End;
+        }
+
+        Open.swap(NextOpen);
+    }
+}
@@ -0,0 +1,86 @@
+/*++
+
+Module Name:
+
+    change_detector.h
+
+Abstract:
+
+    This module contains the tile-hash change detector. It splits each BGRA frame into square tiles, hashes every
+    tile in one streaming pass over the frame and compares the hashes with those of the previous frame, producing a
+    changed-tile bitmap and the changed area as a short list of coalesced rectangles.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.h"
+#include "frame.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Running state of one tile's hash: eight 64-bit lanes, one 64-byte stripe wide.
+        /// </summary>
+        struct alignas(64) TileAccumulator
+        {
+            uint64_t Lanes[8];
+        };
+
+        /// <summary>
+        /// Detects which tiles of a frame changed since the previous frame.
+        /// </summary>
+        class TileChangeDetector
+        {
+        public:
+            // TileSize is rounded up to a multiple of 16 pixels so a tile row is a whole number of 64-byte stripes
+            explicit TileChangeDetector(uint32_t TileSize = 64, SimdLevel Level = DetectSimdLevel());
+
+            // Hashes a BGRA frame and diffs it against the previous one. The first frame, and any frame after a size
+            // change or Reset, reports every tile as changed.
+            void Detect(const uint8_t* pData, uint32_t Pitch, uint32_t Width, uint32_t Height);
+
+            // Forgets the previous frame
+            void Reset();
+
+            uint32_t TileSize() const { return m_TileSize; }
+            uint32_t TileColumns() const { return m_Columns; }
+            uint32_t TileRows() const { return m_Rows; }
+
+            // One bit per tile in row-major order: tile (Column, Row) is bit Row * TileColumns() + Column
+            const std::vector<uint64_t>& ChangedBitmap() const { return m_Changed; }
+            bool IsTileChanged(uint32_t Column, uint32_t Row) const;
+            uint32_t ChangedTileCount() const { return m_ChangedCount; }
+
+            // Non-overlapping rectangles covering exactly the changed tiles, clipped to the frame
+            const std::vector<Rect>& ChangedRects() const { return m_Rects; }
+
+        private:
+            void Coalesce();
+
+            const uint32_t m_TileSize;
+            const SimdLevel m_Level;
+
+            uint32_t m_Width;
+            uint32_t m_Height;
+            uint32_t m_Columns;
+            uint32_t m_Rows;
+            bool m_HasPrevious;
+
+            std::vector<TileAccumulator> m_Accumulators;    // one tile row in flight
+            std::vector<uint64_t> m_Hashes;                 // previous frame, one per tile
+            std::vector<uint64_t> m_Changed;
+            uint32_t m_ChangedCount;
+            std::vector<Rect> m_Rects;
+        };
+    }
+}
@@ -0,0 +1,60 @@
+/*++
+
+Module Name:
+
+    change_detector_kernels.h
+
+Abstract:
+
+    This module contains the tile hash row kernels behind TileChangeDetector. It is private to the pipeline: the
+    motion detector reuses the kernels to hash row segments.
+
+    Every 64-byte stripe of a tile row is folded into the tile's eight 64-bit lanes. Per lane, with the stripe's
+    secret key K and a key R derived from the row index:
+
+        Key = Data ^ (K + R)
+        Lane += Data[Lane ^ 1] + low32(Key) * high32(Key)
+
+    The per-row key makes the sum depend on row order. All tiers compute exactly this, so hashes are comparable
+    no matter which tier produced them.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "change_detector.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const uint32_t TileHashStripeBytes = 64;
+        const uint32_t TileHashSecretStripes = 8;
+
+        // Eight stripes' worth of keys; stripe s of a tile row uses row s % TileHashSecretStripes
+        extern const uint64_t TileHashSecret[TileHashSecretStripes][8];
+
+        // Accumulates one row of TileCount whole tiles, StripesPerTile stripes each, into pAccumulators
+        typedef void (*TileRowKernel)(const uint8_t* pRow, uint32_t TileCount, uint32_t StripesPerTile, uint64_t RowKey, TileAccumulator* pAccumulators);
+
+        void AccumulateTileRowScalar(const uint8_t* pRow, uint32_t TileCount, uint32_t StripesPerTile, uint64_t RowKey, TileAccumulator* pAccumulators);
+
+        // The fastest kernel available at or below Level
+        TileRowKernel SelectTileRowKernel(SimdLevel Level);
+
+        // Folds a tile's eight lanes into its 64-bit hash
+        uint64_t FinalizeTileHash(const TileAccumulator& Accumulator);
+
+#if IDD_X86
+        void AccumulateTileRowSse41(const uint8_t* pRow, uint32_t TileCount, uint32_t StripesPerTile, uint64_t RowKey, TileAccumulator* pAccumulators);
+        void AccumulateTileRowAvx2(const uint8_t* pRow, uint32_t TileCount, uint32_t StripesPerTile, uint64_t RowKey, TileAccumulator* pAccumulators);
+        void AccumulateTileRowAvx512(const uint8_t* pRow, uint32_t TileCount, uint32_t StripesPerTile, uint64_t RowKey, TileAccumulator* pAccumulators);
+#endif
+    }
+}
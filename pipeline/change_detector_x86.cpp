@@ -0,0 +1,154 @@
+/*++
+
+Module Name:
+
+    change_detector_x86.cpp
+
+Abstract:
+
+    This module contains the SSE4.1, AVX2 and AVX-512 tile hash row kernels. Each tier keeps a tile's eight lanes
+    in four, two or one register(s) and swaps neighbouring lanes with a 32-bit shuffle inside every 128 bits.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "change_detector_kernels.h"
+
+#if IDD_X86
+
+#include <immintrin.h>
+
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    IDD_TARGET_SSE41 inline __m128i AccumulateSse41(__m128i Lanes, __m128i Data, __m128i Key)
+    {
+        __m128i Keyed = _mm_xor_si128(Data, Key);
+        __m128i Product = _mm_mul_epu32(Keyed, _mm_srli_epi64(Keyed, 32));
+        __m128i Swapped = _mm_shuffle_epi32(Data, _MM_SHUFFLE(1, 0, 3, 2));
+        return _mm_add_epi64(Lanes, _mm_add_epi64(Product, Swapped));
+    }
+
+    IDD_TARGET_AVX2 inline __m256i AccumulateAvx2(__m256i Lanes, __m256i Data, __m256i Key)
+    {
+        __m256i Keyed = _mm256_xor_si256(Data, Key);
+        __m256i Product = _mm256_mul_epu32(Keyed, _mm256_srli_epi64(Keyed, 32));
+        __m256i Swapped = _mm256_shuffle_epi32(Data, _MM_SHUFFLE(1, 0, 3, 2));
+        return _mm256_add_epi64(Lanes, _mm256_add_epi64(Product, Swapped));
+    }
+
+    IDD_TARGET_AVX512 inline __m512i AccumulateAvx512(__m512i Lanes, __m512i Data, __m512i Key)
+    {
+        __m512i Keyed = _mm512_xor_si512(Data, Key);
+        __m512i Product = _mm512_mul_epu32(Keyed, _mm512_srli_epi64(Keyed, 32));
+        __m512i Swapped = _mm512_shuffle_epi32(Data, _MM_PERM_BADC);
+        return _mm512_add_epi64(Lanes, _mm512_add_epi64(Product, Swapped));
+    }
+}
+
+IDD_TARGET_SSE41 void Microsoft::IndirectDisp::AccumulateTileRowSse41(
+    const uint8_t* pRow,
+    uint32_t TileCount,
+    uint32_t StripesPerTile,
+    uint64_t RowKey,
+    TileAccumulator* pAccumulators)
+{
+    const __m128i Row = _mm_set1_epi64x(static_cast<long long>(RowKey));
+    __m128i Keys[TileHashSecretStripes][4];
+    for (uint32_t s = 0; s < TileHashSecretStripes; s++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            Keys[s][i] = _mm_add_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&TileHashSecret[s][i * 2])), Row);
+        }
+    }
+
+    for (uint32_t t = 0; t < TileCount; t++)
+    {
+        __m128i* pLanes = reinterpret_cast<__m128i*>(pAccumulators[t].Lanes);
+        __m128i Lanes[4] = { _mm_load_si128(pLanes), _mm_load_si128(pLanes + 1), _mm_load_si128(pLanes + 2), _mm_load_si128(pLanes + 3) };
+
+        for (uint32_t s = 0; s < StripesPerTile; s++)
+        {
+            const __m128i* pData = reinterpret_cast<const __m128i*>(pRow + (static_cast<size_t>(t) * StripesPerTile + s) * TileHashStripeBytes);
+            const __m128i* pKey = Keys[s % TileHashSecretStripes];
+            for (int i = 0; i < 4; i++)
+            {
+                Lanes[i] = AccumulateSse41(Lanes[i], _mm_loadu_si128(pData + i), pKey[i]);
+            }
+        }
+
+        for (int i = 0; i < 4; i++)
+        {
+            _mm_store_si128(pLanes + i, Lanes[i]);
+        }
+    }
+}
+
+IDD_TARGET_AVX2 void Microsoft::IndirectDisp::AccumulateTileRowAvx2(
+    const uint8_t* pRow,
+    uint32_t TileCount,
+    uint32_t StripesPerTile,
+    uint64_t RowKey,
+    TileAccumulator* pAccumulators)
+{
+    const __m256i Row = _mm256_set1_epi64x(static_cast<long long>(RowKey));
+    __m256i Keys[TileHashSecretStripes][2];
+    for (uint32_t s = 0; s < TileHashSecretStripes; s++)
+    {
+        Keys[s][0] = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&TileHashSecret[s][0])), Row);
+        Keys[s][1] = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&TileHashSecret[s][4])), Row);
+    }
+
+    for (uint32_t t = 0; t < TileCount; t++)
+    {
+        __m256i* pLanes = reinterpret_cast<__m256i*>(pAccumulators[t].Lanes);
+        __m256i Low = _mm256_load_si256(pLanes);
+        __m256i High = _mm256_load_si256(pLanes + 1);
+
+        for (uint32_t s = 0; s < StripesPerTile; s++)
+        {
+            const __m256i* pData = reinterpret_cast<const __m256i*>(pRow + (static_cast<size_t>(t) * StripesPerTile + s) * TileHashStripeBytes);
+            const __m256i* pKey = Keys[s % TileHashSecretStripes];
+            Low = AccumulateAvx2(Low, _mm256_loadu_si256(pData), pKey[0]);
+            High = AccumulateAvx2(High, _mm256_loadu_si256(pData + 1), pKey[1]);
+        }
+
+        _mm256_store_si256(pLanes, Low);
+        _mm256_store_si256(pLanes + 1, High);
+    }
+}
+
+IDD_TARGET_AVX512 void Microsoft::IndirectDisp::AccumulateTileRowAvx512(
+    const uint8_t* pRow,
+    uint32_t TileCount,
+    uint32_t StripesPerTile,
+    uint64_t RowKey,
+    TileAccumulator* pAccumulators)
+{
+    const __m512i Row = _mm512_set1_epi64(static_cast<long long>(RowKey));
+    __m512i Keys[TileHashSecretStripes];
+    for (uint32_t s = 0; s < TileHashSecretStripes; s++)
+    {
+        Keys[s] = _mm512_add_epi64(_mm512_loadu_si512(TileHashSecret[s]), Row);
+    }
+
+    for (uint32_t t = 0; t < TileCount; t++)
+    {
+        __m512i Lanes = _mm512_load_si512(pAccumulators[t].Lanes);
+
+        for (uint32_t s = 0; s < StripesPerTile; s++)
+        {
+            const uint8_t* pData = pRow + (static_cast<size_t>(t) * StripesPerTile + s) * TileHashStripeBytes;
+            Lanes = AccumulateAvx512(Lanes, _mm512_loadu_si512(pData), Keys[s % TileHashSecretStripes]);
+        }
+
+        _mm512_store_si512(pAccumulators[t].Lanes, Lanes);
+    }
+}
+
+#endif
@@ -0,0 +1,457 @@
+/*++
+
+Module Name:
+
+    color_convert.cpp
+
+Abstract:
+
+    This module contains the scalar reference of the BGRA to YUV converters, the per-CPU kernel selection and the
+    color conversion pipeline stage.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "color_convert.h"
+#include "color_convert_kernels.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    struct RowKernels
+    {
+        LumaRowKernel Luma;
+        ChromaRowKernel Chroma;
+        Chroma444RowKernel Chroma444;
+        SplitEvenOddKernel SplitEvenOdd;
+    };
+
+    uint8_t ClampByte(int32_t Value)
+    {
+        return static_cast<uint8_t>(Value < 0 ? 0 : (Value > 255 ? 255 : Value));
+    }
+
+    int16_t Fixed(double Value)
+    {
+        return static_cast<int16_t>(lround(Value * 16384.0));
+    }
+
+    uint32_t LumaRowScalar(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& C)
+    {
+        for (uint32_t x = 0; x < Width; x++)
+        {
+            const uint8_t* pPixel = pSource + x * 4;
+            int32_t Sum = C.YB * pPixel[0] + C.YG * pPixel[1] + C.YR * pPixel[2];
+            pY[x] = ClampByte(((Sum + (1 << 13)) >> 14) + C.YOffset);
+        }
+
+        return Width;
+    }
+
+    uint32_t ChromaRowScalar(
+        const uint8_t* pRow0,
+        const uint8_t* pRow1,
+        uint8_t* pU,
+        uint8_t* pV,
+        uint32_t Width,
+        bool Interleave,
+        const YuvCoefficients& C)
+    {
+        for (uint32_t x = 0; x < Width; x += 2)
+        {
+            // An odd last column pairs with itself
+            uint32_t Right = (x + 1 < Width) ? x + 1 : x;
+
+            int32_t Sums[3];
+            for (int i = 0; i < 3; i++)
+            {
+                Sums[i] = pRow0[x * 4 + i] + pRow0[Right * 4 + i] + pRow1[x * 4 + i] + pRow1[Right * 4 + i];
+            }
+
+            int32_t U = C.UB * Sums[0] + C.UG * Sums[1] + C.UR * Sums[2];
+            int32_t V = C.VB * Sums[0] + C.VG * Sums[1] + C.VR * Sums[2];
+            uint8_t UByte = ClampByte(((U + (1 << 15)) >> 16) + 128);
+            uint8_t VByte = ClampByte(((V + (1 << 15)) >> 16) + 128);
+
+            if (Interleave)
+            {
+                pU[x] = UByte;
+                pU[x + 1] = VByte;
+            }
+            else
+            {
+                pU[x / 2] = UByte;
+                pV[x / 2] = VByte;
+            }
+        }
+
+        return Width;
+    }
+
+    uint32_t Chroma444RowScalar(const uint8_t* pSource, uint8_t* pU, uint8_t* pV, uint32_t Width, const YuvCoefficients& C)
+    {
+        for (uint32_t x = 0; x < Width; x++)
+        {
+            const uint8_t* pPixel = pSource + x * 4;
+            int32_t U = C.UB * pPixel[0] + C.UG * pPixel[1] + C.UR * pPixel[2];
+            int32_t V = C.VB * pPixel[0] + C.VG * pPixel[1] + C.VR * pPixel[2];
+            pU[x] = ClampByte(((U + (1 << 13)) >> 14) + 128);
+            pV[x] = ClampByte(((V + (1 << 13)) >> 14) + 128);
+        }
+
+        return Width;
+    }
+
+    uint32_t SplitEvenOddScalar(const uint8_t* pSource, uint8_t* pEven, uint8_t* pOdd, uint32_t Pairs)
+    {
+        for (uint32_t i = 0; i < Pairs; i++)
+        {
+            pEven[i] = pSource[i * 2];
+            pOdd[i] = pSource[i * 2 + 1];
+        }
+
+        return Pairs;
+    }
+
+    RowKernels SelectKernels(SimdLevel Level)
+    {
+        switch (ClampSimdLevel(Level))
+        {
+#if IDD_X86
+        case SimdLevel::Avx512:
+            return { LumaRowAvx512, ChromaRowAvx512, Chroma444RowAvx2, SplitEvenOddAvx2 };
+        case SimdLevel::Avx2:
+            return { LumaRowAvx2, ChromaRowAvx2, Chroma444RowAvx2, SplitEvenOddAvx2 };
+        case SimdLevel::Sse41:
+            return { LumaRowSse41, ChromaRowSse41, Chroma444RowScalar, SplitEvenOddScalar };
+#endif
+        default:
+            return { LumaRowScalar, ChromaRowScalar, Chroma444RowScalar, SplitEvenOddScalar };
+        }
+    }
+
+    void ConvertLumaRow(const RowKernels& Kernels, const uint8_t* pRow, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients)
+    {
+        uint32_t Done = Kernels.Luma(pRow, pY, Width, Coefficients);
+        LumaRowScalar(pRow + Done * 4, pY + Done, Width - Done, Coefficients);
+    }
+
+    void ConvertChroma444Row(const RowKernels& Kernels, const uint8_t* pRow, uint8_t* pU, uint8_t* pV, uint32_t Width, const YuvCoefficients& Coefficients)
+    {
+        uint32_t Done = Kernels.Chroma444(pRow, pU, pV, Width, Coefficients);
+        Chroma444RowScalar(pRow + Done * 4, pU + Done, pV + Done, Width - Done, Coefficients);
+    }
+
+    void SplitRow(const RowKernels& Kernels, const uint8_t* pSource, uint8_t* pEven, uint8_t* pOdd, uint32_t Pairs)
+    {
+        uint32_t Done = Kernels.SplitEvenOdd(pSource, pEven, pOdd, Pairs);
+        SplitEvenOddScalar(pSource + Done * 2, pEven + Done, pOdd + Done, Pairs - Done);
+    }
+}
+
+YuvCoefficients Microsoft::IndirectDisp::MakeYuvCoefficients(ColorMatrix Matrix, ColorRange Range)
+{
+    double Kr = (Matrix == ColorMatrix::Bt709) ? 0.2126 : 0.299;
+    double Kb = (Matrix == ColorMatrix::Bt709) ? 0.0722 : 0.114;
+
+    double LumaScale = (Range == ColorRange::Limited) ? 219.0 / 255.0 : 1.0;
+    double ChromaScale = (Range == ColorRange::Limited) ? 224.0 / 255.0 : 1.0;
+
+    YuvCoefficients C = {};
+
+    // Derive one coefficient of each row from the others so white lands exactly on the top of the range and
+    // grays carry exactly neutral chroma despite the rounding of the other two
+    C.YR = Fixed(Kr * LumaScale);
+    C.YB = Fixed(Kb * LumaScale);
+    C.YG = static_cast<int16_t>(Fixed(LumaScale) - C.YR - C.YB);
+
+    C.UB = Fixed(0.5 * ChromaScale);
+    C.UR = Fixed(-Kr / (2.0 * (1.0 - Kb)) * ChromaScale);
+    C.UG = static_cast<int16_t>(-C.UB - C.UR);
+
+    C.VR = Fixed(0.5 * ChromaScale);
+    C.VB = Fixed(-Kb / (2.0 * (1.0 - Kr)) * ChromaScale);
+    C.VG = static_cast<int16_t>(-C.VR - C.VB);
+
+    C.YOffset = (Range == ColorRange::Limited) ? 16 : 0;
+    return C;
+}
+
+YuvPlanes Microsoft::IndirectDisp::MakeYuvPlanes(uint8_t* pData, uint32_t Pitch, uint32_t Height, PixelFormat Format)
+{
+    YuvPlanes Planes = {};
+    Planes.pY = pData;
+    Planes.YPitch = Pitch;
+    Planes.pU = pData + static_cast<size_t>(Pitch) * Height;
+
+    if (Format == PixelFormat::Nv12)
+    {
+        Planes.UPitch = Pitch;
+    }
+    else if (Format == PixelFormat::I444)
+    {
+        Planes.UPitch = Pitch;
+        Planes.VPitch = Pitch;
+        Planes.pV = Planes.pU + static_cast<size_t>(Pitch) * Height;
+    }
+    else
+    {
+        Planes.UPitch = Pitch / 2;
+        Planes.VPitch = Pitch / 2;
+        Planes.pV = Planes.pU + static_cast<size_t>(Planes.UPitch) * ((Height + 1) / 2);
+    }
+
+    return Planes;
+}
+
+bool Microsoft::IndirectDisp::ConvertBgraToYuv420(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t Width,
+    uint32_t Height,
+    const YuvPlanes& Destination,
+    PixelFormat Format,
+    ColorMatrix Matrix,
+    ColorRange Range,
+    SimdLevel Level)
+{
+    if (Format != PixelFormat::Nv12 && Format != PixelFormat::I420)
+    {
+        return false;
+    }
+
+    const RowKernels Kernels = SelectKernels(Level);
+    const YuvCoefficients Coefficients = MakeYuvCoefficients(Matrix, Range);
+    const bool Interleave = (Format == PixelFormat::Nv12);
+
+    for (uint32_t y = 0; y < Height; y++)
+    {
+        const uint8_t* pRow = pSource + static_cast<size_t>(y) * SourcePitch;
+        uint8_t* pY = Destination.pY + static_cast<size_t>(y) * Destination.YPitch;
+
+        ConvertLumaRow(Kernels, pRow, pY, Width, Coefficients);
+
+        if ((y & 1) == 0)
+        {
+            // An odd last row pairs with itself
+            const uint8_t* pNext = (y + 1 < Height) ? pRow + SourcePitch : pRow;
+            uint8_t* pU = Destination.pU + static_cast<size_t>(y / 2) * Destination.UPitch;
+            uint8_t* pV = Interleave ? nullptr : Destination.pV + static_cast<size_t>(y / 2) * Destination.VPitch;
+
+            uint32_t Done = Kernels.Chroma(pRow, pNext, pU, pV, Width, Interleave, Coefficients);
+            if (Done < Width)
+            {
+                ChromaRowScalar(
+                    pRow + Done * 4,
+                    pNext + Done * 4,
+                    Interleave ? pU + Done : pU + Done / 2,
+                    Interleave ? nullptr : pV + Done / 2,
+                    Width - Done,
+                    Interleave,
+                    Coefficients);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Microsoft::IndirectDisp::ConvertBgraToYuv444(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t Width,
+    uint32_t Height,
+    const YuvPlanes& Destination,
+    ColorMatrix Matrix,
+    ColorRange Range,
+    SimdLevel Level)
+{
+    const RowKernels Kernels = SelectKernels(Level);
+    const YuvCoefficients Coefficients = MakeYuvCoefficients(Matrix, Range);
+
+    for (uint32_t y = 0; y < Height; y++)
+    {
+        const uint8_t* pRow = pSource + static_cast<size_t>(y) * SourcePitch;
+
+        ConvertLumaRow(Kernels, pRow, Destination.pY + static_cast<size_t>(y) * Destination.YPitch, Width, Coefficients);
+        ConvertChroma444Row(
+            Kernels,
+            pRow,
+            Destination.pU + static_cast<size_t>(y) * Destination.UPitch,
+            Destination.pV + static_cast<size_t>(y) * Destination.VPitch,
+            Width,
+            Coefficients);
+    }
+
+    return true;
+}
+
+void Microsoft::IndirectDisp::MakeYuvSplitPlanes(uint8_t* pData, uint32_t Pitch, uint32_t Height, YuvPlanes& Main, YuvPlanes& Residual)
+{
+    Main = MakeYuvPlanes(pData, Pitch, Height, PixelFormat::I420);
+    Residual = MakeYuvPlanes(pData + static_cast<size_t>(Pitch) * FrameRows(PixelFormat::I420, Height), Pitch, Height, PixelFormat::I420);
+}
+
+bool Microsoft::IndirectDisp::ConvertBgraToYuv444Split(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t Width,
+    uint32_t Height,
+    const YuvPlanes& Main,
+    const YuvPlanes& Residual,
+    ColorMatrix Matrix,
+    ColorRange Range,
+    SimdLevel Level)
+{
+    if ((Width & 1) != 0 || (Height & 1) != 0)
+    {
+        return false;
+    }
+
+    const RowKernels Kernels = SelectKernels(Level);
+    const YuvCoefficients Coefficients = MakeYuvCoefficients(Matrix, Range);
+
+    for (uint32_t y = 0; y < Height; y += 2)
+    {
+        const uint8_t* pEvenRow = pSource + static_cast<size_t>(y) * SourcePitch;
+        const uint8_t* pOddRow = pEvenRow + SourcePitch;
+
+        ConvertLumaRow(Kernels, pEvenRow, Main.pY + static_cast<size_t>(y) * Main.YPitch, Width, Coefficients);
+        ConvertLumaRow(Kernels, pOddRow, Main.pY + static_cast<size_t>(y + 1) * Main.YPitch, Width, Coefficients);
+
+        // The residual luma rows that will hold the odd chroma rows double as scratch for the even ones
+        uint8_t* pResidualU = Residual.pY + static_cast<size_t>(y / 2) * Residual.YPitch;
+        uint8_t* pResidualV = Residual.pY + static_cast<size_t>(Height / 2 + y / 2) * Residual.YPitch;
+
+        ConvertChroma444Row(Kernels, pEvenRow, pResidualU, pResidualV, Width, Coefficients);
+        SplitRow(
+            Kernels,
+            pResidualU,
+            Main.pU + static_cast<size_t>(y / 2) * Main.UPitch,
+            Residual.pU + static_cast<size_t>(y / 2) * Residual.UPitch,
+            Width / 2);
+        SplitRow(
+            Kernels,
+            pResidualV,
+            Main.pV + static_cast<size_t>(y / 2) * Main.VPitch,
+            Residual.pV + static_cast<size_t>(y / 2) * Residual.VPitch,
+            Width / 2);
+
+        ConvertChroma444Row(Kernels, pOddRow, pResidualU, pResidualV, Width, Coefficients);
+    }
+
+    return true;
+}
+
+void Microsoft::IndirectDisp::MergeYuv444Split(const YuvPlanes& Main, const YuvPlanes& Residual, uint32_t Width, uint32_t Height, const YuvPlanes& Destination)
+{
+    for (uint32_t y = 0; y < Height; y++)
+    {
+        memcpy(Destination.pY + static_cast<size_t>(y) * Destination.YPitch, Main.pY + static_cast<size_t>(y) * Main.YPitch, Width);
+    }
+
+    for (uint32_t y = 0; y < Height; y += 2)
+    {
+        const uint8_t* pPlanes[2][3] =
+        {
+            { Main.pU + static_cast<size_t>(y / 2) * Main.UPitch, Residual.pU + static_cast<size_t>(y / 2) * Residual.UPitch, Residual.pY + static_cast<size_t>(y / 2) * Residual.YPitch },
+            { Main.pV + static_cast<size_t>(y / 2) * Main.VPitch, Residual.pV + static_cast<size_t>(y / 2) * Residual.VPitch, Residual.pY + static_cast<size_t>(Height / 2 + y / 2) * Residual.YPitch },
+        };
+        uint8_t* pRows[2] =
+        {
+            Destination.pU + static_cast<size_t>(y) * Destination.UPitch,
+            Destination.pV + static_cast<size_t>(y) * Destination.VPitch,
+        };
+        uint32_t Pitches[2] = { Destination.UPitch, Destination.VPitch };
+
+        for (int Plane = 0; Plane < 2; Plane++)
+        {
+            for (uint32_t x = 0; x < Width / 2; x++)
+            {
+                pRows[Plane][x * 2] = pPlanes[Plane][0][x];
+                pRows[Plane][x * 2 + 1] = pPlanes[Plane][1][x];
+            }
+
+            memcpy(pRows[Plane] + Pitches[Plane], pPlanes[Plane][2], Width);
+        }
+    }
+}
+
+bool Microsoft::IndirectDisp::ConvertBgraFrame(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t Width,
+    uint32_t Height,
+    uint8_t* pDestination,
+    uint32_t DestinationPitch,
+    PixelFormat Format,
+    ColorMatrix Matrix,
+    ColorRange Range,
+    SimdLevel Level)
+{
+    switch (Format)
+    {
+    case PixelFormat::Nv12:
+    case PixelFormat::I420:
+        return ConvertBgraToYuv420(pSource, SourcePitch, Width, Height, MakeYuvPlanes(pDestination, DestinationPitch, Height, Format), Format, Matrix, Range, Level);
+
+    case PixelFormat::I444:
+        return ConvertBgraToYuv444(pSource, SourcePitch, Width, Height, MakeYuvPlanes(pDestination, DestinationPitch, Height, Format), Matrix, Range, Level);
+
+    case PixelFormat::I444Split:
+    {
+        YuvPlanes Main, Residual;
+        MakeYuvSplitPlanes(pDestination, DestinationPitch, Height, Main, Residual);
+        return ConvertBgraToYuv444Split(pSource, SourcePitch, Width, Height, Main, Residual, Matrix, Range, Level);
+    }
+
+    default:
+        return false;
+    }
+}
+
+ColorConvertStage::ColorConvertStage(PixelFormat Output, ColorMatrix Matrix, ColorRange Range)
+    : m_Output(Output)
+    , m_Matrix(Matrix)
+    , m_Range(Range)
+    , m_Level(DetectSimdLevel())
+    , m_Pool(false, 4)
+{
+}
+
+bool ColorConvertStage::Process(Frame& Frame)
+{
+    if (Frame.Format != PixelFormat::Bgra8 || !Frame.pData)
+    {
+        return true;
+    }
+
+    FrameBufferKey Key = { Frame.Width, Frame.Height, m_Output };
+    FrameBufferRef Converted = m_Pool.Acquire(Key);
+    if (!Converted)
+    {
+        return false;
+    }
+
+    if (!ConvertBgraFrame(Frame.pData, Frame.Pitch, Frame.Width, Frame.Height, Converted->Data(), Converted->Pitch(), m_Output, m_Matrix, m_Range, m_Level))
+    {
+        return false;
+    }
+
+    // Releases the previous frame's output back to the pool
+    m_Converted = move(Converted);
+
+    Frame.pData = m_Converted->Data();
+    Frame.Pitch = m_Converted->Pitch();
+    Frame.Format = m_Output;
+    Frame.pBuffer = m_Converted.Get();
+    return true;
+}
@@ -0,0 +1,159 @@
+/*++
+
+Module Name:
+
+    color_convert.h
+
+Abstract:
+
+    This module contains the BGRA to YUV converters used ahead of video encoders, and a pipeline stage that converts
+    frames in place of the BGRA copy. 4:2:0 (NV12, I420) is the default; 4:4:4 keeps subpixel-rendered text sharp at
+    roughly twice the chroma cost, either as planar I444 or split into two I420 pictures for 4:2:0-only encoders.
+
+    All instruction-set variants share one fixed-point formulation, so every variant is bit-exact with the scalar
+    reference: luma coefficients carry 14 fractional bits, chroma is computed from the sum of each 2x2 block.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "cpu_features.h"
+#include "frame.h"
+#include "frame_buffer_pool.h"
+#include "frame_pipeline.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        enum class ColorMatrix
+        {
+            Bt601,
+            Bt709,
+        };
+
+        enum class ColorRange
+        {
+            Limited,    // Y in [16, 235], UV in [16, 240]
+            Full,       // Y and UV in [0, 255]
+        };
+
+        /// <summary>
+        /// Fixed-point RGB to YUV coefficients, scaled by 2^14.
+        /// </summary>
+        struct YuvCoefficients
+        {
+            int16_t YB, YG, YR;
+            int16_t UB, UG, UR;
+            int16_t VB, VG, VR;
+            int32_t YOffset;
+        };
+
+        YuvCoefficients MakeYuvCoefficients(ColorMatrix Matrix, ColorRange Range);
+
+        /// <summary>
+        /// Destination planes of a 4:2:0 image. For NV12 pU receives the interleaved UV plane and pV is unused.
+        /// </summary>
+        struct YuvPlanes
+        {
+            uint8_t* pY;
+            uint8_t* pU;
+            uint8_t* pV;
+            uint32_t YPitch;
+            uint32_t UPitch;
+            uint32_t VPitch;
+        };
+
+        // Lays the planes of Format (Nv12, I420 or I444) out contiguously the way FrameBufferPool sizes them. Pitch must be
+        // even and cover the width rounded up to even.
+        YuvPlanes MakeYuvPlanes(uint8_t* pData, uint32_t Pitch, uint32_t Height, PixelFormat Format);
+
+        // Converts a BGRA image; odd sizes replicate the last column and row into the chroma blocks.
+        // Level is clamped to what the CPU supports. Returns false for a Format other than Nv12 or I420.
+        bool ConvertBgraToYuv420(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t Width,
+            uint32_t Height,
+            const YuvPlanes& Destination,
+            PixelFormat Format,
+            ColorMatrix Matrix,
+            ColorRange Range,
+            SimdLevel Level = DetectSimdLevel());
+
+        // Converts to planar 4:4:4. Only the AVX2 tier is vectorized; Level is clamped as above.
+        bool ConvertBgraToYuv444(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t Width,
+            uint32_t Height,
+            const YuvPlanes& Destination,
+            ColorMatrix Matrix,
+            ColorRange Range,
+            SimdLevel Level = DetectSimdLevel());
+
+        // Lays out the two I420 views of the I444Split format: Main first, Residual right after it
+        void MakeYuvSplitPlanes(uint8_t* pData, uint32_t Pitch, uint32_t Height, YuvPlanes& Main, YuvPlanes& Residual);
+
+        // Converts to the 4:2:0 + chroma residual split. Main is an ordinary I420 picture whose chroma is the 4:4:4
+        // sample at each even column and row. Residual carries the other three samples of every 2x2 block: its Y
+        // plane holds the odd chroma rows (all U rows, then all V rows) and its U and V planes the odd columns of
+        // the even rows. Width and Height must be even; returns false otherwise.
+        bool ConvertBgraToYuv444Split(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t Width,
+            uint32_t Height,
+            const YuvPlanes& Main,
+            const YuvPlanes& Residual,
+            ColorMatrix Matrix,
+            ColorRange Range,
+            SimdLevel Level = DetectSimdLevel());
+
+        // Rebuilds planar 4:4:4 from the two views of the split; exact inverse of the layout
+        void MergeYuv444Split(const YuvPlanes& Main, const YuvPlanes& Residual, uint32_t Width, uint32_t Height, const YuvPlanes& Destination);
+
+        // Converts into one contiguous buffer of Format laid out the way FrameBufferPool sizes it
+        bool ConvertBgraFrame(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t Width,
+            uint32_t Height,
+            uint8_t* pDestination,
+            uint32_t DestinationPitch,
+            PixelFormat Format,
+            ColorMatrix Matrix,
+            ColorRange Range,
+            SimdLevel Level = DetectSimdLevel());
+
+        /// <summary>
+        /// Converts each BGRA frame to one of the YUV formats in a pooled buffer and hands that on instead. The
+        /// converted buffer stays referenced until the next frame, so sinks that keep it longer must AddRef pBuffer.
+        /// </summary>
+        class ColorConvertStage : public IFrameStage
+        {
+        public:
+            // Output buffers come from a private pool: sharing the pipeline's BGRA pool would alternate its key
+            ColorConvertStage(PixelFormat Output, ColorMatrix Matrix, ColorRange Range);
+
+            const char* Name() const override { return "ColorConvert"; }
+            bool Process(Frame& Frame) override;
+
+        private:
+            const PixelFormat m_Output;
+            const ColorMatrix m_Matrix;
+            const ColorRange m_Range;
+            const SimdLevel m_Level;
+
+            FrameBufferPool m_Pool;
+            FrameBufferRef m_Converted;
+        };
+    }
+}
@@ -0,0 +1,68 @@
+/*++
+
+Module Name:
+
+    color_convert_kernels.h
+
+Abstract:
+
+    This module contains the row kernels behind the BGRA to YUV converters. It is private to color_convert*.cpp.
+
+    A luma kernel converts one BGRA row; a chroma kernel converts a pair of BGRA rows into one row of U and V, either
+    planar or interleaved (NV12); a 4:4:4 chroma kernel converts one BGRA row into full-resolution U and V rows.
+    Vector kernels only handle whole blocks of their width and return how many pixels they converted; the scalar
+    kernel finishes the row from there.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "color_convert.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        typedef uint32_t (*LumaRowKernel)(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients);
+
+        typedef uint32_t (*ChromaRowKernel)(
+            const uint8_t* pRow0,
+            const uint8_t* pRow1,
+            uint8_t* pU,
+            uint8_t* pV,
+            uint32_t Width,
+            bool Interleave,
+            const YuvCoefficients& Coefficients);
+
+        typedef uint32_t (*Chroma444RowKernel)(const uint8_t* pSource, uint8_t* pU, uint8_t* pV, uint32_t Width, const YuvCoefficients& Coefficients);
+
+        // Splits Pairs byte pairs into their even and odd bytes; used to share 4:4:4 chroma between two 4:2:0 views
+        typedef uint32_t (*SplitEvenOddKernel)(const uint8_t* pSource, uint8_t* pEven, uint8_t* pOdd, uint32_t Pairs);
+
+        // Packs two 16-bit coefficients the way pmaddwd pairs them with a BGRA pixel split into (B, R) and (G, A)
+        inline int32_t CoefficientPair(int16_t Low, int16_t High)
+        {
+            return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(Low)) |
+                (static_cast<uint32_t>(static_cast<uint16_t>(High)) << 16));
+        }
+
+#if IDD_X86
+        uint32_t LumaRowSse41(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients);
+        uint32_t LumaRowAvx2(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients);
+        uint32_t LumaRowAvx512(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients);
+
+        uint32_t ChromaRowSse41(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pU, uint8_t* pV, uint32_t Width, bool Interleave, const YuvCoefficients& Coefficients);
+        uint32_t ChromaRowAvx2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pU, uint8_t* pV, uint32_t Width, bool Interleave, const YuvCoefficients& Coefficients);
+        uint32_t ChromaRowAvx512(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pU, uint8_t* pV, uint32_t Width, bool Interleave, const YuvCoefficients& Coefficients);
+
+        uint32_t Chroma444RowAvx2(const uint8_t* pSource, uint8_t* pU, uint8_t* pV, uint32_t Width, const YuvCoefficients& Coefficients);
+        uint32_t SplitEvenOddAvx2(const uint8_t* pSource, uint8_t* pEven, uint8_t* pOdd, uint32_t Pairs);
+#endif
+    }
+}
@@ -0,0 +1,421 @@
+/*++
+
+Module Name:
+
+    color_convert_x86.cpp
+
+Abstract:
+
+    This module contains the SSE4.1, AVX2 and AVX-512 row kernels of the BGRA to YUV 4:2:0 converter and the AVX2
+    kernels of the 4:4:4 converter.
+
+    Each BGRA pixel is split into 16-bit (B, R) and (G, A) pairs so one pmaddwd per pair yields the weighted sum for
+    a whole pixel in a 32-bit lane. For chroma the two rows are added first and then each pixel is added to its right
+    neighbour with a 64-bit shift, which leaves the 2x2 block sums in the even 32-bit lanes.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "color_convert_kernels.h"
+
+#if IDD_X86
+
+#include <cstring>
+#include <immintrin.h>
+
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const int32_t LumaShift = 14;
+    const int32_t ChromaShift = 16;     // block sums are four pixels, two more bits than luma
+
+    int32_t LumaRounding(const YuvCoefficients& Coefficients)
+    {
+        return (1 << (LumaShift - 1)) + (Coefficients.YOffset << LumaShift);
+    }
+
+    int32_t ChromaRounding()
+    {
+        return (1 << (ChromaShift - 1)) + (128 << ChromaShift);
+    }
+
+    void Store32(uint8_t* pDestination, int32_t Value)
+    {
+        memcpy(pDestination, &Value, sizeof(Value));
+    }
+
+    //
+    // SSE4.1: 16 luma pixels, 8 chroma pixels per iteration
+    //
+
+    // Rounded weighted sum of the B, G and R of each pixel, in the 14-bit fixed point of YuvCoefficients
+    IDD_TARGET_SSE41 inline __m128i WeightedSse41(__m128i Pixels, __m128i Mask, __m128i BR, __m128i GA, __m128i Rounding)
+    {
+        __m128i Sum = _mm_add_epi32(
+            _mm_madd_epi16(_mm_and_si128(Pixels, Mask), BR),
+            _mm_madd_epi16(_mm_srli_epi16(Pixels, 8), GA));
+        return _mm_srai_epi32(_mm_add_epi32(Sum, Rounding), LumaShift);
+    }
+
+    // Leaves the (B, R) and (G, A) sums of each 2x2 block in the low half of every 64-bit lane
+    IDD_TARGET_SSE41 inline void BlockSumsSse41(__m128i Top, __m128i Bottom, __m128i Mask, __m128i& BR, __m128i& GA)
+    {
+        BR = _mm_add_epi16(_mm_and_si128(Top, Mask), _mm_and_si128(Bottom, Mask));
+        GA = _mm_add_epi16(_mm_srli_epi16(Top, 8), _mm_srli_epi16(Bottom, 8));
+        BR = _mm_add_epi16(BR, _mm_srli_epi64(BR, 32));
+        GA = _mm_add_epi16(GA, _mm_srli_epi64(GA, 32));
+    }
+
+    //
+    // AVX2: 32 luma pixels, 16 chroma pixels per iteration
+    //
+
+    IDD_TARGET_AVX2 inline __m256i WeightedAvx2(__m256i Pixels, __m256i Mask, __m256i BR, __m256i GA, __m256i Rounding)
+    {
+        __m256i Sum = _mm256_add_epi32(
+            _mm256_madd_epi16(_mm256_and_si256(Pixels, Mask), BR),
+            _mm256_madd_epi16(_mm256_srli_epi16(Pixels, 8), GA));
+        return _mm256_srai_epi32(_mm256_add_epi32(Sum, Rounding), LumaShift);
+    }
+
+    IDD_TARGET_AVX2 inline void BlockSumsAvx2(__m256i Top, __m256i Bottom, __m256i Mask, __m256i& BR, __m256i& GA)
+    {
+        BR = _mm256_add_epi16(_mm256_and_si256(Top, Mask), _mm256_and_si256(Bottom, Mask));
+        GA = _mm256_add_epi16(_mm256_srli_epi16(Top, 8), _mm256_srli_epi16(Bottom, 8));
+        BR = _mm256_add_epi16(BR, _mm256_srli_epi64(BR, 32));
+        GA = _mm256_add_epi16(GA, _mm256_srli_epi64(GA, 32));
+    }
+
+    //
+    // AVX-512: 64 luma pixels, 32 chroma pixels per iteration
+    //
+
+    IDD_TARGET_AVX512 inline __m512i WeightedAvx512(__m512i Pixels, __m512i Mask, __m512i BR, __m512i GA, __m512i Rounding)
+    {
+        __m512i Sum = _mm512_add_epi32(
+            _mm512_madd_epi16(_mm512_and_si512(Pixels, Mask), BR),
+            _mm512_madd_epi16(_mm512_srli_epi16(Pixels, 8), GA));
+        return _mm512_srai_epi32(_mm512_add_epi32(Sum, Rounding), LumaShift);
+    }
+
+    IDD_TARGET_AVX512 inline void BlockSumsAvx512(__m512i Top, __m512i Bottom, __m512i Mask, __m512i& BR, __m512i& GA)
+    {
+        BR = _mm512_add_epi16(_mm512_and_si512(Top, Mask), _mm512_and_si512(Bottom, Mask));
+        GA = _mm512_add_epi16(_mm512_srli_epi16(Top, 8), _mm512_srli_epi16(Bottom, 8));
+        BR = _mm512_add_epi16(BR, _mm512_srli_epi64(BR, 32));
+        GA = _mm512_add_epi16(GA, _mm512_srli_epi64(GA, 32));
+    }
+
+    // Clamps the even 32-bit lanes to a byte and narrows them, eight blocks to eight bytes
+    IDD_TARGET_AVX512 inline __m128i NarrowBlocksAvx512(__m512i Values)
+    {
+        Values = _mm512_min_epi32(_mm512_max_epi32(Values, _mm512_setzero_si512()), _mm512_set1_epi32(255));
+        return _mm512_cvtepi64_epi8(Values);
+    }
+}
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::LumaRowSse41(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients)
+{
+    const __m128i Mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i BR = _mm_set1_epi32(CoefficientPair(Coefficients.YB, Coefficients.YR));
+    const __m128i GA = _mm_set1_epi32(CoefficientPair(Coefficients.YG, 0));
+    const __m128i Rounding = _mm_set1_epi32(LumaRounding(Coefficients));
+
+    uint32_t x = 0;
+    for (; x + 16 <= Width; x += 16)
+    {
+        const __m128i* pPixels = reinterpret_cast<const __m128i*>(pSource + x * 4);
+        __m128i Y0 = WeightedSse41(_mm_loadu_si128(pPixels + 0), Mask, BR, GA, Rounding);
+        __m128i Y1 = WeightedSse41(_mm_loadu_si128(pPixels + 1), Mask, BR, GA, Rounding);
+        __m128i Y2 = WeightedSse41(_mm_loadu_si128(pPixels + 2), Mask, BR, GA, Rounding);
+        __m128i Y3 = WeightedSse41(_mm_loadu_si128(pPixels + 3), Mask, BR, GA, Rounding);
+
+        __m128i Bytes = _mm_packus_epi16(_mm_packs_epi32(Y0, Y1), _mm_packs_epi32(Y2, Y3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pY + x), Bytes);
+    }
+
+    return x;
+}
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::ChromaRowSse41(
+    const uint8_t* pRow0,
+    const uint8_t* pRow1,
+    uint8_t* pU,
+    uint8_t* pV,
+    uint32_t Width,
+    bool Interleave,
+    const YuvCoefficients& Coefficients)
+{
+    const __m128i Mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i UBR = _mm_set1_epi32(CoefficientPair(Coefficients.UB, Coefficients.UR));
+    const __m128i UGA = _mm_set1_epi32(CoefficientPair(Coefficients.UG, 0));
+    const __m128i VBR = _mm_set1_epi32(CoefficientPair(Coefficients.VB, Coefficients.VR));
+    const __m128i VGA = _mm_set1_epi32(CoefficientPair(Coefficients.VG, 0));
+    const __m128i Rounding = _mm_set1_epi32(ChromaRounding());
+    const __m128i InterleaveUV = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+
+    uint32_t x = 0;
+    for (; x + 8 <= Width; x += 8)
+    {
+        const __m128i* pTop = reinterpret_cast<const __m128i*>(pRow0 + x * 4);
+        const __m128i* pBottom = reinterpret_cast<const __m128i*>(pRow1 + x * 4);
+
+        __m128i BR0, GA0, BR1, GA1;
+        BlockSumsSse41(_mm_loadu_si128(pTop + 0), _mm_loadu_si128(pBottom + 0), Mask, BR0, GA0);
+        BlockSumsSse41(_mm_loadu_si128(pTop + 1), _mm_loadu_si128(pBottom + 1), Mask, BR1, GA1);
+
+        __m128i U0 = _mm_add_epi32(_mm_madd_epi16(BR0, UBR), _mm_madd_epi16(GA0, UGA));
+        __m128i U1 = _mm_add_epi32(_mm_madd_epi16(BR1, UBR), _mm_madd_epi16(GA1, UGA));
+        __m128i V0 = _mm_add_epi32(_mm_madd_epi16(BR0, VBR), _mm_madd_epi16(GA0, VGA));
+        __m128i V1 = _mm_add_epi32(_mm_madd_epi16(BR1, VBR), _mm_madd_epi16(GA1, VGA));
+
+        // Gather the even lanes: four blocks each
+        __m128i U = _mm_unpacklo_epi64(_mm_shuffle_epi32(U0, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(U1, _MM_SHUFFLE(0, 0, 2, 0)));
+        __m128i V = _mm_unpacklo_epi64(_mm_shuffle_epi32(V0, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(V1, _MM_SHUFFLE(0, 0, 2, 0)));
+        U = _mm_srai_epi32(_mm_add_epi32(U, Rounding), ChromaShift);
+        V = _mm_srai_epi32(_mm_add_epi32(V, Rounding), ChromaShift);
+
+        // Bytes u0..u3 v0..v3, saturated to [0, 255]
+        __m128i Packed = _mm_packs_epi32(U, V);
+        Packed = _mm_packus_epi16(Packed, Packed);
+
+        if (Interleave)
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pU + x), _mm_shuffle_epi8(Packed, InterleaveUV));
+        }
+        else
+        {
+            Store32(pU + x / 2, _mm_cvtsi128_si32(Packed));
+            Store32(pV + x / 2, _mm_cvtsi128_si32(_mm_srli_si128(Packed, 4)));
+        }
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::LumaRowAvx2(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients)
+{
+    const __m256i Mask = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i BR = _mm256_set1_epi32(CoefficientPair(Coefficients.YB, Coefficients.YR));
+    const __m256i GA = _mm256_set1_epi32(CoefficientPair(Coefficients.YG, 0));
+    const __m256i Rounding = _mm256_set1_epi32(LumaRounding(Coefficients));
+    const __m256i Order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    uint32_t x = 0;
+    for (; x + 32 <= Width; x += 32)
+    {
+        const __m256i* pPixels = reinterpret_cast<const __m256i*>(pSource + x * 4);
+        __m256i Y0 = WeightedAvx2(_mm256_loadu_si256(pPixels + 0), Mask, BR, GA, Rounding);
+        __m256i Y1 = WeightedAvx2(_mm256_loadu_si256(pPixels + 1), Mask, BR, GA, Rounding);
+        __m256i Y2 = WeightedAvx2(_mm256_loadu_si256(pPixels + 2), Mask, BR, GA, Rounding);
+        __m256i Y3 = WeightedAvx2(_mm256_loadu_si256(pPixels + 3), Mask, BR, GA, Rounding);
+
+        // The packs work per 128-bit lane, which leaves groups of four pixels out of order
+        __m256i Bytes = _mm256_packus_epi16(_mm256_packs_epi32(Y0, Y1), _mm256_packs_epi32(Y2, Y3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pY + x), _mm256_permutevar8x32_epi32(Bytes, Order));
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::ChromaRowAvx2(
+    const uint8_t* pRow0,
+    const uint8_t* pRow1,
+    uint8_t* pU,
+    uint8_t* pV,
+    uint32_t Width,
+    bool Interleave,
+    const YuvCoefficients& Coefficients)
+{
+    const __m256i Mask = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i UBR = _mm256_set1_epi32(CoefficientPair(Coefficients.UB, Coefficients.UR));
+    const __m256i UGA = _mm256_set1_epi32(CoefficientPair(Coefficients.UG, 0));
+    const __m256i VBR = _mm256_set1_epi32(CoefficientPair(Coefficients.VB, Coefficients.VR));
+    const __m256i VGA = _mm256_set1_epi32(CoefficientPair(Coefficients.VG, 0));
+    const __m256i Rounding = _mm256_set1_epi32(ChromaRounding());
+    const __m256i InterleaveUV = _mm256_setr_epi8(
+        0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15,
+        0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    const __m256i PlanarOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    uint32_t x = 0;
+    for (; x + 16 <= Width; x += 16)
+    {
+        const __m256i* pTop = reinterpret_cast<const __m256i*>(pRow0 + x * 4);
+        const __m256i* pBottom = reinterpret_cast<const __m256i*>(pRow1 + x * 4);
+
+        __m256i BR0, GA0, BR1, GA1;
+        BlockSumsAvx2(_mm256_loadu_si256(pTop + 0), _mm256_loadu_si256(pBottom + 0), Mask, BR0, GA0);
+        BlockSumsAvx2(_mm256_loadu_si256(pTop + 1), _mm256_loadu_si256(pBottom + 1), Mask, BR1, GA1);
+
+        __m256i U0 = _mm256_add_epi32(_mm256_madd_epi16(BR0, UBR), _mm256_madd_epi16(GA0, UGA));
+        __m256i U1 = _mm256_add_epi32(_mm256_madd_epi16(BR1, UBR), _mm256_madd_epi16(GA1, UGA));
+        __m256i V0 = _mm256_add_epi32(_mm256_madd_epi16(BR0, VBR), _mm256_madd_epi16(GA0, VGA));
+        __m256i V1 = _mm256_add_epi32(_mm256_madd_epi16(BR1, VBR), _mm256_madd_epi16(GA1, VGA));
+
+        // Gather the even lanes of both halves into blocks 0..7 in order
+        __m256i U = _mm256_unpacklo_epi64(_mm256_shuffle_epi32(U0, _MM_SHUFFLE(0, 0, 2, 0)), _mm256_shuffle_epi32(U1, _MM_SHUFFLE(0, 0, 2, 0)));
+        __m256i V = _mm256_unpacklo_epi64(_mm256_shuffle_epi32(V0, _MM_SHUFFLE(0, 0, 2, 0)), _mm256_shuffle_epi32(V1, _MM_SHUFFLE(0, 0, 2, 0)));
+        U = _mm256_permute4x64_epi64(U, _MM_SHUFFLE(3, 1, 2, 0));
+        V = _mm256_permute4x64_epi64(V, _MM_SHUFFLE(3, 1, 2, 0));
+        U = _mm256_srai_epi32(_mm256_add_epi32(U, Rounding), ChromaShift);
+        V = _mm256_srai_epi32(_mm256_add_epi32(V, Rounding), ChromaShift);
+
+        // Per lane: bytes u0..u3 v0..v3 (low lane) and u4..u7 v4..v7 (high lane)
+        __m256i Packed = _mm256_packs_epi32(U, V);
+        Packed = _mm256_packus_epi16(Packed, Packed);
+
+        if (Interleave)
+        {
+            __m256i UV = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(Packed, InterleaveUV), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pU + x), _mm256_castsi256_si128(UV));
+        }
+        else
+        {
+            __m128i UV = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(Packed, PlanarOrder));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pU + x / 2), UV);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pV + x / 2), _mm_srli_si128(UV, 8));
+        }
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX512 uint32_t Microsoft::IndirectDisp::LumaRowAvx512(const uint8_t* pSource, uint8_t* pY, uint32_t Width, const YuvCoefficients& Coefficients)
+{
+    const __m512i Mask = _mm512_set1_epi32(0x00FF00FF);
+    const __m512i BR = _mm512_set1_epi32(CoefficientPair(Coefficients.YB, Coefficients.YR));
+    const __m512i GA = _mm512_set1_epi32(CoefficientPair(Coefficients.YG, 0));
+    const __m512i Rounding = _mm512_set1_epi32(LumaRounding(Coefficients));
+    const __m512i Zero = _mm512_setzero_si512();
+
+    uint32_t x = 0;
+    for (; x + 64 <= Width; x += 64)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            __m512i Pixels = _mm512_loadu_si512(pSource + (x + i * 16) * 4);
+            __m512i Y = _mm512_max_epi32(WeightedAvx512(Pixels, Mask, BR, GA, Rounding), Zero);
+
+            // Unsigned saturation to a byte, matching the pack-based tiers
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pY + x + i * 16), _mm512_cvtusepi32_epi8(Y));
+        }
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX512 uint32_t Microsoft::IndirectDisp::ChromaRowAvx512(
+    const uint8_t* pRow0,
+    const uint8_t* pRow1,
+    uint8_t* pU,
+    uint8_t* pV,
+    uint32_t Width,
+    bool Interleave,
+    const YuvCoefficients& Coefficients)
+{
+    const __m512i Mask = _mm512_set1_epi32(0x00FF00FF);
+    const __m512i UBR = _mm512_set1_epi32(CoefficientPair(Coefficients.UB, Coefficients.UR));
+    const __m512i UGA = _mm512_set1_epi32(CoefficientPair(Coefficients.UG, 0));
+    const __m512i VBR = _mm512_set1_epi32(CoefficientPair(Coefficients.VB, Coefficients.VR));
+    const __m512i VGA = _mm512_set1_epi32(CoefficientPair(Coefficients.VG, 0));
+    const __m512i Rounding = _mm512_set1_epi32(ChromaRounding());
+
+    uint32_t x = 0;
+    for (; x + 32 <= Width; x += 32)
+    {
+        const uint8_t* pTop = pRow0 + x * 4;
+        const uint8_t* pBottom = pRow1 + x * 4;
+
+        __m512i BR0, GA0, BR1, GA1;
+        BlockSumsAvx512(_mm512_loadu_si512(pTop), _mm512_loadu_si512(pBottom), Mask, BR0, GA0);
+        BlockSumsAvx512(_mm512_loadu_si512(pTop + 64), _mm512_loadu_si512(pBottom + 64), Mask, BR1, GA1);
+
+        __m512i U0 = _mm512_add_epi32(_mm512_madd_epi16(BR0, UBR), _mm512_madd_epi16(GA0, UGA));
+        __m512i U1 = _mm512_add_epi32(_mm512_madd_epi16(BR1, UBR), _mm512_madd_epi16(GA1, UGA));
+        __m512i V0 = _mm512_add_epi32(_mm512_madd_epi16(BR0, VBR), _mm512_madd_epi16(GA0, VGA));
+        __m512i V1 = _mm512_add_epi32(_mm512_madd_epi16(BR1, VBR), _mm512_madd_epi16(GA1, VGA));
+
+        U0 = _mm512_srai_epi32(_mm512_add_epi32(U0, Rounding), ChromaShift);
+        U1 = _mm512_srai_epi32(_mm512_add_epi32(U1, Rounding), ChromaShift);
+        V0 = _mm512_srai_epi32(_mm512_add_epi32(V0, Rounding), ChromaShift);
+        V1 = _mm512_srai_epi32(_mm512_add_epi32(V1, Rounding), ChromaShift);
+
+        // Sixteen blocks: the low byte of every 64-bit lane is the clamped even 32-bit lane
+        __m128i U = _mm_unpacklo_epi64(NarrowBlocksAvx512(U0), NarrowBlocksAvx512(U1));
+        __m128i V = _mm_unpacklo_epi64(NarrowBlocksAvx512(V0), NarrowBlocksAvx512(V1));
+
+        if (Interleave)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pU + x), _mm_unpacklo_epi8(U, V));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pU + x + 16), _mm_unpackhi_epi8(U, V));
+        }
+        else
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pU + x / 2), U);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pV + x / 2), V);
+        }
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::Chroma444RowAvx2(const uint8_t* pSource, uint8_t* pU, uint8_t* pV, uint32_t Width, const YuvCoefficients& Coefficients)
+{
+    const __m256i Mask = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i UBR = _mm256_set1_epi32(CoefficientPair(Coefficients.UB, Coefficients.UR));
+    const __m256i UGA = _mm256_set1_epi32(CoefficientPair(Coefficients.UG, 0));
+    const __m256i VBR = _mm256_set1_epi32(CoefficientPair(Coefficients.VB, Coefficients.VR));
+    const __m256i VGA = _mm256_set1_epi32(CoefficientPair(Coefficients.VG, 0));
+    const __m256i Rounding = _mm256_set1_epi32((1 << (LumaShift - 1)) + (128 << LumaShift));
+    const __m256i Order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    uint32_t x = 0;
+    for (; x + 32 <= Width; x += 32)
+    {
+        const __m256i* pPixels = reinterpret_cast<const __m256i*>(pSource + x * 4);
+        __m256i Pixels[4];
+        for (int i = 0; i < 4; i++)
+        {
+            Pixels[i] = _mm256_loadu_si256(pPixels + i);
+        }
+
+        __m256i U = _mm256_packus_epi16(
+            _mm256_packs_epi32(WeightedAvx2(Pixels[0], Mask, UBR, UGA, Rounding), WeightedAvx2(Pixels[1], Mask, UBR, UGA, Rounding)),
+            _mm256_packs_epi32(WeightedAvx2(Pixels[2], Mask, UBR, UGA, Rounding), WeightedAvx2(Pixels[3], Mask, UBR, UGA, Rounding)));
+        __m256i V = _mm256_packus_epi16(
+            _mm256_packs_epi32(WeightedAvx2(Pixels[0], Mask, VBR, VGA, Rounding), WeightedAvx2(Pixels[1], Mask, VBR, VGA, Rounding)),
+            _mm256_packs_epi32(WeightedAvx2(Pixels[2], Mask, VBR, VGA, Rounding), WeightedAvx2(Pixels[3], Mask, VBR, VGA, Rounding)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pU + x), _mm256_permutevar8x32_epi32(U, Order));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pV + x), _mm256_permutevar8x32_epi32(V, Order));
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::SplitEvenOddAvx2(const uint8_t* pSource, uint8_t* pEven, uint8_t* pOdd, uint32_t Pairs)
+{
+    const __m256i Deinterleave = _mm256_setr_epi8(
+        0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+        0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+
+    uint32_t i = 0;
+    for (; i + 16 <= Pairs; i += 16)
+    {
+        // Per lane: eight even bytes then eight odd bytes; gather the even halves into the low lane
+        __m256i Bytes = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource + i * 2)), Deinterleave);
+        Bytes = _mm256_permute4x64_epi64(Bytes, _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pEven + i), _mm256_castsi256_si128(Bytes));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pOdd + i), _mm256_extracti128_si256(Bytes, 1));
+    }
+
+    return i;
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*++
+
+Module Name:
+
+    cpu_features.cpp
+
+Abstract:
+
+    This module contains runtime CPU feature detection for the vectorized frame kernels.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "cpu_features.h"
+
+#include <cstdint>
+
+#if IDD_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+#if IDD_X86
+    void CpuId(uint32_t Leaf, uint32_t SubLeaf, uint32_t Registers[4])
+    {
+#if defined(_MSC_VER)
+        int Values[4];
+        __cpuidex(Values, static_cast<int>(Leaf), static_cast<int>(SubLeaf));
+        for (int i = 0; i < 4; i++)
+        {
+            Registers[i] = static_cast<uint32_t>(Values[i]);
+        }
+#else
+        __cpuid_count(Leaf, SubLeaf, Registers[0], Registers[1], Registers[2], Registers[3]);
+#endif
+    }
+
+    uint64_t ReadXcr0()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t Low, High;
+        __asm__ volatile("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+        return (static_cast<uint64_t>(High) << 32) | Low;
+#endif
+    }
+#endif
+
+    SimdLevel Detect()
+    {
+#if IDD_X86
+        uint32_t Registers[4];
+
+        CpuId(0, 0, Registers);
+        uint32_t MaxLeaf = Registers[0];
+
+        CpuId(1, 0, Registers);
+        bool Sse41 = (Registers[2] & (1u << 19)) != 0;
+        bool OsXsave = (Registers[2] & (1u << 27)) != 0;
+        bool Avx = (Registers[2] & (1u << 28)) != 0;
+
+        if (!Sse41)
+        {
+            return SimdLevel::Scalar;
+        }
+
+        if (!OsXsave || !Avx || MaxLeaf < 7)
+        {
+            return SimdLevel::Sse41;
+        }
+
+        // The OS must save the YMM (and for AVX-512 the opmask and ZMM) state across context switches
+        uint64_t Xcr0 = ReadXcr0();
+        if ((Xcr0 & 0x6) != 0x6)
+        {
+            return SimdLevel::Sse41;
+        }
+
+        CpuId(7, 0, Registers);
+        bool Avx2 = (Registers[1] & (1u << 5)) != 0;
+        bool Avx512F = (Registers[1] & (1u << 16)) != 0;
+        bool Avx512BW = (Registers[1] & (1u << 30)) != 0;
+
+        if (!Avx2)
+        {
+            return SimdLevel::Sse41;
+        }
+
+        if (Avx512F && Avx512BW && (Xcr0 & 0xE6) == 0xE6)
+        {
+            return SimdLevel::Avx512;
+        }
+
+        return SimdLevel::Avx2;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+}
+
+SimdLevel Microsoft::IndirectDisp::DetectSimdLevel()
+{
+    static const SimdLevel s_Level = Detect();
+    return s_Level;
+}
+
+SimdLevel Microsoft::IndirectDisp::ClampSimdLevel(SimdLevel Requested)
+{
+    SimdLevel Supported = DetectSimdLevel();
+    return (Requested < Supported) ? Requested : Supported;
+}
+
+const char* Microsoft::IndirectDisp::SimdLevelName(SimdLevel Level)
+{
+    switch (Level)
+    {
+    case SimdLevel::Sse41:
+        return "sse4.1";
+    case SimdLevel::Avx2:
+        return "avx2";
+    case SimdLevel::Avx512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
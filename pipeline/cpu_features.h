@@ -0,0 +1,60 @@
+/*++
+
+Module Name:
+
+    cpu_features.h
+
+Abstract:
+
+    This module contains runtime CPU feature detection for the vectorized frame kernels, plus the attributes that let
+    a single translation unit carry SSE4.1, AVX2 and AVX-512 code without raising the baseline instruction set.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IDD_X86 1
+#else
+#define IDD_X86 0
+#endif
+
+// MSVC accepts every intrinsic in any function; GCC and Clang need the target spelled out per function
+#if IDD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define IDD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define IDD_TARGET_AVX2 __attribute__((target("avx2")))
+#define IDD_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define IDD_TARGET_SSE41
+#define IDD_TARGET_AVX2
+#define IDD_TARGET_AVX512
+#endif
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Instruction set tiers the kernels are specialized for, in increasing order.
+        /// </summary>
+        enum class SimdLevel
+        {
+            Scalar = 0,
+            Sse41,
+            Avx2,
+            Avx512,     // AVX-512 F + BW
+        };
+
+        // Returns the best tier both the CPU and the OS (register state saving) support; detected once
+        SimdLevel DetectSimdLevel();
+
+        // Returns the lower of Requested and what the machine supports
+        SimdLevel ClampSimdLevel(SimdLevel Requested);
+
+        const char* SimdLevelName(SimdLevel Level);
+    }
+}
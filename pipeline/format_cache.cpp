@@ -0,0 +1,271 @@
+/*++
+
+Module Name:
+
+    format_cache.cpp
+
+Abstract:
+
+    This module contains the per-frame format cache and the stage that attaches it.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "format_cache.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// What a stage shares with the caches it hands out: conversion settings, pools, recycled caches and counters.
+        /// </summary>
+        struct FormatCacheContext
+        {
+            // Caches kept for reuse, so steady-state frames never allocate one
+            static const size_t MaxIdle = 16;
+
+            FormatCacheContext(const vector<PixelFormat>& Offered, ColorMatrix Matrix, ColorRange Range)
+                : Offered(Offered), Matrix(Matrix), Range(Range), Level(DetectSimdLevel()), SourcePool(false, 4)
+            {
+                // One pool per format, since a pool only keeps buffers of the key it was asked for last
+                for (auto& Pool : Pools)
+                {
+                    Pool.reset(new FrameBufferPool(false, 4));
+                }
+            }
+
+            ~FormatCacheContext()
+            {
+                for (FrameFormats* pFormats : Idle)
+                {
+                    delete pFormats;
+                }
+            }
+
+            const vector<PixelFormat> Offered;
+            const ColorMatrix Matrix;
+            const ColorRange Range;
+            const SimdLevel Level;
+
+            FrameBufferPool SourcePool;
+            unique_ptr<FrameBufferPool> Pools[FrameFormats::SlotCount];
+
+            mutex Lock;
+            vector<FrameFormats*> Idle;
+
+            atomic<uint64_t> Frames{ 0 };
+            atomic<uint64_t> Requests{ 0 };
+            atomic<uint64_t> Conversions{ 0 };
+            atomic<uint64_t> SharedRequests{ 0 };
+            atomic<uint64_t> Avoided{ 0 };
+            atomic<uint64_t> Failures{ 0 };
+            atomic<uint64_t> ConversionTime{ 0 };
+        };
+    }
+}
+
+bool FrameFormats::Get(PixelFormat Format, Frame& Frame)
+{
+    if (Format == m_SourceFormat)
+    {
+        return true;
+    }
+
+    FormatCacheContext& Context = *m_Context;
+    Context.Requests.fetch_add(1, memory_order_relaxed);
+
+    uint32_t Index = static_cast<uint32_t>(Format);
+    if (m_SourceFormat != PixelFormat::Bgra8 || Format == PixelFormat::Unknown || Index >= SlotCount)
+    {
+        Context.Failures.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    unique_lock<mutex> Lock(m_Lock);
+    Slot& Slot = m_Slots[Index];
+    if (Slot.State == SlotState::Empty)
+    {
+        // Convert without the lock, so requests for other formats of the frame convert alongside
+        Slot.State = SlotState::Converting;
+        Lock.unlock();
+
+        uint64_t Start = MonotonicNanoseconds();
+        FrameBufferRef Buffer = Context.Pools[Index]->Acquire({ m_Width, m_Height, Format });
+        bool Converted = Buffer && ConvertBgraFrame(m_pSource, m_SourcePitch, m_Width, m_Height, Buffer->Data(), Buffer->Pitch(),
+            Format, Context.Matrix, Context.Range, Context.Level);
+        Context.ConversionTime.fetch_add(MonotonicNanoseconds() - Start, memory_order_relaxed);
+        (Converted ? Context.Conversions : Context.Failures).fetch_add(1, memory_order_relaxed);
+
+        Lock.lock();
+        Slot.State = Converted ? SlotState::Ready : SlotState::Failed;
+        Slot.Buffer = Converted ? move(Buffer) : FrameBufferRef();
+        m_Converted.notify_all();
+    }
+    else
+    {
+        m_Converted.wait(Lock, [&Slot] { return Slot.State != SlotState::Converting; });
+        if (Slot.State == SlotState::Ready)
+        {
+            Context.SharedRequests.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    if (Slot.State != SlotState::Ready)
+    {
+        return false;
+    }
+
+    Frame.pData = Slot.Buffer->Data();
+    Frame.Pitch = Slot.Buffer->Pitch();
+    Frame.Format = Format;
+    Frame.pBuffer = Slot.Buffer.Get();
+    return true;
+}
+
+bool FrameFormats::Has(PixelFormat Format) const
+{
+    if (Format == m_SourceFormat)
+    {
+        return true;
+    }
+
+    uint32_t Index = static_cast<uint32_t>(Format);
+    lock_guard<mutex> Lock(m_Lock);
+    return Index < SlotCount && m_Slots[Index].State == SlotState::Ready;
+}
+
+void FrameFormats::Release()
+{
+    if (m_RefCount.fetch_sub(1, memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    // The context goes away with the last cache once the stage is gone, so hold on to it until this one is stored
+    shared_ptr<FormatCacheContext> Context = move(m_Context);
+    for (PixelFormat Offered : Context->Offered)
+    {
+        uint32_t Index = static_cast<uint32_t>(Offered);
+        Context->Avoided.fetch_add(Offered != m_SourceFormat && Index < SlotCount && m_Slots[Index].State == SlotState::Empty ? 1 : 0,
+            memory_order_relaxed);
+    }
+
+    for (Slot& Slot : m_Slots)
+    {
+        Slot.State = SlotState::Empty;
+        Slot.Buffer.Reset();
+    }
+    m_Source.Reset();
+
+    lock_guard<mutex> Lock(Context->Lock);
+    if (Context->Idle.size() < FormatCacheContext::MaxIdle)
+    {
+        Context->Idle.push_back(this);
+    }
+    else
+    {
+        delete this;
+    }
+}
+
+FormatCacheStage::FormatCacheStage(const vector<PixelFormat>& Offered, ColorMatrix Matrix, ColorRange Range)
+    : m_Context(make_shared<FormatCacheContext>(Offered, Matrix, Range))
+{
+}
+
+FormatCacheStage::~FormatCacheStage()
+{
+    m_Current.Reset();
+}
+
+bool FormatCacheStage::Process(Frame& Frame)
+{
+    Frame.pFormats = nullptr;
+    if (!Frame.pData)
+    {
+        return true;
+    }
+
+    // The cache converts on demand, possibly after the producer's buffer is gone, so it needs pixels of its own
+    FrameBufferRef Source;
+    if (Frame.pBuffer)
+    {
+        Frame.pBuffer->AddRef();
+        Source = FrameBufferRef(Frame.pBuffer);
+    }
+    else
+    {
+        Source = m_Context->SourcePool.Acquire({ Frame.Width, Frame.Height, Frame.Format });
+        if (!Source)
+        {
+            return true;
+        }
+
+        uint32_t RowBytes = Frame.Width * BytesPerPixel(Frame.Format);
+        uint32_t Rows = FrameRows(Frame.Format, Frame.Height);
+        for (uint32_t Y = 0; Y < Rows; Y++)
+        {
+            memcpy(Source->Data() + static_cast<size_t>(Y) * Source->Pitch(), Frame.pData + static_cast<size_t>(Y) * Frame.Pitch, RowBytes);
+        }
+
+        Frame.pData = Source->Data();
+        Frame.Pitch = Source->Pitch();
+        Frame.pBuffer = Source.Get();
+    }
+
+    FrameFormats* pFormats = nullptr;
+    {
+        lock_guard<mutex> Lock(m_Context->Lock);
+        if (!m_Context->Idle.empty())
+        {
+            pFormats = m_Context->Idle.back();
+            m_Context->Idle.pop_back();
+        }
+    }
+    if (!pFormats)
+    {
+        pFormats = new FrameFormats();
+        for (FrameFormats::Slot& Slot : pFormats->m_Slots)
+        {
+            Slot.State = FrameFormats::SlotState::Empty;
+        }
+    }
+
+    pFormats->m_Context = m_Context;
+    pFormats->m_RefCount.store(1, memory_order_relaxed);
+    pFormats->m_Source = move(Source);
+    pFormats->m_pSource = Frame.pData;
+    pFormats->m_SourcePitch = Frame.Pitch;
+    pFormats->m_Width = Frame.Width;
+    pFormats->m_Height = Frame.Height;
+    pFormats->m_SourceFormat = Frame.Format;
+
+    // Releases the previous frame's cache, unless a consumer still holds it
+    m_Current = FrameFormatsRef(pFormats);
+    Frame.pFormats = pFormats;
+    m_Context->Frames.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+FormatCacheStatistics FormatCacheStage::Statistics() const
+{
+    const FormatCacheContext& Context = *m_Context;
+    FormatCacheStatistics Statistics;
+    Statistics.Frames = Context.Frames.load(memory_order_relaxed);
+    Statistics.Requests = Context.Requests.load(memory_order_relaxed);
+    Statistics.Conversions = Context.Conversions.load(memory_order_relaxed);
+    Statistics.SharedRequests = Context.SharedRequests.load(memory_order_relaxed);
+    Statistics.Avoided = Context.Avoided.load(memory_order_relaxed);
+    Statistics.Failures = Context.Failures.load(memory_order_relaxed);
+    Statistics.ConversionTime = Context.ConversionTime.load(memory_order_relaxed);
+    return Statistics;
+}
@@ -0,0 +1,189 @@
+/*++
+
+Module Name:
+
+    format_cache.h
+
+Abstract:
+
+    This module contains the per-frame cache of converted representations, and the stage that attaches one to
+    every frame. Consumers that want the pixels in another format ask the frame's cache for it: the first request
+    for a format converts the frame, every later or concurrent request for it shares that conversion, and formats
+    nobody asks for are never produced.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "color_convert.h"
+#include "frame.h"
+#include "frame_buffer_pool.h"
+#include "frame_pipeline.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Counters of a format cache stage, summed over every frame it cached.
+        /// </summary>
+        struct FormatCacheStatistics
+        {
+            uint64_t Frames;
+            uint64_t Requests;          // for a format other than the source's
+            uint64_t Conversions;       // requests that had to convert
+            uint64_t SharedRequests;    // requests served by a conversion another request did or was doing
+            uint64_t Avoided;           // offered formats of a frame that nobody requested before the frame went away
+            uint64_t Failures;          // requests for a format the source cannot be converted to
+            uint64_t ConversionTime;    // [ns]
+        };
+
+        struct FormatCacheContext;
+
+        /// <summary>
+        /// The representations of one frame. Reference counted: whoever keeps the frame past the call that handed
+        /// it over must AddRef pFormats along with pBuffer. The source pixels are immutable while cached.
+        /// </summary>
+        class FrameFormats
+        {
+        public:
+            // Points the pixels of Frame, a copy of the frame the cache belongs to, at their Format representation,
+            // converting on the first request. The pixels stay valid while the caller holds a reference on the cache,
+            // which is what to keep rather than the converted pBuffer. Returns false if the source cannot be
+            // converted to Format or no buffer is left.
+            bool Get(PixelFormat Format, Frame& Frame);
+
+            // Whether Format has been produced already
+            bool Has(PixelFormat Format) const;
+
+            void AddRef() { m_RefCount.fetch_add(1, std::memory_order_relaxed); }
+
+            // Returns the cache and its buffers once the last reference is gone
+            void Release();
+
+        private:
+            friend class FormatCacheStage;
+            friend struct FormatCacheContext;
+
+            static const uint32_t SlotCount = static_cast<uint32_t>(PixelFormat::I444Split) + 1;
+
+            enum class SlotState
+            {
+                Empty,
+                Converting,
+                Ready,
+                Failed,
+            };
+
+            struct Slot
+            {
+                SlotState State;
+                FrameBufferRef Buffer;
+            };
+
+            FrameFormats() : m_RefCount(0), m_pSource(nullptr), m_SourcePitch(0), m_Width(0), m_Height(0), m_SourceFormat(PixelFormat::Unknown) {}
+
+            // Shared with the stage, so the pools stay around for caches that outlive it
+            std::shared_ptr<FormatCacheContext> m_Context;
+            std::atomic<uint32_t> m_RefCount;
+
+            FrameBufferRef m_Source;
+            const uint8_t* m_pSource;
+            uint32_t m_SourcePitch;
+            uint32_t m_Width;
+            uint32_t m_Height;
+            PixelFormat m_SourceFormat;
+
+            mutable std::mutex m_Lock;
+            std::condition_variable m_Converted;
+            Slot m_Slots[SlotCount];
+        };
+
+        /// <summary>
+        /// Owning handle to a FrameFormats.
+        /// </summary>
+        class FrameFormatsRef
+        {
+        public:
+            FrameFormatsRef() : m_pFormats(nullptr) {}
+
+            // Takes over a reference the caller already owns
+            explicit FrameFormatsRef(FrameFormats* pFormats) : m_pFormats(pFormats) {}
+
+            FrameFormatsRef(const FrameFormatsRef& Other) : m_pFormats(Other.m_pFormats)
+            {
+                if (m_pFormats)
+                {
+                    m_pFormats->AddRef();
+                }
+            }
+
+            FrameFormatsRef(FrameFormatsRef&& Other) noexcept : m_pFormats(Other.m_pFormats)
+            {
+                Other.m_pFormats = nullptr;
+            }
+
+            FrameFormatsRef& operator=(FrameFormatsRef Other) noexcept
+            {
+                std::swap(m_pFormats, Other.m_pFormats);
+                return *this;
+            }
+
+            ~FrameFormatsRef() { Reset(); }
+
+            void Reset()
+            {
+                if (m_pFormats)
+                {
+                    m_pFormats->Release();
+                    m_pFormats = nullptr;
+                }
+            }
+
+            FrameFormats* Get() const { return m_pFormats; }
+            FrameFormats* operator->() const { return m_pFormats; }
+            explicit operator bool() const { return m_pFormats != nullptr; }
+
+        private:
+            FrameFormats* m_pFormats;
+        };
+
+        /// <summary>
+        /// Attaches a format cache to every frame with CPU-visible pixels, through Frame.pFormats. Frames whose
+        /// pixels are not in a pooled buffer yet are copied into one, since the cache may convert them long after
+        /// the producer's buffer is gone.
+        /// </summary>
+        class FormatCacheStage : public IFrameStage
+        {
+        public:
+            // Offered lists the formats consumers may ask for, which converting every frame eagerly would produce;
+            // a frame's offered formats nobody asked for count as avoided conversions
+            FormatCacheStage(const std::vector<PixelFormat>& Offered, ColorMatrix Matrix, ColorRange Range);
+            ~FormatCacheStage();
+
+            const char* Name() const override { return "FormatCache"; }
+            bool Process(Frame& Frame) override;
+
+            FormatCacheStatistics Statistics() const;
+
+        private:
+            // Holds the pools, including the one frames without a pooled buffer are copied into
+            std::shared_ptr<FormatCacheContext> m_Context;
+
+            // The cache of the latest frame, kept until the next one as ColorConvertStage keeps its output
+            FrameFormatsRef m_Current;
+        };
+    }
+}
@@ -0,0 +1,166 @@
+/*++
+
+Module Name:
+
+    frame.h
+
+Abstract:
+
+    This module contains the platform-neutral description of a frame that flows through the swap-chain processing
+    pipeline, shared by the driver and by the portable tools built on top of the pipeline.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        class FrameBuffer;
+        class FrameFormats;
+        struct EncodedFrame;
+
+        /// <summary>
+        /// Pixel layouts understood by the frame pipeline.
+        /// </summary>
+        enum class PixelFormat : uint32_t
+        {
+            Unknown = 0,
+            Bgra8,      // 32-bit B8G8R8A8, the format of every IddCx swap-chain surface
+            Nv12,       // 8-bit Y plane followed by an interleaved half-resolution UV plane with the same pitch
+            I420,       // 8-bit Y plane followed by half-resolution U and V planes, each at half the pitch
+            I444,       // 8-bit Y, U and V planes at full resolution, all with the same pitch
+            I444Split,  // 4:4:4 carried as two I420 pictures: a main view and a chroma residual view
+        };
+
+        // Bytes per pixel of the first (for YUV, the luma) plane
+        inline uint32_t BytesPerPixel(PixelFormat Format)
+        {
+            switch (Format)
+            {
+            case PixelFormat::Bgra8:
+                return 4;
+            case PixelFormat::Nv12:
+            case PixelFormat::I420:
+            case PixelFormat::I444:
+            case PixelFormat::I444Split:
+                return 1;
+            default:
+                return 0;
+            }
+        }
+
+        // Rows of first-plane pitch needed to hold every plane of a Height-row image
+        inline uint32_t FrameRows(PixelFormat Format, uint32_t Height)
+        {
+            switch (Format)
+            {
+            case PixelFormat::Nv12:
+            case PixelFormat::I420:
+                return Height + (Height + 1) / 2;
+            case PixelFormat::I444:
+                return Height * 3;
+            case PixelFormat::I444Split:
+                return (Height + (Height + 1) / 2) * 2;
+            default:
+                return Height;
+            }
+        }
+
+        /// <summary>
+        /// A rectangle in frame pixels. Right and Bottom are exclusive, as in RECT.
+        /// </summary>
+        struct Rect
+        {
+            int32_t Left;
+            int32_t Top;
+            int32_t Right;
+            int32_t Bottom;
+
+            bool Empty() const { return Right <= Left || Bottom <= Top; }
+            int64_t Area() const { return Empty() ? 0 : static_cast<int64_t>(Right - Left) * (Bottom - Top); }
+
+            bool operator==(const Rect& Other) const
+            {
+                return Left == Other.Left && Top == Other.Top && Right == Other.Right && Bottom == Other.Bottom;
+            }
+            bool operator!=(const Rect& Other) const { return !(*this == Other); }
+        };
+
+        /// <summary>
+        /// A region the producer copied from elsewhere in the previous frame, as in an IddCx move region. The source
+        /// is the top-left corner of the copied area; Destination has the same size.
+        /// </summary>
+        struct MoveRect
+        {
+            int32_t SourceX;
+            int32_t SourceY;
+            Rect Destination;
+        };
+
+        /// <summary>
+        /// How much of a frame is known to differ from the previous frame the consumer saw.
+        /// </summary>
+        enum class DamageState : uint32_t
+        {
+            Unknown = 0,    // no information, treat every pixel as changed
+            Full,           // every pixel may have changed
+            Partial,        // apply the move rectangles, then redraw the dirty rectangles; nothing else changed
+        };
+
+        /// <summary>
+        /// Returns the current value of the monotonic clock in nanoseconds. All frame timestamps use this clock.
+        /// </summary>
+        inline uint64_t MonotonicNanoseconds()
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        /// <summary>
+        /// A single acquired swap-chain buffer as seen by processing stages and sinks.
+        /// </summary>
+        struct Frame
+        {
+            uint64_t FrameNumber;   // presentation frame number reported by the producer
+            uint64_t PresentTime;   // monotonic time the producer made the frame available [ns], 0 if unknown
+            uint64_t AcquireTime;   // monotonic time the pipeline acquired the frame [ns]
+            uint64_t VsyncSequence; // virtual vsync the frame was acquired in, counted from the start of the clock
+            uint64_t VsyncTime;     // monotonic time of that vsync [ns], 0 if the pipeline has no vsync clock
+            uint64_t TraceId;       // id of the frame's trace events, 0 if the pipeline has no tracer
+
+            uint32_t Width;
+            uint32_t Height;
+            uint32_t Pitch;         // bytes between the starts of two consecutive rows of pData
+            PixelFormat Format;
+
+            uint8_t* pData;         // CPU-visible pixels, or nullptr when the frame only lives on the GPU
+            void* pSurface;         // native surface backing the frame (IDXGIResource* in the driver), may be nullptr
+            FrameBuffer* pBuffer;   // pooled buffer behind pData, if any; AddRef it to keep the pixels past the call
+
+            // Damage relative to the previous frame delivered to the sink. The rectangles are clipped to the frame,
+            // dirty rectangles never overlap, and all of them are owned by whoever filled them in; they stay valid
+            // for as long as the pixels do.
+            DamageState Damage;
+            uint32_t DirtyRectCount;
+            const Rect* pDirtyRects;
+            uint32_t MoveRectCount;
+            const MoveRect* pMoveRects;
+
+            // Compressed form of the frame, set by an EncodeStage and valid until that stage sees the next frame
+            const EncodedFrame* pEncoded;
+
+            // The frame's pixels in other formats, converted on demand, if a FormatCacheStage attached a cache; AddRef
+            // it along with pBuffer to keep the frame past the call
+            FrameFormats* pFormats;
+        };
+    }
+}
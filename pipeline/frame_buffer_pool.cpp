@@ -0,0 +1,274 @@
+/*++
+
+Module Name:
+
+    frame_buffer_pool.cpp
+
+Abstract:
+
+    This module contains the pool that owns CPU frame memory.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_buffer_pool.h"
+
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const size_t DefaultLargePageSize = 2 * 1024 * 1024;
+
+    size_t AlignUp(size_t Value, size_t Alignment)
+    {
+        return (Value + Alignment - 1) / Alignment * Alignment;
+    }
+
+    // Tries to get large-page backed memory. On Windows this needs SeLockMemoryPrivilege, on Linux it relies on
+    // transparent huge pages; either way the caller falls back to regular pages when it fails.
+    void* AllocateLargePages(size_t Size, size_t& Allocated)
+    {
+#ifdef _WIN32
+        size_t PageSize = GetLargePageMinimum();
+        if (PageSize == 0)
+        {
+            return nullptr;
+        }
+
+        Allocated = AlignUp(Size, PageSize);
+        return VirtualAlloc(nullptr, Allocated, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#else
+        Allocated = AlignUp(Size, DefaultLargePageSize);
+        void* pMemory = mmap(nullptr, Allocated, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pMemory == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+#ifdef MADV_HUGEPAGE
+        if (madvise(pMemory, Allocated, MADV_HUGEPAGE) == 0)
+        {
+            return pMemory;
+        }
+#endif
+
+        munmap(pMemory, Allocated);
+        return nullptr;
+#endif
+    }
+
+    void FreeLargePages(void* pMemory, size_t Allocated)
+    {
+#ifdef _WIN32
+        (void)Allocated;
+        VirtualFree(pMemory, 0, MEM_RELEASE);
+#else
+        munmap(pMemory, Allocated);
+#endif
+    }
+}
+
+void FrameBuffer::Release()
+{
+    if (m_RefCount.fetch_sub(1, memory_order_acq_rel) == 1)
+    {
+        m_pPool->Recycle(this);
+    }
+}
+
+FrameBufferPool::FrameBufferPool(bool UseLargePages, uint32_t MaxIdleBuffers)
+    : m_UseLargePages(UseLargePages)
+    , m_MaxIdleBuffers(MaxIdleBuffers)
+    , m_ActiveKey()
+    , m_Statistics()
+{
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    Trim();
+}
+
+FrameBufferRef FrameBufferPool::Acquire(const FrameBufferKey& Key)
+{
+    FrameBuffer* pBuffer = nullptr;
+    vector<FrameBuffer*> Stale;
+
+    {
+        lock_guard<mutex> Lock(m_Lock);
+
+        if (Key != m_ActiveKey)
+        {
+            // The mode changed: idle buffers of the old mode will never be asked for again
+            Stale.swap(m_Idle);
+            m_ActiveKey = Key;
+        }
+
+        if (!m_Idle.empty())
+        {
+            pBuffer = m_Idle.back();
+            m_Idle.pop_back();
+            m_Statistics.Hits++;
+        }
+        else
+        {
+            m_Statistics.Misses++;
+        }
+
+        m_Statistics.OutstandingBuffers++;
+    }
+
+    for (FrameBuffer* pStale : Stale)
+    {
+        Free(pStale);
+    }
+
+    if (!pBuffer)
+    {
+        pBuffer = Allocate(Key);
+        if (!pBuffer)
+        {
+            lock_guard<mutex> Lock(m_Lock);
+            m_Statistics.OutstandingBuffers--;
+            return FrameBufferRef();
+        }
+    }
+
+    pBuffer->m_RefCount.store(1, memory_order_relaxed);
+    return FrameBufferRef(pBuffer);
+}
+
+void FrameBufferPool::Trim()
+{
+    vector<FrameBuffer*> Idle;
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        Idle.swap(m_Idle);
+    }
+
+    for (FrameBuffer* pBuffer : Idle)
+    {
+        Free(pBuffer);
+    }
+}
+
+FrameBufferPoolStatistics FrameBufferPool::Statistics() const
+{
+    lock_guard<mutex> Lock(m_Lock);
+    return m_Statistics;
+}
+
+FrameBuffer* FrameBufferPool::Allocate(const FrameBufferKey& Key)
+{
+    // Pad rows to the alignment as well so every row of the frame starts on a cache line
+    uint32_t Pitch = static_cast<uint32_t>(AlignUp(static_cast<size_t>(Key.Width) * BytesPerPixel(Key.Format), FrameBufferAlignment));
+    size_t Size = static_cast<size_t>(Pitch) * FrameRows(Key.Format, Key.Height);
+    if (Size == 0)
+    {
+        return nullptr;
+    }
+
+    size_t Allocated = Size;
+    bool LargePages = false;
+    void* pMemory = nullptr;
+
+    if (m_UseLargePages)
+    {
+        pMemory = AllocateLargePages(Size, Allocated);
+        LargePages = (pMemory != nullptr);
+    }
+
+    if (!pMemory)
+    {
+        Allocated = Size;
+        pMemory = ::operator new(Size, align_val_t(FrameBufferAlignment), nothrow);
+        if (!pMemory)
+        {
+            return nullptr;
+        }
+    }
+
+    FrameBuffer* pBuffer = new (nothrow) FrameBuffer();
+    if (!pBuffer)
+    {
+        if (LargePages)
+        {
+            FreeLargePages(pMemory, Allocated);
+        }
+        else
+        {
+            ::operator delete(pMemory, align_val_t(FrameBufferAlignment));
+        }
+        return nullptr;
+    }
+
+    pBuffer->m_pPool = this;
+    pBuffer->m_Key = Key;
+    pBuffer->m_pData = static_cast<uint8_t*>(pMemory);
+    pBuffer->m_Size = Size;
+    pBuffer->m_Allocated = Allocated;
+    pBuffer->m_Pitch = Pitch;
+    pBuffer->m_LargePages = LargePages;
+    pBuffer->m_RefCount.store(0, memory_order_relaxed);
+
+    lock_guard<mutex> Lock(m_Lock);
+    m_Statistics.ResidentBytes += Allocated;
+    m_Statistics.LargePageBuffers += LargePages ? 1 : 0;
+    return pBuffer;
+}
+
+void FrameBufferPool::Free(FrameBuffer* pBuffer)
+{
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Statistics.ResidentBytes -= pBuffer->m_Allocated;
+        m_Statistics.LargePageBuffers -= pBuffer->m_LargePages ? 1 : 0;
+    }
+
+    if (pBuffer->m_LargePages)
+    {
+        FreeLargePages(pBuffer->m_pData, pBuffer->m_Allocated);
+    }
+    else
+    {
+        ::operator delete(pBuffer->m_pData, align_val_t(FrameBufferAlignment));
+    }
+
+    delete pBuffer;
+}
+
+void FrameBufferPool::Recycle(FrameBuffer* pBuffer)
+{
+    bool Keep = false;
+
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Statistics.OutstandingBuffers--;
+
+        if (pBuffer->m_Key == m_ActiveKey && m_Idle.size() < m_MaxIdleBuffers)
+        {
+            m_Idle.push_back(pBuffer);
+            Keep = true;
+        }
+    }
+
+    if (!Keep)
+    {
+        Free(pBuffer);
+    }
+}
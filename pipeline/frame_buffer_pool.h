@@ -0,0 +1,178 @@
+/*++
+
+Module Name:
+
+    frame_buffer_pool.h
+
+Abstract:
+
+    This module contains the pool that owns CPU frame memory. Buffers are 64-byte aligned (rows included), can be
+    backed by large pages, are reference counted and go back to the pool when the last reference is released, so
+    steady-state frame processing never allocates.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "frame.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const size_t FrameBufferAlignment = 64;
+
+        struct FrameBufferKey
+        {
+            uint32_t Width;
+            uint32_t Height;
+            PixelFormat Format;
+
+            bool operator==(const FrameBufferKey& Other) const
+            {
+                return Width == Other.Width && Height == Other.Height && Format == Other.Format;
+            }
+            bool operator!=(const FrameBufferKey& Other) const { return !(*this == Other); }
+        };
+
+        class FrameBufferPool;
+
+        /// <summary>
+        /// A reference-counted block of frame memory owned by a FrameBufferPool.
+        /// </summary>
+        class FrameBuffer
+        {
+        public:
+            uint8_t* Data() const { return m_pData; }
+            uint32_t Pitch() const { return m_Pitch; }
+            size_t Size() const { return m_Size; }
+            const FrameBufferKey& Key() const { return m_Key; }
+            bool LargePages() const { return m_LargePages; }
+
+            void AddRef() { m_RefCount.fetch_add(1, std::memory_order_relaxed); }
+
+            // Returns the buffer to its pool once the last reference is gone
+            void Release();
+
+        private:
+            friend class FrameBufferPool;
+
+            FrameBufferPool* m_pPool;
+            FrameBufferKey m_Key;
+            uint8_t* m_pData;
+            size_t m_Size;
+            size_t m_Allocated;
+            uint32_t m_Pitch;
+            bool m_LargePages;
+            std::atomic<uint32_t> m_RefCount;
+        };
+
+        /// <summary>
+        /// Owning handle to a FrameBuffer, in the spirit of ComPtr.
+        /// </summary>
+        class FrameBufferRef
+        {
+        public:
+            FrameBufferRef() : m_pBuffer(nullptr) {}
+
+            // Takes over a reference the caller already owns
+            explicit FrameBufferRef(FrameBuffer* pBuffer) : m_pBuffer(pBuffer) {}
+
+            FrameBufferRef(const FrameBufferRef& Other) : m_pBuffer(Other.m_pBuffer)
+            {
+                if (m_pBuffer)
+                {
+                    m_pBuffer->AddRef();
+                }
+            }
+
+            FrameBufferRef(FrameBufferRef&& Other) noexcept : m_pBuffer(Other.m_pBuffer)
+            {
+                Other.m_pBuffer = nullptr;
+            }
+
+            FrameBufferRef& operator=(FrameBufferRef Other) noexcept
+            {
+                std::swap(m_pBuffer, Other.m_pBuffer);
+                return *this;
+            }
+
+            ~FrameBufferRef() { Reset(); }
+
+            void Reset()
+            {
+                if (m_pBuffer)
+                {
+                    m_pBuffer->Release();
+                    m_pBuffer = nullptr;
+                }
+            }
+
+            FrameBuffer* Get() const { return m_pBuffer; }
+            FrameBuffer* operator->() const { return m_pBuffer; }
+            explicit operator bool() const { return m_pBuffer != nullptr; }
+
+        private:
+            FrameBuffer* m_pBuffer;
+        };
+
+        struct FrameBufferPoolStatistics
+        {
+            uint64_t Hits;              // acquisitions served from a recycled buffer
+            uint64_t Misses;            // acquisitions that had to allocate
+            uint64_t ResidentBytes;     // memory currently allocated by the pool, in use or idle
+            uint64_t OutstandingBuffers;
+            uint64_t LargePageBuffers;  // resident buffers actually backed by large pages
+        };
+
+        /// <summary>
+        /// Recycles frame buffers keyed by (width, height, format). Only the most recently requested key is kept
+        /// idle, so buffers survive swap-chain reassignment as long as the mode does not change and are freed once
+        /// it does. The pool must outlive every buffer it hands out.
+        /// </summary>
+        class FrameBufferPool
+        {
+        public:
+            // MaxIdleBuffers bounds how many released buffers of the active key are kept for reuse
+            FrameBufferPool(bool UseLargePages = false, uint32_t MaxIdleBuffers = 8);
+            ~FrameBufferPool();
+
+            FrameBufferPool(const FrameBufferPool&) = delete;
+            FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+            // Returns a buffer with one reference, or an empty handle if memory could not be allocated
+            FrameBufferRef Acquire(const FrameBufferKey& Key);
+
+            // Frees every idle buffer
+            void Trim();
+
+            FrameBufferPoolStatistics Statistics() const;
+
+        private:
+            friend class FrameBuffer;
+
+            FrameBuffer* Allocate(const FrameBufferKey& Key);
+            void Free(FrameBuffer* pBuffer);
+            void Recycle(FrameBuffer* pBuffer);
+
+            const bool m_UseLargePages;
+            const uint32_t m_MaxIdleBuffers;
+
+            mutable std::mutex m_Lock;
+            FrameBufferKey m_ActiveKey;
+            std::vector<FrameBuffer*> m_Idle;
+            FrameBufferPoolStatistics m_Statistics;
+        };
+    }
+}
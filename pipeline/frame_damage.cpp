@@ -0,0 +1,245 @@
+/*++
+
+Module Name:
+
+    frame_damage.cpp
+
+Abstract:
+
+    This module contains the frame damage normalization and the accumulation across frames that were skipped.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_damage.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    Rect Clip(const Rect& Area, int32_t Width, int32_t Height)
+    {
+        return { max(Area.Left, 0), max(Area.Top, 0), min(Area.Right, Width), min(Area.Bottom, Height) };
+    }
+}
+
+FrameDamage::FrameDamage()
+    : m_State(DamageState::Unknown), m_Missed(false), m_UnknownMissed(false)
+{
+}
+
+void FrameDamage::Reset(DamageState State)
+{
+    m_State = State;
+    m_Dirty.Clear();
+    m_MoveRects.clear();
+}
+
+void FrameDamage::AddDirtyRect(const Rect& Area)
+{
+    if (m_State == DamageState::Full)
+    {
+        return;
+    }
+
+    m_State = DamageState::Partial;
+    m_Dirty.Union(Area);
+}
+
+void FrameDamage::AddMoveRect(const MoveRect& Move)
+{
+    if (m_State == DamageState::Full)
+    {
+        return;
+    }
+
+    m_State = DamageState::Partial;
+    m_MoveRects.push_back(Move);
+}
+
+void FrameDamage::AddExactMove(const MoveRect& Move)
+{
+    if (m_State == DamageState::Full)
+    {
+        return;
+    }
+
+    AddMoveRect(Move);
+    m_Dirty.Subtract(Move.Destination);
+}
+
+void FrameDamage::Assign(const Frame& Frame)
+{
+    m_State = Frame.Damage;
+
+    // The frame may already point at this object, e.g. after Publish
+    if (Frame.pDirtyRects != m_Dirty.begin())
+    {
+        m_Dirty.Clear();
+        if (Frame.pDirtyRects)
+        {
+            m_Dirty.Union(Frame.pDirtyRects, Frame.DirtyRectCount);
+        }
+    }
+    if (Frame.pMoveRects != m_MoveRects.data())
+    {
+        m_MoveRects.assign(Frame.pMoveRects, Frame.pMoveRects + (Frame.pMoveRects ? Frame.MoveRectCount : 0));
+    }
+
+    if (m_State != DamageState::Partial)
+    {
+        m_Dirty.Clear();
+        m_MoveRects.clear();
+    }
+}
+
+void FrameDamage::Normalize(uint32_t Width, uint32_t Height)
+{
+    if (m_State != DamageState::Partial)
+    {
+        Reset(m_State);
+        return;
+    }
+
+    int32_t W = static_cast<int32_t>(Width);
+    int32_t H = static_cast<int32_t>(Height);
+
+    m_Dirty.Intersect(Rect{ 0, 0, W, H });
+
+    // Clip a move so both its destination and its source lie inside the frame
+    auto LastMove = remove_if(m_MoveRects.begin(), m_MoveRects.end(), [&](MoveRect& Move)
+    {
+        int32_t DeltaX = Move.SourceX - Move.Destination.Left;
+        int32_t DeltaY = Move.SourceY - Move.Destination.Top;
+        Rect Source = { Move.SourceX, Move.SourceY, Move.Destination.Right + DeltaX, Move.Destination.Bottom + DeltaY };
+        Source = Clip(Source, W, H);
+
+        Rect Destination = Clip(Move.Destination, W, H);
+        Destination.Left = max(Destination.Left, Source.Left - DeltaX);
+        Destination.Top = max(Destination.Top, Source.Top - DeltaY);
+        Destination.Right = min(Destination.Right, Source.Right - DeltaX);
+        Destination.Bottom = min(Destination.Bottom, Source.Bottom - DeltaY);
+
+        Move = { Destination.Left + DeltaX, Destination.Top + DeltaY, Destination };
+        return Destination.Empty() || (DeltaX == 0 && DeltaY == 0);
+    });
+    m_MoveRects.erase(LastMove, m_MoveRects.end());
+
+    if (m_MoveRects.size() > MaxMoveRects)
+    {
+        for (size_t i = MaxMoveRects; i < m_MoveRects.size(); i++)
+        {
+            m_Dirty.Union(m_MoveRects[i].Destination);
+        }
+        m_MoveRects.resize(MaxMoveRects);
+    }
+
+    Bound();
+}
+
+void FrameDamage::Publish(Frame& Frame) const
+{
+    Frame.Damage = m_State;
+    Frame.DirtyRectCount = m_Dirty.RectCount();
+    Frame.pDirtyRects = m_Dirty.Empty() ? nullptr : m_Dirty.begin();
+    Frame.MoveRectCount = static_cast<uint32_t>(m_MoveRects.size());
+    Frame.pMoveRects = m_MoveRects.empty() ? nullptr : m_MoveRects.data();
+}
+
+void FrameDamage::Accumulate(const Frame& Missed)
+{
+    if (!m_Missed)
+    {
+        // The first frame missed since the last delivery starts the accumulation
+        Assign(Missed);
+        m_Missed = true;
+        m_UnknownMissed = m_State == DamageState::Unknown;
+        if (m_UnknownMissed)
+        {
+            Reset(DamageState::Partial);
+        }
+    }
+    else if (Missed.Damage == DamageState::Unknown)
+    {
+        m_UnknownMissed = true;
+        return;
+    }
+    else if (Missed.Damage == DamageState::Full)
+    {
+        Reset(DamageState::Full);
+        return;
+    }
+    else if (m_State == DamageState::Partial)
+    {
+        if (Missed.pDirtyRects)
+        {
+            m_Dirty.Union(Missed.pDirtyRects, Missed.DirtyRectCount);
+        }
+        for (uint32_t i = 0; i < Missed.MoveRectCount && Missed.pMoveRects; i++)
+        {
+            m_Dirty.Union(Missed.pMoveRects[i].Destination);
+        }
+    }
+
+    // Moves of different frames do not compose, so a missed frame's moves only mark their destinations dirty
+    AddMovesAsDirty();
+    Bound();
+}
+
+void FrameDamage::Deliver(Frame& Delivered)
+{
+    if (!m_Missed)
+    {
+        return;
+    }
+
+    m_Missed = false;
+
+    if (Delivered.Damage == DamageState::Unknown)
+    {
+        return;
+    }
+
+    if (Delivered.Damage == DamageState::Full || m_State == DamageState::Full || m_UnknownMissed)
+    {
+        Reset(DamageState::Full);
+        Publish(Delivered);
+        return;
+    }
+
+    // The delivered frame's moves are relative to a frame the consumer never saw, so they become dirty too
+    if (Delivered.pDirtyRects)
+    {
+        m_Dirty.Union(Delivered.pDirtyRects, Delivered.DirtyRectCount);
+    }
+    for (uint32_t i = 0; i < Delivered.MoveRectCount && Delivered.pMoveRects; i++)
+    {
+        m_Dirty.Union(Delivered.pMoveRects[i].Destination);
+    }
+
+    Bound();
+    Publish(Delivered);
+}
+
+void FrameDamage::AddMovesAsDirty()
+{
+    for (const MoveRect& Move : m_MoveRects)
+    {
+        m_Dirty.Union(Move.Destination);
+    }
+    m_MoveRects.clear();
+}
+
+void FrameDamage::Bound()
+{
+    if (m_Dirty.RectCount() > MaxDirtyRects)
+    {
+        m_Dirty.Reset(m_Dirty.Extents());
+    }
+}
@@ -0,0 +1,88 @@
+/*++
+
+Module Name:
+
+    frame_damage.h
+
+Abstract:
+
+    This module contains the owned form of a frame's damage: the dirty and move rectangles a producer reports, or
+    the tile-hash detector finds, relative to the previous frame. It also folds the damage of frames that never
+    reach the consumer into the next frame that does, so skipping frames never loses an update.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frame.h"
+#include "region.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Storage for the dirty and move rectangles that a Frame points at.
+        /// </summary>
+        class FrameDamage
+        {
+        public:
+            // Longer lists are collapsed: the dirty region into its bounding box, extra moves into the dirty region
+            static const size_t MaxDirtyRects = 64;
+            static const size_t MaxMoveRects = 16;
+
+            FrameDamage();
+
+            DamageState State() const { return m_State; }
+            const Region& DirtyRegion() const { return m_Dirty; }
+            const std::vector<MoveRect>& MoveRects() const { return m_MoveRects; }
+
+            // Drops every rectangle and starts over in the given state
+            void Reset(DamageState State = DamageState::Unknown);
+
+            // Adding a rectangle makes the damage Partial, unless it is already Full
+            void AddDirtyRect(const Rect& Area);
+            void AddMoveRect(const MoveRect& Move);
+
+            // Adds a move known to reproduce its destination exactly, which therefore no longer needs to be dirty
+            void AddExactMove(const MoveRect& Move);
+
+            // Copies the damage a frame points at, e.g. before the producer's rectangles go away
+            void Assign(const Frame& Frame);
+
+            // Clips every rectangle to a Width x Height frame, drops empty and no-op ones and bounds the list lengths
+            void Normalize(uint32_t Width, uint32_t Height);
+
+            // Points the frame's damage fields at this object
+            void Publish(Frame& Frame) const;
+
+            // Records the damage of a frame the consumer will never see
+            void Accumulate(const Frame& Missed);
+            bool HasMissed() const { return m_Missed; }
+
+            // Folds everything accumulated since the last delivery into Delivered, the next frame the consumer sees,
+            // and publishes the result into it. Damage of Delivered that is still Unknown is left alone: whatever
+            // resolves it (the detector, or a full redraw) compares against the last delivered frame anyway.
+            void Deliver(Frame& Delivered);
+
+        private:
+            void AddMovesAsDirty();
+            void Bound();
+
+            DamageState m_State;
+            Region m_Dirty;         // published as its band rectangles, which never overlap
+            std::vector<MoveRect> m_MoveRects;
+
+            bool m_Missed;          // holds the damage of frames since the last delivery
+            bool m_UnknownMissed;   // one of them had Unknown damage
+        };
+    }
+}
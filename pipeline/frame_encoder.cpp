@@ -0,0 +1,31 @@
+/*++
+
+Module Name:
+
+    frame_encoder.cpp
+
+Abstract:
+
+    This module contains the encode stage.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_encoder.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+EncodeStage::EncodeStage(shared_ptr<IFrameEncoder> Encoder)
+    : m_Encoder(move(Encoder)), m_Output()
+{
+}
+
+bool EncodeStage::Process(Frame& Frame)
+{
+    Frame.pEncoded = m_Encoder->Encode(Frame, m_Output) ? &m_Output : nullptr;
+    return true;
+}
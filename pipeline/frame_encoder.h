@@ -0,0 +1,77 @@
+/*++
+
+Module Name:
+
+    frame_encoder.h
+
+Abstract:
+
+    This module contains the interface between the frame pipeline and frame encoders, and the stage that runs an
+    encoder on every frame. An encoder may produce delta frames from the frame damage: since the damage is relative
+    to the previous frame the sink saw, so is every delta, as long as the encode stage is the last stage.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "frame.h"
+#include "frame_pipeline.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// A compressed frame. The bytes belong to the encoder that produced them.
+        /// </summary>
+        struct EncodedFrame
+        {
+            const char* Codec;
+            const uint8_t* pData;
+            size_t Size;
+            bool KeyFrame;      // decodable on its own; otherwise it updates the previous frame the sink received
+        };
+
+        /// <summary>
+        /// Compresses frames for a sink to send or store.
+        /// </summary>
+        class IFrameEncoder
+        {
+        public:
+            virtual ~IFrameEncoder() = default;
+
+            virtual const char* Name() const = 0;
+
+            // Compresses Frame into Output, which stays valid until the next call. Returns false if the frame cannot
+            // be encoded, e.g. because of its format; the next frame is then encoded as a key frame.
+            virtual bool Encode(const Frame& Frame, EncodedFrame& Output) = 0;
+
+            // Makes the next frame a key frame, e.g. when a new consumer attaches
+            virtual void RequestKeyFrame() = 0;
+        };
+
+        /// <summary>
+        /// Encodes each frame and points Frame.pEncoded at the result. Frames the encoder rejects pass on without it.
+        /// </summary>
+        class EncodeStage : public IFrameStage
+        {
+        public:
+            explicit EncodeStage(std::shared_ptr<IFrameEncoder> Encoder);
+
+            const char* Name() const override { return "Encode"; }
+            bool Process(Frame& Frame) override;
+
+        private:
+            std::shared_ptr<IFrameEncoder> m_Encoder;
+            EncodedFrame m_Output;
+        };
+    }
+}
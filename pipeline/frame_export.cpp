@@ -0,0 +1,700 @@
+/*++
+
+Module Name:
+
+    frame_export.cpp
+
+Abstract:
+
+    This module contains the frame export writer and reader.
+
+    Readers block on a wake-up that the writer only sends when a reader says it is waiting: a futex on WakeCount
+    on Linux, one named event per claim word on Windows, and a short poll elsewhere or for unnamed regions.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_export.h"
+
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <sddl.h>
+#elif defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const size_t PageSize = 4096;
+
+    size_t AlignUp(size_t Value, size_t Alignment)
+    {
+        return (Value + Alignment - 1) / Alignment * Alignment;
+    }
+
+    size_t PixelOffset()
+    {
+        return AlignUp(sizeof(FrameExportSlot), PageSize);
+    }
+
+    size_t SlotSize(uint32_t MaxWidth, uint32_t MaxHeight)
+    {
+        // BGRA is the largest format: every YUV layout takes at most 3 bytes a pixel
+        return AlignUp(PixelOffset() + static_cast<size_t>(MaxWidth) * MaxHeight * 4, PageSize);
+    }
+
+#ifdef _WIN32
+    // Like the region, but readers only need to wait on the events
+    const char* const EventSecurity = "D:P(A;;GA;;;SY)(A;;GA;;;BA)(A;;GA;;;OW)(A;;0x00100000;;;AU)";
+
+    string WakeEventName(const char* Name, uint32_t Reader)
+    {
+        return string(Name) + ".Wake" + to_string(Reader);
+    }
+#elif defined(__linux__)
+    // Without FUTEX_PRIVATE_FLAG, so waiters in other processes that map the same region are woken too. Waiting
+    // only reads the word, so readers can wait on it through their read-only mapping.
+    void WaitOnWord(const atomic<uint32_t>& Word, uint32_t Expected, uint32_t TimeoutMs)
+    {
+        timespec Timeout = { static_cast<time_t>(TimeoutMs / 1000), static_cast<long>(TimeoutMs % 1000) * 1000000 };
+        syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&Word), FUTEX_WAIT, Expected, &Timeout, nullptr, 0);
+    }
+
+    void WakeWord(atomic<uint32_t>& Word)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&Word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+#endif
+}
+
+size_t FrameExportWriter::RegionSize(uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers)
+{
+    return AlignUp(sizeof(FrameExportHeader), PageSize) + (Readers + 2) * SlotSize(MaxWidth, MaxHeight);
+}
+
+FrameExportWriter::FrameExportWriter()
+    : m_pHeader(nullptr), m_pControl(nullptr), m_pBase(nullptr), m_Sequence(0), m_LatestSlot(0), m_SlotCount(0),
+    m_ReaderCount(0), m_FirstSlotOffset(0), m_SlotSize(0), m_PixelOffset(0), m_Width(0), m_Height(0),
+    m_Format(PixelFormat::Unknown), m_Statistics()
+{
+#ifdef _WIN32
+    for (void*& hEvent : m_hWakeEvents)
+    {
+        hEvent = nullptr;
+    }
+#endif
+}
+
+FrameExportWriter::~FrameExportWriter()
+{
+    Close();
+}
+
+bool FrameExportWriter::Create(const char* Name, uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers)
+{
+    Close();
+
+    // Only the control region is writable to readers
+    if (Readers == 0 || Readers > FrameExportMaxReaders || !m_Region.Create(Name, RegionSize(MaxWidth, MaxHeight, Readers)) ||
+        !m_Control.Create((string(Name) + FrameExportControlSuffix).c_str(), sizeof(FrameExportControl), true))
+    {
+        Close();
+        return false;
+    }
+
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES Attributes = { sizeof(Attributes), nullptr, FALSE };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorA(EventSecurity, SDDL_REVISION_1, &Attributes.lpSecurityDescriptor, nullptr))
+    {
+        Close();
+        return false;
+    }
+
+    bool Created = true;
+    for (uint32_t i = 0; i < Readers && Created; i++)
+    {
+        m_hWakeEvents[i] = CreateEventA(&Attributes, FALSE, FALSE, WakeEventName(Name, i).c_str());
+        Created = m_hWakeEvents[i] != nullptr;
+    }
+    LocalFree(Attributes.lpSecurityDescriptor);
+
+    if (!Created)
+    {
+        Close();
+        return false;
+    }
+#endif
+
+    Initialize(m_Region.Data(), static_cast<FrameExportControl*>(m_Control.Data()), MaxWidth, MaxHeight, Readers, m_Region.Reclaimed());
+    return true;
+}
+
+void FrameExportWriter::Attach(void* pRegion, FrameExportControl* pControl, uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers)
+{
+    Initialize(pRegion, pControl, MaxWidth, MaxHeight, Readers, false);
+}
+
+void FrameExportWriter::Initialize(void* pRegion, FrameExportControl* pControl, uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers,
+    bool Reclaimed)
+{
+    // Readers may rewrite anything they map, so the writer goes by these and never by the header
+    m_SlotCount = Readers + 2;
+    m_ReaderCount = Readers;
+    m_FirstSlotOffset = AlignUp(sizeof(FrameExportHeader), PageSize);
+    m_SlotSize = SlotSize(MaxWidth, MaxHeight);
+    m_PixelOffset = PixelOffset();
+
+    // Readers of the previous writer may still claim slots, wait or be opening the region. Hiding the magic keeps
+    // new ones out until the header is rewritten. The generation goes up before the claim words are reset, so a
+    // reader that looks at the generation after it stores a claim either sees it change and hands the word back,
+    // or stored the claim before the reset.
+    FrameExportHeader* pHeader;
+    if (Reclaimed)
+    {
+        pHeader = static_cast<FrameExportHeader*>(pRegion);
+        memset(pHeader->Magic, 0, sizeof(pHeader->Magic));
+        pHeader->Generation.store((pHeader->Generation.load(memory_order_seq_cst) + 1) | 1, memory_order_seq_cst);
+
+        // Waiting readers go by WakeCount, so it keeps counting
+        m_pHeader = pHeader;
+        WakeAll();
+    }
+    else
+    {
+        pHeader = new (pRegion) FrameExportHeader;
+        pHeader->Generation.store(1, memory_order_relaxed);
+        pHeader->WakeCount.store(0, memory_order_relaxed);
+    }
+
+    FrameExportControl* pWords = new (pControl) FrameExportControl;
+    for (uint32_t i = 0; i < FrameExportMaxReaders; i++)
+    {
+        pWords->Claims[i].store(FrameExportNoReader, memory_order_seq_cst);
+        pWords->Waiting[i].store(0, memory_order_relaxed);
+    }
+
+    // Readers that map the region early see no magic until the header and the control words are complete
+    pHeader->Version = FrameExportVersion;
+    pHeader->HeaderSize = sizeof(FrameExportHeader);
+    pHeader->SlotCount = m_SlotCount;
+    pHeader->ReaderCount = m_ReaderCount;
+    pHeader->MaxWidth = MaxWidth;
+    pHeader->MaxHeight = MaxHeight;
+    pHeader->FirstSlotOffset = m_FirstSlotOffset;
+    pHeader->SlotSize = m_SlotSize;
+    pHeader->PixelOffset = static_cast<uint32_t>(m_PixelOffset);
+    pHeader->Latest.store(0, memory_order_relaxed);
+    pHeader->Reserved2 = 0;
+
+    m_pBase = static_cast<uint8_t*>(pRegion);
+    m_pHeader = pHeader;
+    m_pControl = pWords;
+    m_Sequence = 0;
+    m_LatestSlot = 0;
+    m_Stale.assign(m_SlotCount, Region());
+    m_Width = 0;
+    m_Height = 0;
+    m_Format = PixelFormat::Unknown;
+    m_Statistics = FrameExportStatistics();
+
+    atomic_thread_fence(memory_order_release);
+    memcpy(pHeader->Magic, FrameExportMagic, sizeof(pHeader->Magic));
+}
+
+void FrameExportWriter::Close()
+{
+    // Readers that keep the region open stop waiting for frames that will not come
+    if (m_pHeader)
+    {
+        m_pHeader->Generation.fetch_add(1, memory_order_seq_cst);
+        WakeAll();
+    }
+
+#ifdef _WIN32
+    for (void*& hEvent : m_hWakeEvents)
+    {
+        if (hEvent)
+        {
+            CloseHandle(hEvent);
+            hEvent = nullptr;
+        }
+    }
+#endif
+
+    m_pHeader = nullptr;
+    m_pControl = nullptr;
+    m_pBase = nullptr;
+    m_Control.Close();
+    m_Region.Close();
+}
+
+FrameExportSlot& FrameExportWriter::Slot(uint32_t Index) const
+{
+    return *reinterpret_cast<FrameExportSlot*>(m_pBase + m_FirstSlotOffset + Index * m_SlotSize);
+}
+
+uint8_t* FrameExportWriter::Pixels(uint32_t Index) const
+{
+    return reinterpret_cast<uint8_t*>(&Slot(Index)) + m_PixelOffset;
+}
+
+uint32_t FrameExportWriter::FreeSlot() const
+{
+    // Each claim word is read once; one that names no slot (no reader, no frame, or garbage) claims nothing
+    uint32_t Claimed = 0;
+    for (uint32_t i = 0; i < m_ReaderCount; i++)
+    {
+        uint32_t Claim = m_pControl->Claims[i].load(memory_order_seq_cst);
+        if (Claim < m_SlotCount)
+        {
+            Claimed |= 1u << Claim;
+        }
+    }
+
+    for (uint32_t Index = 0; Index < m_SlotCount; Index++)
+    {
+        if ((m_Sequence == 0 || Index != m_LatestSlot) && !(Claimed & (1u << Index)))
+        {
+            return Index;
+        }
+    }
+
+    // Unreachable: the readers claim at most SlotCount - 2 slots besides the latest one
+    return (m_LatestSlot + 1) % m_SlotCount;
+}
+
+bool FrameExportWriter::HasReaders() const
+{
+    if (!m_pControl)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < m_ReaderCount; i++)
+    {
+        if (m_pControl->Claims[i].load(memory_order_relaxed) != FrameExportNoReader)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameExportWriter::Write(const Frame& Frame)
+{
+    // BGRA rows are packed to the width. The planes after the first of a YUV frame sit at the first plane's pitch,
+    // or a fraction of it, so a YUV frame keeps the pitch it came with and is copied whole.
+    uint32_t PixelBytes = BytesPerPixel(Frame.Format);
+    size_t RowBytes = static_cast<size_t>(Frame.Width) * PixelBytes;
+    size_t Pitch = Frame.Format == PixelFormat::Bgra8 ? RowBytes : Frame.Pitch;
+    size_t Rows = FrameRows(Frame.Format, Frame.Height);
+    if (!m_pHeader || !Frame.pData || PixelBytes == 0 || Frame.Pitch < RowBytes || Pitch * Rows > m_SlotSize - m_PixelOffset)
+    {
+        m_Statistics.FramesRejected++;
+        return false;
+    }
+
+    // Forgetting the layout makes the next frame a layout change, which leaves every slot stale and is published
+    // with Full damage
+    if (!HasReaders())
+    {
+        m_Width = 0;
+        m_Height = 0;
+        m_Format = PixelFormat::Unknown;
+        m_Statistics.FramesSkipped++;
+        return true;
+    }
+
+    Rect Whole = { 0, 0, static_cast<int32_t>(Frame.Width), static_cast<int32_t>(Frame.Height) };
+    bool LayoutChanged = Frame.Width != m_Width || Frame.Height != m_Height || Frame.Format != m_Format;
+    if (LayoutChanged)
+    {
+        for (Region& Stale : m_Stale)
+        {
+            Stale.Reset(Whole);
+        }
+        m_Width = Frame.Width;
+        m_Height = Frame.Height;
+        m_Format = Frame.Format;
+    }
+
+    // The pixels already have the moves applied, so a moved area is just another changed one
+    bool Partial = Frame.Damage == DamageState::Partial && !LayoutChanged;
+    Region Damage;
+    if (Partial)
+    {
+        Damage.Union(Frame.pDirtyRects, Frame.DirtyRectCount);
+        for (uint32_t i = 0; i < Frame.MoveRectCount; i++)
+        {
+            Damage.Union(Frame.pMoveRects[i].Destination);
+        }
+    }
+    else
+    {
+        Damage.Reset(Whole);
+    }
+
+    uint32_t Index = FreeSlot();
+    FrameExportSlot& Slot = this->Slot(Index);
+    uint8_t* pPixels = Pixels(Index);
+
+    // Rows of YUV planes do not map to rectangles as simply, so only BGRA slots are brought up to date piecewise
+    Region& Copy = m_Stale[Index];
+    Copy.Union(Damage);
+    if (Frame.Format != PixelFormat::Bgra8 || Copy.Area() == Whole.Area())
+    {
+        if (Frame.Pitch == Pitch)
+        {
+            memcpy(pPixels, Frame.pData, Pitch * Rows);
+        }
+        else
+        {
+            for (size_t Y = 0; Y < Rows; Y++)
+            {
+                memcpy(pPixels + Y * Pitch, Frame.pData + Y * Frame.Pitch, Pitch);
+            }
+        }
+        m_Statistics.BytesCopied += Pitch * Rows;
+    }
+    else
+    {
+        for (const Rect& Area : Copy)
+        {
+            size_t Bytes = static_cast<size_t>(Area.Right - Area.Left) * 4;
+            for (int32_t Y = Area.Top; Y < Area.Bottom; Y++)
+            {
+                memcpy(pPixels + Y * Pitch + Area.Left * 4, Frame.pData + static_cast<size_t>(Y) * Frame.Pitch + Area.Left * 4, Bytes);
+            }
+            m_Statistics.BytesCopied += Bytes * (Area.Bottom - Area.Top);
+        }
+    }
+
+    Copy.Clear();
+    for (uint32_t i = 0; i < m_SlotCount; i++)
+    {
+        if (i != Index)
+        {
+            m_Stale[i].Union(Damage);
+        }
+    }
+
+    Slot.Sequence = ++m_Sequence;
+    Slot.FrameNumber = Frame.FrameNumber;
+    Slot.PresentTime = Frame.PresentTime;
+    Slot.AcquireTime = Frame.AcquireTime;
+    Slot.Width = Frame.Width;
+    Slot.Height = Frame.Height;
+    Slot.Pitch = static_cast<uint32_t>(Pitch);
+    Slot.Format = Frame.Format;
+    Slot.Damage = Partial ? DamageState::Partial : DamageState::Full;
+    Slot.DirtyRectCount = 0;
+    if (Partial && Damage.RectCount() <= FrameExportMaxDirtyRects)
+    {
+        for (const Rect& Area : Damage)
+        {
+            Slot.DirtyRects[Slot.DirtyRectCount++] = Area;
+        }
+    }
+    else if (Partial)
+    {
+        Slot.DirtyRects[Slot.DirtyRectCount++] = Damage.Extents();
+    }
+    Slot.PublishTime = MonotonicNanoseconds();
+
+    m_pHeader->Latest.store(FrameExportLatest(m_Sequence, Index), memory_order_seq_cst);
+    m_LatestSlot = Index;
+    m_Statistics.FramesPublished++;
+
+    Wake();
+    return true;
+}
+
+void FrameExportWriter::Wake()
+{
+    m_pHeader->WakeCount.fetch_add(1, memory_order_seq_cst);
+
+#if defined(__linux__)
+    for (uint32_t i = 0; i < m_ReaderCount; i++)
+    {
+        if (m_pControl->Waiting[i].load(memory_order_seq_cst))
+        {
+            WakeWord(m_pHeader->WakeCount);
+            break;
+        }
+    }
+#elif defined(_WIN32)
+    for (uint32_t i = 0; i < m_ReaderCount; i++)
+    {
+        if (m_hWakeEvents[i] && m_pControl->Waiting[i].load(memory_order_seq_cst))
+        {
+            SetEvent(m_hWakeEvents[i]);
+        }
+    }
+#endif
+}
+
+void FrameExportWriter::WakeAll()
+{
+    m_pHeader->WakeCount.fetch_add(1, memory_order_seq_cst);
+
+#if defined(__linux__)
+    WakeWord(m_pHeader->WakeCount);
+#elif defined(_WIN32)
+    for (uint32_t i = 0; i < m_ReaderCount; i++)
+    {
+        if (m_hWakeEvents[i])
+        {
+            SetEvent(m_hWakeEvents[i]);
+        }
+    }
+#endif
+}
+
+FrameExportReader::FrameExportReader()
+    : m_pHeader(nullptr), m_pControl(nullptr), m_pBase(nullptr), m_SlotCount(0), m_FirstSlotOffset(0), m_SlotSize(0),
+    m_PixelOffset(0), m_Index(0), m_Generation(0), m_LastSequence(0), m_Acquired(0), m_Missed(0)
+#ifdef _WIN32
+    , m_hWakeEvent(nullptr)
+#endif
+{
+}
+
+FrameExportReader::~FrameExportReader()
+{
+    Close();
+}
+
+bool FrameExportReader::Open(const char* Name)
+{
+    Close();
+
+    if (!m_Region.Open(Name) || !m_Control.Open((string(Name) + FrameExportControlSuffix).c_str(), true) ||
+        m_Control.Size() < sizeof(FrameExportControl) ||
+        !Validate(m_Region.Data(), m_Region.Size(), static_cast<FrameExportControl*>(m_Control.Data())))
+    {
+        Close();
+        return false;
+    }
+
+#ifdef _WIN32
+    // Without the event, Wait polls
+    m_hWakeEvent = OpenEventA(SYNCHRONIZE, FALSE, WakeEventName(Name, m_Index).c_str());
+#endif
+    return true;
+}
+
+bool FrameExportReader::Attach(const void* pRegion, size_t Size, FrameExportControl* pControl)
+{
+    Close();
+    return Validate(pRegion, Size, pControl);
+}
+
+void FrameExportReader::Close()
+{
+    // After a change of writers the claim word is no longer this reader's
+    if (m_pHeader && !WriterChanged())
+    {
+        m_pControl->Claims[m_Index].store(FrameExportNoReader, memory_order_seq_cst);
+    }
+
+#ifdef _WIN32
+    if (m_hWakeEvent)
+    {
+        CloseHandle(m_hWakeEvent);
+        m_hWakeEvent = nullptr;
+    }
+#endif
+
+    m_pHeader = nullptr;
+    m_pControl = nullptr;
+    m_pBase = nullptr;
+    m_LastSequence = 0;
+    m_Acquired = 0;
+    m_Missed = 0;
+    m_Control.Close();
+    m_Region.Close();
+}
+
+bool FrameExportReader::Validate(const void* pRegion, size_t Size, FrameExportControl* pControl)
+{
+    const FrameExportHeader* pHeader = static_cast<const FrameExportHeader*>(pRegion);
+    if (Size < sizeof(FrameExportHeader) || memcmp(pHeader->Magic, FrameExportMagic, sizeof(pHeader->Magic)) != 0)
+    {
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    // An even generation means the region has no writer and is only still there because a reader keeps it alive
+    uint32_t Generation = pHeader->Generation.load(memory_order_seq_cst);
+    if (!(Generation & 1) || pHeader->Version == 0 || pHeader->HeaderSize < sizeof(FrameExportHeader) || pHeader->ReaderCount == 0 ||
+        pHeader->ReaderCount > FrameExportMaxReaders || pHeader->SlotCount != pHeader->ReaderCount + 2 ||
+        pHeader->PixelOffset < sizeof(FrameExportSlot) || pHeader->SlotSize < pHeader->PixelOffset ||
+        pHeader->FirstSlotOffset + pHeader->SlotCount * pHeader->SlotSize > Size)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < pHeader->ReaderCount; i++)
+    {
+        uint32_t Free = FrameExportNoReader;
+        if (pControl->Claims[i].compare_exchange_strong(Free, FrameExportNoSlot, memory_order_seq_cst))
+        {
+            // A writer taking the region over may have reset the claim words before this claim
+            if (pHeader->Generation.load(memory_order_seq_cst) != Generation)
+            {
+                uint32_t Claimed = FrameExportNoSlot;
+                pControl->Claims[i].compare_exchange_strong(Claimed, FrameExportNoReader, memory_order_seq_cst);
+                return false;
+            }
+
+            m_pHeader = pHeader;
+            m_Generation = Generation;
+            m_pControl = pControl;
+            m_pBase = static_cast<const uint8_t*>(pRegion);
+            m_SlotCount = pHeader->SlotCount;
+            m_FirstSlotOffset = pHeader->FirstSlotOffset;
+            m_SlotSize = pHeader->SlotSize;
+            m_PixelOffset = pHeader->PixelOffset;
+            m_Index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameExportReader::HasNewFrame() const
+{
+    uint64_t Latest = m_pHeader->Latest.load(memory_order_seq_cst);
+    return Latest != 0 && FrameExportSequence(Latest) != m_LastSequence;
+}
+
+bool FrameExportReader::Acquire(FrameExportView& View)
+{
+    if (WriterChanged())
+    {
+        return false;
+    }
+
+    uint64_t Latest;
+    for (;;)
+    {
+        Latest = m_pHeader->Latest.load(memory_order_seq_cst);
+        if (Latest == 0 || FrameExportSequence(Latest) == m_LastSequence || FrameExportSlotIndex(Latest) >= m_SlotCount)
+        {
+            return false;
+        }
+
+        // Claimed only if the writer had not moved on by the time the claim was visible to it
+        uint32_t Claim = FrameExportSlotIndex(Latest);
+        m_pControl->Claims[m_Index].store(Claim, memory_order_seq_cst);
+        if (WriterChanged())
+        {
+            // A writer taking the region over may have reset the claim words before this store
+            m_pControl->Claims[m_Index].compare_exchange_strong(Claim, FrameExportNoReader, memory_order_seq_cst);
+            return false;
+        }
+        if (m_pHeader->Latest.load(memory_order_seq_cst) == Latest)
+        {
+            break;
+        }
+    }
+
+    uint64_t Sequence = FrameExportSequence(Latest);
+    const FrameExportSlot* pSlot = reinterpret_cast<const FrameExportSlot*>(m_pBase + m_FirstSlotOffset +
+        FrameExportSlotIndex(Latest) * m_SlotSize);
+
+    View.pSlot = pSlot;
+    View.pPixels = reinterpret_cast<const uint8_t*>(pSlot) + m_PixelOffset;
+    View.Sequence = Sequence;
+    View.Missed = m_LastSequence != 0 ? Sequence - m_LastSequence - 1 : 0;
+    if (m_LastSequence == 0 || View.Missed != 0)
+    {
+        View.Damage = DamageState::Full;
+        View.DirtyRectCount = 0;
+        View.pDirtyRects = nullptr;
+    }
+    else
+    {
+        View.Damage = pSlot->Damage;
+        View.DirtyRectCount = pSlot->DirtyRectCount;
+        View.pDirtyRects = pSlot->DirtyRects;
+    }
+
+    m_LastSequence = Sequence;
+    m_Acquired++;
+    m_Missed += View.Missed;
+    return true;
+}
+
+void FrameExportReader::Release()
+{
+    m_pControl->Claims[m_Index].store(FrameExportNoSlot, memory_order_seq_cst);
+}
+
+bool FrameExportReader::Wait(uint32_t TimeoutMs)
+{
+    auto Deadline = chrono::steady_clock::now() + chrono::milliseconds(TimeoutMs);
+
+    for (;;)
+    {
+        uint32_t WakeCount = m_pHeader->WakeCount.load(memory_order_seq_cst);
+        if (WriterChanged())
+        {
+            return false;
+        }
+        if (HasNewFrame())
+        {
+            return true;
+        }
+
+        auto Now = chrono::steady_clock::now();
+        if (Now >= Deadline)
+        {
+            return false;
+        }
+        uint32_t Remaining = static_cast<uint32_t>(chrono::duration_cast<chrono::milliseconds>(Deadline - Now).count()) + 1;
+
+        // The writer checks Waiting after it publishes, so either it sees the flag or the check below sees the frame
+        m_pControl->Waiting[m_Index].store(1, memory_order_seq_cst);
+        if (!HasNewFrame())
+        {
+#if defined(__linux__)
+            WaitOnWord(m_pHeader->WakeCount, WakeCount, Remaining);
+#elif defined(_WIN32)
+            (void)WakeCount;
+            if (m_hWakeEvent)
+            {
+                WaitForSingleObject(m_hWakeEvent, Remaining);
+            }
+            else
+            {
+                Sleep(1);
+            }
+#else
+            (void)WakeCount;
+            (void)Remaining;
+            this_thread::sleep_for(chrono::milliseconds(1));
+#endif
+        }
+        m_pControl->Waiting[m_Index].store(0, memory_order_seq_cst);
+    }
+}
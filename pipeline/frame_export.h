@@ -0,0 +1,214 @@
+/*++
+
+Module Name:
+
+    frame_export.h
+
+Abstract:
+
+    This module contains the writer and the reader of the frame export region, and the sink that exports the
+    frames of a pipeline through a writer. Consumers read frames in place, straight out of the region.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "frame_export_format.h"
+#include "frame_pipeline.h"
+#include "region.h"
+#include "shared_memory.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Counters of a writer.
+        /// </summary>
+        struct FrameExportStatistics
+        {
+            uint64_t FramesPublished;
+            uint64_t FramesRejected;    // larger than the slots, or not CPU-visible
+            uint64_t FramesSkipped;     // written while no reader had the region open
+            uint64_t BytesCopied;       // only what changed since a slot last held a frame is copied into it
+        };
+
+        /// <summary>
+        /// Publishes frames into the region. There must be a single writer per region; it never waits for readers.
+        /// </summary>
+        class FrameExportWriter
+        {
+        public:
+            FrameExportWriter();
+            ~FrameExportWriter();
+
+            FrameExportWriter(const FrameExportWriter&) = delete;
+            FrameExportWriter& operator=(const FrameExportWriter&) = delete;
+
+            // Bytes of a region for frames of up to MaxWidth x MaxHeight BGRA pixels and up to Readers readers
+            static size_t RegionSize(uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers = 1);
+
+            // Creates the named region, which readers map read-only, its control region, which they map writable to
+            // store their claims, and on Windows one wake event per reader. Regions the previous writer left mapped
+            // by readers are taken over, and those readers see the generation change.
+            bool Create(const char* Name, uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers = 1);
+
+            // Initializes a region in caller memory of at least RegionSize bytes, aligned to 8, and its control words
+            void Attach(void* pRegion, FrameExportControl* pControl, uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers = 1);
+
+            void Close();
+
+            bool IsOpen() const { return m_pHeader != nullptr; }
+
+            // Whether any reader holds a claim word; may be called from any thread
+            bool HasReaders() const;
+
+            // Copies the frame into a free slot and publishes it. Fails on a frame with no CPU-visible pixels or
+            // more bytes than a slot holds. Without readers the frame is skipped and every slot goes stale, so the
+            // first frame a new reader sees is written whole.
+            bool Write(const Frame& Frame);
+
+            FrameExportStatistics Statistics() const { return m_Statistics; }
+
+        private:
+            void Initialize(void* pRegion, FrameExportControl* pControl, uint32_t MaxWidth, uint32_t MaxHeight, uint32_t Readers,
+                bool Reclaimed);
+            uint32_t FreeSlot() const;
+            FrameExportSlot& Slot(uint32_t Index) const;
+            uint8_t* Pixels(uint32_t Index) const;
+            void Wake();
+            void WakeAll();
+
+            SharedMemory m_Region;
+            SharedMemory m_Control;
+            FrameExportHeader* m_pHeader;
+            FrameExportControl* m_pControl;
+            uint8_t* m_pBase;
+            uint64_t m_Sequence;
+            uint32_t m_LatestSlot;
+
+            // The layout as Attach wrote it; the header is never read back
+            uint32_t m_SlotCount;
+            uint32_t m_ReaderCount;
+            size_t m_FirstSlotOffset;
+            size_t m_SlotSize;
+            size_t m_PixelOffset;
+
+            // What differs in each slot from the latest frame; a layout change makes all of it differ
+            std::vector<Region> m_Stale;
+            uint32_t m_Width;
+            uint32_t m_Height;
+            PixelFormat m_Format;
+
+            FrameExportStatistics m_Statistics;
+#ifdef _WIN32
+            void* m_hWakeEvents[FrameExportMaxReaders];
+#endif
+        };
+
+        /// <summary>
+        /// A frame claimed by a reader, valid until the reader acquires another, releases it or closes.
+        /// </summary>
+        struct FrameExportView
+        {
+            const FrameExportSlot* pSlot;
+            const uint8_t* pPixels;
+            uint64_t Sequence;              // what pSlot->Sequence stays while the view is held
+            uint64_t Missed;                // frames published since the previous one this reader acquired
+            DamageState Damage;             // relative to that frame: Full whenever any were missed
+            uint32_t DirtyRectCount;
+            const Rect* pDirtyRects;
+        };
+
+        /// <summary>
+        /// Claims the newest frame of a region. Each reader takes one of the region's claim words, so at most
+        /// ReaderCount readers can be open at once.
+        /// </summary>
+        class FrameExportReader
+        {
+        public:
+            FrameExportReader();
+            ~FrameExportReader();
+
+            FrameExportReader(const FrameExportReader&) = delete;
+            FrameExportReader& operator=(const FrameExportReader&) = delete;
+
+            // Maps the named region and its control region; fails if it holds no frame export or every claim word
+            // is taken
+            bool Open(const char* Name);
+
+            // Reads a region in caller memory, e.g. one a FrameExportWriter attached to
+            bool Attach(const void* pRegion, size_t Size, FrameExportControl* pControl);
+
+            void Close();
+
+            bool IsOpen() const { return m_pHeader != nullptr; }
+
+            // Claims the newest frame if it is newer than the last one acquired, releasing that one. Returns false
+            // and keeps the current view when there is nothing new.
+            bool Acquire(FrameExportView& View);
+
+            // Lets the writer reuse the slot of the current view
+            void Release();
+
+            // Waits until a frame newer than the last one acquired is published; false on timeout, or as soon as
+            // the writer is gone
+            bool Wait(uint32_t TimeoutMs);
+
+            // Whether the writer the region had when it was opened closed or was replaced since. Nothing is acquired
+            // any more; close the reader and open the region again.
+            bool WriterChanged() const { return m_pHeader->Generation.load(std::memory_order_seq_cst) != m_Generation; }
+
+            uint64_t FramesAcquired() const { return m_Acquired; }
+            uint64_t FramesMissed() const { return m_Missed; }
+
+        private:
+            bool Validate(const void* pRegion, size_t Size, FrameExportControl* pControl);
+            bool HasNewFrame() const;
+
+            SharedMemory m_Region;
+            SharedMemory m_Control;
+            const FrameExportHeader* m_pHeader;
+            FrameExportControl* m_pControl;
+            const uint8_t* m_pBase;
+            uint32_t m_SlotCount;       // the layout as validated
+            size_t m_FirstSlotOffset;
+            size_t m_SlotSize;
+            size_t m_PixelOffset;
+            uint32_t m_Index;           // of the claim word
+            uint32_t m_Generation;
+            uint64_t m_LastSequence;
+            uint64_t m_Acquired;
+            uint64_t m_Missed;
+#ifdef _WIN32
+            void* m_hWakeEvent;
+#endif
+        };
+
+        /// <summary>
+        /// Exports every frame that reaches the end of a pipeline.
+        /// </summary>
+        class FrameExportSink : public IFrameSink
+        {
+        public:
+            explicit FrameExportSink(std::shared_ptr<FrameExportWriter> Writer) : m_Writer(Writer) {}
+
+            // Nobody reading means no frame needs to be mapped, let alone copied
+            bool NeedsFrames() const override { return m_Writer->HasReaders(); }
+
+            void Consume(const Frame& Frame) override { m_Writer->Write(Frame); }
+
+        private:
+            std::shared_ptr<FrameExportWriter> m_Writer;
+        };
+    }
+}
@@ -0,0 +1,118 @@
+/*++
+
+Module Name:
+
+    frame_export_format.h
+
+Abstract:
+
+    This module contains the layout of the frame export region, through which the driver hands every processed
+    frame to user-mode consumers without copying it again.
+
+    The header is followed by SlotCount slots, each a FrameExportSlot and the pixels of one frame. There are two
+    slots more than readers, so the writer always finds one that is neither the latest frame nor claimed by a
+    reader, and never waits; with one reader that is triple buffering.
+
+    Header.Latest holds the sequence number of the latest frame, shifted left by 8, and the slot it is in. A reader
+    claims a slot by storing its index in its Claims word and then checking that Latest has not moved on; the
+    writer picks its next slot after storing Latest, by reading every claim. Both sides use sequentially consistent
+    operations, so either the reader sees the newer frame and claims that instead, or the writer sees the claim.
+
+    The claim and waiting words are in a control region of their own, the only part readers map writable; the
+    header and the slots are read-only to them. The writer keeps its own copy of the layout rather than reading the
+    header back, and a claim word that names no slot claims nothing, so what a reader writes cannot make the writer
+    copy anywhere but into its slots.
+
+    Header.Generation is odd while a writer is attached and goes up whenever one attaches or leaves. A driver that
+    restarts while a reader still maps the regions takes them over and starts a new generation; readers that see
+    the generation change have lost their writer, and their claim word with it, and must open the region again.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "frame.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const char FrameExportMagic[4] = { 'I', 'D', 'D', 'F' };
+        const uint16_t FrameExportVersion = 2;
+
+        // Where the driver exports the frames of its monitor
+        const char* const FrameExportName = "Global\\WinVirtualDisplayFrames";
+
+        // Appended to the name of a region to name its control region
+        const char* const FrameExportControlSuffix = ".Control";
+
+        const uint32_t FrameExportMaxReaders = 8;
+        const uint32_t FrameExportMaxDirtyRects = 64;
+
+        // Values of a claim word besides a slot index
+        const uint32_t FrameExportNoReader = 0xFFFFFFFF;    // free for a reader to take
+        const uint32_t FrameExportNoSlot = 0xFFFFFFFE;      // taken by a reader that holds no frame
+
+        // Latest is 0 until the first frame is published
+        inline uint64_t FrameExportLatest(uint64_t Sequence, uint32_t Slot) { return Sequence << 8 | Slot; }
+        inline uint64_t FrameExportSequence(uint64_t Latest) { return Latest >> 8; }
+        inline uint32_t FrameExportSlotIndex(uint64_t Latest) { return static_cast<uint32_t>(Latest & 0xFF); }
+
+        struct FrameExportHeader
+        {
+            char Magic[4];
+            uint16_t Version;
+            uint16_t HeaderSize;
+            uint32_t SlotCount;
+            uint32_t ReaderCount;               // claim words in use, SlotCount - 2
+            uint32_t MaxWidth;
+            uint32_t MaxHeight;
+            uint64_t FirstSlotOffset;           // from the start of the region
+            uint64_t SlotSize;                  // bytes between the starts of two slots
+            uint32_t PixelOffset;               // from the start of a slot
+            std::atomic<uint32_t> Generation;
+            std::atomic<uint64_t> Latest;
+            std::atomic<uint32_t> WakeCount;    // bumped on every publish; readers wait for it to change
+            uint32_t Reserved2;
+        };
+
+        /// <summary>
+        /// The words readers write, one of each per reader. The writer initializes them before it completes the header.
+        /// </summary>
+        struct FrameExportControl
+        {
+            std::atomic<uint32_t> Claims[FrameExportMaxReaders];
+            std::atomic<uint32_t> Waiting[FrameExportMaxReaders];  // 1 while the reader is blocked in Wait
+        };
+
+        /// <summary>
+        /// Description of the frame in a slot, written before the frame is published.
+        /// </summary>
+        struct FrameExportSlot
+        {
+            uint64_t Sequence;          // 1 for the first frame published, one more for every later one
+            uint64_t FrameNumber;       // as in Frame
+            uint64_t PresentTime;
+            uint64_t AcquireTime;
+            uint64_t PublishTime;       // MonotonicNanoseconds just before the frame was published
+            uint32_t Width;
+            uint32_t Height;
+            uint32_t Pitch;             // of the first plane; the others follow it as PixelFormat describes
+            PixelFormat Format;
+            DamageState Damage;         // relative to the frame published before this one
+            uint32_t DirtyRectCount;    // moved areas are included; more than fit make the damage Full
+            Rect DirtyRects[FrameExportMaxDirtyRects];
+        };
+
+        static_assert(sizeof(FrameExportHeader) == 64, "the header layout is fixed");
+        static_assert(sizeof(FrameExportControl) == 64, "the control layout is fixed");
+        static_assert(sizeof(FrameExportSlot) % sizeof(uint64_t) == 0, "slots are 8-byte aligned");
+    }
+}
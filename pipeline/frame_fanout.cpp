@@ -0,0 +1,156 @@
+/*++
+
+Module Name:
+
+    frame_fanout.cpp
+
+Abstract:
+
+    This module contains the fan-out sink.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_fanout.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+FrameFanOut::FrameFanOut(shared_ptr<FrameBufferPool> Pool)
+    : m_Pool(Pool), m_Subscribers(make_shared<SubscriberList>()), m_Statistics()
+{
+    if (!m_Pool)
+    {
+        m_Pool = make_shared<FrameBufferPool>();
+    }
+}
+
+FrameFanOut::~FrameFanOut()
+{
+    Stop();
+}
+
+shared_ptr<BackpressureSink> FrameFanOut::Subscribe(shared_ptr<IFrameSink> Consumer, BackpressurePolicy Policy,
+    uint32_t Depth, uint32_t BlockTimeoutMs)
+{
+    auto Added = make_shared<Subscriber>();
+    Added->Sink = make_shared<BackpressureSink>(Consumer, Policy, Depth, BlockTimeoutMs, m_Pool);
+    Added->Policy = Policy;
+    Added->Started = false;
+
+    // Ahead of every Block subscriber, so waiting for room in one of those never delays a frame for the others
+    lock_guard<mutex> Lock(m_Lock);
+    auto Subscribers = make_shared<SubscriberList>(*m_Subscribers);
+    auto Position = Policy == BackpressurePolicy::Block ? Subscribers->end() :
+        find_if(Subscribers->begin(), Subscribers->end(),
+            [](const shared_ptr<Subscriber>& Entry) { return Entry->Policy == BackpressurePolicy::Block; });
+    Subscribers->insert(Position, Added);
+    m_Subscribers = Subscribers;
+    return Added->Sink;
+}
+
+void FrameFanOut::Unsubscribe(const shared_ptr<BackpressureSink>& Sink)
+{
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        auto Subscribers = make_shared<SubscriberList>(*m_Subscribers);
+        Subscribers->erase(remove_if(Subscribers->begin(), Subscribers->end(),
+            [&Sink](const shared_ptr<Subscriber>& Entry) { return Entry->Sink == Sink; }),
+            Subscribers->end());
+        m_Subscribers = Subscribers;
+    }
+
+    // A frame being published right now may still reach it, and is rejected once it has stopped
+    Sink->Stop();
+}
+
+size_t FrameFanOut::SubscriberCount() const
+{
+    lock_guard<mutex> Lock(m_Lock);
+    return m_Subscribers->size();
+}
+
+void FrameFanOut::Consume(const Frame& Published)
+{
+    shared_ptr<const SubscriberList> Subscribers;
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        Subscribers = m_Subscribers;
+    }
+
+    if (Subscribers->empty())
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Statistics.FramesPublished++;
+        return;
+    }
+
+    // Copy the pixels once into a buffer every subscriber can hold on to; if none is left each subscriber copies
+    // them itself
+    Frame Shared = Published;
+    FrameBufferRef Buffer;
+    if (Published.pData && !Published.pBuffer)
+    {
+        Buffer = m_Pool->Acquire({ Published.Width, Published.Height, Published.Format });
+        if (Buffer)
+        {
+            uint32_t RowBytes = Published.Width * BytesPerPixel(Published.Format);
+            uint32_t Rows = FrameRows(Published.Format, Published.Height);
+            for (uint32_t Y = 0; Y < Rows; Y++)
+            {
+                memcpy(Buffer->Data() + static_cast<size_t>(Y) * Buffer->Pitch(), Published.pData + static_cast<size_t>(Y) * Published.Pitch,
+                    RowBytes);
+            }
+
+            Shared.pData = Buffer->Data();
+            Shared.Pitch = Buffer->Pitch();
+            Shared.pBuffer = Buffer.Get();
+        }
+    }
+
+    // A new subscriber has nothing the damage could be relative to
+    Frame First = Shared;
+    First.Damage = DamageState::Full;
+    First.DirtyRectCount = 0;
+    First.pDirtyRects = nullptr;
+    First.MoveRectCount = 0;
+    First.pMoveRects = nullptr;
+
+    for (const shared_ptr<Subscriber>& Entry : *Subscribers)
+    {
+        Entry->Sink->Consume(Entry->Started ? Shared : First);
+        Entry->Started = true;
+    }
+
+    lock_guard<mutex> Lock(m_Lock);
+    m_Statistics.FramesPublished++;
+    m_Statistics.FramesCopied += Buffer ? 1 : 0;
+    m_Statistics.Deliveries += Subscribers->size();
+}
+
+void FrameFanOut::Stop()
+{
+    shared_ptr<const SubscriberList> Subscribers;
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        Subscribers = m_Subscribers;
+        m_Subscribers = make_shared<SubscriberList>();
+    }
+
+    for (const shared_ptr<Subscriber>& Entry : *Subscribers)
+    {
+        Entry->Sink->Stop();
+    }
+}
+
+FanOutStatistics FrameFanOut::Statistics() const
+{
+    lock_guard<mutex> Lock(m_Lock);
+    return m_Statistics;
+}
@@ -0,0 +1,101 @@
+/*++
+
+Module Name:
+
+    frame_fanout.h
+
+Abstract:
+
+    This module contains the sink that hands every frame to several consumers, such as a recorder, a streamer and
+    a thumbnailer. The pixels of a frame are shared by all of them: each subscriber queues a reference on the same
+    pooled buffer, which goes back to the pool once the last subscriber is done with it. Every subscriber has a
+    queue, a backpressure policy and a consumer thread of its own, so a slow one never holds up the others. The
+    exception is the Block policy, which waits for room on the publishing thread: Block subscribers are offered
+    each frame after everyone else, so they never delay that frame, but while one of them is full it paces the
+    publisher, and with it how soon the others see the next frame.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "backpressure.h"
+#include "frame.h"
+#include "frame_buffer_pool.h"
+#include "frame_pipeline.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Counters of a fan-out sink.
+        /// </summary>
+        struct FanOutStatistics
+        {
+            uint64_t FramesPublished;
+            uint64_t FramesCopied;      // frames not in a pooled buffer yet, copied once for every subscriber
+            uint64_t Deliveries;        // frames handed to subscriber queues, one per subscriber and frame
+        };
+
+        /// <summary>
+        /// Publishes every frame to any number of subscribers without copying it for each. Subscribers must treat
+        /// the pixels as read-only, since the others see the same memory. Subscribing and unsubscribing are safe
+        /// while frames flow; Consume must be called from one thread at a time.
+        /// </summary>
+        class FrameFanOut : public IFrameSink
+        {
+        public:
+            // Frames that are not in a pooled buffer are copied into one of Pool; without a pool the sink creates a
+            // private one. Buffers of frames already pooled must outlive Stop.
+            explicit FrameFanOut(std::shared_ptr<FrameBufferPool> Pool = nullptr);
+            ~FrameFanOut();
+
+            FrameFanOut(const FrameFanOut&) = delete;
+            FrameFanOut& operator=(const FrameFanOut&) = delete;
+
+            // Adds a consumer behind a queue of its own. The returned sink holds the subscriber's statistics and is
+            // the handle to unsubscribe it with. The first frame it receives has Full damage.
+            std::shared_ptr<BackpressureSink> Subscribe(std::shared_ptr<IFrameSink> Consumer, BackpressurePolicy Policy,
+                uint32_t Depth = 3, uint32_t BlockTimeoutMs = 20);
+
+            // Delivers what the subscriber has queued, then drops it
+            void Unsubscribe(const std::shared_ptr<BackpressureSink>& Subscriber);
+
+            size_t SubscriberCount() const;
+
+            void Consume(const Frame& Frame) override;
+
+            // Unsubscribes everyone
+            void Stop();
+
+            FanOutStatistics Statistics() const;
+
+        private:
+            struct Subscriber
+            {
+                std::shared_ptr<BackpressureSink> Sink;
+                BackpressurePolicy Policy;
+                bool Started;           // has been offered a frame; only touched by Consume
+            };
+
+            typedef std::vector<std::shared_ptr<Subscriber>> SubscriberList;
+
+            std::shared_ptr<FrameBufferPool> m_Pool;
+
+            // Replaced rather than modified, so Consume walks a list that no one changes under it. Block subscribers
+            // come last.
+            mutable std::mutex m_Lock;
+            std::shared_ptr<const SubscriberList> m_Subscribers;
+            FanOutStatistics m_Statistics;
+        };
+    }
+}
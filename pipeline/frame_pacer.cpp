@@ -0,0 +1,116 @@
+/*++
+
+Module Name:
+
+    frame_pacer.cpp
+
+Abstract:
+
+    This module contains the acquire-loop pacing.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_pacer.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint64_t DefaultPeriod = 1000000000ull / 60;
+
+    // Polls per refresh period while a buffer the event announced is late; never more than one a millisecond
+    const uint64_t RetriesPerPeriod = 8;
+}
+
+FramePacer::FramePacer()
+    : m_Period(DefaultPeriod), m_FixedPolling(0), m_Signalled(false), m_Retrying(false), m_SignalTime(0), m_Statistics()
+{
+}
+
+void FramePacer::SetRefreshRate(uint64_t Numerator, uint64_t Denominator)
+{
+    m_Period = (Numerator != 0 && Denominator != 0) ? max<uint64_t>(1, Denominator * 1000000000ull / Numerator) : DefaultPeriod;
+}
+
+void FramePacer::SetFixedPolling(uint32_t TimeoutMs)
+{
+    m_FixedPolling = TimeoutMs;
+}
+
+uint32_t FramePacer::WaitTimeout(uint64_t Now) const
+{
+    if (m_FixedPolling != 0)
+    {
+        return m_FixedPolling;
+    }
+
+    if (!m_Retrying)
+    {
+        return WaitForever;
+    }
+
+    // Poll a few times within one refresh period of the event, but never past the end of that period
+    uint64_t Deadline = m_SignalTime + m_Period;
+    uint64_t Remaining = Deadline > Now ? Deadline - Now : 0;
+    uint64_t Timeout = min(m_Period / RetriesPerPeriod, Remaining);
+    return static_cast<uint32_t>(max<uint64_t>(1, Timeout / 1000000));
+}
+
+void FramePacer::OnSignalled(uint64_t Now)
+{
+    m_Statistics.Wakeups++;
+
+    // A late buffer keeps the time of the event that announced it
+    if (!m_Retrying)
+    {
+        m_SignalTime = Now;
+    }
+    m_Signalled = true;
+}
+
+void FramePacer::OnTimeout(uint64_t Now)
+{
+    m_Statistics.Wakeups++;
+    m_Statistics.Timeouts++;
+
+    if (m_Retrying && Now >= m_SignalTime + m_Period)
+    {
+        // Whatever the event announced did not arrive; wait for the next one
+        m_Retrying = false;
+        m_Signalled = false;
+    }
+}
+
+void FramePacer::OnAcquired(uint64_t Now)
+{
+    if (m_Signalled)
+    {
+        uint64_t Latency = Now > m_SignalTime ? Now - m_SignalTime : 0;
+        m_Statistics.SignalledFrames++;
+        m_Statistics.SignalLatencySum += Latency;
+        m_Statistics.SignalLatencyMax = max(m_Statistics.SignalLatencyMax, Latency);
+    }
+
+    m_Signalled = false;
+    m_Retrying = false;
+}
+
+void FramePacer::OnEmptyAcquire(uint64_t Now)
+{
+    (void)Now;
+    m_Statistics.EmptyAcquires++;
+
+    // The event fired, so a buffer is on its way even though it is not there yet
+    if (m_Signalled && !m_Retrying)
+    {
+        m_Statistics.SpuriousWakeups++;
+        m_Retrying = true;
+    }
+}
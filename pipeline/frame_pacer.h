@@ -0,0 +1,85 @@
+/*++
+
+Module Name:
+
+    frame_pacer.h
+
+Abstract:
+
+    This module contains the pacing of the acquire loop. The loop normally blocks on the producer's new-frame event
+    alone, so an idle desktop costs no wakeups at all. Only when the event fired but no buffer was ready yet does it
+    poll again, a fraction of the committed mode's refresh period later, and gives up once a whole period has gone
+    by. A fixed poll that treats every timeout as a possible frame is kept for comparison.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Counters maintained by the pacer.
+        /// </summary>
+        struct PacerStatistics
+        {
+            uint64_t Wakeups;               // waits that returned because of the event or a timeout
+            uint64_t Timeouts;
+            uint64_t SpuriousWakeups;       // the event fired, but the acquire that followed found no buffer
+            uint64_t EmptyAcquires;         // acquires that found no buffer, for whatever reason
+            uint64_t SignalledFrames;       // frames acquired after the event fired
+            uint64_t SignalLatencySum;      // event to acquire of those frames [ns]
+            uint64_t SignalLatencyMax;      // [ns]
+        };
+
+        /// <summary>
+        /// Decides how long the acquire loop waits for the next frame.
+        /// </summary>
+        class FramePacer
+        {
+        public:
+            // Same value as INFINITE
+            static const uint32_t WaitForever = 0xFFFFFFFF;
+
+            FramePacer();
+
+            // Refresh rate of the committed mode in Hz, as the fraction Numerator / Denominator; 0 if unknown, in
+            // which case 60 Hz is assumed
+            void SetRefreshRate(uint64_t Numerator, uint64_t Denominator);
+
+            // Waits at most TimeoutMs and retries the acquire after every timeout, as the loop did before pacing.
+            // 0 turns pacing back on.
+            void SetFixedPolling(uint32_t TimeoutMs);
+
+            uint64_t RefreshPeriod() const { return m_Period; }
+
+            // Timeout for the next wait in milliseconds, or WaitForever
+            uint32_t WaitTimeout(uint64_t Now) const;
+
+            // Now is the time the event arrived [ns]
+            void OnSignalled(uint64_t Now);
+            void OnTimeout(uint64_t Now);
+
+            // Outcome of the acquire that followed a wait
+            void OnAcquired(uint64_t Now);
+            void OnEmptyAcquire(uint64_t Now);
+
+            const PacerStatistics& Statistics() const { return m_Statistics; }
+
+        private:
+            uint64_t m_Period;          // [ns]
+            uint32_t m_FixedPolling;    // [ms], 0 when paced
+            bool m_Signalled;           // the event fired since the last acquire
+            bool m_Retrying;            // polling for a buffer the event announced
+            uint64_t m_SignalTime;
+            PacerStatistics m_Statistics;
+        };
+    }
+}
@@ -0,0 +1,607 @@
+/*++
+
+Module Name:
+
+    frame_pipeline.cpp
+
+Abstract:
+
+    This module contains the platform-neutral swap-chain processing loop.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_pipeline.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+FramePipeline::FramePipeline(ISwapChainSource& Source)
+    : m_Source(Source), m_Statistics(), m_DetectionTileSize(64), m_MotionSearch(false), m_QueueDepth(0), m_Stop(false),
+      m_HandOff(false), m_DrainScheduled(false)
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+    StopProcessingThread();
+}
+
+void FramePipeline::AddStage(shared_ptr<IFrameStage> Stage)
+{
+    m_Timings.AddStage(Stage->Name());
+    m_StageEndTimes.push_back(0);
+    m_Stages.push_back(move(Stage));
+}
+
+void FramePipeline::SetSink(shared_ptr<IFrameSink> Sink)
+{
+    m_Sink = move(Sink);
+}
+
+void FramePipeline::SetAsyncProcessing(uint32_t QueueDepth)
+{
+    m_QueueDepth = QueueDepth;
+}
+
+void FramePipeline::SetProcessingPool(shared_ptr<WorkerPool> Pool)
+{
+    m_ProcessingPool = move(Pool);
+}
+
+void FramePipeline::SetRefreshRate(uint64_t Numerator, uint64_t Denominator)
+{
+    m_Pacer.SetRefreshRate(Numerator, Denominator);
+}
+
+void FramePipeline::SetFixedPolling(uint32_t TimeoutMs)
+{
+    m_Pacer.SetFixedPolling(TimeoutMs);
+}
+
+void FramePipeline::SetVsyncClock(shared_ptr<VsyncClock> Clock)
+{
+    m_VsyncClock = move(Clock);
+}
+
+void FramePipeline::SetTracer(shared_ptr<FrameTracer> Tracer)
+{
+    m_Tracer = move(Tracer);
+}
+
+void FramePipeline::SetMetrics(shared_ptr<MetricsRegistry> Metrics)
+{
+    m_Metrics = move(Metrics);
+}
+
+void FramePipeline::SetChangeDetection(uint32_t TileSize)
+{
+    m_DetectionTileSize = TileSize;
+}
+
+void FramePipeline::SetMotionSearch(bool Enable)
+{
+    m_MotionSearch = Enable;
+}
+
+void FramePipeline::SetBufferPool(shared_ptr<FrameBufferPool> Pool)
+{
+    m_Pool = move(Pool);
+}
+
+void FramePipeline::RunCore()
+{
+    if (!m_Source.Initialize())
+    {
+        return;
+    }
+
+    FrameTracer* pTracer = m_Tracer.get();
+    if (pTracer)
+    {
+        pTracer->SetThreadName("acquire");
+    }
+
+    Count(MetricId::ActiveSwapChains);
+
+    if (m_QueueDepth != 0 && HasConsumers())
+    {
+        if (!m_Pool)
+        {
+            m_Pool = make_shared<FrameBufferPool>();
+        }
+
+        m_PendingFrames.reset(new SpscQueue<FrameHandle>(m_QueueDepth));
+        m_HandOff = true;
+
+        if (!m_ProcessingPool)
+        {
+            m_Stop = false;
+            m_ProcessingThread = thread(&FramePipeline::ProcessingThread, this);
+        }
+    }
+
+    // Acquire and release buffers in a loop
+    for (;;)
+    {
+        // Ask for the next buffer from the producer
+        Frame Frame = {};
+        uint64_t AcquireStart = pTracer ? MonotonicNanoseconds() : 0;
+        AcquireStatus Status = m_Source.ReleaseAndAcquire(Frame);
+
+        if (Status == AcquireStatus::Pending)
+        {
+            m_Statistics.PendingAcquires++;
+            Count(MetricId::PendingAcquires);
+            m_Pacer.OnEmptyAcquire(m_Source.Now());
+
+            // We must wait for a new buffer. Normally only the producer's event wakes us up; the pacer only sets a
+            // timeout while a buffer it announced is late.
+            if (pTracer)
+            {
+                pTracer->Record(TracePhase::Begin, "acquire", 0, AcquireStart);
+                pTracer->Record(TracePhase::End, "acquire", 0);
+            }
+
+            WaitStatus WaitResult;
+            {
+                TraceSpan Wait(pTracer, "wait", 0);
+                WaitResult = m_Source.WaitForFrame(m_Pacer.WaitTimeout(m_Source.Now()));
+            }
+            if (WaitResult == WaitStatus::NewFrame)
+            {
+                // We have a new buffer, so try the AcquireBuffer again
+                m_Pacer.OnSignalled(m_Source.Now());
+                continue;
+            }
+            else if (WaitResult == WaitStatus::Timeout)
+            {
+                m_Statistics.WaitTimeouts++;
+                Count(MetricId::WaitTimeouts);
+                m_Pacer.OnTimeout(m_Source.Now());
+                continue;
+            }
+            else
+            {
+                // We need to terminate, or the wait was cancelled or something unexpected happened
+                break;
+            }
+        }
+        else if (Status == AcquireStatus::Acquired)
+        {
+            m_Statistics.FramesAcquired++;
+            Count(MetricId::FramesAcquired);
+            m_Pacer.OnAcquired(m_Source.Now());
+            Frame.AcquireTime = MonotonicNanoseconds();
+            if (m_VsyncClock)
+            {
+                Frame.VsyncSequence = m_VsyncClock->SequenceAt(Frame.AcquireTime);
+                Frame.VsyncTime = m_VsyncClock->TickTime(Frame.VsyncSequence);
+            }
+
+            // The frame only gets its id once it exists, so its acquire span is recorded after the fact
+            if (pTracer)
+            {
+                Frame.TraceId = pTracer->NextTraceId();
+                pTracer->Record(TracePhase::Begin, "acquire", Frame.TraceId, AcquireStart);
+                pTracer->Record(TracePhase::End, "acquire", Frame.TraceId, Frame.AcquireTime);
+            }
+
+            // This is the most performance-critical section of code in an IddCx driver. It's important that whatever
+            // is done with the acquired surface be finished as quickly as possible.
+            if (!NeedsPixels())
+            {
+                // Nobody wants this frame's pixels, but whoever wants the next one needs its damage
+                if (HasConsumers())
+                {
+                    m_MissedDamage.Accumulate(Frame);
+                }
+            }
+            else if (m_HandOff)
+            {
+                HandOff(Frame);
+            }
+            else
+            {
+                bool Mapped;
+                {
+                    TraceSpan Map(pTracer, "map", Frame.TraceId);
+                    Mapped = m_Source.MapFrame(Frame);
+                }
+
+                if (Mapped)
+                {
+                    m_MissedDamage.Deliver(Frame);
+                    ProcessFrame(Frame, 0);
+                    m_Source.UnmapFrame(Frame);
+                }
+                else
+                {
+                    m_MissedDamage.Accumulate(Frame);
+                    m_Statistics.MapFailures++;
+                    Count(MetricId::MapFailures);
+                    ReportSkipped(Frame);
+                }
+            }
+
+            TraceSpan Finish(pTracer, "finish", Frame.TraceId);
+            if (!m_Source.FinishedProcessing())
+            {
+                Count(MetricId::SwapChainsAbandoned);
+                break;
+            }
+        }
+        else
+        {
+            // The swap-chain was likely abandoned (e.g. DXGI_ERROR_ACCESS_LOST), so exit the processing loop
+            Count(MetricId::SwapChainsAbandoned);
+            break;
+        }
+    }
+
+    // Let the processing thread finish whatever was already handed off
+    StopProcessingThread();
+    m_HandOff = false;
+
+    Count(MetricId::ActiveSwapChains, -1);
+}
+
+void FramePipeline::ProcessFrame(Frame& Frame, uint64_t HandOffTime)
+{
+    FrameTracer* pTracer = m_Tracer.get();
+    TraceSpan Process(pTracer, "process", Frame.TraceId);
+    if (pTracer && HandOffTime != 0)
+    {
+        pTracer->Record(TracePhase::FlowEnd, "frame", Frame.TraceId);
+    }
+
+    FrameTimeline Timeline = {};
+    Timeline.FrameNumber = Frame.FrameNumber;
+    Timeline.AcquireTime = Frame.AcquireTime;
+    Timeline.HandOffTime = HandOffTime;
+    Timeline.ProcessStartTime = MonotonicNanoseconds();
+    Timeline.pStageEndTimes = m_StageEndTimes.data();
+
+    if (m_DetectionTileSize != 0)
+    {
+        if (Frame.Damage == DamageState::Unknown && Frame.Format == PixelFormat::Bgra8 && Frame.pData)
+        {
+            TraceSpan Detect(pTracer, "detect", Frame.TraceId);
+            if (!m_Detector)
+            {
+                m_Detector.reset(new TileChangeDetector(m_DetectionTileSize));
+            }
+
+            m_Detector->Detect(Frame.pData, Frame.Pitch, Frame.Width, Frame.Height);
+
+            m_DetectedDamage.Reset(DamageState::Partial);
+            for (const Rect& Area : m_Detector->ChangedRects())
+            {
+                m_DetectedDamage.AddDirtyRect(Area);
+            }
+            m_DetectedDamage.Publish(Frame);
+            m_Statistics.FramesDetected++;
+            Count(MetricId::FramesDetected);
+        }
+        else if (m_Detector)
+        {
+            // The detector did not see this frame, so its hashes no longer describe what the sink has
+            m_Detector->Reset();
+        }
+    }
+
+    m_DroppedDamage.Deliver(Frame);
+
+    if (m_MotionSearch)
+    {
+        TraceSpan Motion(pTracer, "motion", Frame.TraceId);
+        SearchMotion(Frame);
+    }
+
+    Timeline.AnalysisEndTime = MonotonicNanoseconds();
+
+    // Stages may map the damage into their output's coordinates, e.g. when they rotate or scale, but the next frame
+    // enters the stages in the source's, so a dropped frame is remembered by the damage it came in with
+    if (!m_Stages.empty())
+    {
+        m_StageInputDamage.Assign(Frame);
+    }
+
+    for (auto& Stage : m_Stages)
+    {
+        bool Passed;
+        {
+            TraceSpan Step(pTracer, Stage->Name(), Frame.TraceId);
+            Passed = Stage->Process(Frame);
+        }
+        m_StageEndTimes[Timeline.StageCount++] = MonotonicNanoseconds();
+
+        if (!Passed)
+        {
+            auto Input = Frame;
+            m_StageInputDamage.Publish(Input);
+            m_DroppedDamage.Accumulate(Input);
+            m_Statistics.FramesDropped++;
+            Count(MetricId::FramesDropped);
+
+            Timeline.FinishTime = m_StageEndTimes[Timeline.StageCount - 1];
+            Timeline.Dropped = true;
+            m_Timings.Record(Timeline);
+            if (pTracer)
+            {
+                pTracer->Record(TracePhase::Instant, "dropped", Frame.TraceId);
+            }
+
+            TraceSpan Report(pTracer, "report", Frame.TraceId);
+            m_Source.ReportFrame(Timeline);
+            return;
+        }
+    }
+
+    if (m_Sink)
+    {
+        TraceSpan Sink(pTracer, "sink", Frame.TraceId);
+        m_Sink->Consume(Frame);
+    }
+    Count(MetricId::FramesDelivered);
+
+    if (m_MotionSearch)
+    {
+        m_Motion.Commit();
+    }
+
+    Timeline.FinishTime = MonotonicNanoseconds();
+    m_Timings.Record(Timeline);
+
+    TraceSpan Report(pTracer, "report", Frame.TraceId);
+    m_Source.ReportFrame(Timeline);
+}
+
+void FramePipeline::ReportSkipped(const Frame& Frame)
+{
+    FrameTimeline Timeline = {};
+    Timeline.FrameNumber = Frame.FrameNumber;
+    Timeline.AcquireTime = Frame.AcquireTime;
+    Timeline.FinishTime = MonotonicNanoseconds();
+    Timeline.Dropped = true;
+
+    m_Timings.Record(Timeline);
+    if (m_Tracer)
+    {
+        m_Tracer->Record(TracePhase::Instant, "skipped", Frame.TraceId);
+    }
+    m_Source.ReportFrame(Timeline);
+}
+
+void FramePipeline::SearchMotion(Frame& Frame)
+{
+    if (Frame.Format != PixelFormat::Bgra8 || !Frame.pData)
+    {
+        // Without its hashes the detector cannot tell what the sink has any more
+        m_Motion.Reset();
+        return;
+    }
+
+    // Partial damage says which pixels differ from the reference, so only those are hashed again
+    const Region* pChanged = nullptr;
+    if (Frame.Damage == DamageState::Partial)
+    {
+        m_MotionChanged.Clear();
+        m_MotionChanged.Union(Frame.pDirtyRects, Frame.DirtyRectCount);
+        for (uint32_t i = 0; i < Frame.MoveRectCount; i++)
+        {
+            m_MotionChanged.Union(Frame.pMoveRects[i].Destination);
+        }
+        pChanged = &m_MotionChanged;
+    }
+
+    bool Search = pChanged && Frame.MoveRectCount == 0 && !m_MotionChanged.Empty() && m_Motion.HasReference();
+
+    m_Motion.Hash(Frame.pData, Frame.Pitch, Frame.Width, Frame.Height, pChanged);
+    if (!Search)
+    {
+        return;
+    }
+
+    m_Motion.Search(m_MotionChanged, FrameDamage::MaxMoveRects, m_Moves);
+    if (m_Moves.empty())
+    {
+        return;
+    }
+
+    m_MotionDamage.Assign(Frame);
+    for (const MoveRect& Move : m_Moves)
+    {
+        m_MotionDamage.AddExactMove(Move);
+    }
+    m_MotionDamage.Normalize(Frame.Width, Frame.Height);
+    m_MotionDamage.Publish(Frame);
+    m_Statistics.FramesScrolled++;
+    Count(MetricId::FramesScrolled);
+}
+
+void FramePipeline::HandOff(Frame& Frame)
+{
+    FrameTracer* pTracer = m_Tracer.get();
+    TraceSpan Copy(pTracer, "hand-off", Frame.TraceId);
+
+    // Never wait for the processing thread here: if it is a full queue behind, skip this frame. Only this thread
+    // pushes, so the queue cannot fill up between this check and the push below.
+    if (m_PendingFrames->Size() >= m_PendingFrames->Capacity())
+    {
+        m_MissedDamage.Accumulate(Frame);
+        m_Statistics.FramesOverrun++;
+        Count(MetricId::FramesOverrun);
+        ReportSkipped(Frame);
+        return;
+    }
+
+    bool Mapped;
+    {
+        TraceSpan Map(pTracer, "map", Frame.TraceId);
+        Mapped = m_Source.MapFrame(Frame);
+    }
+
+    if (!Mapped)
+    {
+        m_MissedDamage.Accumulate(Frame);
+        m_Statistics.MapFailures++;
+        Count(MetricId::MapFailures);
+        ReportSkipped(Frame);
+        return;
+    }
+
+    FrameHandle Handle;
+    Handle.Buffer = m_Pool->Acquire({ Frame.Width, Frame.Height, Frame.Format });
+    if (!Handle.Buffer)
+    {
+        m_Source.UnmapFrame(Frame);
+        m_MissedDamage.Accumulate(Frame);
+        m_Statistics.FramesOverrun++;
+        Count(MetricId::FramesOverrun);
+        ReportSkipped(Frame);
+        return;
+    }
+
+    // Copy into a pooled buffer so the swap-chain buffer can be released immediately
+    uint8_t* pDestination = Handle.Buffer->Data();
+    uint32_t Pitch = Handle.Buffer->Pitch();
+    uint32_t RowBytes = Frame.Width * BytesPerPixel(Frame.Format);
+
+    for (uint32_t Y = 0; Y < Frame.Height; Y++)
+    {
+        memcpy(pDestination + static_cast<size_t>(Y) * Pitch, Frame.pData + static_cast<size_t>(Y) * Frame.Pitch, RowBytes);
+    }
+
+    m_Source.UnmapFrame(Frame);
+
+    // The producer's rectangles go away with its buffer, so the handle keeps its own copy
+    m_MissedDamage.Deliver(Frame);
+    Handle.Damage.Assign(Frame);
+
+    Handle.Contents = Frame;
+    Handle.Contents.Pitch = Pitch;
+    Handle.Contents.pData = pDestination;
+    Handle.Contents.pSurface = nullptr;
+    Handle.Contents.pBuffer = Handle.Buffer.Get();
+    Handle.Damage.Publish(Handle.Contents);
+
+    Handle.HandOffTime = MonotonicNanoseconds();
+    if (pTracer)
+    {
+        pTracer->Record(TracePhase::FlowStart, "frame", Frame.TraceId, Handle.HandOffTime);
+    }
+    Count(MetricId::FramesQueued);
+    m_PendingFrames->TryPush(move(Handle));
+
+    if (m_ProcessingPool)
+    {
+        ScheduleDrain();
+        return;
+    }
+
+    {
+        lock_guard<mutex> Lock(m_WakeLock);
+    }
+    m_Wake.notify_one();
+}
+
+void FramePipeline::ProcessingThread()
+{
+    if (m_Tracer)
+    {
+        m_Tracer->SetThreadName("process");
+    }
+
+    for (;;)
+    {
+        FrameHandle Handle;
+        if (!m_PendingFrames->TryPop(Handle))
+        {
+            unique_lock<mutex> Lock(m_WakeLock);
+            m_Wake.wait(Lock, [this] { return !m_PendingFrames->Empty() || m_Stop.load(); });
+
+            if (m_PendingFrames->Empty())
+            {
+                // Stop was requested and everything handed off so far has been processed
+                return;
+            }
+            continue;
+        }
+
+        // The rectangles moved along with the handle
+        Count(MetricId::FramesQueued, -1);
+        Handle.Damage.Publish(Handle.Contents);
+        ProcessFrame(Handle.Contents, Handle.HandOffTime);
+
+        // Hand the buffer back to the pool unless a stage or the sink kept a reference
+        Handle.Buffer.Reset();
+    }
+}
+
+void FramePipeline::ScheduleDrain()
+{
+    // Pairs with the fence in DrainFrames: either the running drain sees the new frame, or this sees that no drain
+    // is scheduled any more
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!m_DrainScheduled.exchange(true))
+    {
+        m_ProcessingPool->Fork(m_Drains, [this] { DrainFrames(); });
+    }
+}
+
+void FramePipeline::DrainFrames()
+{
+    // Process at most a queue's worth before yielding the thread, so a monitor that never idles cannot starve the
+    // others
+    for (uint32_t i = 0; i < m_QueueDepth; i++)
+    {
+        FrameHandle Handle;
+        if (!m_PendingFrames->TryPop(Handle))
+        {
+            break;
+        }
+
+        Count(MetricId::FramesQueued, -1);
+        Handle.Damage.Publish(Handle.Contents);
+        ProcessFrame(Handle.Contents, Handle.HandOffTime);
+        Handle.Buffer.Reset();
+    }
+
+    m_DrainScheduled.store(false);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!m_PendingFrames->Empty())
+    {
+        ScheduleDrain();
+    }
+}
+
+void FramePipeline::StopProcessingThread()
+{
+    if (m_ProcessingPool)
+    {
+        // Let the drains finish whatever was already handed off
+        m_ProcessingPool->Wait(m_Drains);
+        return;
+    }
+
+    if (!m_ProcessingThread.joinable())
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> Lock(m_WakeLock);
+        m_Stop = true;
+    }
+    m_Wake.notify_one();
+
+    m_ProcessingThread.join();
+}
@@ -0,0 +1,286 @@
+/*++
+
+Module Name:
+
+    frame_pipeline.h
+
+Abstract:
+
+    This module contains the platform-neutral swap-chain processing loop. The driver plugs an IddCx swap-chain into
+    it, while the benchmarks and tools plug in a simulated swap-chain so the hot path can be measured anywhere.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "change_detector.h"
+#include "frame.h"
+#include "frame_buffer_pool.h"
+#include "frame_damage.h"
+#include "frame_pacer.h"
+#include "frame_timings.h"
+#include "frame_trace.h"
+#include "metrics.h"
+#include "motion_detector.h"
+#include "region.h"
+#include "spsc_queue.h"
+#include "vsync_clock.h"
+#include "worker_pool.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        enum class AcquireStatus
+        {
+            Acquired,   // a new frame was acquired
+            Pending,    // no frame is available yet, the caller must wait
+            Failed,     // the swap-chain was abandoned or lost
+        };
+
+        enum class WaitStatus
+        {
+            NewFrame,   // the producer signalled that a new frame is available
+            Timeout,    // the wait timed out
+            Terminate,  // the processing loop was asked to stop
+            Failed,     // the wait was cancelled or something unexpected happened
+        };
+
+        /// <summary>
+        /// Abstract producer of swap-chain buffers. Mirrors the IddCxSwapChain* DDIs used by the processing loop.
+        /// </summary>
+        class ISwapChainSource
+        {
+        public:
+            virtual ~ISwapChainSource() = default;
+
+            // Prepares the swap-chain for acquisition; the loop exits immediately if this fails
+            virtual bool Initialize() = 0;
+
+            // Releases the previously acquired buffer (if any) and tries to acquire the next one
+            virtual AcquireStatus ReleaseAndAcquire(Frame& Frame) = 0;
+
+            // Blocks until a new buffer may be available, the timeout elapses or termination is requested. TimeoutMs
+            // may be FramePacer::WaitForever.
+            virtual WaitStatus WaitForFrame(uint32_t TimeoutMs) = 0;
+
+            // Tells the producer that the pipeline no longer needs the acquired buffer
+            virtual bool FinishedProcessing() = 0;
+
+            // Makes the acquired buffer readable through Frame.pData, e.g. by copying a GPU surface into a staging
+            // surface. Only called when some stage or sink needs the pixels.
+            virtual bool MapFrame(Frame& Frame) { return Frame.pData != nullptr; }
+            virtual void UnmapFrame(Frame& Frame) { (void)Frame; }
+
+            // The clock WaitForFrame and PresentTime run on [ns]; a simulated source may run a virtual one
+            virtual uint64_t Now() { return MonotonicNanoseconds(); }
+
+            // Receives the timeline of every acquired frame once the pipeline is done with it, including frames it
+            // skipped or dropped. Processed frames are reported on the thread that processed them, skipped frames on
+            // the acquire thread, so with asynchronous processing two calls may overlap.
+            virtual void ReportFrame(const FrameTimeline& Timeline) { (void)Timeline; }
+        };
+
+        /// <summary>
+        /// A processing step run on every acquired frame, in the order the stages were added.
+        /// </summary>
+        class IFrameStage
+        {
+        public:
+            virtual ~IFrameStage() = default;
+
+            virtual const char* Name() const = 0;
+
+            // Returning false drops the frame: later stages and the sink do not see it
+            virtual bool Process(Frame& Frame) = 0;
+        };
+
+        /// <summary>
+        /// The final consumer of frames that made it through every stage.
+        /// </summary>
+        class IFrameSink
+        {
+        public:
+            virtual ~IFrameSink() = default;
+
+            virtual void Consume(const Frame& Frame) = 0;
+
+            // Asked on the acquire thread before each frame is mapped. A sink that needs no frames right now, e.g.
+            // one nobody is reading from, is skipped together with the map, and its next frame carries the damage
+            // of those it missed.
+            virtual bool NeedsFrames() const { return true; }
+        };
+
+        /// <summary>
+        /// Counters maintained by the processing loop. FramesDropped, FramesDetected and FramesScrolled belong to
+        /// whichever thread processes frames, everything else to the acquire thread; read them once RunCore has
+        /// returned.
+        /// </summary>
+        struct PipelineStatistics
+        {
+            uint64_t FramesAcquired;
+            uint64_t FramesDropped;     // frames rejected by a stage
+            uint64_t FramesDetected;    // frames whose damage came from the tile-hash detector
+            uint64_t FramesScrolled;    // frames in which the motion search found moves
+            uint64_t FramesOverrun;     // frames skipped because the processing thread's queue was full
+            uint64_t MapFailures;       // frames whose pixels could not be made CPU-visible
+            uint64_t PendingAcquires;   // acquire attempts that returned Pending
+            uint64_t WaitTimeouts;
+        };
+
+        /// <summary>
+        /// Drives an ISwapChainSource through the acquire/process/release loop.
+        /// </summary>
+        class FramePipeline
+        {
+        public:
+            FramePipeline(ISwapChainSource& Source);
+            ~FramePipeline();
+
+            void AddStage(std::shared_ptr<IFrameStage> Stage);
+            void SetSink(std::shared_ptr<IFrameSink> Sink);
+
+            // With QueueDepth > 0 the acquire loop only copies each frame and hands it to a dedicated processing
+            // thread through a lock-free ring of that depth, so slow stages never stall the producer. With 0 (the
+            // default) stages run inline on the acquire thread. Must be called before RunCore.
+            void SetAsyncProcessing(uint32_t QueueDepth);
+
+            // Runs asynchronous processing as tasks on Pool instead of on a dedicated thread, so the frame processors
+            // of many monitors share a few threads. Frames of one pipeline are still processed one at a time and in
+            // order. Only used with SetAsyncProcessing. Must be called before RunCore.
+            void SetProcessingPool(std::shared_ptr<WorkerPool> Pool);
+
+            // Supplies the pool that hand-off copies are taken from. Sharing one pool across pipelines lets buffers
+            // outlive a swap-chain; without one the pipeline creates a private pool.
+            void SetBufferPool(std::shared_ptr<FrameBufferPool> Pool);
+
+            // Frames whose producer reports no damage are run through a tile-hash change detector with tiles of
+            // TileSize pixels (64 by default), which fills in their dirty rectangles. 0 turns detection off and
+            // leaves their damage Unknown. Must be called before RunCore.
+            void SetChangeDetection(uint32_t TileSize);
+
+            // Looks for scrolled or dragged content in the dirty rectangles of every BGRA frame that has no move
+            // rectangles yet, and turns what it finds into moves so the sink only redraws what was uncovered. Off by
+            // default. Must be called before RunCore.
+            void SetMotionSearch(bool Enable);
+
+            // Refresh rate of the committed mode in Hz, as the fraction Numerator / Denominator, which paces the
+            // retries for a buffer the producer announced before it was ready. 60 Hz when not set.
+            void SetRefreshRate(uint64_t Numerator, uint64_t Denominator);
+
+            // Replaces event-driven waiting with a poll every TimeoutMs, as the loop used to do. For comparison only.
+            void SetFixedPolling(uint32_t TimeoutMs);
+
+            // Stamps every acquired frame with the tick of Clock it was acquired in
+            void SetVsyncClock(std::shared_ptr<VsyncClock> Clock);
+
+            // Records a span for every step each frame goes through, tagged with the frame's TraceId, and names the
+            // acquire and processing threads. Must be called before RunCore.
+            void SetTracer(std::shared_ptr<FrameTracer> Tracer);
+
+            // Adds every statistic to Metrics as it happens, so a registry shared by many pipelines sums them up
+            // while they run. Must be called before RunCore.
+            void SetMetrics(std::shared_ptr<MetricsRegistry> Metrics);
+
+            // Runs the processing loop on the calling thread until the source terminates or fails
+            void RunCore();
+
+            const PipelineStatistics& Statistics() const { return m_Statistics; }
+            const PacerStatistics& Pacing() const { return m_Pacer.Statistics(); }
+
+            // Latency of every segment of the frame timeline; may be read while the loop runs
+            const FrameTimings& Timings() const { return m_Timings; }
+
+        private:
+            struct FrameHandle
+            {
+                Frame Contents;
+                FrameBufferRef Buffer;
+                FrameDamage Damage;     // what Contents points at, since the producer's rectangles are released
+                uint64_t HandOffTime;
+            };
+
+            // Whether frames are mapped at all, and whether this one is
+            bool HasConsumers() const { return !m_Stages.empty() || m_Sink; }
+            bool NeedsPixels() const { return !m_Stages.empty() || (m_Sink && m_Sink->NeedsFrames()); }
+
+            void Count(MetricId Id, int64_t Value = 1)
+            {
+                if (m_Metrics)
+                {
+                    m_Metrics->Add(Id, Value);
+                }
+            }
+
+            void ProcessFrame(Frame& Frame, uint64_t HandOffTime);
+            void ReportSkipped(const Frame& Frame);
+            void SearchMotion(Frame& Frame);
+            void HandOff(Frame& Frame);
+            void ProcessingThread();
+            void StopProcessingThread();
+            void ScheduleDrain();
+            void DrainFrames();
+
+            ISwapChainSource& m_Source;
+            std::vector<std::shared_ptr<IFrameStage>> m_Stages;
+            std::shared_ptr<IFrameSink> m_Sink;
+            PipelineStatistics m_Statistics;
+            FramePacer m_Pacer;
+            std::shared_ptr<VsyncClock> m_VsyncClock;
+            std::shared_ptr<FrameTracer> m_Tracer;
+            std::shared_ptr<MetricsRegistry> m_Metrics;
+
+            // Written by whichever thread processes frames; m_StageEndTimes is that thread's scratch timeline
+            FrameTimings m_Timings;
+            std::vector<uint64_t> m_StageEndTimes;
+
+            // Damage of frames the sink never saw, folded into the next frame it does see: m_MissedDamage for frames
+            // skipped by the acquire thread, m_DroppedDamage for frames rejected by a stage. m_StageInputDamage is
+            // the current frame's damage as the first stage got it.
+            FrameDamage m_MissedDamage;
+            FrameDamage m_DroppedDamage;
+            FrameDamage m_StageInputDamage;
+
+            // Fallback change detection on the processing thread
+            uint32_t m_DetectionTileSize;
+            std::unique_ptr<TileChangeDetector> m_Detector;
+            FrameDamage m_DetectedDamage;
+
+            // Motion search on the processing thread. Its reference is always the last frame the sink saw, which is
+            // what the damage of the next frame is relative to.
+            bool m_MotionSearch;
+            MotionDetector m_Motion;
+            Region m_MotionChanged;
+            std::vector<MoveRect> m_Moves;
+            FrameDamage m_MotionDamage;
+
+            // Asynchronous processing: frames travel to the processing thread through m_PendingFrames, each one
+            // holding a reference on its pooled buffer until the processing thread is done with it
+            uint32_t m_QueueDepth;
+            std::shared_ptr<FrameBufferPool> m_Pool;
+            std::unique_ptr<SpscQueue<FrameHandle>> m_PendingFrames;
+            std::thread m_ProcessingThread;
+            std::mutex m_WakeLock;
+            std::condition_variable m_Wake;
+            std::atomic<bool> m_Stop;
+
+            // Asynchronous processing on a shared pool: at most one drain task per pipeline is queued or running
+            bool m_HandOff;
+            std::shared_ptr<WorkerPool> m_ProcessingPool;
+            std::atomic<bool> m_DrainScheduled;
+            TaskGroup m_Drains;
+        };
+    }
+}
@@ -0,0 +1,545 @@
+/*++
+
+Module Name:
+
+    frame_scaler.cpp
+
+Abstract:
+
+    This module contains the filter tables, the scalar reference of the scaling and halving kernels, the per-CPU
+    kernel selection and the scaling pipeline stage.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_scaler.h"
+#include "frame_scaler_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    struct ScaleKernels
+    {
+        VerticalRowKernel Vertical;
+        HorizontalRowKernel Horizontal;
+        HalveRowKernel Halve;
+    };
+
+    void VerticalRange(const uint8_t* const* ppRows, const int32_t* pWeightPairs, uint32_t Pairs, uint16_t* pRow, uint32_t First, uint32_t Last)
+    {
+        for (uint32_t x = First; x < Last; x++)
+        {
+            int32_t Sum = 1 << (ScaleRowShift - 1);
+            for (uint32_t p = 0; p < Pairs; p++)
+            {
+                int32_t Even = static_cast<int16_t>(pWeightPairs[p] & 0xFFFF);
+                int32_t Odd = static_cast<int16_t>(static_cast<uint32_t>(pWeightPairs[p]) >> 16);
+                Sum += Even * ppRows[p * 2][x] + Odd * ppRows[p * 2 + 1][x];
+            }
+            pRow[x] = static_cast<uint16_t>(Sum >> ScaleRowShift);
+        }
+    }
+
+    void HorizontalRange(
+        const uint16_t* pRow,
+        const int32_t* pElementStart,
+        const int32_t* pWeightPairs,
+        uint32_t Pairs,
+        uint32_t Channels,
+        uint8_t* pDestination,
+        uint32_t First,
+        uint32_t Last,
+        uint32_t Elements)
+    {
+        for (uint32_t i = First; i < Last; i++)
+        {
+            const uint16_t* pTaps = pRow + pElementStart[i];
+            int32_t Sum = 1 << (ScaleWeightShift + ScaleRowShift - 1);
+            for (uint32_t p = 0; p < Pairs; p++)
+            {
+                int32_t Weights = pWeightPairs[static_cast<size_t>(p) * Elements + i];
+                int32_t Even = static_cast<int16_t>(Weights & 0xFFFF);
+                int32_t Odd = static_cast<int16_t>(static_cast<uint32_t>(Weights) >> 16);
+                Sum += Even * pTaps[p * 2 * Channels] + Odd * pTaps[(p * 2 + 1) * Channels];
+            }
+            Sum >>= ScaleWeightShift + ScaleRowShift;
+            pDestination[i] = static_cast<uint8_t>(Sum > 255 ? 255 : Sum);
+        }
+    }
+
+    uint32_t VerticalRowScalar(const uint8_t* const* ppRows, const int32_t* pWeightPairs, uint32_t Pairs, uint16_t* pRow, uint32_t Bytes)
+    {
+        VerticalRange(ppRows, pWeightPairs, Pairs, pRow, 0, Bytes);
+        return Bytes;
+    }
+
+    uint32_t HorizontalRowScalar(
+        const uint16_t* pRow,
+        const int32_t* pElementStart,
+        const int32_t* pWeightPairs,
+        uint32_t Pairs,
+        uint32_t Channels,
+        uint8_t* pDestination,
+        uint32_t Elements)
+    {
+        HorizontalRange(pRow, pElementStart, pWeightPairs, Pairs, Channels, pDestination, 0, Elements, Elements);
+        return Elements;
+    }
+
+    uint32_t HalveRowScalar(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDestination, uint32_t Elements, uint32_t Channels)
+    {
+        for (uint32_t i = 0; i < Elements; i++)
+        {
+            uint32_t Left = (i / Channels) * 2 * Channels + i % Channels;
+            uint32_t Right = Left + Channels;
+            pDestination[i] = static_cast<uint8_t>((pRow0[Left] + pRow0[Right] + pRow1[Left] + pRow1[Right] + 2) >> 2);
+        }
+
+        return Elements;
+    }
+
+    ScaleKernels SelectKernels(SimdLevel Level)
+    {
+        switch (ClampSimdLevel(Level))
+        {
+#if IDD_X86
+        case SimdLevel::Avx512:
+        case SimdLevel::Avx2:
+            return { VerticalRowAvx2, HorizontalRowAvx2, HalveRowAvx2 };
+        case SimdLevel::Sse41:
+            return { VerticalRowSse41, HorizontalRowScalar, HalveRowSse41 };
+#endif
+        default:
+            return { VerticalRowScalar, HorizontalRowScalar, HalveRowScalar };
+        }
+    }
+
+    // Quantizes weights that sum to one into ScaleWeightShift fractional bits summing to exactly one; the rounding
+    // error goes to the largest weight
+    void QuantizeWeights(const vector<double>& Weights, int16_t* pFixed)
+    {
+        int32_t Sum = 0;
+        size_t Largest = 0;
+        for (size_t i = 0; i < Weights.size(); i++)
+        {
+            pFixed[i] = static_cast<int16_t>(lround(Weights[i] * (1 << ScaleWeightShift)));
+            Sum += pFixed[i];
+            Largest = Weights[i] > Weights[Largest] ? i : Largest;
+        }
+        pFixed[Largest] = static_cast<int16_t>(pFixed[Largest] + (1 << ScaleWeightShift) - Sum);
+    }
+
+    // Computes the source pixels and weights behind every destination pixel of one axis. Every destination pixel gets
+    // the same number of consecutive taps, the returned count, padded with weights of 0 and moved back from the end
+    // so that they stay inside the source. Weights has Destination times that many entries.
+    uint32_t BuildAxis(uint32_t Source, uint32_t Destination, ScaleFilter Filter, vector<uint32_t>& Start, vector<int16_t>& Weights)
+    {
+        const double Scale = static_cast<double>(Source) / Destination;
+        vector<uint32_t> First(Destination);
+        vector<vector<double>> Footprints(Destination);
+        uint32_t Taps = 1;
+
+        for (uint32_t d = 0; d < Destination; d++)
+        {
+            vector<double>& Footprint = Footprints[d];
+            switch (Filter)
+            {
+            case ScaleFilter::Box:
+            {
+                uint32_t Begin = static_cast<uint32_t>(static_cast<uint64_t>(d) * Source / Destination);
+                uint32_t End = static_cast<uint32_t>(static_cast<uint64_t>(d + 1) * Source / Destination);
+                End = max(End, Begin + 1);
+                First[d] = Begin;
+                Footprint.assign(End - Begin, 1.0 / (End - Begin));
+                break;
+            }
+
+            case ScaleFilter::Bilinear:
+            {
+                double Center = min(max((d + 0.5) * Scale - 0.5, 0.0), static_cast<double>(Source - 1));
+                uint32_t Left = static_cast<uint32_t>(Center);
+                double Fraction = Center - Left;
+                First[d] = Left;
+                Footprint.push_back(1.0 - Fraction);
+                if (Left + 1 < Source && Fraction > 1e-9)
+                {
+                    Footprint.push_back(Fraction);
+                }
+                break;
+            }
+
+            default:
+            {
+                double Low = d * Scale;
+                double High = min((d + 1) * Scale, static_cast<double>(Source));
+                uint32_t Begin = min(static_cast<uint32_t>(Low), Source - 1);
+                uint32_t End = min(static_cast<uint32_t>(ceil(High)), Source);
+                for (uint32_t i = Begin; i < End; i++)
+                {
+                    double Overlap = min(High, i + 1.0) - max(Low, static_cast<double>(i));
+                    if (Overlap > 1e-9)
+                    {
+                        if (Footprint.empty())
+                        {
+                            First[d] = i;
+                        }
+                        Footprint.push_back(Overlap / Scale);
+                    }
+                }
+                if (Footprint.empty())
+                {
+                    First[d] = Begin;
+                    Footprint.push_back(1.0);
+                }
+                break;
+            }
+            }
+
+            Taps = max(Taps, static_cast<uint32_t>(Footprint.size()));
+        }
+
+        Start.resize(Destination);
+        Weights.assign(static_cast<size_t>(Destination) * Taps, 0);
+        for (uint32_t d = 0; d < Destination; d++)
+        {
+            Start[d] = min(First[d], Source - Taps);
+            QuantizeWeights(Footprints[d], &Weights[static_cast<size_t>(d) * Taps + (First[d] - Start[d])]);
+        }
+
+        return Taps;
+    }
+
+    // Maps a range of source pixels to the destination pixels whose footprint may reach it
+    void MapExtent(int32_t Low, int32_t High, uint32_t Source, uint32_t Destination, int32_t& MappedLow, int32_t& MappedHigh)
+    {
+        // Bilinear reaches a source pixel from up to a destination pixel further away when enlarging
+        int64_t Margin = (Destination + Source - 1) / Source + 1;
+        MappedLow = static_cast<int32_t>(static_cast<int64_t>(Low) * Destination / Source - Margin);
+        MappedHigh = static_cast<int32_t>((static_cast<int64_t>(High) * Destination + Source - 1) / Source + Margin);
+    }
+
+    void HalveRow(const ScaleKernels& Kernels, const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDestination, uint32_t Width, uint32_t Channels)
+    {
+        uint32_t Elements = Width / 2 * Channels;
+        uint32_t Done = Kernels.Halve(pRow0, pRow1, pDestination, Elements, Channels);
+        HalveRowScalar(pRow0 + Done * 2, pRow1 + Done * 2, pDestination + Done, Elements - Done, Channels);
+
+        // An odd last column averages with itself
+        if ((Width & 1) != 0)
+        {
+            const uint8_t* pLast0 = pRow0 + (Width - 1) * Channels;
+            const uint8_t* pLast1 = pRow1 + (Width - 1) * Channels;
+            for (uint32_t c = 0; c < Channels; c++)
+            {
+                pDestination[Elements + c] = static_cast<uint8_t>((pLast0[c] * 2 + pLast1[c] * 2 + 2) >> 2);
+            }
+        }
+    }
+
+    // Halves one plane three times, producing each row of a level as soon as the two rows above it exist
+    void PyramidPlane(
+        const ScaleKernels& Kernels,
+        const uint8_t* pSource,
+        uint32_t SourcePitch,
+        uint32_t Width,
+        uint32_t Height,
+        uint32_t Channels,
+        uint8_t* const pLevels[PyramidLevels],
+        const uint32_t Pitches[PyramidLevels])
+    {
+        const uint8_t* pPlanes[PyramidLevels + 1] = { pSource, pLevels[0], pLevels[1], pLevels[2] };
+        uint32_t PlanePitches[PyramidLevels + 1] = { SourcePitch, Pitches[0], Pitches[1], Pitches[2] };
+        uint32_t Widths[PyramidLevels + 1];
+        uint32_t Heights[PyramidLevels + 1];
+        for (uint32_t Level = 0; Level <= PyramidLevels; Level++)
+        {
+            Widths[Level] = PyramidExtent(Width, Level);
+            Heights[Level] = PyramidExtent(Height, Level);
+        }
+
+        auto Halve = [&](uint32_t Level, uint32_t y) {
+            const uint8_t* pAbove = pPlanes[Level - 1];
+            uint32_t Pitch = PlanePitches[Level - 1];
+
+            // An odd last row averages with itself
+            uint32_t Next = min(y * 2 + 1, Heights[Level - 1] - 1);
+            HalveRow(Kernels, pAbove + static_cast<size_t>(y * 2) * Pitch, pAbove + static_cast<size_t>(Next) * Pitch,
+                pLevels[Level - 1] + static_cast<size_t>(y) * Pitches[Level - 1], Widths[Level - 1], Channels);
+        };
+
+        for (uint32_t y1 = 0; y1 < Heights[1]; y1++)
+        {
+            Halve(1, y1);
+            if ((y1 & 1) != 0 || y1 + 1 == Heights[1])
+            {
+                uint32_t y2 = y1 / 2;
+                Halve(2, y2);
+                if ((y2 & 1) != 0 || y2 + 1 == Heights[2])
+                {
+                    Halve(3, y2 / 2);
+                }
+            }
+        }
+    }
+}
+
+const char* Microsoft::IndirectDisp::ScaleFilterName(ScaleFilter Filter)
+{
+    switch (Filter)
+    {
+    case ScaleFilter::Box:
+        return "box";
+    case ScaleFilter::Bilinear:
+        return "bilinear";
+    case ScaleFilter::Area:
+        return "area";
+    default:
+        return "?";
+    }
+}
+
+FrameScaler::FrameScaler(SimdLevel Level)
+    : m_Level(ClampSimdLevel(Level))
+    , m_Planes()
+{
+}
+
+void FrameScaler::Prepare(PlaneScaler& Plane, uint32_t SourceWidth, uint32_t SourceHeight, uint32_t Width, uint32_t Height,
+    uint32_t Channels, ScaleFilter Filter)
+{
+    if (Plane.SourceWidth == SourceWidth && Plane.SourceHeight == SourceHeight && Plane.Width == Width && Plane.Height == Height &&
+        Plane.Channels == Channels && Plane.Filter == Filter && !Plane.Row.empty())
+    {
+        return;
+    }
+
+    Plane.SourceWidth = SourceWidth;
+    Plane.SourceHeight = SourceHeight;
+    Plane.Width = Width;
+    Plane.Height = Height;
+    Plane.Channels = Channels;
+    Plane.Filter = Filter;
+
+    vector<uint32_t> Start;
+    vector<int16_t> Weights;
+
+    // Odd tap counts get a last pair with an odd weight of 0, whose row is clamped into the source
+    uint32_t Taps = BuildAxis(SourceHeight, Height, Filter, Plane.RowStart, Weights);
+    Plane.VerticalPairs = (Taps + 1) / 2;
+    Plane.RowWeightPairs.assign(static_cast<size_t>(Height) * Plane.VerticalPairs, 0);
+    for (uint32_t y = 0; y < Height; y++)
+    {
+        const int16_t* pWeights = &Weights[static_cast<size_t>(y) * Taps];
+        for (uint32_t p = 0; p < Plane.VerticalPairs; p++)
+        {
+            Plane.RowWeightPairs[static_cast<size_t>(y) * Plane.VerticalPairs + p] =
+                ScaleWeightPair(pWeights[p * 2], p * 2 + 1 < Taps ? pWeights[p * 2 + 1] : 0);
+        }
+    }
+
+    Taps = BuildAxis(SourceWidth, Width, Filter, Start, Weights);
+    uint32_t Elements = Width * Channels;
+    Plane.HorizontalPairs = (Taps + 1) / 2;
+    Plane.ElementStart.resize(Elements);
+    Plane.WeightPairs.assign(static_cast<size_t>(Elements) * Plane.HorizontalPairs, 0);
+    for (uint32_t x = 0; x < Width; x++)
+    {
+        const int16_t* pWeights = &Weights[static_cast<size_t>(x) * Taps];
+        for (uint32_t c = 0; c < Channels; c++)
+        {
+            uint32_t i = x * Channels + c;
+            Plane.ElementStart[i] = static_cast<int32_t>(Start[x] * Channels + c);
+            for (uint32_t p = 0; p < Plane.HorizontalPairs; p++)
+            {
+                Plane.WeightPairs[static_cast<size_t>(p) * Elements + i] =
+                    ScaleWeightPair(pWeights[p * 2], p * 2 + 1 < Taps ? pWeights[p * 2 + 1] : 0);
+            }
+        }
+    }
+
+    // Room for the padding tap and the element past it, kept at 0
+    Plane.Row.assign(static_cast<size_t>(SourceWidth) * Channels + Channels * 2 + 2, 0);
+    Plane.Rows.resize(Plane.VerticalPairs * 2);
+}
+
+void FrameScaler::ScalePlane(PlaneScaler& Plane, const uint8_t* pSource, uint32_t SourcePitch, uint8_t* pDestination, uint32_t DestinationPitch)
+{
+    const ScaleKernels Kernels = SelectKernels(m_Level);
+    const uint32_t Bytes = Plane.SourceWidth * Plane.Channels;
+    const uint32_t Elements = Plane.Width * Plane.Channels;
+
+    for (uint32_t y = 0; y < Plane.Height; y++)
+    {
+        for (uint32_t t = 0; t < Plane.Rows.size(); t++)
+        {
+            uint32_t SourceRow = min(Plane.RowStart[y] + t, Plane.SourceHeight - 1);
+            Plane.Rows[t] = pSource + static_cast<size_t>(SourceRow) * SourcePitch;
+        }
+
+        const int32_t* pRowWeights = &Plane.RowWeightPairs[static_cast<size_t>(y) * Plane.VerticalPairs];
+        uint32_t Done = Kernels.Vertical(Plane.Rows.data(), pRowWeights, Plane.VerticalPairs, Plane.Row.data(), Bytes);
+        VerticalRange(Plane.Rows.data(), pRowWeights, Plane.VerticalPairs, Plane.Row.data(), Done, Bytes);
+
+        uint8_t* pRow = pDestination + static_cast<size_t>(y) * DestinationPitch;
+        Done = Kernels.Horizontal(Plane.Row.data(), Plane.ElementStart.data(), Plane.WeightPairs.data(), Plane.HorizontalPairs,
+            Plane.Channels, pRow, Elements);
+        HorizontalRange(Plane.Row.data(), Plane.ElementStart.data(), Plane.WeightPairs.data(), Plane.HorizontalPairs, Plane.Channels,
+            pRow, Done, Elements, Elements);
+    }
+}
+
+bool FrameScaler::Scale(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t SourceWidth,
+    uint32_t SourceHeight,
+    uint8_t* pDestination,
+    uint32_t DestinationPitch,
+    uint32_t DestinationWidth,
+    uint32_t DestinationHeight,
+    PixelFormat Format,
+    ScaleFilter Filter)
+{
+    if ((Format != PixelFormat::Bgra8 && Format != PixelFormat::Nv12) || SourceWidth == 0 || SourceHeight == 0 ||
+        DestinationWidth == 0 || DestinationHeight == 0)
+    {
+        return false;
+    }
+
+    if (Format == PixelFormat::Bgra8)
+    {
+        Prepare(m_Planes[0], SourceWidth, SourceHeight, DestinationWidth, DestinationHeight, 4, Filter);
+        ScalePlane(m_Planes[0], pSource, SourcePitch, pDestination, DestinationPitch);
+        return true;
+    }
+
+    Prepare(m_Planes[0], SourceWidth, SourceHeight, DestinationWidth, DestinationHeight, 1, Filter);
+    ScalePlane(m_Planes[0], pSource, SourcePitch, pDestination, DestinationPitch);
+
+    Prepare(m_Planes[1], (SourceWidth + 1) / 2, (SourceHeight + 1) / 2, (DestinationWidth + 1) / 2, (DestinationHeight + 1) / 2, 2, Filter);
+    ScalePlane(m_Planes[1], pSource + static_cast<size_t>(SourcePitch) * SourceHeight, SourcePitch,
+        pDestination + static_cast<size_t>(DestinationPitch) * DestinationHeight, DestinationPitch);
+    return true;
+}
+
+bool Microsoft::IndirectDisp::ScaleFrame(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t SourceWidth,
+    uint32_t SourceHeight,
+    uint8_t* pDestination,
+    uint32_t DestinationPitch,
+    uint32_t DestinationWidth,
+    uint32_t DestinationHeight,
+    PixelFormat Format,
+    ScaleFilter Filter,
+    SimdLevel Level)
+{
+    FrameScaler Scaler(Level);
+    return Scaler.Scale(pSource, SourcePitch, SourceWidth, SourceHeight, pDestination, DestinationPitch, DestinationWidth,
+        DestinationHeight, Format, Filter);
+}
+
+bool Microsoft::IndirectDisp::ScalePyramid(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t Width,
+    uint32_t Height,
+    PixelFormat Format,
+    uint8_t* const pLevels[PyramidLevels],
+    const uint32_t Pitches[PyramidLevels],
+    SimdLevel Level)
+{
+    if ((Format != PixelFormat::Bgra8 && Format != PixelFormat::Nv12) || Width == 0 || Height == 0)
+    {
+        return false;
+    }
+
+    const ScaleKernels Kernels = SelectKernels(Level);
+    if (Format == PixelFormat::Bgra8)
+    {
+        PyramidPlane(Kernels, pSource, SourcePitch, Width, Height, 4, pLevels, Pitches);
+        return true;
+    }
+
+    PyramidPlane(Kernels, pSource, SourcePitch, Width, Height, 1, pLevels, Pitches);
+
+    // Each level's chroma plane follows its luma plane, and halves the chroma plane of the level above
+    uint8_t* pChroma[PyramidLevels];
+    for (uint32_t i = 0; i < PyramidLevels; i++)
+    {
+        pChroma[i] = pLevels[i] + static_cast<size_t>(Pitches[i]) * PyramidExtent(Height, i + 1);
+    }
+    PyramidPlane(Kernels, pSource + static_cast<size_t>(SourcePitch) * Height, SourcePitch, (Width + 1) / 2, (Height + 1) / 2, 2,
+        pChroma, Pitches);
+    return true;
+}
+
+ScaleStage::ScaleStage(uint32_t Width, uint32_t Height, ScaleFilter Filter)
+    : m_Width(Width)
+    , m_Height(Height)
+    , m_Filter(Filter)
+    , m_Pool(false, 4)
+{
+}
+
+bool ScaleStage::Process(Frame& Frame)
+{
+    if ((Frame.Format != PixelFormat::Bgra8 && Frame.Format != PixelFormat::Nv12) || !Frame.pData)
+    {
+        return true;
+    }
+
+    FrameBufferRef Scaled = m_Pool.Acquire({ m_Width, m_Height, Frame.Format });
+    if (!Scaled)
+    {
+        return false;
+    }
+
+    if (!m_Scaler.Scale(Frame.pData, Frame.Pitch, Frame.Width, Frame.Height, Scaled->Data(), Scaled->Pitch(), m_Width, m_Height,
+        Frame.Format, m_Filter))
+    {
+        return false;
+    }
+
+    // Moves do not survive scaling; what they changed becomes dirty along with the dirty rectangles
+    if (Frame.Damage == DamageState::Partial)
+    {
+        m_Damage.Reset(DamageState::Partial);
+        auto AddScaled = [&](const Rect& Area) {
+            Rect Mapped;
+            MapExtent(Area.Left, Area.Right, Frame.Width, m_Width, Mapped.Left, Mapped.Right);
+            MapExtent(Area.Top, Area.Bottom, Frame.Height, m_Height, Mapped.Top, Mapped.Bottom);
+            m_Damage.AddDirtyRect(Mapped);
+        };
+        for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+        {
+            AddScaled(Frame.pDirtyRects[i]);
+        }
+        for (uint32_t i = 0; i < Frame.MoveRectCount; i++)
+        {
+            AddScaled(Frame.pMoveRects[i].Destination);
+        }
+        m_Damage.Normalize(m_Width, m_Height);
+        m_Damage.Publish(Frame);
+    }
+
+    // Releases the previous frame's output back to the pool
+    m_Scaled = move(Scaled);
+
+    Frame.Width = m_Width;
+    Frame.Height = m_Height;
+    Frame.pData = m_Scaled->Data();
+    Frame.Pitch = m_Scaled->Pitch();
+    Frame.pBuffer = m_Scaled.Get();
+    Frame.pFormats = nullptr;
+    return true;
+}
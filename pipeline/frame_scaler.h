@@ -0,0 +1,174 @@
+/*++
+
+Module Name:
+
+    frame_scaler.h
+
+Abstract:
+
+    This module contains the BGRA and NV12 scalers used for thumbnails and lower-resolution simulcast streams, and a
+    pipeline stage that scales frames in place of the full-resolution copy.
+
+    Scaling is separable and runs one destination row at a time: the source rows under it are filtered vertically
+    into a 16-bit row with 7 fractional bits, which is then filtered horizontally into the destination. Weights carry
+    14 fractional bits and sum to exactly one, and all instruction-set variants share this fixed-point formulation,
+    so every variant is bit-exact with the scalar reference.
+
+    The pyramid produces 1/2, 1/4 and 1/8 of an image in a single pass over the source: every level is the rounded
+    average of 2x2 blocks of the level above, computed as soon as the two rows it needs exist, while they are still
+    in cache.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.h"
+#include "frame.h"
+#include "frame_buffer_pool.h"
+#include "frame_damage.h"
+#include "frame_pipeline.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        enum class ScaleFilter
+        {
+            Box,        // averages the source pixels whose left/top edge falls in the destination pixel; point sampling when enlarging
+            Bilinear,   // interpolates the two source pixels nearest the destination pixel's center
+            Area,       // weighs every source pixel by how much of it the destination pixel covers
+        };
+
+        const char* ScaleFilterName(ScaleFilter Filter);
+
+        /// <summary>
+        /// Scales BGRA and NV12 images by arbitrary ratios. Keeps the filter tables and the row buffer of the last
+        /// sizes it was used with, so scaling a stream of equally sized frames never allocates; not thread-safe.
+        /// </summary>
+        class FrameScaler
+        {
+        public:
+            // Level is clamped to what the CPU supports. Only the vertical pass has an SSE4.1 variant; the
+            // horizontal pass needs the AVX2 gathers.
+            explicit FrameScaler(SimdLevel Level = DetectSimdLevel());
+
+            // Scales a Bgra8 or Nv12 image laid out the way FrameBufferPool sizes it; NV12 scales its luma and its
+            // interleaved chroma plane separately, odd sizes rounding the chroma plane up. Returns false for another
+            // format or an empty size.
+            bool Scale(
+                const uint8_t* pSource,
+                uint32_t SourcePitch,
+                uint32_t SourceWidth,
+                uint32_t SourceHeight,
+                uint8_t* pDestination,
+                uint32_t DestinationPitch,
+                uint32_t DestinationWidth,
+                uint32_t DestinationHeight,
+                PixelFormat Format,
+                ScaleFilter Filter);
+
+        private:
+            /// <summary>
+            /// Filter tables for one plane, and the intermediate row between its two passes.
+            /// </summary>
+            struct PlaneScaler
+            {
+                uint32_t SourceWidth;
+                uint32_t SourceHeight;
+                uint32_t Width;
+                uint32_t Height;
+                uint32_t Channels;
+                ScaleFilter Filter;
+
+                // Vertical, per destination row: the first source row, and the weights of the consecutive rows
+                // from there packed in pairs
+                uint32_t VerticalPairs;
+                std::vector<uint32_t> RowStart;
+                std::vector<int32_t> RowWeightPairs;
+
+                // Horizontal, per destination element (pixel and channel): the element of its first tap, and pairs
+                // of tap weights packed into 32 bits, pair-major so that consecutive elements are adjacent
+                uint32_t HorizontalPairs;
+                std::vector<int32_t> ElementStart;
+                std::vector<int32_t> WeightPairs;
+
+                std::vector<uint16_t> Row;
+                std::vector<const uint8_t*> Rows;
+            };
+
+            static void Prepare(PlaneScaler& Plane, uint32_t SourceWidth, uint32_t SourceHeight, uint32_t Width, uint32_t Height,
+                uint32_t Channels, ScaleFilter Filter);
+            void ScalePlane(PlaneScaler& Plane, const uint8_t* pSource, uint32_t SourcePitch, uint8_t* pDestination, uint32_t DestinationPitch);
+
+            const SimdLevel m_Level;
+            PlaneScaler m_Planes[2];    // BGRA or luma, then NV12 chroma
+        };
+
+        // Scales once without keeping the tables around
+        bool ScaleFrame(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t SourceWidth,
+            uint32_t SourceHeight,
+            uint8_t* pDestination,
+            uint32_t DestinationPitch,
+            uint32_t DestinationWidth,
+            uint32_t DestinationHeight,
+            PixelFormat Format,
+            ScaleFilter Filter,
+            SimdLevel Level = DetectSimdLevel());
+
+        // Levels of the pyramid: 1/2, 1/4 and 1/8
+        const uint32_t PyramidLevels = 3;
+
+        // Width or height of pyramid level Level (1 to PyramidLevels) of an Extent-pixel image: halved and rounded up
+        // Level times, the last column and row of an odd extent averaging with themselves
+        inline uint32_t PyramidExtent(uint32_t Extent, uint32_t Level)
+        {
+            return (Extent + (1u << Level) - 1) >> Level;
+        }
+
+        // Writes the three pyramid levels of a Bgra8 or Nv12 image into pLevels[0..2], each laid out the way
+        // FrameBufferPool sizes it, with the pitch in Pitches. Returns false for another format or an empty size.
+        bool ScalePyramid(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t Width,
+            uint32_t Height,
+            PixelFormat Format,
+            uint8_t* const pLevels[PyramidLevels],
+            const uint32_t Pitches[PyramidLevels],
+            SimdLevel Level = DetectSimdLevel());
+
+        /// <summary>
+        /// Scales each BGRA or NV12 frame to a fixed size in a pooled buffer and hands that on instead, with its
+        /// damage mapped to the new size. Like ColorConvertStage, it keeps its output until the next frame. Put it
+        /// ahead of a FormatCacheStage: a cache attached earlier holds the full-size frame and is detached.
+        /// </summary>
+        class ScaleStage : public IFrameStage
+        {
+        public:
+            ScaleStage(uint32_t Width, uint32_t Height, ScaleFilter Filter);
+
+            const char* Name() const override { return "Scale"; }
+            bool Process(Frame& Frame) override;
+
+        private:
+            const uint32_t m_Width;
+            const uint32_t m_Height;
+            const ScaleFilter m_Filter;
+
+            FrameScaler m_Scaler;
+            FrameBufferPool m_Pool;
+            FrameBufferRef m_Scaled;
+            FrameDamage m_Damage;
+        };
+    }
+}
@@ -0,0 +1,78 @@
+/*++
+
+Module Name:
+
+    frame_scaler_kernels.h
+
+Abstract:
+
+    This module contains the row kernels behind the scalers. It is private to frame_scaler*.cpp.
+
+    Weights come in pairs packed into 32 bits, the way pmaddwd pairs them with two 16-bit samples. A vertical kernel
+    filters two source rows per weight pair, byte by byte, into one 16-bit row with 7 fractional bits; a horizontal
+    kernel filters that row into destination bytes, every element through its own first tap and weight pairs; a
+    halving kernel averages 2x2 blocks of two rows of Channels-byte pixels into one row of the next pyramid level.
+    Vector kernels only handle whole blocks of their width and return how many elements they produced; the scalar
+    kernel finishes the row from there.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "cpu_features.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const int32_t ScaleWeightShift = 14;
+        const int32_t ScaleRowShift = 7;    // fractional bits of the intermediate row, which madd still sees as non-negative
+
+        // Packs the weights of an even and an odd tap
+        inline int32_t ScaleWeightPair(int16_t Even, int16_t Odd)
+        {
+            return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(Even)) |
+                (static_cast<uint32_t>(static_cast<uint16_t>(Odd)) << 16));
+        }
+
+        // ppRows holds two rows per pair
+        typedef uint32_t (*VerticalRowKernel)(const uint8_t* const* ppRows, const int32_t* pWeightPairs, uint32_t Pairs, uint16_t* pRow, uint32_t Bytes);
+
+        // The weights of element i of pair p are at pWeightPairs[p * Elements + i]. Reads up to Channels - 1 elements past
+        // the odd tap of every pair; the row is padded for them and for the odd tap of weight 0 past an odd tap count.
+        typedef uint32_t (*HorizontalRowKernel)(
+            const uint16_t* pRow,
+            const int32_t* pElementStart,
+            const int32_t* pWeightPairs,
+            uint32_t Pairs,
+            uint32_t Channels,
+            uint8_t* pDestination,
+            uint32_t Elements);
+
+        // Produces Elements output bytes from 2 * Elements bytes of each row
+        typedef uint32_t (*HalveRowKernel)(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDestination, uint32_t Elements, uint32_t Channels);
+
+#if IDD_X86
+        uint32_t VerticalRowSse41(const uint8_t* const* ppRows, const int32_t* pWeightPairs, uint32_t Pairs, uint16_t* pRow, uint32_t Bytes);
+        uint32_t VerticalRowAvx2(const uint8_t* const* ppRows, const int32_t* pWeightPairs, uint32_t Pairs, uint16_t* pRow, uint32_t Bytes);
+
+        uint32_t HorizontalRowAvx2(
+            const uint16_t* pRow,
+            const int32_t* pElementStart,
+            const int32_t* pWeightPairs,
+            uint32_t Pairs,
+            uint32_t Channels,
+            uint8_t* pDestination,
+            uint32_t Elements);
+
+        uint32_t HalveRowSse41(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDestination, uint32_t Elements, uint32_t Channels);
+        uint32_t HalveRowAvx2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDestination, uint32_t Elements, uint32_t Channels);
+#endif
+    }
+}
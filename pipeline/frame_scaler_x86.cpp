@@ -0,0 +1,243 @@
+/*++
+
+Module Name:
+
+    frame_scaler_x86.cpp
+
+Abstract:
+
+    This module contains the SSE4.1 and AVX2 kernels of the scalers.
+
+    The vertical kernels widen two source rows to 16 bits and interleave them, so one pmaddwd applies a weight pair
+    to a pair of samples. The horizontal kernel gathers the even and the odd tap of eight destination elements at a
+    time, each element from its own position, and combines them the same way; for BGRA, where the two taps of a
+    pixel are adjacent, a plain load and a shuffle replace the gathers. The halving kernels bring the two
+    pixels of each block next to each other with a byte shuffle, so pmaddubsw adds them while widening.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_scaler_kernels.h"
+
+#if IDD_X86
+
+#include <cstring>
+#include <immintrin.h>
+
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    void Store32(uint8_t* pDestination, int32_t Value)
+    {
+        memcpy(pDestination, &Value, sizeof(Value));
+    }
+
+    // Byte order that puts the samples of each 2x2 block's two pixels side by side, per 128-bit lane
+    IDD_TARGET_SSE41 inline __m128i BlockOrder(uint32_t Channels)
+    {
+        switch (Channels)
+        {
+        case 4:
+            return _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+        case 2:
+            return _mm_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+        default:
+            return _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        }
+    }
+}
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::VerticalRowSse41(
+    const uint8_t* const* ppRows,
+    const int32_t* pWeightPairs,
+    uint32_t Pairs,
+    uint16_t* pRow,
+    uint32_t Bytes)
+{
+    const __m128i Zero = _mm_setzero_si128();
+    const __m128i Rounding = _mm_set1_epi32(1 << (ScaleRowShift - 1));
+
+    uint32_t x = 0;
+    for (; x + 16 <= Bytes; x += 16)
+    {
+        __m128i Sum0 = Rounding, Sum1 = Rounding, Sum2 = Rounding, Sum3 = Rounding;
+        for (uint32_t p = 0; p < Pairs; p++)
+        {
+            const __m128i Weights = _mm_set1_epi32(pWeightPairs[p]);
+            __m128i Even = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[p * 2] + x));
+            __m128i Odd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[p * 2 + 1] + x));
+
+            __m128i EvenLow = _mm_unpacklo_epi8(Even, Zero), EvenHigh = _mm_unpackhi_epi8(Even, Zero);
+            __m128i OddLow = _mm_unpacklo_epi8(Odd, Zero), OddHigh = _mm_unpackhi_epi8(Odd, Zero);
+            Sum0 = _mm_add_epi32(Sum0, _mm_madd_epi16(_mm_unpacklo_epi16(EvenLow, OddLow), Weights));
+            Sum1 = _mm_add_epi32(Sum1, _mm_madd_epi16(_mm_unpackhi_epi16(EvenLow, OddLow), Weights));
+            Sum2 = _mm_add_epi32(Sum2, _mm_madd_epi16(_mm_unpacklo_epi16(EvenHigh, OddHigh), Weights));
+            Sum3 = _mm_add_epi32(Sum3, _mm_madd_epi16(_mm_unpackhi_epi16(EvenHigh, OddHigh), Weights));
+        }
+
+        __m128i Low = _mm_packus_epi32(_mm_srai_epi32(Sum0, ScaleRowShift), _mm_srai_epi32(Sum1, ScaleRowShift));
+        __m128i High = _mm_packus_epi32(_mm_srai_epi32(Sum2, ScaleRowShift), _mm_srai_epi32(Sum3, ScaleRowShift));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + x), Low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + x + 8), High);
+    }
+
+    return x;
+}
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::HalveRowSse41(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDestination, uint32_t Elements, uint32_t Channels)
+{
+    const __m128i Order = BlockOrder(Channels);
+    const __m128i Ones = _mm_set1_epi8(1);
+    const __m128i Two = _mm_set1_epi16(2);
+
+    uint32_t i = 0;
+    for (; i + 8 <= Elements; i += 8)
+    {
+        __m128i Top = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + i * 2)), Order);
+        __m128i Bottom = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + i * 2)), Order);
+        __m128i Sum = _mm_add_epi16(_mm_maddubs_epi16(Top, Ones), _mm_maddubs_epi16(Bottom, Ones));
+        __m128i Average = _mm_srli_epi16(_mm_add_epi16(Sum, Two), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pDestination + i), _mm_packus_epi16(Average, Average));
+    }
+
+    return i;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::VerticalRowAvx2(
+    const uint8_t* const* ppRows,
+    const int32_t* pWeightPairs,
+    uint32_t Pairs,
+    uint16_t* pRow,
+    uint32_t Bytes)
+{
+    const __m256i Zero = _mm256_setzero_si256();
+    const __m256i Rounding = _mm256_set1_epi32(1 << (ScaleRowShift - 1));
+
+    uint32_t x = 0;
+    for (; x + 32 <= Bytes; x += 32)
+    {
+        __m256i Sum0 = Rounding, Sum1 = Rounding, Sum2 = Rounding, Sum3 = Rounding;
+        for (uint32_t p = 0; p < Pairs; p++)
+        {
+            const __m256i Weights = _mm256_set1_epi32(pWeightPairs[p]);
+            __m256i Even = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ppRows[p * 2] + x));
+            __m256i Odd = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ppRows[p * 2 + 1] + x));
+
+            // Per lane: bytes 0..7 and 8..15 widened, then paired with the same byte of the odd row
+            __m256i EvenLow = _mm256_unpacklo_epi8(Even, Zero), EvenHigh = _mm256_unpackhi_epi8(Even, Zero);
+            __m256i OddLow = _mm256_unpacklo_epi8(Odd, Zero), OddHigh = _mm256_unpackhi_epi8(Odd, Zero);
+            Sum0 = _mm256_add_epi32(Sum0, _mm256_madd_epi16(_mm256_unpacklo_epi16(EvenLow, OddLow), Weights));
+            Sum1 = _mm256_add_epi32(Sum1, _mm256_madd_epi16(_mm256_unpackhi_epi16(EvenLow, OddLow), Weights));
+            Sum2 = _mm256_add_epi32(Sum2, _mm256_madd_epi16(_mm256_unpacklo_epi16(EvenHigh, OddHigh), Weights));
+            Sum3 = _mm256_add_epi32(Sum3, _mm256_madd_epi16(_mm256_unpackhi_epi16(EvenHigh, OddHigh), Weights));
+        }
+
+        // The packs undo the unpacks per lane: Low holds bytes 0..7 and 16..23, High bytes 8..15 and 24..31
+        __m256i Low = _mm256_packus_epi32(_mm256_srai_epi32(Sum0, ScaleRowShift), _mm256_srai_epi32(Sum1, ScaleRowShift));
+        __m256i High = _mm256_packus_epi32(_mm256_srai_epi32(Sum2, ScaleRowShift), _mm256_srai_epi32(Sum3, ScaleRowShift));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pRow + x), _mm256_permute2x128_si256(Low, High, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pRow + x + 16), _mm256_permute2x128_si256(Low, High, 0x31));
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::HorizontalRowAvx2(
+    const uint16_t* pRow,
+    const int32_t* pElementStart,
+    const int32_t* pWeightPairs,
+    uint32_t Pairs,
+    uint32_t Channels,
+    uint8_t* pDestination,
+    uint32_t Elements)
+{
+    const __m256i Rounding = _mm256_set1_epi32(1 << (ScaleWeightShift + ScaleRowShift - 1));
+
+    uint32_t i = 0;
+    if (Channels == 4)
+    {
+        // A pixel's two taps are adjacent, so one load brings both for all channels; pair them up per channel
+        const __m256i Interleave = _mm256_setr_epi8(
+            0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+            0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+
+        for (; i + 8 <= Elements; i += 8)
+        {
+            const uint16_t* pLow = pRow + pElementStart[i];
+            const uint16_t* pHigh = pRow + pElementStart[i + 4];
+            __m256i Sum = Rounding;
+            for (uint32_t p = 0; p < Pairs; p++)
+            {
+                __m256i Taps = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pLow + p * 8))),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(pHigh + p * 8)), 1);
+                __m256i Weights = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pWeightPairs + static_cast<size_t>(p) * Elements + i));
+                Sum = _mm256_add_epi32(Sum, _mm256_madd_epi16(_mm256_shuffle_epi8(Taps, Interleave), Weights));
+            }
+
+            Sum = _mm256_srai_epi32(Sum, ScaleWeightShift + ScaleRowShift);
+            __m256i Words = _mm256_packus_epi32(Sum, Sum);
+            __m256i Bytes = _mm256_packus_epi16(Words, Words);
+            Store32(pDestination + i, _mm_cvtsi128_si32(_mm256_castsi256_si128(Bytes)));
+            Store32(pDestination + i + 4, _mm_cvtsi128_si32(_mm256_extracti128_si256(Bytes, 1)));
+        }
+
+        return i;
+    }
+
+    for (; i + 8 <= Elements; i += 8)
+    {
+        const __m256i Start = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pElementStart + i));
+        __m256i Sum = Rounding;
+        for (uint32_t p = 0; p < Pairs; p++)
+        {
+            // Each 32-bit gather brings the wanted sample in its low half
+            const int* pEven = reinterpret_cast<const int*>(pRow + p * 2 * Channels);
+            const int* pOdd = reinterpret_cast<const int*>(pRow + (p * 2 + 1) * Channels);
+            __m256i Even = _mm256_i32gather_epi32(pEven, Start, 2);
+            __m256i Odd = _mm256_i32gather_epi32(pOdd, Start, 2);
+            __m256i Samples = _mm256_blend_epi16(Even, _mm256_slli_epi32(Odd, 16), 0xAA);
+
+            __m256i Weights = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pWeightPairs + static_cast<size_t>(p) * Elements + i));
+            Sum = _mm256_add_epi32(Sum, _mm256_madd_epi16(Samples, Weights));
+        }
+
+        // Per lane: four elements, saturated to bytes
+        Sum = _mm256_srai_epi32(Sum, ScaleWeightShift + ScaleRowShift);
+        __m256i Words = _mm256_packus_epi32(Sum, Sum);
+        __m256i Bytes = _mm256_packus_epi16(Words, Words);
+        Store32(pDestination + i, _mm_cvtsi128_si32(_mm256_castsi256_si128(Bytes)));
+        Store32(pDestination + i + 4, _mm_cvtsi128_si32(_mm256_extracti128_si256(Bytes, 1)));
+    }
+
+    return i;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::HalveRowAvx2(const uint8_t* pRow0, const uint8_t* pRow1, uint8_t* pDestination, uint32_t Elements, uint32_t Channels)
+{
+    const __m128i LaneOrder = BlockOrder(Channels);
+    const __m256i Order = _mm256_inserti128_si256(_mm256_castsi128_si256(LaneOrder), LaneOrder, 1);
+    const __m256i Ones = _mm256_set1_epi8(1);
+    const __m256i Two = _mm256_set1_epi16(2);
+
+    uint32_t i = 0;
+    for (; i + 16 <= Elements; i += 16)
+    {
+        __m256i Top = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow0 + i * 2)), Order);
+        __m256i Bottom = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow1 + i * 2)), Order);
+        __m256i Sum = _mm256_add_epi16(_mm256_maddubs_epi16(Top, Ones), _mm256_maddubs_epi16(Bottom, Ones));
+        __m256i Average = _mm256_srli_epi16(_mm256_add_epi16(Sum, Two), 2);
+
+        // Per lane: eight averages, doubled; gather the first copies of both lanes
+        __m256i Bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(Average, Average), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + i), _mm256_castsi256_si128(Bytes));
+    }
+
+    return i;
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*++
+
+Module Name:
+
+    frame_timings.cpp
+
+Abstract:
+
+    This module contains the per-pipeline latency histograms.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_timings.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    uint64_t Elapsed(uint64_t From, uint64_t To)
+    {
+        return To > From ? To - From : 0;
+    }
+}
+
+FrameTimings::FrameTimings()
+    : m_StageCount(0), m_Dropped(0)
+{
+    const char* Names[] = { "copy", "queue", "analysis", "sink", "total" };
+    for (const char* Name : Names)
+    {
+        m_Segments.push_back({ Name, unique_ptr<LatencyHistogram>(new LatencyHistogram) });
+    }
+}
+
+void FrameTimings::AddStage(const char* Name)
+{
+    m_Segments.insert(m_Segments.begin() + FirstStage + m_StageCount, { Name, unique_ptr<LatencyHistogram>(new LatencyHistogram) });
+    m_StageCount++;
+}
+
+void FrameTimings::Record(const FrameTimeline& Timeline)
+{
+    if (Timeline.Dropped)
+    {
+        m_Dropped.fetch_add(1, memory_order_relaxed);
+    }
+
+    if (Timeline.ProcessStartTime == 0)
+    {
+        return;
+    }
+
+    if (Timeline.HandOffTime != 0)
+    {
+        At(Copy).Record(Elapsed(Timeline.AcquireTime, Timeline.HandOffTime));
+        At(Queue).Record(Elapsed(Timeline.HandOffTime, Timeline.ProcessStartTime));
+    }
+
+    At(Analysis).Record(Elapsed(Timeline.ProcessStartTime, Timeline.AnalysisEndTime));
+
+    uint64_t Previous = Timeline.AnalysisEndTime;
+    for (uint32_t i = 0; i < Timeline.StageCount && i < m_StageCount; i++)
+    {
+        At(FirstStage + i).Record(Elapsed(Previous, Timeline.pStageEndTimes[i]));
+        Previous = Timeline.pStageEndTimes[i];
+    }
+
+    if (!Timeline.Dropped)
+    {
+        At(FirstStage + m_StageCount).Record(Elapsed(Previous, Timeline.FinishTime));
+    }
+
+    At(FirstStage + m_StageCount + 1).Record(Elapsed(Timeline.AcquireTime, Timeline.FinishTime));
+}
+
+void FrameTimings::Reset()
+{
+    for (NamedHistogram& Segment : m_Segments)
+    {
+        Segment.pHistogram->Reset();
+    }
+    m_Dropped.store(0, memory_order_relaxed);
+}
@@ -0,0 +1,87 @@
+/*++
+
+Module Name:
+
+    frame_timings.h
+
+Abstract:
+
+    This module contains the per-frame timeline the pipeline stamps as a frame moves from acquisition through the
+    hand-off, the analysis, every stage and the sink, and the per-pipeline latency histograms the timelines feed.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "latency_histogram.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Monotonic timestamps [ns] of one frame on its way through the pipeline.
+        /// </summary>
+        struct FrameTimeline
+        {
+            uint64_t FrameNumber;
+            uint64_t AcquireTime;
+            uint64_t HandOffTime;       // queued for the processing thread, 0 when processed on the acquire thread
+            uint64_t ProcessStartTime;  // 0 when the frame was skipped before processing
+            uint64_t AnalysisEndTime;   // change detection and motion search done
+            uint32_t StageCount;        // stages that ran; when Dropped, the last of them rejected the frame
+            const uint64_t* pStageEndTimes;
+            uint64_t FinishTime;        // the sink returned, or the frame was dropped
+            bool Dropped;
+        };
+
+        /// <summary>
+        /// Latency histograms of one pipeline, one per segment of the timeline.
+        /// </summary>
+        class FrameTimings
+        {
+        public:
+            FrameTimings();
+
+            // Adds the histogram of the next stage, in pipeline order
+            void AddStage(const char* Name);
+
+            void Record(const FrameTimeline& Timeline);
+
+            // Segments are copy (acquire to hand-off), queue (hand-off to processing), analysis, one per stage,
+            // sink, and total (acquire to finish)
+            uint32_t SegmentCount() const { return static_cast<uint32_t>(m_Segments.size()); }
+            const char* SegmentName(uint32_t Index) const { return m_Segments[Index].Name; }
+            const LatencyHistogram& Segment(uint32_t Index) const { return *m_Segments[Index].pHistogram; }
+
+            // Frames skipped before processing or rejected by a stage
+            uint64_t FramesDropped() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+            void Reset();
+
+        private:
+            struct NamedHistogram
+            {
+                const char* Name;
+                std::unique_ptr<LatencyHistogram> pHistogram;
+            };
+
+            enum : uint32_t { Copy, Queue, Analysis, FirstStage };
+
+            LatencyHistogram& At(uint32_t Index) { return *m_Segments[Index].pHistogram; }
+
+            std::vector<NamedHistogram> m_Segments;     // the fixed ones, the stages, then sink and total
+            uint32_t m_StageCount;
+            std::atomic<uint64_t> m_Dropped;
+        };
+    }
+}
@@ -0,0 +1,274 @@
+/*++
+
+Module Name:
+
+    frame_trace.cpp
+
+Abstract:
+
+    This module contains the frame tracer and its Chrome trace export.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_trace.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    atomic<uint32_t> s_NextThread(1);
+    thread_local uint32_t t_Thread = 0;
+
+    uint32_t CurrentThread()
+    {
+        if (t_Thread == 0)
+        {
+            t_Thread = s_NextThread.fetch_add(1, memory_order_relaxed);
+        }
+        return t_Thread;
+    }
+
+    void AppendString(string& Json, const char* pText)
+    {
+        Json += '"';
+        for (const char* p = pText; *p; p++)
+        {
+            if (*p == '"' || *p == '\\')
+            {
+                Json += '\\';
+                Json += *p;
+            }
+            else if (static_cast<unsigned char>(*p) < 0x20)
+            {
+                char Escape[8];
+                snprintf(Escape, sizeof(Escape), "\\u%04x", static_cast<unsigned>(*p));
+                Json += Escape;
+            }
+            else
+            {
+                Json += *p;
+            }
+        }
+        Json += '"';
+    }
+}
+
+FrameTracer::FrameTracer(uint32_t Capacity)
+    : m_Next(0), m_NextTraceId(1), m_Dropped(0)
+{
+    uint64_t Size = 1;
+    while (Size < Capacity)
+    {
+        Size <<= 1;
+    }
+
+    m_pSlots.reset(new Slot[Size]);
+    m_Mask = Size - 1;
+    for (uint64_t i = 0; i < Size; i++)
+    {
+        m_pSlots[i].Sequence.store(0, memory_order_relaxed);
+    }
+}
+
+void FrameTracer::Record(TracePhase Phase, const char* pName, uint64_t TraceId, uint64_t Timestamp)
+{
+    uint64_t Index = m_Next.fetch_add(1, memory_order_relaxed);
+    Slot& Event = m_pSlots[Index & m_Mask];
+
+    // Claimed only from an older event that is complete. A writer a whole ring behind finds a newer event, or one
+    // still being written, and drops its own rather than overwrite it.
+    uint64_t Sequence = Event.Sequence.load(memory_order_relaxed);
+    do
+    {
+        if ((Sequence & 1) != 0 || Sequence >= 2 * Index + 2)
+        {
+            m_Dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+    } while (!Event.Sequence.compare_exchange_weak(Sequence, 2 * Index + 1, memory_order_relaxed));
+    atomic_thread_fence(memory_order_release);
+
+    Event.Timestamp.store(Timestamp, memory_order_relaxed);
+    Event.pName.store(pName, memory_order_relaxed);
+    Event.TraceId.store(TraceId, memory_order_relaxed);
+    Event.ThreadAndPhase.store(static_cast<uint64_t>(CurrentThread()) << 8 | static_cast<uint8_t>(Phase), memory_order_relaxed);
+
+    Event.Sequence.store(2 * Index + 2, memory_order_release);
+}
+
+void FrameTracer::SetThreadName(const char* pName)
+{
+    uint32_t Thread = CurrentThread();
+
+    lock_guard<mutex> Lock(m_NamesLock);
+    for (auto& Name : m_ThreadNames)
+    {
+        if (Name.first == Thread)
+        {
+            Name.second = pName;
+            return;
+        }
+    }
+    m_ThreadNames.emplace_back(Thread, pName);
+}
+
+uint64_t FrameTracer::Overwritten() const
+{
+    uint64_t Next = m_Next.load(memory_order_relaxed);
+    return Next > m_Mask + 1 ? Next - (m_Mask + 1) : 0;
+}
+
+void FrameTracer::Snapshot(vector<TraceEvent>& Events) const
+{
+    Events.clear();
+
+    uint64_t Next = m_Next.load(memory_order_acquire);
+    uint64_t First = Next > m_Mask + 1 ? Next - (m_Mask + 1) : 0;
+    Events.reserve(static_cast<size_t>(Next - First));
+
+    for (uint64_t Index = First; Index < Next; Index++)
+    {
+        const Slot& Event = m_pSlots[Index & m_Mask];
+
+        uint64_t Sequence = Event.Sequence.load(memory_order_acquire);
+        if (Sequence != 2 * Index + 2)
+        {
+            continue;
+        }
+
+        TraceEvent Copy;
+        Copy.Timestamp = Event.Timestamp.load(memory_order_relaxed);
+        Copy.pName = Event.pName.load(memory_order_relaxed);
+        Copy.TraceId = Event.TraceId.load(memory_order_relaxed);
+        uint64_t ThreadAndPhase = Event.ThreadAndPhase.load(memory_order_relaxed);
+        Copy.Thread = static_cast<uint32_t>(ThreadAndPhase >> 8);
+        Copy.Phase = static_cast<TracePhase>(ThreadAndPhase & 0xFF);
+
+        // Overwritten while it was copied
+        atomic_thread_fence(memory_order_acquire);
+        if (Event.Sequence.load(memory_order_relaxed) != Sequence)
+        {
+            continue;
+        }
+
+        Events.push_back(Copy);
+    }
+}
+
+void FrameTracer::ExportChromeTrace(string& Json) const
+{
+    vector<TraceEvent> Events;
+    Snapshot(Events);
+
+    // A span that begins just before an acquire is recorded after it, with the time the call started
+    stable_sort(Events.begin(), Events.end(), [](const TraceEvent& Left, const TraceEvent& Right) { return Left.Timestamp < Right.Timestamp; });
+
+    uint64_t Origin = Events.empty() ? 0 : Events.front().Timestamp;
+
+    Json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool First = true;
+    char Text[160];
+
+    vector<uint32_t> Threads;
+    for (const TraceEvent& Event : Events)
+    {
+        if (find(Threads.begin(), Threads.end(), Event.Thread) == Threads.end())
+        {
+            Threads.push_back(Event.Thread);
+        }
+    }
+
+    {
+        lock_guard<mutex> Lock(m_NamesLock);
+        for (uint32_t Thread : Threads)
+        {
+            string Name = "thread " + to_string(Thread);
+            for (const auto& Named : m_ThreadNames)
+            {
+                if (Named.first == Thread)
+                {
+                    Name = Named.second;
+                }
+            }
+
+            snprintf(Text, sizeof(Text), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", First ? "" : ",", Thread);
+            Json += Text;
+            AppendString(Json, Name.c_str());
+            Json += "}}";
+            First = false;
+        }
+    }
+
+    // The ring may have lost the beginning of a span whose end it still holds; Chrome would close the wrong one
+    vector<uint32_t> Depth(s_NextThread.load(memory_order_relaxed) + 1, 0);
+
+    for (const TraceEvent& Event : Events)
+    {
+        uint32_t& ThreadDepth = Depth[Event.Thread < Depth.size() ? Event.Thread : 0];
+        if (Event.Phase == TracePhase::Begin)
+        {
+            ThreadDepth++;
+        }
+        else if (Event.Phase == TracePhase::End)
+        {
+            if (ThreadDepth == 0)
+            {
+                continue;
+            }
+            ThreadDepth--;
+        }
+
+        Json += First ? "{\"name\":" : ",{\"name\":";
+        First = false;
+
+        bool Flow = Event.Phase == TracePhase::FlowStart || Event.Phase == TracePhase::FlowEnd;
+        AppendString(Json, Flow ? "frame" : Event.pName);
+
+        uint64_t Time = Event.Timestamp - Origin;
+        snprintf(Text, sizeof(Text), ",\"cat\":\"frame\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%u",
+            static_cast<char>(Event.Phase), static_cast<unsigned long long>(Time / 1000), static_cast<unsigned>(Time % 1000), Event.Thread);
+        Json += Text;
+
+        if (Flow)
+        {
+            snprintf(Text, sizeof(Text), ",\"id\":%llu%s", static_cast<unsigned long long>(Event.TraceId), Event.Phase == TracePhase::FlowEnd ? ",\"bp\":\"e\"" : "");
+            Json += Text;
+        }
+        else if (Event.Phase == TracePhase::Instant)
+        {
+            Json += ",\"s\":\"t\"";
+        }
+
+        if (Event.TraceId != 0)
+        {
+            snprintf(Text, sizeof(Text), ",\"args\":{\"frame\":%llu}", static_cast<unsigned long long>(Event.TraceId));
+            Json += Text;
+        }
+        Json += '}';
+    }
+
+    Json += "]}\n";
+}
+
+bool FrameTracer::SaveChromeTrace(const char* Path) const
+{
+    string Json;
+    ExportChromeTrace(Json);
+
+    FILE* pFile = fopen(Path, "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    bool Written = fwrite(Json.data(), 1, Json.size(), pFile) == Json.size();
+    return fclose(pFile) == 0 && Written;
+}
@@ -0,0 +1,156 @@
+/*++
+
+Module Name:
+
+    frame_trace.h
+
+Abstract:
+
+    This module contains the frame tracer: a flight recorder of begin/end spans, tagged with the id of the frame
+    they worked on, that the pipeline emits from acquisition through every stage to the sink. Events go to a fixed
+    ring that overwrites its oldest events, so tracing can stay on; the ring is dumped as Chrome trace JSON, which
+    chrome://tracing and Perfetto open, with flow arrows from the acquire thread to the thread that processed each
+    frame.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Kinds of trace events, named after their Chrome trace phases.
+        /// </summary>
+        enum class TracePhase : uint8_t
+        {
+            Begin = 'B',
+            End = 'E',
+            Instant = 'i',
+            FlowStart = 's',    // the frame leaves this thread...
+            FlowEnd = 'f',      // ...and arrives here, inside the span that begins at the same time
+        };
+
+        /// <summary>
+        /// One event read back from the ring.
+        /// </summary>
+        struct TraceEvent
+        {
+            uint64_t Timestamp;     // MonotonicNanoseconds
+            const char* pName;
+            uint64_t TraceId;       // the frame the event belongs to, 0 for none
+            uint32_t Thread;        // small number given to each thread the first time it records
+            TracePhase Phase;
+        };
+
+        /// <summary>
+        /// A ring of trace events shared by any number of threads. Recording is lock-free and never waits; the
+        /// ring keeps the last Capacity events, less any dropped by writers that fell a whole ring behind.
+        /// </summary>
+        class FrameTracer
+        {
+        public:
+            static const uint32_t DefaultCapacity = 1 << 16;
+
+            // Capacity is rounded up to a power of two
+            explicit FrameTracer(uint32_t Capacity = DefaultCapacity);
+
+            FrameTracer(const FrameTracer&) = delete;
+            FrameTracer& operator=(const FrameTracer&) = delete;
+
+            // A new frame id, never 0
+            uint64_t NextTraceId() { return m_NextTraceId.fetch_add(1, std::memory_order_relaxed); }
+
+            // Names are not copied: they must outlive the tracer, which string literals do
+            void Record(TracePhase Phase, const char* pName, uint64_t TraceId, uint64_t Timestamp);
+            void Record(TracePhase Phase, const char* pName, uint64_t TraceId) { Record(Phase, pName, TraceId, MonotonicNanoseconds()); }
+
+            // Names the calling thread in exported traces; unnamed threads show up as "thread N"
+            void SetThreadName(const char* pName);
+
+            // The events still in the ring, oldest first. Events being written, or overwritten while they were
+            // read, are left out.
+            void Snapshot(std::vector<TraceEvent>& Events) const;
+
+            // The ring as a Chrome trace JSON document
+            void ExportChromeTrace(std::string& Json) const;
+            bool SaveChromeTrace(const char* Path) const;
+
+            uint64_t Recorded() const { return m_Next.load(std::memory_order_relaxed); }
+            uint64_t Overwritten() const;
+
+            // Events never written: their slot was in use, or already held a newer event, by the time the writer got
+            // to it, which takes a writer descheduled for a whole ring
+            uint64_t Dropped() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+        private:
+            // Every field is written and read with relaxed atomics; Sequence makes a seqlock of them
+            struct Slot
+            {
+                std::atomic<uint64_t> Sequence;     // 2 * index + 1 while written, 2 * index + 2 once written; only
+                                                    // ever grows
+                std::atomic<uint64_t> Timestamp;
+                std::atomic<const char*> pName;
+                std::atomic<uint64_t> TraceId;
+                std::atomic<uint64_t> ThreadAndPhase;
+            };
+
+            std::unique_ptr<Slot[]> m_pSlots;
+            uint64_t m_Mask;
+            std::atomic<uint64_t> m_Next;
+            std::atomic<uint64_t> m_NextTraceId;
+            std::atomic<uint64_t> m_Dropped;
+
+            mutable std::mutex m_NamesLock;
+            std::vector<std::pair<uint32_t, std::string>> m_ThreadNames;
+        };
+
+        /// <summary>
+        /// Records a begin event now and the matching end event when it goes out of scope. Does nothing without a
+        /// tracer.
+        /// </summary>
+        class TraceSpan
+        {
+        public:
+            TraceSpan(FrameTracer* pTracer, const char* pName, uint64_t TraceId)
+                : m_pTracer(pTracer), m_pName(pName), m_TraceId(TraceId)
+            {
+                if (m_pTracer)
+                {
+                    m_pTracer->Record(TracePhase::Begin, m_pName, m_TraceId);
+                }
+            }
+
+            ~TraceSpan()
+            {
+                if (m_pTracer)
+                {
+                    m_pTracer->Record(TracePhase::End, m_pName, m_TraceId);
+                }
+            }
+
+            TraceSpan(const TraceSpan&) = delete;
+            TraceSpan& operator=(const TraceSpan&) = delete;
+
+        private:
+            FrameTracer* m_pTracer;
+            const char* m_pName;
+            uint64_t m_TraceId;
+        };
+    }
+}
@@ -0,0 +1,442 @@
+/*++
+
+Module Name:
+
+    frame_transform.cpp
+
+Abstract:
+
+    This module contains the scalar reference of the transform kernels, the per-CPU kernel selection, the tiled
+    transpose and the transform pipeline stage.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_transform.h"
+#include "frame_transform_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "color_convert.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // Tiles of the transpose: 64 source rows of two cache lines each. Narrow tiles keep few destination rows, and
+    // so few pages, in flight; at 4K, wider ones run about half again as long. Both are multiples of every block.
+    const uint32_t TransformTileRows = 64;
+    const uint32_t TransformTileBytes = 128;
+
+    // Side of the blocks of the scalar reference
+    const uint32_t ScalarBlock = 8;
+
+    struct BlockKernel
+    {
+        TransposeBlockKernel Transpose;
+        uint32_t Rows;
+        uint32_t Columns;
+    };
+
+    // Indexed by the log2 of the element size
+    struct TransformKernels
+    {
+        BlockKernel Blocks[3];
+        ReverseRowKernel Reverse[3];
+    };
+
+    template <uint32_t Bytes>
+    void TransposeRegion(
+        const uint8_t* pSource,
+        ptrdiff_t SourcePitch,
+        uint8_t* pDestination,
+        ptrdiff_t DestinationPitch,
+        uint32_t Columns,
+        uint32_t Rows)
+    {
+        for (uint32_t y = 0; y < Rows; y++)
+        {
+            const uint8_t* pRow = pSource + SourcePitch * y;
+            for (uint32_t x = 0; x < Columns; x++)
+            {
+                memcpy(pDestination + DestinationPitch * x + y * Bytes, pRow + x * Bytes, Bytes);
+            }
+        }
+    }
+
+    void TransposeRegion(
+        uint32_t Bytes,
+        const uint8_t* pSource,
+        ptrdiff_t SourcePitch,
+        uint8_t* pDestination,
+        ptrdiff_t DestinationPitch,
+        uint32_t Columns,
+        uint32_t Rows)
+    {
+        switch (Bytes)
+        {
+        case 1:
+            TransposeRegion<1>(pSource, SourcePitch, pDestination, DestinationPitch, Columns, Rows);
+            break;
+        case 2:
+            TransposeRegion<2>(pSource, SourcePitch, pDestination, DestinationPitch, Columns, Rows);
+            break;
+        default:
+            TransposeRegion<4>(pSource, SourcePitch, pDestination, DestinationPitch, Columns, Rows);
+            break;
+        }
+    }
+
+    template <uint32_t Bytes>
+    void TransposeBlockScalar(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch)
+    {
+        TransposeRegion<Bytes>(pSource, SourcePitch, pDestination, DestinationPitch, ScalarBlock, ScalarBlock);
+    }
+
+    template <uint32_t Bytes>
+    void ReverseRange(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements, uint32_t First)
+    {
+        for (uint32_t i = First; i < Elements; i++)
+        {
+            memcpy(pDestination + i * Bytes, pSource + (Elements - 1 - i) * Bytes, Bytes);
+        }
+    }
+
+    void ReverseRange(uint32_t Bytes, const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements, uint32_t First)
+    {
+        switch (Bytes)
+        {
+        case 1:
+            ReverseRange<1>(pSource, pDestination, Elements, First);
+            break;
+        case 2:
+            ReverseRange<2>(pSource, pDestination, Elements, First);
+            break;
+        default:
+            ReverseRange<4>(pSource, pDestination, Elements, First);
+            break;
+        }
+    }
+
+    template <uint32_t Bytes>
+    uint32_t ReverseRowScalar(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+    {
+        ReverseRange<Bytes>(pSource, pDestination, Elements, 0);
+        return Elements;
+    }
+
+    TransformKernels SelectKernels(SimdLevel Level)
+    {
+        switch (ClampSimdLevel(Level))
+        {
+#if IDD_X86
+        case SimdLevel::Avx512:
+        case SimdLevel::Avx2:
+            return {
+                { { TransposeBlock8Avx2, 32, 16 }, { TransposeBlock16Avx2, 16, 8 }, { TransposeBlock32Avx2, 8, 4 } },
+                { ReverseRow8Avx2, ReverseRow16Avx2, ReverseRow32Avx2 } };
+        case SimdLevel::Sse41:
+            return {
+                { { TransposeBlock8Sse41, 16, 16 }, { TransposeBlock16Sse41, 8, 8 }, { TransposeBlock32Sse41, 4, 4 } },
+                { ReverseRow8Sse41, ReverseRow16Sse41, ReverseRow32Sse41 } };
+#endif
+        default:
+            return {
+                { { TransposeBlockScalar<1>, ScalarBlock, ScalarBlock }, { TransposeBlockScalar<2>, ScalarBlock, ScalarBlock },
+                    { TransposeBlockScalar<4>, ScalarBlock, ScalarBlock } },
+                { ReverseRowScalar<1>, ReverseRowScalar<2>, ReverseRowScalar<4> } };
+        }
+    }
+
+    // Writes the transpose of a Width x Height source into Width destination rows, tile by tile; the blocks that do
+    // not fit at the right and bottom edges of the image are transposed element by element
+    void TransposeTiles(
+        const BlockKernel& Block,
+        uint32_t Bytes,
+        const uint8_t* pSource,
+        ptrdiff_t SourcePitch,
+        uint8_t* pDestination,
+        ptrdiff_t DestinationPitch,
+        uint32_t Width,
+        uint32_t Height)
+    {
+        const uint32_t TileColumns = TransformTileBytes / Bytes;
+        for (uint32_t TileY = 0; TileY < Height; TileY += TransformTileRows)
+        {
+            uint32_t Rows = min(TransformTileRows, Height - TileY);
+            uint32_t BlockRows = Rows - Rows % Block.Rows;
+
+            for (uint32_t TileX = 0; TileX < Width; TileX += TileColumns)
+            {
+                uint32_t Columns = min(TileColumns, Width - TileX);
+                uint32_t BlockColumns = Columns - Columns % Block.Columns;
+
+                const uint8_t* pTile = pSource + SourcePitch * TileY + static_cast<size_t>(TileX) * Bytes;
+                uint8_t* pTransposed = pDestination + DestinationPitch * TileX + static_cast<size_t>(TileY) * Bytes;
+
+                for (uint32_t y = 0; y < BlockRows; y += Block.Rows)
+                {
+                    for (uint32_t x = 0; x < BlockColumns; x += Block.Columns)
+                    {
+                        Block.Transpose(pTile + SourcePitch * y + x * Bytes, SourcePitch, pTransposed + DestinationPitch * x + y * Bytes,
+                            DestinationPitch);
+                    }
+                }
+
+                TransposeRegion(Bytes, pTile + BlockColumns * Bytes, SourcePitch, pTransposed + DestinationPitch * BlockColumns,
+                    DestinationPitch, Columns - BlockColumns, BlockRows);
+                TransposeRegion(Bytes, pTile + SourcePitch * BlockRows, SourcePitch, pTransposed + BlockRows * Bytes, DestinationPitch,
+                    Columns, Rows - BlockRows);
+            }
+        }
+    }
+}
+
+const char* Microsoft::IndirectDisp::FrameOrientationName(FrameOrientation Orientation)
+{
+    switch (Orientation)
+    {
+    case FrameOrientation::Identity:
+        return "identity";
+    case FrameOrientation::Rotate90:
+        return "rotate 90";
+    case FrameOrientation::Rotate180:
+        return "rotate 180";
+    case FrameOrientation::Rotate270:
+        return "rotate 270";
+    case FrameOrientation::FlipHorizontal:
+        return "flip horizontal";
+    case FrameOrientation::FlipVertical:
+        return "flip vertical";
+    case FrameOrientation::Transpose:
+        return "transpose";
+    case FrameOrientation::Transverse:
+        return "transverse";
+    default:
+        return "unknown";
+    }
+}
+
+Rect Microsoft::IndirectDisp::TransformRect(const Rect& Area, uint32_t Width, uint32_t Height, FrameOrientation Orientation)
+{
+    const int32_t W = static_cast<int32_t>(Width);
+    const int32_t H = static_cast<int32_t>(Height);
+
+    switch (Orientation)
+    {
+    case FrameOrientation::Rotate90:
+        return { H - Area.Bottom, Area.Left, H - Area.Top, Area.Right };
+    case FrameOrientation::Rotate180:
+        return { W - Area.Right, H - Area.Bottom, W - Area.Left, H - Area.Top };
+    case FrameOrientation::Rotate270:
+        return { Area.Top, W - Area.Right, Area.Bottom, W - Area.Left };
+    case FrameOrientation::FlipHorizontal:
+        return { W - Area.Right, Area.Top, W - Area.Left, Area.Bottom };
+    case FrameOrientation::FlipVertical:
+        return { Area.Left, H - Area.Bottom, Area.Right, H - Area.Top };
+    case FrameOrientation::Transpose:
+        return { Area.Top, Area.Left, Area.Bottom, Area.Right };
+    case FrameOrientation::Transverse:
+        return { H - Area.Bottom, W - Area.Right, H - Area.Top, W - Area.Left };
+    default:
+        return Area;
+    }
+}
+
+bool Microsoft::IndirectDisp::TransformPlane(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t Width,
+    uint32_t Height,
+    uint32_t BytesPerElement,
+    uint8_t* pDestination,
+    uint32_t DestinationPitch,
+    FrameOrientation Orientation,
+    SimdLevel Level)
+{
+    uint32_t Index;
+    switch (BytesPerElement)
+    {
+    case 1:
+        Index = 0;
+        break;
+    case 2:
+        Index = 1;
+        break;
+    case 4:
+        Index = 2;
+        break;
+    default:
+        return false;
+    }
+
+    if (Width == 0 || Height == 0)
+    {
+        return true;
+    }
+
+    const TransformKernels Kernels = SelectKernels(Level);
+
+    // Walking the source bottom-up mirrors it top to bottom; so does walking the destination bottom-up
+    bool MirrorSource = false;
+    bool MirrorDestination = false;
+    switch (Orientation)
+    {
+    case FrameOrientation::Rotate90:
+    case FrameOrientation::Rotate180:
+    case FrameOrientation::FlipVertical:
+        MirrorSource = true;
+        break;
+    case FrameOrientation::Rotate270:
+        MirrorDestination = true;
+        break;
+    case FrameOrientation::Transverse:
+        MirrorSource = true;
+        MirrorDestination = true;
+        break;
+    default:
+        break;
+    }
+
+    ptrdiff_t SourceStep = MirrorSource ? -static_cast<ptrdiff_t>(SourcePitch) : static_cast<ptrdiff_t>(SourcePitch);
+    const uint8_t* pFirst = MirrorSource ? pSource + static_cast<size_t>(SourcePitch) * (Height - 1) : pSource;
+
+    if (SwapsAxes(Orientation))
+    {
+        ptrdiff_t DestinationStep = MirrorDestination ? -static_cast<ptrdiff_t>(DestinationPitch) : static_cast<ptrdiff_t>(DestinationPitch);
+        uint8_t* pTransposed = MirrorDestination ? pDestination + static_cast<size_t>(DestinationPitch) * (Width - 1) : pDestination;
+        TransposeTiles(Kernels.Blocks[Index], BytesPerElement, pFirst, SourceStep, pTransposed, DestinationStep, Width, Height);
+    }
+    else if (Orientation == FrameOrientation::FlipHorizontal || Orientation == FrameOrientation::Rotate180)
+    {
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            const uint8_t* pRow = pFirst + SourceStep * y;
+            uint8_t* pReversed = pDestination + static_cast<size_t>(DestinationPitch) * y;
+            uint32_t Done = Kernels.Reverse[Index](pRow, pReversed, Width);
+            ReverseRange(BytesPerElement, pRow, pReversed, Width, Done);
+        }
+    }
+    else
+    {
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            memcpy(pDestination + static_cast<size_t>(DestinationPitch) * y, pFirst + SourceStep * y, static_cast<size_t>(Width) * BytesPerElement);
+        }
+    }
+
+    return true;
+}
+
+bool Microsoft::IndirectDisp::TransformFrame(
+    const uint8_t* pSource,
+    uint32_t SourcePitch,
+    uint32_t Width,
+    uint32_t Height,
+    uint8_t* pDestination,
+    uint32_t DestinationPitch,
+    PixelFormat Format,
+    FrameOrientation Orientation,
+    SimdLevel Level)
+{
+    if (Width == 0 || Height == 0)
+    {
+        return false;
+    }
+
+    if (Format == PixelFormat::Bgra8)
+    {
+        return TransformPlane(pSource, SourcePitch, Width, Height, 4, pDestination, DestinationPitch, Orientation, Level);
+    }
+
+    if (Format != PixelFormat::Nv12 && Format != PixelFormat::I420 && Format != PixelFormat::I444)
+    {
+        return false;
+    }
+
+    // The planes are only read, whatever MakeYuvPlanes hands back
+    const YuvPlanes Source = MakeYuvPlanes(const_cast<uint8_t*>(pSource), SourcePitch, Height, Format);
+    const YuvPlanes Destination = MakeYuvPlanes(pDestination, DestinationPitch, SwapsAxes(Orientation) ? Width : Height, Format);
+
+    TransformPlane(Source.pY, Source.YPitch, Width, Height, 1, Destination.pY, Destination.YPitch, Orientation, Level);
+
+    if (Format == PixelFormat::Nv12)
+    {
+        return TransformPlane(Source.pU, Source.UPitch, (Width + 1) / 2, (Height + 1) / 2, 2, Destination.pU, Destination.UPitch,
+            Orientation, Level);
+    }
+
+    uint32_t ChromaWidth = (Format == PixelFormat::I444) ? Width : (Width + 1) / 2;
+    uint32_t ChromaHeight = (Format == PixelFormat::I444) ? Height : (Height + 1) / 2;
+    TransformPlane(Source.pU, Source.UPitch, ChromaWidth, ChromaHeight, 1, Destination.pU, Destination.UPitch, Orientation, Level);
+    return TransformPlane(Source.pV, Source.VPitch, ChromaWidth, ChromaHeight, 1, Destination.pV, Destination.VPitch, Orientation, Level);
+}
+
+TransformStage::TransformStage(FrameOrientation Orientation, SimdLevel Level)
+    : m_Orientation(Orientation)
+    , m_Level(Level)
+    , m_Pool(false, 4)
+{
+}
+
+bool TransformStage::Process(Frame& Frame)
+{
+    if (m_Orientation == FrameOrientation::Identity || !Frame.pData ||
+        (Frame.Format != PixelFormat::Bgra8 && Frame.Format != PixelFormat::Nv12 && Frame.Format != PixelFormat::I420 &&
+            Frame.Format != PixelFormat::I444))
+    {
+        return true;
+    }
+
+    const bool Swap = SwapsAxes(m_Orientation);
+    const uint32_t Width = Swap ? Frame.Height : Frame.Width;
+    const uint32_t Height = Swap ? Frame.Width : Frame.Height;
+
+    FrameBufferRef Transformed = m_Pool.Acquire({ Width, Height, Frame.Format });
+    if (!Transformed)
+    {
+        return false;
+    }
+
+    if (!TransformFrame(Frame.pData, Frame.Pitch, Frame.Width, Frame.Height, Transformed->Data(), Transformed->Pitch(), Frame.Format,
+        m_Orientation, m_Level))
+    {
+        return false;
+    }
+
+    // Every orientation maps rectangles onto rectangles one to one, so moves stay moves
+    if (Frame.Damage == DamageState::Partial)
+    {
+        m_Damage.Reset(DamageState::Partial);
+        for (uint32_t i = 0; i < Frame.MoveRectCount; i++)
+        {
+            const MoveRect& Move = Frame.pMoveRects[i];
+            const Rect Source = { Move.SourceX, Move.SourceY, Move.SourceX + (Move.Destination.Right - Move.Destination.Left),
+                Move.SourceY + (Move.Destination.Bottom - Move.Destination.Top) };
+            const Rect MovedSource = TransformRect(Source, Frame.Width, Frame.Height, m_Orientation);
+            m_Damage.AddMoveRect({ MovedSource.Left, MovedSource.Top, TransformRect(Move.Destination, Frame.Width, Frame.Height, m_Orientation) });
+        }
+        for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+        {
+            m_Damage.AddDirtyRect(TransformRect(Frame.pDirtyRects[i], Frame.Width, Frame.Height, m_Orientation));
+        }
+        m_Damage.Normalize(Width, Height);
+        m_Damage.Publish(Frame);
+    }
+
+    // Releases the previous frame's output back to the pool
+    m_Transformed = move(Transformed);
+
+    Frame.Width = Width;
+    Frame.Height = Height;
+    Frame.pData = m_Transformed->Data();
+    Frame.Pitch = m_Transformed->Pitch();
+    Frame.pBuffer = m_Transformed.Get();
+    Frame.pFormats = nullptr;
+    return true;
+}
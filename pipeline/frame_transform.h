@@ -0,0 +1,112 @@
+/*++
+
+Module Name:
+
+    frame_transform.h
+
+Abstract:
+
+    This module contains the rotations and flips of BGRA and planar YUV frames used for portrait and mirrored
+    virtual monitors, and a pipeline stage that orients frames right after they are acquired.
+
+    The orientations that swap the axes (the quarter turns, the transpose and the transverse) are all a transpose
+    once the source, the destination or both are walked bottom-up with a negative pitch. The transpose runs in tiles
+    small enough that the source rows and destination rows they touch stay in cache, and within a tile in blocks
+    transposed in registers by a cascade of unpacks. The other orientations copy or reverse whole rows.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "cpu_features.h"
+#include "frame.h"
+#include "frame_buffer_pool.h"
+#include "frame_damage.h"
+#include "frame_pipeline.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// How a frame is turned or mirrored, as seen by whoever looks at the result. Rotations are clockwise.
+        /// </summary>
+        enum class FrameOrientation : uint32_t
+        {
+            Identity = 0,
+            Rotate90,
+            Rotate180,
+            Rotate270,
+            FlipHorizontal, // mirrors left and right
+            FlipVertical,   // mirrors top and bottom
+            Transpose,      // mirrors across the diagonal from the top-left corner
+            Transverse,     // mirrors across the diagonal from the top-right corner
+        };
+
+        const char* FrameOrientationName(FrameOrientation Orientation);
+
+        // Whether the oriented frame is Height pixels wide and Width pixels high
+        inline bool SwapsAxes(FrameOrientation Orientation)
+        {
+            return Orientation == FrameOrientation::Rotate90 || Orientation == FrameOrientation::Rotate270 ||
+                Orientation == FrameOrientation::Transpose || Orientation == FrameOrientation::Transverse;
+        }
+
+        // Where a rectangle of a Width x Height frame ends up in the oriented frame
+        Rect TransformRect(const Rect& Area, uint32_t Width, uint32_t Height, FrameOrientation Orientation);
+
+        // Orients one plane of Width x Height elements of BytesPerElement (1, 2 or 4) bytes. The destination must not
+        // overlap the source. Level is clamped to what the CPU supports. Returns false for another element size.
+        bool TransformPlane(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t Width,
+            uint32_t Height,
+            uint32_t BytesPerElement,
+            uint8_t* pDestination,
+            uint32_t DestinationPitch,
+            FrameOrientation Orientation,
+            SimdLevel Level = DetectSimdLevel());
+
+        // Orients a Bgra8, Nv12, I420 or I444 image laid out the way FrameBufferPool sizes it, into one laid out the
+        // same way for the oriented size. Returns false for another format or an empty size.
+        bool TransformFrame(
+            const uint8_t* pSource,
+            uint32_t SourcePitch,
+            uint32_t Width,
+            uint32_t Height,
+            uint8_t* pDestination,
+            uint32_t DestinationPitch,
+            PixelFormat Format,
+            FrameOrientation Orientation,
+            SimdLevel Level = DetectSimdLevel());
+
+        /// <summary>
+        /// Orients each frame into a pooled buffer and hands that on instead, with its dirty and move rectangles
+        /// oriented along with it. Like ScaleStage, it keeps its output until the next frame; add it first, so every
+        /// later stage sees the frame the way the monitor is meant to be looked at.
+        /// </summary>
+        class TransformStage : public IFrameStage
+        {
+        public:
+            TransformStage(FrameOrientation Orientation, SimdLevel Level = DetectSimdLevel());
+
+            const char* Name() const override { return "Transform"; }
+            bool Process(Frame& Frame) override;
+
+        private:
+            const FrameOrientation m_Orientation;
+            const SimdLevel m_Level;
+
+            FrameBufferPool m_Pool;
+            FrameBufferRef m_Transformed;
+            FrameDamage m_Damage;
+        };
+    }
+}
@@ -0,0 +1,58 @@
+/*++
+
+Module Name:
+
+    frame_transform_kernels.h
+
+Abstract:
+
+    This module contains the block and row kernels behind the frame transforms. It is private to
+    frame_transform*.cpp.
+
+    A block kernel transposes a block of its size: Rows source rows of Columns elements become Columns destination
+    rows of Rows elements. Either pitch may be negative, which is how the same kernels rotate and mirror. A reverse
+    kernel writes the elements of a row in reverse order; vector kernels only handle whole vectors and return how
+    many elements they produced, and the scalar kernel finishes the row from there.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu_features.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        typedef void (*TransposeBlockKernel)(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch);
+
+        typedef uint32_t (*ReverseRowKernel)(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements);
+
+#if IDD_X86
+        // 16 x 16, 8 x 8 and 4 x 4 blocks of 1, 2 and 4-byte elements: one 128-bit register per row
+        void TransposeBlock8Sse41(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch);
+        void TransposeBlock16Sse41(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch);
+        void TransposeBlock32Sse41(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch);
+
+        // 32 x 16, 16 x 8 and 8 x 4 blocks: two rows per 256-bit register, transposed lane by lane into 32-byte rows
+        void TransposeBlock8Avx2(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch);
+        void TransposeBlock16Avx2(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch);
+        void TransposeBlock32Avx2(const uint8_t* pSource, ptrdiff_t SourcePitch, uint8_t* pDestination, ptrdiff_t DestinationPitch);
+
+        uint32_t ReverseRow8Sse41(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements);
+        uint32_t ReverseRow16Sse41(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements);
+        uint32_t ReverseRow32Sse41(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements);
+
+        uint32_t ReverseRow8Avx2(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements);
+        uint32_t ReverseRow16Avx2(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements);
+        uint32_t ReverseRow32Avx2(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements);
+#endif
+    }
+}
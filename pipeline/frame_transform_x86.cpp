@@ -0,0 +1,332 @@
+/*++
+
+Module Name:
+
+    frame_transform_x86.cpp
+
+Abstract:
+
+    This module contains the SSE4.1 and AVX2 kernels of the frame transforms.
+
+    A block is transposed with one register per source row: interleaving neighbouring registers element by element,
+    then in pairs of elements and so on up to 8 bytes, leaves every register holding one column, in bit-reversed
+    order. The AVX2 kernels load a second block's rows into the upper lanes, and since the unpacks work lane by lane,
+    each register ends up holding a column of both, which is a 32-byte destination row. The reverse kernels load a
+    vector from the end of the row and put it back to front with a byte shuffle.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "frame_transform_kernels.h"
+
+#if IDD_X86
+
+#include <immintrin.h>
+#include <utility>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // The cascade leaves column Index of a Count-row block in register BitReverse(Index, Count)
+    constexpr size_t BitReverse(size_t Index, size_t Count)
+    {
+        size_t Reversed = 0;
+        for (size_t Bit = 1; Bit < Count; Bit <<= 1)
+        {
+            Reversed = (Reversed << 1) | ((Index & Bit) ? 1 : 0);
+        }
+
+        return Reversed;
+    }
+
+    template <uint32_t Bytes>
+    IDD_TARGET_SSE41 inline __m128i UnpackLo(__m128i A, __m128i B)
+    {
+        switch (Bytes)
+        {
+        case 1:
+            return _mm_unpacklo_epi8(A, B);
+        case 2:
+            return _mm_unpacklo_epi16(A, B);
+        case 4:
+            return _mm_unpacklo_epi32(A, B);
+        default:
+            return _mm_unpacklo_epi64(A, B);
+        }
+    }
+
+    template <uint32_t Bytes>
+    IDD_TARGET_SSE41 inline __m128i UnpackHi(__m128i A, __m128i B)
+    {
+        switch (Bytes)
+        {
+        case 1:
+            return _mm_unpackhi_epi8(A, B);
+        case 2:
+            return _mm_unpackhi_epi16(A, B);
+        case 4:
+            return _mm_unpackhi_epi32(A, B);
+        default:
+            return _mm_unpackhi_epi64(A, B);
+        }
+    }
+
+    template <uint32_t Bytes>
+    IDD_TARGET_AVX2 inline __m256i UnpackLo(__m256i A, __m256i B)
+    {
+        switch (Bytes)
+        {
+        case 1:
+            return _mm256_unpacklo_epi8(A, B);
+        case 2:
+            return _mm256_unpacklo_epi16(A, B);
+        case 4:
+            return _mm256_unpacklo_epi32(A, B);
+        default:
+            return _mm256_unpacklo_epi64(A, B);
+        }
+    }
+
+    template <uint32_t Bytes>
+    IDD_TARGET_AVX2 inline __m256i UnpackHi(__m256i A, __m256i B)
+    {
+        switch (Bytes)
+        {
+        case 1:
+            return _mm256_unpackhi_epi8(A, B);
+        case 2:
+            return _mm256_unpackhi_epi16(A, B);
+        case 4:
+            return _mm256_unpackhi_epi32(A, B);
+        default:
+            return _mm256_unpackhi_epi64(A, B);
+        }
+    }
+
+    // One step of the cascade: the low halves of every pair of neighbouring registers interleaved, then the high
+    // halves. The steps, loads and stores are expanded over index packs rather than looped over, so that every
+    // register index is a constant and the block never leaves the registers.
+    template <uint32_t Bytes, size_t Count, size_t... Pair>
+    IDD_TARGET_SSE41 inline void Interleave(__m128i (&Rows)[Count], index_sequence<Pair...>)
+    {
+        const __m128i Low[] = { UnpackLo<Bytes>(Rows[Pair * 2], Rows[Pair * 2 + 1])... };
+        const __m128i High[] = { UnpackHi<Bytes>(Rows[Pair * 2], Rows[Pair * 2 + 1])... };
+        ((Rows[Pair] = Low[Pair]), ...);
+        ((Rows[Count / 2 + Pair] = High[Pair]), ...);
+    }
+
+    template <uint32_t Bytes, size_t Count, size_t... Pair>
+    IDD_TARGET_AVX2 inline void Interleave(__m256i (&Rows)[Count], index_sequence<Pair...>)
+    {
+        const __m256i Low[] = { UnpackLo<Bytes>(Rows[Pair * 2], Rows[Pair * 2 + 1])... };
+        const __m256i High[] = { UnpackHi<Bytes>(Rows[Pair * 2], Rows[Pair * 2 + 1])... };
+        ((Rows[Pair] = Low[Pair]), ...);
+        ((Rows[Count / 2 + Pair] = High[Pair]), ...);
+    }
+
+    // Interleaves from Bytes-byte elements up to 8 bytes
+    template <uint32_t Bytes, size_t Count>
+    IDD_TARGET_SSE41 inline void Cascade(__m128i (&Rows)[Count])
+    {
+        const auto Pairs = make_index_sequence<Count / 2>();
+        if (Bytes <= 1)
+        {
+            Interleave<1>(Rows, Pairs);
+        }
+        if (Bytes <= 2)
+        {
+            Interleave<2>(Rows, Pairs);
+        }
+        if (Bytes <= 4)
+        {
+            Interleave<4>(Rows, Pairs);
+        }
+        Interleave<8>(Rows, Pairs);
+    }
+
+    template <uint32_t Bytes, size_t Count>
+    IDD_TARGET_AVX2 inline void Cascade(__m256i (&Rows)[Count])
+    {
+        const auto Pairs = make_index_sequence<Count / 2>();
+        if (Bytes <= 1)
+        {
+            Interleave<1>(Rows, Pairs);
+        }
+        if (Bytes <= 2)
+        {
+            Interleave<2>(Rows, Pairs);
+        }
+        if (Bytes <= 4)
+        {
+            Interleave<4>(Rows, Pairs);
+        }
+        Interleave<8>(Rows, Pairs);
+    }
+
+    template <uint32_t Bytes, size_t... Row>
+    IDD_TARGET_SSE41 inline void TransposeBlockSse41(
+        const uint8_t* pSource,
+        ptrdiff_t SourcePitch,
+        uint8_t* pDestination,
+        ptrdiff_t DestinationPitch,
+        index_sequence<Row...>)
+    {
+        __m128i Rows[] = { _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource + SourcePitch * static_cast<ptrdiff_t>(Row)))... };
+        Cascade<Bytes>(Rows);
+        (_mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + DestinationPitch * static_cast<ptrdiff_t>(BitReverse(Row, sizeof...(Row)))), Rows[Row]), ...);
+    }
+
+    template <uint32_t Bytes, size_t... Row>
+    IDD_TARGET_AVX2 inline void TransposeBlockAvx2(
+        const uint8_t* pSource,
+        ptrdiff_t SourcePitch,
+        uint8_t* pDestination,
+        ptrdiff_t DestinationPitch,
+        index_sequence<Row...>)
+    {
+        const ptrdiff_t Upper = SourcePitch * static_cast<ptrdiff_t>(sizeof...(Row));
+        __m256i Rows[] = { _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource + SourcePitch * static_cast<ptrdiff_t>(Row)))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource + Upper + SourcePitch * static_cast<ptrdiff_t>(Row))), 1)... };
+        Cascade<Bytes>(Rows);
+        (_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination + DestinationPitch * static_cast<ptrdiff_t>(BitReverse(Row, sizeof...(Row)))), Rows[Row]), ...);
+    }
+
+    // Byte order that reverses the Bytes-byte elements of a 128-bit lane
+    IDD_TARGET_SSE41 inline __m128i ReverseOrder(uint32_t Bytes)
+    {
+        switch (Bytes)
+        {
+        case 4:
+            return _mm_setr_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+        case 2:
+            return _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+        default:
+            return _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        }
+    }
+
+    template <uint32_t Bytes>
+    IDD_TARGET_SSE41 inline uint32_t ReverseRowSse41(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+    {
+        const uint32_t Step = 16 / Bytes;
+        const __m128i Order = ReverseOrder(Bytes);
+
+        uint32_t i = 0;
+        for (; i + Step <= Elements; i += Step)
+        {
+            __m128i Block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource + static_cast<size_t>(Elements - i - Step) * Bytes));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDestination + static_cast<size_t>(i) * Bytes), _mm_shuffle_epi8(Block, Order));
+        }
+
+        return i;
+    }
+
+    template <uint32_t Bytes>
+    IDD_TARGET_AVX2 inline uint32_t ReverseRowAvx2(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+    {
+        const uint32_t Step = 32 / Bytes;
+        const __m256i Order = _mm256_broadcastsi128_si256(ReverseOrder(Bytes));
+
+        uint32_t i = 0;
+        for (; i + Step <= Elements; i += Step)
+        {
+            __m256i Block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource + static_cast<size_t>(Elements - i - Step) * Bytes));
+            Block = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(Block, Order), 0x4E);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pDestination + static_cast<size_t>(i) * Bytes), Block);
+        }
+
+        return i;
+    }
+}
+
+IDD_TARGET_SSE41 void Microsoft::IndirectDisp::TransposeBlock8Sse41(
+    const uint8_t* pSource,
+    ptrdiff_t SourcePitch,
+    uint8_t* pDestination,
+    ptrdiff_t DestinationPitch)
+{
+    TransposeBlockSse41<1>(pSource, SourcePitch, pDestination, DestinationPitch, make_index_sequence<16>());
+}
+
+IDD_TARGET_SSE41 void Microsoft::IndirectDisp::TransposeBlock16Sse41(
+    const uint8_t* pSource,
+    ptrdiff_t SourcePitch,
+    uint8_t* pDestination,
+    ptrdiff_t DestinationPitch)
+{
+    TransposeBlockSse41<2>(pSource, SourcePitch, pDestination, DestinationPitch, make_index_sequence<8>());
+}
+
+IDD_TARGET_SSE41 void Microsoft::IndirectDisp::TransposeBlock32Sse41(
+    const uint8_t* pSource,
+    ptrdiff_t SourcePitch,
+    uint8_t* pDestination,
+    ptrdiff_t DestinationPitch)
+{
+    TransposeBlockSse41<4>(pSource, SourcePitch, pDestination, DestinationPitch, make_index_sequence<4>());
+}
+
+IDD_TARGET_AVX2 void Microsoft::IndirectDisp::TransposeBlock8Avx2(
+    const uint8_t* pSource,
+    ptrdiff_t SourcePitch,
+    uint8_t* pDestination,
+    ptrdiff_t DestinationPitch)
+{
+    TransposeBlockAvx2<1>(pSource, SourcePitch, pDestination, DestinationPitch, make_index_sequence<16>());
+}
+
+IDD_TARGET_AVX2 void Microsoft::IndirectDisp::TransposeBlock16Avx2(
+    const uint8_t* pSource,
+    ptrdiff_t SourcePitch,
+    uint8_t* pDestination,
+    ptrdiff_t DestinationPitch)
+{
+    TransposeBlockAvx2<2>(pSource, SourcePitch, pDestination, DestinationPitch, make_index_sequence<8>());
+}
+
+IDD_TARGET_AVX2 void Microsoft::IndirectDisp::TransposeBlock32Avx2(
+    const uint8_t* pSource,
+    ptrdiff_t SourcePitch,
+    uint8_t* pDestination,
+    ptrdiff_t DestinationPitch)
+{
+    TransposeBlockAvx2<4>(pSource, SourcePitch, pDestination, DestinationPitch, make_index_sequence<4>());
+}
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::ReverseRow8Sse41(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+{
+    return ReverseRowSse41<1>(pSource, pDestination, Elements);
+}
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::ReverseRow16Sse41(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+{
+    return ReverseRowSse41<2>(pSource, pDestination, Elements);
+}
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::ReverseRow32Sse41(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+{
+    return ReverseRowSse41<4>(pSource, pDestination, Elements);
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::ReverseRow8Avx2(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+{
+    return ReverseRowAvx2<1>(pSource, pDestination, Elements);
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::ReverseRow16Avx2(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+{
+    return ReverseRowAvx2<2>(pSource, pDestination, Elements);
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::ReverseRow32Avx2(const uint8_t* pSource, uint8_t* pDestination, uint32_t Elements)
+{
+    return ReverseRowAvx2<4>(pSource, pDestination, Elements);
+}
+
+#endif
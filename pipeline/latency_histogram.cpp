@@ -0,0 +1,153 @@
+/*++
+
+Module Name:
+
+    latency_histogram.cpp
+
+Abstract:
+
+    This module contains the log-linear latency histogram.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // Index of the highest set bit; Value must not be 0
+    uint32_t HighestBit(uint64_t Value)
+    {
+#if defined(_MSC_VER)
+        unsigned long Index;
+        _BitScanReverse64(&Index, Value);
+        return Index;
+#else
+        return 63 - __builtin_clzll(Value);
+#endif
+    }
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    Reset();
+}
+
+uint32_t LatencyHistogram::BucketIndex(uint64_t Value)
+{
+    if (Value < LinearBuckets)
+    {
+        return static_cast<uint32_t>(Value);
+    }
+
+    // The top seven bits select the bucket: the leading one picks the power of two, the other six the sub-bucket
+    uint32_t Shift = HighestBit(Value) - 6;
+    return LinearBuckets + (Shift - 1) * SubBuckets + static_cast<uint32_t>(Value >> Shift) - SubBuckets;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(uint32_t Index)
+{
+    if (Index < LinearBuckets)
+    {
+        return Index;
+    }
+
+    uint32_t Shift = (Index - LinearBuckets) / SubBuckets + 1;
+    uint64_t Top = (Index - LinearBuckets) % SubBuckets + SubBuckets;
+    return ((Top + 1) << Shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t Value)
+{
+    m_Counts[BucketIndex(Value)].fetch_add(1, memory_order_relaxed);
+    m_Sum.fetch_add(Value, memory_order_relaxed);
+
+    uint64_t Max = m_Max.load(memory_order_relaxed);
+    while (Value > Max && !m_Max.compare_exchange_weak(Max, Value, memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t LatencyHistogram::Count() const
+{
+    uint64_t Count = 0;
+    for (const auto& Bucket : m_Counts)
+    {
+        Count += Bucket.load(memory_order_relaxed);
+    }
+    return Count;
+}
+
+uint64_t LatencyHistogram::Percentile(double P) const
+{
+    uint64_t Count = this->Count();
+    if (Count == 0)
+    {
+        return 0;
+    }
+
+    // The rank of the value asked for, counting from 1
+    uint64_t Rank = static_cast<uint64_t>(ceil(min(max(P, 0.0), 100.0) / 100.0 * Count));
+    Rank = max<uint64_t>(Rank, 1);
+
+    uint64_t Seen = 0;
+    for (uint32_t i = 0; i < BucketCount; i++)
+    {
+        Seen += m_Counts[i].load(memory_order_relaxed);
+        if (Seen >= Rank)
+        {
+            return min(BucketUpperBound(i), Max());
+        }
+    }
+
+    return Max();
+}
+
+LatencySummary LatencyHistogram::Summarize() const
+{
+    LatencySummary Summary;
+    Summary.Count = Count();
+    Summary.P50 = Percentile(50);
+    Summary.P99 = Percentile(99);
+    Summary.P999 = Percentile(99.9);
+    Summary.Max = Max();
+    return Summary;
+}
+
+void LatencyHistogram::Add(const LatencyHistogram& Other)
+{
+    for (uint32_t i = 0; i < BucketCount; i++)
+    {
+        m_Counts[i].fetch_add(Other.m_Counts[i].load(memory_order_relaxed), memory_order_relaxed);
+    }
+    m_Sum.fetch_add(Other.Sum(), memory_order_relaxed);
+
+    uint64_t Value = Other.Max();
+    uint64_t Max = m_Max.load(memory_order_relaxed);
+    while (Value > Max && !m_Max.compare_exchange_weak(Max, Value, memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (auto& Bucket : m_Counts)
+    {
+        Bucket.store(0, memory_order_relaxed);
+    }
+    m_Sum.store(0, memory_order_relaxed);
+    m_Max.store(0, memory_order_relaxed);
+}
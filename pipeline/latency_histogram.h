@@ -0,0 +1,82 @@
+/*++
+
+Module Name:
+
+    latency_histogram.h
+
+Abstract:
+
+    This module contains a log-linear latency histogram in the style of HdrHistogram. Values below 128 get a
+    bucket each; above that, every power of two is split into 64 buckets, so any recorded value is known to within
+    1.6% and the whole 64-bit range fits in a fixed array. Recording is a relaxed atomic increment, so any thread
+    may record into a histogram and any other may read it at the same time without a lock.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// The percentiles of a histogram most reports want. Every value is the upper bound of its bucket.
+        /// </summary>
+        struct LatencySummary
+        {
+            uint64_t Count;
+            uint64_t P50;
+            uint64_t P99;
+            uint64_t P999;
+            uint64_t Max;
+        };
+
+        /// <summary>
+        /// Lock-free histogram of non-negative values, typically nanoseconds.
+        /// </summary>
+        class LatencyHistogram
+        {
+        public:
+            static const uint32_t LinearBuckets = 128;
+            static const uint32_t SubBuckets = 64;
+            static const uint32_t BucketCount = LinearBuckets + (64 - 7) * SubBuckets;
+
+            LatencyHistogram();
+
+            LatencyHistogram(const LatencyHistogram&) = delete;
+            LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+            void Record(uint64_t Value);
+
+            uint64_t Count() const;
+            uint64_t Sum() const { return m_Sum.load(std::memory_order_relaxed); }
+            uint64_t Max() const { return m_Max.load(std::memory_order_relaxed); }
+
+            // The smallest bucket bound at or below which P percent (0..100) of the values lie, 0 when empty.
+            // Concurrent recording may or may not be included.
+            uint64_t Percentile(double P) const;
+            LatencySummary Summarize() const;
+
+            // Adds the counts of Other to this histogram
+            void Add(const LatencyHistogram& Other);
+
+            // Not safe against concurrent recording: values recorded meanwhile may be lost or half counted
+            void Reset();
+
+            static uint32_t BucketIndex(uint64_t Value);
+            static uint64_t BucketUpperBound(uint32_t Index);
+
+        private:
+            std::atomic<uint64_t> m_Counts[BucketCount];
+            std::atomic<uint64_t> m_Sum;
+            std::atomic<uint64_t> m_Max;
+        };
+    }
+}
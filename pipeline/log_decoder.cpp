@@ -0,0 +1,437 @@
+/*++
+
+Module Name:
+
+    log_decoder.cpp
+
+Abstract:
+
+    This module contains the offline reader of binary log files. Messages are formatted one conversion at a time,
+    with the length modifier replaced to match the stored argument, so a format written for the original call
+    prints the same text no matter how the argument was widened on its way to the file.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "log_decoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // More call sites than any build could have; a larger id means the chunk is damaged
+    const uint32_t MaxSites = 1 << 20;
+
+    const char* LevelName(LogLevel Level)
+    {
+        switch (Level)
+        {
+        case LogLevel::Trace:
+            return "Trace";
+        case LogLevel::Info:
+            return "Info";
+        case LogLevel::Warning:
+            return "Warning";
+        default:
+            return "Error";
+        }
+    }
+
+    // The value as the caller passed it: truncated to its size, sign-extended if it was signed
+    uint64_t Unsigned(uint64_t Value, char Type)
+    {
+        switch (Type)
+        {
+        case 'b':
+        case 'B':
+            return Value & 0xFF;
+        case 'h':
+        case 'H':
+            return Value & 0xFFFF;
+        case 'i':
+        case 'I':
+            return Value & 0xFFFFFFFF;
+        case 'f':
+        {
+            double Floating;
+            memcpy(&Floating, &Value, sizeof(Floating));
+            return static_cast<uint64_t>(static_cast<int64_t>(Floating));
+        }
+        default:
+            return Value;
+        }
+    }
+
+    bool IsSigned(char Type)
+    {
+        return Type == 'b' || Type == 'h' || Type == 'i' || Type == 'l';
+    }
+
+    int64_t Signed(uint64_t Value, char Type)
+    {
+        if (Type == 'f')
+        {
+            double Floating;
+            memcpy(&Floating, &Value, sizeof(Floating));
+            return static_cast<int64_t>(Floating);
+        }
+        return static_cast<int64_t>(Value);
+    }
+
+    double Floating(uint64_t Value, char Type)
+    {
+        if (Type == 'f')
+        {
+            double Result;
+            memcpy(&Result, &Value, sizeof(Result));
+            return Result;
+        }
+        return IsSigned(Type) ? static_cast<double>(static_cast<int64_t>(Value)) : static_cast<double>(Unsigned(Value, Type));
+    }
+}
+
+LogDecoder::LogDecoder()
+    : m_Offset(0), m_OpenTime(0), m_pRecords(nullptr), m_RecordCount(0), m_NextRecord(0), m_LastTime(0)
+    , m_Dropped(), m_HasDropped(false), m_Damaged(false)
+{
+}
+
+bool LogDecoder::Open(const char* Path)
+{
+    m_Data.clear();
+    m_Sites.clear();
+    m_Offset = 0;
+    m_RecordCount = 0;
+    m_NextRecord = 0;
+    m_LastTime = 0;
+    m_HasDropped = false;
+    m_Damaged = false;
+
+    FILE* pFile = fopen(Path, "rb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    uint8_t Buffer[65536];
+    size_t Read;
+    while ((Read = fread(Buffer, 1, sizeof(Buffer), pFile)) != 0)
+    {
+        m_Data.insert(m_Data.end(), Buffer, Buffer + Read);
+    }
+    fclose(pFile);
+
+    LogFileHeader Header;
+    if (m_Data.size() < sizeof(Header))
+    {
+        return false;
+    }
+
+    memcpy(&Header, m_Data.data(), sizeof(Header));
+    if (memcmp(Header.Magic, LogFileMagic, sizeof(Header.Magic)) != 0 || Header.Version != LogFileVersion ||
+        Header.RecordSize != sizeof(LogRecord))
+    {
+        return false;
+    }
+
+    m_OpenTime = Header.OpenTime;
+    m_Offset = sizeof(Header);
+    return true;
+}
+
+bool LogDecoder::Next(LogEntry& Entry)
+{
+    for (;;)
+    {
+        if (m_HasDropped)
+        {
+            m_HasDropped = false;
+
+            Entry.Time = m_LastTime;
+            Entry.Thread = static_cast<uint16_t>(m_Dropped.Thread);
+            Entry.Level = LogLevel::Warning;
+            Entry.File = "";
+            Entry.Function = "";
+            Entry.Line = 0;
+            Entry.Dropped = m_Dropped.Count;
+            Entry.Message.clear();
+            return true;
+        }
+
+        if (m_NextRecord < m_RecordCount)
+        {
+            LogRecord Record;
+            memcpy(&Record, m_pRecords + m_NextRecord * sizeof(LogRecord), sizeof(Record));
+            m_NextRecord++;
+
+            if (Record.Site == 0 || Record.Site > m_Sites.size() || !m_Sites[Record.Site - 1].Defined)
+            {
+                // A record of a site the file never defined
+                m_Damaged = true;
+                return false;
+            }
+
+            const Site& Definition = m_Sites[Record.Site - 1];
+            m_LastTime = Record.Timestamp > m_OpenTime ? Record.Timestamp - m_OpenTime : 0;
+
+            Entry.Time = m_LastTime;
+            Entry.Thread = Record.Thread;
+            Entry.Level = Definition.Level;
+            Entry.File = Definition.File.c_str();
+            Entry.Function = Definition.Function.c_str();
+            Entry.Line = Definition.Line;
+            Entry.Dropped = 0;
+            FormatArguments(Definition.Format.c_str(), Definition.Types.c_str(), Record.Arguments,
+                min<uint32_t>(Record.ArgumentCount, static_cast<uint32_t>(Definition.Types.size())), Entry.Message);
+            return true;
+        }
+
+        if (!ReadChunk())
+        {
+            return false;
+        }
+    }
+}
+
+bool LogDecoder::ReadChunk()
+{
+    if (m_Offset == m_Data.size())
+    {
+        return false;
+    }
+
+    LogChunkHeader Header;
+    if (m_Data.size() - m_Offset < sizeof(Header))
+    {
+        m_Damaged = true;
+        return false;
+    }
+
+    memcpy(&Header, m_Data.data() + m_Offset, sizeof(Header));
+    m_Offset += sizeof(Header);
+
+    if (m_Data.size() - m_Offset < Header.Size)
+    {
+        m_Damaged = true;
+        return false;
+    }
+
+    const uint8_t* pData = m_Data.data() + m_Offset;
+    m_Offset += Header.Size;
+
+    switch (static_cast<LogChunkKind>(Header.Kind))
+    {
+    case LogChunkKind::Site:
+        if (!ReadSite(pData, Header.Size))
+        {
+            m_Damaged = true;
+            return false;
+        }
+        return true;
+    case LogChunkKind::Records:
+        if (Header.Size % sizeof(LogRecord) != 0)
+        {
+            m_Damaged = true;
+            return false;
+        }
+        m_pRecords = pData;
+        m_RecordCount = Header.Size / sizeof(LogRecord);
+        m_NextRecord = 0;
+        return true;
+    case LogChunkKind::Dropped:
+        if (Header.Size != sizeof(LogDroppedChunk))
+        {
+            m_Damaged = true;
+            return false;
+        }
+        memcpy(&m_Dropped, pData, sizeof(m_Dropped));
+        m_HasDropped = true;
+        return true;
+    default:
+        m_Damaged = true;
+        return false;
+    }
+}
+
+bool LogDecoder::ReadSite(const uint8_t* pData, uint32_t Size)
+{
+    uint32_t Fields[3];
+    if (Size < sizeof(Fields))
+    {
+        return false;
+    }
+    memcpy(Fields, pData, sizeof(Fields));
+
+    if (Fields[0] == 0 || Fields[0] > MaxSites)
+    {
+        return false;
+    }
+
+    Site Definition;
+    Definition.Defined = true;
+    Definition.Line = Fields[1];
+    Definition.Level = static_cast<LogLevel>(Fields[2]);
+
+    string* Strings[] = { &Definition.Format, &Definition.File, &Definition.Function, &Definition.Types };
+    size_t Offset = sizeof(Fields);
+    for (string* pString : Strings)
+    {
+        const void* pEnd = memchr(pData + Offset, '\0', Size - Offset);
+        if (!pEnd)
+        {
+            return false;
+        }
+        size_t Length = static_cast<const uint8_t*>(pEnd) - (pData + Offset);
+        pString->assign(reinterpret_cast<const char*>(pData + Offset), Length);
+        Offset += Length + 1;
+    }
+
+    if (m_Sites.size() < Fields[0])
+    {
+        m_Sites.resize(Fields[0]);
+    }
+    m_Sites[Fields[0] - 1] = move(Definition);
+    return true;
+}
+
+void LogDecoder::FormatArguments(const char* Format, const char* Types, const uint64_t* pArguments, uint32_t ArgumentCount, string& Message)
+{
+    Message.clear();
+
+    uint32_t Next = 0;
+    const char* p = Format;
+    while (*p)
+    {
+        if (*p != '%')
+        {
+            Message += *p++;
+            continue;
+        }
+
+        if (p[1] == '%')
+        {
+            Message += '%';
+            p += 2;
+            continue;
+        }
+
+        // Flags, width and precision carry over; '*' would take an argument of its own and is not supported
+        string Specification = "%";
+        p++;
+        while (*p && strchr("-+ #0", *p))
+        {
+            Specification += *p++;
+        }
+        while (isdigit(static_cast<unsigned char>(*p)) || *p == '.')
+        {
+            Specification += *p++;
+        }
+
+        // The stored type decides the length modifier
+        for (;;)
+        {
+            if (*p && strchr("hljztLq", *p))
+            {
+                p++;
+            }
+            else if (*p == 'I')
+            {
+                p += (strncmp(p, "I64", 3) == 0 || strncmp(p, "I32", 3) == 0) ? 3 : 1;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        char Conversion = *p;
+        if (!Conversion)
+        {
+            Message += Specification;
+            break;
+        }
+        p++;
+
+        if (Next >= ArgumentCount)
+        {
+            Message += "<missing>";
+            continue;
+        }
+
+        uint64_t Value = pArguments[Next];
+        char Type = Types[Next];
+        Next++;
+
+        char Text[512];
+        switch (Conversion)
+        {
+        case 'd':
+        case 'i':
+            snprintf(Text, sizeof(Text), (Specification + "lld").c_str(), static_cast<long long>(Signed(Value, Type)));
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            snprintf(Text, sizeof(Text), (Specification + "ll" + Conversion).c_str(), static_cast<unsigned long long>(Unsigned(Value, Type)));
+            break;
+        case 'c':
+            snprintf(Text, sizeof(Text), (Specification + 'c').c_str(), static_cast<int>(Unsigned(Value, Type) & 0xFF));
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            snprintf(Text, sizeof(Text), (Specification + Conversion).c_str(), Floating(Value, Type));
+            break;
+        case 'p':
+            snprintf(Text, sizeof(Text), (Specification + 'p').c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(Value)));
+            break;
+        default:
+            // Strings, of which only the address was kept
+            snprintf(Text, sizeof(Text), "0x%016llx", static_cast<unsigned long long>(Value));
+            break;
+        }
+        Message += Text;
+    }
+}
+
+void LogDecoder::FormatEntry(const LogEntry& Entry, string& Line)
+{
+    char Prefix[64];
+    snprintf(Prefix, sizeof(Prefix), "%14.6f T%-3u %-7s ", Entry.Time / 1e9, Entry.Thread, LevelName(Entry.Level));
+    Line = Prefix;
+
+    if (Entry.Dropped != 0)
+    {
+        Line += to_string(Entry.Dropped) + " records dropped, the thread's ring was full";
+        return;
+    }
+
+    Line += '[';
+    Line += Entry.File;
+    Line += ' ';
+    Line += to_string(Entry.Line);
+    Line += ' ';
+    Line += Entry.Function;
+    Line += ']';
+
+    if (!Entry.Message.empty())
+    {
+        Line += ' ';
+        Line += Entry.Message;
+    }
+}
@@ -0,0 +1,101 @@
+/*++
+
+Module Name:
+
+    log_decoder.h
+
+Abstract:
+
+    This module contains the offline reader of binary log files, used by logfmt and the log benchmark.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "binary_log.h"
+#include "log_format.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// One decoded record, or a note that a thread dropped records.
+        /// </summary>
+        struct LogEntry
+        {
+            uint64_t Time;              // since the file was opened [ns]
+            uint16_t Thread;
+            LogLevel Level;
+            const char* File;
+            const char* Function;
+            uint32_t Line;
+            uint64_t Dropped;           // nonzero for a note of dropped records, which carries no message
+            std::string Message;
+        };
+
+        /// <summary>
+        /// Reads a whole log file and decodes it entry by entry.
+        /// </summary>
+        class LogDecoder
+        {
+        public:
+            LogDecoder();
+
+            // Fails if the file cannot be read or is not a binary log
+            bool Open(const char* Path);
+
+            // Returns false at the end of the file, or at the first chunk that does not decode
+            bool Next(LogEntry& Entry);
+
+            // The file ended in the middle of a chunk or held something that is not a chunk
+            bool Damaged() const { return m_Damaged; }
+
+            // Formats Arguments the way printf would have formatted the original call
+            static void FormatArguments(const char* Format, const char* Types, const uint64_t* pArguments, uint32_t ArgumentCount, std::string& Message);
+
+            // One line of text, without the newline
+            static void FormatEntry(const LogEntry& Entry, std::string& Line);
+
+        private:
+            struct Site
+            {
+                bool Defined = false;
+                uint32_t Line;
+                LogLevel Level;
+                std::string Format;
+                std::string File;
+                std::string Function;
+                std::string Types;
+            };
+
+            bool ReadChunk();
+            bool ReadSite(const uint8_t* pData, uint32_t Size);
+
+            std::vector<uint8_t> m_Data;
+            size_t m_Offset;
+            uint64_t m_OpenTime;
+            std::vector<Site> m_Sites;      // m_Sites[Id - 1]
+
+            // The records chunk being decoded
+            const uint8_t* m_pRecords;
+            size_t m_RecordCount;
+            size_t m_NextRecord;
+            uint64_t m_LastTime;
+
+            // A dropped chunk waiting to be returned
+            LogDroppedChunk m_Dropped;
+            bool m_HasDropped;
+
+            bool m_Damaged;
+        };
+    }
+}
@@ -0,0 +1,59 @@
+/*++
+
+Module Name:
+
+    log_format.h
+
+Abstract:
+
+    This module contains the layout of binary log files, shared by the writer and the decoder. All fields are
+    little-endian, as written by the machine that logged.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const char LogFileMagic[8] = { 'I', 'D', 'D', 'B', 'L', 'O', 'G', '\0' };
+        const uint32_t LogFileVersion = 1;
+
+        struct LogFileHeader
+        {
+            char Magic[8];
+            uint32_t Version;
+            uint32_t RecordSize;
+            uint64_t OpenTime;      // MonotonicNanoseconds when the file was opened
+        };
+
+        // Argument types of a site, one character each: b, h, i, l for signed integers of 1, 2, 4 and 8 bytes, B, H,
+        // I, L for unsigned ones, f for floating point (stored as a double) and p for pointers
+        enum class LogChunkKind : uint32_t
+        {
+            Site = 1,       // uint32 Id, Line, Level, then the format, file, function and argument types, each NUL-terminated
+            Records = 2,    // LogRecords
+            Dropped = 3,    // LogDroppedChunk
+        };
+
+        struct LogChunkHeader
+        {
+            uint32_t Kind;
+            uint32_t Size;          // bytes following the header
+        };
+
+        struct LogDroppedChunk
+        {
+            uint32_t Thread;
+            uint32_t Reserved;
+            uint64_t Count;         // since the previous chunk for the same thread
+        };
+    }
+}
@@ -0,0 +1,147 @@
+/*++
+
+Module Name:
+
+    metrics.cpp
+
+Abstract:
+
+    This module contains the metrics registry and the snapshot encoder and decoder.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "metrics.h"
+
+#include <cstring>
+
+#include "frame.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    struct MetricInfo
+    {
+        const char* Name;
+        MetricKind Kind;
+    };
+
+    const MetricInfo s_Metrics[] =
+    {
+        { "swapchains-assigned", MetricKind::Counter },
+        { "swapchains-abandoned", MetricKind::Counter },
+        { "frames-acquired", MetricKind::Counter },
+        { "pending-acquires", MetricKind::Counter },
+        { "wait-timeouts", MetricKind::Counter },
+        { "frames-delivered", MetricKind::Counter },
+        { "frames-dropped", MetricKind::Counter },
+        { "frames-overrun", MetricKind::Counter },
+        { "map-failures", MetricKind::Counter },
+        { "frames-detected", MetricKind::Counter },
+        { "frames-scrolled", MetricKind::Counter },
+        { "monitors-plugged", MetricKind::Gauge },
+        { "active-swapchains", MetricKind::Gauge },
+        { "frames-queued", MetricKind::Gauge },
+    };
+
+    static_assert(sizeof(s_Metrics) / sizeof(s_Metrics[0]) == MetricCount, "every metric needs a name");
+
+    atomic<uint32_t> s_NextShard(0);
+}
+
+const char* Microsoft::IndirectDisp::MetricName(uint32_t Index)
+{
+    return Index < MetricCount ? s_Metrics[Index].Name : nullptr;
+}
+
+MetricKind Microsoft::IndirectDisp::MetricKindOf(uint32_t Index)
+{
+    return Index < MetricCount ? s_Metrics[Index].Kind : MetricKind::Counter;
+}
+
+bool MetricsSnapshot::Decode(const void* pData, size_t Size)
+{
+    MetricsHeader Header;
+    if (Size < sizeof(Header))
+    {
+        return false;
+    }
+    memcpy(&Header, pData, sizeof(Header));
+
+    // A later version may have grown the header, but never shrunk it
+    if (memcmp(Header.Magic, MetricsMagic, sizeof(Header.Magic)) != 0 || Header.Version == 0 ||
+        Header.HeaderSize < sizeof(Header) || Header.HeaderSize > Size ||
+        (Size - Header.HeaderSize) / sizeof(int64_t) < Header.MetricCount)
+    {
+        return false;
+    }
+
+    Version = Header.Version;
+    ShardCount = Header.ShardCount;
+    Timestamp = Header.Timestamp;
+    StartTime = Header.StartTime;
+    Values.resize(Header.MetricCount);
+    memcpy(Values.data(), static_cast<const uint8_t*>(pData) + Header.HeaderSize, Values.size() * sizeof(int64_t));
+    return true;
+}
+
+MetricsRegistry::MetricsRegistry()
+    : m_StartTime(MonotonicNanoseconds())
+{
+    for (Shard& Shard : m_Shards)
+    {
+        for (atomic<int64_t>& Value : Shard.Values)
+        {
+            Value.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+uint32_t MetricsRegistry::NextShard()
+{
+    return s_NextShard.fetch_add(1, memory_order_relaxed) % ShardCount;
+}
+
+int64_t MetricsRegistry::Read(MetricId Id) const
+{
+    int64_t Sum = 0;
+    for (const Shard& Shard : m_Shards)
+    {
+        Sum += Shard.Values[static_cast<uint32_t>(Id)].load(memory_order_relaxed);
+    }
+    return Sum;
+}
+
+bool MetricsRegistry::Serialize(void* pBuffer, size_t Size) const
+{
+    if (Size < SerializedSize())
+    {
+        return false;
+    }
+
+    MetricsHeader Header = {};
+    memcpy(Header.Magic, MetricsMagic, sizeof(Header.Magic));
+    Header.Version = MetricsVersion;
+    Header.HeaderSize = sizeof(Header);
+    Header.MetricCount = MetricCount;
+    Header.ShardCount = ShardCount;
+    Header.Timestamp = MonotonicNanoseconds();
+    Header.StartTime = m_StartTime;
+
+    uint8_t* pOut = static_cast<uint8_t*>(pBuffer);
+    memcpy(pOut, &Header, sizeof(Header));
+    pOut += sizeof(Header);
+
+    for (uint32_t i = 0; i < MetricCount; i++)
+    {
+        int64_t Value = Read(static_cast<MetricId>(i));
+        memcpy(pOut, &Value, sizeof(Value));
+        pOut += sizeof(Value);
+    }
+    return true;
+}
@@ -0,0 +1,128 @@
+/*++
+
+Module Name:
+
+    metrics.h
+
+Abstract:
+
+    This module contains the metrics registry: counters and gauges kept on the hot path of every monitor and read
+    out in one snapshot through IOCTL_QUERY_METRICS. Every thread adds to its own cache-line-aligned shard with a
+    relaxed atomic add, so threads never contend for a line; a snapshot sums the shards.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "metrics_format.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Every metric the driver keeps. Only ever append: the values are indexed by these numbers on the wire.
+        /// </summary>
+        enum class MetricId : uint32_t
+        {
+            SwapChainsAssigned = 0,
+            SwapChainsAbandoned,    // acquisition or release failed, e.g. with DXGI_ERROR_ACCESS_LOST
+            FramesAcquired,
+            PendingAcquires,        // IddCxSwapChainReleaseAndAcquireBuffer returned E_PENDING
+            WaitTimeouts,
+            FramesDelivered,        // passed every stage and reached the sink
+            FramesDropped,          // rejected by a stage
+            FramesOverrun,          // skipped because processing was a full queue behind
+            MapFailures,
+            FramesDetected,
+            FramesScrolled,
+            MonitorsPlugged,        // gauge
+            ActiveSwapChains,       // gauge
+            FramesQueued,           // gauge: handed off and not processed yet
+            Count
+        };
+
+        const uint32_t MetricCount = static_cast<uint32_t>(MetricId::Count);
+
+        enum class MetricKind : uint32_t
+        {
+            Counter,    // only goes up
+            Gauge,      // goes up and down; the value is the current level
+        };
+
+        // Name and kind of a metric, nullptr for one this build does not know
+        const char* MetricName(uint32_t Index);
+        MetricKind MetricKindOf(uint32_t Index);
+
+        /// <summary>
+        /// A decoded snapshot.
+        /// </summary>
+        struct MetricsSnapshot
+        {
+            uint16_t Version;
+            uint32_t ShardCount;
+            uint64_t Timestamp;
+            uint64_t StartTime;
+            std::vector<int64_t> Values;    // indexed by MetricId, possibly more than this build knows
+
+            // Fails on anything that is not a whole snapshot
+            bool Decode(const void* pData, size_t Size);
+        };
+
+        /// <summary>
+        /// Sharded counters and gauges. Adding is lock-free and wait-free; a snapshot taken while threads add is not
+        /// atomic across metrics, but every value in it was current at some point during the snapshot.
+        /// </summary>
+        class MetricsRegistry
+        {
+        public:
+            static const uint32_t ShardCount = 16;
+
+            MetricsRegistry();
+
+            MetricsRegistry(const MetricsRegistry&) = delete;
+            MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+            void Add(MetricId Id, int64_t Value = 1)
+            {
+                m_Shards[CurrentShard()].Values[static_cast<uint32_t>(Id)].fetch_add(Value, std::memory_order_relaxed);
+            }
+
+            int64_t Read(MetricId Id) const;
+
+            // Bytes Serialize writes
+            static size_t SerializedSize() { return sizeof(MetricsHeader) + MetricCount * sizeof(int64_t); }
+
+            // Writes a snapshot; fails without writing anything if Size is less than SerializedSize
+            bool Serialize(void* pBuffer, size_t Size) const;
+
+        private:
+            // Threads are spread over the shards in the order they first add; with more threads than shards some
+            // share one, which the atomic add keeps correct
+            static uint32_t CurrentShard()
+            {
+                thread_local uint32_t t_Shard = NextShard();
+                return t_Shard;
+            }
+
+            static uint32_t NextShard();
+
+            struct alignas(64) Shard
+            {
+                std::atomic<int64_t> Values[MetricCount];
+            };
+
+            Shard m_Shards[ShardCount];
+            uint64_t m_StartTime;
+        };
+    }
+}
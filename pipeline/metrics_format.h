@@ -0,0 +1,53 @@
+/*++
+
+Module Name:
+
+    metrics_format.h
+
+Abstract:
+
+    This module contains the layout of a metrics snapshot, as returned by IOCTL_QUERY_METRICS and saved by the
+    iddstat tool. All fields are little-endian.
+
+    Metrics are only ever appended to MetricId, so a reader decodes the metrics it knows from a snapshot of any
+    later version and shows the others by number.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+// Device type and function of the query; the driver and iddstat each build IOCTL_QUERY_METRICS from them with
+// CTL_CODE(METRICS_DEVICE_TYPE, METRICS_IOCTL_FUNCTION, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define METRICS_DEVICE_TYPE     0x00009528
+#define METRICS_IOCTL_FUNCTION  0xcc4
+
+// Function of IOCTL_QUERY_TRACE, which returns the frame trace as Chrome trace JSON, on the same device type. An
+// output buffer too small for the trace, but holding at least a ULONG, gets the size the trace needs with
+// STATUS_BUFFER_OVERFLOW.
+#define TRACE_IOCTL_FUNCTION    0xcc3
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const char MetricsMagic[4] = { 'I', 'D', 'D', 'M' };
+        const uint16_t MetricsVersion = 1;
+
+        struct MetricsHeader
+        {
+            char Magic[4];
+            uint16_t Version;
+            uint16_t HeaderSize;    // bytes before the first value
+            uint32_t MetricCount;   // int64 values following the header, indexed by MetricId
+            uint32_t ShardCount;
+            uint64_t Timestamp;     // MonotonicNanoseconds when the snapshot was taken
+            uint64_t StartTime;     // MonotonicNanoseconds when the registry was created
+        };
+    }
+}
@@ -0,0 +1,451 @@
+/*++
+
+Module Name:
+
+    motion_detector.cpp
+
+Abstract:
+
+    This module contains the scroll and move detector: the row and column hashing, its scalar column kernel and the
+    search for shifted runs.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "motion_detector.h"
+#include "change_detector_kernels.h"
+#include "motion_detector_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint64_t GoldenRatio = 0x9E3779B97F4A7C15ull;
+
+    uint64_t Mix(uint64_t Value)
+    {
+        Value ^= Value >> 33;
+        Value *= 0xFF51AFD7ED558CCDull;
+        Value ^= Value >> 33;
+        Value *= 0xC4CEB9FE1A85EC53ull;
+        Value ^= Value >> 33;
+        return Value;
+    }
+
+    uint32_t AccumulateColumnsScalar(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns)
+    {
+        for (uint32_t x = 0; x < Width; x++)
+        {
+            uint32_t Pixel;
+            memcpy(&Pixel, pRow + static_cast<size_t>(x) * 4, sizeof(Pixel));
+
+            uint64_t Key = (Pixel | (static_cast<uint64_t>(Pixel) << 32)) ^ RowKey;
+            pColumns[x] += (Key & 0xFFFFFFFFull) * (Key >> 32);
+        }
+
+        return Width;
+    }
+
+    ColumnHashKernel SelectColumnKernel(SimdLevel Level)
+    {
+        switch (ClampSimdLevel(Level))
+        {
+#if IDD_X86
+        case SimdLevel::Avx512:
+            return AccumulateColumnsAvx512;
+        case SimdLevel::Avx2:
+            return AccumulateColumnsAvx2;
+        case SimdLevel::Sse41:
+            return AccumulateColumnsSse41;
+#endif
+        default:
+            return AccumulateColumnsScalar;
+        }
+    }
+
+    bool Overlaps(const Rect& A, const Rect& B)
+    {
+        return A.Left < B.Right && B.Left < A.Right && A.Top < B.Bottom && B.Top < A.Bottom;
+    }
+}
+
+MotionDetector::MotionDetector(uint32_t MinRun, SimdLevel Level)
+    : m_MinRun(max(MinRun, 1u))
+    , m_Level(Level)
+    , m_Signatures()
+    , m_Current(0)
+    , m_IndexMask(0)
+{
+}
+
+void MotionDetector::Reset()
+{
+    m_Signatures[0].Valid = false;
+    m_Signatures[1].Valid = false;
+}
+
+bool MotionDetector::HasReference() const
+{
+    return m_Signatures[m_Current ^ 1].Valid;
+}
+
+void MotionDetector::Commit()
+{
+    if (m_Signatures[m_Current].Valid)
+    {
+        m_Current ^= 1;
+    }
+}
+
+void MotionDetector::Hash(const uint8_t* pData, uint32_t Pitch, uint32_t Width, uint32_t Height, const Region* pChanged)
+{
+    Signature& Current = m_Signatures[m_Current];
+    const Signature& Reference = m_Signatures[m_Current ^ 1];
+
+    const uint32_t Strips = Width / SegmentSize;
+    const uint32_t Bands = Height / SegmentSize;
+
+    bool Incremental = pChanged && Reference.Valid && Reference.Width == Width && Reference.Height == Height;
+
+    Current.Width = Width;
+    Current.Height = Height;
+    Current.Valid = true;
+    m_Accumulators.resize(Strips);
+
+    if (Incremental)
+    {
+        Current.Rows = Reference.Rows;
+        Current.Columns = Reference.Columns;
+
+        for (const Rect& Area : *pChanged)
+        {
+            uint32_t Left = static_cast<uint32_t>(max(Area.Left, 0));
+            uint32_t Top = static_cast<uint32_t>(max(Area.Top, 0));
+            uint32_t Right = min(static_cast<uint32_t>(max(Area.Right, 0)), Width);
+            uint32_t Bottom = min(static_cast<uint32_t>(max(Area.Bottom, 0)), Height);
+            if (Left >= Right || Top >= Bottom)
+            {
+                continue;
+            }
+
+            uint32_t LastStrip = min(Strips, (Right + SegmentSize - 1) / SegmentSize);
+            if (Left / SegmentSize < LastStrip)
+            {
+                HashRows(pData, Pitch, Left / SegmentSize, LastStrip, Top, Bottom);
+            }
+
+            uint32_t LastBand = min(Bands, (Bottom + SegmentSize - 1) / SegmentSize);
+            for (uint32_t Band = Top / SegmentSize; Band < LastBand; Band++)
+            {
+                HashColumns(pData, Pitch, Band, Left, Right);
+            }
+        }
+        return;
+    }
+
+    Current.Rows.resize(static_cast<size_t>(Strips) * Height);
+    Current.Columns.resize(static_cast<size_t>(Bands) * Width);
+
+    // Band by band, so the column pass finds the rows the row pass just read still in cache
+    for (uint32_t Band = 0; Band < Bands; Band++)
+    {
+        HashRows(pData, Pitch, 0, Strips, Band * SegmentSize, (Band + 1) * SegmentSize);
+        HashColumns(pData, Pitch, Band, 0, Width);
+    }
+    HashRows(pData, Pitch, 0, Strips, Bands * SegmentSize, Height);
+}
+
+void MotionDetector::HashRows(const uint8_t* pData, uint32_t Pitch, uint32_t FirstStrip, uint32_t LastStrip, uint32_t Top, uint32_t Bottom)
+{
+    Signature& Current = m_Signatures[m_Current];
+
+    const TileRowKernel Kernel = SelectTileRowKernel(m_Level);
+    const uint32_t Count = LastStrip - FirstStrip;
+    const uint32_t StripesPerStrip = SegmentSize * 4 / TileHashStripeBytes;
+
+    for (uint32_t y = Top; y < Bottom; y++)
+    {
+        memset(m_Accumulators.data(), 0, Count * sizeof(TileAccumulator));
+        Kernel(pData + static_cast<size_t>(y) * Pitch + static_cast<size_t>(FirstStrip) * SegmentSize * 4, Count, StripesPerStrip, GoldenRatio, m_Accumulators.data());
+
+        for (uint32_t i = 0; i < Count; i++)
+        {
+            Current.Rows[static_cast<size_t>(FirstStrip + i) * Current.Height + y] = FinalizeTileHash(m_Accumulators[i]);
+        }
+    }
+}
+
+void MotionDetector::HashColumns(const uint8_t* pData, uint32_t Pitch, uint32_t Band, uint32_t Left, uint32_t Right)
+{
+    Signature& Current = m_Signatures[m_Current];
+
+    const ColumnHashKernel Kernel = SelectColumnKernel(m_Level);
+    const uint32_t Count = Right - Left;
+    uint64_t* pColumns = &Current.Columns[static_cast<size_t>(Band) * Current.Width + Left];
+
+    fill(pColumns, pColumns + Count, 0);
+
+    for (uint32_t r = 0; r < SegmentSize; r++)
+    {
+        const uint8_t* pRow = pData + static_cast<size_t>(Band * SegmentSize + r) * Pitch + static_cast<size_t>(Left) * 4;
+        uint64_t RowKey = (r + 1) * GoldenRatio;
+
+        uint32_t Done = Kernel(pRow, Count, RowKey, pColumns);
+        AccumulateColumnsScalar(pRow + static_cast<size_t>(Done) * 4, Count - Done, RowKey, pColumns + Done);
+    }
+
+    for (uint32_t i = 0; i < Count; i++)
+    {
+        pColumns[i] = Mix(pColumns[i] ^ GoldenRatio);
+    }
+}
+
+void MotionDetector::Search(const Region& Damage, size_t MaxMoves, vector<MoveRect>& Moves)
+{
+    Moves.clear();
+    m_Found.clear();
+
+    const Signature& Current = m_Signatures[m_Current];
+    const Signature& Reference = m_Signatures[m_Current ^ 1];
+
+    if (!Current.Valid || !Reference.Valid || Current.Width != Reference.Width || Current.Height != Reference.Height ||
+        Damage.Empty() || MaxMoves == 0)
+    {
+        return;
+    }
+
+    const uint32_t Width = Current.Width;
+    const uint32_t Height = Current.Height;
+    const uint32_t Strips = Width / SegmentSize;
+    const uint32_t Bands = Height / SegmentSize;
+
+    // Vertical shifts, strip by strip, over the damaged rows of each strip
+    m_Runs.clear();
+    m_Damaged.resize(Height);
+
+    for (uint32_t Strip = 0; Strip < Strips; Strip++)
+    {
+        int32_t Left = static_cast<int32_t>(Strip * SegmentSize);
+        int32_t Right = Left + static_cast<int32_t>(SegmentSize);
+        bool Any = false;
+
+        fill(m_Damaged.begin(), m_Damaged.end(), 0);
+        for (const Rect& Area : Damage)
+        {
+            if (Area.Right > Left && Area.Left < Right)
+            {
+                fill(m_Damaged.begin() + max(Area.Top, 0), m_Damaged.begin() + min(Area.Bottom, static_cast<int32_t>(Height)), 1);
+                Any = true;
+            }
+        }
+
+        if (Any)
+        {
+            size_t Offset = static_cast<size_t>(Strip) * Height;
+            FindRuns(&Current.Rows[Offset], &Reference.Rows[Offset], Height, Strip);
+        }
+    }
+
+    MergeRuns(true, m_Found);
+    const size_t VerticalMoves = m_Found.size();
+
+    // Horizontal shifts, band by band, over whatever the vertical moves did not explain
+    Region Remaining(Damage);
+    for (const MoveRect& Move : m_Found)
+    {
+        Remaining.Subtract(Move.Destination);
+    }
+
+    m_Runs.clear();
+    m_Damaged.resize(Width);
+
+    for (uint32_t Band = 0; Band < Bands && !Remaining.Empty(); Band++)
+    {
+        int32_t Top = static_cast<int32_t>(Band * SegmentSize);
+        int32_t Bottom = Top + static_cast<int32_t>(SegmentSize);
+        bool Any = false;
+
+        fill(m_Damaged.begin(), m_Damaged.end(), 0);
+        for (const Rect& Area : Remaining)
+        {
+            if (Area.Bottom > Top && Area.Top < Bottom)
+            {
+                fill(m_Damaged.begin() + max(Area.Left, 0), m_Damaged.begin() + min(Area.Right, static_cast<int32_t>(Width)), 1);
+                Any = true;
+            }
+        }
+
+        if (Any)
+        {
+            size_t Offset = static_cast<size_t>(Band) * Width;
+            FindRuns(&Current.Columns[Offset], &Reference.Columns[Offset], Width, Band);
+        }
+    }
+
+    MergeRuns(false, m_Found);
+
+    // A horizontal move spans its whole band, which may reach into a vertical move's destination
+    auto LastMove = remove_if(m_Found.begin() + VerticalMoves, m_Found.end(), [&](const MoveRect& Move)
+    {
+        for (size_t i = 0; i < VerticalMoves; i++)
+        {
+            if (Overlaps(Move.Destination, m_Found[i].Destination))
+            {
+                return true;
+            }
+        }
+        return false;
+    });
+    m_Found.erase(LastMove, m_Found.end());
+
+    stable_sort(m_Found.begin(), m_Found.end(), [](const MoveRect& A, const MoveRect& B)
+    {
+        return A.Destination.Area() > B.Destination.Area();
+    });
+
+    Moves.assign(m_Found.begin(), m_Found.begin() + min(MaxMoves, m_Found.size()));
+}
+
+void MotionDetector::FindRuns(const uint64_t* pCurrent, const uint64_t* pReference, uint32_t Length, uint32_t Line)
+{
+    bool Indexed = false;
+    uint32_t Floor = 0;     // end of the last run, so runs never overlap
+
+    for (uint32_t i = 0; i < Length;)
+    {
+        if (!m_Damaged[i] || pCurrent[i] == pReference[i])
+        {
+            i++;
+            continue;
+        }
+
+        if (!Indexed)
+        {
+            BuildIndex(pReference, Length);
+            Indexed = true;
+        }
+
+        // Only a hash that occurs once in the reference pins down the shift; blank or repeated rows do not
+        uint32_t Source = Lookup(pCurrent[i]);
+        if (Source >= Duplicate)
+        {
+            i++;
+            continue;
+        }
+
+        int32_t Shift = static_cast<int32_t>(Source) - static_cast<int32_t>(i);
+
+        auto Matches = [&](uint32_t k)
+        {
+            int64_t Source = static_cast<int64_t>(k) + Shift;
+            return m_Damaged[k] && Source >= 0 && Source < Length && pCurrent[k] == pReference[Source];
+        };
+
+        uint32_t Begin = i;
+        while (Begin > Floor && Matches(Begin - 1))
+        {
+            Begin--;
+        }
+
+        uint32_t End = i + 1;
+        while (End < Length && Matches(End))
+        {
+            End++;
+        }
+
+        if (End - Begin >= m_MinRun)
+        {
+            m_Runs.push_back({ Line, Begin, End, Shift });
+            Floor = End;
+        }
+
+        i = End;
+    }
+}
+
+void MotionDetector::BuildIndex(const uint64_t* pReference, uint32_t Length)
+{
+    // Open addressing at a load factor of at most one half
+    uint32_t Size = 16;
+    while (Size < Length * 2)
+    {
+        Size *= 2;
+    }
+
+    m_Index.assign(Size, { 0, Empty });
+    m_IndexMask = Size - 1;
+
+    for (uint32_t i = 0; i < Length; i++)
+    {
+        for (uint32_t Slot = static_cast<uint32_t>(pReference[i]) & m_IndexMask;; Slot = (Slot + 1) & m_IndexMask)
+        {
+            IndexEntry& Entry = m_Index[Slot];
+            if (Entry.Line == Empty)
+            {
+                Entry = { pReference[i], i };
+                break;
+            }
+            if (Entry.Hash == pReference[i])
+            {
+                Entry.Line = Duplicate;
+                break;
+            }
+        }
+    }
+}
+
+uint32_t MotionDetector::Lookup(uint64_t Hash) const
+{
+    for (uint32_t Slot = static_cast<uint32_t>(Hash) & m_IndexMask;; Slot = (Slot + 1) & m_IndexMask)
+    {
+        const IndexEntry& Entry = m_Index[Slot];
+        if (Entry.Line == Empty || Entry.Hash == Hash)
+        {
+            return Entry.Line;
+        }
+    }
+}
+
+void MotionDetector::MergeRuns(bool Vertical, vector<MoveRect>& Moves)
+{
+    // Identical runs in neighbouring strips (or bands) are one wider move
+    sort(m_Runs.begin(), m_Runs.end(), [](const Run& A, const Run& B)
+    {
+        return tie(A.Begin, A.End, A.Shift, A.Line) < tie(B.Begin, B.End, B.Shift, B.Line);
+    });
+
+    for (size_t i = 0; i < m_Runs.size();)
+    {
+        const Run& First = m_Runs[i];
+        size_t Last = i;
+        while (Last + 1 < m_Runs.size() && m_Runs[Last + 1].Begin == First.Begin && m_Runs[Last + 1].End == First.End &&
+            m_Runs[Last + 1].Shift == First.Shift && m_Runs[Last + 1].Line == m_Runs[Last].Line + 1)
+        {
+            Last++;
+        }
+
+        int32_t Near = static_cast<int32_t>(First.Line * SegmentSize);
+        int32_t Far = static_cast<int32_t>((m_Runs[Last].Line + 1) * SegmentSize);
+        int32_t Begin = static_cast<int32_t>(First.Begin);
+        int32_t End = static_cast<int32_t>(First.End);
+
+        if (Vertical)
+        {
+            Moves.push_back({ Near, Begin + First.Shift, { Near, Begin, Far, End } });
+        }
+        else
+        {
+            Moves.push_back({ Begin + First.Shift, Near, { Begin, Near, End, Far } });
+        }
+
+        i = Last + 1;
+    }
+}
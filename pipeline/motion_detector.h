@@ -0,0 +1,114 @@
+/*++
+
+Module Name:
+
+    motion_detector.h
+
+Abstract:
+
+    This module contains the scroll and move detector. It keeps two hash signatures per frame: one hash per row of
+    every 64-pixel-wide strip, and one hash per column of every 64-pixel-tall band. A region that slid vertically
+    shows up as a run of row hashes that reappears in the previous frame at a constant offset; a horizontal slide
+    does the same with column hashes. Each long enough run becomes a move rectangle, so only the area the move
+    uncovered is left as damage.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "change_detector.h"
+#include "cpu_features.h"
+#include "frame.h"
+#include "region.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Finds vertical and horizontal shifts of frame content between the previous and the current frame.
+        /// </summary>
+        class MotionDetector
+        {
+        public:
+            // Width of a row hash strip and height of a column hash band; partial strips and bands are not searched
+            static const uint32_t SegmentSize = 64;
+
+            // MinRun is the shortest shift, in rows or columns, worth reporting as a move
+            explicit MotionDetector(uint32_t MinRun = 32, SimdLevel Level = DetectSimdLevel());
+
+            // Hashes a BGRA frame. With pChanged only the pixels it covers are hashed again and the rest is taken
+            // from the reference frame, which pChanged must then be relative to.
+            void Hash(const uint8_t* pData, uint32_t Pitch, uint32_t Width, uint32_t Height, const Region* pChanged = nullptr);
+
+            // Makes the frame hashed last the reference the next frame is compared with
+            void Commit();
+
+            // Forgets the reference frame
+            void Reset();
+            bool HasReference() const;
+
+            // Looks for content inside Damage that moved there from elsewhere in the reference frame and returns at
+            // most MaxMoves moves, largest first. Their destinations never overlap and lie inside the damage rows or
+            // columns they were found in.
+            void Search(const Region& Damage, size_t MaxMoves, std::vector<MoveRect>& Moves);
+
+        private:
+            struct Signature
+            {
+                uint32_t Width;
+                uint32_t Height;
+                bool Valid;
+                std::vector<uint64_t> Rows;     // strip s, row y at s * Height + y
+                std::vector<uint64_t> Columns;  // band b, column x at b * Width + x
+            };
+
+            // Where a reference hash occurs: the row or column, or one of the markers below
+            struct IndexEntry
+            {
+                uint64_t Hash;
+                uint32_t Line;
+            };
+
+            static const uint32_t Duplicate = 0xFFFFFFFE;
+            static const uint32_t Empty = 0xFFFFFFFF;
+
+            // A run of Begin..End rows (or columns) of strip (or band) Line that came from Shift further on
+            struct Run
+            {
+                uint32_t Line;
+                uint32_t Begin;
+                uint32_t End;
+                int32_t Shift;
+            };
+
+            void HashRows(const uint8_t* pData, uint32_t Pitch, uint32_t FirstStrip, uint32_t LastStrip, uint32_t Top, uint32_t Bottom);
+            void HashColumns(const uint8_t* pData, uint32_t Pitch, uint32_t Band, uint32_t Left, uint32_t Right);
+            void BuildIndex(const uint64_t* pReference, uint32_t Length);
+            uint32_t Lookup(uint64_t Hash) const;
+            void FindRuns(const uint64_t* pCurrent, const uint64_t* pReference, uint32_t Length, uint32_t Line);
+            void MergeRuns(bool Vertical, std::vector<MoveRect>& Moves);
+
+            const uint32_t m_MinRun;
+            const SimdLevel m_Level;
+
+            Signature m_Signatures[2];
+            uint32_t m_Current;                                 // the other one is the reference
+
+            std::vector<TileAccumulator> m_Accumulators;        // one row of strips in flight
+            std::vector<uint8_t> m_Damaged;                     // rows or columns of the line being searched
+            std::vector<IndexEntry> m_Index;                    // hash table of the reference hashes of that line
+            uint32_t m_IndexMask;
+            std::vector<Run> m_Runs;
+            std::vector<MoveRect> m_Found;
+        };
+    }
+}
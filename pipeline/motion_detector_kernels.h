@@ -0,0 +1,45 @@
+/*++
+
+Module Name:
+
+    motion_detector_kernels.h
+
+Abstract:
+
+    This module contains the column hash kernels behind MotionDetector. It is private to motion_detector*.cpp.
+
+    Every row of a band adds each of its pixels P into the running hash of that pixel's column. With a key R that
+    depends on the row's position inside the band:
+
+        Key = (P | P << 32) ^ R
+        Column += low32(Key) * high32(Key)
+
+    All tiers compute exactly this, so hashes are comparable no matter which tier produced them.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "cpu_features.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        // Adds one row of BGRA pixels into pColumns and returns how many pixels it handled; the caller finishes the
+        // remaining Width minus that many
+        typedef uint32_t (*ColumnHashKernel)(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns);
+
+#if IDD_X86
+        uint32_t AccumulateColumnsSse41(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns);
+        uint32_t AccumulateColumnsAvx2(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns);
+        uint32_t AccumulateColumnsAvx512(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns);
+#endif
+    }
+}
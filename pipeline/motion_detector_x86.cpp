@@ -0,0 +1,79 @@
+/*++
+
+Module Name:
+
+    motion_detector_x86.cpp
+
+Abstract:
+
+    This module contains the SSE4.1, AVX2 and AVX-512 column hash kernels. Each widens two, four or eight pixels to
+    64-bit lanes, one lane per column.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "motion_detector_kernels.h"
+
+#if IDD_X86
+
+#include <immintrin.h>
+
+using namespace Microsoft::IndirectDisp;
+
+IDD_TARGET_SSE41 uint32_t Microsoft::IndirectDisp::AccumulateColumnsSse41(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns)
+{
+    const __m128i Row = _mm_set1_epi64x(static_cast<long long>(RowKey));
+    uint32_t x = 0;
+
+    for (; x + 2 <= Width; x += 2)
+    {
+        __m128i Pixels = _mm_cvtepu32_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pRow + x * 4)));
+        __m128i Key = _mm_xor_si128(_mm_or_si128(Pixels, _mm_slli_epi64(Pixels, 32)), Row);
+        __m128i Product = _mm_mul_epu32(Key, _mm_srli_epi64(Key, 32));
+
+        __m128i* pSum = reinterpret_cast<__m128i*>(pColumns + x);
+        _mm_storeu_si128(pSum, _mm_add_epi64(_mm_loadu_si128(pSum), Product));
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX2 uint32_t Microsoft::IndirectDisp::AccumulateColumnsAvx2(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns)
+{
+    const __m256i Row = _mm256_set1_epi64x(static_cast<long long>(RowKey));
+    uint32_t x = 0;
+
+    for (; x + 4 <= Width; x += 4)
+    {
+        __m256i Pixels = _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow + x * 4)));
+        __m256i Key = _mm256_xor_si256(_mm256_or_si256(Pixels, _mm256_slli_epi64(Pixels, 32)), Row);
+        __m256i Product = _mm256_mul_epu32(Key, _mm256_srli_epi64(Key, 32));
+
+        __m256i* pSum = reinterpret_cast<__m256i*>(pColumns + x);
+        _mm256_storeu_si256(pSum, _mm256_add_epi64(_mm256_loadu_si256(pSum), Product));
+    }
+
+    return x;
+}
+
+IDD_TARGET_AVX512 uint32_t Microsoft::IndirectDisp::AccumulateColumnsAvx512(const uint8_t* pRow, uint32_t Width, uint64_t RowKey, uint64_t* pColumns)
+{
+    const __m512i Row = _mm512_set1_epi64(static_cast<long long>(RowKey));
+    uint32_t x = 0;
+
+    for (; x + 8 <= Width; x += 8)
+    {
+        __m512i Pixels = _mm512_cvtepu32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow + x * 4)));
+        __m512i Key = _mm512_xor_si512(_mm512_or_si512(Pixels, _mm512_slli_epi64(Pixels, 32)), Row);
+        __m512i Product = _mm512_mul_epu32(Key, _mm512_srli_epi64(Key, 32));
+
+        _mm512_storeu_si512(pColumns + x, _mm512_add_epi64(_mm512_loadu_si512(pColumns + x), Product));
+    }
+
+    return x;
+}
+
+#endif
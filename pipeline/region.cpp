@@ -0,0 +1,612 @@
+/*++
+
+Module Name:
+
+    region.cpp
+
+Abstract:
+
+    This module contains the banded region operations. The band sweep follows the classic X11 miRegionOp: bands
+    covered by only one operand are copied or skipped, rows covered by both are combined span by span, and every
+    new band is merged into the one above it when their spans match.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "region.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // First rectangle past the band that starts at pBand
+    const Rect* BandEnd(const Rect* pBand, const Rect* pEnd)
+    {
+        const Rect* p = pBand;
+        while (p != pEnd && p->Top == pBand->Top)
+        {
+            p++;
+        }
+        return p;
+    }
+
+    bool Overlaps(const Rect& A, const Rect& B)
+    {
+        return A.Left < B.Right && B.Left < A.Right && A.Top < B.Bottom && B.Top < A.Bottom;
+    }
+
+    bool Covers(const Rect& Outer, const Rect& Inner)
+    {
+        return Outer.Left <= Inner.Left && Outer.Top <= Inner.Top && Outer.Right >= Inner.Right && Outer.Bottom >= Inner.Bottom;
+    }
+}
+
+Region::Region()
+    : m_Extents(), m_Count(0), m_Capacity(InlineRects), m_pRects(m_Inline), m_SpareCapacity(0)
+{
+}
+
+Region::Region(const Rect& Area)
+    : Region()
+{
+    Reset(Area);
+}
+
+Region::Region(const Region& Other)
+    : Region()
+{
+    *this = Other;
+}
+
+Region::Region(Region&& Other)
+    : Region()
+{
+    *this = move(Other);
+}
+
+Region& Region::operator=(const Region& Other)
+{
+    if (this != &Other)
+    {
+        m_Count = 0;
+        Reserve(Other.m_Count);
+        copy(Other.begin(), Other.end(), m_pRects);
+        m_Count = Other.m_Count;
+        m_Extents = Other.m_Extents;
+    }
+    return *this;
+}
+
+Region& Region::operator=(Region&& Other)
+{
+    if (this == &Other)
+    {
+        return *this;
+    }
+
+    if (!Other.OnHeap())
+    {
+        return *this = static_cast<const Region&>(Other);
+    }
+
+    // Take over the other region's heap block and leave it empty
+    m_Heap = move(Other.m_Heap);
+    m_pRects = m_Heap.get();
+    m_Capacity = Other.m_Capacity;
+    m_Count = Other.m_Count;
+    m_Extents = Other.m_Extents;
+
+    Other.m_pRects = Other.m_Inline;
+    Other.m_Capacity = InlineRects;
+    Other.Clear();
+    return *this;
+}
+
+int64_t Region::Area() const
+{
+    int64_t Total = 0;
+    for (const Rect& Area : *this)
+    {
+        Total += Area.Area();
+    }
+    return Total;
+}
+
+bool Region::Contains(int32_t X, int32_t Y) const
+{
+    if (X < m_Extents.Left || X >= m_Extents.Right || Y < m_Extents.Top || Y >= m_Extents.Bottom)
+    {
+        return false;
+    }
+
+    for (const Rect& Area : *this)
+    {
+        if (Area.Top > Y)
+        {
+            // Bands are sorted, so nothing further down can contain the point
+            break;
+        }
+        if (Y < Area.Bottom && X >= Area.Left && X < Area.Right)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Region::Clear()
+{
+    m_Count = 0;
+    m_Extents = {};
+}
+
+void Region::Reset(const Rect& Area)
+{
+    // Area may be this region's own extents or one of its rectangles
+    Rect Single = Area;
+    Clear();
+    if (!Single.Empty())
+    {
+        m_pRects[0] = Single;
+        m_Count = 1;
+        m_Extents = Single;
+    }
+}
+
+void Region::Union(const Region& Other)
+{
+    if (Other.Empty() || this == &Other)
+    {
+        return;
+    }
+
+    if (Empty() || (Other.m_Count == 1 && Covers(Other.m_Extents, m_Extents)))
+    {
+        *this = Other;
+        return;
+    }
+
+    if (m_Count == 1 && Covers(m_Extents, Other.m_Extents))
+    {
+        return;
+    }
+
+    Combine(Other, true, true, UnionBand);
+}
+
+void Region::Union(const Rect& Area)
+{
+    if (!Area.Empty())
+    {
+        Union(Region(Area));
+    }
+}
+
+void Region::Union(const Rect* pRects, size_t Count)
+{
+    if (Count <= 2)
+    {
+        for (size_t i = 0; i < Count; i++)
+        {
+            Union(pRects[i]);
+        }
+        return;
+    }
+
+    // Merge halves so each rectangle takes part in O(log Count) sweeps rather than Count of them
+    Region Half;
+    Half.Union(pRects, Count / 2);
+    Region Rest;
+    Rest.Union(pRects + Count / 2, Count - Count / 2);
+    Half.Union(Rest);
+    Union(Half);
+}
+
+void Region::Intersect(const Region& Other)
+{
+    if (this == &Other)
+    {
+        return;
+    }
+
+    if (Empty() || Other.Empty() || !Overlaps(m_Extents, Other.m_Extents))
+    {
+        Clear();
+        return;
+    }
+
+    if (Other.m_Count == 1 && Covers(Other.m_Extents, m_Extents))
+    {
+        return;
+    }
+
+    if (m_Count == 1 && Covers(m_Extents, Other.m_Extents))
+    {
+        *this = Other;
+        return;
+    }
+
+    Combine(Other, false, false, IntersectBand);
+}
+
+void Region::Intersect(const Rect& Area)
+{
+    Intersect(Region(Area));
+}
+
+void Region::Subtract(const Region& Other)
+{
+    if (this == &Other)
+    {
+        Clear();
+        return;
+    }
+
+    if (Empty() || Other.Empty() || !Overlaps(m_Extents, Other.m_Extents))
+    {
+        return;
+    }
+
+    Combine(Other, true, false, SubtractBand);
+}
+
+void Region::Subtract(const Rect& Area)
+{
+    if (!Area.Empty())
+    {
+        Subtract(Region(Area));
+    }
+}
+
+void Region::Translate(int32_t DeltaX, int32_t DeltaY)
+{
+    if (Empty())
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < m_Count; i++)
+    {
+        m_pRects[i] = { m_pRects[i].Left + DeltaX, m_pRects[i].Top + DeltaY, m_pRects[i].Right + DeltaX, m_pRects[i].Bottom + DeltaY };
+    }
+    m_Extents = { m_Extents.Left + DeltaX, m_Extents.Top + DeltaY, m_Extents.Right + DeltaX, m_Extents.Bottom + DeltaY };
+}
+
+bool Region::operator==(const Region& Other) const
+{
+    return m_Count == Other.m_Count && equal(begin(), end(), Other.begin());
+}
+
+void Region::UnionBand(Region& Out, const Rect* pA, const Rect* pAEnd, const Rect* pB, const Rect* pBEnd, int32_t Top, int32_t Bottom)
+{
+    // Walk both span lists in order of Left, extending the current span while the next one overlaps or touches it
+    int32_t Left = 0;
+    int32_t Right = 0;
+    bool Open = false;
+
+    while (pA != pAEnd || pB != pBEnd)
+    {
+        const Rect* pNext = (pB == pBEnd || (pA != pAEnd && pA->Left < pB->Left)) ? pA++ : pB++;
+
+        if (Open && pNext->Left <= Right)
+        {
+            Right = max(Right, pNext->Right);
+            continue;
+        }
+
+        if (Open)
+        {
+            Out.Append(Left, Right, Top, Bottom);
+        }
+        Left = pNext->Left;
+        Right = pNext->Right;
+        Open = true;
+    }
+
+    if (Open)
+    {
+        Out.Append(Left, Right, Top, Bottom);
+    }
+}
+
+void Region::IntersectBand(Region& Out, const Rect* pA, const Rect* pAEnd, const Rect* pB, const Rect* pBEnd, int32_t Top, int32_t Bottom)
+{
+    while (pA != pAEnd && pB != pBEnd)
+    {
+        int32_t Left = max(pA->Left, pB->Left);
+        int32_t Right = min(pA->Right, pB->Right);
+        if (Left < Right)
+        {
+            Out.Append(Left, Right, Top, Bottom);
+        }
+
+        // Advance whichever span ends first; both when they end together
+        int32_t End = Right;
+        if (pA->Right == End)
+        {
+            pA++;
+        }
+        if (pB->Right == End)
+        {
+            pB++;
+        }
+    }
+}
+
+void Region::SubtractBand(Region& Out, const Rect* pA, const Rect* pAEnd, const Rect* pB, const Rect* pBEnd, int32_t Top, int32_t Bottom)
+{
+    // Left is where the part of *pA not yet subtracted from starts
+    int32_t Left = pA->Left;
+
+    while (pA != pAEnd && pB != pBEnd)
+    {
+        if (pB->Right <= Left)
+        {
+            // B ends before what is left of A
+            pB++;
+        }
+        else if (pB->Left <= Left)
+        {
+            // B covers the start of what is left of A
+            Left = pB->Right;
+            if (Left >= pA->Right)
+            {
+                if (++pA != pAEnd)
+                {
+                    Left = pA->Left;
+                }
+            }
+            else
+            {
+                pB++;
+            }
+        }
+        else if (pB->Left < pA->Right)
+        {
+            // B cuts a piece out of A
+            Out.Append(Left, pB->Left, Top, Bottom);
+            Left = pB->Right;
+            if (Left >= pA->Right)
+            {
+                if (++pA != pAEnd)
+                {
+                    Left = pA->Left;
+                }
+            }
+            else
+            {
+                pB++;
+            }
+        }
+        else
+        {
+            // B starts after A ends
+            Out.Append(Left, pA->Right, Top, Bottom);
+            if (++pA != pAEnd)
+            {
+                Left = pA->Left;
+            }
+        }
+    }
+
+    while (pA != pAEnd)
+    {
+        Out.Append(Left, pA->Right, Top, Bottom);
+        if (++pA != pAEnd)
+        {
+            Left = pA->Left;
+        }
+    }
+}
+
+void Region::Combine(const Region& Other, bool KeepA, bool KeepB, BandOperation Operation)
+{
+    // Build the result in the block left over from the previous operation, if any
+    Region Result;
+    if (m_Spare)
+    {
+        Result.m_Heap = move(m_Spare);
+        Result.m_pRects = Result.m_Heap.get();
+        Result.m_Capacity = m_SpareCapacity;
+    }
+
+    Result.Sweep(*this, Other, KeepA, KeepB, Operation);
+
+    // Then keep this region's block as the spare for the next one
+    if (OnHeap())
+    {
+        m_Spare = move(m_Heap);
+        m_SpareCapacity = m_Capacity;
+        m_pRects = m_Inline;
+        m_Capacity = InlineRects;
+    }
+
+    *this = move(Result);
+}
+
+void Region::Sweep(const Region& A, const Region& B, bool KeepA, bool KeepB, BandOperation Operation)
+{
+
+    const Rect* pA = A.begin();
+    const Rect* pB = B.begin();
+    int32_t YBottom = min(pA->Top, pB->Top);
+    uint32_t PreviousBand = 0;
+
+    while (pA != A.end() && pB != B.end())
+    {
+        const Rect* pABandEnd = BandEnd(pA, A.end());
+        const Rect* pBBandEnd = BandEnd(pB, B.end());
+        int32_t YTop;
+
+        // Rows only one operand covers, from the bottom of the last band handled to the top of the other operand
+        if (pA->Top < pB->Top)
+        {
+            if (KeepA)
+            {
+                int32_t Top = max(pA->Top, YBottom);
+                int32_t Bottom = min(pA->Bottom, pB->Top);
+                if (Top < Bottom)
+                {
+                    uint32_t CurrentBand = m_Count;
+                    AppendBand(pA, pABandEnd, Top, Bottom);
+                    PreviousBand = CoalesceBands(PreviousBand, CurrentBand);
+                }
+            }
+            YTop = pB->Top;
+        }
+        else if (pB->Top < pA->Top)
+        {
+            if (KeepB)
+            {
+                int32_t Top = max(pB->Top, YBottom);
+                int32_t Bottom = min(pB->Bottom, pA->Top);
+                if (Top < Bottom)
+                {
+                    uint32_t CurrentBand = m_Count;
+                    AppendBand(pB, pBBandEnd, Top, Bottom);
+                    PreviousBand = CoalesceBands(PreviousBand, CurrentBand);
+                }
+            }
+            YTop = pA->Top;
+        }
+        else
+        {
+            YTop = pA->Top;
+        }
+
+        // Rows both operands cover
+        YBottom = min(pA->Bottom, pB->Bottom);
+        if (YBottom > YTop)
+        {
+            uint32_t CurrentBand = m_Count;
+            Operation(*this, pA, pABandEnd, pB, pBBandEnd, YTop, YBottom);
+            PreviousBand = CoalesceBands(PreviousBand, CurrentBand);
+        }
+
+        if (pA->Bottom == YBottom)
+        {
+            pA = pABandEnd;
+        }
+        if (pB->Bottom == YBottom)
+        {
+            pB = pBBandEnd;
+        }
+    }
+
+    // Whatever is left of one operand lies below the other entirely
+    const Rect* pRest = nullptr;
+    const Rect* pRestEnd = nullptr;
+    if (pA != A.end() && KeepA)
+    {
+        pRest = pA;
+        pRestEnd = A.end();
+    }
+    else if (pB != B.end() && KeepB)
+    {
+        pRest = pB;
+        pRestEnd = B.end();
+    }
+
+    if (pRest)
+    {
+        const Rect* pBandEnd = BandEnd(pRest, pRestEnd);
+        uint32_t CurrentBand = m_Count;
+        AppendBand(pRest, pBandEnd, max(pRest->Top, YBottom), pRest->Bottom);
+        CoalesceBands(PreviousBand, CurrentBand);
+
+        Reserve(m_Count + static_cast<uint32_t>(pRestEnd - pBandEnd));
+        copy(pBandEnd, pRestEnd, m_pRects + m_Count);
+        m_Count += static_cast<uint32_t>(pRestEnd - pBandEnd);
+    }
+
+    UpdateExtents();
+}
+
+void Region::AppendBand(const Rect* pBegin, const Rect* pEnd, int32_t Top, int32_t Bottom)
+{
+    for (const Rect* p = pBegin; p != pEnd; p++)
+    {
+        Append(p->Left, p->Right, Top, Bottom);
+    }
+}
+
+void Region::Append(int32_t Left, int32_t Right, int32_t Top, int32_t Bottom)
+{
+    if (m_Count == m_Capacity)
+    {
+        Reserve(m_Count + 1);
+    }
+    m_pRects[m_Count++] = { Left, Top, Right, Bottom };
+}
+
+uint32_t Region::CoalesceBands(uint32_t PreviousBand, uint32_t CurrentBand)
+{
+    // Merges the band starting at CurrentBand into the one above it if they touch and have the same spans. Returns
+    // where the last band now starts.
+    uint32_t Count = m_Count - CurrentBand;
+    if (Count == 0 || CurrentBand - PreviousBand != Count)
+    {
+        return CurrentBand;
+    }
+
+    const Rect* pPrevious = m_pRects + PreviousBand;
+    const Rect* pCurrent = m_pRects + CurrentBand;
+    if (pPrevious->Bottom != pCurrent->Top)
+    {
+        return CurrentBand;
+    }
+
+    for (uint32_t i = 0; i < Count; i++)
+    {
+        if (pPrevious[i].Left != pCurrent[i].Left || pPrevious[i].Right != pCurrent[i].Right)
+        {
+            return CurrentBand;
+        }
+    }
+
+    int32_t Bottom = pCurrent->Bottom;
+    for (uint32_t i = 0; i < Count; i++)
+    {
+        m_pRects[PreviousBand + i].Bottom = Bottom;
+    }
+    m_Count = CurrentBand;
+    return PreviousBand;
+}
+
+void Region::UpdateExtents()
+{
+    if (m_Count == 0)
+    {
+        m_Extents = {};
+        return;
+    }
+
+    m_Extents = { m_pRects[0].Left, m_pRects[0].Top, m_pRects[0].Right, m_pRects[m_Count - 1].Bottom };
+    for (const Rect& Area : *this)
+    {
+        m_Extents.Left = min(m_Extents.Left, Area.Left);
+        m_Extents.Right = max(m_Extents.Right, Area.Right);
+    }
+}
+
+void Region::Reserve(uint32_t Capacity)
+{
+    if (Capacity <= m_Capacity)
+    {
+        return;
+    }
+
+    uint32_t NewCapacity = max(Capacity, m_Capacity * 2);
+    unique_ptr<Rect[]> Heap(new Rect[NewCapacity]);
+    copy(begin(), end(), Heap.get());
+
+    m_Heap = move(Heap);
+    m_pRects = m_Heap.get();
+    m_Capacity = NewCapacity;
+}
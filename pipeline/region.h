@@ -0,0 +1,109 @@
+/*++
+
+Module Name:
+
+    region.h
+
+Abstract:
+
+    This module contains a banded rectangle region in the style of X11 and pixman regions. A region is kept as
+    non-overlapping rectangles sorted top to bottom, then left to right. Rectangles with the same Top and Bottom form
+    a band. Spans in a band never touch, and two touching bands never have identical spans, so every set of pixels
+    has exactly one representation. Union, intersection and subtraction sweep the bands of both operands once, in
+    time linear in their rectangle counts. The rectangles are stored inline up to InlineRects, so typical damage
+    regions never allocate.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "frame.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// A set of pixels stored as the minimal banded list of non-overlapping rectangles.
+        /// </summary>
+        class Region
+        {
+        public:
+            static const uint32_t InlineRects = 32;
+
+            Region();
+            explicit Region(const Rect& Area);
+            Region(const Region& Other);
+            Region(Region&& Other);
+            Region& operator=(const Region& Other);
+            Region& operator=(Region&& Other);
+
+            bool Empty() const { return m_Count == 0; }
+            uint32_t RectCount() const { return m_Count; }
+            int64_t Area() const;
+
+            // Bounding box of the region; all zero when the region is empty
+            const Rect& Extents() const { return m_Extents; }
+
+            // Iterates over the rectangles in band order
+            const Rect* begin() const { return m_pRects; }
+            const Rect* end() const { return m_pRects + m_Count; }
+
+            bool Contains(int32_t X, int32_t Y) const;
+
+            // True once the rectangles no longer fit in the inline storage
+            bool OnHeap() const { return m_pRects != m_Inline; }
+
+            void Clear();
+            void Reset(const Rect& Area);
+
+            void Union(const Region& Other);
+            void Union(const Rect& Area);
+            void Union(const Rect* pRects, size_t Count);
+            void Intersect(const Region& Other);
+            void Intersect(const Rect& Area);
+            void Subtract(const Region& Other);
+            void Subtract(const Rect& Area);
+
+            void Translate(int32_t DeltaX, int32_t DeltaY);
+
+            // The representation is canonical, so equal pixel sets compare equal
+            bool operator==(const Region& Other) const;
+            bool operator!=(const Region& Other) const { return !(*this == Other); }
+
+        private:
+            // Emits the spans of one output band from the overlapping bands [pA, pAEnd) and [pB, pBEnd)
+            typedef void (*BandOperation)(Region& Out, const Rect* pA, const Rect* pAEnd, const Rect* pB, const Rect* pBEnd, int32_t Top, int32_t Bottom);
+
+            static void UnionBand(Region& Out, const Rect* pA, const Rect* pAEnd, const Rect* pB, const Rect* pBEnd, int32_t Top, int32_t Bottom);
+            static void IntersectBand(Region& Out, const Rect* pA, const Rect* pAEnd, const Rect* pB, const Rect* pBEnd, int32_t Top, int32_t Bottom);
+            static void SubtractBand(Region& Out, const Rect* pA, const Rect* pAEnd, const Rect* pB, const Rect* pBEnd, int32_t Top, int32_t Bottom);
+
+            // Replaces this region with the result of Operation applied to it and Other
+            void Combine(const Region& Other, bool KeepA, bool KeepB, BandOperation Operation);
+            void Sweep(const Region& A, const Region& B, bool KeepA, bool KeepB, BandOperation Operation);
+            void AppendBand(const Rect* pBegin, const Rect* pEnd, int32_t Top, int32_t Bottom);
+            void Append(int32_t Left, int32_t Right, int32_t Top, int32_t Bottom);
+            uint32_t CoalesceBands(uint32_t PreviousBand, uint32_t CurrentBand);
+            void UpdateExtents();
+            void Reserve(uint32_t Capacity);
+
+            Rect m_Extents;
+            uint32_t m_Count;
+            uint32_t m_Capacity;
+            Rect* m_pRects;                     // m_Inline, or m_Heap once the region outgrew it
+            std::unique_ptr<Rect[]> m_Heap;
+            std::unique_ptr<Rect[]> m_Spare;    // the heap block of the previous result, reused by the next one
+            uint32_t m_SpareCapacity;
+            Rect m_Inline[InlineRects];
+        };
+    }
+}
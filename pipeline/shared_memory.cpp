@@ -0,0 +1,266 @@
+/*++
+
+Module Name:
+
+    shared_memory.cpp
+
+Abstract:
+
+    This module contains the named shared-memory region.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "shared_memory.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <aclapi.h>
+#include <sddl.h>
+#include <vector>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+#ifdef _WIN32
+    // System and administrators may do anything, the creator (the driver's LocalService host) too, and any
+    // logged-on user may read, or read and write
+    const char* const RegionSecurity = "D:P(A;;GA;;;SY)(A;;GA;;;BA)(A;;GA;;;OW)(A;;GR;;;AU)";
+    const char* const SharedRegionSecurity = "D:P(A;;GA;;;SY)(A;;GA;;;BA)(A;;GA;;;OW)(A;;GRGW;;;AU)";
+
+    // Whether the owner of an existing section is the one this process gives the objects it creates, i.e. whether
+    // an earlier instance of this process created it rather than someone squatting on the name
+    bool OwnedByThisAccount(HANDLE hMapping)
+    {
+        PSID pOwner = nullptr;
+        PSECURITY_DESCRIPTOR pDescriptor = nullptr;
+        if (GetSecurityInfo(hMapping, SE_KERNEL_OBJECT, OWNER_SECURITY_INFORMATION, &pOwner, nullptr, nullptr, nullptr,
+            &pDescriptor) != ERROR_SUCCESS)
+        {
+            return false;
+        }
+
+        bool Owned = false;
+        HANDLE hToken;
+        if (OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &hToken))
+        {
+            DWORD Size = 0;
+            GetTokenInformation(hToken, TokenOwner, nullptr, 0, &Size);
+            vector<uint8_t> Owner(Size);
+            if (Size != 0 && GetTokenInformation(hToken, TokenOwner, Owner.data(), Size, &Size))
+            {
+                Owned = EqualSid(pOwner, reinterpret_cast<TOKEN_OWNER*>(Owner.data())->Owner) != FALSE;
+            }
+            CloseHandle(hToken);
+        }
+
+        LocalFree(pDescriptor);
+        return Owned;
+    }
+#else
+    // POSIX names are a single component starting with a slash
+    string PosixName(const char* Name)
+    {
+        string Result = "/";
+        for (const char* p = Name; *p; p++)
+        {
+            Result += (*p == '/' || *p == '\\') ? '_' : *p;
+        }
+        return Result;
+    }
+#endif
+}
+
+SharedMemory::SharedMemory()
+    : m_pData(nullptr), m_Size(0), m_Owner(false), m_Reclaimed(false)
+#ifdef _WIN32
+    , m_hMapping(nullptr)
+#endif
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+
+bool SharedMemory::Create(const char* Name, size_t Size, bool SharedWrite)
+{
+    Close();
+
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES Attributes = { sizeof(Attributes), nullptr, FALSE };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorA(SharedWrite ? SharedRegionSecurity : RegionSecurity, SDDL_REVISION_1, &Attributes.lpSecurityDescriptor, nullptr))
+    {
+        return false;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, &Attributes, PAGE_READWRITE,
+        static_cast<DWORD>(static_cast<uint64_t>(Size) >> 32), static_cast<DWORD>(Size), Name);
+    DWORD Error = GetLastError();
+    LocalFree(Attributes.lpSecurityDescriptor);
+
+    // An existing section keeps its size and security, so mapping Size bytes of it fails if it is too small
+    bool Reclaimed = hMapping && Error == ERROR_ALREADY_EXISTS;
+    if (!hMapping || (Reclaimed && !OwnedByThisAccount(hMapping)))
+    {
+        if (hMapping)
+        {
+            CloseHandle(hMapping);
+        }
+        return false;
+    }
+
+    void* pData = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, Size);
+    if (!pData)
+    {
+        CloseHandle(hMapping);
+        return false;
+    }
+
+    m_hMapping = hMapping;
+#else
+    string Posix = PosixName(Name);
+    bool Reclaimed = false;
+    int File = shm_open(Posix.c_str(), O_RDWR | O_CREAT | O_EXCL, SharedWrite ? 0666 : 0644);
+    if (File < 0 && errno == EEXIST)
+    {
+        // Left behind by a creator that never closed it, e.g. because it crashed
+        struct stat Status;
+        File = shm_open(Posix.c_str(), O_RDWR, 0);
+        if (File >= 0 && (fstat(File, &Status) != 0 || Status.st_uid != geteuid() || static_cast<size_t>(Status.st_size) < Size))
+        {
+            close(File);
+            return false;
+        }
+        Reclaimed = true;
+    }
+    if (File < 0)
+    {
+        return false;
+    }
+
+    // The mode passed to shm_open is subject to the umask
+    if (!Reclaimed && ((SharedWrite && fchmod(File, 0666) != 0) || ftruncate(File, static_cast<off_t>(Size)) != 0))
+    {
+        close(File);
+        shm_unlink(Posix.c_str());
+        return false;
+    }
+
+    void* pData = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+    close(File);
+    if (pData == MAP_FAILED)
+    {
+        if (!Reclaimed)
+        {
+            shm_unlink(Posix.c_str());
+        }
+        return false;
+    }
+
+    m_Name = Posix;
+#endif
+
+    m_pData = pData;
+    m_Size = Size;
+    m_Owner = true;
+    m_Reclaimed = Reclaimed;
+    return true;
+}
+
+bool SharedMemory::Open(const char* Name, bool Writable)
+{
+    Close();
+
+#ifdef _WIN32
+    DWORD Access = Writable ? FILE_MAP_READ | FILE_MAP_WRITE : FILE_MAP_READ;
+    HANDLE hMapping = OpenFileMappingA(Access, FALSE, Name);
+    if (!hMapping)
+    {
+        return false;
+    }
+
+    void* pData = MapViewOfFile(hMapping, Access, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION Information;
+    if (!pData || VirtualQuery(pData, &Information, sizeof(Information)) == 0)
+    {
+        if (pData)
+        {
+            UnmapViewOfFile(pData);
+        }
+        CloseHandle(hMapping);
+        return false;
+    }
+
+    m_hMapping = hMapping;
+    m_Size = Information.RegionSize;
+#else
+    int File = shm_open(PosixName(Name).c_str(), Writable ? O_RDWR : O_RDONLY, 0);
+    if (File < 0)
+    {
+        return false;
+    }
+
+    struct stat Status;
+    if (fstat(File, &Status) != 0 || Status.st_size <= 0)
+    {
+        close(File);
+        return false;
+    }
+
+    void* pData = mmap(nullptr, static_cast<size_t>(Status.st_size), Writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, File, 0);
+    close(File);
+    if (pData == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_Size = static_cast<size_t>(Status.st_size);
+#endif
+
+    m_pData = pData;
+    m_Owner = false;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (!m_pData)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_pData);
+    CloseHandle(m_hMapping);
+    m_hMapping = nullptr;
+#else
+    munmap(m_pData, m_Size);
+    if (m_Owner)
+    {
+        shm_unlink(m_Name.c_str());
+    }
+#endif
+
+    m_pData = nullptr;
+    m_Size = 0;
+    m_Owner = false;
+    m_Reclaimed = false;
+    m_Name.clear();
+}
@@ -0,0 +1,73 @@
+/*++
+
+Module Name:
+
+    shared_memory.h
+
+Abstract:
+
+    This module contains a named shared-memory region: a file mapping on Windows, POSIX shared memory elsewhere.
+    The driver creates regions that user-mode tools map by name.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// A mapping of a named shared-memory region, unmapped on destruction. The region itself goes away with
+        /// the last mapping on Windows, and when its creator closes it elsewhere.
+        /// </summary>
+        class SharedMemory
+        {
+        public:
+            SharedMemory();
+            ~SharedMemory();
+
+            SharedMemory(const SharedMemory&) = delete;
+            SharedMemory& operator=(const SharedMemory&) = delete;
+
+            // Creates the region zero-filled. On Windows a name may carry the "Global\" prefix; anyone may map the
+            // region for reading, but only its creator and administrators for writing, unless SharedWrite lets every
+            // logged-on user write too.
+            //
+            // A region outlives its creator while readers map it, e.g. across a restart of the driver. If one of
+            // that name exists already, is owned by the account this process runs as and holds at least Size bytes,
+            // it is taken over as it is, with whatever its last creator left in it; otherwise Create fails.
+            bool Create(const char* Name, size_t Size, bool SharedWrite = false);
+
+            // Whether Create took over an existing region rather than creating a zero-filled one
+            bool Reclaimed() const { return m_Reclaimed; }
+
+            // Maps an existing region in full
+            bool Open(const char* Name, bool Writable = false);
+
+            void Close();
+
+            bool IsOpen() const { return m_pData != nullptr; }
+            void* Data() const { return m_pData; }
+            size_t Size() const { return m_Size; }
+
+        private:
+            void* m_pData;
+            size_t m_Size;
+            bool m_Owner;
+            bool m_Reclaimed;
+            std::string m_Name;
+#ifdef _WIN32
+            void* m_hMapping;
+#endif
+        };
+    }
+}
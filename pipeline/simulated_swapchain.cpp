@@ -0,0 +1,226 @@
+/*++
+
+Module Name:
+
+    simulated_swapchain.cpp
+
+Abstract:
+
+    This module contains a software stand-in for an IddCx swap-chain.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "simulated_swapchain.h"
+
+#include <chrono>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const int32_t MarkerSize = 64;
+
+    // A desktop-like background: a soft gradient with a title bar and a block of pseudo-text
+    uint32_t BackgroundPixel(uint32_t X, uint32_t Y, uint32_t Width, uint32_t Height)
+    {
+        if (Y < 32)
+        {
+            return 0xFF2B579Au;
+        }
+
+        if (X > Width / 8 && X < Width / 2 && Y > Height / 8 && Y < Height / 2 && (Y % 20) < 14)
+        {
+            uint32_t Hash = (X / 3) * 2654435761u ^ (Y / 2) * 40503u;
+            return ((Hash >> 13) & 3) ? 0xFFFFFFFFu : 0xFF202020u;
+        }
+
+        uint32_t B = 0x60 + (X * 0x60) / Width;
+        uint32_t G = 0x40 + (Y * 0x40) / Height;
+        return 0xFF000000u | (0x30u << 16) | (G << 8) | B;
+    }
+}
+
+SimulatedSwapChain::SimulatedSwapChain(uint32_t Width, uint32_t Height, double FramesPerSecond, uint64_t FrameLimit)
+    : m_Width(Width)
+    , m_Height(Height)
+    , m_Pitch(Width * 4)
+    , m_FramePeriod(FramesPerSecond > 0 ? static_cast<uint64_t>(1e9 / FramesPerSecond) : 0)
+    , m_FrameLimit(FrameLimit)
+    , m_StartTime(0)
+    , m_FramesProduced(0)
+    , m_CurrentBuffer(0)
+    , m_Terminate(false)
+{
+    // Render the initial content up front so it is not charged to the pipeline being measured
+    for (auto& Surface : m_Surfaces)
+    {
+        Surface.Pixels.resize(static_cast<size_t>(m_Pitch) * m_Height);
+        DrawBackground(Surface);
+    }
+}
+
+void SimulatedSwapChain::Terminate()
+{
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Terminate = true;
+    }
+    m_Wake.notify_all();
+}
+
+bool SimulatedSwapChain::Initialize()
+{
+    m_StartTime = MonotonicNanoseconds();
+    return true;
+}
+
+AcquireStatus SimulatedSwapChain::ReleaseAndAcquire(Frame& Frame)
+{
+    if (m_Terminate)
+    {
+        return AcquireStatus::Failed;
+    }
+
+    if (m_FrameLimit != 0 && m_FramesProduced >= m_FrameLimit)
+    {
+        // Behave like an abandoned swap-chain once the requested number of frames has been produced
+        return AcquireStatus::Failed;
+    }
+
+    uint64_t Due = DueTime(m_FramesProduced);
+    if (MonotonicNanoseconds() < Due)
+    {
+        return AcquireStatus::Pending;
+    }
+
+    // Rotate to the next buffer and update only the region that changed since that buffer was last presented
+    m_CurrentBuffer = (m_CurrentBuffer + 1) % BufferCount;
+    Surface& Surface = m_Surfaces[m_CurrentBuffer];
+    DrawMarker(Surface, m_FramesProduced);
+
+    Frame.FrameNumber = m_FramesProduced;
+    Frame.PresentTime = (m_FramePeriod != 0) ? Due : MonotonicNanoseconds();
+    Frame.Width = m_Width;
+    Frame.Height = m_Height;
+    Frame.Pitch = m_Pitch;
+    Frame.Format = PixelFormat::Bgra8;
+    Frame.pData = Surface.Pixels.data();
+    Frame.pSurface = &Surface;
+
+    // Only the marker moved since the previous frame: it left one cell and entered another
+    m_Damage.Reset(m_FramesProduced == 0 ? DamageState::Full : DamageState::Partial);
+    if (m_FramesProduced != 0)
+    {
+        m_Damage.AddDirtyRect(MarkerRect(m_FramesProduced - 1));
+        m_Damage.AddDirtyRect(MarkerRect(m_FramesProduced));
+        m_Damage.Normalize(m_Width, m_Height);
+    }
+    m_Damage.Publish(Frame);
+
+    m_FramesProduced++;
+    return AcquireStatus::Acquired;
+}
+
+WaitStatus SimulatedSwapChain::WaitForFrame(uint32_t TimeoutMs)
+{
+    uint64_t Now = MonotonicNanoseconds();
+    uint64_t Due = DueTime(m_FramesProduced);
+    uint64_t Deadline = Now + static_cast<uint64_t>(TimeoutMs) * 1000000;
+    bool TimedOut = Deadline < Due;
+    if (!TimedOut)
+    {
+        Deadline = Due;
+    }
+
+    unique_lock<mutex> Lock(m_Lock);
+    m_Wake.wait_for(Lock, chrono::nanoseconds(Deadline > Now ? Deadline - Now : 0), [this] { return m_Terminate.load(); });
+
+    if (m_Terminate)
+    {
+        return WaitStatus::Terminate;
+    }
+
+    return TimedOut ? WaitStatus::Timeout : WaitStatus::NewFrame;
+}
+
+bool SimulatedSwapChain::FinishedProcessing()
+{
+    // Buffers are only rewritten when they come around again, so there is nothing to release
+    return true;
+}
+
+uint64_t SimulatedSwapChain::DueTime(uint64_t FrameIndex) const
+{
+    return m_StartTime + FrameIndex * m_FramePeriod;
+}
+
+void SimulatedSwapChain::DrawBackground(Surface& Surface)
+{
+    for (uint32_t Y = 0; Y < m_Height; Y++)
+    {
+        uint32_t* pRow = reinterpret_cast<uint32_t*>(Surface.Pixels.data() + static_cast<size_t>(Y) * m_Pitch);
+        for (uint32_t X = 0; X < m_Width; X++)
+        {
+            pRow[X] = BackgroundPixel(X, Y, m_Width, m_Height);
+        }
+    }
+
+    Surface.MarkerX = -1;
+    Surface.MarkerY = -1;
+}
+
+void SimulatedSwapChain::DrawMarker(Surface& Surface, uint64_t FrameIndex)
+{
+    Rect Marker = MarkerRect(FrameIndex);
+    if (Marker.Empty())
+    {
+        return;
+    }
+
+    // Erase the marker this buffer showed the last time it was presented
+    if (Surface.MarkerX >= 0)
+    {
+        for (int32_t Y = Surface.MarkerY; Y < Surface.MarkerY + MarkerSize; Y++)
+        {
+            uint32_t* pRow = reinterpret_cast<uint32_t*>(Surface.Pixels.data() + static_cast<size_t>(Y) * m_Pitch);
+            for (int32_t X = Surface.MarkerX; X < Surface.MarkerX + MarkerSize; X++)
+            {
+                pRow[X] = BackgroundPixel(X, Y, m_Width, m_Height);
+            }
+        }
+    }
+
+    Surface.MarkerX = Marker.Left;
+    Surface.MarkerY = Marker.Top;
+
+    uint32_t Color = 0xFF000000u | static_cast<uint32_t>(FrameIndex * 0x9E3779B9u >> 8);
+    for (int32_t Y = Marker.Top; Y < Marker.Bottom; Y++)
+    {
+        uint32_t* pRow = reinterpret_cast<uint32_t*>(Surface.Pixels.data() + static_cast<size_t>(Y) * m_Pitch);
+        for (int32_t X = Marker.Left; X < Marker.Right; X++)
+        {
+            pRow[X] = Color;
+        }
+    }
+}
+
+Rect SimulatedSwapChain::MarkerRect(uint64_t FrameIndex) const
+{
+    int32_t Columns = static_cast<int32_t>(m_Width) / MarkerSize;
+    int32_t Rows = static_cast<int32_t>(m_Height) / MarkerSize;
+    if (Columns == 0 || Rows == 0)
+    {
+        return {};
+    }
+
+    // Walk a block across the screen, like a caret advancing while typing
+    uint64_t Cell = FrameIndex % (static_cast<uint64_t>(Columns) * Rows);
+    int32_t Left = static_cast<int32_t>(Cell % Columns) * MarkerSize;
+    int32_t Top = static_cast<int32_t>(Cell / Columns) * MarkerSize;
+    return { Left, Top, Left + MarkerSize, Top + MarkerSize };
+}
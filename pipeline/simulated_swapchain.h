@@ -0,0 +1,87 @@
+/*++
+
+Module Name:
+
+    simulated_swapchain.h
+
+Abstract:
+
+    This module contains a software stand-in for an IddCx swap-chain. It produces synthetic BGRA frames at a chosen
+    rate so the frame pipeline can be exercised and profiled without a Windows display stack.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "frame_damage.h"
+#include "frame_pipeline.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Emits synthetic desktop-like BGRA frames through the ISwapChainSource interface. Like IddCx, it reports
+        /// the dirty rectangles of every frame relative to the previous one.
+        /// </summary>
+        class SimulatedSwapChain : public ISwapChainSource
+        {
+        public:
+            // FramesPerSecond == 0 makes a new frame available on every acquire. FrameLimit == 0 never abandons the
+            // swap-chain; otherwise acquisition fails once FrameLimit frames have been handed out.
+            SimulatedSwapChain(uint32_t Width, uint32_t Height, double FramesPerSecond, uint64_t FrameLimit = 0);
+
+            // Asks a pipeline blocked in WaitForFrame to stop, like the driver's terminate event
+            void Terminate();
+
+            bool Initialize() override;
+            AcquireStatus ReleaseAndAcquire(Frame& Frame) override;
+            WaitStatus WaitForFrame(uint32_t TimeoutMs) override;
+            bool FinishedProcessing() override;
+
+            uint64_t FramesProduced() const { return m_FramesProduced; }
+
+        private:
+            // Rough equivalent of the buffers the OS rotates through a real swap-chain
+            static const uint32_t BufferCount = 3;
+
+            struct Surface
+            {
+                std::vector<uint8_t> Pixels;
+                int32_t MarkerX;
+                int32_t MarkerY;
+            };
+
+            uint64_t DueTime(uint64_t FrameIndex) const;
+            void DrawBackground(Surface& Surface);
+            void DrawMarker(Surface& Surface, uint64_t FrameIndex);
+            Rect MarkerRect(uint64_t FrameIndex) const;
+
+            uint32_t m_Width;
+            uint32_t m_Height;
+            uint32_t m_Pitch;
+            uint64_t m_FramePeriod;     // [ns], 0 when unthrottled
+            uint64_t m_FrameLimit;
+            uint64_t m_StartTime;
+            uint64_t m_FramesProduced;
+            uint32_t m_CurrentBuffer;
+
+            Surface m_Surfaces[BufferCount];
+            FrameDamage m_Damage;
+
+            std::mutex m_Lock;
+            std::condition_variable m_Wake;
+            std::atomic<bool> m_Terminate;
+        };
+    }
+}
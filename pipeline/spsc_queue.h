@@ -0,0 +1,127 @@
+/*++
+
+Module Name:
+
+    spsc_queue.h
+
+Abstract:
+
+    This module contains a bounded, lock-free single-producer/single-consumer ring used to hand frames from the
+    swap-chain acquire thread to the processing thread without ever blocking the acquire thread.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const size_t CacheLineSize = 64;
+
+        /// <summary>
+        /// Bounded lock-free ring with exactly one pushing thread and exactly one popping thread.
+        /// </summary>
+        template <typename T>
+        class SpscQueue
+        {
+        public:
+            // The capacity is rounded up to the next power of two
+            explicit SpscQueue(size_t Capacity)
+                : m_Mask(RoundUpToPowerOfTwo(Capacity < 2 ? 2 : Capacity) - 1)
+                , m_Slots(new T[m_Mask + 1])
+                , m_Head(0)
+                , m_CachedTail(0)
+                , m_Tail(0)
+                , m_CachedHead(0)
+            {
+            }
+
+            SpscQueue(const SpscQueue&) = delete;
+            SpscQueue& operator=(const SpscQueue&) = delete;
+
+            size_t Capacity() const { return m_Mask + 1; }
+
+            // Producer only. Returns false without side effects when the ring is full.
+            template <typename U>
+            bool TryPush(U&& Item)
+            {
+                size_t Tail = m_Tail.load(std::memory_order_relaxed);
+                if (Tail - m_CachedHead > m_Mask)
+                {
+                    // Only touch the consumer's cache line when the ring looks full
+                    m_CachedHead = m_Head.load(std::memory_order_acquire);
+                    if (Tail - m_CachedHead > m_Mask)
+                    {
+                        return false;
+                    }
+                }
+
+                m_Slots[Tail & m_Mask] = std::forward<U>(Item);
+                m_Tail.store(Tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Consumer only. Returns false when the ring is empty.
+            bool TryPop(T& Item)
+            {
+                size_t Head = m_Head.load(std::memory_order_relaxed);
+                if (Head == m_CachedTail)
+                {
+                    // Only touch the producer's cache line when the ring looks empty
+                    m_CachedTail = m_Tail.load(std::memory_order_acquire);
+                    if (Head == m_CachedTail)
+                    {
+                        return false;
+                    }
+                }
+
+                Item = std::move(m_Slots[Head & m_Mask]);
+                m_Head.store(Head + 1, std::memory_order_release);
+                return true;
+            }
+
+            // Approximate when called concurrently with the other side
+            bool Empty() const
+            {
+                return m_Head.load(std::memory_order_acquire) == m_Tail.load(std::memory_order_acquire);
+            }
+
+            size_t Size() const
+            {
+                return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+            }
+
+        private:
+            static size_t RoundUpToPowerOfTwo(size_t Value)
+            {
+                size_t Result = 1;
+                while (Result < Value)
+                {
+                    Result <<= 1;
+                }
+                return Result;
+            }
+
+            const size_t m_Mask;
+            const std::unique_ptr<T[]> m_Slots;
+
+            // Consumer-owned line: the read index and the consumer's last view of the write index
+            alignas(CacheLineSize) std::atomic<size_t> m_Head;
+            size_t m_CachedTail;
+
+            // Producer-owned line: the write index and the producer's last view of the read index
+            alignas(CacheLineSize) std::atomic<size_t> m_Tail;
+            size_t m_CachedHead;
+        };
+    }
+}
@@ -0,0 +1,217 @@
+/*++
+
+Module Name:
+
+    stats_page.cpp
+
+Abstract:
+
+    This module contains the seqlock writer and reader of the live statistics page.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "stats_page.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const size_t DataWords = sizeof(StatsPageData) / sizeof(uint64_t);
+}
+
+StatsPageWriter::StatsPageWriter()
+    : m_pHeader(nullptr), m_pWords(nullptr)
+{
+}
+
+bool StatsPageWriter::Create(const char* Name)
+{
+    Close();
+
+    if (!m_Region.Create(Name, StatsPageSize()))
+    {
+        return false;
+    }
+
+    Initialize(m_Region.Data(), m_Region.Reclaimed());
+    return true;
+}
+
+void StatsPageWriter::Attach(void* pPage)
+{
+    Initialize(pPage, false);
+}
+
+void StatsPageWriter::Initialize(void* pPage, bool Reclaimed)
+{
+    StatsPageHeader* pHeader;
+    uint32_t Generation = 1;
+    uint64_t Sequence = 0;
+    if (Reclaimed)
+    {
+        // Readers may be opening the page or copying it. Hiding the magic keeps new ones out until the header is
+        // rewritten, the generation tells the others their writer is gone, and an odd sequence restarts any copy.
+        pHeader = static_cast<StatsPageHeader*>(pPage);
+        memset(pHeader->Magic, 0, sizeof(pHeader->Magic));
+        Generation = (pHeader->Generation.load(memory_order_relaxed) + 1) | 1;
+        Sequence = (pHeader->Sequence.load(memory_order_relaxed) | 1) + 1;
+        pHeader->Generation.store(Generation, memory_order_relaxed);
+        pHeader->Sequence.store(Sequence - 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+    }
+    else
+    {
+        // The region is zero-filled, so readers that map it early see no magic until the header is complete
+        pHeader = new (pPage) StatsPageHeader;
+        pHeader->Generation.store(Generation, memory_order_relaxed);
+    }
+
+    pHeader->Version = StatsPageVersion;
+    pHeader->HeaderSize = sizeof(StatsPageHeader);
+    pHeader->DataSize = sizeof(StatsPageData);
+
+    m_pWords = reinterpret_cast<atomic<uint64_t>*>(static_cast<uint8_t*>(pPage) + sizeof(StatsPageHeader));
+    for (size_t i = 0; i < DataWords; i++)
+    {
+        if (Reclaimed)
+        {
+            m_pWords[i].store(0, memory_order_relaxed);
+        }
+        else
+        {
+            new (&m_pWords[i]) atomic<uint64_t>(0);
+        }
+    }
+
+    pHeader->Sequence.store(Sequence, memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    memcpy(pHeader->Magic, StatsPageMagic, sizeof(pHeader->Magic));
+    m_pHeader = pHeader;
+}
+
+void StatsPageWriter::Close()
+{
+    // Readers that kept the page open can tell it has no writer any more
+    if (m_pHeader)
+    {
+        m_pHeader->Generation.fetch_add(1, memory_order_release);
+    }
+
+    m_pHeader = nullptr;
+    m_pWords = nullptr;
+    m_Region.Close();
+}
+
+void StatsPageWriter::Publish(const StatsPageData& Data)
+{
+    uint64_t Words[DataWords];
+    memcpy(Words, &Data, sizeof(Data));
+
+    uint64_t Sequence = m_pHeader->Sequence.load(memory_order_relaxed);
+    m_pHeader->Sequence.store(Sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (size_t i = 0; i < DataWords; i++)
+    {
+        m_pWords[i].store(Words[i], memory_order_relaxed);
+    }
+
+    m_pHeader->Sequence.store(Sequence + 2, memory_order_release);
+}
+
+StatsPageReader::StatsPageReader()
+    : m_pHeader(nullptr), m_pWords(nullptr), m_WordCount(0), m_Generation(0), m_Retries(0)
+{
+}
+
+bool StatsPageReader::Open(const char* Name)
+{
+    Close();
+
+    if (!m_Region.Open(Name) || !Validate(m_Region.Data(), m_Region.Size()))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool StatsPageReader::Attach(const void* pPage, size_t Size)
+{
+    Close();
+    return Validate(pPage, Size);
+}
+
+void StatsPageReader::Close()
+{
+    m_pHeader = nullptr;
+    m_pWords = nullptr;
+    m_WordCount = 0;
+    m_Region.Close();
+}
+
+bool StatsPageReader::Validate(const void* pPage, size_t Size)
+{
+    const StatsPageHeader* pHeader = static_cast<const StatsPageHeader*>(pPage);
+    if (Size < sizeof(StatsPageHeader) || memcmp(pHeader->Magic, StatsPageMagic, sizeof(pHeader->Magic)) != 0)
+    {
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    // A later writer may have grown the header or the data, but never shrunk them. An even generation means the
+    // page is only still there because another reader keeps it alive.
+    uint32_t Generation = pHeader->Generation.load(memory_order_acquire);
+    if (pHeader->Version == 0 || pHeader->HeaderSize < sizeof(StatsPageHeader) || pHeader->DataSize % sizeof(uint64_t) != 0 ||
+        pHeader->HeaderSize + static_cast<size_t>(pHeader->DataSize) > Size || !(Generation & 1))
+    {
+        return false;
+    }
+
+    m_pHeader = pHeader;
+    m_Generation = Generation;
+    m_pWords = reinterpret_cast<const atomic<uint64_t>*>(static_cast<const uint8_t*>(pPage) + pHeader->HeaderSize);
+    m_WordCount = min(DataWords, static_cast<size_t>(pHeader->DataSize / sizeof(uint64_t)));
+    return true;
+}
+
+bool StatsPageReader::Read(StatsPageData& Data, uint32_t MaxAttempts)
+{
+    uint64_t Words[DataWords] = {};
+
+    for (uint32_t Attempt = 0; Attempt < MaxAttempts; Attempt++)
+    {
+        uint64_t Before = m_pHeader->Sequence.load(memory_order_acquire);
+        if (Before & 1)
+        {
+            // A publish is under way; it takes well under a microsecond
+            m_Retries++;
+            this_thread::yield();
+            continue;
+        }
+
+        for (size_t i = 0; i < m_WordCount; i++)
+        {
+            Words[i] = m_pWords[i].load(memory_order_relaxed);
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (m_pHeader->Sequence.load(memory_order_relaxed) == Before)
+        {
+            memcpy(&Data, Words, sizeof(Data));
+            return true;
+        }
+        m_Retries++;
+    }
+    return false;
+}
@@ -0,0 +1,103 @@
+/*++
+
+Module Name:
+
+    stats_page.h
+
+Abstract:
+
+    This module contains the writer and the reader of the live statistics page. Either works on a named
+    shared-memory region or on memory the caller provides.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "shared_memory.h"
+#include "stats_page_format.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        // Bytes a page takes: the header, then the data words
+        inline size_t StatsPageSize() { return sizeof(StatsPageHeader) + sizeof(StatsPageData); }
+
+        /// <summary>
+        /// Publishes StatsPageData through the seqlock. There must be a single writer per page.
+        /// </summary>
+        class StatsPageWriter
+        {
+        public:
+            StatsPageWriter();
+
+            // Creates the named region and initializes the page in it. A region the previous writer left mapped by
+            // readers is taken over, and its readers see the generation change.
+            bool Create(const char* Name);
+
+            // Initializes a page in caller memory of at least StatsPageSize bytes, aligned to 8
+            void Attach(void* pPage);
+
+            void Close();
+
+            bool IsOpen() const { return m_pHeader != nullptr; }
+
+            void Publish(const StatsPageData& Data);
+
+        private:
+            void Initialize(void* pPage, bool Reclaimed);
+
+            SharedMemory m_Region;
+            StatsPageHeader* m_pHeader;
+            std::atomic<uint64_t>* m_pWords;
+        };
+
+        /// <summary>
+        /// Copies consistent snapshots of a page. Never writes to the page, so any number of readers may poll it.
+        /// </summary>
+        class StatsPageReader
+        {
+        public:
+            StatsPageReader();
+
+            // Maps the named region read-only; fails if it holds no page
+            bool Open(const char* Name);
+
+            // Reads a page in caller memory, e.g. one a StatsPageWriter attached to; fails if it holds no page
+            bool Attach(const void* pPage, size_t Size);
+
+            void Close();
+
+            bool IsOpen() const { return m_pHeader != nullptr; }
+
+            // Copies the latest publish. Fails if the writer was in the middle of a publish on every one of
+            // MaxAttempts tries.
+            bool Read(StatsPageData& Data, uint32_t MaxAttempts = 1000);
+
+            // Copies that were discarded because a publish overlapped them
+            uint64_t Retries() const { return m_Retries; }
+
+            // Whether the writer the page had when it was opened left or was replaced since; the page then holds
+            // nothing, or the counts of a writer that started over, and should be opened again
+            bool WriterChanged() const { return m_pHeader->Generation.load(std::memory_order_acquire) != m_Generation; }
+
+        private:
+            bool Validate(const void* pPage, size_t Size);
+
+            SharedMemory m_Region;
+            const StatsPageHeader* m_pHeader;
+            const std::atomic<uint64_t>* m_pWords;
+            size_t m_WordCount;
+            uint32_t m_Generation;
+            uint64_t m_Retries;
+        };
+    }
+}
@@ -0,0 +1,97 @@
+/*++
+
+Module Name:
+
+    stats_page_format.h
+
+Abstract:
+
+    This module contains the layout of the live statistics page, which the driver republishes in shared memory
+    a few times a second for monitoring tools to read without calling into it.
+
+    The header is followed by StatsPageData, stored as 64-bit words so the writer and the readers can move it with
+    relaxed atomics. Header.Sequence is a seqlock: the writer makes it odd, rewrites the words and makes it even
+    again; a reader keeps a copy only if the sequence was the same even number before and after it copied.
+
+    Header.Generation is odd while a writer publishes into the page and goes up whenever a writer attaches or
+    leaves, e.g. when the driver restarts and takes the page over from its previous instance because a reader
+    kept it alive. A reader that sees it change is reading a page whose writer went away or started over.
+
+    Fields are only ever appended to StatsPageData, so a reader copies the DataSize bytes it knows of and leaves
+    the rest of its copy zero.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        const char StatsPageMagic[4] = { 'I', 'D', 'D', 'S' };
+        const uint16_t StatsPageVersion = 1;
+
+        // Where the driver publishes the page
+        const char* const StatsPageName = "Global\\WinVirtualDisplayStats";
+
+        const uint32_t StatsPageMaxMetrics = 32;
+        const uint32_t StatsPageMaxMonitors = 4;
+
+        /// <summary>
+        /// Live state of one monitor. Every field is 8 bytes.
+        /// </summary>
+        struct MonitorStats
+        {
+            uint64_t Active;                // 1 while a mode is committed
+            uint64_t Width;
+            uint64_t Height;
+            uint64_t RefreshNumerator;      // refresh rate [Hz] of the mode, as a fraction
+            uint64_t RefreshDenominator;
+            uint64_t SwapChainActive;       // 1 while a swap-chain is being processed
+            uint64_t FramesAcquired;        // since the driver started
+            uint64_t FramesDelivered;
+            uint64_t FramesDropped;         // rejected by a stage, overrun or not mappable
+            double AcquiredPerSecond;       // over the last publish interval
+            double DeliveredPerSecond;
+            uint64_t LatencyP50;            // acquisition to finish [ns], over the current swap-chain
+            uint64_t LatencyP99;
+            uint64_t LatencyP999;
+            uint64_t LatencyMax;
+        };
+
+        /// <summary>
+        /// Everything the seqlock protects. Every field is 8 bytes.
+        /// </summary>
+        struct StatsPageData
+        {
+            uint64_t PublishTime;           // MonotonicNanoseconds of the publish
+            uint64_t PublishCount;
+            uint64_t StartTime;             // MonotonicNanoseconds when the driver started publishing
+            uint64_t MetricCount;           // valid entries of Metrics, indexed by MetricId
+            int64_t Metrics[StatsPageMaxMetrics];
+            uint64_t MonitorCount;
+            MonitorStats Monitors[StatsPageMaxMonitors];
+        };
+
+        struct StatsPageHeader
+        {
+            char Magic[4];
+            uint16_t Version;
+            uint16_t HeaderSize;            // bytes before the data words
+            uint32_t DataSize;              // bytes of StatsPageData the writer publishes, a multiple of 8
+            std::atomic<uint32_t> Generation;
+            std::atomic<uint64_t> Sequence;
+        };
+
+        static_assert(sizeof(MonitorStats) % sizeof(uint64_t) == 0 && sizeof(StatsPageData) % sizeof(uint64_t) == 0,
+            "the page is copied in 64-bit words");
+        static_assert(sizeof(StatsPageHeader) == 24, "the header layout is fixed");
+    }
+}
@@ -0,0 +1,228 @@
+/*++
+
+Module Name:
+
+    stats_publisher.cpp
+
+Abstract:
+
+    This module contains the statistics publisher.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "stats_publisher.h"
+
+#include <chrono>
+
+#include "frame.h"
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+static_assert(MetricCount <= StatsPageMaxMetrics, "the page has no room for every metric");
+
+StatsPublisher::StatsPublisher(shared_ptr<MetricsRegistry> Metrics)
+    : m_Metrics(Metrics), m_Data(), m_Monitors(), m_LastPublishTime(0), m_Stop(false)
+{
+}
+
+StatsPublisher::~StatsPublisher()
+{
+    Stop();
+}
+
+bool StatsPublisher::Start(const char* Name, uint32_t IntervalMs)
+{
+    Stop();
+
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        if (!m_Writer.Create(Name))
+        {
+            return false;
+        }
+    }
+
+    StartThread(IntervalMs);
+    return true;
+}
+
+void StatsPublisher::Start(void* pPage, uint32_t IntervalMs)
+{
+    Stop();
+
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Writer.Attach(pPage);
+    }
+
+    StartThread(IntervalMs);
+}
+
+void StatsPublisher::StartThread(uint32_t IntervalMs)
+{
+    lock_guard<mutex> Lock(m_Lock);
+    m_Data = StatsPageData();
+    m_Data.StartTime = MonotonicNanoseconds();
+    m_LastPublishTime = 0;
+    m_Stop = false;
+    Publish();
+
+    if (IntervalMs != 0)
+    {
+        m_Thread = thread(&StatsPublisher::Run, this, IntervalMs);
+    }
+}
+
+void StatsPublisher::Stop()
+{
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Stop = true;
+    }
+    m_Wake.notify_all();
+
+    if (m_Thread.joinable())
+    {
+        m_Thread.join();
+    }
+
+    lock_guard<mutex> Lock(m_Lock);
+    m_Writer.Close();
+}
+
+void StatsPublisher::PublishNow()
+{
+    lock_guard<mutex> Lock(m_Lock);
+    Publish();
+}
+
+void StatsPublisher::SetMonitorMode(uint32_t Monitor, uint32_t Width, uint32_t Height, uint32_t RefreshNumerator, uint32_t RefreshDenominator)
+{
+    if (Monitor >= StatsPageMaxMonitors)
+    {
+        return;
+    }
+
+    lock_guard<mutex> Lock(m_Lock);
+    MonitorState& State = m_Monitors[Monitor];
+    State.Active = Width != 0;
+    State.Width = Width;
+    State.Height = Height;
+    State.RefreshNumerator = RefreshNumerator;
+    State.RefreshDenominator = RefreshDenominator;
+}
+
+void StatsPublisher::SetMonitorMetrics(uint32_t Monitor, shared_ptr<MetricsRegistry> Metrics)
+{
+    if (Monitor >= StatsPageMaxMonitors)
+    {
+        return;
+    }
+
+    lock_guard<mutex> Lock(m_Lock);
+    MonitorState& State = m_Monitors[Monitor];
+    State.Metrics = Metrics;
+    State.LastAcquired = Metrics ? Metrics->Read(MetricId::FramesAcquired) : 0;
+    State.LastDelivered = Metrics ? Metrics->Read(MetricId::FramesDelivered) : 0;
+}
+
+void StatsPublisher::AttachTimings(uint32_t Monitor, const FrameTimings* pTimings)
+{
+    if (Monitor >= StatsPageMaxMonitors)
+    {
+        return;
+    }
+
+    lock_guard<mutex> Lock(m_Lock);
+    m_Monitors[Monitor].pTimings = pTimings;
+}
+
+void StatsPublisher::Run(uint32_t IntervalMs)
+{
+    unique_lock<mutex> Lock(m_Lock);
+    while (!m_Stop)
+    {
+        m_Wake.wait_for(Lock, chrono::milliseconds(IntervalMs), [this] { return m_Stop; });
+        if (!m_Stop)
+        {
+            Publish();
+        }
+    }
+}
+
+// Called with m_Lock held
+void StatsPublisher::Publish()
+{
+    if (!m_Writer.IsOpen())
+    {
+        return;
+    }
+
+    uint64_t Now = MonotonicNanoseconds();
+    double Seconds = m_LastPublishTime != 0 && Now > m_LastPublishTime ? (Now - m_LastPublishTime) / 1e9 : 0.0;
+    m_LastPublishTime = Now;
+
+    m_Data.PublishTime = Now;
+    m_Data.PublishCount++;
+
+    m_Data.MetricCount = m_Metrics ? MetricCount : 0;
+    for (uint32_t i = 0; i < m_Data.MetricCount; i++)
+    {
+        m_Data.Metrics[i] = m_Metrics->Read(static_cast<MetricId>(i));
+    }
+
+    m_Data.MonitorCount = 0;
+    for (uint32_t i = 0; i < StatsPageMaxMonitors; i++)
+    {
+        MonitorState& State = m_Monitors[i];
+        MonitorStats& Stats = m_Data.Monitors[i];
+        Stats = MonitorStats();
+
+        Stats.Active = State.Active ? 1 : 0;
+        Stats.Width = State.Width;
+        Stats.Height = State.Height;
+        Stats.RefreshNumerator = State.RefreshNumerator;
+        Stats.RefreshDenominator = State.RefreshDenominator;
+        Stats.SwapChainActive = State.pTimings ? 1 : 0;
+
+        if (State.Metrics)
+        {
+            int64_t Acquired = State.Metrics->Read(MetricId::FramesAcquired);
+            int64_t Delivered = State.Metrics->Read(MetricId::FramesDelivered);
+            Stats.FramesAcquired = Acquired;
+            Stats.FramesDelivered = Delivered;
+            Stats.FramesDropped = State.Metrics->Read(MetricId::FramesDropped) + State.Metrics->Read(MetricId::FramesOverrun) +
+                State.Metrics->Read(MetricId::MapFailures);
+
+            if (Seconds > 0)
+            {
+                Stats.AcquiredPerSecond = (Acquired - State.LastAcquired) / Seconds;
+                Stats.DeliveredPerSecond = (Delivered - State.LastDelivered) / Seconds;
+            }
+            State.LastAcquired = Acquired;
+            State.LastDelivered = Delivered;
+        }
+
+        if (State.pTimings && State.pTimings->SegmentCount() != 0)
+        {
+            // The last segment is the total, acquisition to finish
+            LatencySummary Latency = State.pTimings->Segment(State.pTimings->SegmentCount() - 1).Summarize();
+            Stats.LatencyP50 = Latency.P50;
+            Stats.LatencyP99 = Latency.P99;
+            Stats.LatencyP999 = Latency.P999;
+            Stats.LatencyMax = Latency.Max;
+        }
+
+        if (State.Active || State.pTimings || State.Metrics)
+        {
+            m_Data.MonitorCount = i + 1;
+        }
+    }
+
+    m_Writer.Publish(m_Data);
+}
@@ -0,0 +1,98 @@
+/*++
+
+Module Name:
+
+    stats_publisher.h
+
+Abstract:
+
+    This module contains the statistics publisher, which gathers the metrics and the state of every monitor into
+    the live statistics page on a background thread.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "frame_timings.h"
+#include "metrics.h"
+#include "stats_page.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Republishes the statistics page every interval. Monitors are numbered from 0 to StatsPageMaxMonitors - 1.
+        /// </summary>
+        class StatsPublisher
+        {
+        public:
+            static const uint32_t DefaultIntervalMs = 100;
+
+            explicit StatsPublisher(std::shared_ptr<MetricsRegistry> Metrics);
+            ~StatsPublisher();
+
+            StatsPublisher(const StatsPublisher&) = delete;
+            StatsPublisher& operator=(const StatsPublisher&) = delete;
+
+            // Creates the page and publishes to it every IntervalMs, or only on PublishNow if IntervalMs is 0
+            bool Start(const char* Name, uint32_t IntervalMs = DefaultIntervalMs);
+
+            // Publishes to caller memory of at least StatsPageSize bytes instead of a named region
+            void Start(void* pPage, uint32_t IntervalMs = DefaultIntervalMs);
+
+            void Stop();
+
+            void PublishNow();
+
+            // Records the committed mode; a Width of 0 marks the monitor inactive
+            void SetMonitorMode(uint32_t Monitor, uint32_t Width, uint32_t Height, uint32_t RefreshNumerator, uint32_t RefreshDenominator);
+
+            // The registry the frame counters of the monitor come from
+            void SetMonitorMetrics(uint32_t Monitor, std::shared_ptr<MetricsRegistry> Metrics);
+
+            // Publishes latency percentiles from the timings of the swap-chain being processed, until detached with
+            // nullptr. Detaching waits for a publish reading them to finish, so they may be destroyed right after.
+            void AttachTimings(uint32_t Monitor, const FrameTimings* pTimings);
+
+        private:
+            struct MonitorState
+            {
+                bool Active;
+                uint32_t Width;
+                uint32_t Height;
+                uint32_t RefreshNumerator;
+                uint32_t RefreshDenominator;
+                std::shared_ptr<MetricsRegistry> Metrics;
+                const FrameTimings* pTimings;
+                int64_t LastAcquired;
+                int64_t LastDelivered;
+            };
+
+            void StartThread(uint32_t IntervalMs);
+            void Run(uint32_t IntervalMs);
+            void Publish();
+
+            std::shared_ptr<MetricsRegistry> m_Metrics;
+            StatsPageWriter m_Writer;
+            StatsPageData m_Data;
+            MonitorState m_Monitors[StatsPageMaxMonitors];
+            uint64_t m_LastPublishTime;
+
+            std::mutex m_Lock;              // the monitors, the data and the writer
+            std::condition_variable m_Wake;
+            bool m_Stop;
+            std::thread m_Thread;
+        };
+    }
+}
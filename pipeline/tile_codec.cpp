@@ -0,0 +1,676 @@
+/*++
+
+Module Name:
+
+    tile_codec.cpp
+
+Abstract:
+
+    This module contains the tile codec: the QOI tile coder, the stream writer and the validating stream reader.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "tile_codec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint32_t StreamMagic = 0x51544449;    // "IDTQ"
+    const uint16_t KeyFrameFlag = 1;
+    const size_t HeaderBytes = 24;
+    const size_t MoveBytes = 24;
+    const size_t DirectoryEntryBytes = 8;
+    const uint32_t MaxDimension = 16384;
+
+    const uint8_t QoiTile = 0;
+    const uint8_t RawTile = 1;
+
+    // QOI operations: 2-bit tags, or full bytes for the literal colors
+    const uint8_t OpIndex = 0x00;
+    const uint8_t OpDiff = 0x40;
+    const uint8_t OpLuma = 0x80;
+    const uint8_t OpRun = 0xC0;
+    const uint8_t OpRgb = 0xFE;
+    const uint8_t OpRgba = 0xFF;
+    const uint8_t TagMask = 0xC0;
+    const uint32_t MaxRun = 62;
+
+    // Worst case of a QOI tile: every pixel an OpRgba
+    const uint32_t MaxQoiBytesPerPixel = 5;
+
+    void Put16(uint8_t*& p, uint16_t Value)
+    {
+        p[0] = static_cast<uint8_t>(Value);
+        p[1] = static_cast<uint8_t>(Value >> 8);
+        p += 2;
+    }
+
+    void Put32(uint8_t*& p, uint32_t Value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            p[i] = static_cast<uint8_t>(Value >> (i * 8));
+        }
+        p += 4;
+    }
+
+    uint16_t Get16(const uint8_t*& p)
+    {
+        uint16_t Value = static_cast<uint16_t>(p[0] | p[1] << 8);
+        p += 2;
+        return Value;
+    }
+
+    uint32_t Get32(const uint8_t*& p)
+    {
+        uint32_t Value = p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+        p += 4;
+        return Value;
+    }
+
+    // Pixels are handled as BGRA bytes loaded into a little-endian word: B in the low byte, A in the high byte
+    uint32_t ColorHash(uint32_t Pixel)
+    {
+        uint32_t B = Pixel & 0xFF;
+        uint32_t G = (Pixel >> 8) & 0xFF;
+        uint32_t R = (Pixel >> 16) & 0xFF;
+        uint32_t A = Pixel >> 24;
+        return (R * 3 + G * 5 + B * 7 + A * 11) & 63;
+    }
+
+    size_t EncodeQoi(const uint8_t* pData, uint32_t Pitch, uint32_t Width, uint32_t Height, uint8_t* pOut)
+    {
+        uint32_t Index[64] = {};
+        uint32_t Previous = 0xFF000000u;
+        uint32_t Run = 0;
+        uint8_t* p = pOut;
+
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            const uint8_t* pRow = pData + static_cast<size_t>(y) * Pitch;
+
+            for (uint32_t x = 0; x < Width; x++)
+            {
+                uint32_t Pixel;
+                memcpy(&Pixel, pRow + static_cast<size_t>(x) * 4, sizeof(Pixel));
+
+                if (Pixel == Previous)
+                {
+                    if (++Run == MaxRun)
+                    {
+                        *p++ = static_cast<uint8_t>(OpRun | (Run - 1));
+                        Run = 0;
+                    }
+                    continue;
+                }
+
+                if (Run != 0)
+                {
+                    *p++ = static_cast<uint8_t>(OpRun | (Run - 1));
+                    Run = 0;
+                }
+
+                uint32_t Slot = ColorHash(Pixel);
+                if (Index[Slot] == Pixel)
+                {
+                    *p++ = static_cast<uint8_t>(OpIndex | Slot);
+                }
+                else
+                {
+                    Index[Slot] = Pixel;
+
+                    if ((Pixel >> 24) == (Previous >> 24))
+                    {
+                        int8_t DeltaB = static_cast<int8_t>((Pixel & 0xFF) - (Previous & 0xFF));
+                        int8_t DeltaG = static_cast<int8_t>(((Pixel >> 8) & 0xFF) - ((Previous >> 8) & 0xFF));
+                        int8_t DeltaR = static_cast<int8_t>(((Pixel >> 16) & 0xFF) - ((Previous >> 16) & 0xFF));
+                        int8_t DeltaRG = static_cast<int8_t>(DeltaR - DeltaG);
+                        int8_t DeltaBG = static_cast<int8_t>(DeltaB - DeltaG);
+
+                        if (DeltaR >= -2 && DeltaR <= 1 && DeltaG >= -2 && DeltaG <= 1 && DeltaB >= -2 && DeltaB <= 1)
+                        {
+                            *p++ = static_cast<uint8_t>(OpDiff | (DeltaR + 2) << 4 | (DeltaG + 2) << 2 | (DeltaB + 2));
+                        }
+                        else if (DeltaG >= -32 && DeltaG <= 31 && DeltaRG >= -8 && DeltaRG <= 7 && DeltaBG >= -8 && DeltaBG <= 7)
+                        {
+                            *p++ = static_cast<uint8_t>(OpLuma | (DeltaG + 32));
+                            *p++ = static_cast<uint8_t>((DeltaRG + 8) << 4 | (DeltaBG + 8));
+                        }
+                        else
+                        {
+                            *p++ = OpRgb;
+                            *p++ = static_cast<uint8_t>(Pixel >> 16);
+                            *p++ = static_cast<uint8_t>(Pixel >> 8);
+                            *p++ = static_cast<uint8_t>(Pixel);
+                        }
+                    }
+                    else
+                    {
+                        *p++ = OpRgba;
+                        *p++ = static_cast<uint8_t>(Pixel >> 16);
+                        *p++ = static_cast<uint8_t>(Pixel >> 8);
+                        *p++ = static_cast<uint8_t>(Pixel);
+                        *p++ = static_cast<uint8_t>(Pixel >> 24);
+                    }
+                }
+
+                Previous = Pixel;
+            }
+        }
+
+        if (Run != 0)
+        {
+            *p++ = static_cast<uint8_t>(OpRun | (Run - 1));
+        }
+
+        return p - pOut;
+    }
+
+    // Fails unless the payload holds exactly Width x Height pixels
+    bool DecodeQoi(const uint8_t* pIn, size_t Size, uint8_t* pData, uint32_t Pitch, uint32_t Width, uint32_t Height)
+    {
+        uint32_t Index[64] = {};
+        uint32_t Previous = 0xFF000000u;
+        uint32_t Run = 0;
+        const uint8_t* p = pIn;
+        const uint8_t* pEnd = pIn + Size;
+
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            uint8_t* pRow = pData + static_cast<size_t>(y) * Pitch;
+
+            for (uint32_t x = 0; x < Width; x++)
+            {
+                if (Run != 0)
+                {
+                    Run--;
+                }
+                else
+                {
+                    if (p == pEnd)
+                    {
+                        return false;
+                    }
+
+                    uint8_t Op = *p++;
+                    if (Op == OpRgb || Op == OpRgba)
+                    {
+                        size_t Bytes = Op == OpRgb ? 3 : 4;
+                        if (static_cast<size_t>(pEnd - p) < Bytes)
+                        {
+                            return false;
+                        }
+
+                        uint32_t Alpha = Op == OpRgb ? (Previous & 0xFF000000u) : static_cast<uint32_t>(p[3]) << 24;
+                        Previous = Alpha | static_cast<uint32_t>(p[0]) << 16 | static_cast<uint32_t>(p[1]) << 8 | p[2];
+                        Index[ColorHash(Previous)] = Previous;
+                        p += Bytes;
+                    }
+                    else
+                    {
+                        switch (Op & TagMask)
+                        {
+                        case OpIndex:
+                            Previous = Index[Op];
+                            break;
+                        case OpDiff:
+                        {
+                            uint32_t B = ((Previous & 0xFF) + (Op & 3) - 2) & 0xFF;
+                            uint32_t G = (((Previous >> 8) & 0xFF) + ((Op >> 2) & 3) - 2) & 0xFF;
+                            uint32_t R = (((Previous >> 16) & 0xFF) + ((Op >> 4) & 3) - 2) & 0xFF;
+                            Previous = (Previous & 0xFF000000u) | R << 16 | G << 8 | B;
+                            Index[ColorHash(Previous)] = Previous;
+                            break;
+                        }
+                        case OpLuma:
+                        {
+                            if (p == pEnd)
+                            {
+                                return false;
+                            }
+
+                            int32_t DeltaG = (Op & 0x3F) - 32;
+                            int32_t DeltaR = DeltaG + (*p >> 4) - 8;
+                            int32_t DeltaB = DeltaG + (*p & 0x0F) - 8;
+                            p++;
+
+                            uint32_t B = ((Previous & 0xFF) + DeltaB) & 0xFF;
+                            uint32_t G = (((Previous >> 8) & 0xFF) + DeltaG) & 0xFF;
+                            uint32_t R = (((Previous >> 16) & 0xFF) + DeltaR) & 0xFF;
+                            Previous = (Previous & 0xFF000000u) | R << 16 | G << 8 | B;
+                            Index[ColorHash(Previous)] = Previous;
+                            break;
+                        }
+                        default:
+                            Run = Op & 0x3F;
+                            break;
+                        }
+                    }
+                }
+
+                memcpy(pRow + static_cast<size_t>(x) * 4, &Previous, sizeof(Previous));
+            }
+        }
+
+        return Run == 0 && p == pEnd;
+    }
+}
+
+TileEncoder::TileEncoder(shared_ptr<WorkerPool> Pool, uint32_t TileSize)
+    : m_Pool(move(Pool))
+    , m_TileSize(min(max(TileSize, 8u), 1024u))
+    , m_Width(0)
+    , m_Height(0)
+    , m_Columns(0)
+    , m_Rows(0)
+    , m_NeedKeyFrame(true)
+{
+}
+
+bool TileEncoder::Encode(const Frame& Frame, EncodedFrame& Output)
+{
+    if (Frame.Format != PixelFormat::Bgra8 || !Frame.pData || Frame.Width == 0 || Frame.Height == 0 ||
+        Frame.Width > MaxDimension || Frame.Height > MaxDimension)
+    {
+        // Whoever consumes the stream missed this frame, so the next one must not depend on what came before
+        m_NeedKeyFrame = true;
+        return false;
+    }
+
+    bool KeyFrame = m_NeedKeyFrame || Frame.Width != m_Width || Frame.Height != m_Height || Frame.Damage != DamageState::Partial;
+
+    m_Width = Frame.Width;
+    m_Height = Frame.Height;
+    m_Columns = (m_Width + m_TileSize - 1) / m_TileSize;
+    m_Rows = (m_Height + m_TileSize - 1) / m_TileSize;
+    m_NeedKeyFrame = false;
+
+    const uint32_t TileCount = m_Columns * m_Rows;
+    m_Tiles.clear();
+    m_Moves.clear();
+
+    if (KeyFrame)
+    {
+        for (uint32_t Tile = 0; Tile < TileCount; Tile++)
+        {
+            m_Tiles.push_back(Tile);
+        }
+    }
+    else
+    {
+        m_Marked.assign(TileCount, 0);
+
+        for (uint32_t i = 0; i < Frame.DirtyRectCount; i++)
+        {
+            MarkTiles(Frame.pDirtyRects[i]);
+        }
+
+        // A move the frame does not fully contain is sent as pixels instead
+        const int32_t Width = static_cast<int32_t>(m_Width);
+        const int32_t Height = static_cast<int32_t>(m_Height);
+        for (uint32_t i = 0; i < Frame.MoveRectCount; i++)
+        {
+            const MoveRect& Move = Frame.pMoveRects[i];
+            const Rect& Destination = Move.Destination;
+            int32_t SourceRight = Move.SourceX + Destination.Right - Destination.Left;
+            int32_t SourceBottom = Move.SourceY + Destination.Bottom - Destination.Top;
+
+            if (Destination.Empty())
+            {
+                continue;
+            }
+            if (Destination.Left < 0 || Destination.Top < 0 || Destination.Right > Width || Destination.Bottom > Height ||
+                Move.SourceX < 0 || Move.SourceY < 0 || SourceRight > Width || SourceBottom > Height)
+            {
+                MarkTiles(Destination);
+                continue;
+            }
+
+            m_Moves.push_back(Move);
+        }
+
+        for (uint32_t Tile = 0; Tile < TileCount; Tile++)
+        {
+            if (m_Marked[Tile])
+            {
+                m_Tiles.push_back(Tile);
+            }
+        }
+    }
+
+    // Compress the tiles one tile row per task, each row into its own scratch buffer, so the tasks stay large
+    // enough to be worth stealing and the output does not depend on which thread ran what
+    m_Batches.clear();
+    for (uint32_t Index = 0; Index < m_Tiles.size(); Index++)
+    {
+        if (Index == 0 || m_Tiles[Index] / m_Columns != m_Tiles[Index - 1] / m_Columns)
+        {
+            m_Batches.push_back(Index);
+        }
+    }
+    const uint32_t BatchCount = static_cast<uint32_t>(m_Batches.size());
+    m_Batches.push_back(static_cast<uint32_t>(m_Tiles.size()));
+
+    if (m_Scratch.size() < BatchCount)
+    {
+        m_Scratch.resize(BatchCount);
+    }
+    m_Outputs.resize(m_Tiles.size());
+
+    if (m_Pool)
+    {
+        m_Pool->ParallelFor(BatchCount, [&](uint32_t Batch)
+        {
+            EncodeBatch(Frame, Batch);
+        });
+    }
+    else
+    {
+        for (uint32_t Batch = 0; Batch < BatchCount; Batch++)
+        {
+            EncodeBatch(Frame, Batch);
+        }
+    }
+
+    // Assemble the stream
+    size_t Size = HeaderBytes + m_Moves.size() * MoveBytes + m_Tiles.size() * DirectoryEntryBytes;
+    for (const TileOutput& Tile : m_Outputs)
+    {
+        Size += Tile.Size;
+    }
+    m_Stream.resize(Size);
+
+    uint8_t* p = m_Stream.data();
+    Put32(p, StreamMagic);
+    Put32(p, m_Width);
+    Put32(p, m_Height);
+    Put16(p, static_cast<uint16_t>(m_TileSize));
+    Put16(p, KeyFrame ? KeyFrameFlag : 0);
+    Put32(p, static_cast<uint32_t>(m_Moves.size()));
+    Put32(p, static_cast<uint32_t>(m_Tiles.size()));
+
+    for (const MoveRect& Move : m_Moves)
+    {
+        Put32(p, static_cast<uint32_t>(Move.SourceX));
+        Put32(p, static_cast<uint32_t>(Move.SourceY));
+        Put32(p, static_cast<uint32_t>(Move.Destination.Left));
+        Put32(p, static_cast<uint32_t>(Move.Destination.Top));
+        Put32(p, static_cast<uint32_t>(Move.Destination.Right));
+        Put32(p, static_cast<uint32_t>(Move.Destination.Bottom));
+    }
+
+    for (size_t i = 0; i < m_Tiles.size(); i++)
+    {
+        Put32(p, m_Tiles[i]);
+        Put32(p, m_Outputs[i].Size);
+    }
+
+    for (const TileOutput& Tile : m_Outputs)
+    {
+        memcpy(p, m_Scratch[Tile.Batch].Bytes.data() + Tile.Offset, Tile.Size);
+        p += Tile.Size;
+    }
+
+    Output.Codec = Name();
+    Output.pData = m_Stream.data();
+    Output.Size = m_Stream.size();
+    Output.KeyFrame = KeyFrame;
+    return true;
+}
+
+void TileEncoder::MarkTiles(const Rect& Area)
+{
+    int32_t Left = max(Area.Left, 0);
+    int32_t Top = max(Area.Top, 0);
+    int32_t Right = min(Area.Right, static_cast<int32_t>(m_Width));
+    int32_t Bottom = min(Area.Bottom, static_cast<int32_t>(m_Height));
+    if (Left >= Right || Top >= Bottom)
+    {
+        return;
+    }
+
+    for (uint32_t Row = Top / m_TileSize; Row <= (Bottom - 1) / m_TileSize; Row++)
+    {
+        for (uint32_t Column = Left / m_TileSize; Column <= (Right - 1) / m_TileSize; Column++)
+        {
+            m_Marked[static_cast<size_t>(Row) * m_Columns + Column] = 1;
+        }
+    }
+}
+
+void TileEncoder::EncodeBatch(const Frame& Frame, uint32_t Batch)
+{
+    m_Scratch[Batch].Used = 0;
+    for (uint32_t Index = m_Batches[Batch]; Index < m_Batches[Batch + 1]; Index++)
+    {
+        EncodeTile(Frame, Index, Batch);
+    }
+}
+
+void TileEncoder::EncodeTile(const Frame& Frame, uint32_t Index, uint32_t Batch)
+{
+    uint32_t Tile = m_Tiles[Index];
+    uint32_t Left = (Tile % m_Columns) * m_TileSize;
+    uint32_t Top = (Tile / m_Columns) * m_TileSize;
+    uint32_t Width = min(m_TileSize, m_Width - Left);
+    uint32_t Height = min(m_TileSize, m_Height - Top);
+    size_t RawBytes = static_cast<size_t>(Width) * Height * 4;
+    const uint8_t* pTile = Frame.pData + static_cast<size_t>(Top) * Frame.Pitch + static_cast<size_t>(Left) * 4;
+
+    BatchScratch& Scratch = m_Scratch[Batch];
+    size_t Needed = Scratch.Used + 1 + static_cast<size_t>(Width) * Height * MaxQoiBytesPerPixel;
+    if (Scratch.Bytes.size() < Needed)
+    {
+        Scratch.Bytes.resize(max(Needed, Scratch.Bytes.size() * 2));
+    }
+
+    uint8_t* p = Scratch.Bytes.data() + Scratch.Used;
+    size_t Size = EncodeQoi(pTile, Frame.Pitch, Width, Height, p + 1);
+
+    // Noise compresses badly; never send more than the pixels themselves
+    if (Size < RawBytes)
+    {
+        p[0] = QoiTile;
+    }
+    else
+    {
+        p[0] = RawTile;
+        for (uint32_t y = 0; y < Height; y++)
+        {
+            memcpy(p + 1 + static_cast<size_t>(y) * Width * 4, pTile + static_cast<size_t>(y) * Frame.Pitch, static_cast<size_t>(Width) * 4);
+        }
+        Size = RawBytes;
+    }
+
+    m_Outputs[Index] = { Batch, static_cast<uint32_t>(Size + 1), Scratch.Used };
+    Scratch.Used += Size + 1;
+}
+
+TileDecoder::TileDecoder(shared_ptr<WorkerPool> Pool)
+    : m_Pool(move(Pool)), m_Width(0), m_Height(0), m_Valid(false)
+{
+}
+
+bool TileDecoder::Decode(const uint8_t* pData, size_t Size)
+{
+    if (!pData || Size < HeaderBytes)
+    {
+        m_Valid = false;
+        return false;
+    }
+
+    const uint8_t* p = pData;
+    uint32_t Magic = Get32(p);
+    uint32_t Width = Get32(p);
+    uint32_t Height = Get32(p);
+    uint32_t TileSize = Get16(p);
+    uint16_t Flags = Get16(p);
+    uint32_t MoveCount = Get32(p);
+    uint32_t TileCount = Get32(p);
+
+    bool KeyFrame = (Flags & KeyFrameFlag) != 0;
+
+    if (Magic != StreamMagic || (Flags & ~KeyFrameFlag) != 0 ||
+        Width == 0 || Height == 0 || Width > MaxDimension || Height > MaxDimension || TileSize < 8 || TileSize > 1024 ||
+        (!KeyFrame && (!m_Valid || Width != m_Width || Height != m_Height)))
+    {
+        m_Valid = false;
+        return false;
+    }
+
+    const uint32_t Columns = (Width + TileSize - 1) / TileSize;
+    const uint32_t Rows = (Height + TileSize - 1) / TileSize;
+
+    // A key frame must cover every tile and can have nothing to move
+    if (TileCount > Columns * Rows || (KeyFrame && (TileCount != Columns * Rows || MoveCount != 0)) ||
+        static_cast<uint64_t>(MoveCount) * MoveBytes + static_cast<uint64_t>(TileCount) * DirectoryEntryBytes > Size - HeaderBytes)
+    {
+        m_Valid = false;
+        return false;
+    }
+
+    const uint8_t* pMoves = p;
+    for (uint32_t i = 0; i < MoveCount; i++)
+    {
+        int32_t SourceX = static_cast<int32_t>(Get32(p));
+        int32_t SourceY = static_cast<int32_t>(Get32(p));
+        Rect Destination;
+        Destination.Left = static_cast<int32_t>(Get32(p));
+        Destination.Top = static_cast<int32_t>(Get32(p));
+        Destination.Right = static_cast<int32_t>(Get32(p));
+        Destination.Bottom = static_cast<int32_t>(Get32(p));
+
+        // Widths are checked before they are added to a source coordinate, so nothing here can overflow
+        int64_t SourceRight = static_cast<int64_t>(SourceX) + Destination.Right - Destination.Left;
+        int64_t SourceBottom = static_cast<int64_t>(SourceY) + Destination.Bottom - Destination.Top;
+        if (Destination.Empty() || Destination.Left < 0 || Destination.Top < 0 ||
+            Destination.Right > static_cast<int32_t>(Width) || Destination.Bottom > static_cast<int32_t>(Height) ||
+            SourceX < 0 || SourceY < 0 || SourceRight > Width || SourceBottom > Height)
+        {
+            m_Valid = false;
+            return false;
+        }
+    }
+
+    // Tiles in increasing order, payloads exactly filling the rest of the stream
+    const uint8_t* pDirectory = p;
+    size_t Offset = HeaderBytes + static_cast<size_t>(MoveCount) * MoveBytes + static_cast<size_t>(TileCount) * DirectoryEntryBytes;
+    uint32_t NextTile = 0;
+    m_Offsets.resize(TileCount);
+
+    for (uint32_t i = 0; i < TileCount; i++)
+    {
+        uint32_t Tile = Get32(p);
+        uint32_t TileBytes = Get32(p);
+
+        if (Tile < NextTile || Tile >= Columns * Rows || TileBytes < 1 || TileBytes > Size - Offset)
+        {
+            m_Valid = false;
+            return false;
+        }
+
+        m_Offsets[i] = Offset;
+        Offset += TileBytes;
+        NextTile = Tile + 1;
+    }
+
+    if (Offset != Size)
+    {
+        m_Valid = false;
+        return false;
+    }
+
+    // The stream is consistent: apply it
+    const size_t Pitch = static_cast<size_t>(Width) * 4;
+
+    if (KeyFrame)
+    {
+        m_Width = Width;
+        m_Height = Height;
+        m_Pixels.resize(Pitch * Height);
+    }
+
+    if (MoveCount != 0)
+    {
+        m_Previous = m_Pixels;
+
+        p = pMoves;
+        for (uint32_t i = 0; i < MoveCount; i++)
+        {
+            int32_t SourceX = static_cast<int32_t>(Get32(p));
+            int32_t SourceY = static_cast<int32_t>(Get32(p));
+            int32_t Left = static_cast<int32_t>(Get32(p));
+            int32_t Top = static_cast<int32_t>(Get32(p));
+            int32_t Right = static_cast<int32_t>(Get32(p));
+            int32_t Bottom = static_cast<int32_t>(Get32(p));
+
+            for (int32_t y = Top; y < Bottom; y++)
+            {
+                memcpy(&m_Pixels[y * Pitch + Left * 4], &m_Previous[(SourceY + y - Top) * Pitch + SourceX * 4], static_cast<size_t>(Right - Left) * 4);
+            }
+        }
+    }
+
+    atomic<bool> Failed(false);
+    auto DecodeTile = [&](uint32_t Index)
+    {
+        const uint8_t* pEntry = pDirectory + static_cast<size_t>(Index) * DirectoryEntryBytes;
+        uint32_t Tile = Get32(pEntry);
+        uint32_t TileBytes = Get32(pEntry);
+
+        uint32_t Left = (Tile % Columns) * TileSize;
+        uint32_t Top = (Tile / Columns) * TileSize;
+        uint32_t TileWidth = min(TileSize, Width - Left);
+        uint32_t TileHeight = min(TileSize, Height - Top);
+        uint8_t* pTile = &m_Pixels[Top * Pitch + static_cast<size_t>(Left) * 4];
+        const uint8_t* pPayload = pData + m_Offsets[Index];
+
+        bool Decoded;
+        if (pPayload[0] == QoiTile)
+        {
+            Decoded = DecodeQoi(pPayload + 1, TileBytes - 1, pTile, static_cast<uint32_t>(Pitch), TileWidth, TileHeight);
+        }
+        else if (pPayload[0] == RawTile && TileBytes - 1 == static_cast<size_t>(TileWidth) * TileHeight * 4)
+        {
+            for (uint32_t y = 0; y < TileHeight; y++)
+            {
+                memcpy(pTile + y * Pitch, pPayload + 1 + static_cast<size_t>(y) * TileWidth * 4, static_cast<size_t>(TileWidth) * 4);
+            }
+            Decoded = true;
+        }
+        else
+        {
+            Decoded = false;
+        }
+
+        if (!Decoded)
+        {
+            Failed.store(true, memory_order_relaxed);
+        }
+    };
+
+    if (m_Pool)
+    {
+        m_Pool->ParallelFor(TileCount, DecodeTile);
+    }
+    else
+    {
+        for (uint32_t Index = 0; Index < TileCount; Index++)
+        {
+            DecodeTile(Index);
+        }
+    }
+
+    m_Valid = !Failed.load();
+    return m_Valid;
+}
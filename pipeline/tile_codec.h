@@ -0,0 +1,124 @@
+/*++
+
+Module Name:
+
+    tile_codec.h
+
+Abstract:
+
+    This module contains a fast lossless codec for BGRA screen content. A frame is cut into square tiles that are
+    compressed independently with the QOI operations (color cache, small deltas, runs), so a worker pool can encode
+    and decode the tiles in parallel. Delta frames carry only the tiles the frame damage touches, plus its move
+    rectangles.
+
+    Stream layout, all integers little endian:
+
+        Header      Magic 'IDTQ', Width, Height (uint32), TileSize, Flags (uint16, bit 0: key frame),
+                    MoveCount, TileCount (uint32)
+        Moves       MoveCount x { SourceX, SourceY, Left, Top, Right, Bottom } (int32)
+        Directory   TileCount x { Tile, Size } (uint32), tiles in row-major order and increasing
+        Tiles       one payload per directory entry: a mode byte (0: QOI, 1: raw BGRA) and the tile data
+
+    A decoder applies the moves to the previous frame, all reading from it as it was, then replaces the tiles.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "frame.h"
+#include "frame_encoder.h"
+#include "worker_pool.h"
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Lossless tile encoder for BGRA frames.
+        /// </summary>
+        class TileEncoder : public IFrameEncoder
+        {
+        public:
+            // Without a pool, tiles are encoded on the calling thread. TileSize is clamped to [8, 1024].
+            explicit TileEncoder(std::shared_ptr<WorkerPool> Pool = nullptr, uint32_t TileSize = 64);
+
+            const char* Name() const override { return "tile-qoi"; }
+            bool Encode(const Frame& Frame, EncodedFrame& Output) override;
+            void RequestKeyFrame() override { m_NeedKeyFrame = true; }
+
+        private:
+            struct TileOutput
+            {
+                uint32_t Batch;
+                uint32_t Size;
+                size_t Offset;      // into the batch's scratch
+            };
+
+            // Tile payloads of one batch. The buffer only ever grows, so steady state never touches the allocator.
+            struct BatchScratch
+            {
+                std::vector<uint8_t> Bytes;
+                size_t Used;
+            };
+
+            void MarkTiles(const Rect& Area);
+            void EncodeBatch(const Frame& Frame, uint32_t Batch);
+            void EncodeTile(const Frame& Frame, uint32_t Index, uint32_t Batch);
+
+            std::shared_ptr<WorkerPool> m_Pool;
+            const uint32_t m_TileSize;
+
+            uint32_t m_Width;
+            uint32_t m_Height;
+            uint32_t m_Columns;
+            uint32_t m_Rows;
+            bool m_NeedKeyFrame;
+
+            std::vector<uint8_t> m_Marked;              // one flag per tile of a delta frame
+            std::vector<uint32_t> m_Tiles;              // the tiles to encode, in row-major order
+            std::vector<MoveRect> m_Moves;
+            std::vector<uint32_t> m_Batches;            // first entry of m_Tiles in each tile row that has any
+            std::vector<TileOutput> m_Outputs;          // one per entry of m_Tiles
+            std::vector<BatchScratch> m_Scratch;        // one per tile row
+            std::vector<uint8_t> m_Stream;
+        };
+
+        /// <summary>
+        /// Decoder for the TileEncoder stream. Keeps the image every frame applies to.
+        /// </summary>
+        class TileDecoder
+        {
+        public:
+            explicit TileDecoder(std::shared_ptr<WorkerPool> Pool = nullptr);
+
+            // Applies one encoded frame. A malformed stream, or a delta frame without the key frame before it, is
+            // rejected and leaves the image unusable until the next key frame.
+            bool Decode(const uint8_t* pData, size_t Size);
+
+            bool Valid() const { return m_Valid; }
+            uint32_t Width() const { return m_Width; }
+            uint32_t Height() const { return m_Height; }
+            uint32_t Pitch() const { return m_Width * 4; }
+            const uint8_t* Data() const { return m_Pixels.data(); }
+
+        private:
+            std::shared_ptr<WorkerPool> m_Pool;
+
+            uint32_t m_Width;
+            uint32_t m_Height;
+            bool m_Valid;
+            std::vector<uint8_t> m_Pixels;
+            std::vector<uint8_t> m_Previous;    // the image the moves read from
+            std::vector<size_t> m_Offsets;      // payload of each directory entry
+        };
+    }
+}
@@ -0,0 +1,233 @@
+/*++
+
+Module Name:
+
+    vsync_clock.cpp
+
+Abstract:
+
+    This module contains the virtual vsync clock.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "vsync_clock.h"
+#include "frame.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    const uint64_t NanosecondsPerSecond = 1000000000ull;
+
+    // Slack added to the timer's recent oversleep, and the most the clock ever yields through before a tick
+    const uint64_t LeadMargin = 50000;
+    const uint64_t MaxLead = 2000000;
+
+    uint64_t GreatestCommonDivisor(uint64_t A, uint64_t B)
+    {
+        while (B != 0)
+        {
+            uint64_t Remainder = A % B;
+            A = B;
+            B = Remainder;
+        }
+        return A;
+    }
+}
+
+VsyncClock::VsyncClock(uint64_t Numerator, uint64_t Denominator, uint64_t Start)
+    : m_Numerator(Numerator), m_Denominator(Denominator), m_Start(Start), m_Next(0), m_Lead(LeadMargin),
+      m_Published(0), m_Ticks(0), m_MissedTicks(0), m_LatenessSum(0), m_LatenessMax(0), m_Stop(false)
+{
+    if (m_Numerator == 0 || m_Denominator == 0)
+    {
+        m_Numerator = 60;
+        m_Denominator = 1;
+    }
+
+    // 148.5 MHz / (2200 * 1125) becomes 60 / 1
+    uint64_t Divisor = GreatestCommonDivisor(m_Numerator, m_Denominator);
+    m_Numerator /= Divisor;
+    m_Denominator /= Divisor;
+
+    m_PeriodQuotient = (m_Denominator / m_Numerator) * NanosecondsPerSecond + (m_Denominator % m_Numerator) * NanosecondsPerSecond / m_Numerator;
+    m_PeriodRemainder = (m_Denominator % m_Numerator) * NanosecondsPerSecond % m_Numerator;
+}
+
+VsyncClock::~VsyncClock()
+{
+    Stop();
+}
+
+uint64_t VsyncClock::TickTime(uint64_t Sequence) const
+{
+    // Sequence * Remainder / Numerator, split so that it cannot overflow
+    uint64_t Fraction = (Sequence / m_Numerator) * m_PeriodRemainder + (Sequence % m_Numerator) * m_PeriodRemainder / m_Numerator;
+    return m_Start + Sequence * m_PeriodQuotient + Fraction;
+}
+
+uint64_t VsyncClock::SequenceAt(uint64_t Time) const
+{
+    if (Time < m_Start)
+    {
+        return 0;
+    }
+
+    // Start from an estimate that can only be low, then step up to the exact tick
+    uint64_t Sequence = (Time - m_Start) / (m_PeriodQuotient + 1);
+    while (TickTime(Sequence + 1) <= Time)
+    {
+        Sequence++;
+    }
+    return Sequence;
+}
+
+void VsyncClock::Start()
+{
+    if (m_Thread.joinable())
+    {
+        return;
+    }
+
+    m_Next = SequenceAt(MonotonicNanoseconds()) + 1;
+    m_Stop = false;
+    m_Thread = thread(&VsyncClock::ClockThread, this);
+}
+
+void VsyncClock::Stop()
+{
+    if (!m_Thread.joinable())
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> Lock(m_Lock);
+        m_Stop = true;
+    }
+    m_Tick.notify_all();
+
+    m_Thread.join();
+}
+
+VsyncTick VsyncClock::Latest() const
+{
+    uint64_t Published = m_Published.load(memory_order_acquire);
+    if (Published == 0)
+    {
+        return { 0, 0, 0 };
+    }
+
+    return { Published - 1, TickTime(Published - 1), 0 };
+}
+
+bool VsyncClock::WaitForTick(uint64_t Sequence, uint32_t TimeoutMs, VsyncTick& Tick)
+{
+    unique_lock<mutex> Lock(m_Lock);
+    bool Ticked = m_Tick.wait_for(Lock, chrono::milliseconds(TimeoutMs), [&]
+    {
+        return m_Published.load(memory_order_acquire) > Sequence + 1 || m_Stop;
+    });
+
+    if (!Ticked || m_Published.load(memory_order_acquire) <= Sequence + 1)
+    {
+        return false;
+    }
+
+    Tick = Latest();
+    return true;
+}
+
+uint64_t VsyncClock::NextWakeTime() const
+{
+    uint64_t Target = TickTime(m_Next);
+    return Target - min(m_Lead.load(memory_order_relaxed), Target);
+}
+
+VsyncTick VsyncClock::Publish(uint64_t Fired, uint64_t Now)
+{
+    uint64_t Target = TickTime(m_Next);
+    uint64_t Lead = m_Lead.load(memory_order_relaxed);
+    uint64_t Wake = Target - min(Lead, Target);
+    uint64_t Oversleep = Fired > Wake ? Fired - Wake : 0;
+
+    // Follow a timer that got later at once, and one that got more punctual slowly
+    Lead = min(max(Oversleep + LeadMargin, Lead - Lead / 16), min(MaxLead, m_PeriodQuotient / 4));
+    m_Lead.store(Lead, memory_order_relaxed);
+
+    // Publishing a tick a whole period late would make it indistinguishable from the next one
+    Now = max(Now, Target);
+    if (Now - Target >= m_PeriodQuotient)
+    {
+        uint64_t Current = SequenceAt(Now);
+        m_MissedTicks.fetch_add(Current - m_Next, memory_order_relaxed);
+        m_Next = Current;
+        Target = TickTime(Current);
+    }
+
+    VsyncTick Tick = { m_Next, Target, Now - Target };
+
+    m_Ticks.fetch_add(1, memory_order_relaxed);
+    m_LatenessSum.fetch_add(Tick.Lateness, memory_order_relaxed);
+    if (Tick.Lateness > m_LatenessMax.load(memory_order_relaxed))
+    {
+        m_LatenessMax.store(Tick.Lateness, memory_order_relaxed);
+    }
+
+    m_Published.store(m_Next + 1, memory_order_release);
+    m_Next++;
+
+    {
+        lock_guard<mutex> Lock(m_Lock);
+    }
+    m_Tick.notify_all();
+
+    return Tick;
+}
+
+VsyncStatistics VsyncClock::Statistics() const
+{
+    VsyncStatistics Statistics = {};
+    Statistics.Ticks = m_Ticks.load(memory_order_relaxed);
+    Statistics.MissedTicks = m_MissedTicks.load(memory_order_relaxed);
+    Statistics.LatenessSum = m_LatenessSum.load(memory_order_relaxed);
+    Statistics.LatenessMax = m_LatenessMax.load(memory_order_relaxed);
+    Statistics.Lead = m_Lead.load(memory_order_relaxed);
+    return Statistics;
+}
+
+void VsyncClock::ClockThread()
+{
+    for (;;)
+    {
+        auto Wake = chrono::steady_clock::time_point(chrono::duration_cast<chrono::steady_clock::duration>(chrono::nanoseconds(NextWakeTime())));
+
+        {
+            unique_lock<mutex> Lock(m_Lock);
+            if (m_Tick.wait_until(Lock, Wake, [this] { return m_Stop; }))
+            {
+                return;
+            }
+        }
+
+        // The timer cannot hit the tick exactly; yield through what is left of the lead
+        uint64_t Fired = MonotonicNanoseconds();
+        uint64_t Target = TickTime(m_Next);
+        uint64_t Now = Fired;
+        while (Now < Target)
+        {
+            this_thread::yield();
+            Now = MonotonicNanoseconds();
+        }
+
+        Publish(Fired, Now);
+    }
+}
@@ -0,0 +1,128 @@
+/*++
+
+Module Name:
+
+    vsync_clock.h
+
+Abstract:
+
+    This module contains the virtual vsync clock of a monitor that has no scan-out of its own. Tick N is due at
+    exactly Start + N / RefreshRate, computed from the mode's fractional refresh rate with integer arithmetic, so
+    rounding the period never accumulates into drift. The clock thread sleeps until a little before each tick and
+    yields through the rest; the lead it sleeps short by follows how late the timer has recently been, so a timer
+    that oversleeps does not make every tick late. A tick the thread could not make in time is skipped rather than
+    published late.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// One published vsync.
+        /// </summary>
+        struct VsyncTick
+        {
+            uint64_t Sequence;  // ticks since the clock started
+            uint64_t Time;      // when the tick was due on the monotonic clock [ns]
+            uint64_t Lateness;  // how long after Time it was published [ns]; only filled in by Publish
+        };
+
+        /// <summary>
+        /// Counters maintained by the clock thread.
+        /// </summary>
+        struct VsyncStatistics
+        {
+            uint64_t Ticks;             // published
+            uint64_t MissedTicks;       // skipped because the thread woke up a whole period late or more
+            uint64_t LatenessSum;       // [ns]
+            uint64_t LatenessMax;       // [ns]
+            uint64_t Lead;              // how early the timer is currently set before each tick [ns]
+        };
+
+        /// <summary>
+        /// Generates vsync ticks at a fractional refresh rate.
+        /// </summary>
+        class VsyncClock
+        {
+        public:
+            // The refresh rate is Numerator / Denominator Hz, e.g. the vSyncFreq of a DISPLAYCONFIG_VIDEO_SIGNAL_INFO;
+            // 0 means 60 Hz. Tick 0 is due at Start.
+            VsyncClock(uint64_t Numerator, uint64_t Denominator, uint64_t Start);
+            ~VsyncClock();
+
+            VsyncClock(const VsyncClock&) = delete;
+            VsyncClock& operator=(const VsyncClock&) = delete;
+
+            uint64_t Numerator() const { return m_Numerator; }
+            uint64_t Denominator() const { return m_Denominator; }
+
+            // Period rounded down to whole nanoseconds; the ticks themselves never round
+            uint64_t Period() const { return m_PeriodQuotient; }
+
+            // When tick Sequence is due [ns]
+            uint64_t TickTime(uint64_t Sequence) const;
+
+            // The last tick due at or before Time, 0 before the clock started
+            uint64_t SequenceAt(uint64_t Time) const;
+
+            // Starts and stops the thread that publishes the ticks
+            void Start();
+            void Stop();
+
+            // The last tick the thread published; Sequence and Time are 0 until the first one
+            VsyncTick Latest() const;
+
+            // Blocks until a tick after Sequence is published or TimeoutMs elapse; false on timeout or Stop
+            bool WaitForTick(uint64_t Sequence, uint32_t TimeoutMs, VsyncTick& Tick);
+
+            // The scheduling steps of the clock thread, which a simulation can drive on a virtual clock: set a timer
+            // for NextWakeTime, and once it fires at Fired, hold off until NextTickTime and call Publish with both
+            // times. Publish returns the tick it published.
+            uint64_t NextWakeTime() const;
+            uint64_t NextTickTime() const { return TickTime(m_Next); }
+            VsyncTick Publish(uint64_t Fired, uint64_t Now);
+
+            VsyncStatistics Statistics() const;
+
+        private:
+            void ClockThread();
+
+            uint64_t m_Numerator;
+            uint64_t m_Denominator;
+            uint64_t m_Start;
+
+            // 1e9 * Denominator / Numerator as quotient and remainder, so TickTime never overflows
+            uint64_t m_PeriodQuotient;
+            uint64_t m_PeriodRemainder;
+
+            // Scheduling state, owned by whoever calls NextWakeTime and Publish
+            uint64_t m_Next;                        // sequence of the next tick to publish
+            std::atomic<uint64_t> m_Lead;
+
+            std::atomic<uint64_t> m_Published;      // sequence of the latest tick plus one, 0 before the first
+            std::atomic<uint64_t> m_Ticks;
+            std::atomic<uint64_t> m_MissedTicks;
+            std::atomic<uint64_t> m_LatenessSum;
+            std::atomic<uint64_t> m_LatenessMax;
+
+            std::thread m_Thread;
+            std::mutex m_Lock;
+            std::condition_variable m_Tick;     // notified on every tick and on Stop
+            bool m_Stop;
+        };
+    }
+}
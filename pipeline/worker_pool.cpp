@@ -0,0 +1,402 @@
+/*++
+
+Module Name:
+
+    worker_pool.cpp
+
+Abstract:
+
+    This module contains the work-stealing pool. The deques are short and only contended when a thread steals, so
+    each one is guarded by its own lock rather than being lock-free.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace Microsoft::IndirectDisp;
+
+namespace
+{
+    // Searches an idle thread makes before it goes to sleep
+    const int IdleSpins = 64;
+
+    // The pool and deque of the pool thread running on this thread, if any
+    thread_local const WorkerPool* t_pPool = nullptr;
+    thread_local uint32_t t_WorkerIndex = 0;
+
+    uint64_t Nanoseconds()
+    {
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
+
+WorkerPool::WorkerPool(uint32_t ThreadCount)
+    : m_ExternalExecuted(0), m_ExternalStolen(0), m_Queued(0), m_MaxQueued(0), m_Sleeping(0), m_Stop(false)
+{
+    ThreadCount = max(ThreadCount, 1u);
+
+    for (uint32_t i = 0; i < ThreadCount; i++)
+    {
+        unique_ptr<Worker> pWorker(new Worker);
+        pWorker->Executed = 0;
+        pWorker->Stolen = 0;
+        pWorker->IdleNanoseconds = 0;
+        m_Workers.push_back(move(pWorker));
+    }
+
+    // Start the threads only once every deque exists, since they steal from each other right away
+    for (uint32_t i = 0; i < ThreadCount; i++)
+    {
+        m_Workers[i]->Thread = thread(&WorkerPool::WorkerThread, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> Lock(m_SleepLock);
+        m_Stop = true;
+    }
+    m_Wake.notify_all();
+
+    for (auto& pWorker : m_Workers)
+    {
+        pWorker->Thread.join();
+    }
+}
+
+uint32_t WorkerPool::DefaultThreadCount()
+{
+    return max(thread::hardware_concurrency(), 1u);
+}
+
+shared_ptr<WorkerPool> WorkerPool::Shared()
+{
+    static mutex Lock;
+    static weak_ptr<WorkerPool> Instance;
+
+    lock_guard<mutex> Guard(Lock);
+    shared_ptr<WorkerPool> Pool = Instance.lock();
+    if (!Pool)
+    {
+        Pool = make_shared<WorkerPool>();
+        Instance = Pool;
+    }
+    return Pool;
+}
+
+WorkerPool::Worker* WorkerPool::CurrentWorker() const
+{
+    return t_pPool == this ? m_Workers[t_WorkerIndex].get() : nullptr;
+}
+
+void WorkerPool::Fork(TaskGroup& Group, Task Body)
+{
+    Group.m_Pending.fetch_add(1, memory_order_relaxed);
+
+    // Count the task before it becomes visible, so the count never drops below zero when it is stolen at once
+    uint32_t Depth = m_Queued.fetch_add(1) + 1;
+    uint32_t Max = m_MaxQueued.load(memory_order_relaxed);
+    while (Depth > Max && !m_MaxQueued.compare_exchange_weak(Max, Depth, memory_order_relaxed))
+    {
+    }
+
+    Worker* pSelf = CurrentWorker();
+    if (pSelf)
+    {
+        lock_guard<mutex> Lock(pSelf->Lock);
+        pSelf->Tasks.push_back({ move(Body), &Group });
+    }
+    else
+    {
+        lock_guard<mutex> Lock(m_InjectLock);
+        m_Injected.push_back({ move(Body), &Group });
+    }
+
+    // Pairs with the waiter, which registers in m_Waiting before it checks m_Forked
+    Group.m_Forked.fetch_add(1);
+    if (Group.m_Waiting.load())
+    {
+        lock_guard<mutex> Lock(Group.m_Lock);
+        Group.m_Changed.notify_all();
+    }
+
+    // Pairs with the sleeper, which registers in m_Sleeping before it checks m_Queued
+    if (m_Sleeping.load() != 0)
+    {
+        lock_guard<mutex> Lock(m_SleepLock);
+        m_Wake.notify_one();
+    }
+}
+
+void WorkerPool::Wait(TaskGroup& Group)
+{
+    Worker* pSelf = CurrentWorker();
+
+    for (;;)
+    {
+        // Only tasks of the group, so unrelated work never holds the waiter up
+        uint32_t Forked = Group.m_Forked.load();
+        QueuedTask Task;
+        if (FindGroupTask(pSelf, Group, Task))
+        {
+            Execute(pSelf, Task);
+            continue;
+        }
+
+        // The rest of the group runs on other threads. Returning only under the lock keeps the group alive until
+        // the last task has signalled it.
+        unique_lock<mutex> Lock(Group.m_Lock);
+        Group.m_Waiting.store(true);
+        Group.m_Changed.wait(Lock, [&] { return Group.m_Pending.load() == 0 || Group.m_Forked.load() != Forked; });
+        Group.m_Waiting.store(false);
+        if (Group.m_Pending.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+void WorkerPool::ParallelFor(uint32_t Count, const function<void(uint32_t)>& Body)
+{
+    uint32_t Helpers = Count != 0 ? min(Count - 1, ThreadCount()) : 0;
+
+    atomic<uint32_t> Next(0);
+    auto Run = [&]
+    {
+        for (uint32_t Index; (Index = Next.fetch_add(1, memory_order_relaxed)) < Count;)
+        {
+            Body(Index);
+        }
+    };
+
+    // Helpers that start after the indices ran out return at once
+    TaskGroup Group;
+    for (uint32_t i = 0; i < Helpers; i++)
+    {
+        Fork(Group, Run);
+    }
+
+    Run();
+    Wait(Group);
+}
+
+WorkerPoolStatistics WorkerPool::Statistics() const
+{
+    WorkerPoolStatistics Statistics = {};
+    Statistics.Threads = ThreadCount();
+    Statistics.TasksExecuted = m_ExternalExecuted.load(memory_order_relaxed);
+    Statistics.TasksStolen = m_ExternalStolen.load(memory_order_relaxed);
+    Statistics.QueueDepth = m_Queued.load(memory_order_relaxed);
+    Statistics.MaxQueueDepth = m_MaxQueued.load(memory_order_relaxed);
+
+    for (const auto& pWorker : m_Workers)
+    {
+        Statistics.TasksExecuted += pWorker->Executed.load(memory_order_relaxed);
+        Statistics.TasksStolen += pWorker->Stolen.load(memory_order_relaxed);
+        Statistics.IdleNanoseconds += pWorker->IdleNanoseconds.load(memory_order_relaxed);
+    }
+
+    return Statistics;
+}
+
+void WorkerPool::WorkerThread(uint32_t Index)
+{
+    t_pPool = this;
+    t_WorkerIndex = Index;
+
+    Worker* pSelf = m_Workers[Index].get();
+    uint32_t Victim = Index + 1;
+
+    for (;;)
+    {
+        QueuedTask Task;
+        if (FindTask(pSelf, Victim, Task))
+        {
+            Execute(pSelf, Task);
+            continue;
+        }
+
+        // Nothing to do: look a few more times, then sleep until a task is forked
+        uint64_t IdleStart = Nanoseconds();
+        bool Found = false;
+
+        for (int Spin = 0; Spin < IdleSpins && !Found; Spin++)
+        {
+            this_thread::yield();
+            Found = FindTask(pSelf, Victim, Task);
+        }
+
+        if (!Found)
+        {
+            unique_lock<mutex> Lock(m_SleepLock);
+            m_Sleeping++;
+            m_Wake.wait(Lock, [this] { return m_Queued.load() != 0 || m_Stop; });
+            m_Sleeping--;
+        }
+
+        pSelf->IdleNanoseconds.fetch_add(Nanoseconds() - IdleStart, memory_order_relaxed);
+
+        if (Found)
+        {
+            Execute(pSelf, Task);
+        }
+        else if (m_Stop && m_Queued.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool WorkerPool::FindTask(Worker* pSelf, uint32_t& Victim, QueuedTask& Task)
+{
+    if (m_Queued.load(memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+
+    // Newest own task first, then the oldest of everybody else's
+    if (pSelf)
+    {
+        lock_guard<mutex> Lock(pSelf->Lock);
+        if (!pSelf->Tasks.empty())
+        {
+            Task = move(pSelf->Tasks.back());
+            pSelf->Tasks.pop_back();
+            m_Queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    {
+        lock_guard<mutex> Lock(m_InjectLock);
+        if (!m_Injected.empty())
+        {
+            Task = move(m_Injected.front());
+            m_Injected.pop_front();
+            m_Queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    const uint32_t Count = ThreadCount();
+    for (uint32_t i = 0; i < Count; i++)
+    {
+        Worker* pVictim = m_Workers[(Victim + i) % Count].get();
+        if (pVictim == pSelf)
+        {
+            continue;
+        }
+
+        lock_guard<mutex> Lock(pVictim->Lock);
+        if (!pVictim->Tasks.empty())
+        {
+            Task = move(pVictim->Tasks.front());
+            pVictim->Tasks.pop_front();
+            m_Queued.fetch_sub(1);
+
+            // Come back to the same victim first: it likely forked more than one task
+            Victim = (Victim + i) % Count;
+            (pSelf ? pSelf->Stolen : m_ExternalStolen).fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WorkerPool::FindGroupTask(Worker* pSelf, const TaskGroup& Group, QueuedTask& Task)
+{
+    if (m_Queued.load(memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+
+    // Newest first from the own deque, oldest first from the others, as FindTask takes them
+    auto Take = [&](deque<QueuedTask>& Tasks, bool Newest)
+    {
+        for (size_t i = 0; i < Tasks.size(); i++)
+        {
+            auto It = Newest ? Tasks.begin() + (Tasks.size() - 1 - i) : Tasks.begin() + i;
+            if (It->pGroup == &Group)
+            {
+                Task = move(*It);
+                Tasks.erase(It);
+                m_Queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    };
+
+    if (pSelf)
+    {
+        lock_guard<mutex> Lock(pSelf->Lock);
+        if (Take(pSelf->Tasks, true))
+        {
+            return true;
+        }
+    }
+
+    {
+        lock_guard<mutex> Lock(m_InjectLock);
+        if (Take(m_Injected, false))
+        {
+            return true;
+        }
+    }
+
+    for (auto& pVictim : m_Workers)
+    {
+        if (pVictim.get() == pSelf)
+        {
+            continue;
+        }
+
+        lock_guard<mutex> Lock(pVictim->Lock);
+        if (Take(pVictim->Tasks, false))
+        {
+            (pSelf ? pSelf->Stolen : m_ExternalStolen).fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkerPool::Execute(Worker* pSelf, QueuedTask& Task)
+{
+    Task.Body();
+
+    // Release whatever the task captured before its group can complete
+    Task.Body = nullptr;
+    (pSelf ? pSelf->Executed : m_ExternalExecuted).fetch_add(1, memory_order_relaxed);
+
+    if (!Task.pGroup)
+    {
+        return;
+    }
+
+    // All but the last task leave the group without touching it again. The last one counts down under the lock,
+    // since the waiter may destroy the group as soon as it sees the count reach zero.
+    TaskGroup& Group = *Task.pGroup;
+    uint32_t Pending = Group.m_Pending.load(memory_order_relaxed);
+    while (Pending > 1 && !Group.m_Pending.compare_exchange_weak(Pending, Pending - 1, memory_order_release, memory_order_relaxed))
+    {
+    }
+
+    if (Pending == 1)
+    {
+        lock_guard<mutex> Lock(Group.m_Lock);
+        Group.m_Pending.fetch_sub(1, memory_order_release);
+        Group.m_Changed.notify_all();
+    }
+}
@@ -0,0 +1,152 @@
+/*++
+
+Module Name:
+
+    worker_pool.h
+
+Abstract:
+
+    This module contains the work-stealing thread pool that the frame processors of every monitor share. Each pool
+    thread owns a deque: it pushes and pops its own tasks at the back, so forked work stays hot in its cache, while
+    idle threads steal from the front of the others. Threads outside the pool submit through a shared queue. A
+    thread waiting for a group of tasks runs the queued tasks of that group meanwhile, so tasks can fork and wait
+    for tasks of their own without tying up a thread, then sleeps until the ones running elsewhere finish.
+
+Environment:
+
+    User Mode, portable C++17
+
+--*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Microsoft
+{
+    namespace IndirectDisp
+    {
+        /// <summary>
+        /// Counts the unfinished tasks forked into it, so whoever forked them can wait for them.
+        /// </summary>
+        class TaskGroup
+        {
+        public:
+            TaskGroup() : m_Pending(0), m_Forked(0), m_Waiting(false) {}
+
+            TaskGroup(const TaskGroup&) = delete;
+            TaskGroup& operator=(const TaskGroup&) = delete;
+
+            bool Done() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+
+        private:
+            friend class WorkerPool;
+
+            std::atomic<uint32_t> m_Pending;
+
+            // The waiter sleeps here until the last task finishes or another task is forked into the group
+            std::mutex m_Lock;
+            std::condition_variable m_Changed;
+            std::atomic<uint32_t> m_Forked;
+            std::atomic<bool> m_Waiting;
+        };
+
+        /// <summary>
+        /// Snapshot of a pool's counters, summed over its threads.
+        /// </summary>
+        struct WorkerPoolStatistics
+        {
+            uint32_t Threads;
+            uint64_t TasksExecuted;     // by pool threads and by threads helping while they wait
+            uint64_t TasksStolen;       // taken from the deque of another thread
+            uint64_t IdleNanoseconds;   // pool threads searching for work or asleep
+            uint32_t QueueDepth;        // tasks queued right now
+            uint32_t MaxQueueDepth;     // most tasks ever queued at once
+        };
+
+        /// <summary>
+        /// A work-stealing pool of threads running forked tasks.
+        /// </summary>
+        class WorkerPool
+        {
+        public:
+            typedef std::function<void()> Task;
+
+            explicit WorkerPool(uint32_t ThreadCount = DefaultThreadCount());
+            ~WorkerPool();
+
+            WorkerPool(const WorkerPool&) = delete;
+            WorkerPool& operator=(const WorkerPool&) = delete;
+
+            // One thread per hardware thread, at least one
+            static uint32_t DefaultThreadCount();
+
+            // The pool of the process, created on first use and destroyed with its last reference
+            static std::shared_ptr<WorkerPool> Shared();
+
+            uint32_t ThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+
+            // Queues Body as part of Group. A pool thread queues it on its own deque, where it runs next unless
+            // another thread steals it first.
+            void Fork(TaskGroup& Group, Task Body);
+
+            // Returns once every task of Group has finished, running the queued tasks of Group meanwhile and
+            // sleeping while none is left to run
+            void Wait(TaskGroup& Group);
+
+            // Calls Body(Index) for every Index in [0, Count) on the calling thread and on whichever pool threads
+            // are free, and returns once all calls have returned. Indices are handed out one at a time, so uneven
+            // iterations balance themselves.
+            void ParallelFor(uint32_t Count, const std::function<void(uint32_t)>& Body);
+
+            WorkerPoolStatistics Statistics() const;
+
+        private:
+            struct QueuedTask
+            {
+                Task Body;
+                TaskGroup* pGroup;
+            };
+
+            struct alignas(64) Worker
+            {
+                std::mutex Lock;
+                std::deque<QueuedTask> Tasks;       // owner at the back, thieves at the front
+                std::atomic<uint64_t> Executed;
+                std::atomic<uint64_t> Stolen;
+                std::atomic<uint64_t> IdleNanoseconds;
+                std::thread Thread;
+            };
+
+            void WorkerThread(uint32_t Index);
+            bool FindTask(Worker* pSelf, uint32_t& Victim, QueuedTask& Task);
+            bool FindGroupTask(Worker* pSelf, const TaskGroup& Group, QueuedTask& Task);
+            void Execute(Worker* pSelf, QueuedTask& Task);
+            Worker* CurrentWorker() const;
+
+            std::vector<std::unique_ptr<Worker>> m_Workers;
+
+            std::mutex m_InjectLock;
+            std::deque<QueuedTask> m_Injected;      // tasks forked by threads outside the pool
+            std::atomic<uint64_t> m_ExternalExecuted;
+            std::atomic<uint64_t> m_ExternalStolen;
+
+            std::atomic<uint32_t> m_Queued;
+            std::atomic<uint32_t> m_MaxQueued;
+
+            // Idle threads sleep here; forking wakes one only if some thread is asleep
+            std::mutex m_SleepLock;
+            std::condition_variable m_Wake;
+            std::atomic<uint32_t> m_Sleeping;
+            std::atomic<bool> m_Stop;
+        };
+    }
+}